@@ -330,6 +330,7 @@
 330 stdcall NtReleaseMutant(long ptr)
 331 stdcall NtReleaseSemaphore(long long ptr)
 332 stdcall NtRemoveIoCompletion(ptr ptr ptr ptr ptr)
+@ stdcall NtRemoveIoCompletionEx(ptr ptr long ptr ptr long) ; 6.0 and higher
 333 stdcall NtRemoveProcessDebug(ptr ptr)
 334 stdcall NtRenameKey(ptr ptr)
 335 stdcall NtReplaceKey(ptr long ptr)
@@ -1175,6 +1176,7 @@
 1167 stdcall ZwReleaseMutant(long ptr) NtReleaseMutant
 1168 stdcall ZwReleaseSemaphore(long long ptr) NtReleaseSemaphore
 1169 stdcall ZwRemoveIoCompletion(ptr ptr ptr ptr ptr) NtRemoveIoCompletion
+@ stdcall ZwRemoveIoCompletionEx(ptr ptr long ptr ptr long) NtRemoveIoCompletionEx ; 6.0 and higher
 1170 stdcall ZwRemoveProcessDebug(ptr ptr) NtRemoveProcessDebug
 1171 stdcall ZwRenameKey(ptr ptr) NtRenameKey
 1172 stdcall ZwReplaceKey(ptr long ptr) NtReplaceKey
@@ -124,7 +124,8 @@ void BtrfsPropSheet::do_search(WCHAR* fn) {
                         sizes[1] += bii2.disk_size[0];
                         sizes[2] += bii2.disk_size[1];
                         sizes[3] += bii2.disk_size[2];
-                        totalsize += bii2.inline_length + bii2.disk_size[0] + bii2.disk_size[1] + bii2.disk_size[2];
+                        sizes[4] += bii2.disk_size[3];
+                        totalsize += bii2.inline_length + bii2.disk_size[0] + bii2.disk_size[1] + bii2.disk_size[2] + bii2.disk_size[3];
                     }
 
                     CloseHandle(fh);
@@ -226,7 +227,7 @@ HRESULT BtrfsPropSheet::check_file(std::wstring fn, UINT i, UINT num_files, UINT
             sizes[0] += bii2.inline_length;
         }
 
-        for (j = 0; j < 3; j++) {
+        for (j = 0; j < 4; j++) {
             if (bii2.disk_size[j] > 0) {
                 totalsize += bii2.disk_size[j];
                 sizes[j + 1] += bii2.disk_size[j];
@@ -288,7 +289,7 @@ HRESULT BtrfsPropSheet::load_file_list() {
     can_change_perms = TRUE;
     can_change_nocow = TRUE;
 
-    sizes[0] = sizes[1] = sizes[2] = sizes[3] = 0;
+    sizes[0] = sizes[1] = sizes[2] = sizes[3] = sizes[4] = 0;
 
     for (i = 0; i < num_files; i++) {
         if (DragQueryFileW((HDROP)stgm.hGlobal, i, fn, sizeof(fn) / sizeof(MAX_PATH))) {
@@ -414,7 +415,7 @@ void BtrfsPropSheet::set_cmdline(std::wstring cmdline) {
             sizes[0] += bii2.inline_length;
         }
 
-        for (j = 0; j < 3; j++) {
+        for (j = 0; j < 4; j++) {
             if (bii2.disk_size[j] > 0) {
                 totalsize += bii2.disk_size[j];
                 sizes[j + 1] += bii2.disk_size[j];
@@ -704,9 +705,9 @@ void BtrfsPropSheet::change_gid(HWND hDlg, UINT32 gid) {
 void BtrfsPropSheet::update_size_details_dialog(HWND hDlg) {
     WCHAR size[1024], old_text[1024];
     int i;
-    ULONG items[] = { IDC_SIZE_INLINE, IDC_SIZE_UNCOMPRESSED, IDC_SIZE_ZLIB, IDC_SIZE_LZO };
+    ULONG items[] = { IDC_SIZE_INLINE, IDC_SIZE_UNCOMPRESSED, IDC_SIZE_ZLIB, IDC_SIZE_LZO, IDC_SIZE_ZSTD };
 
-    for (i = 0; i < 4; i++) {
+    for (i = 0; i < 5; i++) {
         format_size(sizes[i], size, sizeof(size) / sizeof(WCHAR), TRUE);
 
         GetDlgItemTextW(hDlg, items[i], old_text, sizeof(old_text) / sizeof(WCHAR));
@@ -319,6 +319,7 @@
 #define IDC_RESIZE_CURSIZE              1071
 #define IDC_RESIZE_SLIDER               1072
 #define IDC_RESIZE_NEWSIZE              1073
+#define IDC_SIZE_ZSTD                   1074
 
 // Next default values for new objects
 // 
@@ -326,7 +327,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        173
 #define _APS_NEXT_COMMAND_VALUE         40001
-#define _APS_NEXT_CONTROL_VALUE         1073
+#define _APS_NEXT_CONTROL_VALUE         1075
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -26,6 +26,8 @@
 #else
 #include <intrin.h>
 #endif
+#elif defined(_X86_) || defined(_AMD64_)
+#include <intrin.h>
 #endif
 #include <ntddscsi.h>
 #include "btrfs.h"
@@ -48,7 +50,8 @@
 
 #define INCOMPAT_SUPPORTED (BTRFS_INCOMPAT_FLAGS_MIXED_BACKREF | BTRFS_INCOMPAT_FLAGS_DEFAULT_SUBVOL | BTRFS_INCOMPAT_FLAGS_MIXED_GROUPS | \
                             BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO | BTRFS_INCOMPAT_FLAGS_BIG_METADATA | BTRFS_INCOMPAT_FLAGS_RAID56 | \
-                            BTRFS_INCOMPAT_FLAGS_EXTENDED_IREF | BTRFS_INCOMPAT_FLAGS_SKINNY_METADATA | BTRFS_INCOMPAT_FLAGS_NO_HOLES)
+                            BTRFS_INCOMPAT_FLAGS_EXTENDED_IREF | BTRFS_INCOMPAT_FLAGS_SKINNY_METADATA | BTRFS_INCOMPAT_FLAGS_NO_HOLES | \
+                            BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD)
 #define COMPAT_RO_SUPPORTED (BTRFS_COMPAT_RO_FLAGS_FREE_SPACE_CACHE | BTRFS_COMPAT_RO_FLAGS_FREE_SPACE_CACHE_VALID)
 
 static WCHAR device_name[] = {'\\','B','t','r','f','s',0};
@@ -58,9 +61,7 @@ DEFINE_GUID(BtrfsBusInterface, 0x4d414874, 0x6865, 0x6761, 0x6d, 0x65, 0x83, 0x6
 
 PDRIVER_OBJECT drvobj;
 PDEVICE_OBJECT master_devobj;
-#ifndef __REACTOS__
 BOOL have_sse42 = FALSE, have_sse2 = FALSE;
-#endif
 UINT64 num_reads = 0;
 LIST_ENTRY uid_map_list, gid_map_list;
 LIST_ENTRY VcbList;
@@ -70,6 +71,7 @@ UINT32 mount_compress = 0;
 UINT32 mount_compress_force = 0;
 UINT32 mount_compress_type = 0;
 UINT32 mount_zlib_level = 3;
+UINT32 mount_zstd_level = 3;
 UINT32 mount_flush_interval = 30;
 UINT32 mount_max_inline = 2048;
 UINT32 mount_skip_balance = 0;
@@ -5157,10 +5159,14 @@ static void init_serial(BOOL first_time) {
 }
 #endif
 
-#ifndef __REACTOS__
+#if !defined(__REACTOS__) || defined(_X86_) || defined(_AMD64_)
 static void check_cpu() {
     unsigned int cpuInfo[4];
-#ifndef _MSC_VER
+#ifdef __REACTOS__
+    __cpuid((int*)cpuInfo, 1);
+    have_sse42 = cpuInfo[2] & (1 << 20);
+    have_sse2 = cpuInfo[3] & (1 << 26);
+#elif !defined(_MSC_VER)
     __get_cpuid(1, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]);
     have_sse42 = cpuInfo[2] & bit_SSE4_2;
     have_sse2 = cpuInfo[3] & bit_SSE2;
@@ -5179,6 +5185,8 @@ static void check_cpu() {
         TRACE("SSE2 is supported\n");
     else
         TRACE("SSE2 is not supported\n");
+
+    init_crc32c();
 }
 #endif
 
@@ -5451,7 +5459,7 @@ NTSTATUS DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_STRING Regi
 
     TRACE("DriverEntry\n");
 
-#ifndef __REACTOS__
+#if !defined(__REACTOS__) || defined(_X86_) || defined(_AMD64_)
     check_cpu();
 #endif
 
@@ -84,6 +84,7 @@
 
 #define ALLOC_TAG 0x7442484D //'MHBt'
 #define ALLOC_TAG_ZLIB 0x7A42484D //'MHBz'
+#define ALLOC_TAG_ZSTD 0x7342484D //'MHBs'
 
 #define UID_NOBODY 65534
 #define GID_NOBODY 65534
@@ -234,7 +235,8 @@ typedef struct {
 enum prop_compression_type {
     PropCompression_None,
     PropCompression_Zlib,
-    PropCompression_LZO
+    PropCompression_LZO,
+    PropCompression_ZSTD
 };
 
 typedef struct {
@@ -578,6 +580,8 @@ typedef struct {
     UINT8* data;
     UINT32* csum;
     UINT32 sectors;
+    UINT32 block_size;
+    LONG blocks;
     LONG pos, done;
     KEVENT event;
     LONG refcount;
@@ -606,6 +610,7 @@ typedef struct {
     UINT8 compress_type;
     BOOL readonly;
     UINT32 zlib_level;
+    UINT32 zstd_level;
     UINT32 flush_interval;
     UINT32 max_inline;
     UINT64 subvol_id;
@@ -1123,6 +1128,7 @@ extern UINT32 mount_compress;
 extern UINT32 mount_compress_force;
 extern UINT32 mount_compress_type;
 extern UINT32 mount_zlib_level;
+extern UINT32 mount_zstd_level;
 extern UINT32 mount_flush_interval;
 extern UINT32 mount_max_inline;
 extern UINT32 mount_skip_balance;
@@ -1180,6 +1186,7 @@ void _free_fcb(_Requires_exclusive_lock_held_(_Curr_->fcb_lock) _In_ device_exte
 void init_fast_io_dispatch(FAST_IO_DISPATCH** fiod);
 
 // in crc32c.c
+void init_crc32c();
 UINT32 calc_crc32c(_In_ UINT32 seed, _In_reads_bytes_(msglen) UINT8* msg, _In_ ULONG msglen);
 
 typedef struct {
@@ -1481,6 +1488,10 @@ NTSTATUS zlib_decompress(UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outle
 NTSTATUS lzo_decompress(UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen, UINT32 inpageoff);
 NTSTATUS write_compressed_bit(fcb* fcb, UINT64 start_data, UINT64 end_data, void* data, BOOL* compressed, PIRP Irp, LIST_ENTRY* rollback);
 
+// in zstd.c
+NTSTATUS zstd_decompress(UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen);
+NTSTATUS zstd_compress(const UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen, UINT32 level, UINT32* complen);
+
 // in galois.c
 void galois_double(UINT8* data, UINT32 len);
 void galois_divpower(UINT8* data, UINT8 div, UINT32 readlen);
@@ -1504,6 +1515,7 @@ void calc_thread(void* context);
 #endif
 
 NTSTATUS add_calc_job(device_extension* Vcb, UINT8* data, UINT32 sectors, UINT32* csum, calc_job** pcj);
+void wait_calc_job(device_extension* Vcb, calc_job* cj);
 void free_calc_job(calc_job* cj);
 
 // in balance.c
@@ -31,6 +31,11 @@ NTSTATUS add_calc_job(device_extension* Vcb, UINT8* data, UINT32 sectors, UINT32
     cj->data = data;
     cj->sectors = sectors;
     cj->csum = csum;
+
+    // Split the job so that every calc thread, as well as the thread waiting for it, gets a share
+    cj->block_size = min(SECTOR_BLOCK, (sectors + Vcb->calcthreads.num_threads) / (Vcb->calcthreads.num_threads + 1));
+    cj->blocks = (sectors + cj->block_size - 1) / cj->block_size;
+
     cj->pos = 0;
     cj->done = 0;
     cj->refcount = 1;
@@ -63,13 +68,21 @@ static BOOL do_calc(device_extension* Vcb, calc_job* cj) {
 
     pos = InterlockedIncrement(&cj->pos) - 1;
 
-    if ((UINT32)pos * SECTOR_BLOCK >= cj->sectors)
+    if (pos >= cj->blocks)
         return FALSE;
 
-    csum = &cj->csum[pos * SECTOR_BLOCK];
-    data = cj->data + (pos * SECTOR_BLOCK * Vcb->superblock.sector_size);
+    // Whoever takes the last block takes the job off the queue, so that the
+    // other threads can move on to the next one straight away.
+    if (pos == cj->blocks - 1) {
+        ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, TRUE);
+        RemoveEntryList(&cj->list_entry);
+        ExReleaseResourceLite(&Vcb->calcthreads.lock);
+    }
+
+    csum = &cj->csum[pos * cj->block_size];
+    data = cj->data + (pos * cj->block_size * Vcb->superblock.sector_size);
 
-    blocksize = min(SECTOR_BLOCK, cj->sectors - (pos * SECTOR_BLOCK));
+    blocksize = min(cj->block_size, cj->sectors - (pos * cj->block_size));
     for (i = 0; i < blocksize; i++) {
         *csum = ~calc_crc32c(0xffffffff, data, Vcb->superblock.sector_size);
         csum++;
@@ -78,17 +91,19 @@ static BOOL do_calc(device_extension* Vcb, calc_job* cj) {
 
     done = InterlockedIncrement(&cj->done);
 
-    if ((UINT32)done * SECTOR_BLOCK >= cj->sectors) {
-        ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, TRUE);
-        RemoveEntryList(&cj->list_entry);
-        ExReleaseResourceLite(&Vcb->calcthreads.lock);
-
+    if (done == cj->blocks)
         KeSetEvent(&cj->event, 0, FALSE);
-    }
 
     return TRUE;
 }
 
+void wait_calc_job(device_extension* Vcb, calc_job* cj) {
+    // Rather than sleeping, help out with our own job
+    while (do_calc(Vcb, cj)) { }
+
+    KeWaitForSingleObject(&cj->event, Executive, KernelMode, FALSE, NULL);
+}
+
 _Function_class_(KSTART_ROUTINE)
 #ifdef __REACTOS__
 void NTAPI calc_thread(void* context) {
@@ -105,7 +120,6 @@ void calc_thread(void* context) {
 
         while (TRUE) {
             calc_job* cj;
-            BOOL b;
 
             ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, TRUE);
 
@@ -115,16 +129,15 @@ void calc_thread(void* context) {
             }
 
             cj = CONTAINING_RECORD(Vcb->calcthreads.job_list.Flink, calc_job, list_entry);
-            cj->refcount++;
+            InterlockedIncrement(&cj->refcount);
 
             ExReleaseResourceLite(&Vcb->calcthreads.lock);
 
-            b = do_calc(Vcb, cj);
+            // If this fails, someone else has just taken the last block and is about
+            // to remove the job from the queue - so try again with whatever's next.
+            do_calc(Vcb, cj);
 
             free_calc_job(cj);
-
-            if (!b)
-                break;
         }
 
         if (thread->quit)
@@ -16,11 +16,20 @@
  * along with WinBtrfs.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <windef.h>
+
+#if !defined(__REACTOS__) || defined(_X86_) || defined(_AMD64_)
+#define CRC32C_HW
+#endif
+
 #ifndef __REACTOS__
 #include <smmintrin.h>
+#elif defined(_MSC_VER) && defined(CRC32C_HW)
+#include <intrin.h>
+#endif /* __REACTOS__ */
 
+#ifdef CRC32C_HW
 extern BOOL have_sse42;
-#endif /* __REACTOS__ */
+#endif
 
 static const UINT32 crctable[] = {
     0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
@@ -57,7 +66,7 @@ static const UINT32 crctable[] = {
     0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e, 0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
 };
 
-#ifndef __REACTOS__
+#ifdef CRC32C_HW
 // HW code taken from https://github.com/rurban/smhasher/blob/master/crc32_hw.c
 #define ALIGN_SIZE      0x08UL
 #define ALIGN_MASK      (ALIGN_SIZE - 1)
@@ -68,52 +77,211 @@ static const UINT32 crctable[] = {
     }                                                                   \
   } while(0)
 
-static UINT32 crc32c_hw(const void *input, ULONG len, UINT32 crc) {
-    const char* buf = (const char*)input;
+#if defined(__REACTOS__) && !defined(_MSC_VER)
+// GCC only lets us use the SSE4.2 intrinsics if the whole driver is built for SSE4.2,
+// which would break it on older CPUs - so we emit the instructions ourselves.
+
+static __inline UINT32 crc32c_u8(UINT32 crc, UINT8 v) {
+    __asm__("crc32b %1, %0" : "+r" (crc) : "rm" (v));
+    return crc;
+}
+
+static __inline UINT32 crc32c_u32(UINT32 crc, UINT32 v) {
+    __asm__("crc32l %1, %0" : "+r" (crc) : "rm" (v));
+    return crc;
+}
+
+#ifdef _AMD64_
+static __inline UINT64 crc32c_u64(UINT64 crc, UINT64 v) {
+    __asm__("crc32q %1, %0" : "+r" (crc) : "rm" (v));
+    return crc;
+}
+#endif
+#else
+#define crc32c_u8 _mm_crc32_u8
+#define crc32c_u32 _mm_crc32_u32
+#define crc32c_u64 _mm_crc32_u64
+#endif
+
+#ifdef _AMD64_
+typedef UINT64 crc_word;
+#define crc32c_word crc32c_u64
+#else
+typedef UINT32 crc_word;
+#define crc32c_word crc32c_u32
+#endif
+
+// The crc32 instruction has a latency of three cycles but a throughput of one per
+// cycle, so we run three of them at once over consecutive blocks and stitch the
+// results together afterwards. Appending a block of zeroes to a CRC is linear, so
+// for each of our block sizes we precompute it as four lookup tables.
+#define LONG_BLOCK      1024
+#define SHORT_BLOCK     256
+
+static UINT32 crc32c_long[4][256];
+static UINT32 crc32c_short[4][256];
+
+static UINT32 gf2_matrix_times(const UINT32* mat, UINT32 vec) {
+    UINT32 sum = 0;
+
+    while (vec) {
+        if (vec & 1)
+            sum ^= *mat;
+
+        vec >>= 1;
+        mat++;
+    }
+
+    return sum;
+}
+
+static void gf2_matrix_square(UINT32* square, const UINT32* mat) {
+    ULONG n;
+
+    for (n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+// len has to be a power of two
+static void crc32c_zeroes_op(UINT32* even, ULONG len) {
+    UINT32 odd[32], row = 1;
+    ULONG n;
+
+    // operator for one zero bit
+    odd[0] = 0x82f63b78;
+    for (n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+
+    // two zero bits, then four
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+
+    // keep squaring until we've got len bytes
+    do {
+        gf2_matrix_square(even, odd);
+        len >>= 1;
 
+        if (len == 0)
+            return;
+
+        gf2_matrix_square(odd, even);
+        len >>= 1;
+    } while (len);
+
+    for (n = 0; n < 32; n++) {
+        even[n] = odd[n];
+    }
+}
+
+static void crc32c_zeroes(UINT32 zeroes[4][256], ULONG len) {
+    UINT32 op[32];
+    ULONG n;
+
+    crc32c_zeroes_op(op, len);
+
+    for (n = 0; n < 256; n++) {
+        zeroes[0][n] = gf2_matrix_times(op, n);
+        zeroes[1][n] = gf2_matrix_times(op, n << 8);
+        zeroes[2][n] = gf2_matrix_times(op, n << 16);
+        zeroes[3][n] = gf2_matrix_times(op, n << 24);
+    }
+}
+
+static __inline UINT32 crc32c_shift(UINT32 zeroes[4][256], UINT32 crc) {
+    return zeroes[0][crc & 0xff] ^ zeroes[1][(crc >> 8) & 0xff] ^ zeroes[2][(crc >> 16) & 0xff] ^ zeroes[3][crc >> 24];
+}
+
+static __inline UINT32 crc32c_byte(UINT32 crc, UINT8 v) {
     // Annoyingly, the CRC32 intrinsics don't work properly in modern versions of MSVC -
     // it compiles _mm_crc32_u8 as if it was _mm_crc32_u32. And because we're apparently
     // not allowed to use inline asm on amd64, there's no easy way to fix this!
-
-    for (; (len > 0) && ((size_t)buf & ALIGN_MASK); len--, buf++) {
 #ifdef _MSC_VER
-        crc = crctable[(crc ^ *buf) & 0xff] ^ (crc >> 8);
+    return crctable[(crc ^ v) & 0xff] ^ (crc >> 8);
 #else
-        crc = _mm_crc32_u8(crc, *buf);
+    return crc32c_u8(crc, v);
 #endif
+}
+
+static UINT32 crc32c_hw(const void *input, ULONG len, UINT32 crc) {
+    const UINT8* buf = (const UINT8*)input;
+    const UINT8* end;
+    crc_word crc0 = crc, crc1, crc2;
+
+    for (; (len > 0) && ((size_t)buf & ALIGN_MASK); len--, buf++) {
+        crc0 = crc32c_byte((UINT32)crc0, *buf);
     }
 
-#ifdef _AMD64_
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:4244) // _mm_crc32_u64 wants to return UINT64(!)
 #pragma warning(disable:4242)
 #endif
-    CALC_CRC(_mm_crc32_u64, crc, UINT64, buf, len);
+    while (len >= LONG_BLOCK * 3) {
+        crc1 = crc2 = 0;
+        end = buf + LONG_BLOCK;
+
+        do {
+            crc0 = crc32c_word(crc0, *(crc_word*)buf);
+            crc1 = crc32c_word(crc1, *(crc_word*)(buf + LONG_BLOCK));
+            crc2 = crc32c_word(crc2, *(crc_word*)(buf + (LONG_BLOCK * 2)));
+            buf += sizeof(crc_word);
+        } while (buf < end);
+
+        crc0 = crc32c_shift(crc32c_long, (UINT32)crc0) ^ (UINT32)crc1;
+        crc0 = crc32c_shift(crc32c_long, (UINT32)crc0) ^ (UINT32)crc2;
+
+        buf += LONG_BLOCK * 2;
+        len -= LONG_BLOCK * 3;
+    }
+
+    while (len >= SHORT_BLOCK * 3) {
+        crc1 = crc2 = 0;
+        end = buf + SHORT_BLOCK;
+
+        do {
+            crc0 = crc32c_word(crc0, *(crc_word*)buf);
+            crc1 = crc32c_word(crc1, *(crc_word*)(buf + SHORT_BLOCK));
+            crc2 = crc32c_word(crc2, *(crc_word*)(buf + (SHORT_BLOCK * 2)));
+            buf += sizeof(crc_word);
+        } while (buf < end);
+
+        crc0 = crc32c_shift(crc32c_short, (UINT32)crc0) ^ (UINT32)crc1;
+        crc0 = crc32c_shift(crc32c_short, (UINT32)crc0) ^ (UINT32)crc2;
+
+        buf += SHORT_BLOCK * 2;
+        len -= SHORT_BLOCK * 3;
+    }
+
+    CALC_CRC(crc32c_word, crc0, crc_word, buf, len);
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
-#endif
-    CALC_CRC(_mm_crc32_u32, crc, UINT32, buf, len);
 
-#ifdef _MSC_VER
     for (; len > 0; len--, buf++) {
-        crc = crctable[(crc ^ *buf) & 0xff] ^ (crc >> 8);
+        crc0 = crc32c_byte((UINT32)crc0, *buf);
     }
-#else
-    CALC_CRC(_mm_crc32_u16, crc, UINT16, buf, len);
-    CALC_CRC(_mm_crc32_u8, crc, UINT8, buf, len);
-#endif
 
-    return crc;
+    return (UINT32)crc0;
 }
 #endif
 
+void init_crc32c() {
+#ifdef CRC32C_HW
+    if (have_sse42) {
+        crc32c_zeroes(crc32c_long, LONG_BLOCK);
+        crc32c_zeroes(crc32c_short, SHORT_BLOCK);
+    }
+#endif
+}
+
 UINT32 calc_crc32c(_In_ UINT32 seed, _In_reads_bytes_(msglen) UINT8* msg, _In_ ULONG msglen) {
     UINT32 rem;
     ULONG i;
 
-#ifndef __REACTOS__
+#ifdef CRC32C_HW
     if (have_sse42) {
         return crc32c_hw(msg, msglen, seed);
     } else {
@@ -123,7 +291,7 @@ UINT32 calc_crc32c(_In_ UINT32 seed, _In_reads_bytes_(msglen) UINT8* msg, _In_ U
         for (i = 0; i < msglen; i++) {
             rem = crctable[(rem ^ msg[i]) & 0xff] ^ (rem >> 8);
         }
-#ifndef __REACTOS__
+#ifdef CRC32C_HW
     }
 #endif
 
@@ -2798,7 +2798,7 @@ NTSTATUS calc_csum(_In_ device_extension* Vcb, _In_reads_bytes_(sectors*Vcb->sup
         return Status;
     }
 
-    KeWaitForSingleObject(&cj->event, Executive, KernelMode, FALSE, NULL);
+    wait_calc_job(Vcb, cj);
     free_calc_job(cj);
 
     return STATUS_SUCCESS;
@@ -0,0 +1,2037 @@
+/* Copyright (c) Mark Harmstone 2016-17
+ *
+ * This file is part of WinBtrfs.
+ *
+ * WinBtrfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public Licence as published by
+ * the Free Software Foundation, either version 3 of the Licence, or
+ * (at your option) any later version.
+ *
+ * WinBtrfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public Licence for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public Licence
+ * along with WinBtrfs.  If not, see <http://www.gnu.org/licenses/>. */
+
+// The zstd code was written from the format description in RFC 8478. It only
+// handles what btrfs needs: no dictionaries, and frames small enough to be
+// decompressed in one go.
+
+#include "btrfs_drv.h"
+
+#define ZSTD_MAGIC                  0xfd2fb528
+#define ZSTD_SKIPPABLE_MAGIC        0x184d2a50
+#define ZSTD_BLOCK_SIZE_MAX         0x20000
+
+#define ZSTD_BLOCK_RAW              0
+#define ZSTD_BLOCK_RLE              1
+#define ZSTD_BLOCK_COMPRESSED       2
+
+#define ZSTD_LITERALS_RAW           0
+#define ZSTD_LITERALS_RLE           1
+#define ZSTD_LITERALS_COMPRESSED    2
+#define ZSTD_LITERALS_TREELESS      3
+
+#define ZSTD_MODE_PREDEFINED        0
+#define ZSTD_MODE_RLE               1
+#define ZSTD_MODE_FSE               2
+#define ZSTD_MODE_REPEAT            3
+
+#define ZSTD_HUF_MAX_BITS           11
+#define ZSTD_WEIGHTS_MAX_LOG        6
+#define ZSTD_FSE_MAX_LOG            9
+#define ZSTD_FSE_MAX_SYMBOLS        64
+#define ZSTD_FSE_MIN_SEQUENCES      64
+
+#define ZSTD_MIN_MATCH              4
+#define ZSTD_HASH_LOG               15
+
+typedef struct {
+    UINT8 symbol;
+    UINT8 bits;
+    UINT16 base;
+} zstd_fse_entry;
+
+typedef struct {
+    UINT8 symbol;
+    UINT8 bits;
+} zstd_huf_entry;
+
+typedef struct {
+    const INT16* probs;
+    UINT32 num_probs;
+    UINT32 log;
+    UINT32 max_log;
+    UINT32 max_symbol;
+} zstd_seq_params;
+
+typedef struct {
+    const UINT8* data;
+    UINT32 len;
+    INT32 pos;
+} zstd_bits;
+
+typedef struct {
+    UINT8* out;
+    UINT32 outlen;
+    UINT32 pos;
+    UINT64 acc;
+    UINT32 bits;
+    BOOL overflow;
+} zstd_wbits;
+
+typedef struct {
+    zstd_fse_entry ll[1 << ZSTD_FSE_MAX_LOG];
+    zstd_fse_entry ml[1 << ZSTD_FSE_MAX_LOG];
+    zstd_fse_entry of[1 << ZSTD_FSE_MAX_LOG];
+    UINT8 ll_log, ml_log, of_log;
+    BOOL have_ll, have_ml, have_of;
+    zstd_huf_entry huf[1 << ZSTD_HUF_MAX_BITS];
+    UINT8 huf_log;
+    BOOL have_huf;
+    UINT32 rep[3];
+    UINT8 literals[ZSTD_BLOCK_SIZE_MAX];
+} zstd_dctx;
+
+typedef struct {
+    UINT32 litlen;
+    UINT32 matchlen;
+    UINT32 offset;
+} zstd_seq;
+
+typedef struct {
+    INT32 find_state;
+    UINT32 nb_bits;
+} zstd_fse_transform;
+
+typedef struct {
+    UINT32 log;
+    BOOL rle;
+    UINT16 states[1 << ZSTD_FSE_MAX_LOG];
+    zstd_fse_transform symbols[ZSTD_FSE_MAX_SYMBOLS];
+} zstd_fse_ctable;
+
+typedef struct {
+    UINT32 hash[1 << ZSTD_HASH_LOG];
+    UINT32* chain;
+    UINT32 depth;
+    BOOL lazy;
+    UINT32 next_insert;
+    UINT32 rep[3];
+    zstd_seq* seqs;
+    UINT32 num_seqs;
+    UINT8* lits;
+    UINT32 num_lits;
+    UINT8* codes;
+    zstd_fse_ctable ll, ml, of;
+    UINT16 huf_codes[256];
+    UINT8 huf_lengths[256];
+} zstd_cctx;
+
+static const UINT32 zstd_ll_base[] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536
+};
+
+static const UINT8 zstd_ll_bits[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16
+};
+
+static const UINT32 zstd_ml_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539
+};
+
+static const UINT8 zstd_ml_bits[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16
+};
+
+static const INT16 zstd_ll_default[] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1
+};
+
+static const INT16 zstd_ml_default[] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1
+};
+
+static const INT16 zstd_of_default[] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static const zstd_seq_params zstd_ll_params = { zstd_ll_default, sizeof(zstd_ll_default) / sizeof(INT16), 6, 9, 35 };
+static const zstd_seq_params zstd_ml_params = { zstd_ml_default, sizeof(zstd_ml_default) / sizeof(INT16), 6, 9, 52 };
+static const zstd_seq_params zstd_of_params = { zstd_of_default, sizeof(zstd_of_default) / sizeof(INT16), 5, 8, 31 };
+
+static __inline UINT32 zstd_highbit(UINT32 v) {
+    UINT32 n = 0;
+
+    while (v >>= 1) {
+        n++;
+    }
+
+    return n;
+}
+
+static __inline UINT32 zstd_read32(const UINT8* p) {
+    UINT32 v;
+
+    RtlCopyMemory(&v, p, sizeof(UINT32));
+
+    return v;
+}
+
+// Returns the n bits starting at bit pos, treating anything past the end as zeroes
+static __inline UINT32 zstd_peek(const UINT8* data, UINT32 len, INT32 pos, UINT32 n) {
+    UINT32 byte = (UINT32)pos >> 3, i;
+    UINT64 val = 0;
+
+    if (n == 0)
+        return 0;
+
+    if (byte + sizeof(UINT64) <= len)
+        RtlCopyMemory(&val, data + byte, sizeof(UINT64));
+    else {
+        for (i = 0; i < sizeof(UINT64) && byte + i < len; i++) {
+            val |= (UINT64)data[byte + i] << (i * 8);
+        }
+    }
+
+    return (UINT32)(val >> (pos & 7)) & (UINT32)((1ULL << n) - 1);
+}
+
+// Most of zstd is read backwards, starting from a marker bit in the last byte
+static BOOL zstd_init_rbits(zstd_bits* bits, const UINT8* data, UINT32 len) {
+    if (len == 0 || data[len - 1] == 0)
+        return FALSE;
+
+    bits->data = data;
+    bits->len = len;
+    bits->pos = ((len - 1) * 8) + zstd_highbit(data[len - 1]);
+
+    return TRUE;
+}
+
+static __inline UINT32 zstd_peek_rbits(const zstd_bits* bits, UINT32 n) {
+    if (bits->pos >= (INT32)n)
+        return zstd_peek(bits->data, bits->len, bits->pos - n, n);
+    else if (bits->pos <= 0)
+        return 0;
+    else
+        return zstd_peek(bits->data, bits->len, 0, bits->pos) << (n - bits->pos);
+}
+
+static __inline UINT32 zstd_read_rbits(zstd_bits* bits, UINT32 n) {
+    UINT32 val = zstd_peek_rbits(bits, n);
+
+    bits->pos -= n;
+
+    return val;
+}
+
+static BOOL zstd_build_fse_table(zstd_fse_entry* table, const INT16* probs, UINT32 num_symbols, UINT32 log) {
+    UINT16 next[ZSTD_FSE_MAX_SYMBOLS];
+    UINT32 size = 1 << log, high = size - 1, step = (size >> 1) + (size >> 3) + 3, pos = 0, s, i;
+
+    for (s = 0; s < num_symbols; s++) {
+        if (probs[s] == -1) {
+            table[high].symbol = (UINT8)s;
+            high--;
+            next[s] = 1;
+        } else
+            next[s] = probs[s];
+    }
+
+    for (s = 0; s < num_symbols; s++) {
+        for (i = 0; (INT32)i < probs[s]; i++) {
+            table[pos].symbol = (UINT8)s;
+
+            do {
+                pos = (pos + step) & (size - 1);
+            } while (pos > high);
+        }
+    }
+
+    if (pos != 0)
+        return FALSE;
+
+    for (i = 0; i < size; i++) {
+        UINT32 state = next[table[i].symbol]++;
+
+        table[i].bits = (UINT8)(log - zstd_highbit(state));
+        table[i].base = (UINT16)((state << table[i].bits) - size);
+    }
+
+    return TRUE;
+}
+
+static NTSTATUS zstd_read_fse_table(const UINT8* in, UINT32 inlen, UINT32* used, zstd_fse_entry* table, UINT8* plog, UINT32 max_log, UINT32 max_symbol) {
+    INT16 probs[ZSTD_FSE_MAX_SYMBOLS];
+    INT32 pos, remaining, threshold, bits, count, max;
+    UINT32 log, symbol = 0, val, repeat;
+
+    if (inlen == 0)
+        return STATUS_INTERNAL_ERROR;
+
+    log = (in[0] & 0xf) + 5;
+    if (log > max_log)
+        return STATUS_INTERNAL_ERROR;
+
+    pos = 4;
+    remaining = (1 << log) + 1;
+    threshold = 1 << log;
+    bits = log + 1;
+
+    while (remaining > 1) {
+        if (symbol > max_symbol)
+            return STATUS_INTERNAL_ERROR;
+
+        max = (2 * threshold) - 1 - remaining;
+        val = zstd_peek(in, inlen, pos, bits);
+
+        if ((INT32)(val & (threshold - 1)) < max) {
+            count = val & (threshold - 1);
+            pos += bits - 1;
+        } else {
+            count = val & ((2 * threshold) - 1);
+
+            if (count >= threshold)
+                count -= max;
+
+            pos += bits;
+        }
+
+        count--;
+        remaining -= count < 0 ? -count : count;
+        probs[symbol++] = (INT16)count;
+
+        if (remaining < 1)
+            return STATUS_INTERNAL_ERROR;
+
+        if (count == 0) {
+            do {
+                repeat = zstd_peek(in, inlen, pos, 2);
+                pos += 2;
+
+                if (symbol + repeat > max_symbol + 1)
+                    return STATUS_INTERNAL_ERROR;
+
+                while (repeat > 0 && repeat < 3) {
+                    probs[symbol++] = 0;
+                    repeat--;
+                }
+
+                if (repeat == 3) {
+                    probs[symbol++] = 0;
+                    probs[symbol++] = 0;
+                    probs[symbol++] = 0;
+                }
+            } while (repeat == 3);
+        }
+
+        while (remaining < threshold) {
+            bits--;
+            threshold >>= 1;
+        }
+    }
+
+    if ((UINT32)(pos + 7) / 8 > inlen)
+        return STATUS_INTERNAL_ERROR;
+
+    if (!zstd_build_fse_table(table, probs, symbol, log))
+        return STATUS_INTERNAL_ERROR;
+
+    *used = (pos + 7) / 8;
+    *plog = (UINT8)log;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS zstd_read_seq_table(const UINT8* in, UINT32 inlen, UINT32* used, UINT32 mode, const zstd_seq_params* params,
+                                    zstd_fse_entry* table, UINT8* log, BOOL* have) {
+    switch (mode) {
+        case ZSTD_MODE_PREDEFINED:
+            zstd_build_fse_table(table, params->probs, params->num_probs, params->log);
+            *log = (UINT8)params->log;
+            *used = 0;
+        break;
+
+        case ZSTD_MODE_RLE:
+            if (inlen < 1 || in[0] > params->max_symbol)
+                return STATUS_INTERNAL_ERROR;
+
+            table[0].symbol = in[0];
+            table[0].bits = 0;
+            table[0].base = 0;
+            *log = 0;
+            *used = 1;
+        break;
+
+        case ZSTD_MODE_FSE:
+        {
+            NTSTATUS Status = zstd_read_fse_table(in, inlen, used, table, log, params->max_log, params->max_symbol);
+            if (!NT_SUCCESS(Status))
+                return Status;
+
+            break;
+        }
+
+        case ZSTD_MODE_REPEAT:
+            if (!*have)
+                return STATUS_INTERNAL_ERROR;
+
+            *used = 0;
+        break;
+    }
+
+    *have = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS zstd_read_huffman_weights(const UINT8* in, UINT32 inlen, UINT32* used, UINT8* weights, UINT32* pnum_weights) {
+    UINT32 num_weights, i, hdr;
+
+    if (inlen == 0)
+        return STATUS_INTERNAL_ERROR;
+
+    hdr = in[0];
+
+    if (hdr >= 128) { // four bits per weight
+        num_weights = hdr - 127;
+
+        if (1 + ((num_weights + 1) / 2) > inlen)
+            return STATUS_INTERNAL_ERROR;
+
+        for (i = 0; i < num_weights; i++) {
+            weights[i] = i & 1 ? (in[1 + (i / 2)] & 0xf) : (in[1 + (i / 2)] >> 4);
+        }
+
+        *used = 1 + ((num_weights + 1) / 2);
+    } else { // weights compressed with FSE, using two interleaved states
+        zstd_fse_entry table[1 << ZSTD_WEIGHTS_MAX_LOG];
+        UINT32 hsize, state1, state2;
+        UINT8 log;
+        zstd_bits bits;
+        NTSTATUS Status;
+
+        if (1 + hdr > inlen)
+            return STATUS_INTERNAL_ERROR;
+
+        Status = zstd_read_fse_table(in + 1, hdr, &hsize, table, &log, ZSTD_WEIGHTS_MAX_LOG, 15);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        if (!zstd_init_rbits(&bits, in + 1 + hsize, hdr - hsize))
+            return STATUS_INTERNAL_ERROR;
+
+        state1 = zstd_read_rbits(&bits, log);
+        state2 = zstd_read_rbits(&bits, log);
+        num_weights = 0;
+
+        while (TRUE) {
+            if (num_weights > 253)
+                return STATUS_INTERNAL_ERROR;
+
+            weights[num_weights++] = table[state1].symbol;
+            state1 = table[state1].base + zstd_read_rbits(&bits, table[state1].bits);
+
+            if (bits.pos < 0) {
+                weights[num_weights++] = table[state2].symbol;
+                break;
+            }
+
+            weights[num_weights++] = table[state2].symbol;
+            state2 = table[state2].base + zstd_read_rbits(&bits, table[state2].bits);
+
+            if (bits.pos < 0) {
+                weights[num_weights++] = table[state1].symbol;
+                break;
+            }
+        }
+
+        *used = 1 + hdr;
+    }
+
+    *pnum_weights = num_weights;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS zstd_read_huffman_table(zstd_dctx* ctx, const UINT8* in, UINT32 inlen, UINT32* used) {
+    UINT8 weights[256];
+    UINT32 num_weights, i, j, total, max_bits, rest;
+    UINT32 counts[ZSTD_HUF_MAX_BITS + 1], start[ZSTD_HUF_MAX_BITS + 1];
+    NTSTATUS Status;
+
+    Status = zstd_read_huffman_weights(in, inlen, used, weights, &num_weights);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    // The weight of the last symbol is implied, as the tree has to be complete
+
+    total = 0;
+    for (i = 0; i < num_weights; i++) {
+        if (weights[i] > ZSTD_HUF_MAX_BITS)
+            return STATUS_INTERNAL_ERROR;
+
+        if (weights[i] > 0)
+            total += 1 << (weights[i] - 1);
+    }
+
+    if (total == 0)
+        return STATUS_INTERNAL_ERROR;
+
+    max_bits = zstd_highbit(total) + 1;
+    if (max_bits > ZSTD_HUF_MAX_BITS)
+        return STATUS_INTERNAL_ERROR;
+
+    rest = (1 << max_bits) - total;
+    if (rest & (rest - 1))
+        return STATUS_INTERNAL_ERROR;
+
+    weights[num_weights++] = (UINT8)(zstd_highbit(rest) + 1);
+
+    RtlZeroMemory(counts, sizeof(counts));
+
+    for (i = 0; i < num_weights; i++) {
+        counts[weights[i]]++;
+    }
+
+    total = 0;
+    for (i = 1; i <= max_bits; i++) {
+        start[i] = total;
+        total += counts[i] << (i - 1);
+    }
+
+    for (i = 0; i < num_weights; i++) {
+        UINT32 w = weights[i];
+
+        if (w == 0)
+            continue;
+
+        for (j = 0; j < 1u << (w - 1); j++) {
+            ctx->huf[start[w] + j].symbol = (UINT8)i;
+            ctx->huf[start[w] + j].bits = (UINT8)(max_bits + 1 - w);
+        }
+
+        start[w] += 1 << (w - 1);
+    }
+
+    ctx->huf_log = (UINT8)max_bits;
+    ctx->have_huf = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+static BOOL zstd_decode_huffman_stream(zstd_dctx* ctx, const UINT8* in, UINT32 inlen, UINT8* out, UINT32 outlen) {
+    zstd_bits bits;
+    UINT32 i;
+
+    if (!zstd_init_rbits(&bits, in, inlen))
+        return FALSE;
+
+    for (i = 0; i < outlen; i++) {
+        const zstd_huf_entry* e = &ctx->huf[zstd_peek_rbits(&bits, ctx->huf_log)];
+
+        out[i] = e->symbol;
+        bits.pos -= e->bits;
+    }
+
+    return bits.pos == 0;
+}
+
+static NTSTATUS zstd_decode_literals(zstd_dctx* ctx, const UINT8* in, UINT32 inlen, UINT32* used, const UINT8** lits, UINT32* litlen) {
+    UINT32 type, format, hlen, regen, comp;
+
+    if (inlen < 1)
+        return STATUS_INTERNAL_ERROR;
+
+    type = in[0] & 3;
+    format = (in[0] >> 2) & 3;
+
+    if (type == ZSTD_LITERALS_RAW || type == ZSTD_LITERALS_RLE) {
+        if (format == 0 || format == 2) {
+            hlen = 1;
+            regen = in[0] >> 3;
+        } else if (format == 1) {
+            hlen = 2;
+
+            if (inlen < hlen)
+                return STATUS_INTERNAL_ERROR;
+
+            regen = (in[0] >> 4) | (in[1] << 4);
+        } else {
+            hlen = 3;
+
+            if (inlen < hlen)
+                return STATUS_INTERNAL_ERROR;
+
+            regen = (in[0] >> 4) | (in[1] << 4) | (in[2] << 12);
+        }
+
+        if (regen > ZSTD_BLOCK_SIZE_MAX)
+            return STATUS_INTERNAL_ERROR;
+
+        if (type == ZSTD_LITERALS_RAW) {
+            if (hlen + regen > inlen)
+                return STATUS_INTERNAL_ERROR;
+
+            *lits = in + hlen;
+            *used = hlen + regen;
+        } else {
+            if (hlen + 1 > inlen)
+                return STATUS_INTERNAL_ERROR;
+
+            RtlFillMemory(ctx->literals, regen, in[hlen]);
+            *lits = ctx->literals;
+            *used = hlen + 1;
+        }
+
+        *litlen = regen;
+
+        return STATUS_SUCCESS;
+    }
+
+    // Huffman-compressed literals
+
+    if (format <= 1) {
+        hlen = 3;
+
+        if (inlen < hlen)
+            return STATUS_INTERNAL_ERROR;
+
+        regen = ((in[0] >> 4) | (in[1] << 4) | (in[2] << 12)) & 0x3ff;
+        comp = ((in[1] >> 6) | (in[2] << 2)) & 0x3ff;
+    } else if (format == 2) {
+        hlen = 4;
+
+        if (inlen < hlen)
+            return STATUS_INTERNAL_ERROR;
+
+        regen = ((in[0] >> 4) | (in[1] << 4) | (in[2] << 12)) & 0x3fff;
+        comp = (in[2] >> 2) | (in[3] << 6);
+    } else {
+        hlen = 5;
+
+        if (inlen < hlen)
+            return STATUS_INTERNAL_ERROR;
+
+        regen = ((in[0] >> 4) | (in[1] << 4) | (in[2] << 12)) & 0x3ffff;
+        comp = (in[2] >> 6) | (in[3] << 2) | (in[4] << 10);
+    }
+
+    if (regen > ZSTD_BLOCK_SIZE_MAX || hlen + comp > inlen)
+        return STATUS_INTERNAL_ERROR;
+
+    in += hlen;
+    *used = hlen + comp;
+
+    if (type == ZSTD_LITERALS_COMPRESSED) {
+        UINT32 tlen;
+        NTSTATUS Status = zstd_read_huffman_table(ctx, in, comp, &tlen);
+
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        in += tlen;
+        comp -= tlen;
+    } else if (!ctx->have_huf)
+        return STATUS_INTERNAL_ERROR;
+
+    if (format == 0) {
+        if (!zstd_decode_huffman_stream(ctx, in, comp, ctx->literals, regen))
+            return STATUS_INTERNAL_ERROR;
+    } else {
+        UINT32 size1, size2, size3, seg = (regen + 3) / 4;
+
+        if (comp < 6 || regen < 3 * seg)
+            return STATUS_INTERNAL_ERROR;
+
+        size1 = in[0] | (in[1] << 8);
+        size2 = in[2] | (in[3] << 8);
+        size3 = in[4] | (in[5] << 8);
+
+        if (6 + size1 + size2 + size3 > comp)
+            return STATUS_INTERNAL_ERROR;
+
+        in += 6;
+        comp -= 6;
+
+        if (!zstd_decode_huffman_stream(ctx, in, size1, ctx->literals, seg) ||
+            !zstd_decode_huffman_stream(ctx, in + size1, size2, ctx->literals + seg, seg) ||
+            !zstd_decode_huffman_stream(ctx, in + size1 + size2, size3, ctx->literals + (2 * seg), seg) ||
+            !zstd_decode_huffman_stream(ctx, in + size1 + size2 + size3, comp - size1 - size2 - size3, ctx->literals + (3 * seg), regen - (3 * seg)))
+            return STATUS_INTERNAL_ERROR;
+    }
+
+    *lits = ctx->literals;
+    *litlen = regen;
+
+    return STATUS_SUCCESS;
+}
+
+// Returns FALSE once outbuf is full - btrfs often only wants the start of an extent
+static __inline BOOL zstd_copy_literals(UINT8* outbuf, UINT32* outpos, UINT32 outlen, const UINT8* lits, UINT32 len) {
+    BOOL ret = TRUE;
+
+    if (len >= outlen - *outpos) {
+        len = outlen - *outpos;
+        ret = FALSE;
+    }
+
+    RtlCopyMemory(outbuf + *outpos, lits, len);
+    *outpos += len;
+
+    return ret;
+}
+
+static __inline BOOL zstd_copy_match(UINT8* outbuf, UINT32* outpos, UINT32 outlen, UINT32 offset, UINT32 len) {
+    UINT8* dest = outbuf + *outpos;
+    UINT8* src = dest - offset;
+    BOOL ret = TRUE;
+    UINT32 i;
+
+    if (len >= outlen - *outpos) {
+        len = outlen - *outpos;
+        ret = FALSE;
+    }
+
+    if (offset >= len)
+        RtlCopyMemory(dest, src, len);
+    else {
+        for (i = 0; i < len; i++) {
+            dest[i] = src[i];
+        }
+    }
+
+    *outpos += len;
+
+    return ret;
+}
+
+static NTSTATUS zstd_decode_sequences(zstd_dctx* ctx, const UINT8* in, UINT32 inlen, const UINT8* lits, UINT32 litlen,
+                                      UINT8* outbuf, UINT32* outpos, UINT32 outlen, UINT32 framestart) {
+    UINT32 num_seqs, pos, used, i, modes, ll_state, ml_state, of_state, litpos = 0;
+    zstd_bits bits;
+    NTSTATUS Status;
+
+    if (inlen < 1)
+        return STATUS_INTERNAL_ERROR;
+
+    if (in[0] < 128) {
+        num_seqs = in[0];
+        pos = 1;
+    } else if (in[0] < 255) {
+        if (inlen < 2)
+            return STATUS_INTERNAL_ERROR;
+
+        num_seqs = ((in[0] - 128) << 8) | in[1];
+        pos = 2;
+    } else {
+        if (inlen < 3)
+            return STATUS_INTERNAL_ERROR;
+
+        num_seqs = (in[1] | (in[2] << 8)) + 0x7f00;
+        pos = 3;
+    }
+
+    if (num_seqs == 0) {
+        zstd_copy_literals(outbuf, outpos, outlen, lits, litlen);
+        return STATUS_SUCCESS;
+    }
+
+    if (pos >= inlen)
+        return STATUS_INTERNAL_ERROR;
+
+    modes = in[pos];
+    pos++;
+
+    Status = zstd_read_seq_table(in + pos, inlen - pos, &used, modes >> 6, &zstd_ll_params, ctx->ll, &ctx->ll_log, &ctx->have_ll);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    pos += used;
+
+    Status = zstd_read_seq_table(in + pos, inlen - pos, &used, (modes >> 4) & 3, &zstd_of_params, ctx->of, &ctx->of_log, &ctx->have_of);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    pos += used;
+
+    Status = zstd_read_seq_table(in + pos, inlen - pos, &used, (modes >> 2) & 3, &zstd_ml_params, ctx->ml, &ctx->ml_log, &ctx->have_ml);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    pos += used;
+
+    if (!zstd_init_rbits(&bits, in + pos, inlen - pos))
+        return STATUS_INTERNAL_ERROR;
+
+    ll_state = zstd_read_rbits(&bits, ctx->ll_log);
+    of_state = zstd_read_rbits(&bits, ctx->of_log);
+    ml_state = zstd_read_rbits(&bits, ctx->ml_log);
+
+    for (i = 0; i < num_seqs; i++) {
+        UINT32 of_code = ctx->of[of_state].symbol;
+        UINT32 ml_code = ctx->ml[ml_state].symbol;
+        UINT32 ll_code = ctx->ll[ll_state].symbol;
+        UINT32 offset, matchlen, lit;
+
+        if (of_code > 31)
+            return STATUS_INTERNAL_ERROR;
+
+        offset = (1 << of_code) + zstd_read_rbits(&bits, of_code);
+        matchlen = zstd_ml_base[ml_code] + zstd_read_rbits(&bits, zstd_ml_bits[ml_code]);
+        lit = zstd_ll_base[ll_code] + zstd_read_rbits(&bits, zstd_ll_bits[ll_code]);
+
+        if (offset > 3) {
+            offset -= 3;
+            ctx->rep[2] = ctx->rep[1];
+            ctx->rep[1] = ctx->rep[0];
+            ctx->rep[0] = offset;
+        } else {
+            UINT32 idx = offset - 1 + (lit == 0 ? 1 : 0);
+
+            if (idx == 0)
+                offset = ctx->rep[0];
+            else {
+                offset = idx == 3 ? ctx->rep[0] - 1 : ctx->rep[idx];
+
+                if (idx != 1)
+                    ctx->rep[2] = ctx->rep[1];
+
+                ctx->rep[1] = ctx->rep[0];
+                ctx->rep[0] = offset;
+            }
+        }
+
+        if (i + 1 < num_seqs) {
+            ll_state = ctx->ll[ll_state].base + zstd_read_rbits(&bits, ctx->ll[ll_state].bits);
+            ml_state = ctx->ml[ml_state].base + zstd_read_rbits(&bits, ctx->ml[ml_state].bits);
+            of_state = ctx->of[of_state].base + zstd_read_rbits(&bits, ctx->of[of_state].bits);
+        }
+
+        if (lit > litlen - litpos)
+            return STATUS_INTERNAL_ERROR;
+
+        if (!zstd_copy_literals(outbuf, outpos, outlen, lits + litpos, lit))
+            return STATUS_SUCCESS;
+
+        litpos += lit;
+
+        if (offset == 0 || offset > *outpos - framestart)
+            return STATUS_INTERNAL_ERROR;
+
+        if (!zstd_copy_match(outbuf, outpos, outlen, offset, matchlen))
+            return STATUS_SUCCESS;
+    }
+
+    if (bits.pos != 0)
+        return STATUS_INTERNAL_ERROR;
+
+    zstd_copy_literals(outbuf, outpos, outlen, lits + litpos, litlen - litpos);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS zstd_decode_block(zstd_dctx* ctx, const UINT8* in, UINT32 inlen, UINT8* outbuf, UINT32* outpos, UINT32 outlen, UINT32 framestart) {
+    const UINT8* lits;
+    UINT32 litlen, used;
+    NTSTATUS Status;
+
+    Status = zstd_decode_literals(ctx, in, inlen, &used, &lits, &litlen);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    return zstd_decode_sequences(ctx, in + used, inlen - used, lits, litlen, outbuf, outpos, outlen, framestart);
+}
+
+NTSTATUS zstd_decompress(UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen) {
+    zstd_dctx* ctx;
+    UINT32 inpos = 0, outpos = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    ctx = ExAllocatePoolWithTag(PagedPool, sizeof(zstd_dctx), ALLOC_TAG_ZSTD);
+    if (!ctx) {
+        ERR("out of memory\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    while (inpos + sizeof(UINT32) <= inlen && outpos < outlen) {
+        UINT32 magic = zstd_read32(inbuf + inpos), fhd, framestart;
+        static const UINT8 dict_id_size[] = { 0, 1, 2, 4 };
+        static const UINT8 fcs_size[] = { 0, 2, 4, 8 };
+        BOOL last;
+
+        if ((magic & 0xfffffff0) == ZSTD_SKIPPABLE_MAGIC) {
+            UINT32 size;
+
+            if (inlen - inpos < 2 * sizeof(UINT32)) {
+                Status = STATUS_INTERNAL_ERROR;
+                break;
+            }
+
+            // the size comes straight off the disk, so don't let it wrap inpos
+            size = zstd_read32(inbuf + inpos + sizeof(UINT32));
+
+            if (size > inlen - inpos - (2 * sizeof(UINT32))) {
+                ERR("zstd skippable frame of %x bytes overruns extent\n", size);
+                Status = STATUS_INTERNAL_ERROR;
+                break;
+            }
+
+            inpos += (2 * sizeof(UINT32)) + size;
+            continue;
+        }
+
+        if (magic != ZSTD_MAGIC) {
+            // btrfs pads the end of the extent with zeroes
+            if (magic == 0)
+                break;
+
+            ERR("invalid zstd magic %08x\n", magic);
+            Status = STATUS_INTERNAL_ERROR;
+            break;
+        }
+
+        inpos += sizeof(UINT32);
+
+        if (inpos >= inlen) {
+            Status = STATUS_INTERNAL_ERROR;
+            break;
+        }
+
+        fhd = inbuf[inpos];
+        inpos++;
+
+        if (fhd & 0x08) {
+            ERR("reserved bit set in zstd frame header\n");
+            Status = STATUS_INTERNAL_ERROR;
+            break;
+        }
+
+        if (!(fhd & 0x20)) // window descriptor
+            inpos++;
+
+        if (dict_id_size[fhd & 3] > 0) {
+            UINT32 dict_id = 0, i;
+
+            for (i = 0; i < dict_id_size[fhd & 3] && inpos + i < inlen; i++) {
+                dict_id |= inbuf[inpos + i] << (i * 8);
+            }
+
+            if (dict_id != 0) {
+                ERR("zstd dictionaries not supported\n");
+                Status = STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            inpos += dict_id_size[fhd & 3];
+        }
+
+        inpos += (fhd >> 6) == 0 && fhd & 0x20 ? 1 : fcs_size[fhd >> 6];
+
+        ctx->rep[0] = 1;
+        ctx->rep[1] = 4;
+        ctx->rep[2] = 8;
+        ctx->have_ll = ctx->have_ml = ctx->have_of = ctx->have_huf = FALSE;
+        framestart = outpos;
+
+        do {
+            UINT32 hdr, size;
+
+            if (inpos + 3 > inlen) {
+                Status = STATUS_INTERNAL_ERROR;
+                break;
+            }
+
+            hdr = inbuf[inpos] | (inbuf[inpos + 1] << 8) | (inbuf[inpos + 2] << 16);
+            inpos += 3;
+
+            last = hdr & 1;
+            size = hdr >> 3;
+
+            switch ((hdr >> 1) & 3) {
+                case ZSTD_BLOCK_RAW:
+                    if (size > inlen - inpos) {
+                        Status = STATUS_INTERNAL_ERROR;
+                        break;
+                    }
+
+                    zstd_copy_literals(outbuf, &outpos, outlen, inbuf + inpos, size);
+                    inpos += size;
+                break;
+
+                case ZSTD_BLOCK_RLE:
+                    if (inpos >= inlen) {
+                        Status = STATUS_INTERNAL_ERROR;
+                        break;
+                    }
+
+                    size = min(size, outlen - outpos);
+                    RtlFillMemory(outbuf + outpos, size, inbuf[inpos]);
+                    outpos += size;
+                    inpos++;
+                break;
+
+                case ZSTD_BLOCK_COMPRESSED:
+                    if (size > ZSTD_BLOCK_SIZE_MAX || size > inlen - inpos) {
+                        Status = STATUS_INTERNAL_ERROR;
+                        break;
+                    }
+
+                    Status = zstd_decode_block(ctx, inbuf + inpos, size, outbuf, &outpos, outlen, framestart);
+                    inpos += size;
+                break;
+
+                default:
+                    Status = STATUS_INTERNAL_ERROR;
+                break;
+            }
+
+            if (!NT_SUCCESS(Status)) {
+                ERR("corrupted zstd block\n");
+                break;
+            }
+        } while (!last && outpos < outlen);
+
+        if (!NT_SUCCESS(Status))
+            break;
+
+        if (fhd & 0x04) // checksum
+            inpos += sizeof(UINT32);
+    }
+
+    ExFreePool(ctx);
+
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    if (outpos < outlen)
+        RtlZeroMemory(outbuf + outpos, outlen - outpos);
+
+    return STATUS_SUCCESS;
+}
+
+static void zstd_init_wbits(zstd_wbits* w, UINT8* out, UINT32 outlen) {
+    w->out = out;
+    w->outlen = outlen;
+    w->pos = 0;
+    w->acc = 0;
+    w->bits = 0;
+    w->overflow = FALSE;
+}
+
+static __inline void zstd_write_bits(zstd_wbits* w, UINT32 val, UINT32 n) {
+    w->acc |= (UINT64)(val & (UINT32)((1ULL << n) - 1)) << w->bits;
+    w->bits += n;
+
+    while (w->bits >= 8) {
+        if (w->pos < w->outlen)
+            w->out[w->pos] = (UINT8)w->acc;
+        else
+            w->overflow = TRUE;
+
+        w->pos++;
+        w->acc >>= 8;
+        w->bits -= 8;
+    }
+}
+
+// Returns the number of bytes written, or 0 if we ran out of space
+static UINT32 zstd_flush_wbits(zstd_wbits* w, BOOL marker) {
+    if (marker)
+        zstd_write_bits(w, 1, 1);
+
+    if (w->bits > 0)
+        zstd_write_bits(w, 0, 8 - w->bits);
+
+    return w->overflow ? 0 : w->pos;
+}
+
+static void zstd_normalize(const UINT32* counts, UINT32 num_symbols, UINT32 total, UINT32 log, INT16* probs) {
+    INT32 left = 1 << log;
+    UINT32 s, largest = 0;
+
+    for (s = 0; s < num_symbols; s++) {
+        if (counts[s] == 0) {
+            probs[s] = 0;
+            continue;
+        }
+
+        probs[s] = (INT16)((((UINT64)counts[s] << log) + (total / 2)) / total);
+        if (probs[s] == 0)
+            probs[s] = 1;
+
+        left -= probs[s];
+
+        if (counts[s] > counts[largest])
+            largest = s;
+    }
+
+    // Hand out or take back whatever got lost in the rounding
+    if (left > 0)
+        probs[largest] += (INT16)left;
+
+    while (left < 0) {
+        UINT32 biggest = 0;
+
+        for (s = 1; s < num_symbols; s++) {
+            if (probs[s] > probs[biggest])
+                biggest = s;
+        }
+
+        probs[biggest]--;
+        left++;
+    }
+}
+
+static UINT32 zstd_fse_log(UINT32 total, UINT32 distinct, UINT32 max_log) {
+    UINT32 log = zstd_highbit(total);
+
+    if (log < 5)
+        log = 5;
+
+    while ((1u << log) < 2 * distinct && log < max_log) {
+        log++;
+    }
+
+    return min(log, max_log);
+}
+
+static void zstd_build_fse_ctable(zstd_fse_ctable* ct, const INT16* probs, UINT32 num_symbols, UINT32 log) {
+    UINT8 spread[1 << ZSTD_FSE_MAX_LOG];
+    UINT32 cumul[ZSTD_FSE_MAX_SYMBOLS + 1];
+    UINT32 size = 1 << log, high = size - 1, step = (size >> 1) + (size >> 3) + 3, pos = 0, s, i;
+    INT32 total = 0;
+
+    ct->log = log;
+    ct->rle = FALSE;
+
+    cumul[0] = 0;
+    for (s = 0; s < num_symbols; s++) {
+        if (probs[s] == -1) {
+            cumul[s + 1] = cumul[s] + 1;
+            spread[high] = (UINT8)s;
+            high--;
+        } else
+            cumul[s + 1] = cumul[s] + probs[s];
+    }
+
+    for (s = 0; s < num_symbols; s++) {
+        for (i = 0; (INT32)i < probs[s]; i++) {
+            spread[pos] = (UINT8)s;
+
+            do {
+                pos = (pos + step) & (size - 1);
+            } while (pos > high);
+        }
+    }
+
+    for (i = 0; i < size; i++) {
+        ct->states[cumul[spread[i]]++] = (UINT16)(size + i);
+    }
+
+    for (s = 0; s < num_symbols; s++) {
+        switch (probs[s]) {
+            case 0:
+                ct->symbols[s].nb_bits = ((log + 1) << 16) - size;
+            break;
+
+            case -1:
+            case 1:
+                ct->symbols[s].nb_bits = (log << 16) - size;
+                ct->symbols[s].find_state = total - 1;
+                total++;
+            break;
+
+            default:
+            {
+                UINT32 max_bits = log - zstd_highbit(probs[s] - 1);
+
+                ct->symbols[s].nb_bits = (max_bits << 16) - (probs[s] << max_bits);
+                ct->symbols[s].find_state = total - probs[s];
+                total += probs[s];
+            }
+        }
+    }
+}
+
+static __inline void zstd_fse_init_state(UINT32* state, const zstd_fse_ctable* ct, UINT32 symbol) {
+    const zstd_fse_transform* tt = &ct->symbols[symbol];
+    UINT32 bits = (tt->nb_bits + (1 << 15)) >> 16;
+    UINT32 value = (bits << 16) - tt->nb_bits;
+
+    *state = ct->states[(INT32)(value >> bits) + tt->find_state];
+}
+
+static __inline void zstd_fse_encode(zstd_wbits* w, UINT32* state, const zstd_fse_ctable* ct, UINT32 symbol) {
+    const zstd_fse_transform* tt = &ct->symbols[symbol];
+    UINT32 bits = (*state + tt->nb_bits) >> 16;
+
+    zstd_write_bits(w, *state, bits);
+    *state = ct->states[(INT32)(*state >> bits) + tt->find_state];
+}
+
+static UINT32 zstd_write_fse_table(UINT8* out, UINT32 outlen, const INT16* probs, UINT32 log) {
+    INT32 remaining = (1 << log) + 1, threshold = 1 << log, bits = log + 1, count, max;
+    UINT32 symbol = 0, start;
+    BOOL previous0 = FALSE;
+    zstd_wbits w;
+
+    zstd_init_wbits(&w, out, outlen);
+    zstd_write_bits(&w, log - 5, 4);
+
+    while (remaining > 1) {
+        if (previous0) {
+            start = symbol;
+
+            while (probs[symbol] == 0) {
+                symbol++;
+            }
+
+            while (symbol >= start + 24) {
+                start += 24;
+                zstd_write_bits(&w, 0xffff, 16);
+            }
+
+            while (symbol >= start + 3) {
+                start += 3;
+                zstd_write_bits(&w, 3, 2);
+            }
+
+            zstd_write_bits(&w, symbol - start, 2);
+        }
+
+        count = probs[symbol++];
+        max = (2 * threshold) - 1 - remaining;
+        remaining -= count < 0 ? -count : count;
+
+        count++;
+        if (count >= threshold)
+            count += max;
+
+        zstd_write_bits(&w, count, count < max ? bits - 1 : bits);
+        previous0 = count == 1;
+
+        while (remaining < threshold) {
+            bits--;
+            threshold >>= 1;
+        }
+    }
+
+    return zstd_flush_wbits(&w, FALSE);
+}
+
+static void zstd_huffman_lengths(const UINT32* counts, UINT8* lengths) {
+    UINT16 order[256], parent[511];
+    UINT32 weight[511];
+    UINT8 depth[511];
+    UINT32 n = 0, leaf, internal, node, i, j, kraft, best;
+
+    for (i = 0; i < 256; i++) {
+        lengths[i] = 0;
+
+        if (counts[i] == 0)
+            continue;
+
+        // insertion sort, by ascending count
+        for (j = n; j > 0 && counts[order[j - 1]] > counts[i]; j--) {
+            order[j] = order[j - 1];
+        }
+
+        order[j] = (UINT16)i;
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        weight[i] = counts[order[i]];
+    }
+
+    // As the leaves are sorted, the internal nodes get created in order too,
+    // so we only ever have to look at the front of the two queues.
+
+    leaf = 0;
+    internal = n;
+
+    for (node = n; node < (2 * n) - 1; node++) {
+        UINT32 a, b;
+
+        if (leaf < n && (internal >= node || weight[leaf] <= weight[internal]))
+            a = leaf++;
+        else
+            a = internal++;
+
+        if (leaf < n && (internal >= node || weight[leaf] <= weight[internal]))
+            b = leaf++;
+        else
+            b = internal++;
+
+        weight[node] = weight[a] + weight[b];
+        parent[a] = parent[b] = (UINT16)node;
+    }
+
+    depth[(2 * n) - 2] = 0;
+    for (i = (2 * n) - 2; i > 0; i--) {
+        depth[i - 1] = depth[parent[i - 1]] + 1;
+    }
+
+    for (i = 0; i < n; i++) {
+        lengths[order[i]] = depth[i];
+    }
+
+    // Clamp the lengths to what zstd allows, then fix up the tree so it's complete again
+
+    kraft = 0;
+    for (i = 0; i < 256; i++) {
+        if (lengths[i] > ZSTD_HUF_MAX_BITS)
+            lengths[i] = ZSTD_HUF_MAX_BITS;
+
+        if (lengths[i] > 0)
+            kraft += 1 << (ZSTD_HUF_MAX_BITS - lengths[i]);
+    }
+
+    while (kraft > 1u << ZSTD_HUF_MAX_BITS) {
+        best = 256;
+
+        for (i = 0; i < 256; i++) {
+            if (lengths[i] > 0 && lengths[i] < ZSTD_HUF_MAX_BITS &&
+                (best == 256 || lengths[i] > lengths[best] || (lengths[i] == lengths[best] && counts[i] < counts[best])))
+                best = i;
+        }
+
+        kraft -= 1 << (ZSTD_HUF_MAX_BITS - lengths[best] - 1);
+        lengths[best]++;
+    }
+
+    while (kraft < 1u << ZSTD_HUF_MAX_BITS) {
+        best = 256;
+
+        for (i = 0; i < 256; i++) {
+            if (lengths[i] > 1 && kraft + (1u << (ZSTD_HUF_MAX_BITS - lengths[i])) <= 1u << ZSTD_HUF_MAX_BITS &&
+                (best == 256 || lengths[i] > lengths[best] || (lengths[i] == lengths[best] && counts[i] > counts[best])))
+                best = i;
+        }
+
+        kraft += 1 << (ZSTD_HUF_MAX_BITS - lengths[best]);
+        lengths[best]--;
+    }
+}
+
+
+static UINT32 zstd_write_huffman_weights(UINT8* out, UINT32 outlen, const UINT8* weights, UINT32 num_weights) {
+    UINT32 counts[ZSTD_HUF_MAX_BITS + 1], distinct = 0, i, size, state1, state2, hsize, used, check_num;
+    UINT8 check[256];
+    INT16 probs[ZSTD_HUF_MAX_BITS + 1];
+    zstd_fse_ctable* ct;
+    zstd_wbits w;
+
+    if (num_weights <= 128) {
+        if (1 + ((num_weights + 1) / 2) > outlen)
+            return 0;
+
+        out[0] = (UINT8)(127 + num_weights);
+
+        for (i = 0; i < num_weights; i += 2) {
+            out[1 + (i / 2)] = (UINT8)((weights[i] << 4) | (i + 1 < num_weights ? weights[i + 1] : 0));
+        }
+
+        return 1 + ((num_weights + 1) / 2);
+    }
+
+    // Too many symbols for the simple representation, so we have to use FSE
+
+    RtlZeroMemory(counts, sizeof(counts));
+
+    for (i = 0; i < num_weights; i++) {
+        if (counts[weights[i]] == 0)
+            distinct++;
+
+        counts[weights[i]]++;
+    }
+
+    if (distinct < 2 || outlen < 2)
+        return 0;
+
+    zstd_normalize(counts, ZSTD_HUF_MAX_BITS + 1, num_weights, ZSTD_WEIGHTS_MAX_LOG, probs);
+
+    hsize = zstd_write_fse_table(out + 1, min(outlen - 1, 127), probs, ZSTD_WEIGHTS_MAX_LOG);
+    if (hsize == 0)
+        return 0;
+
+    ct = ExAllocatePoolWithTag(PagedPool, sizeof(zstd_fse_ctable), ALLOC_TAG_ZSTD);
+    if (!ct)
+        return 0;
+
+    zstd_build_fse_ctable(ct, probs, ZSTD_HUF_MAX_BITS + 1, ZSTD_WEIGHTS_MAX_LOG);
+
+    zstd_init_wbits(&w, out + 1 + hsize, min(outlen - 1, 127) - hsize);
+
+    i = num_weights;
+
+    if (num_weights & 1) {
+        zstd_fse_init_state(&state1, ct, weights[--i]);
+        zstd_fse_init_state(&state2, ct, weights[--i]);
+        zstd_fse_encode(&w, &state1, ct, weights[--i]);
+    } else {
+        zstd_fse_init_state(&state2, ct, weights[--i]);
+        zstd_fse_init_state(&state1, ct, weights[--i]);
+    }
+
+    while (i > 0) {
+        zstd_fse_encode(&w, &state2, ct, weights[--i]);
+        zstd_fse_encode(&w, &state1, ct, weights[--i]);
+    }
+
+    zstd_write_bits(&w, state2, ct->log);
+    zstd_write_bits(&w, state1, ct->log);
+
+    ExFreePool(ct);
+
+    size = zstd_flush_wbits(&w, TRUE);
+    if (size == 0)
+        return 0;
+
+    out[0] = (UINT8)(hsize + size);
+
+    // The decoder can only tell where the weights end by running out of bits, which
+    // doesn't work for every distribution - so make sure we get back what we put in.
+
+    if (!NT_SUCCESS(zstd_read_huffman_weights(out, 1 + hsize + size, &used, check, &check_num)) ||
+        check_num != num_weights || RtlCompareMemory(check, weights, num_weights) != num_weights)
+        return 0;
+
+    return 1 + hsize + size;
+}
+
+static UINT32 zstd_write_literals_header(UINT8* out, UINT32 type, UINT32 regen, UINT32 comp, BOOL four_streams) {
+    if (type == ZSTD_LITERALS_RAW || type == ZSTD_LITERALS_RLE) {
+        if (regen < 32) {
+            out[0] = (UINT8)(type | (regen << 3));
+            return 1;
+        } else if (regen < 4096) {
+            out[0] = (UINT8)(type | (1 << 2) | (regen << 4));
+            out[1] = (UINT8)(regen >> 4);
+            return 2;
+        } else {
+            out[0] = (UINT8)(type | (3 << 2) | (regen << 4));
+            out[1] = (UINT8)(regen >> 4);
+            out[2] = (UINT8)(regen >> 12);
+            return 3;
+        }
+    }
+
+    if (regen < 1024 && comp < 1024) {
+        UINT32 v = type | ((four_streams ? 1 : 0) << 2) | (regen << 4) | (comp << 14);
+
+        out[0] = (UINT8)v;
+        out[1] = (UINT8)(v >> 8);
+        out[2] = (UINT8)(v >> 16);
+        return 3;
+    } else if (regen < 16384 && comp < 16384) {
+        UINT32 v = type | (2 << 2) | (regen << 4) | (comp << 18);
+
+        out[0] = (UINT8)v;
+        out[1] = (UINT8)(v >> 8);
+        out[2] = (UINT8)(v >> 16);
+        out[3] = (UINT8)(v >> 24);
+        return 4;
+    } else {
+        UINT64 v = type | (3 << 2) | (regen << 4) | ((UINT64)comp << 22);
+
+        out[0] = (UINT8)v;
+        out[1] = (UINT8)(v >> 8);
+        out[2] = (UINT8)(v >> 16);
+        out[3] = (UINT8)(v >> 24);
+        out[4] = (UINT8)(v >> 32);
+        return 5;
+    }
+}
+
+static UINT32 zstd_write_raw_literals(UINT8* out, UINT32 outlen, const UINT8* lits, UINT32 num_lits) {
+    UINT32 hlen = num_lits < 32 ? 1 : (num_lits < 4096 ? 2 : 3);
+
+    if (hlen + num_lits > outlen)
+        return 0;
+
+    zstd_write_literals_header(out, ZSTD_LITERALS_RAW, num_lits, 0, FALSE);
+    RtlCopyMemory(out + hlen, lits, num_lits);
+
+    return hlen + num_lits;
+}
+
+static UINT32 zstd_write_huffman_stream(zstd_cctx* ctx, UINT8* out, UINT32 outlen, const UINT8* lits, UINT32 num_lits) {
+    zstd_wbits w;
+    UINT32 i;
+
+    zstd_init_wbits(&w, out, outlen);
+
+    // The stream is read backwards, so the first literal has to be written last
+    for (i = num_lits; i > 0; i--) {
+        zstd_write_bits(&w, ctx->huf_codes[lits[i - 1]], ctx->huf_lengths[lits[i - 1]]);
+    }
+
+    return zstd_flush_wbits(&w, TRUE);
+}
+
+static UINT32 zstd_write_literals(zstd_cctx* ctx, UINT8* out, UINT32 outlen) {
+    UINT32 counts[256], wcounts[ZSTD_HUF_MAX_BITS + 1], start[ZSTD_HUF_MAX_BITS + 1];
+    UINT8 weights[256];
+    UINT32 num_lits = ctx->num_lits, distinct = 0, last = 0, max_bits = 0, hlen, tlen, pos, i, total;
+    BOOL four_streams;
+
+    if (num_lits == 0)
+        return zstd_write_raw_literals(out, outlen, ctx->lits, 0);
+
+    RtlZeroMemory(counts, sizeof(counts));
+
+    for (i = 0; i < num_lits; i++) {
+        counts[ctx->lits[i]]++;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            distinct++;
+            last = i;
+        }
+    }
+
+    if (distinct == 1) {
+        if (outlen < 4)
+            return 0;
+
+        hlen = zstd_write_literals_header(out, ZSTD_LITERALS_RLE, num_lits, 0, FALSE);
+        out[hlen] = ctx->lits[0];
+
+        return hlen + 1;
+    }
+
+    // Not worth building a Huffman table for a handful of literals
+    if (num_lits < 64)
+        return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+    zstd_huffman_lengths(counts, ctx->huf_lengths);
+
+    for (i = 0; i < 256; i++) {
+        if (ctx->huf_lengths[i] > max_bits)
+            max_bits = ctx->huf_lengths[i];
+    }
+
+    // Work out the canonical codes the same way the decoder does
+
+    RtlZeroMemory(wcounts, sizeof(wcounts));
+
+    for (i = 0; i <= last; i++) {
+        weights[i] = ctx->huf_lengths[i] == 0 ? 0 : (UINT8)(max_bits + 1 - ctx->huf_lengths[i]);
+        wcounts[weights[i]]++;
+    }
+
+    total = 0;
+    for (i = 1; i <= max_bits; i++) {
+        start[i] = total;
+        total += wcounts[i] << (i - 1);
+    }
+
+    for (i = 0; i <= last; i++) {
+        UINT32 wt = weights[i];
+
+        if (wt == 0)
+            continue;
+
+        ctx->huf_codes[i] = (UINT16)(start[wt] >> (wt - 1));
+        start[wt] += 1 << (wt - 1);
+    }
+
+    four_streams = num_lits >= 1024;
+    hlen = num_lits < 1024 ? 3 : (num_lits < 16384 ? 4 : 5);
+
+    if (hlen + 1 >= outlen)
+        return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+    // The last weight is implied
+    tlen = zstd_write_huffman_weights(out + hlen, outlen - hlen, weights, last);
+    if (tlen == 0)
+        return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+    pos = hlen + tlen;
+
+    if (!four_streams) {
+        UINT32 size = zstd_write_huffman_stream(ctx, out + pos, outlen - pos, ctx->lits, num_lits);
+
+        if (size == 0)
+            return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+        pos += size;
+    } else {
+        UINT32 seg = (num_lits + 3) / 4, jump = pos;
+
+        if (pos + 6 >= outlen)
+            return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+        pos += 6;
+
+        for (i = 0; i < 4; i++) {
+            UINT32 size = zstd_write_huffman_stream(ctx, out + pos, outlen - pos, ctx->lits + (i * seg), i == 3 ? num_lits - (3 * seg) : seg);
+
+            if (size == 0 || (i < 3 && size > 0xffff))
+                return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+            if (i < 3) {
+                out[jump + (i * 2)] = (UINT8)size;
+                out[jump + (i * 2) + 1] = (UINT8)(size >> 8);
+            }
+
+            pos += size;
+        }
+    }
+
+    if (pos >= hlen + num_lits || hlen != zstd_write_literals_header(out, ZSTD_LITERALS_COMPRESSED, num_lits, pos - hlen, four_streams))
+        return zstd_write_raw_literals(out, outlen, ctx->lits, num_lits);
+
+    return pos;
+}
+
+static __inline UINT8 zstd_ll_code(UINT32 litlen) {
+    UINT8 code;
+
+    if (litlen < 16)
+        return (UINT8)litlen;
+    else if (litlen >= 64)
+        return (UINT8)(zstd_highbit(litlen) + 19);
+
+    for (code = 24; zstd_ll_base[code] > litlen; code--);
+
+    return code;
+}
+
+static __inline UINT8 zstd_ml_code(UINT32 matchlen) {
+    UINT8 code;
+
+    if (matchlen < 35)
+        return (UINT8)(matchlen - 3);
+    else if (matchlen >= 131)
+        return (UINT8)(zstd_highbit(matchlen - 3) + 36);
+
+    for (code = 42; zstd_ml_base[code] > matchlen; code--);
+
+    return code;
+}
+
+static UINT32 zstd_write_seq_table(UINT8* out, UINT32 outlen, const UINT8* codes, UINT32 num_seqs, const zstd_seq_params* params,
+                                   zstd_fse_ctable* ct, UINT32* mode) {
+    UINT32 counts[ZSTD_FSE_MAX_SYMBOLS], distinct = 0, i, log;
+    INT16 probs[ZSTD_FSE_MAX_SYMBOLS];
+
+    if (num_seqs < ZSTD_FSE_MIN_SEQUENCES) {
+        zstd_build_fse_ctable(ct, params->probs, params->num_probs, params->log);
+        *mode = ZSTD_MODE_PREDEFINED;
+        return 0;
+    }
+
+    RtlZeroMemory(counts, sizeof(counts));
+
+    for (i = 0; i < num_seqs; i++) {
+        if (counts[codes[i]] == 0)
+            distinct++;
+
+        counts[codes[i]]++;
+    }
+
+    if (distinct == 1) {
+        if (outlen < 1)
+            return 0xffffffff;
+
+        ct->rle = TRUE;
+        out[0] = codes[0];
+        *mode = ZSTD_MODE_RLE;
+        return 1;
+    }
+
+    log = zstd_fse_log(num_seqs, distinct, params->max_log);
+
+    zstd_normalize(counts, params->max_symbol + 1, num_seqs, log, probs);
+    zstd_build_fse_ctable(ct, probs, params->max_symbol + 1, log);
+    *mode = ZSTD_MODE_FSE;
+
+    i = zstd_write_fse_table(out, outlen, probs, log);
+
+    return i == 0 ? 0xffffffff : i;
+}
+
+static __inline void zstd_seq_init_state(UINT32* state, const zstd_fse_ctable* ct, UINT32 symbol) {
+    if (!ct->rle)
+        zstd_fse_init_state(state, ct, symbol);
+}
+
+static __inline void zstd_seq_encode(zstd_wbits* w, UINT32* state, const zstd_fse_ctable* ct, UINT32 symbol) {
+    if (!ct->rle)
+        zstd_fse_encode(w, state, ct, symbol);
+}
+
+static __inline void zstd_seq_flush(zstd_wbits* w, UINT32 state, const zstd_fse_ctable* ct) {
+    if (!ct->rle)
+        zstd_write_bits(w, state, ct->log);
+}
+
+static __inline void zstd_write_seq_extra(zstd_wbits* w, const zstd_seq* seq, const UINT8* codes) {
+    zstd_write_bits(w, seq->litlen - zstd_ll_base[codes[0]], zstd_ll_bits[codes[0]]);
+    zstd_write_bits(w, seq->matchlen - zstd_ml_base[codes[1]], zstd_ml_bits[codes[1]]);
+    zstd_write_bits(w, seq->offset - (1 << codes[2]), codes[2]);
+}
+
+static UINT32 zstd_write_sequences(zstd_cctx* ctx, UINT8* out, UINT32 outlen) {
+    UINT32 num_seqs = ctx->num_seqs, pos, i, size, ll_state = 0, ml_state = 0, of_state = 0;
+    UINT32 ll_mode, ml_mode, of_mode, modes;
+    UINT8* ll_codes = ctx->codes;
+    UINT8* ml_codes = ctx->codes + num_seqs;
+    UINT8* of_codes = ctx->codes + (2 * num_seqs);
+    UINT8 codes[3];
+    zstd_wbits w;
+
+    if (outlen < 4)
+        return 0;
+
+    if (num_seqs < 128) {
+        out[0] = (UINT8)num_seqs;
+        pos = 1;
+    } else if (num_seqs < 0x7f00) {
+        out[0] = (UINT8)((num_seqs >> 8) + 128);
+        out[1] = (UINT8)num_seqs;
+        pos = 2;
+    } else {
+        out[0] = 255;
+        out[1] = (UINT8)(num_seqs - 0x7f00);
+        out[2] = (UINT8)((num_seqs - 0x7f00) >> 8);
+        pos = 3;
+    }
+
+    if (num_seqs == 0)
+        return pos;
+
+    for (i = 0; i < num_seqs; i++) {
+        ll_codes[i] = zstd_ll_code(ctx->seqs[i].litlen);
+        ml_codes[i] = zstd_ml_code(ctx->seqs[i].matchlen);
+        of_codes[i] = (UINT8)zstd_highbit(ctx->seqs[i].offset);
+    }
+
+    modes = pos++;
+
+    size = zstd_write_seq_table(out + pos, outlen - pos, ll_codes, num_seqs, &zstd_ll_params, &ctx->ll, &ll_mode);
+    if (size == 0xffffffff)
+        return 0;
+
+    pos += size;
+
+    size = zstd_write_seq_table(out + pos, outlen - pos, of_codes, num_seqs, &zstd_of_params, &ctx->of, &of_mode);
+    if (size == 0xffffffff)
+        return 0;
+
+    pos += size;
+
+    size = zstd_write_seq_table(out + pos, outlen - pos, ml_codes, num_seqs, &zstd_ml_params, &ctx->ml, &ml_mode);
+    if (size == 0xffffffff)
+        return 0;
+
+    pos += size;
+
+    out[modes] = (UINT8)((ll_mode << 6) | (of_mode << 4) | (ml_mode << 2));
+
+    // Like everything else, the sequences get written in reverse
+
+    zstd_init_wbits(&w, out + pos, outlen - pos);
+
+    i = num_seqs - 1;
+    codes[0] = ll_codes[i];
+    codes[1] = ml_codes[i];
+    codes[2] = of_codes[i];
+
+    zstd_seq_init_state(&ml_state, &ctx->ml, codes[1]);
+    zstd_seq_init_state(&of_state, &ctx->of, codes[2]);
+    zstd_seq_init_state(&ll_state, &ctx->ll, codes[0]);
+    zstd_write_seq_extra(&w, &ctx->seqs[i], codes);
+
+    while (i > 0) {
+        i--;
+
+        codes[0] = ll_codes[i];
+        codes[1] = ml_codes[i];
+        codes[2] = of_codes[i];
+
+        zstd_seq_encode(&w, &of_state, &ctx->of, codes[2]);
+        zstd_seq_encode(&w, &ml_state, &ctx->ml, codes[1]);
+        zstd_seq_encode(&w, &ll_state, &ctx->ll, codes[0]);
+        zstd_write_seq_extra(&w, &ctx->seqs[i], codes);
+    }
+
+    zstd_seq_flush(&w, ml_state, &ctx->ml);
+    zstd_seq_flush(&w, of_state, &ctx->of);
+    zstd_seq_flush(&w, ll_state, &ctx->ll);
+
+    size = zstd_flush_wbits(&w, TRUE);
+    if (size == 0)
+        return 0;
+
+    return pos + size;
+}
+
+static __inline UINT32 zstd_hash(const UINT8* p) {
+    return (zstd_read32(p) * 2654435761u) >> (32 - ZSTD_HASH_LOG);
+}
+
+static __inline UINT32 zstd_match_length(const UINT8* a, const UINT8* b, const UINT8* end) {
+    const UINT8* start = b;
+
+    while (b < end && *a == *b) {
+        a++;
+        b++;
+    }
+
+    return (UINT32)(b - start);
+}
+
+static void zstd_insert(zstd_cctx* ctx, const UINT8* in, UINT32 upto) {
+    while (ctx->next_insert < upto) {
+        UINT32 h = zstd_hash(in + ctx->next_insert);
+
+        ctx->chain[ctx->next_insert] = ctx->hash[h];
+        ctx->hash[h] = ctx->next_insert + 1; // 0 means empty
+        ctx->next_insert++;
+    }
+}
+
+static UINT32 zstd_find_match(zstd_cctx* ctx, const UINT8* in, UINT32 pos, UINT32 end, UINT32 litlen, UINT32* offset) {
+    UINT32 best = 0, cand, depth = ctx->depth;
+
+    // Check the last offset first, as it's nearly free to encode
+    if (litlen > 0 && ctx->rep[0] <= pos) {
+        best = zstd_match_length(in + pos - ctx->rep[0], in + pos, in + end);
+
+        if (best >= ZSTD_MIN_MATCH) {
+            *offset = ctx->rep[0];
+
+            if (pos + best == end)
+                return best;
+        } else
+            best = 0;
+    }
+
+    zstd_insert(ctx, in, pos);
+
+    cand = ctx->hash[zstd_hash(in + pos)];
+
+    while (cand != 0 && depth > 0) {
+        cand--;
+
+        if (in[cand + best] == in[pos + best]) {
+            UINT32 l = zstd_match_length(in + cand, in + pos, in + end);
+
+            if (l > best && l >= ZSTD_MIN_MATCH) {
+                best = l;
+                *offset = pos - cand;
+
+                if (pos + best == end)
+                    break;
+            }
+        }
+
+        cand = ctx->chain[cand];
+        depth--;
+    }
+
+    return best;
+}
+
+static void zstd_add_seq(zstd_cctx* ctx, const UINT8* lits, UINT32 litlen, UINT32 matchlen, UINT32 offset) {
+    zstd_seq* seq = &ctx->seqs[ctx->num_seqs];
+
+    RtlCopyMemory(ctx->lits + ctx->num_lits, lits, litlen);
+    ctx->num_lits += litlen;
+
+    seq->litlen = litlen;
+    seq->matchlen = matchlen;
+
+    // Offsets 1 to 3 mean a repeated offset - we only use the first one, which means
+    // something else if there are no literals
+    if (litlen > 0 && offset == ctx->rep[0])
+        seq->offset = 1;
+    else {
+        seq->offset = offset + 3;
+        ctx->rep[2] = ctx->rep[1];
+        ctx->rep[1] = ctx->rep[0];
+        ctx->rep[0] = offset;
+    }
+
+    ctx->num_seqs++;
+}
+
+// Matches can point back into earlier blocks, but can't run on past the end of this one
+static UINT32 zstd_compress_block(zstd_cctx* ctx, const UINT8* in, UINT32 start, UINT32 end, UINT8* out, UINT32 outlen) {
+    UINT32 pos = start, anchor = start, size, seqsize, offset = 0, matchlen;
+
+    ctx->num_seqs = 0;
+    ctx->num_lits = 0;
+
+    // The last few bytes can't start a match, as we need four bytes to hash
+    while (end - pos >= ZSTD_MIN_MATCH) {
+        matchlen = zstd_find_match(ctx, in, pos, end, pos - anchor, &offset);
+
+        if (matchlen == 0) {
+            pos++;
+            continue;
+        }
+
+        // Lazy matching - see if we'd do better by starting at the next byte
+        while (ctx->lazy && end - pos > ZSTD_MIN_MATCH) {
+            UINT32 offset2 = 0, matchlen2;
+
+            matchlen2 = zstd_find_match(ctx, in, pos + 1, end, pos + 1 - anchor, &offset2);
+
+            if (matchlen2 <= matchlen)
+                break;
+
+            pos++;
+            matchlen = matchlen2;
+            offset = offset2;
+        }
+
+        zstd_add_seq(ctx, in + anchor, pos - anchor, matchlen, offset);
+
+        pos += matchlen;
+        anchor = pos;
+    }
+
+    RtlCopyMemory(ctx->lits + ctx->num_lits, in + anchor, end - anchor);
+    ctx->num_lits += end - anchor;
+
+    size = zstd_write_literals(ctx, out, outlen);
+    if (size == 0)
+        return 0;
+
+    seqsize = zstd_write_sequences(ctx, out + size, outlen - size);
+    if (seqsize == 0)
+        return 0;
+
+    return size + seqsize;
+}
+
+NTSTATUS zstd_compress(const UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen, UINT32 level, UINT32* complen) {
+    zstd_cctx* ctx;
+    UINT32 inpos = 0, outpos, saved_rep[3];
+
+    if (outlen < 18)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    ctx = ExAllocatePoolWithTag(PagedPool, sizeof(zstd_cctx), ALLOC_TAG_ZSTD);
+    if (!ctx) {
+        ERR("out of memory\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    ctx->chain = ExAllocatePoolWithTag(PagedPool, (inlen * sizeof(UINT32)) + (inlen * sizeof(zstd_seq) / ZSTD_MIN_MATCH) + sizeof(zstd_seq) +
+                                       min(inlen, ZSTD_BLOCK_SIZE_MAX) + (3 * (min(inlen, ZSTD_BLOCK_SIZE_MAX) / ZSTD_MIN_MATCH + 1)), ALLOC_TAG_ZSTD);
+    if (!ctx->chain) {
+        ERR("out of memory\n");
+        ExFreePool(ctx);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    ctx->seqs = (zstd_seq*)(ctx->chain + inlen);
+    ctx->lits = (UINT8*)(ctx->seqs + (inlen / ZSTD_MIN_MATCH) + 1);
+    ctx->codes = ctx->lits + min(inlen, ZSTD_BLOCK_SIZE_MAX);
+
+    // Higher levels search further back, and from level 3 onwards we match lazily
+    ctx->depth = 1 << min(level - 1, 8);
+    ctx->lazy = level >= 3;
+
+    RtlZeroMemory(ctx->hash, sizeof(ctx->hash));
+    ctx->next_insert = 0;
+    ctx->rep[0] = 1;
+    ctx->rep[1] = 4;
+    ctx->rep[2] = 8;
+
+    // frame header - we put the whole extent in a single segment, and don't bother with a checksum
+
+    *(UINT32*)outbuf = ZSTD_MAGIC;
+    outpos = sizeof(UINT32);
+
+    if (inlen < 256) {
+        outbuf[outpos++] = 0x20;
+        outbuf[outpos++] = (UINT8)inlen;
+    } else if (inlen < 65536 + 256) {
+        outbuf[outpos++] = 0x60;
+        outbuf[outpos++] = (UINT8)(inlen - 256);
+        outbuf[outpos++] = (UINT8)((inlen - 256) >> 8);
+    } else {
+        outbuf[outpos++] = 0xa0;
+        outbuf[outpos++] = (UINT8)inlen;
+        outbuf[outpos++] = (UINT8)(inlen >> 8);
+        outbuf[outpos++] = (UINT8)(inlen >> 16);
+        outbuf[outpos++] = (UINT8)(inlen >> 24);
+    }
+
+    do {
+        UINT32 len = min(inlen - inpos, ZSTD_BLOCK_SIZE_MAX), size, hdr;
+        BOOL last = inpos + len == inlen;
+
+        if (outpos + 3 > outlen) {
+            ExFreePool(ctx->chain);
+            ExFreePool(ctx);
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+
+        RtlCopyMemory(saved_rep, ctx->rep, sizeof(saved_rep));
+
+        size = zstd_compress_block(ctx, inbuf, inpos, inpos + len, outbuf + outpos + 3, min(outlen - outpos - 3, len));
+
+        if (size == 0 || size >= len) {
+            // Compressing didn't help, so store the block as it is. The repeat offsets
+            // are only updated by compressed blocks.
+
+            RtlCopyMemory(ctx->rep, saved_rep, sizeof(saved_rep));
+
+            if (outpos + 3 + len > outlen) {
+                ExFreePool(ctx->chain);
+                ExFreePool(ctx);
+                return STATUS_BUFFER_TOO_SMALL;
+            }
+
+            RtlCopyMemory(outbuf + outpos + 3, inbuf + inpos, len);
+            size = len;
+            hdr = (ZSTD_BLOCK_RAW << 1) | (size << 3);
+        } else
+            hdr = (ZSTD_BLOCK_COMPRESSED << 1) | (size << 3);
+
+        if (last)
+            hdr |= 1;
+
+        outbuf[outpos] = (UINT8)hdr;
+        outbuf[outpos + 1] = (UINT8)(hdr >> 8);
+        outbuf[outpos + 2] = (UINT8)(hdr >> 16);
+
+        outpos += 3 + size;
+        inpos += len;
+    } while (inpos < inlen);
+
+    ExFreePool(ctx->chain);
+    ExFreePool(ctx);
+
+    *complen = outpos;
+
+    return STATUS_SUCCESS;
+}
@@ -639,6 +639,8 @@ FATAddEntry(
     CcSetDirtyPinnedData(Context, NULL);
     CcUnpinData(Context);
 
+    vfatNameIndexAdd(ParentFcb, &DirContext.LongNameU, &DirContext.ShortNameU, DirContext.StartIndex);
+
     if (MoveContext != NULL)
     {
         /* We're modifying an existing FCB - likely rename/move */
@@ -881,6 +883,8 @@ FATDelEntry(
         CcUnpinData(Context);
     }
 
+    vfatNameIndexRemove(pFcb->parentFcb, &pFcb->LongNameU, &pFcb->ShortNameU, pFcb->startIndex);
+
     /* In case of moving, don't delete data */
     if (MoveContext == NULL)
     {
@@ -413,7 +413,11 @@ FAT12CountAvailableClusters(
         }
 
         if (Entry == 0)
+        {
             ulCount++;
+            if (DeviceExt->FreeClusterMapBuffer)
+                RtlClearBit(&DeviceExt->FreeClusterMap, i);
+        }
     }
 
     CcUnpinData(Context);
@@ -464,7 +468,11 @@ FAT16CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if (*Block == 0)
+            {
                 ulCount++;
+                if (DeviceExt->FreeClusterMapBuffer)
+                    RtlClearBit(&DeviceExt->FreeClusterMap, i);
+            }
             Block++;
             i++;
         }
@@ -520,7 +528,11 @@ FAT32CountAvailableClusters(
         while (Block < BlockEnd && i < FatLength)
         {
             if ((*Block & 0x0fffffff) == 0)
+            {
                 ulCount++;
+                if (DeviceExt->FreeClusterMapBuffer)
+                    RtlClearBit(&DeviceExt->FreeClusterMap, i);
+            }
             Block++;
             i++;
         }
@@ -534,6 +546,19 @@ FAT32CountAvailableClusters(
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+ScanAvailableClusters(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FatInfo.FatType == FAT12)
+        return FAT12CountAvailableClusters(DeviceExt);
+    else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
+        return FAT16CountAvailableClusters(DeviceExt);
+    else
+        return FAT32CountAvailableClusters(DeviceExt);
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
@@ -542,20 +567,60 @@ CountAvailableClusters(
     NTSTATUS Status = STATUS_SUCCESS;
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
-    {
-        if (DeviceExt->FatInfo.FatType == FAT12)
-            Status = FAT12CountAvailableClusters(DeviceExt);
-        else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
-            Status = FAT16CountAvailableClusters(DeviceExt);
-        else
-            Status = FAT32CountAvailableClusters(DeviceExt);
-    }
+        Status = ScanAvailableClusters(DeviceExt);
     Clusters->QuadPart = DeviceExt->AvailableClusters;
     ExReleaseResourceLite (&DeviceExt->FatResource);
 
     return Status;
 }
 
+/*
+ * FUNCTION: Builds the in-memory map of the used clusters at mount time, so
+ *           that allocations don't have to scan the FAT anymore
+ */
+NTSTATUS
+InitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    NTSTATUS Status;
+    ULONG Clusters = DeviceExt->FatInfo.NumberOfClusters + 2;
+
+    /* Without the map, we just keep scanning the FAT */
+    DeviceExt->FreeClusterMapBuffer = ExAllocatePoolWithTag(PagedPool,
+                                                            ROUND_UP(Clusters, 32) / 8,
+                                                            TAG_VFAT);
+    if (DeviceExt->FreeClusterMapBuffer == NULL)
+    {
+        DPRINT1("No memory for the map of %u clusters\n", Clusters);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Everything is in use until the FAT says otherwise, including the
+     * two reserved entries */
+    RtlInitializeBitMap(&DeviceExt->FreeClusterMap, DeviceExt->FreeClusterMapBuffer, Clusters);
+    RtlSetAllBits(&DeviceExt->FreeClusterMap);
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+    Status = ScanAvailableClusters(DeviceExt);
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    if (!NT_SUCCESS(Status))
+        FreeFreeClusterMap(DeviceExt);
+
+    return Status;
+}
+
+VOID
+FreeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FreeClusterMapBuffer)
+    {
+        ExFreePoolWithTag(DeviceExt->FreeClusterMapBuffer, TAG_VFAT);
+        DeviceExt->FreeClusterMapBuffer = NULL;
+    }
+}
+
 
 /*
  * FUNCTION: Writes a cluster to the FAT12 physical and in-memory tables
@@ -713,6 +778,14 @@ WriteCluster(
         else if (OldValue == 0 && NewValue)
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
     }
+    if (NT_SUCCESS(Status) && DeviceExt->FreeClusterMapBuffer &&
+        ClusterToWrite < DeviceExt->FreeClusterMap.SizeOfBitMap)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->FreeClusterMap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->FreeClusterMap, ClusterToWrite);
+    }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
@@ -760,6 +833,94 @@ GetNextCluster(
     return Status;
 }
 
+/*
+ * FUNCTION: Allocates up to Count contiguous clusters, chains them together
+ *           and appends them to PreviousCluster, unless it is 0. Fewer
+ *           clusters are returned when there is no run long enough
+ */
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG PreviousCluster,
+    ULONG Count,
+    PULONG FirstCluster,
+    PULONG Allocated)
+{
+    NTSTATUS Status;
+    ULONG Cluster, Length, i;
+
+    ASSERT(Count > 0);
+
+    *FirstCluster = 0;
+    *Allocated = 0;
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+
+    if (DeviceExt->FreeClusterMapBuffer)
+    {
+        /* Try to get everything at once, close to the last allocation */
+        Length = Count;
+        Cluster = RtlFindClearBits(&DeviceExt->FreeClusterMap, Count, DeviceExt->LastAvailableCluster);
+        if (Cluster == MAXULONG)
+        {
+            /* Otherwise, the longest run will do */
+            Length = RtlFindLongestRunClear(&DeviceExt->FreeClusterMap, &Cluster);
+            if (Length == 0)
+            {
+                ExReleaseResourceLite(&DeviceExt->FatResource);
+                return STATUS_DISK_FULL;
+            }
+            Length = min(Length, Count);
+        }
+
+        /* Chain the run, from its end so that it is never left unterminated */
+        for (i = Length; i > 0; i--)
+        {
+            Status = WriteCluster(DeviceExt, Cluster + i - 1,
+                                  i == Length ? 0xffffffff : Cluster + i);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Give back what we took */
+                for (; i < Length; i++)
+                    WriteCluster(DeviceExt, Cluster + i, 0);
+                ExReleaseResourceLite(&DeviceExt->FatResource);
+                return Status;
+            }
+        }
+
+        DeviceExt->LastAvailableCluster = Cluster + Length - 1;
+    }
+    else
+    {
+        /* No map, fall back to scanning the FAT for a single cluster */
+        Length = 1;
+        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &Cluster);
+        if (!NT_SUCCESS(Status))
+        {
+            ExReleaseResourceLite(&DeviceExt->FatResource);
+            return Status;
+        }
+    }
+
+    if (PreviousCluster != 0)
+    {
+        Status = WriteCluster(DeviceExt, PreviousCluster, Cluster);
+        if (!NT_SUCCESS(Status))
+        {
+            for (i = 0; i < Length; i++)
+                WriteCluster(DeviceExt, Cluster + i, 0);
+            ExReleaseResourceLite(&DeviceExt->FatResource);
+            return Status;
+        }
+    }
+
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    *FirstCluster = Cluster;
+    *Allocated = Length;
+    return STATUS_SUCCESS;
+}
+
 /*
  * FUNCTION: Retrieve the next cluster depending on the FAT type
  */
@@ -769,7 +930,7 @@ GetNextClusterExtend(
     ULONG CurrentCluster,
     PULONG NextCluster)
 {
-    ULONG NewCluster;
+    ULONG NewCluster, Allocated;
     NTSTATUS Status;
 
     DPRINT("GetNextClusterExtend(DeviceExt %p, CurrentCluster %x)\n",
@@ -782,16 +943,11 @@ GetNextClusterExtend(
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
-        {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
-        }
-
-        *NextCluster = NewCluster;
+        Status = AllocateClusters(DeviceExt, 0, 1, &NewCluster, &Allocated);
+        if (NT_SUCCESS(Status))
+            *NextCluster = NewCluster;
         ExReleaseResourceLite(&DeviceExt->FatResource);
-        return STATUS_SUCCESS;
+        return Status;
     }
 
     Status = DeviceExt->GetNextCluster(DeviceExt, CurrentCluster, NextCluster);
@@ -799,19 +955,9 @@ GetNextClusterExtend(
     if ((*NextCluster) == 0xFFFFFFFF)
     {
         /* We are after last existing cluster, we must add one to file */
-        /* Firstly, find the next available open allocation unit and
-           mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
-        if (!NT_SUCCESS(Status))
-        {
-            ExReleaseResourceLite(&DeviceExt->FatResource);
-            return Status;
-        }
-
-        /* Now, write the AU of the LastCluster with the value of the newly
-           found AU */
-        WriteCluster(DeviceExt, CurrentCluster, NewCluster);
-        *NextCluster = NewCluster;
+        Status = AllocateClusters(DeviceExt, CurrentCluster, 1, &NewCluster, &Allocated);
+        if (NT_SUCCESS(Status))
+            *NextCluster = NewCluster;
     }
 
     ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -271,6 +271,7 @@ vfatDestroyFCB(
         RemoveEntryList(&pFCB->ParentListEntry);
     }
     ExFreePool(pFCB->PathNameBuffer);
+    vfatFreeNameIndex(pFCB);
     ExDeleteResourceLite(&pFCB->PagingIoResource);
     ExDeleteResourceLite(&pFCB->MainResource);
     ASSERT(IsListEmpty(&pFCB->ParentListHead));
@@ -760,6 +761,290 @@ vfatAttachFCBToFileObject(
     return STATUS_SUCCESS;
 }
 
+/*
+ * Big directories get an index of the hashes of their long and short names,
+ * giving the index of the first entry for each name. Candidates are always
+ * decoded again and compared, so the index only has to be complete: every
+ * name of the directory must be in it, or there must be no index at all.
+ * It is only used and modified with the DirResource held exclusively.
+ */
+
+static
+ULONG
+vfatNameIndexHash(
+    PUNICODE_STRING NameU)
+{
+    ULONG i, Hash = 0;
+
+    /* Names are compared case insensitively, so we use the same upcasing */
+    for (i = 0; i < NameU->Length / sizeof(WCHAR); i++)
+        Hash = Hash * 37 + RtlUpcaseUnicodeChar(NameU->Buffer[i]);
+
+    return Hash;
+}
+
+static
+PVFAT_NAME_INDEX
+vfatAllocateNameIndex(
+    ULONG Size)
+{
+    PVFAT_NAME_INDEX Index;
+    ULONG i;
+
+    Index = ExAllocatePoolWithTag(PagedPool,
+                                  FIELD_OFFSET(VFAT_NAME_INDEX, Slots[Size]),
+                                  TAG_NIDX);
+    if (Index == NULL)
+        return NULL;
+
+    Index->Size = Size;
+    Index->Used = 0;
+    for (i = 0; i < Size; i++)
+        Index->Slots[i].StartIndex = VFAT_NAME_INDEX_FREE;
+
+    return Index;
+}
+
+VOID
+vfatFreeNameIndex(
+    PVFATFCB DirFcb)
+{
+    if (DirFcb->NameIndex != NULL)
+    {
+        ExFreePoolWithTag(DirFcb->NameIndex, TAG_NIDX);
+        DirFcb->NameIndex = NULL;
+    }
+}
+
+static
+BOOLEAN
+vfatNameIndexInsert(
+    PVFATFCB DirFcb,
+    ULONG Hash,
+    ULONG StartIndex)
+{
+    PVFAT_NAME_INDEX Index = DirFcb->NameIndex, NewIndex;
+    ULONG i, Slot, Live;
+
+    /* Keep at least half of the slots free, deleted ones included */
+    if ((Index->Used + 1) * 2 > Index->Size)
+    {
+        /* Only grow if it isn't just full of deleted slots */
+        for (i = 0, Live = 0; i < Index->Size; i++)
+        {
+            if (Index->Slots[i].StartIndex < VFAT_NAME_INDEX_DELETED)
+                Live++;
+        }
+
+        NewIndex = vfatAllocateNameIndex((Live + 1) * 4 > Index->Size ? Index->Size * 2 : Index->Size);
+        if (NewIndex == NULL)
+            return FALSE;
+
+        for (i = 0; i < Index->Size; i++)
+        {
+            if (Index->Slots[i].StartIndex >= VFAT_NAME_INDEX_DELETED)
+                continue;
+
+            Slot = Index->Slots[i].Hash & (NewIndex->Size - 1);
+            while (NewIndex->Slots[Slot].StartIndex != VFAT_NAME_INDEX_FREE)
+                Slot = (Slot + 1) & (NewIndex->Size - 1);
+            NewIndex->Slots[Slot] = Index->Slots[i];
+            NewIndex->Used++;
+        }
+
+        ExFreePoolWithTag(Index, TAG_NIDX);
+        DirFcb->NameIndex = Index = NewIndex;
+    }
+
+    Slot = Hash & (Index->Size - 1);
+    while (Index->Slots[Slot].StartIndex != VFAT_NAME_INDEX_FREE)
+        Slot = (Slot + 1) & (Index->Size - 1);
+
+    Index->Slots[Slot].Hash = Hash;
+    Index->Slots[Slot].StartIndex = StartIndex;
+    Index->Used++;
+
+    return TRUE;
+}
+
+/*
+ * FUNCTION: Adds the names of a new directory entry to the index of its
+ *           directory, if it has one
+ */
+VOID
+vfatNameIndexAdd(
+    PVFATFCB DirFcb,
+    PUNICODE_STRING LongNameU,
+    PUNICODE_STRING ShortNameU,
+    ULONG StartIndex)
+{
+    ULONG LongHash, ShortHash;
+
+    if (DirFcb->NameIndex == NULL)
+        return;
+
+    /* Entries without both names are never found, see vfatDirFindFile */
+    if (LongNameU->Length == 0 || ShortNameU->Length == 0)
+        return;
+
+    LongHash = vfatNameIndexHash(LongNameU);
+    ShortHash = vfatNameIndexHash(ShortNameU);
+
+    if (!vfatNameIndexInsert(DirFcb, LongHash, StartIndex) ||
+        (ShortHash != LongHash && !vfatNameIndexInsert(DirFcb, ShortHash, StartIndex)))
+    {
+        /* An incomplete index is worse than none */
+        DPRINT1("Dropping the name index of %wZ\n", &DirFcb->PathNameU);
+        vfatFreeNameIndex(DirFcb);
+    }
+}
+
+static
+VOID
+vfatNameIndexDelete(
+    PVFAT_NAME_INDEX Index,
+    ULONG Hash,
+    ULONG StartIndex)
+{
+    ULONG Slot = Hash & (Index->Size - 1);
+
+    while (Index->Slots[Slot].StartIndex != VFAT_NAME_INDEX_FREE)
+    {
+        if (Index->Slots[Slot].Hash == Hash &&
+            Index->Slots[Slot].StartIndex == StartIndex)
+        {
+            /* The slot stays used, so that probing goes on past it */
+            Index->Slots[Slot].StartIndex = VFAT_NAME_INDEX_DELETED;
+            return;
+        }
+        Slot = (Slot + 1) & (Index->Size - 1);
+    }
+}
+
+/*
+ * FUNCTION: Removes the names of a deleted directory entry from the index
+ *           of its directory
+ */
+VOID
+vfatNameIndexRemove(
+    PVFATFCB DirFcb,
+    PUNICODE_STRING LongNameU,
+    PUNICODE_STRING ShortNameU,
+    ULONG StartIndex)
+{
+    if (DirFcb->NameIndex == NULL)
+        return;
+
+    vfatNameIndexDelete(DirFcb->NameIndex, vfatNameIndexHash(LongNameU), StartIndex);
+    vfatNameIndexDelete(DirFcb->NameIndex, vfatNameIndexHash(ShortNameU), StartIndex);
+}
+
+static
+VOID
+vfatBuildNameIndex(
+    PDEVICE_EXTENSION pDeviceExt,
+    PVFATFCB pDirectoryFCB,
+    PVFAT_DIRENTRY_CONTEXT DirContext)
+{
+    NTSTATUS Status;
+    PVOID Context = NULL;
+    PVOID Page = NULL;
+    BOOLEAN First = TRUE;
+
+    pDirectoryFCB->NameIndex = vfatAllocateNameIndex(VFAT_NAME_INDEX_INITIAL_SIZE);
+    if (pDirectoryFCB->NameIndex == NULL)
+        return;
+
+    DirContext->DirIndex = 0;
+    while (TRUE)
+    {
+        Status = VfatGetNextDirEntry(pDeviceExt, &Context, &Page, pDirectoryFCB, DirContext, First);
+        First = FALSE;
+        if (Status == STATUS_NO_MORE_ENTRIES)
+            break;
+
+        if (!NT_SUCCESS(Status))
+        {
+            vfatFreeNameIndex(pDirectoryFCB);
+            break;
+        }
+
+        if (!ENTRY_VOLUME(FALSE, &DirContext->DirEntry))
+        {
+            vfatNameIndexAdd(pDirectoryFCB, &DirContext->LongNameU, &DirContext->ShortNameU, DirContext->StartIndex);
+            if (pDirectoryFCB->NameIndex == NULL)
+                break;
+        }
+
+        DirContext->DirIndex++;
+    }
+
+    if (Context != NULL)
+        CcUnpinData(Context);
+
+    DPRINT("Indexed %wZ: %u slots used\n", &pDirectoryFCB->PathNameU,
+           pDirectoryFCB->NameIndex ? pDirectoryFCB->NameIndex->Used : 0);
+}
+
+static
+NTSTATUS
+vfatNameIndexFindFile(
+    PDEVICE_EXTENSION pDeviceExt,
+    PVFATFCB pDirectoryFCB,
+    PUNICODE_STRING FileToFindU,
+    PVFAT_DIRENTRY_CONTEXT DirContext,
+    PVFATFCB *pFoundFCB)
+{
+    PVFAT_NAME_INDEX Index = pDirectoryFCB->NameIndex;
+    ULONG Hash = vfatNameIndexHash(FileToFindU);
+    ULONG Slot = Hash & (Index->Size - 1);
+    ULONG StartIndex;
+    PVOID Context;
+    PVOID Page;
+    NTSTATUS Status;
+
+    for (; Index->Slots[Slot].StartIndex != VFAT_NAME_INDEX_FREE;
+         Slot = (Slot + 1) & (Index->Size - 1))
+    {
+        StartIndex = Index->Slots[Slot].StartIndex;
+        if (StartIndex == VFAT_NAME_INDEX_DELETED || Index->Slots[Slot].Hash != Hash)
+            continue;
+
+        /* Decode this entry alone */
+        Context = NULL;
+        DirContext->DirIndex = StartIndex;
+        Status = VfatGetNextDirEntry(pDeviceExt, &Context, &Page, pDirectoryFCB, DirContext, TRUE);
+        if (Status == STATUS_NO_MORE_ENTRIES)
+            continue;
+        if (!NT_SUCCESS(Status))
+        {
+            if (Context != NULL)
+                CcUnpinData(Context);
+            return Status;
+        }
+
+        if (DirContext->StartIndex == StartIndex &&
+            !ENTRY_VOLUME(FALSE, &DirContext->DirEntry) &&
+            DirContext->LongNameU.Length != 0 &&
+            DirContext->ShortNameU.Length != 0 &&
+            (RtlEqualUnicodeString(FileToFindU, &DirContext->LongNameU, TRUE) ||
+             RtlEqualUnicodeString(FileToFindU, &DirContext->ShortNameU, TRUE)))
+        {
+            Status = vfatMakeFCBFromDirEntry(pDeviceExt,
+                pDirectoryFCB,
+                DirContext,
+                pFoundFCB);
+            CcUnpinData(Context);
+            return Status;
+        }
+
+        if (Context != NULL)
+            CcUnpinData(Context);
+    }
+
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
 NTSTATUS
 vfatDirFindFile(
     PDEVICE_EXTENSION pDeviceExt,
@@ -796,6 +1081,24 @@ vfatDirFindFile(
     DirContext.ShortNameU.Length = 0;
     DirContext.ShortNameU.MaximumLength = sizeof(ShortNameBuffer);
 
+    /* Index big directories on first use, instead of scanning them for each
+     * name. FATX volumes are always scanned */
+    if (!IsFatX)
+    {
+        if (pDirectoryFCB->NameIndex == NULL &&
+            pDirectoryFCB->RFCB.FileSize.u.LowPart >= VFAT_NAME_INDEX_MIN_SIZE)
+        {
+            vfatBuildNameIndex(pDeviceExt, pDirectoryFCB, &DirContext);
+        }
+
+        if (pDirectoryFCB->NameIndex != NULL)
+        {
+            return vfatNameIndexFindFile(pDeviceExt, pDirectoryFCB, FileToFindU, &DirContext, pFoundFCB);
+        }
+
+        DirContext.DirIndex = 0;
+    }
+
     while (TRUE)
     {
         status = VfatGetNextDirEntry(pDeviceExt,
@@ -734,6 +734,9 @@ VfatMount(
     DeviceExt->LastAvailableCluster = 2;
     ExInitializeResourceLite(&DeviceExt->FatResource);
 
+    /* Allocations go through the map when we could build it */
+    InitializeFreeClusterMap(DeviceExt);
+
     InitializeListHead(&DeviceExt->FcbListHead);
 
     VolumeFcb = vfatNewFCB(DeviceExt, &VolumeNameU);
@@ -796,6 +799,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VFAT);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_VFAT);
+        if (DeviceExt)
+            FreeFreeClusterMap(DeviceExt);
         if (Fcb)
             vfatDestroyFCB(Fcb);
         if (Ccb)
@@ -1220,6 +1225,7 @@ VfatDismountVolume(
     ExDeleteResourceLite(&DeviceExt->DirResource);
     ExDeleteResourceLite(&DeviceExt->FatResource);
     ObDereferenceObject(DeviceExt->FATFileObject);
+    FreeFreeClusterMap(DeviceExt);
 
     return STATUS_SUCCESS;
 }
@@ -58,7 +58,8 @@ OffsetToCluster(
     PULONG Cluster,
     BOOLEAN Extend)
 {
-    ULONG CurrentCluster;
+    ULONG CurrentCluster, NextCluster;
+    ULONG Count, Allocated;
     ULONG i;
     NTSTATUS Status;
 /*
@@ -84,11 +85,29 @@ OffsetToCluster(
         CurrentCluster = FirstCluster;
         if (Extend)
         {
-            for (i = 0; i < FileOffset / DeviceExt->FatInfo.BytesPerCluster; i++)
+            Count = FileOffset / DeviceExt->FatInfo.BytesPerCluster;
+            for (i = 0; i < Count; )
             {
-                Status = GetNextClusterExtend (DeviceExt, CurrentCluster, &CurrentCluster);
+                Status = GetNextCluster(DeviceExt, CurrentCluster, &NextCluster);
                 if (!NT_SUCCESS(Status))
                     return Status;
+
+                if (NextCluster == 0xffffffff)
+                {
+                    /* End of the chain, append all the missing clusters at once */
+                    Status = AllocateClusters(DeviceExt, CurrentCluster, Count - i, &NextCluster, &Allocated);
+                    if (!NT_SUCCESS(Status))
+                        return Status;
+
+                    /* They are contiguous */
+                    CurrentCluster = NextCluster + Allocated - 1;
+                    i += Allocated;
+                }
+                else
+                {
+                    CurrentCluster = NextCluster;
+                    i++;
+                }
             }
             *Cluster = CurrentCluster;
         }
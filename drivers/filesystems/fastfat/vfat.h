@@ -313,6 +313,8 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    RTL_BITMAP FreeClusterMap; /* Set bits are used clusters */
+    PULONG FreeClusterMapBuffer;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     PSTATISTICS Statistics;
@@ -410,6 +412,28 @@ extern PVFAT_GLOBAL_DATA VfatGlobalData;
 #define FCB_IS_VOLUME           0x0010
 #define FCB_IS_DIRTY            0x0020
 
+#define VFAT_NAME_INDEX_FREE            0xffffffff
+#define VFAT_NAME_INDEX_DELETED         0xfffffffe
+#define VFAT_NAME_INDEX_INITIAL_SIZE    1024
+/* Smaller directories are just scanned */
+#define VFAT_NAME_INDEX_MIN_SIZE        (16 * 1024)
+
+typedef struct _VFAT_NAME_INDEX_SLOT
+{
+    ULONG Hash;
+    /* Directory index where the long name starts, or one of the values above */
+    ULONG StartIndex;
+} VFAT_NAME_INDEX_SLOT, *PVFAT_NAME_INDEX_SLOT;
+
+typedef struct _VFAT_NAME_INDEX
+{
+    /* Power of two */
+    ULONG Size;
+    /* Slots which aren't free, deleted ones included */
+    ULONG Used;
+    VFAT_NAME_INDEX_SLOT Slots[1];
+} VFAT_NAME_INDEX, *PVFAT_NAME_INDEX;
+
 typedef struct _VFATFCB
 {
     /* FCB header required by ROS/NT */
@@ -493,6 +517,9 @@ typedef struct _VFATFCB
     FAST_MUTEX LastMutex;
     ULONG LastCluster;
     ULONG LastOffset;
+
+    /* Name lookup index for big directories, see vfatDirFindFile */
+    PVFAT_NAME_INDEX NameIndex;
 } VFATFCB, *PVFATFCB;
 
 #define CCB_DELETE_ON_CLOSE     0x0001
@@ -511,6 +538,7 @@ typedef struct _VFATCCB
 #define TAG_FCB  'BCFV'
 #define TAG_IRP  'PRIV'
 #define TAG_VFAT 'TAFV'
+#define TAG_NIDX 'XDIV'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -867,11 +895,27 @@ GetNextClusterExtend(
     ULONG CurrentCluster,
     PULONG NextCluster);
 
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG PreviousCluster,
+    ULONG Count,
+    PULONG FirstCluster,
+    PULONG Allocated);
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters);
 
+NTSTATUS
+InitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+FreeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt);
+
 NTSTATUS
 WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -950,6 +994,24 @@ vfatDirFindFile(
     PUNICODE_STRING FileToFindU,
     PVFATFCB *fileFCB);
 
+VOID
+vfatNameIndexAdd(
+    PVFATFCB DirFcb,
+    PUNICODE_STRING LongNameU,
+    PUNICODE_STRING ShortNameU,
+    ULONG StartIndex);
+
+VOID
+vfatNameIndexRemove(
+    PVFATFCB DirFcb,
+    PUNICODE_STRING LongNameU,
+    PUNICODE_STRING ShortNameU,
+    ULONG StartIndex);
+
+VOID
+vfatFreeNameIndex(
+    PVFATFCB DirFcb);
+
 NTSTATUS
 vfatGetFCBForFile(
     PDEVICE_EXTENSION pVCB,
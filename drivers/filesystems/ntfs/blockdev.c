@@ -304,6 +304,119 @@ NtfsWriteDisk(IN PDEVICE_OBJECT DeviceObject,
     return Status;
 }
 
+/**
+* @name NtfsReadDiskCached
+* @implemented
+*
+* Reads metadata through the volume stream file object, so that clusters that are read
+* over and over again, like those of the MFT and of directory indexes, are served by
+* the cache manager instead of the disk.
+*
+* @param DeviceExt
+* Volume to read from. Its stream file object must have been set up for caching.
+*
+* @param StartingOffset
+* Offset, in bytes, from the start of the volume.
+*
+* @param Length
+* Number of bytes to read. Doesn't need to be sector-aligned.
+*
+* @param Buffer
+* Buffer that receives the data.
+*
+* @return
+* STATUS_SUCCESS if successful, an error code from the cache manager or the paging read otherwise.
+*/
+NTSTATUS
+NtfsReadDiskCached(IN PDEVICE_EXTENSION DeviceExt,
+                   IN LONGLONG StartingOffset,
+                   IN ULONG Length,
+                   IN OUT PUCHAR Buffer)
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER Offset;
+    NTSTATUS Status;
+
+    DPRINT("NtfsReadDiskCached(%p, %I64x, %lu, %p)\n", DeviceExt, StartingOffset, Length, Buffer);
+
+    ASSERT(DeviceExt->Flags & VCB_METADATA_CACHED);
+
+    Offset.QuadPart = StartingOffset;
+
+    _SEH2_TRY
+    {
+        CcCopyRead(DeviceExt->StreamFileObject, &Offset, Length, TRUE, Buffer, &IoStatus);
+        Status = IoStatus.Status;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    return Status;
+}
+
+/**
+* @name NtfsWriteDiskCached
+* @implemented
+*
+* Writes metadata through the volume stream file object and flushes it right away.
+* Going through the cache keeps the copy NtfsReadDiskCached() reads from up to date.
+*
+* @param DeviceExt
+* Volume to write to. Its stream file object must have been set up for caching.
+*
+* @param StartingOffset
+* Offset, in bytes, from the start of the volume.
+*
+* @param Length
+* Number of bytes to write. Doesn't need to be sector-aligned.
+*
+* @param Buffer
+* The data that's being written.
+*
+* @return
+* STATUS_SUCCESS if successful, an error code from the cache manager or the paging write otherwise.
+*/
+NTSTATUS
+NtfsWriteDiskCached(IN PDEVICE_EXTENSION DeviceExt,
+                    IN LONGLONG StartingOffset,
+                    IN ULONG Length,
+                    IN const PUCHAR Buffer)
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER Offset;
+    NTSTATUS Status;
+
+    DPRINT("NtfsWriteDiskCached(%p, %I64x, %lu, %p)\n", DeviceExt, StartingOffset, Length, Buffer);
+
+    ASSERT(DeviceExt->Flags & VCB_METADATA_CACHED);
+
+    Offset.QuadPart = StartingOffset;
+
+    _SEH2_TRY
+    {
+        CcCopyWrite(DeviceExt->StreamFileObject, &Offset, Length, TRUE, Buffer);
+        Status = STATUS_SUCCESS;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    // Write through, callers expect metadata to be on the disk when we return
+    CcFlushCache(DeviceExt->StreamFileObject->SectionObjectPointer, &Offset, Length, &IoStatus);
+
+    return IoStatus.Status;
+}
+
 NTSTATUS
 NtfsReadSectors(IN PDEVICE_OBJECT DeviceObject,
                 IN ULONG DiskSector,
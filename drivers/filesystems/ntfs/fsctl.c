@@ -461,6 +461,8 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     Vcb->Identifier.Type = NTFS_TYPE_VCB;
     Vcb->Identifier.Size = sizeof(NTFS_TYPE_VCB);
 
+    NtfsInitializeFileRecordCache(Vcb);
+
     Status = NtfsGetVolumeData(DeviceToMount,
                                Vcb);
     if (!NT_SUCCESS(Status))
@@ -534,6 +536,9 @@ NtfsMountVolume(PDEVICE_OBJECT DeviceObject,
     }
     _SEH2_END;
 
+    /* From now on, the MFT and directory indexes are read through the volume stream */
+    Vcb->Flags |= VCB_METADATA_CACHED;
+
     ExInitializeResourceLite(&Vcb->DirResource);
 
     KeInitializeSpinLock(&Vcb->FcbListLock);
@@ -564,6 +569,9 @@ ByeBye:
         if (Ccb)
             ExFreePool(Ccb);
 
+        if (Vcb)
+            NtfsFreeFileRecordCache(Vcb);
+
         if (NewDeviceObject)
             IoDeleteDevice(NewDeviceObject);
 
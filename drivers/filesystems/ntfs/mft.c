@@ -1005,6 +1005,238 @@ SetResidentAttributeDataLength(PDEVICE_EXTENSION Vcb,
     return STATUS_SUCCESS;
 }
 
+/*
+ * File record cache. ReadFileRecord() keeps the records it read, with their
+ * fixups applied, so that walking a path or listing a directory doesn't read
+ * and fix up the same records again. Writes to the MFT go through
+ * WriteAttribute(), which drops the records it overwrites.
+ */
+
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    ULONG i;
+
+    ExInitializeFastMutex(&Vcb->FileRecordCacheLock);
+    for (i = 0; i < NTFS_FILE_RECORD_CACHE_BUCKETS; i++)
+    {
+        InitializeListHead(&Vcb->FileRecordCacheHash[i]);
+    }
+    InitializeListHead(&Vcb->FileRecordCacheLru);
+    Vcb->FileRecordCacheCount = 0;
+    Vcb->FileRecordCacheGeneration = 0;
+}
+
+VOID
+NtfsFreeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PNTFS_CACHED_FILE_RECORD CachedRecord;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+    while (!IsListEmpty(&Vcb->FileRecordCacheLru))
+    {
+        CachedRecord = CONTAINING_RECORD(RemoveHeadList(&Vcb->FileRecordCacheLru),
+                                         NTFS_CACHED_FILE_RECORD,
+                                         LruEntry);
+        RemoveEntryList(&CachedRecord->HashEntry);
+        ExFreePoolWithTag(CachedRecord, TAG_FILE_REC);
+    }
+    Vcb->FileRecordCacheCount = 0;
+    Vcb->FileRecordCacheGeneration++;
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+}
+
+static
+PNTFS_CACHED_FILE_RECORD
+LookupCachedFileRecord(PDEVICE_EXTENSION Vcb,
+                       ULONGLONG MFTIndex)
+{
+    PLIST_ENTRY ListHead, ListEntry;
+    PNTFS_CACHED_FILE_RECORD CachedRecord;
+
+    ListHead = &Vcb->FileRecordCacheHash[MFTIndex % NTFS_FILE_RECORD_CACHE_BUCKETS];
+    for (ListEntry = ListHead->Flink; ListEntry != ListHead; ListEntry = ListEntry->Flink)
+    {
+        CachedRecord = CONTAINING_RECORD(ListEntry, NTFS_CACHED_FILE_RECORD, HashEntry);
+        if (CachedRecord->MFTIndex == MFTIndex)
+            return CachedRecord;
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+ReadCachedFileRecord(PDEVICE_EXTENSION Vcb,
+                     ULONGLONG MFTIndex,
+                     PFILE_RECORD_HEADER FileRecord,
+                     PULONG Generation)
+{
+    PNTFS_CACHED_FILE_RECORD CachedRecord;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+
+    CachedRecord = LookupCachedFileRecord(Vcb, MFTIndex);
+    if (CachedRecord == NULL)
+    {
+        // Remember the generation, so a record we read meanwhile isn't cached if it got overwritten
+        *Generation = Vcb->FileRecordCacheGeneration;
+        ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+        return FALSE;
+    }
+
+    RemoveEntryList(&CachedRecord->LruEntry);
+    InsertHeadList(&Vcb->FileRecordCacheLru, &CachedRecord->LruEntry);
+    RtlCopyMemory(FileRecord, CachedRecord->Record, Vcb->NtfsInfo.BytesPerFileRecord);
+
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+
+    return TRUE;
+}
+
+static
+VOID
+CacheFileRecord(PDEVICE_EXTENSION Vcb,
+                ULONGLONG MFTIndex,
+                PFILE_RECORD_HEADER FileRecord,
+                PULONG Generation)
+{
+    PNTFS_CACHED_FILE_RECORD CachedRecord;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+
+    if (Generation != NULL && *Generation != Vcb->FileRecordCacheGeneration)
+    {
+        ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+        return;
+    }
+
+    CachedRecord = LookupCachedFileRecord(Vcb, MFTIndex);
+    if (CachedRecord != NULL)
+    {
+        RemoveEntryList(&CachedRecord->LruEntry);
+    }
+    else if (Vcb->FileRecordCacheCount >= NTFS_FILE_RECORD_CACHE_SIZE)
+    {
+        // Reuse the least recently used record
+        CachedRecord = CONTAINING_RECORD(RemoveTailList(&Vcb->FileRecordCacheLru),
+                                         NTFS_CACHED_FILE_RECORD,
+                                         LruEntry);
+        RemoveEntryList(&CachedRecord->HashEntry);
+        CachedRecord->MFTIndex = MFTIndex;
+        InsertHeadList(&Vcb->FileRecordCacheHash[MFTIndex % NTFS_FILE_RECORD_CACHE_BUCKETS], &CachedRecord->HashEntry);
+    }
+    else
+    {
+        CachedRecord = ExAllocatePoolWithTag(NonPagedPool,
+                                             FIELD_OFFSET(NTFS_CACHED_FILE_RECORD, Record) + Vcb->NtfsInfo.BytesPerFileRecord,
+                                             TAG_FILE_REC);
+        if (CachedRecord == NULL)
+        {
+            ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+            return;
+        }
+
+        CachedRecord->MFTIndex = MFTIndex;
+        InsertHeadList(&Vcb->FileRecordCacheHash[MFTIndex % NTFS_FILE_RECORD_CACHE_BUCKETS], &CachedRecord->HashEntry);
+        Vcb->FileRecordCacheCount++;
+    }
+
+    RtlCopyMemory(CachedRecord->Record, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+    InsertHeadList(&Vcb->FileRecordCacheLru, &CachedRecord->LruEntry);
+
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+}
+
+static
+VOID
+InvalidateCachedFileRecords(PDEVICE_EXTENSION Vcb,
+                            ULONGLONG Offset,
+                            ULONG Length)
+{
+    PNTFS_CACHED_FILE_RECORD CachedRecord;
+    ULONGLONG MFTIndex;
+
+    if (Length == 0)
+        return;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+
+    for (MFTIndex = Offset / Vcb->NtfsInfo.BytesPerFileRecord;
+         MFTIndex <= (Offset + Length - 1) / Vcb->NtfsInfo.BytesPerFileRecord;
+         MFTIndex++)
+    {
+        CachedRecord = LookupCachedFileRecord(Vcb, MFTIndex);
+        if (CachedRecord != NULL)
+        {
+            RemoveEntryList(&CachedRecord->HashEntry);
+            RemoveEntryList(&CachedRecord->LruEntry);
+            ExFreePoolWithTag(CachedRecord, TAG_FILE_REC);
+            Vcb->FileRecordCacheCount--;
+        }
+    }
+
+    Vcb->FileRecordCacheGeneration++;
+
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+}
+
+/*
+ * The MFT and directory indexes are read over and over again while looking up
+ * and listing files, their clusters go through the cache manager.
+ */
+static
+BOOLEAN
+IsCachedMetadataAttribute(PDEVICE_EXTENSION Vcb,
+                          PNTFS_ATTR_CONTEXT Context)
+{
+    if (!(Vcb->Flags & VCB_METADATA_CACHED))
+        return FALSE;
+
+    if (Context->pRecord->Type == AttributeIndexAllocation)
+        return TRUE;
+
+    return (Context == Vcb->MFTContext ||
+            (Context->FileMFTIndex == NTFS_FILE_MFT && Context->pRecord->Type == AttributeData));
+}
+
+static
+NTSTATUS
+ReadAttributeRun(PDEVICE_EXTENSION Vcb,
+                 PNTFS_ATTR_CONTEXT Context,
+                 LONGLONG StartingOffset,
+                 ULONG Length,
+                 PCHAR Buffer)
+{
+    if (IsCachedMetadataAttribute(Vcb, Context))
+        return NtfsReadDiskCached(Vcb, StartingOffset, Length, (PUCHAR)Buffer);
+
+    return NtfsReadDisk(Vcb->StorageDevice,
+                        StartingOffset,
+                        Length,
+                        Vcb->NtfsInfo.BytesPerSector,
+                        (PVOID)Buffer,
+                        FALSE);
+}
+
+static
+NTSTATUS
+WriteAttributeRun(PDEVICE_EXTENSION Vcb,
+                  PNTFS_ATTR_CONTEXT Context,
+                  LONGLONG StartingOffset,
+                  ULONG Length,
+                  const PUCHAR Buffer)
+{
+    if (IsCachedMetadataAttribute(Vcb, Context))
+        return NtfsWriteDiskCached(Vcb, StartingOffset, Length, Buffer);
+
+    return NtfsWriteDisk(Vcb->StorageDevice,
+                         StartingOffset,
+                         Length,
+                         Vcb->NtfsInfo.BytesPerSector,
+                         Buffer);
+}
+
 ULONG
 ReadAttribute(PDEVICE_EXTENSION Vcb,
               PNTFS_ATTR_CONTEXT Context,
@@ -1125,12 +1357,11 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
     }
     else
     {
-        Status = NtfsReadDisk(Vcb->StorageDevice,
-                              DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset,
-                              ReadLength,
-                              Vcb->NtfsInfo.BytesPerSector,
-                              (PVOID)Buffer,
-                              FALSE);
+        Status = ReadAttributeRun(Vcb,
+                                  Context,
+                                  DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset,
+                                  ReadLength,
+                                  Buffer);
     }
     if (NT_SUCCESS(Status))
     {
@@ -1158,12 +1389,11 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
                 RtlZeroMemory(Buffer, ReadLength);
             else
             {
-                Status = NtfsReadDisk(Vcb->StorageDevice,
-                                      DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                      ReadLength,
-                                      Vcb->NtfsInfo.BytesPerSector,
-                                      (PVOID)Buffer,
-                                      FALSE);
+                Status = ReadAttributeRun(Vcb,
+                                          Context,
+                                          DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
+                                          ReadLength,
+                                          Buffer);
                 if (!NT_SUCCESS(Status))
                     break;
             }
@@ -1275,6 +1505,7 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
     PUCHAR SourceBuffer = Buffer;
     LONGLONG StartingOffset;
     BOOLEAN FileRecordAllocated = FALSE;
+    ULONG RequestedLength = Length;
     
     //TEMPTEMP
     PUCHAR TempBuffer;
@@ -1452,11 +1683,11 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
     StartingOffset = DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset;
 
     // Write the data to the disk
-    Status = NtfsWriteDisk(Vcb->StorageDevice,
-                           StartingOffset,
-                           WriteLength,
-                           Vcb->NtfsInfo.BytesPerSector,
-                           (PVOID)SourceBuffer);
+    Status = WriteAttributeRun(Vcb,
+                               Context,
+                               StartingOffset,
+                               WriteLength,
+                               SourceBuffer);
 
     // Did the write fail?
     if (!NT_SUCCESS(Status))
@@ -1507,11 +1738,11 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
         else
         {
             // write the data to the disk
-            Status = NtfsWriteDisk(Vcb->StorageDevice,
-                                   DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                   WriteLength,
-                                   Vcb->NtfsInfo.BytesPerSector,
-                                   (PVOID)SourceBuffer);
+            Status = WriteAttributeRun(Vcb,
+                                       Context,
+                                       DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
+                                       WriteLength,
+                                       SourceBuffer);
             if (!NT_SUCCESS(Status))
                 break;
         }
@@ -1568,6 +1799,13 @@ Cleanup:
     if (Context->pRecord->IsNonResident)
         ExFreePoolWithTag(TempBuffer, TAG_NTFS);
 
+    // Cached copies of the file records we wrote to (even partly) are stale now
+    if (Context == Vcb->MFTContext ||
+        (Context->FileMFTIndex == NTFS_FILE_MFT && Context->pRecord->Type == AttributeData))
+    {
+        InvalidateCachedFileRecords(Vcb, Offset, RequestedLength);
+    }
+
     return Status;
 }
 
@@ -1577,9 +1815,16 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    if (ReadCachedFileRecord(Vcb, index, file, &Generation))
+    {
+        return STATUS_SUCCESS;
+    }
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1589,7 +1834,13 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+    {
+        CacheFileRecord(Vcb, index, file, &Generation);
+    }
+
+    return Status;
 }
 
 
@@ -1898,7 +2149,11 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
     }
 
     // remove the fixup array (so the file record pointer can still be used)
-    FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
+    if (NT_SUCCESS(FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs)) && NT_SUCCESS(Status))
+    {
+        // The record is most likely read again soon
+        CacheFileRecord(Vcb, MftIndex, FileRecord, NULL);
+    }
 
     return Status;
 }
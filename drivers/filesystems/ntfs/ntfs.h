@@ -101,6 +101,18 @@ typedef struct
     ULONG Size;
 } NTFSIDENTIFIER, *PNTFSIDENTIFIER;
 
+/* Fixed up file records are kept around, keyed by their MFT index */
+#define NTFS_FILE_RECORD_CACHE_SIZE     512
+#define NTFS_FILE_RECORD_CACHE_BUCKETS  64
+
+typedef struct _NTFS_CACHED_FILE_RECORD
+{
+    LIST_ENTRY HashEntry;
+    LIST_ENTRY LruEntry;
+    ULONGLONG MFTIndex;
+    UCHAR Record[ANYSIZE_ARRAY];
+} NTFS_CACHED_FILE_RECORD, *PNTFS_CACHED_FILE_RECORD;
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -127,9 +139,16 @@ typedef struct
     ULONG Flags;
     ULONG OpenHandleCount;
 
+    FAST_MUTEX FileRecordCacheLock;
+    LIST_ENTRY FileRecordCacheHash[NTFS_FILE_RECORD_CACHE_BUCKETS];
+    LIST_ENTRY FileRecordCacheLru;
+    ULONG FileRecordCacheCount;
+    ULONG FileRecordCacheGeneration;
+
 } DEVICE_EXTENSION, *PDEVICE_EXTENSION, NTFS_VCB, *PNTFS_VCB;
 
 #define VCB_VOLUME_LOCKED       0x0001
+#define VCB_METADATA_CACHED     0x0002
 
 typedef struct
 {
@@ -702,6 +721,18 @@ NtfsWriteDisk(IN PDEVICE_OBJECT DeviceObject,
               IN ULONG SectorSize,
               IN const PUCHAR Buffer);
 
+NTSTATUS
+NtfsReadDiskCached(IN PDEVICE_EXTENSION DeviceExt,
+                   IN LONGLONG StartingOffset,
+                   IN ULONG Length,
+                   IN OUT PUCHAR Buffer);
+
+NTSTATUS
+NtfsWriteDiskCached(IN PDEVICE_EXTENSION DeviceExt,
+                    IN LONGLONG StartingOffset,
+                    IN ULONG Length,
+                    IN const PUCHAR Buffer);
+
 NTSTATUS
 NtfsReadSectors(IN PDEVICE_OBJECT DeviceObject,
                 IN ULONG DiskSector,
@@ -1095,6 +1126,12 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file);
 
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsFreeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
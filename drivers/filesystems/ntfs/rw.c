@@ -231,6 +231,21 @@ NtfsRead(PNTFS_IRP_CONTEXT IrpContext)
     ReadOffset = Stack->Parameters.Read.ByteOffset;
     Buffer = NtfsGetUserBuffer(Irp, BooleanFlagOn(Irp->Flags, IRP_PAGING_IO));
 
+    /* The volume stream caches metadata, its pages come straight from the disk */
+    if (((PNTFS_FCB)FileObject->FsContext)->Flags & FCB_IS_VOLUME_STREAM)
+    {
+        ASSERT(Irp->Flags & IRP_PAGING_IO);
+
+        Status = NtfsReadDisk(DeviceExt->StorageDevice,
+                              ReadOffset.QuadPart,
+                              ReadLength,
+                              DeviceExt->NtfsInfo.BytesPerSector,
+                              Buffer,
+                              FALSE);
+        Irp->IoStatus.Information = NT_SUCCESS(Status) ? ReadLength : 0;
+        return Status;
+    }
+
     Status = NtfsReadFile(DeviceExt,
                           FileObject,
                           Buffer,
@@ -561,6 +576,22 @@ NtfsWrite(PNTFS_IRP_CONTEXT IrpContext)
     Fcb = (PNTFS_FCB)IrpContext->FileObject->FsContext;
     ASSERT(Fcb);
 
+    // Metadata written through the volume stream goes straight back to the disk
+    if (Fcb->Flags & FCB_IS_VOLUME_STREAM)
+    {
+        ASSERT(Irp->Flags & IRP_PAGING_IO);
+
+        DeviceExt = IrpContext->DeviceObject->DeviceExtension;
+        Length = IrpContext->Stack->Parameters.Write.Length;
+        Status = NtfsWriteDisk(DeviceExt->StorageDevice,
+                               IrpContext->Stack->Parameters.Write.ByteOffset.QuadPart,
+                               Length,
+                               DeviceExt->NtfsInfo.BytesPerSector,
+                               NtfsGetUserBuffer(Irp, TRUE));
+        Irp->IoStatus.Information = NT_SUCCESS(Status) ? Length : 0;
+        return Status;
+    }
+
     DPRINT("About to write %wS\n", Fcb->ObjectName);
     DPRINT("NTFS Version: %d.%d\n", Fcb->Vcb->NtfsInfo.MajorVersion, Fcb->Vcb->NtfsInfo.MinorVersion);
 
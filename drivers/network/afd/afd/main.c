@@ -360,6 +360,7 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollWaiters );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -445,6 +446,7 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     }
 
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    DestroyPollSet( FCB->DeviceExt, FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -910,6 +912,12 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_EVENT_SELECT:
             return AfdEventSelect( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_UPDATE_POLL_SET:
+            return AfdUpdatePollSet( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_WAIT_POLL_SET:
+            return AfdWaitPollSet( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_ENUM_NETWORK_EVENTS:
             return AfdEnumEvents( DeviceObject, Irp, IrpSp );
 
@@ -1209,6 +1217,11 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (IOCTL_AFD_SELECT)\n");
             return;
 
+        case IOCTL_AFD_WAIT_POLL_SET:
+            CancelPollSetWait(DeviceExt, FCB, Irp);
+            SocketStateUnlock(FCB);
+            return;
+
         case IOCTL_AFD_DISCONNECT:
             Function = FUNCTION_DISCONNECT;
             break;
@@ -68,6 +68,8 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        for( i = 0; i < Poll->WaiterCount; i++ )
+            RemoveEntryList( &Poll->Waiters[i].ListEntry );
         ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
     }
 
@@ -122,42 +124,85 @@ static VOID NTAPI SelectTimeout( PKDPC Dpc,
     AFD_DbgPrint(MID_TRACE,("Timeout\n"));
 }
 
+/* Returns the next waiter not belonging to the same poll. The waiters a
+ * poll has on a socket are inserted together, so they are adjacent */
+static PLIST_ENTRY SkipPollWaiters( PAFD_FCB FCB, PLIST_ENTRY ListEntry,
+                                    PAFD_ACTIVE_POLL Poll ) {
+    while( ListEntry != &FCB->PollWaiters &&
+           CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry)->Poll == Poll )
+        ListEntry = ListEntry->Flink;
+
+    return ListEntry;
+}
+
+static VOID FreePollSetEntries( PLIST_ENTRY EntryList ) {
+    PAFD_POLL_SET_ENTRY Entry;
+
+    while( !IsListEmpty( EntryList ) ) {
+        Entry = CONTAINING_RECORD(RemoveHeadList( EntryList ),
+                                  AFD_POLL_SET_ENTRY, ListEntry);
+        ObDereferenceObject( Entry->FileObject );
+        ExFreePoolWithTag( Entry, TAG_AFD_POLL_SET );
+    }
+}
+
+/* Called with the device lock held, the caller frees the entry */
+static VOID UnlinkPollSetEntry( PAFD_POLL_SET_ENTRY Entry ) {
+    RemoveEntryList( &Entry->ListEntry );
+    RemoveEntryList( &Entry->Waiter.ListEntry );
+    if( Entry->Ready ) {
+        RemoveEntryList( &Entry->ReadyEntry );
+        Entry->Ready = FALSE;
+    }
+}
+
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject,
                         BOOLEAN OnlyExclusive ) {
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
+    PAFD_POLL_WAITER Waiter;
+    PAFD_POLL_SET_ENTRY Entry;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_FCB FCB = FileObject->FsContext;
+    LIST_ENTRY DeadEntries;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
+    InitializeListHead( &DeadEntries );
+
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    ListEntry = FCB->PollWaiters.Flink;
+    while ( ListEntry != &FCB->PollWaiters ) {
+        Waiter = CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry);
+        Poll = Waiter->Poll;
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
+        if( !Poll ) {
+            ListEntry = ListEntry->Flink;
+            if( OnlyExclusive ) continue;
+
+            /* The socket is going away, so it leaves the poll sets too */
+            Entry = CONTAINING_RECORD(Waiter, AFD_POLL_SET_ENTRY, Waiter);
+            UnlinkPollSetEntry( Entry );
+            InsertTailList( &DeadEntries, &Entry->ListEntry );
+            continue;
+        }
+
+        ListEntry = SkipPollWaiters( FCB, ListEntry, Poll );
+
+        if( !OnlyExclusive || Poll->Exclusive ) {
+            PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+            ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+            SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
         }
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
+    FreePollSetEntries( &DeadEntries );
+
     AFD_DbgPrint(MID_TRACE,("Done\n"));
 }
 
@@ -229,13 +274,15 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
        PAFD_ACTIVE_POLL Poll = NULL;
 
        Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
+                                    FIELD_OFFSET(AFD_ACTIVE_POLL,
+                                                 Waiters[PollReq->HandleCount]),
                                     TAG_AFD_ACTIVE_POLL);
 
        if (Poll){
           Poll->Irp = Irp;
           Poll->DeviceExt = DeviceExt;
           Poll->Exclusive = Exclusive;
+          Poll->WaiterCount = 0;
 
           KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
@@ -243,6 +290,19 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
           InsertTailList( &DeviceExt->Polls, &Poll->ListEntry );
 
+          /* Wait on each socket, so that only its own events look at us */
+          for( i = 0; i < PollReq->HandleCount; i++ ) {
+              if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
+
+              FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+              FCB = FileObject->FsContext;
+
+              Poll->Waiters[Poll->WaiterCount].Poll = Poll;
+              InsertTailList( &FCB->PollWaiters,
+                              &Poll->Waiters[Poll->WaiterCount].ListEntry );
+              Poll->WaiterCount++;
+          }
+
           KeSetTimer( &Poll->Timer, PollReq->Timeout, &Poll->TimeoutDpc );
 
           Status = STATUS_PENDING;
@@ -404,9 +464,350 @@ static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject
     return Signalled ? 1 : 0;
 }
 
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static ULONG CollectPollSetEvents( PAFD_POLL_SET Set,
+                                   PAFD_POLL_SET_WAIT_INFO WaitInfo,
+                                   ULONG MaxCount ) {
+    LIST_ENTRY Reported, Skipped;
+    PAFD_POLL_SET_ENTRY Entry;
+    PAFD_FCB FCB;
+    ULONG Count = 0, Events;
+
+    InitializeListHead( &Reported );
+    InitializeListHead( &Skipped );
+
+    /* Sockets stay ready until their state changes, but the ones we
+     * report now go to the back so that the others get their turn */
+    while( !IsListEmpty( &Set->ReadyList ) ) {
+        Entry = CONTAINING_RECORD(RemoveHeadList( &Set->ReadyList ),
+                                  AFD_POLL_SET_ENTRY, ReadyEntry);
+        FCB = Entry->FileObject->FsContext;
+
+        Events = Entry->Events & FCB->PollState;
+        if( !Events ) {
+            Entry->Ready = FALSE;
+            continue;
+        }
+
+        if( Count < MaxCount ) {
+            WaitInfo->Handles[Count].Handle = Entry->Handle;
+            WaitInfo->Handles[Count].Events = Events;
+            WaitInfo->Handles[Count].Status = STATUS_SUCCESS;
+            Count++;
+            InsertTailList( &Reported, &Entry->ReadyEntry );
+        } else {
+            InsertTailList( &Skipped, &Entry->ReadyEntry );
+        }
+    }
+
+    while( !IsListEmpty( &Skipped ) )
+        InsertTailList( &Set->ReadyList, RemoveHeadList( &Skipped ) );
+    while( !IsListEmpty( &Reported ) )
+        InsertTailList( &Set->ReadyList, RemoveHeadList( &Reported ) );
+
+    return Count;
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static BOOLEAN CompletePollSetWait( PAFD_POLL_SET Set, NTSTATUS Status ) {
+    PIRP Irp = Set->WaitIrp;
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+    ULONG Count = 0;
+
+    if( Status == STATUS_SUCCESS ) {
+        Count = CollectPollSetEvents( Set, WaitInfo,
+            (IrpSp->Parameters.DeviceIoControl.OutputBufferLength -
+             FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles)) / sizeof(AFD_HANDLE) );
+
+        /* Nothing is really ready anymore, keep waiting */
+        if( !Count ) return FALSE;
+    }
+
+    Set->WaitIrp = NULL;
+    KeCancelTimer( &Set->Timer );
+
+    WaitInfo->HandleCount = Count;
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles[Count]);
+    (void)IoSetCancelRoutine(Irp, NULL);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+
+    return TRUE;
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static VOID SignalPollSetEntry( PAFD_POLL_SET_ENTRY Entry ) {
+    PAFD_POLL_SET Set = Entry->Set;
+
+    if( !Entry->Ready ) {
+        Entry->Ready = TRUE;
+        InsertTailList( &Set->ReadyList, &Entry->ReadyEntry );
+    }
+
+    if( Set->WaitIrp )
+        CompletePollSetWait( Set, STATUS_SUCCESS );
+}
+
+static KDEFERRED_ROUTINE PollSetTimeout;
+static VOID NTAPI PollSetTimeout( PKDPC Dpc,
+                                  PVOID DeferredContext,
+                                  PVOID SystemArgument1,
+                                  PVOID SystemArgument2 ) {
+    PAFD_POLL_SET Set = DeferredContext;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+    if( Set->WaitIrp )
+        CompletePollSetWait( Set, STATUS_TIMEOUT );
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+}
+
+NTSTATUS NTAPI
+AfdUpdatePollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_SET_INFO SetInfo = Irp->AssociatedIrp.SystemBuffer;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    PAFD_FCB FCB = IrpSp->FileObject->FsContext, SocketFCB;
+    PAFD_POLL_SET Set, NewSet = NULL;
+    PAFD_POLL_SET_ENTRY Entry, NewEntry;
+    PFILE_OBJECT FileObject;
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_WAITER Waiter;
+    LIST_ENTRY DeadEntries;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    ULONG i;
+
+    if( InputLength < FIELD_OFFSET(AFD_POLL_SET_INFO, Handles) ||
+        SetInfo->HandleCount > (InputLength - FIELD_OFFSET(AFD_POLL_SET_INFO, Handles)) / sizeof(AFD_HANDLE) ) {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* The set lives as long as the handle it was first used with */
+    if( !FCB->PollSet ) {
+        NewSet = ExAllocatePoolWithTag( NonPagedPool, sizeof(AFD_POLL_SET), TAG_AFD_POLL_SET );
+        if( !NewSet ) {
+            Irp->IoStatus.Status = STATUS_NO_MEMORY;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+            return STATUS_NO_MEMORY;
+        }
+
+        InitializeListHead( &NewSet->Entries );
+        InitializeListHead( &NewSet->ReadyList );
+        NewSet->WaitIrp = NULL;
+        NewSet->DeviceExt = DeviceExt;
+        KeInitializeTimerEx( &NewSet->Timer, NotificationTimer );
+        KeInitializeDpc( &NewSet->TimeoutDpc, PollSetTimeout, NewSet );
+    }
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    if( !FCB->PollSet ) {
+        FCB->PollSet = NewSet;
+        NewSet = NULL;
+    }
+    Set = FCB->PollSet;
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    if( NewSet ) ExFreePoolWithTag( NewSet, TAG_AFD_POLL_SET );
+
+    for( i = 0; i < SetInfo->HandleCount; i++ ) {
+        Status = ObReferenceObjectByHandle( (HANDLE)SetInfo->Handles[i].Handle,
+                                            FILE_ALL_ACCESS,
+                                            *IoFileObjectType,
+                                            Irp->RequestorMode,
+                                            (PVOID*)&FileObject,
+                                            NULL );
+        if( !NT_SUCCESS(Status) ) {
+            SetInfo->Handles[i].Status = Status;
+            continue;
+        }
+
+        if( FileObject->DeviceObject != DeviceObject || !FileObject->FsContext ) {
+            ObDereferenceObject( FileObject );
+            SetInfo->Handles[i].Status = STATUS_INVALID_HANDLE;
+            continue;
+        }
+
+        NewEntry = NULL;
+        if( SetInfo->Handles[i].Events ) {
+            NewEntry = ExAllocatePoolWithTag( NonPagedPool, sizeof(AFD_POLL_SET_ENTRY), TAG_AFD_POLL_SET );
+            if( !NewEntry ) {
+                ObDereferenceObject( FileObject );
+                SetInfo->Handles[i].Status = STATUS_NO_MEMORY;
+                continue;
+            }
+        }
+
+        SocketFCB = FileObject->FsContext;
+        InitializeListHead( &DeadEntries );
+
+        KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+        /* Look for the socket in the set, its own waiter list is shorter */
+        Entry = NULL;
+        for( ListEntry = SocketFCB->PollWaiters.Flink;
+             ListEntry != &SocketFCB->PollWaiters;
+             ListEntry = ListEntry->Flink ) {
+            Waiter = CONTAINING_RECORD(ListEntry, AFD_POLL_WAITER, ListEntry);
+            if( !Waiter->Poll &&
+                CONTAINING_RECORD(Waiter, AFD_POLL_SET_ENTRY, Waiter)->Set == Set ) {
+                Entry = CONTAINING_RECORD(Waiter, AFD_POLL_SET_ENTRY, Waiter);
+                break;
+            }
+        }
+
+        if( !SetInfo->Handles[i].Events ) {
+            if( Entry ) {
+                UnlinkPollSetEntry( Entry );
+                InsertTailList( &DeadEntries, &Entry->ListEntry );
+            }
+        } else {
+            if( !Entry ) {
+                /* The entry keeps our reference */
+                Entry = NewEntry;
+                NewEntry = NULL;
+                Entry->Set = Set;
+                Entry->FileObject = FileObject;
+                FileObject = NULL;
+                Entry->Ready = FALSE;
+                Entry->Waiter.Poll = NULL;
+                InsertTailList( &Set->Entries, &Entry->ListEntry );
+                InsertTailList( &SocketFCB->PollWaiters, &Entry->Waiter.ListEntry );
+            }
+
+            Entry->Handle = SetInfo->Handles[i].Handle;
+            Entry->Events = SetInfo->Handles[i].Events;
+
+            if( Entry->Events & SocketFCB->PollState )
+                SignalPollSetEntry( Entry );
+        }
+
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+        if( FileObject ) ObDereferenceObject( FileObject );
+        if( NewEntry ) ExFreePoolWithTag( NewEntry, TAG_AFD_POLL_SET );
+        FreePollSetEntries( &DeadEntries );
+
+        SetInfo->Handles[i].Status = STATUS_SUCCESS;
+    }
+
+    /* The per handle status goes back through the same buffer, but only as far as
+     * the caller's output buffer reaches */
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = MIN(InputLength, IrpSp->Parameters.DeviceIoControl.OutputBufferLength);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+AfdWaitPollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_SET_WAIT_INFO WaitInfo = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_FCB FCB = IrpSp->FileObject->FsContext;
+    PAFD_POLL_SET Set;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles) ||
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength < FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles[1]) ) {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    Set = FCB->PollSet;
+    if( !Set || Set->WaitIrp ) {
+        /* One waiter at a time */
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+        Status = Set ? STATUS_DEVICE_BUSY : STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return Status;
+    }
+
+    Set->WaitIrp = Irp;
+
+    if( CompletePollSetWait( Set, STATUS_SUCCESS ) ) {
+        Status = STATUS_SUCCESS;
+    } else if( !WaitInfo->Timeout.QuadPart ) {
+        CompletePollSetWait( Set, STATUS_TIMEOUT );
+        Status = STATUS_TIMEOUT;
+    } else {
+        Status = STATUS_PENDING;
+        IoMarkIrpPending( Irp );
+        (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+        KeSetTimer( &Set->Timer, WaitInfo->Timeout, &Set->TimeoutDpc );
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    return Status;
+}
+
+VOID CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp ) {
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    if( FCB->PollSet && FCB->PollSet->WaitIrp == Irp )
+        CompletePollSetWait( FCB->PollSet, STATUS_CANCELLED );
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+}
+
+VOID DestroyPollSet( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB ) {
+    PAFD_POLL_SET Set;
+    PAFD_POLL_SET_ENTRY Entry;
+    LIST_ENTRY DeadEntries;
+    KIRQL OldIrql;
+
+    InitializeListHead( &DeadEntries );
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    Set = FCB->PollSet;
+    FCB->PollSet = NULL;
+
+    if( Set ) {
+        if( Set->WaitIrp )
+            CompletePollSetWait( Set, STATUS_CANCELLED );
+
+        while( !IsListEmpty( &Set->Entries ) ) {
+            Entry = CONTAINING_RECORD(Set->Entries.Flink, AFD_POLL_SET_ENTRY, ListEntry);
+            UnlinkPollSetEntry( Entry );
+            InsertTailList( &DeadEntries, &Entry->ListEntry );
+        }
+
+        KeCancelTimer( &Set->Timer );
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    if( !Set ) return;
+
+    FreePollSetEntries( &DeadEntries );
+    ExFreePoolWithTag( Set, TAG_AFD_POLL_SET );
+}
+
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
     PAFD_ACTIVE_POLL Poll = NULL;
-    PLIST_ENTRY ThePollEnt = NULL;
+    PLIST_ENTRY ListEntry = NULL;
+    PAFD_POLL_WAITER Waiter;
+    PAFD_POLL_SET_ENTRY Entry;
     PAFD_FCB FCB;
     KIRQL OldIrql;
     PAFD_POLL_INFO PollReq;
@@ -424,20 +825,31 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal normal select irps and poll sets waiting on this socket */
+    ListEntry = FCB->PollWaiters.Flink;
+
+    while( ListEntry != &FCB->PollWaiters ) {
+        Waiter = CONTAINING_RECORD( ListEntry, AFD_POLL_WAITER, ListEntry );
+        Poll = Waiter->Poll;
+
+        if( !Poll ) {
+            ListEntry = ListEntry->Flink;
+            Entry = CONTAINING_RECORD( Waiter, AFD_POLL_SET_ENTRY, Waiter );
+            if( Entry->Events & FCB->PollState )
+                SignalPollSetEntry( Entry );
+            continue;
+        }
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
+        /* The poll goes away when signalled, and its waiters with it */
+        ListEntry = SkipPollWaiters( FCB, ListEntry, Poll );
+
         if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
-        } else
-            ThePollEnt = ThePollEnt->Flink;
+        }
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
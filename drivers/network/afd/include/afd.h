@@ -47,6 +47,7 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_SET                   'spfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -113,6 +114,12 @@ typedef struct _AFD_DEVICE_EXTENSION {
     KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Links a select or a poll set to one of the sockets it waits for */
+typedef struct _AFD_POLL_WAITER {
+    LIST_ENTRY ListEntry;
+    struct _AFD_ACTIVE_POLL *Poll; /* NULL for poll set entries */
+} AFD_POLL_WAITER, *PAFD_POLL_WAITER;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,8 +128,30 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT WaiterCount;
+    AFD_POLL_WAITER Waiters[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+typedef struct _AFD_POLL_SET {
+    LIST_ENTRY Entries;
+    LIST_ENTRY ReadyList;
+    PIRP WaitIrp;
+    PAFD_DEVICE_EXTENSION DeviceExt;
+    KDPC TimeoutDpc;
+    KTIMER Timer;
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
+typedef struct _AFD_POLL_SET_ENTRY {
+    LIST_ENTRY ListEntry;
+    LIST_ENTRY ReadyEntry;
+    AFD_POLL_WAITER Waiter;
+    PAFD_POLL_SET Set;
+    PFILE_OBJECT FileObject;
+    SOCKET Handle;
+    ULONG Events;
+    BOOLEAN Ready;
+} AFD_POLL_SET_ENTRY, *PAFD_POLL_SET_ENTRY;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -201,6 +230,8 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    LIST_ENTRY PollWaiters;
+    PAFD_POLL_SET PollSet;
 } AFD_FCB, *PAFD_FCB;
 
 /* bind.c */
@@ -328,9 +359,17 @@ AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	       PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdUpdatePollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdWaitPollSet( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp );
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
+VOID DestroyPollSet( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB );
+VOID CancelPollSetWait( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB, PIRP Irp );
 VOID ZeroEvents( PAFD_HANDLE HandleArray,
 		 UINT HandleCount );
 VOID SignalSocket(
@@ -0,0 +1,734 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        hardware.c
+ * PURPOSE:     Device setup, virtqueues and control commands
+ */
+
+#include "nic.h"
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+NICResetDevice (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    //
+    // Writing zero resets the device, it doesn't touch our rings after that
+    //
+    NdisRawWritePortUchar(Adapter->IoBase + VIRTIO_PCI_STATUS, 0);
+}
+
+static
+VOID
+NICReadConfig (
+    IN PVNET_ADAPTER Adapter,
+    IN ULONG Offset,
+    OUT PUCHAR Data,
+    IN ULONG Length
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+    {
+        NdisRawReadPortUchar(Adapter->IoBase + VIRTIO_PCI_CONFIG + Offset + i, &Data[i]);
+    }
+}
+
+NDIS_STATUS
+NTAPI
+NICInitializeDevice (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    ULONG hostFeatures;
+    USHORT maxPairs;
+
+    NICResetDevice(Adapter);
+    NdisRawWritePortUchar(Adapter->IoBase + VIRTIO_PCI_STATUS,
+                          VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER);
+
+    //
+    // Take only the features we know how to drive
+    //
+    NdisRawReadPortUlong(Adapter->IoBase + VIRTIO_PCI_HOST_FEATURES, &hostFeatures);
+    Adapter->Features = hostFeatures & (VIRTIO_NET_F_CSUM |
+                                        VIRTIO_NET_F_GUEST_CSUM |
+                                        VIRTIO_NET_F_MAC |
+                                        VIRTIO_NET_F_STATUS |
+                                        VIRTIO_NET_F_CTRL_VQ |
+                                        VIRTIO_NET_F_CTRL_RX |
+                                        VIRTIO_NET_F_MQ);
+    if (!(Adapter->Features & VIRTIO_NET_F_CTRL_VQ))
+    {
+        Adapter->Features &= ~(VIRTIO_NET_F_CTRL_RX | VIRTIO_NET_F_MQ);
+    }
+
+    NdisRawWritePortUlong(Adapter->IoBase + VIRTIO_PCI_GUEST_FEATURES, Adapter->Features);
+
+    NDIS_DbgPrint(MID_TRACE, ("Host features 0x%x, using 0x%x\n", hostFeatures, Adapter->Features));
+
+    //
+    // Spread the flows over one queue pair per processor, more pairs only
+    // matter when the host has a thread to serve each of them
+    //
+    Adapter->QueuePairs = 1;
+    if (Adapter->Features & VIRTIO_NET_F_MQ)
+    {
+        NICReadConfig(Adapter, VIRTIO_NET_CONFIG_MAX_PAIRS, (PUCHAR)&maxPairs, sizeof(maxPairs));
+
+        Adapter->QueuePairs = min(maxPairs, NdisSystemProcessorCount());
+        Adapter->QueuePairs = min(Adapter->QueuePairs, MAXIMUM_QUEUE_PAIRS);
+        Adapter->QueuePairs = max(Adapter->QueuePairs, 1);
+
+        //
+        // The control queue comes after every queue pair the device has
+        //
+        Adapter->Control.Index = maxPairs * 2;
+    }
+    else
+    {
+        Adapter->Control.Index = 2;
+    }
+
+    NDIS_DbgPrint(MID_TRACE, ("Using %d queue pairs\n", Adapter->QueuePairs));
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+NICGetPermanentMacAddress (
+    IN PVNET_ADAPTER Adapter,
+    OUT PUCHAR MacAddress
+    )
+{
+    LARGE_INTEGER time;
+
+    if (Adapter->Features & VIRTIO_NET_F_MAC)
+    {
+        NICReadConfig(Adapter, VIRTIO_NET_CONFIG_MAC, MacAddress, IEEE_802_ADDR_LENGTH);
+    }
+    else
+    {
+        //
+        // The device takes any address, make up a locally administered one
+        //
+        KeQuerySystemTime(&time);
+        MacAddress[0] = 0x02;
+        MacAddress[1] = 0x00;
+        MacAddress[2] = (UCHAR)(time.LowPart >> 24);
+        MacAddress[3] = (UCHAR)(time.LowPart >> 16);
+        MacAddress[4] = (UCHAR)(time.LowPart >> 8);
+        MacAddress[5] = (UCHAR)time.LowPart;
+    }
+
+    NDIS_DbgPrint(MIN_TRACE, ("MAC address: %02x-%02x-%02x-%02x-%02x-%02x\n",
+                              MacAddress[0], MacAddress[1], MacAddress[2],
+                              MacAddress[3], MacAddress[4], MacAddress[5]));
+}
+
+VOID
+NTAPI
+NICUpdateLinkStatus (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    USHORT linkStatus;
+    ULONG mediaState;
+
+    //
+    // Without the status feature the link is always up
+    //
+    linkStatus = VIRTIO_NET_S_LINK_UP;
+    if (Adapter->Features & VIRTIO_NET_F_STATUS)
+    {
+        NICReadConfig(Adapter, VIRTIO_NET_CONFIG_STATUS, (PUCHAR)&linkStatus, sizeof(linkStatus));
+    }
+
+    mediaState = (linkStatus & VIRTIO_NET_S_LINK_UP) ? NdisMediaStateConnected :
+                                                       NdisMediaStateDisconnected;
+    if (mediaState != Adapter->MediaState)
+    {
+        Adapter->MediaState = mediaState;
+        Adapter->LinkChange = TRUE;
+    }
+}
+
+static
+NDIS_STATUS
+NICAllocateQueue (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE Queue,
+    IN ULONG MaximumBuffers,
+    IN ULONG BufferSize
+    )
+{
+    USHORT queueSize;
+
+    NdisRawWritePortUshort(Adapter->IoBase + VIRTIO_PCI_QUEUE_SEL, Queue->Index);
+    NdisRawReadPortUshort(Adapter->IoBase + VIRTIO_PCI_QUEUE_NUM, &queueSize);
+    if (queueSize < 4 || (queueSize & (queueSize - 1)) != 0)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Queue %d has an unusable size of %d\n", Queue->Index, queueSize));
+        return NDIS_STATUS_ADAPTER_NOT_FOUND;
+    }
+
+    Queue->Size = queueSize;
+    Queue->RingLength = VRING_SIZE(queueSize);
+    NdisMAllocateSharedMemory(Adapter->MiniportAdapterHandle,
+                              Queue->RingLength,
+                              TRUE,
+                              (PVOID*)&Queue->Ring,
+                              &Queue->RingPa);
+    if (Queue->Ring == NULL)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate ring for queue %d\n", Queue->Index));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    RtlZeroMemory(Queue->Ring, Queue->RingLength);
+    Queue->Desc = (PVRING_DESC)Queue->Ring;
+    Queue->Avail = (PVRING_AVAIL)(Queue->Ring + sizeof(VRING_DESC) * queueSize);
+    Queue->Used = (PVRING_USED)(Queue->Ring + VRING_USED_OFFSET(queueSize));
+
+    //
+    // Every buffer takes two descriptors: the header and the frame
+    //
+    Queue->BufferCount = (USHORT)min(MaximumBuffers, queueSize / 2u);
+    Queue->BuffersLength = Queue->BufferCount * BufferSize;
+    NdisMAllocateSharedMemory(Adapter->MiniportAdapterHandle,
+                              Queue->BuffersLength,
+                              TRUE,
+                              (PVOID*)&Queue->Buffers,
+                              &Queue->BuffersPa);
+    if (Queue->Buffers == NULL)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate buffers for queue %d\n", Queue->Index));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    RtlZeroMemory(Queue->Buffers, Queue->BuffersLength);
+
+    NdisRawWritePortUlong(Adapter->IoBase + VIRTIO_PCI_QUEUE_PFN,
+                          (ULONG)(Queue->RingPa.QuadPart >> VIRTIO_PCI_QUEUE_ADDR_SHIFT));
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+static
+VOID
+NICFreeQueue (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE Queue
+    )
+{
+    if (Queue->Buffers != NULL)
+    {
+        NdisMFreeSharedMemory(Adapter->MiniportAdapterHandle,
+                              Queue->BuffersLength,
+                              TRUE,
+                              Queue->Buffers,
+                              Queue->BuffersPa);
+        Queue->Buffers = NULL;
+    }
+
+    if (Queue->Ring != NULL)
+    {
+        NdisMFreeSharedMemory(Adapter->MiniportAdapterHandle,
+                              Queue->RingLength,
+                              TRUE,
+                              Queue->Ring,
+                              Queue->RingPa);
+        Queue->Ring = NULL;
+    }
+}
+
+static
+VOID
+NICSetupBufferDescriptors (
+    IN PVIRTIO_QUEUE Queue,
+    IN USHORT Flags
+    )
+{
+    ULONG i;
+    ULONGLONG address;
+
+    for (i = 0; i < Queue->BufferCount; i++)
+    {
+        address = Queue->BuffersPa.QuadPart + i * BUFFER_SIZE;
+
+        Queue->Desc[i * 2].Address = address;
+        Queue->Desc[i * 2].Length = sizeof(VIRTIO_NET_HDR);
+        Queue->Desc[i * 2].Flags = VRING_DESC_F_NEXT | Flags;
+        Queue->Desc[i * 2].Next = (USHORT)(i * 2 + 1);
+
+        Queue->Desc[i * 2 + 1].Address = address + BUFFER_FRAME_OFFSET;
+        Queue->Desc[i * 2 + 1].Length = BUFFER_SIZE - BUFFER_FRAME_OFFSET;
+        Queue->Desc[i * 2 + 1].Flags = Flags;
+    }
+}
+
+NDIS_STATUS
+NTAPI
+NICSetupQueues (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    PVIRTIO_QUEUE_PAIR pair;
+    PNDIS_BUFFER ndisBuffer;
+    NDIS_STATUS status;
+    ULONG i, j;
+
+    NdisAllocatePacketPool(&status,
+                           &Adapter->PacketPool,
+                           Adapter->QueuePairs * RX_BUFFER_COUNT,
+                           PROTOCOL_RESERVED_SIZE_IN_PACKET);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate packet pool\n"));
+        return status;
+    }
+
+    NdisAllocateBufferPool(&status,
+                           &Adapter->BufferPool,
+                           Adapter->QueuePairs * RX_BUFFER_COUNT);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate buffer pool\n"));
+        return status;
+    }
+
+    for (i = 0; i < Adapter->QueuePairs; i++)
+    {
+        pair = &Adapter->Pairs[i];
+
+        //
+        // Receive queues are 0, 2, 4, ... and transmit queues 1, 3, 5, ...
+        //
+        pair->Rx.Index = (USHORT)(i * 2);
+        status = NICAllocateQueue(Adapter, &pair->Rx, RX_BUFFER_COUNT, BUFFER_SIZE);
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            return status;
+        }
+
+        pair->Tx.Index = (USHORT)(i * 2 + 1);
+        status = NICAllocateQueue(Adapter, &pair->Tx, TX_BUFFER_COUNT, BUFFER_SIZE);
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            return status;
+        }
+
+        NICSetupBufferDescriptors(&pair->Rx, VRING_DESC_F_WRITE);
+        NICSetupBufferDescriptors(&pair->Tx, 0);
+
+        //
+        // Each receive buffer gets a packet that points straight at the frame
+        //
+        for (j = 0; j < pair->Rx.BufferCount; j++)
+        {
+            NdisAllocatePacket(&status, &pair->RxPackets[j], Adapter->PacketPool);
+            if (status != NDIS_STATUS_SUCCESS)
+            {
+                NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive packet\n"));
+                return status;
+            }
+
+            NdisAllocateBuffer(&status,
+                               &ndisBuffer,
+                               Adapter->BufferPool,
+                               pair->Rx.Buffers + j * BUFFER_SIZE + BUFFER_FRAME_OFFSET,
+                               BUFFER_SIZE - BUFFER_FRAME_OFFSET);
+            if (status != NDIS_STATUS_SUCCESS)
+            {
+                NDIS_DbgPrint(MIN_TRACE, ("Unable to allocate receive buffer\n"));
+                return status;
+            }
+
+            NdisChainBufferAtFront(pair->RxPackets[j], ndisBuffer);
+            RX_CONTEXT(pair->RxPackets[j])->Pair = (USHORT)i;
+            RX_CONTEXT(pair->RxPackets[j])->Buffer = (USHORT)j;
+
+            NICPostReceiveBuffer(Adapter, pair, (USHORT)j);
+        }
+
+        //
+        // Finished transmits are picked up when we need the space, so the
+        // device doesn't have to interrupt for them
+        //
+        for (j = 0; j < pair->Tx.BufferCount; j++)
+        {
+            pair->TxFree[j] = (USHORT)j;
+        }
+        pair->TxFreeCount = pair->Tx.BufferCount;
+        pair->Tx.Avail->Flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+
+    if (Adapter->Features & VIRTIO_NET_F_CTRL_VQ)
+    {
+        status = NICAllocateQueue(Adapter, &Adapter->Control, 1, CONTROL_BUFFER_SIZE);
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            return status;
+        }
+
+        //
+        // Commands are a header and data the device reads, then an ack it writes
+        //
+        Adapter->Control.Desc[0].Address = Adapter->Control.BuffersPa.QuadPart;
+        Adapter->Control.Desc[0].Length = sizeof(VIRTIO_NET_CTRL_HDR);
+        Adapter->Control.Desc[0].Flags = VRING_DESC_F_NEXT;
+        Adapter->Control.Desc[0].Next = 1;
+        Adapter->Control.Desc[1].Address = Adapter->Control.BuffersPa.QuadPart + CONTROL_DATA_OFFSET;
+        Adapter->Control.Desc[1].Flags = VRING_DESC_F_NEXT;
+        Adapter->Control.Desc[1].Next = 2;
+        Adapter->Control.Desc[2].Address = Adapter->Control.BuffersPa.QuadPart + CONTROL_ACK_OFFSET;
+        Adapter->Control.Desc[2].Length = sizeof(UCHAR);
+        Adapter->Control.Desc[2].Flags = VRING_DESC_F_WRITE;
+        Adapter->Control.Avail->Flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+NICFreeQueues (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    PVIRTIO_QUEUE_PAIR pair;
+    PNDIS_BUFFER ndisBuffer;
+    ULONG i, j;
+
+    for (i = 0; i < MAXIMUM_QUEUE_PAIRS; i++)
+    {
+        pair = &Adapter->Pairs[i];
+
+        for (j = 0; j < RX_BUFFER_COUNT; j++)
+        {
+            if (pair->RxPackets[j] == NULL)
+            {
+                continue;
+            }
+
+            NdisUnchainBufferAtFront(pair->RxPackets[j], &ndisBuffer);
+            if (ndisBuffer != NULL)
+            {
+                NdisFreeBuffer(ndisBuffer);
+            }
+            NdisFreePacket(pair->RxPackets[j]);
+            pair->RxPackets[j] = NULL;
+        }
+
+        NICFreeQueue(Adapter, &pair->Rx);
+        NICFreeQueue(Adapter, &pair->Tx);
+    }
+
+    NICFreeQueue(Adapter, &Adapter->Control);
+
+    if (Adapter->BufferPool != NULL)
+    {
+        NdisFreeBufferPool(Adapter->BufferPool);
+        Adapter->BufferPool = NULL;
+    }
+
+    if (Adapter->PacketPool != NULL)
+    {
+        NdisFreePacketPool(Adapter->PacketPool);
+        Adapter->PacketPool = NULL;
+    }
+}
+
+VOID
+NTAPI
+NICPostReceiveBuffer (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE_PAIR Pair,
+    IN USHORT Buffer
+    )
+{
+    PVIRTIO_QUEUE queue = &Pair->Rx;
+
+    //
+    // The device only sees it once NICNotifyQueue publishes the index
+    //
+    queue->Avail->Ring[queue->AvailIndex & (queue->Size - 1)] = Buffer * 2;
+    queue->AvailIndex++;
+    Pair->RxPosted++;
+}
+
+VOID
+NTAPI
+NICNotifyQueue (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE Queue
+    )
+{
+    //
+    // Make the ring entries visible before the index that covers them,
+    // and the index visible before we look at the device's flags
+    //
+    KeMemoryBarrier();
+    Queue->Avail->Index = Queue->AvailIndex;
+    KeMemoryBarrier();
+
+    if (!(Queue->Used->Flags & VRING_USED_F_NO_NOTIFY))
+    {
+        NdisRawWritePortUshort(Adapter->IoBase + VIRTIO_PCI_QUEUE_NOTIFY, Queue->Index);
+    }
+}
+
+BOOLEAN
+NTAPI
+NICReclaimTransmitBuffers (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE_PAIR Pair
+    )
+{
+    PVIRTIO_QUEUE queue = &Pair->Tx;
+    PVRING_USED_ELEM element;
+    USHORT usedIndex;
+    BOOLEAN reclaimed;
+
+    reclaimed = FALSE;
+    usedIndex = queue->Used->Index;
+    KeMemoryBarrier();
+
+    while (queue->LastUsedIndex != usedIndex)
+    {
+        element = &queue->Used->Ring[queue->LastUsedIndex & (queue->Size - 1)];
+        ASSERT(element->Id / 2 < queue->BufferCount);
+
+        Pair->TxFree[Pair->TxFreeCount++] = (USHORT)(element->Id / 2);
+        queue->LastUsedIndex++;
+        Adapter->TransmitOk++;
+        reclaimed = TRUE;
+    }
+
+    return reclaimed;
+}
+
+static
+NDIS_STATUS
+NICSendControlCommand (
+    IN PVNET_ADAPTER Adapter,
+    IN UCHAR Class,
+    IN UCHAR Command,
+    IN PVOID Data,
+    IN ULONG DataLength
+    )
+{
+    PVIRTIO_QUEUE queue = &Adapter->Control;
+    PVIRTIO_NET_CTRL_HDR header;
+    PUCHAR ack;
+    ULONG i;
+
+    if (!(Adapter->Features & VIRTIO_NET_F_CTRL_VQ))
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    ASSERT(DataLength <= CONTROL_ACK_OFFSET - CONTROL_DATA_OFFSET);
+
+    header = (PVIRTIO_NET_CTRL_HDR)queue->Buffers;
+    header->Class = Class;
+    header->Command = Command;
+    RtlCopyMemory(queue->Buffers + CONTROL_DATA_OFFSET, Data, DataLength);
+    ack = queue->Buffers + CONTROL_ACK_OFFSET;
+    *ack = (UCHAR)~VIRTIO_NET_OK;
+
+    queue->Desc[1].Length = DataLength;
+    queue->Avail->Ring[queue->AvailIndex & (queue->Size - 1)] = 0;
+    queue->AvailIndex++;
+    NICNotifyQueue(Adapter, queue);
+
+    for (i = 0; i < CONTROL_TIMEOUT_US / 10; i++)
+    {
+        KeMemoryBarrier();
+        if (queue->Used->Index != queue->LastUsedIndex)
+        {
+            queue->LastUsedIndex++;
+            KeMemoryBarrier();
+            return (*ack == VIRTIO_NET_OK) ? NDIS_STATUS_SUCCESS : NDIS_STATUS_FAILURE;
+        }
+
+        NdisStallExecution(10);
+    }
+
+    //
+    // A late answer would be taken for the next command, so stop using the queue
+    //
+    NDIS_DbgPrint(MIN_TRACE, ("Control command %d/%d timed out\n", Class, Command));
+    Adapter->Features &= ~(VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_CTRL_RX);
+    return NDIS_STATUS_FAILURE;
+}
+
+NDIS_STATUS
+NTAPI
+NICStartDevice (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    USHORT queuePairs;
+    NDIS_STATUS status;
+    ULONG i;
+
+    NdisRawWritePortUchar(Adapter->IoBase + VIRTIO_PCI_STATUS,
+                          VIRTIO_CONFIG_S_ACKNOWLEDGE |
+                          VIRTIO_CONFIG_S_DRIVER |
+                          VIRTIO_CONFIG_S_DRIVER_OK);
+
+    //
+    // Only the first pair runs until we ask for more
+    //
+    if (Adapter->QueuePairs > 1)
+    {
+        queuePairs = (USHORT)Adapter->QueuePairs;
+        status = NICSendControlCommand(Adapter,
+                                       VIRTIO_NET_CTRL_MQ,
+                                       VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                       &queuePairs,
+                                       sizeof(queuePairs));
+        if (status != NDIS_STATUS_SUCCESS)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to enable %d queue pairs\n", queuePairs));
+            Adapter->QueuePairs = 1;
+        }
+    }
+
+    //
+    // Hand the pre-posted receive buffers to the device
+    //
+    for (i = 0; i < Adapter->QueuePairs; i++)
+    {
+        NICNotifyQueue(Adapter, &Adapter->Pairs[i].Rx);
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+NDIS_STATUS
+NTAPI
+NICApplyPacketFilter (
+    IN PVNET_ADAPTER Adapter
+    )
+{
+    UCHAR enable;
+    NDIS_STATUS status;
+
+    //
+    // Without receive mode control the device passes everything up
+    //
+    if (!(Adapter->Features & VIRTIO_NET_F_CTRL_RX))
+    {
+        return NDIS_STATUS_SUCCESS;
+    }
+
+    enable = (Adapter->PacketFilter & NDIS_PACKET_TYPE_PROMISCUOUS) ? 1 : 0;
+    status = NICSendControlCommand(Adapter,
+                                   VIRTIO_NET_CTRL_RX,
+                                   VIRTIO_NET_CTRL_RX_PROMISC,
+                                   &enable,
+                                   sizeof(enable));
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        return status;
+    }
+
+    enable = (Adapter->PacketFilter & (NDIS_PACKET_TYPE_MULTICAST |
+                                       NDIS_PACKET_TYPE_ALL_MULTICAST)) ? 1 : 0;
+    return NICSendControlCommand(Adapter,
+                                 VIRTIO_NET_CTRL_RX,
+                                 VIRTIO_NET_CTRL_RX_ALLMULTI,
+                                 &enable,
+                                 sizeof(enable));
+}
+
+UCHAR
+NTAPI
+NICParseIpv4Header (
+    IN PUCHAR Frame,
+    IN ULONG Length,
+    OUT PULONG HeaderLength,
+    OUT PULONG PayloadLength
+    )
+{
+    PUCHAR ipHeader = Frame + ETH_HEADER_LENGTH;
+    ULONG totalLength;
+
+    //
+    // Only whole IPv4 datagrams behind a plain Ethernet header qualify
+    //
+    if (Length < ETH_HEADER_LENGTH + 20 ||
+        Frame[12] != 0x08 || Frame[13] != 0x00 ||
+        (ipHeader[0] >> 4) != 4)
+    {
+        return 0;
+    }
+
+    *HeaderLength = (ipHeader[0] & 0x0F) * 4;
+    totalLength = (ipHeader[2] << 8) | ipHeader[3];
+    if (*HeaderLength < 20 ||
+        totalLength < *HeaderLength ||
+        ETH_HEADER_LENGTH + totalLength > Length)
+    {
+        return 0;
+    }
+
+    //
+    // More fragments or a fragment offset
+    //
+    if ((ipHeader[6] & 0x3F) != 0 || ipHeader[7] != 0)
+    {
+        return 0;
+    }
+
+    *PayloadLength = totalLength - *HeaderLength;
+    return ipHeader[9];
+}
+
+ULONG
+NTAPI
+NICChecksumAdd (
+    IN ULONG Sum,
+    IN PUCHAR Data,
+    IN ULONG Length
+    )
+{
+    ULONG i;
+
+    for (i = 0; i + 1 < Length; i += 2)
+    {
+        Sum += (Data[i] << 8) | Data[i + 1];
+    }
+
+    if (Length & 1)
+    {
+        Sum += Data[Length - 1] << 8;
+    }
+
+    //
+    // Keep the carries from piling up past 32 bits
+    //
+    return (Sum & 0xFFFF) + (Sum >> 16);
+}
+
+USHORT
+NTAPI
+NICChecksumFold (
+    IN ULONG Sum
+    )
+{
+    while (Sum >> 16)
+    {
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    }
+
+    return (USHORT)Sum;
+}
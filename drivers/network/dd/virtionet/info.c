@@ -0,0 +1,536 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        info.c
+ * PURPOSE:     OID query and set handlers
+ */
+
+#include "nic.h"
+
+#define NDEBUG
+#include <debug.h>
+
+static ULONG SupportedOidList[] =
+{
+    OID_GEN_SUPPORTED_LIST,
+    OID_GEN_HARDWARE_STATUS,
+    OID_GEN_MEDIA_SUPPORTED,
+    OID_GEN_MEDIA_IN_USE,
+    OID_GEN_MAXIMUM_LOOKAHEAD,
+    OID_GEN_MAXIMUM_FRAME_SIZE,
+    OID_GEN_LINK_SPEED,
+    OID_GEN_TRANSMIT_BUFFER_SPACE,
+    OID_GEN_RECEIVE_BUFFER_SPACE,
+    OID_GEN_RECEIVE_BLOCK_SIZE,
+    OID_GEN_TRANSMIT_BLOCK_SIZE,
+    OID_GEN_VENDOR_ID,
+    OID_GEN_VENDOR_DESCRIPTION,
+    OID_GEN_VENDOR_DRIVER_VERSION,
+    OID_GEN_CURRENT_PACKET_FILTER,
+    OID_GEN_CURRENT_LOOKAHEAD,
+    OID_GEN_DRIVER_VERSION,
+    OID_GEN_MAXIMUM_TOTAL_SIZE,
+    OID_GEN_PROTOCOL_OPTIONS,
+    OID_GEN_MAC_OPTIONS,
+    OID_GEN_MEDIA_CONNECT_STATUS,
+    OID_GEN_MAXIMUM_SEND_PACKETS,
+    OID_GEN_XMIT_OK,
+    OID_GEN_RCV_OK,
+    OID_GEN_XMIT_ERROR,
+    OID_GEN_RCV_ERROR,
+    OID_GEN_RCV_NO_BUFFER,
+    OID_802_3_PERMANENT_ADDRESS,
+    OID_802_3_CURRENT_ADDRESS,
+    OID_802_3_MULTICAST_LIST,
+    OID_802_3_MAXIMUM_LIST_SIZE,
+    OID_TCP_TASK_OFFLOAD
+};
+
+typedef struct _CHECKSUM_TASK_OFFLOAD {
+    NDIS_TASK_OFFLOAD_HEADER Header;
+    NDIS_TASK_OFFLOAD Task;
+} CHECKSUM_TASK_OFFLOAD, *PCHECKSUM_TASK_OFFLOAD;
+
+// The checksum capabilities go in TaskBuffer, past the end of the task
+#define CHECKSUM_TASK_OFFLOAD_SIZE \
+    (FIELD_OFFSET(CHECKSUM_TASK_OFFLOAD, Task.TaskBuffer) + sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+
+static
+NDIS_STATUS
+NICQueryTaskOffload (
+    IN PVNET_ADAPTER Adapter,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength,
+    OUT PUCHAR Offload
+    )
+{
+    PNDIS_TASK_OFFLOAD_HEADER header = (PNDIS_TASK_OFFLOAD_HEADER)InformationBuffer;
+    PCHECKSUM_TASK_OFFLOAD offload = (PCHECKSUM_TASK_OFFLOAD)Offload;
+    PNDIS_TASK_TCP_IP_CHECKSUM checksum;
+
+    if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER) ||
+        header->Version != NDIS_TASK_OFFLOAD_VERSION ||
+        header->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation)
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    if (!(Adapter->Features & (VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM)))
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    RtlZeroMemory(offload, CHECKSUM_TASK_OFFLOAD_SIZE);
+    offload->Header = *header;
+    offload->Header.OffsetFirstTask = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+
+    offload->Task.Version = NDIS_TASK_OFFLOAD_VERSION;
+    offload->Task.Size = sizeof(NDIS_TASK_OFFLOAD);
+    offload->Task.Task = TcpIpChecksumNdisTask;
+    offload->Task.OffsetNextTask = 0;
+    offload->Task.TaskBufferLength = sizeof(NDIS_TASK_TCP_IP_CHECKSUM);
+
+    //
+    // The device checksums from an offset to the end of the frame, so the
+    // headers in front of it can carry any options
+    //
+    checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)offload->Task.TaskBuffer;
+    if (Adapter->Features & VIRTIO_NET_F_CSUM)
+    {
+        checksum->V4Transmit.IpOptionsSupported = 1;
+        checksum->V4Transmit.TcpOptionsSupported = 1;
+        checksum->V4Transmit.TcpChecksum = 1;
+        checksum->V4Transmit.UdpChecksum = 1;
+    }
+
+    if (Adapter->Features & VIRTIO_NET_F_GUEST_CSUM)
+    {
+        checksum->V4Receive.IpOptionsSupported = 1;
+        checksum->V4Receive.TcpOptionsSupported = 1;
+        checksum->V4Receive.TcpChecksum = 1;
+        checksum->V4Receive.UdpChecksum = 1;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+static
+NDIS_STATUS
+NICSetTaskOffload (
+    IN PVNET_ADAPTER Adapter,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength
+    )
+{
+    PNDIS_TASK_OFFLOAD_HEADER header = (PNDIS_TASK_OFFLOAD_HEADER)InformationBuffer;
+    PNDIS_TASK_OFFLOAD task;
+    PNDIS_TASK_TCP_IP_CHECKSUM checksum;
+    NDIS_TASK_TCP_IP_CHECKSUM enable;
+    ULONG offset;
+
+    if (InformationBufferLength < sizeof(NDIS_TASK_OFFLOAD_HEADER) ||
+        header->Version != NDIS_TASK_OFFLOAD_VERSION ||
+        header->EncapsulationFormat.Encapsulation != IEEE_802_3_Encapsulation)
+    {
+        return NDIS_STATUS_NOT_SUPPORTED;
+    }
+
+    //
+    // Whatever isn't in the list is turned off
+    //
+    RtlZeroMemory(&enable, sizeof(enable));
+
+    offset = header->OffsetFirstTask;
+    while (offset != 0)
+    {
+        if (offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) > InformationBufferLength)
+        {
+            return NDIS_STATUS_INVALID_LENGTH;
+        }
+
+        task = (PNDIS_TASK_OFFLOAD)((PUCHAR)InformationBuffer + offset);
+        if (offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) + task->TaskBufferLength >
+            InformationBufferLength)
+        {
+            return NDIS_STATUS_INVALID_LENGTH;
+        }
+
+        if (task->Task != TcpIpChecksumNdisTask ||
+            task->TaskBufferLength < sizeof(NDIS_TASK_TCP_IP_CHECKSUM))
+        {
+            return NDIS_STATUS_NOT_SUPPORTED;
+        }
+
+        checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)task->TaskBuffer;
+        if (checksum->V4Transmit.IpChecksum || checksum->V4Receive.IpChecksum ||
+            checksum->V6Transmit.TcpChecksum || checksum->V6Transmit.UdpChecksum ||
+            checksum->V6Receive.TcpChecksum || checksum->V6Receive.UdpChecksum)
+        {
+            return NDIS_STATUS_NOT_SUPPORTED;
+        }
+
+        if ((checksum->V4Transmit.TcpChecksum || checksum->V4Transmit.UdpChecksum) &&
+            !(Adapter->Features & VIRTIO_NET_F_CSUM))
+        {
+            return NDIS_STATUS_NOT_SUPPORTED;
+        }
+
+        if ((checksum->V4Receive.TcpChecksum || checksum->V4Receive.UdpChecksum) &&
+            !(Adapter->Features & VIRTIO_NET_F_GUEST_CSUM))
+        {
+            return NDIS_STATUS_NOT_SUPPORTED;
+        }
+
+        enable = *checksum;
+
+        if (task->OffsetNextTask == 0)
+        {
+            break;
+        }
+        offset += task->OffsetNextTask;
+    }
+
+    Adapter->ChecksumOffload = enable;
+
+    NDIS_DbgPrint(MIN_TRACE, ("Checksum offload: TX TCP %d UDP %d, RX TCP %d UDP %d\n",
+                              enable.V4Transmit.TcpChecksum, enable.V4Transmit.UdpChecksum,
+                              enable.V4Receive.TcpChecksum, enable.V4Receive.UdpChecksum));
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+NDIS_STATUS
+NTAPI
+MiniportQueryInformation (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN NDIS_OID Oid,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength,
+    OUT PULONG BytesWritten,
+    OUT PULONG BytesNeeded
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    ULONG genericUlong;
+    ULONG copyLength;
+    PVOID copySource;
+    NDIS_STATUS status;
+    ULONG taskOffload[(CHECKSUM_TASK_OFFLOAD_SIZE + sizeof(ULONG) - 1) / sizeof(ULONG)];
+
+    status = NDIS_STATUS_SUCCESS;
+    copySource = &genericUlong;
+    copyLength = sizeof(ULONG);
+
+    NdisAcquireSpinLock(&adapter->Lock);
+
+    switch (Oid)
+    {
+        case OID_GEN_SUPPORTED_LIST:
+            copySource = (PVOID)&SupportedOidList;
+            copyLength = sizeof(SupportedOidList);
+            break;
+
+        case OID_GEN_CURRENT_PACKET_FILTER:
+            genericUlong = adapter->PacketFilter;
+            break;
+
+        case OID_GEN_HARDWARE_STATUS:
+            genericUlong = (ULONG)NdisHardwareStatusReady;
+            break;
+
+        case OID_GEN_MEDIA_SUPPORTED:
+        case OID_GEN_MEDIA_IN_USE:
+        {
+            static const NDIS_MEDIUM medium = NdisMedium802_3;
+            copySource = (PVOID)&medium;
+            copyLength = sizeof(medium);
+            break;
+        }
+
+        case OID_GEN_RECEIVE_BLOCK_SIZE:
+        case OID_GEN_TRANSMIT_BLOCK_SIZE:
+        case OID_GEN_CURRENT_LOOKAHEAD:
+        case OID_GEN_MAXIMUM_LOOKAHEAD:
+        case OID_GEN_MAXIMUM_FRAME_SIZE:
+            genericUlong = MAXIMUM_FRAME_SIZE - ETH_HEADER_LENGTH;
+            break;
+
+        case OID_GEN_LINK_SPEED:
+            //
+            // There is no wire, report 10 Gbps in units of 100 bps
+            //
+            genericUlong = 100000000;
+            break;
+
+        case OID_GEN_TRANSMIT_BUFFER_SPACE:
+            genericUlong = MAXIMUM_FRAME_SIZE * TX_BUFFER_COUNT * adapter->QueuePairs;
+            break;
+
+        case OID_GEN_RECEIVE_BUFFER_SPACE:
+            genericUlong = MAXIMUM_FRAME_SIZE * RX_BUFFER_COUNT * adapter->QueuePairs;
+            break;
+
+        case OID_GEN_VENDOR_ID:
+            //
+            // The 3 bytes of the MAC address is the vendor ID
+            //
+            genericUlong = 0;
+            genericUlong |= (adapter->PermanentMacAddress[0] << 16);
+            genericUlong |= (adapter->PermanentMacAddress[1] << 8);
+            genericUlong |= (adapter->PermanentMacAddress[2] & 0xFF);
+            break;
+
+        case OID_GEN_VENDOR_DESCRIPTION:
+        {
+            static UCHAR vendorDesc[] = "ReactOS Team";
+            copySource = vendorDesc;
+            copyLength = sizeof(vendorDesc);
+            break;
+        }
+
+        case OID_GEN_VENDOR_DRIVER_VERSION:
+            genericUlong = DRIVER_VERSION;
+            break;
+
+        case OID_GEN_DRIVER_VERSION:
+        {
+            static const USHORT driverVersion =
+                 (NDIS_MINIPORT_MAJOR_VERSION << 8) + NDIS_MINIPORT_MINOR_VERSION;
+            copySource = (PVOID)&driverVersion;
+            copyLength = sizeof(driverVersion);
+            break;
+        }
+
+        case OID_GEN_MAXIMUM_TOTAL_SIZE:
+            genericUlong = MAXIMUM_FRAME_SIZE;
+            break;
+
+        case OID_GEN_PROTOCOL_OPTIONS:
+            NDIS_DbgPrint(MIN_TRACE, ("OID_GEN_PROTOCOL_OPTIONS is unimplemented\n"));
+            status = NDIS_STATUS_NOT_SUPPORTED;
+            break;
+
+        case OID_GEN_MAC_OPTIONS:
+            genericUlong = NDIS_MAC_OPTION_RECEIVE_SERIALIZED |
+                           NDIS_MAC_OPTION_COPY_LOOKAHEAD_DATA |
+                           NDIS_MAC_OPTION_TRANSFERS_NOT_PEND |
+                           NDIS_MAC_OPTION_NO_LOOPBACK;
+            break;
+
+        case OID_GEN_MEDIA_CONNECT_STATUS:
+            genericUlong = adapter->MediaState;
+            break;
+
+        case OID_GEN_MAXIMUM_SEND_PACKETS:
+            genericUlong = TX_BUFFER_COUNT;
+            break;
+
+        case OID_802_3_CURRENT_ADDRESS:
+            copySource = adapter->CurrentMacAddress;
+            copyLength = IEEE_802_ADDR_LENGTH;
+            break;
+
+        case OID_802_3_PERMANENT_ADDRESS:
+            copySource = adapter->PermanentMacAddress;
+            copyLength = IEEE_802_ADDR_LENGTH;
+            break;
+
+        case OID_802_3_MAXIMUM_LIST_SIZE:
+            genericUlong = MAXIMUM_MULTICAST_ADDRESSES;
+            break;
+
+        case OID_GEN_XMIT_OK:
+            genericUlong = adapter->TransmitOk;
+            break;
+
+        case OID_GEN_RCV_OK:
+            genericUlong = adapter->ReceiveOk;
+            break;
+
+        case OID_GEN_XMIT_ERROR:
+            genericUlong = adapter->TransmitError;
+            break;
+
+        case OID_GEN_RCV_ERROR:
+            genericUlong = adapter->ReceiveError;
+            break;
+
+        case OID_GEN_RCV_NO_BUFFER:
+            genericUlong = adapter->ReceiveNoBufferSpace;
+            break;
+
+        case OID_TCP_TASK_OFFLOAD:
+            status = NICQueryTaskOffload(adapter,
+                                         InformationBuffer,
+                                         InformationBufferLength,
+                                         (PUCHAR)taskOffload);
+            copySource = taskOffload;
+            copyLength = CHECKSUM_TASK_OFFLOAD_SIZE;
+            break;
+
+        default:
+            NDIS_DbgPrint(MIN_TRACE, ("Unknown OID\n"));
+            status = NDIS_STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    if (status == NDIS_STATUS_SUCCESS)
+    {
+        if (copyLength > InformationBufferLength)
+        {
+            *BytesNeeded = copyLength;
+            *BytesWritten = 0;
+            status = NDIS_STATUS_INVALID_LENGTH;
+        }
+        else
+        {
+            NdisMoveMemory(InformationBuffer, copySource, copyLength);
+            *BytesWritten = copyLength;
+            *BytesNeeded = copyLength;
+        }
+    }
+    else
+    {
+        *BytesWritten = 0;
+        *BytesNeeded = 0;
+    }
+
+    NdisReleaseSpinLock(&adapter->Lock);
+
+    NDIS_DbgPrint(MAX_TRACE, ("Query OID 0x%x: Completed with status 0x%x (%d, %d)\n",
+                              Oid, status, *BytesWritten, *BytesNeeded));
+
+    return status;
+}
+
+NDIS_STATUS
+NTAPI
+MiniportSetInformation (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN NDIS_OID Oid,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength,
+    OUT PULONG BytesRead,
+    OUT PULONG BytesNeeded
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    ULONG genericUlong;
+    NDIS_STATUS status;
+
+    status = NDIS_STATUS_SUCCESS;
+
+    NdisAcquireSpinLock(&adapter->Lock);
+
+    switch (Oid)
+    {
+        case OID_GEN_CURRENT_PACKET_FILTER:
+            if (InformationBufferLength < sizeof(ULONG))
+            {
+                *BytesRead = 0;
+                *BytesNeeded = sizeof(ULONG);
+                status = NDIS_STATUS_INVALID_LENGTH;
+                break;
+            }
+
+            NdisMoveMemory(&genericUlong, InformationBuffer, sizeof(ULONG));
+
+            if (genericUlong &
+                (NDIS_PACKET_TYPE_ALL_FUNCTIONAL |
+                 NDIS_PACKET_TYPE_FUNCTIONAL |
+                 NDIS_PACKET_TYPE_GROUP |
+                 NDIS_PACKET_TYPE_MAC_FRAME |
+                 NDIS_PACKET_TYPE_SMT |
+                 NDIS_PACKET_TYPE_SOURCE_ROUTING))
+            {
+                *BytesRead = sizeof(ULONG);
+                *BytesNeeded = sizeof(ULONG);
+                status = NDIS_STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            adapter->PacketFilter = genericUlong;
+
+            status = NICApplyPacketFilter(adapter);
+            if (status != NDIS_STATUS_SUCCESS)
+            {
+                NDIS_DbgPrint(MIN_TRACE, ("Failed to apply new packet filter\n"));
+                break;
+            }
+
+            break;
+
+        case OID_GEN_CURRENT_LOOKAHEAD:
+            if (InformationBufferLength < sizeof(ULONG))
+            {
+                *BytesRead = 0;
+                *BytesNeeded = sizeof(ULONG);
+                status = NDIS_STATUS_INVALID_LENGTH;
+                break;
+            }
+
+            NdisMoveMemory(&genericUlong, InformationBuffer, sizeof(ULONG));
+
+            if (genericUlong > MAXIMUM_FRAME_SIZE - ETH_HEADER_LENGTH)
+            {
+                status = NDIS_STATUS_INVALID_DATA;
+            }
+            else
+            {
+                // Ignore this...
+            }
+
+            break;
+
+        case OID_802_3_MULTICAST_LIST:
+            if (InformationBufferLength % IEEE_802_ADDR_LENGTH)
+            {
+                *BytesRead = 0;
+                *BytesNeeded = InformationBufferLength + (InformationBufferLength % IEEE_802_ADDR_LENGTH);
+                status = NDIS_STATUS_INVALID_LENGTH;
+                break;
+            }
+
+            if (InformationBufferLength / 6 > MAXIMUM_MULTICAST_ADDRESSES)
+            {
+                *BytesNeeded = MAXIMUM_MULTICAST_ADDRESSES * IEEE_802_ADDR_LENGTH;
+                *BytesRead = 0;
+                status = NDIS_STATUS_INVALID_LENGTH;
+                break;
+            }
+
+            NdisMoveMemory(adapter->MulticastList, InformationBuffer, InformationBufferLength);
+
+            //
+            // The packet filter lets all multicast through, the protocol
+            // drops the groups it didn't join
+            //
+            break;
+
+        case OID_TCP_TASK_OFFLOAD:
+            status = NICSetTaskOffload(adapter, InformationBuffer, InformationBufferLength);
+            if (status != NDIS_STATUS_SUCCESS)
+            {
+                *BytesRead = 0;
+                *BytesNeeded = 0;
+            }
+            break;
+
+        default:
+            NDIS_DbgPrint(MIN_TRACE, ("Unknown OID\n"));
+            status = NDIS_STATUS_NOT_SUPPORTED;
+            *BytesRead = 0;
+            *BytesNeeded = 0;
+            break;
+    }
+
+    if (status == NDIS_STATUS_SUCCESS)
+    {
+        *BytesRead = InformationBufferLength;
+        *BytesNeeded = 0;
+    }
+
+    NdisReleaseSpinLock(&adapter->Lock);
+
+    return status;
+}
@@ -0,0 +1,335 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        interrupt.c
+ * PURPOSE:     Interrupt handling and receive path
+ */
+
+#include "nic.h"
+
+#define NDEBUG
+#include <debug.h>
+
+VOID
+NTAPI
+MiniportISR (
+    OUT PBOOLEAN InterruptRecognized,
+    OUT PBOOLEAN QueueMiniportHandleInterrupt,
+    IN NDIS_HANDLE MiniportAdapterContext
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    UCHAR isr;
+    ULONG i;
+
+    //
+    // Reading the ISR register acknowledges the interrupt
+    //
+    NdisRawReadPortUchar(adapter->IoBase + VIRTIO_PCI_ISR, &isr);
+    if (isr == 0)
+    {
+        //
+        // This is not ours.
+        //
+        *InterruptRecognized = FALSE;
+        *QueueMiniportHandleInterrupt = FALSE;
+        return;
+    }
+
+    InterlockedOr(&adapter->InterruptPending, isr);
+
+    //
+    // The DPC drains the receive queues, the device needn't interrupt
+    // again until it's done
+    //
+    for (i = 0; i < adapter->QueuePairs; i++)
+    {
+        adapter->Pairs[i].Rx.Avail->Flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    }
+
+    *InterruptRecognized = TRUE;
+    *QueueMiniportHandleInterrupt = TRUE;
+}
+
+static
+BOOLEAN
+NICCompleteReceiveChecksum (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_NET_HDR Header,
+    IN PUCHAR Frame,
+    IN ULONG Length
+    )
+{
+    ULONG start = Header->ChecksumStart;
+    ULONG offset = Header->ChecksumOffset;
+    USHORT checksum;
+
+    if (start + offset + sizeof(USHORT) > Length)
+    {
+        Adapter->ReceiveError++;
+        return FALSE;
+    }
+
+    //
+    // The field already holds the pseudo header sum, fold in the rest
+    //
+    checksum = ~NICChecksumFold(NICChecksumAdd(0, Frame + start, Length - start));
+    if (checksum == 0 && offset == UDP_CHECKSUM_OFFSET)
+    {
+        checksum = 0xFFFF;
+    }
+
+    Frame[start + offset] = (UCHAR)(checksum >> 8);
+    Frame[start + offset + 1] = (UCHAR)checksum;
+
+    return TRUE;
+}
+
+static
+VOID
+NICProcessReceiveChecksum (
+    IN PVNET_ADAPTER Adapter,
+    IN PNDIS_PACKET Packet,
+    IN PVIRTIO_NET_HDR Header,
+    IN PUCHAR Frame,
+    IN ULONG Length
+    )
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO checksumInfo;
+    ULONG headerLength, payloadLength;
+    UCHAR protocol;
+    BOOLEAN valid;
+
+    checksumInfo.Value = 0;
+
+    if (Header->Flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+    {
+        //
+        // Always finish the checksum, even for a protocol that trusts us
+        // with it. The packet can be forwarded as is, and packets indicated
+        // with NDIS_STATUS_RESOURCES are copied through the protocol's
+        // Receive handler, which never sees the per packet info
+        //
+        valid = NICCompleteReceiveChecksum(Adapter, Header, Frame, Length);
+    }
+    else
+    {
+        valid = (Header->Flags & VIRTIO_NET_HDR_F_DATA_VALID) != 0;
+    }
+
+    if (valid)
+    {
+        protocol = NICParseIpv4Header(Frame, Length, &headerLength, &payloadLength);
+
+        if (protocol == IP_PROTOCOL_TCP && Adapter->ChecksumOffload.V4Receive.TcpChecksum)
+        {
+            checksumInfo.Receive.NdisPacketTcpChecksumSucceeded = 1;
+        }
+        else if (protocol == IP_PROTOCOL_UDP && Adapter->ChecksumOffload.V4Receive.UdpChecksum)
+        {
+            checksumInfo.Receive.NdisPacketUdpChecksumSucceeded = 1;
+        }
+    }
+
+    NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpIpChecksumPacketInfo) = UlongToPtr(checksumInfo.Value);
+}
+
+static
+VOID
+NICReceivePackets (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE_PAIR Pair
+    )
+{
+    PVIRTIO_QUEUE queue = &Pair->Rx;
+    PNDIS_PACKET packets[RX_INDICATE_BATCH];
+    PVRING_USED_ELEM element;
+    PNDIS_PACKET packet;
+    PNDIS_BUFFER ndisBuffer;
+    PUCHAR buffer;
+    USHORT usedIndex, slot;
+    ULONG count, length, i;
+
+    for (;;)
+    {
+        usedIndex = queue->Used->Index;
+        KeMemoryBarrier();
+        if (queue->LastUsedIndex == usedIndex)
+        {
+            break;
+        }
+
+        count = 0;
+        while (queue->LastUsedIndex != usedIndex && count < RX_INDICATE_BATCH)
+        {
+            element = &queue->Used->Ring[queue->LastUsedIndex & (queue->Size - 1)];
+            slot = (USHORT)(element->Id / 2);
+            length = element->Length;
+            queue->LastUsedIndex++;
+            Pair->RxPosted--;
+
+            ASSERT(slot < queue->BufferCount);
+
+            if (length < BUFFER_FRAME_OFFSET + ETH_HEADER_LENGTH || length > BUFFER_SIZE)
+            {
+                NDIS_DbgPrint(MIN_TRACE, ("Bad receive length %d\n", length));
+                Adapter->ReceiveError++;
+                NICPostReceiveBuffer(Adapter, Pair, slot);
+                continue;
+            }
+
+            length -= BUFFER_FRAME_OFFSET;
+            buffer = queue->Buffers + slot * BUFFER_SIZE;
+            packet = Pair->RxPackets[slot];
+
+            NICProcessReceiveChecksum(Adapter,
+                                      packet,
+                                      (PVIRTIO_NET_HDR)buffer,
+                                      buffer + BUFFER_FRAME_OFFSET,
+                                      length);
+
+            NdisQueryPacket(packet, NULL, NULL, &ndisBuffer, NULL);
+            NdisAdjustBufferLength(ndisBuffer, length);
+            NdisRecalculatePacketCounts(packet);
+            NDIS_SET_PACKET_HEADER_SIZE(packet, ETH_HEADER_LENGTH);
+
+            //
+            // When we're running out of buffers the protocol has to copy
+            // the data and give the buffer back right away
+            //
+            if (Pair->RxPosted < RX_LOW_WATER)
+            {
+                NDIS_SET_PACKET_STATUS(packet, NDIS_STATUS_RESOURCES);
+                Adapter->ReceiveNoBufferSpace++;
+            }
+            else
+            {
+                NDIS_SET_PACKET_STATUS(packet, NDIS_STATUS_SUCCESS);
+            }
+
+            packets[count++] = packet;
+            Adapter->ReceiveOk++;
+        }
+
+        if (count != 0)
+        {
+            NdisDprReleaseSpinLock(&Adapter->Lock);
+            NdisMIndicateReceivePacket(Adapter->MiniportAdapterHandle, packets, count);
+            NdisDprAcquireSpinLock(&Adapter->Lock);
+
+            //
+            // Packets the protocol didn't keep are ours again
+            //
+            for (i = 0; i < count; i++)
+            {
+                if (NDIS_GET_PACKET_STATUS(packets[i]) != NDIS_STATUS_PENDING)
+                {
+                    NICPostReceiveBuffer(Adapter, Pair, RX_CONTEXT(packets[i])->Buffer);
+                }
+            }
+        }
+
+        NICNotifyQueue(Adapter, queue);
+    }
+}
+
+VOID
+NTAPI
+MiniportHandleInterrupt (
+    IN NDIS_HANDLE MiniportAdapterContext
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    PVIRTIO_QUEUE_PAIR pair;
+    BOOLEAN moreWork, sendResourcesAvailable;
+    LONG interruptPending;
+    ULONG i;
+
+    NdisDprAcquireSpinLock(&adapter->Lock);
+
+    interruptPending = InterlockedExchange(&adapter->InterruptPending, 0);
+
+    NDIS_DbgPrint(MAX_TRACE, ("Interrupts pending: 0x%x\n", interruptPending));
+
+    if (interruptPending & VIRTIO_PCI_ISR_CONFIG)
+    {
+        NICUpdateLinkStatus(adapter);
+    }
+
+    //
+    // Handle a link change
+    //
+    if (adapter->LinkChange)
+    {
+        adapter->LinkChange = FALSE;
+        NdisDprReleaseSpinLock(&adapter->Lock);
+        NdisMIndicateStatus(adapter->MiniportAdapterHandle,
+                            adapter->MediaState == NdisMediaStateConnected ?
+                                NDIS_STATUS_MEDIA_CONNECT : NDIS_STATUS_MEDIA_DISCONNECT,
+                            NULL,
+                            0);
+        NdisMIndicateStatusComplete(adapter->MiniportAdapterHandle);
+        NdisDprAcquireSpinLock(&adapter->Lock);
+    }
+
+    sendResourcesAvailable = FALSE;
+    do
+    {
+        //
+        // Transmit buffers only interrupt when a send is waiting for them
+        //
+        for (i = 0; i < adapter->QueuePairs; i++)
+        {
+            pair = &adapter->Pairs[i];
+            NICReclaimTransmitBuffers(adapter, pair);
+            if (adapter->SendResourcesNeeded &&
+                !(pair->Tx.Avail->Flags & VRING_AVAIL_F_NO_INTERRUPT) &&
+                pair->TxFreeCount != 0)
+            {
+                sendResourcesAvailable = TRUE;
+            }
+        }
+
+        for (i = 0; i < adapter->QueuePairs; i++)
+        {
+            NICReceivePackets(adapter, &adapter->Pairs[i]);
+        }
+
+        //
+        // Re-enable interrupts, then catch anything that slipped in
+        // before the device saw the flag
+        //
+        for (i = 0; i < adapter->QueuePairs; i++)
+        {
+            adapter->Pairs[i].Rx.Avail->Flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+        }
+
+        KeMemoryBarrier();
+
+        moreWork = FALSE;
+        for (i = 0; i < adapter->QueuePairs; i++)
+        {
+            pair = &adapter->Pairs[i];
+            if (pair->Rx.Used->Index != pair->Rx.LastUsedIndex)
+            {
+                pair->Rx.Avail->Flags |= VRING_AVAIL_F_NO_INTERRUPT;
+                moreWork = TRUE;
+            }
+        }
+    } while (moreWork);
+
+    if (sendResourcesAvailable)
+    {
+        adapter->SendResourcesNeeded = FALSE;
+        for (i = 0; i < adapter->QueuePairs; i++)
+        {
+            adapter->Pairs[i].Tx.Avail->Flags |= VRING_AVAIL_F_NO_INTERRUPT;
+        }
+
+        NdisDprReleaseSpinLock(&adapter->Lock);
+        NdisMSendResourcesAvailable(adapter->MiniportAdapterHandle);
+        return;
+    }
+
+    NdisDprReleaseSpinLock(&adapter->Lock);
+}
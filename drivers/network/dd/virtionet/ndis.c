@@ -0,0 +1,616 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        ndis.c
+ * PURPOSE:     Miniport entry points and transmit path
+ */
+
+#include "nic.h"
+
+#define NDEBUG
+#include <debug.h>
+
+ULONG DebugTraceLevel = MIN_TRACE;
+
+NDIS_STATUS
+NTAPI
+MiniportReset (
+    OUT PBOOLEAN AddressingReset,
+    IN NDIS_HANDLE MiniportAdapterContext
+    )
+{
+    *AddressingReset = FALSE;
+    return NDIS_STATUS_FAILURE;
+}
+
+static
+ULONG
+NICSelectTransmitQueue (
+    IN PVNET_ADAPTER Adapter,
+    IN PUCHAR Frame,
+    IN ULONG Length
+    )
+{
+    ULONG headerLength, payloadLength, hash;
+    UCHAR protocol;
+
+    if (Adapter->QueuePairs == 1)
+    {
+        return 0;
+    }
+
+    //
+    // Keep every TCP or UDP flow on one queue so it stays in order
+    //
+    protocol = NICParseIpv4Header(Frame, Length, &headerLength, &payloadLength);
+    if (protocol == 0)
+    {
+        return 0;
+    }
+
+    hash = NICChecksumAdd(0, Frame + ETH_HEADER_LENGTH + 12, 8);
+    if ((protocol == IP_PROTOCOL_TCP || protocol == IP_PROTOCOL_UDP) && payloadLength >= 4)
+    {
+        hash = NICChecksumAdd(hash, Frame + ETH_HEADER_LENGTH + headerLength, 4);
+    }
+
+    return NICChecksumFold(hash) % Adapter->QueuePairs;
+}
+
+static
+VOID
+NICPrepareTransmitChecksum (
+    IN PVNET_ADAPTER Adapter,
+    IN PNDIS_PACKET Packet,
+    IN PVIRTIO_NET_HDR Header,
+    IN PUCHAR Frame,
+    IN ULONG Length
+    )
+{
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO checksumInfo;
+    ULONG headerLength, payloadLength, checksumOffset, sum;
+    USHORT pseudoHeader;
+    UCHAR protocol;
+
+    checksumInfo.Value = PtrToUlong(NDIS_PER_PACKET_INFO_FROM_PACKET(Packet, TcpIpChecksumPacketInfo));
+    if (!checksumInfo.Transmit.NdisPacketChecksumV4)
+    {
+        return;
+    }
+
+    protocol = NICParseIpv4Header(Frame, Length, &headerLength, &payloadLength);
+    if (protocol == IP_PROTOCOL_TCP && checksumInfo.Transmit.NdisPacketTcpChecksum &&
+        Adapter->ChecksumOffload.V4Transmit.TcpChecksum && payloadLength >= 20)
+    {
+        checksumOffset = TCP_CHECKSUM_OFFSET;
+    }
+    else if (protocol == IP_PROTOCOL_UDP && checksumInfo.Transmit.NdisPacketUdpChecksum &&
+             Adapter->ChecksumOffload.V4Transmit.UdpChecksum && payloadLength >= 8)
+    {
+        checksumOffset = UDP_CHECKSUM_OFFSET;
+    }
+    else
+    {
+        return;
+    }
+
+    //
+    // The device sums from ChecksumStart to the end of the frame and stores
+    // the result at ChecksumOffset, seed that field with the pseudo header
+    //
+    sum = NICChecksumAdd(0, Frame + ETH_HEADER_LENGTH + 12, 8);
+    sum += protocol + payloadLength;
+    pseudoHeader = NICChecksumFold(sum);
+
+    Frame[ETH_HEADER_LENGTH + headerLength + checksumOffset] = (UCHAR)(pseudoHeader >> 8);
+    Frame[ETH_HEADER_LENGTH + headerLength + checksumOffset + 1] = (UCHAR)pseudoHeader;
+
+    Header->Flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    Header->ChecksumStart = (USHORT)(ETH_HEADER_LENGTH + headerLength);
+    Header->ChecksumOffset = (USHORT)checksumOffset;
+}
+
+static
+ULONG
+NICCopyPacket (
+    IN PNDIS_PACKET Packet,
+    OUT PUCHAR Frame
+    )
+{
+    PNDIS_BUFFER ndisBuffer;
+    PVOID bufferVa;
+    UINT bufferLength, totalLength;
+    ULONG copied;
+
+    NdisQueryPacket(Packet, NULL, NULL, &ndisBuffer, &totalLength);
+    if (totalLength > MAXIMUM_FRAME_SIZE)
+    {
+        return 0;
+    }
+
+    copied = 0;
+    while (ndisBuffer != NULL)
+    {
+        NdisQueryBufferSafe(ndisBuffer, &bufferVa, &bufferLength, NormalPagePriority);
+        if (bufferVa == NULL)
+        {
+            return 0;
+        }
+
+        RtlCopyMemory(Frame + copied, bufferVa, bufferLength);
+        copied += bufferLength;
+
+        NdisGetNextBuffer(ndisBuffer, &ndisBuffer);
+    }
+
+    return copied;
+}
+
+VOID
+NTAPI
+MiniportSendPackets (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN PPNDIS_PACKET PacketArray,
+    IN UINT NumberOfPackets
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    PVIRTIO_QUEUE_PAIR pair;
+    PVIRTIO_NET_HDR header;
+    PNDIS_BUFFER firstBuffer;
+    PVOID firstBufferVa;
+    UINT firstBufferLength, totalBufferLength;
+    PUCHAR buffer;
+    ULONG pairIndex, length, pending, i;
+    USHORT slot;
+
+    NdisAcquireSpinLock(&adapter->Lock);
+
+    pending = 0;
+    for (i = 0; i < NumberOfPackets; i++)
+    {
+        //
+        // Once one packet is out of space the rest wait with it to stay in order
+        //
+        if (adapter->SendResourcesNeeded)
+        {
+            NDIS_SET_PACKET_STATUS(PacketArray[i], NDIS_STATUS_RESOURCES);
+            continue;
+        }
+
+        NdisGetFirstBufferFromPacketSafe(PacketArray[i],
+                                         &firstBuffer,
+                                         &firstBufferVa,
+                                         &firstBufferLength,
+                                         &totalBufferLength,
+                                         NormalPagePriority);
+        pairIndex = (firstBufferVa != NULL) ?
+            NICSelectTransmitQueue(adapter, firstBufferVa, firstBufferLength) : 0;
+        pair = &adapter->Pairs[pairIndex];
+
+        if (pair->TxFreeCount == 0)
+        {
+            NICReclaimTransmitBuffers(adapter, pair);
+        }
+
+        if (pair->TxFreeCount == 0)
+        {
+            //
+            // Have the device interrupt once it has sent something, and
+            // catch whatever it finished before it saw the flag
+            //
+            pair->Tx.Avail->Flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+            KeMemoryBarrier();
+            NICReclaimTransmitBuffers(adapter, pair);
+        }
+
+        if (pair->TxFreeCount == 0)
+        {
+            NDIS_DbgPrint(MID_TRACE, ("All TX buffers of queue pair %d are full\n", pairIndex));
+            adapter->SendResourcesNeeded = TRUE;
+            NDIS_SET_PACKET_STATUS(PacketArray[i], NDIS_STATUS_RESOURCES);
+            continue;
+        }
+
+        slot = pair->TxFree[--pair->TxFreeCount];
+        buffer = pair->Tx.Buffers + slot * BUFFER_SIZE;
+        header = (PVIRTIO_NET_HDR)buffer;
+
+        length = NICCopyPacket(PacketArray[i], buffer + BUFFER_FRAME_OFFSET);
+        if (length < ETH_HEADER_LENGTH)
+        {
+            NDIS_DbgPrint(MIN_TRACE, ("Unable to copy packet for transmit\n"));
+            pair->TxFree[pair->TxFreeCount++] = slot;
+            adapter->TransmitError++;
+            NDIS_SET_PACKET_STATUS(PacketArray[i], NDIS_STATUS_FAILURE);
+            continue;
+        }
+
+        RtlZeroMemory(header, sizeof(*header));
+        header->GsoType = VIRTIO_NET_HDR_GSO_NONE;
+        NICPrepareTransmitChecksum(adapter, PacketArray[i], header, buffer + BUFFER_FRAME_OFFSET, length);
+
+        pair->Tx.Desc[slot * 2 + 1].Length = length;
+        pair->Tx.Avail->Ring[pair->Tx.AvailIndex & (pair->Tx.Size - 1)] = slot * 2;
+        pair->Tx.AvailIndex++;
+        pending |= (1 << pairIndex);
+
+        //
+        // The frame is copied out, so the packet is done as far as NDIS cares
+        //
+        NDIS_SET_PACKET_STATUS(PacketArray[i], NDIS_STATUS_SUCCESS);
+    }
+
+    //
+    // One notification covers every frame queued above
+    //
+    for (i = 0; i < adapter->QueuePairs; i++)
+    {
+        if (pending & (1 << i))
+        {
+            NICNotifyQueue(adapter, &adapter->Pairs[i].Tx);
+        }
+    }
+
+    NdisReleaseSpinLock(&adapter->Lock);
+}
+
+VOID
+NTAPI
+MiniportReturnPacket (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN PNDIS_PACKET Packet
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+    PVIRTIO_QUEUE_PAIR pair;
+
+    NdisDprAcquireSpinLock(&adapter->Lock);
+
+    pair = &adapter->Pairs[RX_CONTEXT(Packet)->Pair];
+    NICPostReceiveBuffer(adapter, pair, RX_CONTEXT(Packet)->Buffer);
+    NICNotifyQueue(adapter, &pair->Rx);
+
+    NdisDprReleaseSpinLock(&adapter->Lock);
+}
+
+VOID
+NTAPI
+MiniportHalt (
+    IN NDIS_HANDLE MiniportAdapterContext
+    )
+{
+    PVNET_ADAPTER adapter = (PVNET_ADAPTER)MiniportAdapterContext;
+
+    ASSERT(adapter != NULL);
+
+    //
+    // Interrupts need to stop first
+    //
+    if (adapter->InterruptRegistered != FALSE)
+    {
+        NdisMDeregisterInterrupt(&adapter->Interrupt);
+    }
+
+    //
+    // If we have a mapped IO port range, we can talk to the NIC
+    //
+    if (adapter->IoBase != NULL)
+    {
+        //
+        // Stop the device before freeing the rings it writes to
+        //
+        NICResetDevice(adapter);
+        NICFreeQueues(adapter);
+
+        //
+        // Unregister the IO range
+        //
+        NdisMDeregisterIoPortRange(adapter->MiniportAdapterHandle,
+                                   adapter->IoRangeStart,
+                                   adapter->IoRangeLength,
+                                   adapter->IoBase);
+    }
+
+    if (adapter->MapRegistersAllocated != FALSE)
+    {
+        NdisMFreeMapRegisters(adapter->MiniportAdapterHandle);
+    }
+
+    NdisFreeSpinLock(&adapter->Lock);
+
+    //
+    // Destroy the adapter context
+    //
+    NdisFreeMemory(adapter, sizeof(*adapter), 0);
+}
+
+NDIS_STATUS
+NTAPI
+MiniportInitialize (
+    OUT PNDIS_STATUS OpenErrorStatus,
+    OUT PUINT SelectedMediumIndex,
+    IN PNDIS_MEDIUM MediumArray,
+    IN UINT MediumArraySize,
+    IN NDIS_HANDLE MiniportAdapterHandle,
+    IN NDIS_HANDLE WrapperConfigurationContext
+    )
+{
+    PVNET_ADAPTER adapter;
+    NDIS_STATUS status;
+    UINT i;
+    PNDIS_RESOURCE_LIST resourceList;
+    UINT resourceListSize;
+
+    //
+    // Make sure the medium is supported
+    //
+    for (i = 0; i < MediumArraySize; i++)
+    {
+        if (MediumArray[i] == NdisMedium802_3)
+        {
+            *SelectedMediumIndex = i;
+            break;
+        }
+    }
+
+    if (i == MediumArraySize)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("802.3 medium was not found in the medium array\n"));
+        return NDIS_STATUS_UNSUPPORTED_MEDIA;
+    }
+
+    //
+    // Allocate our adapter context
+    //
+    status = NdisAllocateMemoryWithTag((PVOID*)&adapter,
+                                       sizeof(*adapter),
+                                       ADAPTER_TAG);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Failed to allocate adapter context\n"));
+        return NDIS_STATUS_RESOURCES;
+    }
+
+    RtlZeroMemory(adapter, sizeof(*adapter));
+    adapter->MiniportAdapterHandle = MiniportAdapterHandle;
+    adapter->MediaState = NdisMediaStateConnected;
+    NdisAllocateSpinLock(&adapter->Lock);
+
+    //
+    // Notify NDIS of some characteristics of our NIC
+    //
+    NdisMSetAttributesEx(MiniportAdapterHandle,
+                         adapter,
+                         0,
+                         NDIS_ATTRIBUTE_BUS_MASTER,
+                         NdisInterfacePci);
+
+    //
+    // Get our resources for IRQ and IO base information
+    //
+    resourceList = NULL;
+    resourceListSize = 0;
+    NdisMQueryAdapterResources(&status,
+                               WrapperConfigurationContext,
+                               resourceList,
+                               &resourceListSize);
+    if (status != NDIS_STATUS_RESOURCES)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unexpected failure of NdisMQueryAdapterResources #1\n"));
+        status = NDIS_STATUS_FAILURE;
+        goto Cleanup;
+    }
+
+    status = NdisAllocateMemoryWithTag((PVOID*)&resourceList,
+                                resourceListSize,
+                                RESOURCE_LIST_TAG);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Failed to allocate resource list\n"));
+        goto Cleanup;
+    }
+
+    NdisMQueryAdapterResources(&status,
+                               WrapperConfigurationContext,
+                               resourceList,
+                               &resourceListSize);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unexpected failure of NdisMQueryAdapterResources #2\n"));
+        goto Cleanup;
+    }
+
+    ASSERT(resourceList->Version == 1);
+    ASSERT(resourceList->Revision == 1);
+
+    for (i = 0; i < resourceList->Count; i++)
+    {
+        switch (resourceList->PartialDescriptors[i].Type)
+        {
+            case CmResourceTypePort:
+                ASSERT(adapter->IoRangeStart == 0);
+
+                ASSERT(resourceList->PartialDescriptors[i].u.Port.Start.HighPart == 0);
+
+                adapter->IoRangeStart = resourceList->PartialDescriptors[i].u.Port.Start.LowPart;
+                adapter->IoRangeLength = resourceList->PartialDescriptors[i].u.Port.Length;
+
+                NDIS_DbgPrint(MID_TRACE, ("I/O port range is %p to %p\n",
+                              adapter->IoRangeStart, adapter->IoRangeStart + adapter->IoRangeLength));
+                break;
+
+            case CmResourceTypeInterrupt:
+                ASSERT(adapter->InterruptVector == 0);
+                ASSERT(adapter->InterruptLevel == 0);
+
+                adapter->InterruptVector = resourceList->PartialDescriptors[i].u.Interrupt.Vector;
+                adapter->InterruptLevel = resourceList->PartialDescriptors[i].u.Interrupt.Level;
+                adapter->InterruptShared = (resourceList->PartialDescriptors[i].ShareDisposition == CmResourceShareShared);
+                adapter->InterruptFlags = resourceList->PartialDescriptors[i].Flags;
+
+                NDIS_DbgPrint(MID_TRACE, ("IRQ vector is %d\n", adapter->InterruptVector));
+                break;
+
+            default:
+                NDIS_DbgPrint(MIN_TRACE, ("Unrecognized resource type: 0x%x\n", resourceList->PartialDescriptors[i].Type));
+                break;
+        }
+    }
+
+    NdisFreeMemory(resourceList, resourceListSize, 0);
+    resourceList = NULL;
+
+    if (adapter->IoRangeStart == 0 || adapter->InterruptVector == 0)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Adapter didn't receive enough resources\n"));
+        status = NDIS_STATUS_RESOURCES;
+        goto Cleanup;
+    }
+
+    //
+    // Frames are copied through buffers shared with the device, so all we
+    // need from DMA is the adapter object behind NdisMAllocateSharedMemory
+    //
+    status = NdisMAllocateMapRegisters(MiniportAdapterHandle,
+                                       0,
+                                       NDIS_DMA_64BITS,
+                                       1,
+                                       BUFFER_SIZE);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to configure DMA\n"));
+        goto Cleanup;
+    }
+
+    adapter->MapRegistersAllocated = TRUE;
+
+    //
+    // Register the I/O port range and configure the NIC
+    //
+    status = NdisMRegisterIoPortRange((PVOID*)&adapter->IoBase,
+                                      MiniportAdapterHandle,
+                                      adapter->IoRangeStart,
+                                      adapter->IoRangeLength);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to register IO port range (0x%x)\n", status));
+        goto Cleanup;
+    }
+
+    //
+    // Adapter setup
+    //
+    status = NICInitializeDevice(adapter);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to initialize the device (0x%x)\n", status));
+        goto Cleanup;
+    }
+
+    NICGetPermanentMacAddress(adapter, adapter->PermanentMacAddress);
+    RtlCopyMemory(adapter->CurrentMacAddress, adapter->PermanentMacAddress, IEEE_802_ADDR_LENGTH);
+
+    //
+    // Update link state
+    //
+    NICUpdateLinkStatus(adapter);
+    adapter->LinkChange = FALSE;
+
+    status = NICSetupQueues(adapter);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to set up the queues (0x%x)\n", status));
+        goto Cleanup;
+    }
+
+    //
+    // We're ready to handle interrupts now
+    //
+    status = NdisMRegisterInterrupt(&adapter->Interrupt,
+                                    MiniportAdapterHandle,
+                                    adapter->InterruptVector,
+                                    adapter->InterruptLevel,
+                                    TRUE, // We always want ISR calls
+                                    adapter->InterruptShared,
+                                    (adapter->InterruptFlags & CM_RESOURCE_INTERRUPT_LATCHED) ?
+                                        NdisInterruptLatched : NdisInterruptLevelSensitive);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to register interrupt (0x%x)\n", status));
+        goto Cleanup;
+    }
+
+    adapter->InterruptRegistered = TRUE;
+
+    //
+    // Turn on TX and RX now
+    //
+    status = NICStartDevice(adapter);
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NDIS_DbgPrint(MIN_TRACE, ("Unable to start the device (0x%x)\n", status));
+        goto Cleanup;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+
+Cleanup:
+    if (resourceList != NULL)
+    {
+        NdisFreeMemory(resourceList, resourceListSize, 0);
+    }
+    if (adapter != NULL)
+    {
+        MiniportHalt(adapter);
+    }
+
+    return status;
+}
+
+NTSTATUS
+NTAPI
+DriverEntry (
+    IN PDRIVER_OBJECT DriverObject,
+    IN PUNICODE_STRING RegistryPath
+    )
+{
+    NDIS_HANDLE wrapperHandle;
+    NDIS_MINIPORT_CHARACTERISTICS characteristics;
+    NDIS_STATUS status;
+
+    RtlZeroMemory(&characteristics, sizeof(characteristics));
+    characteristics.MajorNdisVersion = NDIS_MINIPORT_MAJOR_VERSION;
+    characteristics.MinorNdisVersion = NDIS_MINIPORT_MINOR_VERSION;
+    characteristics.CheckForHangHandler = NULL;
+    characteristics.DisableInterruptHandler = NULL;
+    characteristics.EnableInterruptHandler = NULL;
+    characteristics.HaltHandler = MiniportHalt;
+    characteristics.HandleInterruptHandler = MiniportHandleInterrupt;
+    characteristics.InitializeHandler = MiniportInitialize;
+    characteristics.ISRHandler = MiniportISR;
+    characteristics.QueryInformationHandler = MiniportQueryInformation;
+    characteristics.ReconfigureHandler = NULL;
+    characteristics.ResetHandler = MiniportReset;
+    characteristics.SendHandler = NULL;
+    characteristics.SetInformationHandler = MiniportSetInformation;
+    characteristics.TransferDataHandler = NULL;
+    characteristics.ReturnPacketHandler = MiniportReturnPacket;
+    characteristics.SendPacketsHandler = MiniportSendPackets;
+    characteristics.AllocateCompleteHandler = NULL;
+
+    NdisMInitializeWrapper(&wrapperHandle, DriverObject, RegistryPath, NULL);
+    if (!wrapperHandle)
+    {
+        return NDIS_STATUS_FAILURE;
+    }
+
+    status = NdisMRegisterMiniport(wrapperHandle, &characteristics, sizeof(characteristics));
+    if (status != NDIS_STATUS_SUCCESS)
+    {
+        NdisTerminateWrapper(wrapperHandle, 0);
+        return NDIS_STATUS_FAILURE;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
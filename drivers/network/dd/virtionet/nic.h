@@ -0,0 +1,278 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        nic.h
+ * PURPOSE:     Virtio network driver definitions
+ */
+
+#ifndef _VIRTIONET_PCH_
+#define _VIRTIONET_PCH_
+
+#include <ndis.h>
+
+#include "virtiohw.h"
+
+#define ADAPTER_TAG 'Aoiv'
+#define RESOURCE_LIST_TAG 'Roiv'
+
+#define MAXIMUM_FRAME_SIZE 1514
+#define ETH_HEADER_LENGTH 14
+#define MAXIMUM_MULTICAST_ADDRESSES 32
+
+#define DRIVER_VERSION 1
+
+// More queue pairs than this rarely help a single NDIS 5 interrupt
+#define MAXIMUM_QUEUE_PAIRS 4
+
+// Buffers are posted in pairs of descriptors, one for the header and
+// one for the frame, so a queue never holds more than half its size
+#define RX_BUFFER_COUNT 128
+#define TX_BUFFER_COUNT 64
+
+// Below this many posted buffers received packets are copied out
+// and the buffer is reposted right away
+#define RX_LOW_WATER 16
+
+// Every buffer holds a virtio-net header followed by a full frame.
+// The 10 byte header leaves the IP header 4 byte aligned
+#define BUFFER_SIZE 1536
+#define BUFFER_FRAME_OFFSET sizeof(VIRTIO_NET_HDR)
+
+// Received packets are handed to NDIS in batches of this many
+#define RX_INDICATE_BATCH 16
+
+// Control commands are polled, the device answers them right away
+#define CONTROL_TIMEOUT_US 100000
+#define CONTROL_BUFFER_SIZE 32
+#define CONTROL_DATA_OFFSET 8
+#define CONTROL_ACK_OFFSET 16
+
+#define IP_PROTOCOL_TCP 6
+#define IP_PROTOCOL_UDP 17
+
+// Where the checksum sits in the TCP and UDP headers
+#define TCP_CHECKSUM_OFFSET 16
+#define UDP_CHECKSUM_OFFSET 6
+
+typedef struct _VIRTIO_QUEUE {
+    USHORT Index;
+    USHORT Size;
+
+    PUCHAR Ring;
+    NDIS_PHYSICAL_ADDRESS RingPa;
+    ULONG RingLength;
+    PVRING_DESC Desc;
+    PVRING_AVAIL Avail;
+    PVRING_USED Used;
+
+    USHORT AvailIndex;
+    USHORT LastUsedIndex;
+
+    PUCHAR Buffers;
+    NDIS_PHYSICAL_ADDRESS BuffersPa;
+    ULONG BuffersLength;
+    USHORT BufferCount;
+} VIRTIO_QUEUE, *PVIRTIO_QUEUE;
+
+typedef struct _VIRTIO_QUEUE_PAIR {
+    VIRTIO_QUEUE Rx;
+    VIRTIO_QUEUE Tx;
+
+    PNDIS_PACKET RxPackets[RX_BUFFER_COUNT];
+    USHORT RxPosted;
+
+    USHORT TxFree[TX_BUFFER_COUNT];
+    USHORT TxFreeCount;
+    BOOLEAN TxPending;
+} VIRTIO_QUEUE_PAIR, *PVIRTIO_QUEUE_PAIR;
+
+// Received packets remember where their buffer came from
+typedef struct _RX_PACKET_CONTEXT {
+    USHORT Pair;
+    USHORT Buffer;
+} RX_PACKET_CONTEXT, *PRX_PACKET_CONTEXT;
+
+#define RX_CONTEXT(Packet) ((PRX_PACKET_CONTEXT)(Packet)->MiniportReserved)
+
+typedef struct _VNET_ADAPTER {
+    NDIS_HANDLE MiniportAdapterHandle;
+    NDIS_SPIN_LOCK Lock;
+
+    ULONG IoRangeStart;
+    ULONG IoRangeLength;
+
+    ULONG InterruptVector;
+    ULONG InterruptLevel;
+    BOOLEAN InterruptShared;
+    ULONG InterruptFlags;
+
+    PUCHAR IoBase;
+    NDIS_MINIPORT_INTERRUPT Interrupt;
+    BOOLEAN InterruptRegistered;
+    BOOLEAN MapRegistersAllocated;
+
+    ULONG Features;
+
+    UCHAR PermanentMacAddress[IEEE_802_ADDR_LENGTH];
+    UCHAR CurrentMacAddress[IEEE_802_ADDR_LENGTH];
+    struct {
+        UCHAR MacAddress[IEEE_802_ADDR_LENGTH];
+    } MulticastList[MAXIMUM_MULTICAST_ADDRESSES];
+
+    ULONG MediaState;
+    BOOLEAN LinkChange;
+
+    ULONG PacketFilter;
+
+    LONG InterruptPending;
+
+    ULONG QueuePairs;
+    VIRTIO_QUEUE_PAIR Pairs[MAXIMUM_QUEUE_PAIRS];
+    VIRTIO_QUEUE Control;
+
+    NDIS_HANDLE PacketPool;
+    NDIS_HANDLE BufferPool;
+
+    BOOLEAN SendResourcesNeeded;
+
+    NDIS_TASK_TCP_IP_CHECKSUM ChecksumOffload;
+
+    ULONG ReceiveOk;
+    ULONG TransmitOk;
+    ULONG ReceiveError;
+    ULONG TransmitError;
+    ULONG ReceiveNoBufferSpace;
+
+} VNET_ADAPTER, *PVNET_ADAPTER;
+
+NDIS_STATUS
+NTAPI
+NICInitializeDevice (
+    IN PVNET_ADAPTER Adapter
+    );
+
+VOID
+NTAPI
+NICResetDevice (
+    IN PVNET_ADAPTER Adapter
+    );
+
+NDIS_STATUS
+NTAPI
+NICSetupQueues (
+    IN PVNET_ADAPTER Adapter
+    );
+
+VOID
+NTAPI
+NICFreeQueues (
+    IN PVNET_ADAPTER Adapter
+    );
+
+NDIS_STATUS
+NTAPI
+NICStartDevice (
+    IN PVNET_ADAPTER Adapter
+    );
+
+VOID
+NTAPI
+NICGetPermanentMacAddress (
+    IN PVNET_ADAPTER Adapter,
+    OUT PUCHAR MacAddress
+    );
+
+NDIS_STATUS
+NTAPI
+NICApplyPacketFilter (
+    IN PVNET_ADAPTER Adapter
+    );
+
+VOID
+NTAPI
+NICUpdateLinkStatus (
+    IN PVNET_ADAPTER Adapter
+    );
+
+VOID
+NTAPI
+NICPostReceiveBuffer (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE_PAIR Pair,
+    IN USHORT Buffer
+    );
+
+VOID
+NTAPI
+NICNotifyQueue (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE Queue
+    );
+
+BOOLEAN
+NTAPI
+NICReclaimTransmitBuffers (
+    IN PVNET_ADAPTER Adapter,
+    IN PVIRTIO_QUEUE_PAIR Pair
+    );
+
+UCHAR
+NTAPI
+NICParseIpv4Header (
+    IN PUCHAR Frame,
+    IN ULONG Length,
+    OUT PULONG HeaderLength,
+    OUT PULONG PayloadLength
+    );
+
+ULONG
+NTAPI
+NICChecksumAdd (
+    IN ULONG Sum,
+    IN PUCHAR Data,
+    IN ULONG Length
+    );
+
+USHORT
+NTAPI
+NICChecksumFold (
+    IN ULONG Sum
+    );
+
+NDIS_STATUS
+NTAPI
+MiniportSetInformation (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN NDIS_OID Oid,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength,
+    OUT PULONG BytesRead,
+    OUT PULONG BytesNeeded
+    );
+
+NDIS_STATUS
+NTAPI
+MiniportQueryInformation (
+    IN NDIS_HANDLE MiniportAdapterContext,
+    IN NDIS_OID Oid,
+    IN PVOID InformationBuffer,
+    IN ULONG InformationBufferLength,
+    OUT PULONG BytesWritten,
+    OUT PULONG BytesNeeded
+    );
+
+VOID
+NTAPI
+MiniportISR (
+    OUT PBOOLEAN InterruptRecognized,
+    OUT PBOOLEAN QueueMiniportHandleInterrupt,
+    IN NDIS_HANDLE MiniportAdapterContext
+    );
+
+VOID
+NTAPI
+MiniportHandleInterrupt (
+    IN NDIS_HANDLE MiniportAdapterContext
+    );
+
+#endif /* _VIRTIONET_PCH_ */
@@ -0,0 +1,117 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Virtio Network Driver
+ * FILE:        virtiohw.h
+ * PURPOSE:     Legacy virtio PCI and virtio-net definitions
+ */
+
+#pragma once
+
+//Legacy virtio PCI registers (I/O BAR 0)
+#define VIRTIO_PCI_HOST_FEATURES    0x00    //Features offered by the device, 32 bits
+#define VIRTIO_PCI_GUEST_FEATURES   0x04    //Features accepted by the driver, 32 bits
+#define VIRTIO_PCI_QUEUE_PFN        0x08    //Page frame of the selected queue, 32 bits
+#define VIRTIO_PCI_QUEUE_NUM        0x0C    //Size of the selected queue, 16 bits
+#define VIRTIO_PCI_QUEUE_SEL        0x0E    //Queue selector, 16 bits
+#define VIRTIO_PCI_QUEUE_NOTIFY     0x10    //Queue notifier, 16 bits
+#define VIRTIO_PCI_STATUS           0x12    //Device status, 8 bits
+#define VIRTIO_PCI_ISR              0x13    //Interrupt status, cleared on read, 8 bits
+#define VIRTIO_PCI_CONFIG           0x14    //Device specific configuration without MSI-X
+
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT 12
+#define VIRTIO_PCI_VRING_ALIGN      4096
+
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 0x01    //Guest noticed the device
+#define VIRTIO_CONFIG_S_DRIVER      0x02    //Guest has a driver for it
+#define VIRTIO_CONFIG_S_DRIVER_OK   0x04    //Driver is ready to drive the device
+#define VIRTIO_CONFIG_S_FAILED      0x80    //Driver gave up on the device
+
+#define VIRTIO_PCI_ISR_QUEUE        0x01    //A queue has used buffers
+#define VIRTIO_PCI_ISR_CONFIG       0x02    //Device configuration changed
+
+//Feature bits
+#define VIRTIO_NET_F_CSUM           (1 << 0)    //Device checksums partially checksummed packets
+#define VIRTIO_NET_F_GUEST_CSUM     (1 << 1)    //Device passes partially checksummed packets up
+#define VIRTIO_NET_F_MAC            (1 << 5)    //Device has a MAC address
+#define VIRTIO_NET_F_STATUS         (1 << 16)   //Link status is available
+#define VIRTIO_NET_F_CTRL_VQ        (1 << 17)   //Control queue is available
+#define VIRTIO_NET_F_CTRL_RX        (1 << 18)   //Control queue handles RX mode
+#define VIRTIO_NET_F_MQ             (1 << 22)   //Device has more than one queue pair
+
+//virtio-net configuration space, relative to VIRTIO_PCI_CONFIG
+#define VIRTIO_NET_CONFIG_MAC       0x00    //6 byte MAC address
+#define VIRTIO_NET_CONFIG_STATUS    0x06    //Link status, 16 bits
+#define VIRTIO_NET_CONFIG_MAX_PAIRS 0x08    //Maximum queue pairs, 16 bits
+
+#define VIRTIO_NET_S_LINK_UP        0x0001
+
+//Split virtqueue layout
+typedef struct _VRING_DESC {
+    ULONGLONG Address;
+    ULONG Length;
+    USHORT Flags;
+    USHORT Next;
+} VRING_DESC, *PVRING_DESC;
+
+#define VRING_DESC_F_NEXT           0x0001  //Descriptor continues in Next
+#define VRING_DESC_F_WRITE          0x0002  //Descriptor is written by the device
+
+typedef struct _VRING_AVAIL {
+    USHORT Flags;
+    USHORT Index;
+    USHORT Ring[ANYSIZE_ARRAY];
+} VRING_AVAIL, *PVRING_AVAIL;
+
+#define VRING_AVAIL_F_NO_INTERRUPT  0x0001  //Driver doesn't need used buffer interrupts
+
+typedef struct _VRING_USED_ELEM {
+    ULONG Id;
+    ULONG Length;
+} VRING_USED_ELEM, *PVRING_USED_ELEM;
+
+typedef struct _VRING_USED {
+    USHORT Flags;
+    USHORT Index;
+    VRING_USED_ELEM Ring[ANYSIZE_ARRAY];
+} VRING_USED, *PVRING_USED;
+
+#define VRING_USED_F_NO_NOTIFY      0x0001  //Device doesn't need available buffer notifications
+
+// Descriptors and the available ring share the first part of the ring,
+// the used ring starts on the next VIRTIO_PCI_VRING_ALIGN boundary
+#define VRING_USED_OFFSET(n) \
+    ALIGN_UP_BY(sizeof(VRING_DESC) * (n) + FIELD_OFFSET(VRING_AVAIL, Ring) + \
+                sizeof(USHORT) * ((n) + 1), VIRTIO_PCI_VRING_ALIGN)
+#define VRING_SIZE(n) \
+    (VRING_USED_OFFSET(n) + \
+     ALIGN_UP_BY(FIELD_OFFSET(VRING_USED, Ring) + sizeof(VRING_USED_ELEM) * (n) + \
+                 sizeof(USHORT), VIRTIO_PCI_VRING_ALIGN))
+
+//Header in front of every frame on the RX and TX queues
+typedef struct _VIRTIO_NET_HDR {
+    UCHAR Flags;
+    UCHAR GsoType;
+    USHORT HeaderLength;
+    USHORT GsoSize;
+    USHORT ChecksumStart;
+    USHORT ChecksumOffset;
+} VIRTIO_NET_HDR, *PVIRTIO_NET_HDR;
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 0x01    //Checksum from ChecksumStart still has to be done
+#define VIRTIO_NET_HDR_F_DATA_VALID 0x02    //Device validated the checksum
+#define VIRTIO_NET_HDR_GSO_NONE     0x00
+
+//Control queue commands
+typedef struct _VIRTIO_NET_CTRL_HDR {
+    UCHAR Class;
+    UCHAR Command;
+} VIRTIO_NET_CTRL_HDR, *PVIRTIO_NET_CTRL_HDR;
+
+#define VIRTIO_NET_CTRL_RX              0
+#define VIRTIO_NET_CTRL_RX_PROMISC      0
+#define VIRTIO_NET_CTRL_RX_ALLMULTI     1
+
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+#define VIRTIO_NET_OK                   0
@@ -313,6 +313,7 @@ VOID LanReceiveWorker( PVOID Context ) {
     IP_PACKET IPPacket;
     BOOLEAN LegacyReceive;
     PIP_INTERFACE Interface;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(DEBUG_DATALINK, ("Called.\n"));
 
@@ -358,6 +359,13 @@ VOID LanReceiveWorker( PVOID Context ) {
 
         /* Calculate packet size (excluding media header) */
         NdisQueryPacketLength(IPPacket.NdisPacket, &IPPacket.TotalSize);
+
+        /* Don't checksum again what the adapter has already verified */
+        ChecksumInfo.Value = (ULONG)(ULONG_PTR)NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket.NdisPacket,
+                                                                               TcpIpChecksumPacketInfo);
+        if (ChecksumInfo.Receive.NdisPacketTcpChecksumSucceeded ||
+            ChecksumInfo.Receive.NdisPacketUdpChecksumSucceeded)
+            IPPacket.Flags |= IP_PACKET_FLAG_CHECKSUM_OK;
     }
 
     TI_DbgPrint
@@ -1006,6 +1014,10 @@ VOID LANTransmit(
 
     RtlCopyMemory(Data + Adapter->HeaderSize, OldData, OldSize);
 
+    /* Pass on any checksums the adapter was asked to compute */
+    NDIS_PER_PACKET_INFO_FROM_PACKET(XmitPacket, TcpIpChecksumPacketInfo) =
+        NDIS_PER_PACKET_INFO_FROM_PACKET(NdisPacket, TcpIpChecksumPacketInfo);
+
     (*PC(NdisPacket)->DLComplete)(PC(NdisPacket)->Context, NdisPacket, NDIS_STATUS_SUCCESS);
 
     switch (Adapter->Media) {
@@ -1309,6 +1321,102 @@ VOID GetName( PUNICODE_STRING RegistryKey,
     AppendUnicodeString( OutName, &PartialRegistryKey, FALSE );
 }
 
+VOID EnableChecksumOffload(
+    PLAN_ADAPTER Adapter,
+    PIP_INTERFACE Interface)
+/*
+ * FUNCTION: Hands TCP/UDP checksums over to the adapter if it can do them
+ * ARGUMENTS:
+ *     Adapter   = Pointer to LAN_ADAPTER structure
+ *     Interface = Pointer to the IP interface bound to the adapter
+ * NOTES:
+ *     Receive checksums are offloaded for TCP and UDP. Transmit checksums
+ *     are only offloaded for UDP, lwIP fills in its own TCP checksums
+ */
+{
+    ULONG Buffer[64];
+    PNDIS_TASK_OFFLOAD_HEADER Header = (PNDIS_TASK_OFFLOAD_HEADER)Buffer;
+    PNDIS_TASK_OFFLOAD Task;
+    PNDIS_TASK_TCP_IP_CHECKSUM Checksum;
+    NDIS_TASK_TCP_IP_CHECKSUM Enable;
+    NDIS_STATUS NdisStatus;
+    ULONG Offset;
+
+    if (Adapter->Media != NdisMedium802_3)
+        return;
+
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    Header->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Header->Size = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Header->EncapsulationFormat.Encapsulation = IEEE_802_3_Encapsulation;
+    Header->EncapsulationFormat.Flags.FixedHeaderSize = 1;
+    Header->EncapsulationFormat.EncapsulationHeaderSize = Adapter->HeaderSize;
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestQueryInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          sizeof(Buffer));
+    if (NdisStatus != NDIS_STATUS_SUCCESS) {
+        TI_DbgPrint(DEBUG_DATALINK, ("Adapter has no task offload (0x%X).\n", NdisStatus));
+        return;
+    }
+
+    /* Look for the checksum task in the list the adapter returned */
+    Checksum = NULL;
+    Offset = Header->OffsetFirstTask;
+    while (Offset != 0 &&
+           Offset + FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+           sizeof(NDIS_TASK_TCP_IP_CHECKSUM) <= sizeof(Buffer)) {
+        Task = (PNDIS_TASK_OFFLOAD)((PUCHAR)Buffer + Offset);
+
+        if (Task->Task == TcpIpChecksumNdisTask &&
+            Task->TaskBufferLength >= sizeof(NDIS_TASK_TCP_IP_CHECKSUM)) {
+            Checksum = (PNDIS_TASK_TCP_IP_CHECKSUM)Task->TaskBuffer;
+            break;
+        }
+
+        if (Task->OffsetNextTask == 0)
+            break;
+        Offset += Task->OffsetNextTask;
+    }
+
+    if (!Checksum)
+        return;
+
+    RtlZeroMemory(&Enable, sizeof(Enable));
+    Enable.V4Receive.IpOptionsSupported  = Checksum->V4Receive.IpOptionsSupported;
+    Enable.V4Receive.TcpOptionsSupported = Checksum->V4Receive.TcpOptionsSupported;
+    Enable.V4Receive.TcpChecksum         = Checksum->V4Receive.TcpChecksum;
+    Enable.V4Receive.UdpChecksum         = Checksum->V4Receive.UdpChecksum;
+    Enable.V4Transmit.UdpChecksum        = Checksum->V4Transmit.UdpChecksum;
+
+    /* Send back the one task we use behind the header we queried with */
+    Task = (PNDIS_TASK_OFFLOAD)((PUCHAR)Buffer + sizeof(NDIS_TASK_OFFLOAD_HEADER));
+    Header->OffsetFirstTask = sizeof(NDIS_TASK_OFFLOAD_HEADER);
+    Task->Version = NDIS_TASK_OFFLOAD_VERSION;
+    Task->Size = sizeof(NDIS_TASK_OFFLOAD);
+    Task->Task = TcpIpChecksumNdisTask;
+    Task->OffsetNextTask = 0;
+    Task->TaskBufferLength = sizeof(Enable);
+    RtlCopyMemory(Task->TaskBuffer, &Enable, sizeof(Enable));
+
+    NdisStatus = NDISCall(Adapter,
+                          NdisRequestSetInformation,
+                          OID_TCP_TASK_OFFLOAD,
+                          Buffer,
+                          sizeof(NDIS_TASK_OFFLOAD_HEADER) +
+                          FIELD_OFFSET(NDIS_TASK_OFFLOAD, TaskBuffer) +
+                          sizeof(Enable));
+    if (NdisStatus != NDIS_STATUS_SUCCESS) {
+        TI_DbgPrint(MIN_TRACE, ("Could not enable checksum offload (0x%X).\n", NdisStatus));
+        return;
+    }
+
+    if (Enable.V4Transmit.UdpChecksum)
+        Interface->OffloadFlags |= IP_OFFLOAD_UDP_CHECKSUM;
+}
+
 BOOLEAN BindAdapter(
     PLAN_ADAPTER Adapter,
     PNDIS_STRING RegistryPath)
@@ -1410,6 +1518,8 @@ BOOLEAN BindAdapter(
     if (NdisStatus != NDIS_STATUS_SUCCESS)
         return FALSE;
 
+    EnableChecksumOffload(Adapter, IF);
+
     /* Register interface with IP layer */
     IPRegisterInterface(IF);
 
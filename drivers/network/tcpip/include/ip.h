@@ -91,6 +91,7 @@ typedef struct _IP_PACKET {
 } IP_PACKET, *PIP_PACKET;
 
 #define IP_PACKET_FLAG_RAW      0x01    /* Raw IP packet */
+#define IP_PACKET_FLAG_CHECKSUM_OK 0x02 /* Adapter verified the TCP/UDP checksum */
 
 
 /* Packet context */
@@ -168,8 +169,11 @@ typedef struct _IP_INTERFACE {
     LL_TRANSMIT_ROUTINE Transmit; /* Pointer to transmit function */
     PVOID TCPContext;             /* TCP Content for this interface */
     SEND_RECV_STATS Stats;        /* Send/Receive statistics */
+    ULONG OffloadFlags;           /* Work done by the adapter (see IP_OFFLOAD_xx below) */
 } IP_INTERFACE, *PIP_INTERFACE;
 
+#define IP_OFFLOAD_UDP_CHECKSUM 0x01  /* Adapter computes transmit UDP checksums */
+
 typedef struct _IP_SET_ADDRESS {
     ULONG NteIndex;
     IPv4_RAW_ADDRESS Address;
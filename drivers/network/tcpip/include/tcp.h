@@ -216,3 +216,9 @@ VOID CompleteBucket(PCONNECTION_ENDPOINT Connection, PTDI_BUCKET Bucket, const B
 
 void
 LibTCPDumpPcb(PVOID SocketContext);
+
+void
+LibTCPLockCore(void);
+
+void
+LibTCPUnlockCore(void);
@@ -596,12 +596,15 @@ NTSTATUS DispTdiListen(
        Irp,
        (PDRIVER_CANCEL)DispCancelListenRequest);
 
+  /* TCPSocket and TCPListen enter the lwIP core, which must be locked before us */
+  LibTCPLockCore();
   LockObject(Connection, &OldIrql);
 
   if (Connection->AddressFile == NULL)
   {
      TI_DbgPrint(MID_TRACE, ("No associated address file\n"));
      UnlockObject(Connection, OldIrql);
+     LibTCPUnlockCore();
      Status = STATUS_INVALID_PARAMETER;
      goto done;
   }
@@ -649,6 +652,7 @@ NTSTATUS DispTdiListen(
 
   UnlockObjectFromDpcLevel(Connection->AddressFile);
   UnlockObject(Connection, OldIrql);
+  LibTCPUnlockCore();
 
 done:
   if (Status != STATUS_PENDING) {
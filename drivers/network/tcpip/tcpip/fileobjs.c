@@ -564,6 +564,7 @@ NTSTATUS FileCloseAddress(
   PTDI_REQUEST Request)
 {
   PADDRESS_FILE AddrFile = Request->Handle.AddressHandle;
+  PCONNECTION_ENDPOINT Listener;
   KIRQL OldIrql;
 
   if (!Request->Handle.AddressHandle) return STATUS_INVALID_PARAMETER;
@@ -577,14 +578,22 @@ NTSTATUS FileCloseAddress(
       return STATUS_SUCCESS;
   }
 
-  /* We have to close this listener because we started it */
-  if( AddrFile->Listener )
+  /* We have to close this listener because we started it. Closing it unlinks
+   * it from the address file under our lock, so drop that first */
+  Listener = AddrFile->Listener;
+  if( Listener )
   {
-      TCPClose( AddrFile->Listener );
+      ReferenceObject(Listener);
   }
 
   UnlockObject(AddrFile, OldIrql);
 
+  if( Listener )
+  {
+      TCPClose( Listener );
+      DereferenceObject(Listener);
+  }
+
   DereferenceObject(AddrFile);
 
   TI_DbgPrint(MAX_TRACE, ("Leaving.\n"));
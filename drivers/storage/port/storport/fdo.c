@@ -24,8 +24,8 @@ PortFdoInterruptRoutine(
 {
     PFDO_DEVICE_EXTENSION DeviceExtension;
 
-    DPRINT1("PortFdoInterruptRoutine(%p %p)\n",
-            Interrupt, ServiceContext);
+    DPRINT("PortFdoInterruptRoutine(%p %p)\n",
+           Interrupt, ServiceContext);
 
     DeviceExtension = (PFDO_DEVICE_EXTENSION)ServiceContext;
 
@@ -33,6 +33,107 @@ PortFdoInterruptRoutine(
 }
 
 
+static
+BOOLEAN
+NTAPI
+PortFdoMessageInterruptRoutine(
+    _In_ PKINTERRUPT Interrupt,
+    _In_ PVOID ServiceContext)
+{
+    PMESSAGE_INTERRUPT MessageInterrupt;
+
+    MessageInterrupt = (PMESSAGE_INTERRUPT)ServiceContext;
+
+    return MiniportHwMessageInterrupt(&MessageInterrupt->DeviceExtension->Miniport,
+                                      MessageInterrupt->MessageId);
+}
+
+
+static
+NTSTATUS
+PortFdoConnectMessageInterrupts(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ ULONG MessageCount)
+{
+    PMESSAGE_INTERRUPT MessageInterrupts;
+    PKSPIN_LOCK SpinLock = NULL;
+    KIRQL SynchronizeIrql;
+    ULONG i;
+    NTSTATUS Status;
+
+    DPRINT1("PortFdoConnectMessageInterrupts(%p %lu)\n",
+            DeviceExtension, MessageCount);
+
+    MessageInterrupts = ExAllocatePoolWithTag(NonPagedPool,
+                                              MessageCount * sizeof(MESSAGE_INTERRUPT),
+                                              TAG_MESSAGE_DATA);
+    if (MessageInterrupts == NULL)
+        return STATUS_NO_MEMORY;
+
+    RtlZeroMemory(MessageInterrupts,
+                  MessageCount * sizeof(MESSAGE_INTERRUPT));
+
+    Status = GetResourceListMessageInterrupts(DeviceExtension,
+                                              MessageInterrupts,
+                                              MessageCount);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("GetResourceListMessageInterrupts() failed (Status 0x%08lx)\n", Status);
+        ExFreePoolWithTag(MessageInterrupts, TAG_MESSAGE_DATA);
+        return Status;
+    }
+
+    /*
+     * All messages are synchronized at the same IRQL, so that their locks can
+     * be held together. Unless the miniport synchronizes per message, they
+     * also share a single lock.
+     */
+    SynchronizeIrql = 0;
+    for (i = 0; i < MessageCount; i++)
+    {
+        if (MessageInterrupts[i].Irql > SynchronizeIrql)
+            SynchronizeIrql = MessageInterrupts[i].Irql;
+    }
+
+    if (DeviceExtension->Miniport.PortConfig.InterruptSynchronizationMode != InterruptSynchronizePerMessage)
+    {
+        KeInitializeSpinLock(&DeviceExtension->MessageLock);
+        SpinLock = &DeviceExtension->MessageLock;
+    }
+
+    for (i = 0; i < MessageCount; i++)
+    {
+        Status = IoConnectInterrupt(&MessageInterrupts[i].Interrupt,
+                                    PortFdoMessageInterruptRoutine,
+                                    &MessageInterrupts[i],
+                                    SpinLock,
+                                    MessageInterrupts[i].Vector,
+                                    MessageInterrupts[i].Irql,
+                                    SynchronizeIrql,
+                                    MessageInterrupts[i].InterruptMode,
+                                    FALSE,
+                                    MessageInterrupts[i].Affinity,
+                                    FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("IoConnectInterrupt() failed for message %lu (Status 0x%08lx)\n", i, Status);
+
+            while (i-- > 0)
+                IoDisconnectInterrupt(MessageInterrupts[i].Interrupt);
+
+            ExFreePoolWithTag(MessageInterrupts, TAG_MESSAGE_DATA);
+            return Status;
+        }
+    }
+
+    DeviceExtension->MessageInterrupts = MessageInterrupts;
+    DeviceExtension->MessageCount = MessageCount;
+    DeviceExtension->InterruptIrql = SynchronizeIrql;
+
+    return STATUS_SUCCESS;
+}
+
+
 static
 NTSTATUS
 PortFdoConnectInterrupt(
@@ -43,6 +144,7 @@ PortFdoConnectInterrupt(
     KINTERRUPT_MODE InterruptMode;
     BOOLEAN ShareVector;
     KAFFINITY Affinity;
+    ULONG MessageCount;
     NTSTATUS Status;
 
     DPRINT1("PortFdoConnectInterrupt(%p)\n",
@@ -56,6 +158,22 @@ PortFdoConnectInterrupt(
         return STATUS_SUCCESS;
     }
 
+    /* Prefer message signaled interrupts if the miniport can handle them */
+    if (DeviceExtension->Miniport.PortConfig.HwMSInterruptRoutine != NULL)
+    {
+        MessageCount = GetResourceListMessageCount(DeviceExtension);
+        DPRINT1("MessageCount: %lu\n", MessageCount);
+        if (MessageCount != 0)
+        {
+            Status = PortFdoConnectMessageInterrupts(DeviceExtension,
+                                                     MessageCount);
+            if (NT_SUCCESS(Status))
+                return Status;
+
+            DPRINT1("PortFdoConnectMessageInterrupts() failed (Status 0x%08lx)\n", Status);
+        }
+    }
+
     /* Get the interrupt data from the resource list */
     Status = GetResourceListInterrupt(DeviceExtension,
                                       &Vector,
@@ -99,6 +217,835 @@ PortFdoConnectInterrupt(
 }
 
 
+static
+NTSTATUS
+PortFdoGetDmaAdapter(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig;
+    PIO_SCSI_CAPABILITIES Capabilities;
+    DEVICE_DESCRIPTION DeviceDescription;
+    ULONG MaximumLength;
+
+    DPRINT1("PortFdoGetDmaAdapter(%p)\n", DeviceExtension);
+
+    PortConfig = &DeviceExtension->Miniport.PortConfig;
+
+    MaximumLength = PortConfig->MaximumTransferLength;
+    if (MaximumLength == (ULONG)-1)
+        MaximumLength = PORT_DEFAULT_MAXIMUM_TRANSFER;
+
+    /* Describe the addressing capabilities the miniport reported */
+    RtlZeroMemory(&DeviceDescription, sizeof(DEVICE_DESCRIPTION));
+    DeviceDescription.Version = DEVICE_DESCRIPTION_VERSION;
+    DeviceDescription.Master = PortConfig->Master;
+    DeviceDescription.ScatterGather = PortConfig->ScatterGather;
+    DeviceDescription.DemandMode = PortConfig->DemandMode;
+    DeviceDescription.Dma32BitAddresses = PortConfig->Dma32BitAddresses;
+    DeviceDescription.Dma64BitAddresses = (PortConfig->Dma64BitAddresses != 0);
+    DeviceDescription.BusNumber = PortConfig->SystemIoBusNumber;
+    DeviceDescription.DmaChannel = PortConfig->DmaChannel;
+    DeviceDescription.InterfaceType = PortConfig->AdapterInterfaceType;
+    DeviceDescription.DmaWidth = PortConfig->DmaWidth;
+    DeviceDescription.DmaSpeed = PortConfig->DmaSpeed;
+    DeviceDescription.MaximumLength = MaximumLength;
+    DeviceDescription.DmaPort = PortConfig->DmaPort;
+
+    DeviceExtension->DmaAdapter = IoGetDmaAdapter(DeviceExtension->PhysicalDevice,
+                                                  &DeviceDescription,
+                                                  &DeviceExtension->MapRegisterCount);
+    if (DeviceExtension->DmaAdapter == NULL)
+    {
+        DPRINT1("IoGetDmaAdapter() failed\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    DPRINT1("MapRegisterCount: %lu\n", DeviceExtension->MapRegisterCount);
+
+    /* Tell the class drivers how large a single request may be */
+    Capabilities = &DeviceExtension->PortCapabilities;
+    Capabilities->Length = sizeof(IO_SCSI_CAPABILITIES);
+    Capabilities->MaximumTransferLength = min(MaximumLength,
+                                              (DeviceExtension->MapRegisterCount - 1) << PAGE_SHIFT);
+    Capabilities->MaximumPhysicalPages = DeviceExtension->MapRegisterCount;
+    if (PortConfig->NumberOfPhysicalBreaks != 0 &&
+        PortConfig->NumberOfPhysicalBreaks != (ULONG)-1)
+    {
+        Capabilities->MaximumPhysicalPages = min(Capabilities->MaximumPhysicalPages,
+                                                 PortConfig->NumberOfPhysicalBreaks + 1);
+    }
+    Capabilities->SupportedAsynchronousEvents = 0;
+    Capabilities->AlignmentMask = PortConfig->AlignmentMask;
+    Capabilities->TaggedQueuing = PortConfig->TaggedQueuing;
+    Capabilities->AdapterScansDown = PortConfig->AdapterScansDown;
+    Capabilities->AdapterUsesPio = FALSE;
+
+    /* Every request carries the SRB extension of the miniport */
+    DeviceExtension->RequestSize = ALIGN_UP_BY(sizeof(PORT_REQUEST), MEMORY_ALLOCATION_ALIGNMENT) +
+                                   DeviceExtension->Miniport.InitData->SrbExtensionSize;
+    ExInitializeNPagedLookasideList(&DeviceExtension->RequestLookaside,
+                                    NULL,
+                                    NULL,
+                                    0,
+                                    DeviceExtension->RequestSize,
+                                    TAG_REQUEST,
+                                    0);
+
+    return STATUS_SUCCESS;
+}
+
+
+PPORT_REQUEST
+PortGetRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PIRP Irp;
+
+    Irp = (PIRP)Srb->OriginalRequest;
+    if (Irp == NULL)
+        return NULL;
+
+    return (PPORT_REQUEST)Irp->Tail.Overlay.DriverContext[0];
+}
+
+
+static
+NTSTATUS
+PortSrbStatusToNtStatus(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    switch (SRB_STATUS(Srb->SrbStatus))
+    {
+        case SRB_STATUS_SUCCESS:
+        case SRB_STATUS_DATA_OVERRUN:
+            return STATUS_SUCCESS;
+
+        case SRB_STATUS_BUSY:
+            return STATUS_DEVICE_BUSY;
+
+        case SRB_STATUS_NO_DEVICE:
+        case SRB_STATUS_NO_HBA:
+        case SRB_STATUS_SELECTION_TIMEOUT:
+            return STATUS_DEVICE_DOES_NOT_EXIST;
+
+        case SRB_STATUS_INVALID_REQUEST:
+        case SRB_STATUS_BAD_FUNCTION:
+        case SRB_STATUS_INVALID_PATH_ID:
+        case SRB_STATUS_INVALID_TARGET_ID:
+        case SRB_STATUS_INVALID_LUN:
+            return STATUS_INVALID_DEVICE_REQUEST;
+
+        case SRB_STATUS_TIMEOUT:
+        case SRB_STATUS_COMMAND_TIMEOUT:
+            return STATUS_IO_TIMEOUT;
+
+        default:
+            return STATUS_IO_DEVICE_ERROR;
+    }
+}
+
+
+/*
+ * Runs for every request the miniport completed with RequestComplete.
+ * The notification may arrive at DIRQL, so the IRP is completed here.
+ */
+static
+VOID
+NTAPI
+PortRequestCompletionDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PPORT_REQUEST Request = DeferredContext;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PSCSI_REQUEST_BLOCK Srb;
+    PIRP Irp;
+
+    DeviceExtension = Request->DeviceExtension;
+    Srb = Request->Srb;
+    Irp = Request->Irp;
+
+    if (Request->SgList != NULL)
+    {
+        DeviceExtension->DmaAdapter->DmaOperations->PutScatterGatherList(DeviceExtension->DmaAdapter,
+                                                                          Request->SgList,
+                                                                          Request->WriteToDevice);
+    }
+
+    if (Request->Mdl != NULL)
+        IoFreeMdl(Request->Mdl);
+
+    /* Give the caller its own buffer address back */
+    Srb->DataBuffer = Request->DataBuffer;
+    Srb->SrbExtension = NULL;
+
+    Irp->Tail.Overlay.DriverContext[0] = NULL;
+    Irp->IoStatus.Status = PortSrbStatusToNtStatus(Srb);
+    Irp->IoStatus.Information = NT_SUCCESS(Irp->IoStatus.Status) ? Srb->DataTransferLength : 0;
+
+    ExFreeToNPagedLookasideList(&DeviceExtension->RequestLookaside, Request);
+
+    IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+}
+
+
+static
+BOOLEAN
+NTAPI
+PortFdoSynchronizedStartIo(
+    _In_ PVOID SynchronizeContext)
+{
+    PPORT_REQUEST Request = SynchronizeContext;
+
+    return MiniportStartIo(&Request->DeviceExtension->Miniport, Request->Srb);
+}
+
+
+static
+VOID
+PortFdoStartIo(
+    _In_ PPORT_REQUEST Request)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = Request->DeviceExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    /* HwBuildIo runs without any lock held */
+    if (!MiniportBuildIo(&DeviceExtension->Miniport, Request->Srb))
+    {
+        /* The miniport set the SRB status already */
+        KeInsertQueueDpc(&Request->CompletionDpc, NULL, NULL);
+        return;
+    }
+
+    /* HwStartIo calls are serialized by the StartIo lock */
+    KeAcquireInStackQueuedSpinLock(&DeviceExtension->StartIoLock, &LockHandle);
+
+    /* Half duplex miniports also expect HwStartIo to exclude their interrupt */
+    if (DeviceExtension->Miniport.PortConfig.SynchronizationModel == StorSynchronizeHalfDuplex &&
+        DeviceExtension->Interrupt != NULL)
+    {
+        KeSynchronizeExecution(DeviceExtension->Interrupt,
+                               PortFdoSynchronizedStartIo,
+                               Request);
+    }
+    else
+    {
+        MiniportStartIo(&DeviceExtension->Miniport, Request->Srb);
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+}
+
+
+static
+VOID
+NTAPI
+PortFdoListControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp,
+    _In_ PSCATTER_GATHER_LIST ScatterGather,
+    _In_ PVOID Context)
+{
+    PPORT_REQUEST Request = Context;
+
+    Request->SgList = ScatterGather;
+    PortFdoStartIo(Request);
+}
+
+
+static
+BOOLEAN
+PortIsReadWriteRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    if (Srb->Function != SRB_FUNCTION_EXECUTE_SCSI)
+        return FALSE;
+
+    switch (Srb->Cdb[0])
+    {
+        case SCSIOP_READ6:
+        case SCSIOP_WRITE6:
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+        case SCSIOP_READ12:
+        case SCSIOP_WRITE12:
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+
+static
+NTSTATUS
+PortFdoStartRequest(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PPORT_REQUEST Request;
+    PMDL Mdl;
+    PUCHAR SystemAddress;
+    ULONG_PTR Offset;
+    UCHAR MapBuffers;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    Request = ExAllocateFromNPagedLookasideList(&DeviceExtension->RequestLookaside);
+    if (Request == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(Request, DeviceExtension->RequestSize);
+    KeInitializeDpc(&Request->CompletionDpc, PortRequestCompletionDpc, Request);
+    Request->DeviceExtension = DeviceExtension;
+    Request->Irp = Irp;
+    Request->Srb = Srb;
+    Request->DataBuffer = Srb->DataBuffer;
+    Request->WriteToDevice = ((Srb->SrbFlags & SRB_FLAGS_DATA_OUT) != 0);
+
+    if (DeviceExtension->Miniport.InitData->SrbExtensionSize != 0)
+        Srb->SrbExtension = (PUCHAR)Request + ALIGN_UP_BY(sizeof(PORT_REQUEST), MEMORY_ALLOCATION_ALIGNMENT);
+
+    /* The miniport finds the request through the IRP */
+    Srb->OriginalRequest = Irp;
+    Irp->Tail.Overlay.DriverContext[0] = Request;
+
+    Srb->SrbStatus = SRB_STATUS_PENDING;
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+
+    IoMarkIrpPending(Irp);
+
+    if (Srb->DataBuffer == NULL || Srb->DataTransferLength == 0)
+    {
+        KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+        PortFdoStartIo(Request);
+        KeLowerIrql(OldIrql);
+        return STATUS_PENDING;
+    }
+
+    /* Requests built inside the kernel may come without an MDL */
+    Mdl = Irp->MdlAddress;
+    if (Mdl == NULL)
+    {
+        Mdl = IoAllocateMdl(Srb->DataBuffer, Srb->DataTransferLength, FALSE, FALSE, NULL);
+        if (Mdl == NULL)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failed;
+        }
+
+        MmBuildMdlForNonPagedPool(Mdl);
+        Request->Mdl = Mdl;
+    }
+
+    Offset = (PUCHAR)Srb->DataBuffer - (PUCHAR)MmGetMdlVirtualAddress(Mdl);
+
+    /* Give the miniport a system address for the buffers it touches itself */
+    MapBuffers = DeviceExtension->Miniport.InitData->MapBuffers;
+    if (MapBuffers == STOR_MAP_ALL_BUFFERS ||
+        (MapBuffers == STOR_MAP_NON_READ_WRITE_BUFFERS && !PortIsReadWriteRequest(Srb)))
+    {
+        SystemAddress = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        if (SystemAddress == NULL)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failed;
+        }
+
+        Srb->DataBuffer = SystemAddress + Offset;
+    }
+
+    /* The adapter maps the buffer within the addressing limits of the device */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Status = DeviceExtension->DmaAdapter->DmaOperations->GetScatterGatherList(DeviceExtension->DmaAdapter,
+                                                                               DeviceExtension->Device,
+                                                                               Mdl,
+                                                                               (PUCHAR)MmGetMdlVirtualAddress(Mdl) + Offset,
+                                                                               Srb->DataTransferLength,
+                                                                               PortFdoListControl,
+                                                                               Request,
+                                                                               Request->WriteToDevice);
+    KeLowerIrql(OldIrql);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("GetScatterGatherList() failed (Status 0x%08lx)\n", Status);
+        goto Failed;
+    }
+
+    return STATUS_PENDING;
+
+Failed:
+    if (Request->Mdl != NULL)
+        IoFreeMdl(Request->Mdl);
+
+    Srb->DataBuffer = Request->DataBuffer;
+    Srb->SrbExtension = NULL;
+    Srb->SrbStatus = SRB_STATUS_ERROR;
+    Irp->Tail.Overlay.DriverContext[0] = NULL;
+    ExFreeToNPagedLookasideList(&DeviceExtension->RequestLookaside, Request);
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return STATUS_PENDING;
+}
+
+
+static
+PPORT_UNIT
+PortFdoFindUnit(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun)
+{
+    PLIST_ENTRY ListEntry;
+    PPORT_UNIT Unit;
+
+    for (ListEntry = DeviceExtension->UnitListHead.Flink;
+         ListEntry != &DeviceExtension->UnitListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Unit = CONTAINING_RECORD(ListEntry, PORT_UNIT, ListEntry);
+        if (Unit->PathId == PathId &&
+            Unit->TargetId == TargetId &&
+            Unit->Lun == Lun)
+            return Unit;
+    }
+
+    return NULL;
+}
+
+
+NTSTATUS
+NTAPI
+PortFdoScsi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSCSI_REQUEST_BLOCK Srb;
+    PPORT_UNIT Unit;
+    NTSTATUS Status;
+
+    DPRINT("PortFdoScsi(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension->ExtensionType == FdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    Srb = Stack->Parameters.Scsi.Srb;
+
+    if (DeviceExtension->PnpState != dsStarted)
+    {
+        Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+        Status = STATUS_DEVICE_DOES_NOT_EXIST;
+        goto Done;
+    }
+
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_EXECUTE_SCSI:
+        case SRB_FUNCTION_IO_CONTROL:
+        case SRB_FUNCTION_SHUTDOWN:
+        case SRB_FUNCTION_FLUSH:
+        case SRB_FUNCTION_ABORT_COMMAND:
+        case SRB_FUNCTION_RESET_BUS:
+        case SRB_FUNCTION_RESET_DEVICE:
+        case SRB_FUNCTION_RESET_LOGICAL_UNIT:
+            return PortFdoStartRequest(DeviceExtension, Irp, Srb);
+
+        case SRB_FUNCTION_CLAIM_DEVICE:
+            Unit = PortFdoFindUnit(DeviceExtension, Srb->PathId, Srb->TargetId, Srb->Lun);
+            if (Unit == NULL)
+            {
+                Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+                Status = STATUS_DEVICE_DOES_NOT_EXIST;
+            }
+            else if (InterlockedCompareExchange(&Unit->Claimed, TRUE, FALSE) != FALSE)
+            {
+                Srb->SrbStatus = SRB_STATUS_BUSY;
+                Status = STATUS_DEVICE_BUSY;
+            }
+            else
+            {
+                /* The class driver sends its requests to this device */
+                Srb->DataBuffer = DeviceObject;
+                Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                Status = STATUS_SUCCESS;
+            }
+            break;
+
+        case SRB_FUNCTION_RELEASE_DEVICE:
+            Unit = PortFdoFindUnit(DeviceExtension, Srb->PathId, Srb->TargetId, Srb->Lun);
+            if (Unit != NULL)
+                InterlockedExchange(&Unit->Claimed, FALSE);
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_RELEASE_QUEUE:
+        case SRB_FUNCTION_FLUSH_QUEUE:
+        case SRB_FUNCTION_LOCK_QUEUE:
+        case SRB_FUNCTION_UNLOCK_QUEUE:
+            /* Requests go straight to the miniport, there is no queue to freeze */
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            DPRINT1("Unsupported SRB function 0x%x\n", Srb->Function);
+            Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+    }
+
+Done:
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+static
+NTSTATUS
+PortFdoGetInquiryData(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp)
+{
+    PSCSI_ADAPTER_BUS_INFO AdapterBusInfo;
+    PSCSI_INQUIRY_DATA InquiryData, LastInquiryData;
+    PSCSI_BUS_DATA BusData;
+    PIO_STACK_LOCATION Stack;
+    PLIST_ENTRY ListEntry;
+    PPORT_UNIT Unit;
+    ULONG BusCount, Bus, InquiryDataSize, Length;
+    PUCHAR Buffer;
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    Buffer = Irp->AssociatedIrp.SystemBuffer;
+
+    BusCount = max(DeviceExtension->Miniport.PortConfig.NumberOfBuses, 1);
+
+    InquiryDataSize = ALIGN_UP_BY(FIELD_OFFSET(SCSI_INQUIRY_DATA, InquiryData) + INQUIRYDATABUFFERSIZE,
+                                  sizeof(ULONG));
+    Length = FIELD_OFFSET(SCSI_ADAPTER_BUS_INFO, BusData) +
+             BusCount * sizeof(SCSI_BUS_DATA) +
+             DeviceExtension->UnitCount * InquiryDataSize;
+
+    if (Stack->Parameters.DeviceIoControl.OutputBufferLength < Length)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlZeroMemory(Buffer, Length);
+
+    AdapterBusInfo = (PSCSI_ADAPTER_BUS_INFO)Buffer;
+    AdapterBusInfo->NumberOfBuses = (UCHAR)BusCount;
+
+    InquiryData = (PSCSI_INQUIRY_DATA)&AdapterBusInfo->BusData[BusCount];
+
+    /* The unit list is sorted by path id */
+    ListEntry = DeviceExtension->UnitListHead.Flink;
+    for (Bus = 0; Bus < BusCount; Bus++)
+    {
+        BusData = &AdapterBusInfo->BusData[Bus];
+        BusData->InitiatorBusId = DeviceExtension->Miniport.PortConfig.InitiatorBusId[min(Bus, 7)];
+        LastInquiryData = NULL;
+
+        while (ListEntry != &DeviceExtension->UnitListHead)
+        {
+            Unit = CONTAINING_RECORD(ListEntry, PORT_UNIT, ListEntry);
+            if (Unit->PathId != Bus)
+                break;
+
+            if (LastInquiryData == NULL)
+                BusData->InquiryDataOffset = (ULONG)((PUCHAR)InquiryData - Buffer);
+            else
+                LastInquiryData->NextInquiryDataOffset = (ULONG)((PUCHAR)InquiryData - Buffer);
+
+            InquiryData->PathId = Unit->PathId;
+            InquiryData->TargetId = Unit->TargetId;
+            InquiryData->Lun = Unit->Lun;
+            InquiryData->DeviceClaimed = (BOOLEAN)Unit->Claimed;
+            InquiryData->InquiryDataLength = INQUIRYDATABUFFERSIZE;
+            RtlCopyMemory(InquiryData->InquiryData,
+                          &Unit->InquiryData,
+                          INQUIRYDATABUFFERSIZE);
+
+            BusData->NumberOfLogicalUnits++;
+            LastInquiryData = InquiryData;
+            InquiryData = (PSCSI_INQUIRY_DATA)((PUCHAR)InquiryData + InquiryDataSize);
+            ListEntry = ListEntry->Flink;
+        }
+    }
+
+    Irp->IoStatus.Information = Length;
+    return STATUS_SUCCESS;
+}
+
+
+NTSTATUS
+NTAPI
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSCSI_ADDRESS Address;
+    ULONG OutputLength;
+    NTSTATUS Status;
+
+    DPRINT1("PortFdoDeviceControl(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension->ExtensionType == FdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    OutputLength = Stack->Parameters.DeviceIoControl.OutputBufferLength;
+
+    Irp->IoStatus.Information = 0;
+
+    switch (Stack->Parameters.DeviceIoControl.IoControlCode)
+    {
+        case IOCTL_SCSI_GET_CAPABILITIES:
+            DPRINT1("IOCTL_SCSI_GET_CAPABILITIES\n");
+            /* Old class drivers ask for a pointer to the capabilities */
+            if (OutputLength == sizeof(PVOID))
+            {
+                *((PVOID *)Irp->AssociatedIrp.SystemBuffer) = &DeviceExtension->PortCapabilities;
+                Irp->IoStatus.Information = sizeof(PVOID);
+                Status = STATUS_SUCCESS;
+                break;
+            }
+
+            if (OutputLength < sizeof(IO_SCSI_CAPABILITIES))
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            RtlCopyMemory(Irp->AssociatedIrp.SystemBuffer,
+                          &DeviceExtension->PortCapabilities,
+                          sizeof(IO_SCSI_CAPABILITIES));
+            Irp->IoStatus.Information = sizeof(IO_SCSI_CAPABILITIES);
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IOCTL_SCSI_GET_INQUIRY_DATA:
+            DPRINT1("IOCTL_SCSI_GET_INQUIRY_DATA\n");
+            Status = PortFdoGetInquiryData(DeviceExtension, Irp);
+            break;
+
+        case IOCTL_SCSI_GET_ADDRESS:
+            DPRINT1("IOCTL_SCSI_GET_ADDRESS\n");
+            if (OutputLength < sizeof(SCSI_ADDRESS))
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            Address = Irp->AssociatedIrp.SystemBuffer;
+            RtlZeroMemory(Address, sizeof(SCSI_ADDRESS));
+            Address->Length = sizeof(SCSI_ADDRESS);
+            Address->PortNumber = (UCHAR)DeviceExtension->ScsiPortNumber;
+            Irp->IoStatus.Information = sizeof(SCSI_ADDRESS);
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            DPRINT1("Unsupported IOCTL 0x%lx\n", Stack->Parameters.DeviceIoControl.IoControlCode);
+            Status = STATUS_NOT_SUPPORTED;
+            break;
+    }
+
+    Irp->IoStatus.Status = Status;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    return Status;
+}
+
+
+static
+NTSTATUS
+PortFdoSendInquiry(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ UCHAR PathId,
+    _In_ UCHAR TargetId,
+    _In_ UCHAR Lun,
+    _Out_ PINQUIRYDATA InquiryData)
+{
+    SCSI_REQUEST_BLOCK Srb;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PIO_STACK_LOCATION Stack;
+    KEVENT Event;
+    PCDB Cdb;
+    PIRP Irp;
+    NTSTATUS Status;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    /* The data buffer is non-paged pool, the request path maps it itself */
+    Irp = IoBuildDeviceIoControlRequest(IOCTL_SCSI_EXECUTE_IN,
+                                        DeviceExtension->Device,
+                                        NULL,
+                                        0,
+                                        NULL,
+                                        0,
+                                        TRUE,
+                                        &Event,
+                                        &IoStatusBlock);
+    if (Irp == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(&Srb, sizeof(SCSI_REQUEST_BLOCK));
+    Srb.Length = sizeof(SCSI_REQUEST_BLOCK);
+    Srb.Function = SRB_FUNCTION_EXECUTE_SCSI;
+    Srb.PathId = PathId;
+    Srb.TargetId = TargetId;
+    Srb.Lun = Lun;
+    Srb.CdbLength = 6;
+    Srb.SrbFlags = SRB_FLAGS_DATA_IN | SRB_FLAGS_DISABLE_SYNCH_TRANSFER;
+    Srb.DataBuffer = InquiryData;
+    Srb.DataTransferLength = INQUIRYDATABUFFERSIZE;
+    Srb.TimeOutValue = 4;
+    Srb.OriginalRequest = Irp;
+
+    Cdb = (PCDB)Srb.Cdb;
+    Cdb->CDB6INQUIRY.OperationCode = SCSIOP_INQUIRY;
+    Cdb->CDB6INQUIRY.AllocationLength = INQUIRYDATABUFFERSIZE;
+
+    Stack = IoGetNextIrpStackLocation(Irp);
+    Stack->Parameters.Scsi.Srb = &Srb;
+
+    Status = IoCallDriver(DeviceExtension->Device, Irp);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = IoStatusBlock.Status;
+    }
+
+    return Status;
+}
+
+
+static
+VOID
+PortFdoScanBus(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig;
+    PINQUIRYDATA InquiryData;
+    PPORT_UNIT Unit;
+    ULONG BusCount, TargetCount, LunCount;
+    ULONG Bus, Target, Lun;
+    NTSTATUS Status;
+
+    DPRINT1("PortFdoScanBus(%p)\n", DeviceExtension);
+
+    PortConfig = &DeviceExtension->Miniport.PortConfig;
+    BusCount = min(max(PortConfig->NumberOfBuses, 1), PORT_MAXIMUM_BUSES);
+    TargetCount = min(max(PortConfig->MaximumNumberOfTargets, 1), PORT_MAXIMUM_TARGETS);
+    LunCount = min(max(PortConfig->MaximumNumberOfLogicalUnits, 1), PORT_MAXIMUM_LUNS);
+
+    InquiryData = ExAllocatePoolWithTag(NonPagedPool, INQUIRYDATABUFFERSIZE, TAG_UNIT_DATA);
+    if (InquiryData == NULL)
+        return;
+
+    for (Bus = 0; Bus < BusCount; Bus++)
+    {
+        for (Target = 0; Target < TargetCount; Target++)
+        {
+            for (Lun = 0; Lun < LunCount; Lun++)
+            {
+                RtlZeroMemory(InquiryData, INQUIRYDATABUFFERSIZE);
+
+                Status = PortFdoSendInquiry(DeviceExtension,
+                                            (UCHAR)Bus,
+                                            (UCHAR)Target,
+                                            (UCHAR)Lun,
+                                            InquiryData);
+                if (!NT_SUCCESS(Status))
+                {
+                    /* No logical unit behind this one, if not even LUN 0 answered */
+                    break;
+                }
+
+                if (InquiryData->DeviceTypeQualifier == DEVICE_QUALIFIER_NOT_SUPPORTED)
+                    continue;
+
+                Unit = ExAllocatePoolWithTag(NonPagedPool, sizeof(PORT_UNIT), TAG_UNIT_DATA);
+                if (Unit == NULL)
+                    break;
+
+                RtlZeroMemory(Unit, sizeof(PORT_UNIT));
+                Unit->PathId = (UCHAR)Bus;
+                Unit->TargetId = (UCHAR)Target;
+                Unit->Lun = (UCHAR)Lun;
+                RtlCopyMemory(&Unit->InquiryData, InquiryData, INQUIRYDATABUFFERSIZE);
+
+                DPRINT1("Found device type 0x%x at %lu:%lu:%lu\n",
+                        InquiryData->DeviceType, Bus, Target, Lun);
+
+                InsertTailList(&DeviceExtension->UnitListHead, &Unit->ListEntry);
+                DeviceExtension->UnitCount++;
+            }
+        }
+    }
+
+    ExFreePoolWithTag(InquiryData, TAG_UNIT_DATA);
+}
+
+
+static
+VOID
+PortFdoCreateScsiPortLinks(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PCONFIGURATION_INFORMATION ConfigInfo;
+    WCHAR DeviceNameBuffer[80];
+    WCHAR LinkNameBuffer[80];
+    UNICODE_STRING DeviceName;
+    UNICODE_STRING LinkName;
+    NTSTATUS Status;
+
+    if (DeviceExtension->ScsiPortLinked)
+        return;
+
+    /* The class drivers open the adapters by their SCSI port name */
+    ConfigInfo = IoGetConfigurationInformation();
+
+    swprintf(DeviceNameBuffer, L"\\Device\\RaidPort%lu", DeviceExtension->PortNumber);
+    RtlInitUnicodeString(&DeviceName, DeviceNameBuffer);
+
+    swprintf(LinkNameBuffer, L"\\Device\\ScsiPort%lu", ConfigInfo->ScsiPortCount);
+    RtlInitUnicodeString(&LinkName, LinkNameBuffer);
+
+    Status = IoCreateSymbolicLink(&LinkName, &DeviceName);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("IoCreateSymbolicLink(%wZ) failed (Status 0x%08lx)\n", &LinkName, Status);
+        return;
+    }
+
+    swprintf(LinkNameBuffer, L"\\??\\Scsi%lu:", ConfigInfo->ScsiPortCount);
+    RtlInitUnicodeString(&LinkName, LinkNameBuffer);
+    IoCreateSymbolicLink(&LinkName, &DeviceName);
+
+    DeviceExtension->ScsiPortNumber = ConfigInfo->ScsiPortCount;
+    DeviceExtension->ScsiPortLinked = TRUE;
+    ConfigInfo->ScsiPortCount++;
+}
+
+
 static
 NTSTATUS
 PortFdoStartMiniport(
@@ -139,6 +1086,14 @@ PortFdoStartMiniport(
         return Status;
     }
 
+    /* Get the DMA adapter that builds the scatter/gather lists */
+    Status = PortFdoGetDmaAdapter(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("PortFdoGetDmaAdapter() failed (Status 0x%08lx)\n", Status);
+        return Status;
+    }
+
     /* Connect the configured interrupt */
     Status = PortFdoConnectInterrupt(DeviceExtension);
     if (!NT_SUCCESS(Status))
@@ -166,6 +1121,10 @@ PortFdoStartMiniport(
         }
     }
 
+    /* Find the logical units and make them visible to the class drivers */
+    PortFdoScanBus(DeviceExtension);
+    PortFdoCreateScsiPortLinks(DeviceExtension);
+
     return STATUS_SUCCESS;
 }
 
@@ -315,6 +1274,9 @@ PortFdoPnp(
 
         case IRP_MN_REMOVE_DEVICE: /* 0x02 */
             DPRINT1("IRP_MJ_PNP / IRP_MN_REMOVE_DEVICE\n");
+            if (DeviceExtension->PnpState == dsStarted)
+                MiniportAdapterControl(&DeviceExtension->Miniport, ScsiStopAdapter);
+            DeviceExtension->PnpState = dsRemoved;
             break;
 
         case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
@@ -323,6 +1285,9 @@ PortFdoPnp(
 
         case IRP_MN_STOP_DEVICE: /* 0x04 */
             DPRINT1("IRP_MJ_PNP / IRP_MN_STOP_DEVICE\n");
+            if (DeviceExtension->PnpState == dsStarted)
+                MiniportAdapterControl(&DeviceExtension->Miniport, ScsiStopAdapter);
+            DeviceExtension->PnpState = dsStopped;
             break;
 
         case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
@@ -368,6 +1333,10 @@ PortFdoPnp(
 
         case IRP_MN_SURPRISE_REMOVAL: /* 0x17 */
             DPRINT1("IRP_MJ_PNP / IRP_MN_SURPRISE_REMOVAL\n");
+            /* Reject new requests, the miniport fails the outstanding ones */
+            DeviceExtension->PnpState = dsSurpriseRemoved;
+            MiniportAdapterControl(&DeviceExtension->Miniport, ScsiStopAdapter);
+            Status = STATUS_SUCCESS;
             break;
 
         default:
@@ -382,4 +1351,39 @@ PortFdoPnp(
     return Status;
 }
 
+
+NTSTATUS
+NTAPI
+PortFdoPower(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+
+    DPRINT1("PortFdoPower(%p %p)\n",
+            DeviceObject, Irp);
+
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension->ExtensionType == FdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* Let the miniport shut the adapter down before it loses power */
+    if (Stack->MinorFunction == IRP_MN_SET_POWER &&
+        DeviceExtension->PnpState == dsStarted &&
+        ((Stack->Parameters.Power.Type == SystemPowerState &&
+          Stack->Parameters.Power.State.SystemState > PowerSystemWorking) ||
+         (Stack->Parameters.Power.Type == DevicePowerState &&
+          Stack->Parameters.Power.State.DeviceState > PowerDeviceD0)))
+    {
+        DPRINT1("IRP_MJ_POWER / IRP_MN_SET_POWER: stopping the adapter\n");
+        MiniportAdapterControl(&DeviceExtension->Miniport, ScsiStopAdapter);
+    }
+
+    PoStartNextPowerIrp(Irp);
+    IoSkipCurrentIrpStackLocation(Irp);
+    return PoCallDriver(DeviceExtension->LowerDevice, Irp);
+}
+
 /* EOF */
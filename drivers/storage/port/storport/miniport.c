@@ -353,13 +353,83 @@ MiniportHwInterrupt(
 {
     BOOLEAN Result;
 
-    DPRINT1("MiniportHwInterrupt(%p)\n",
-            Miniport);
+    DPRINT("MiniportHwInterrupt(%p)\n",
+           Miniport);
 
     Result = Miniport->InitData->HwInterrupt(&Miniport->MiniportExtension->HwDeviceExtension);
-    DPRINT1("HwInterrupt() returned %u\n", Result);
+    DPRINT("HwInterrupt() returned %u\n", Result);
 
     return Result;
 }
 
+
+BOOLEAN
+MiniportHwMessageInterrupt(
+    _In_ PMINIPORT Miniport,
+    _In_ ULONG MessageId)
+{
+    /* Called for every message, so don't trace here */
+    return Miniport->PortConfig.HwMSInterruptRoutine(&Miniport->MiniportExtension->HwDeviceExtension,
+                                                     MessageId);
+}
+
+
+BOOLEAN
+MiniportBuildIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    /* HwBuildIo is optional */
+    if (Miniport->InitData->HwBuildIo == NULL)
+        return TRUE;
+
+    return Miniport->InitData->HwBuildIo(&Miniport->MiniportExtension->HwDeviceExtension,
+                                         Srb);
+}
+
+
+BOOLEAN
+MiniportStartIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    return Miniport->InitData->HwStartIo(&Miniport->MiniportExtension->HwDeviceExtension,
+                                         Srb);
+}
+
+
+BOOLEAN
+MiniportAdapterControl(
+    _In_ PMINIPORT Miniport,
+    _In_ SCSI_ADAPTER_CONTROL_TYPE ControlType)
+{
+    ULONG Buffer[(sizeof(SCSI_SUPPORTED_CONTROL_TYPE_LIST) + ScsiAdapterControlMax + sizeof(ULONG) - 1) / sizeof(ULONG)];
+    PSCSI_SUPPORTED_CONTROL_TYPE_LIST SupportedTypes;
+    SCSI_ADAPTER_CONTROL_STATUS Status;
+
+    DPRINT1("MiniportAdapterControl(%p %lu)\n",
+            Miniport, ControlType);
+
+    if (Miniport->InitData->HwAdapterControl == NULL)
+        return FALSE;
+
+    /* Ask the miniport whether it handles this control type at all */
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    SupportedTypes = (PSCSI_SUPPORTED_CONTROL_TYPE_LIST)Buffer;
+    SupportedTypes->MaxControlType = ScsiAdapterControlMax;
+
+    Miniport->InitData->HwAdapterControl(&Miniport->MiniportExtension->HwDeviceExtension,
+                                         ScsiQuerySupportedControlTypes,
+                                         SupportedTypes);
+    if (!SupportedTypes->SupportedTypeList[ControlType])
+        return FALSE;
+
+    Status = Miniport->InitData->HwAdapterControl(&Miniport->MiniportExtension->HwDeviceExtension,
+                                                  ControlType,
+                                                  NULL);
+    DPRINT1("HwAdapterControl() returned %lu\n", Status);
+
+    return (Status == ScsiAdapterControlSuccess);
+}
+
 /* EOF */
@@ -317,6 +317,10 @@ GetResourceListInterrupt(
                             PartialDescriptor->u.Interrupt.Level,
                             PartialDescriptor->u.Interrupt.Vector);
 
+                    /* Message signaled interrupts are connected separately */
+                    if (PartialDescriptor->Flags & CM_RESOURCE_INTERRUPT_MESSAGE)
+                        break;
+
                     *Vector = PartialDescriptor->u.Interrupt.Vector;
                     *Irql = (KIRQL)PartialDescriptor->u.Interrupt.Level;
                     *InterruptMode = (PartialDescriptor->Flags & CM_RESOURCE_INTERRUPT_LATCHED) ? Latched : LevelSensitive;
@@ -336,6 +340,96 @@ GetResourceListInterrupt(
 }
 
 
+ULONG
+GetResourceListMessageCount(
+    PFDO_DEVICE_EXTENSION DeviceExtension)
+{
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR PartialDescriptor;
+    ULONG MessageCount = 0;
+    INT i, j;
+
+    DPRINT1("GetResourceListMessageCount(%p)\n",
+            DeviceExtension);
+
+    FullDescriptor = DeviceExtension->TranslatedResources->List;
+    for (i = 0; i < DeviceExtension->TranslatedResources->Count; i++)
+    {
+        for (j = 0; j < FullDescriptor->PartialResourceList.Count; j++)
+        {
+            PartialDescriptor = FullDescriptor->PartialResourceList.PartialDescriptors + j;
+
+            if (PartialDescriptor->Type == CmResourceTypeInterrupt &&
+                (PartialDescriptor->Flags & CM_RESOURCE_INTERRUPT_MESSAGE))
+            {
+                MessageCount++;
+            }
+        }
+
+        /* Advance to next CM_FULL_RESOURCE_DESCRIPTOR block in memory. */
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)(FullDescriptor->PartialResourceList.PartialDescriptors +
+                                                        FullDescriptor->PartialResourceList.Count);
+    }
+
+    return MessageCount;
+}
+
+
+NTSTATUS
+GetResourceListMessageInterrupts(
+    PFDO_DEVICE_EXTENSION DeviceExtension,
+    PMESSAGE_INTERRUPT MessageInterrupts,
+    ULONG MessageCount)
+{
+    PCM_FULL_RESOURCE_DESCRIPTOR FullDescriptor;
+    PCM_PARTIAL_RESOURCE_DESCRIPTOR PartialDescriptor;
+    ULONG MessageId = 0;
+    INT i, j;
+
+    DPRINT1("GetResourceListMessageInterrupts(%p %p %lu)\n",
+            DeviceExtension, MessageInterrupts, MessageCount);
+
+    /* Every message is reported in a translated descriptor of its own */
+    FullDescriptor = DeviceExtension->TranslatedResources->List;
+    for (i = 0; i < DeviceExtension->TranslatedResources->Count; i++)
+    {
+        for (j = 0; j < FullDescriptor->PartialResourceList.Count; j++)
+        {
+            PartialDescriptor = FullDescriptor->PartialResourceList.PartialDescriptors + j;
+
+            if (PartialDescriptor->Type != CmResourceTypeInterrupt ||
+                !(PartialDescriptor->Flags & CM_RESOURCE_INTERRUPT_MESSAGE))
+            {
+                continue;
+            }
+
+            if (MessageId >= MessageCount)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            DPRINT1("Message %lu: Level %lu  Vector %lu  Affinity 0x%Ix\n",
+                    MessageId,
+                    PartialDescriptor->u.Interrupt.Level,
+                    PartialDescriptor->u.Interrupt.Vector,
+                    PartialDescriptor->u.Interrupt.Affinity);
+
+            MessageInterrupts[MessageId].DeviceExtension = DeviceExtension;
+            MessageInterrupts[MessageId].MessageId = MessageId;
+            MessageInterrupts[MessageId].Vector = PartialDescriptor->u.Interrupt.Vector;
+            MessageInterrupts[MessageId].Irql = (KIRQL)PartialDescriptor->u.Interrupt.Level;
+            MessageInterrupts[MessageId].InterruptMode = Latched;
+            MessageInterrupts[MessageId].Affinity = PartialDescriptor->u.Interrupt.Affinity;
+            MessageId++;
+        }
+
+        /* Advance to next CM_FULL_RESOURCE_DESCRIPTOR block in memory. */
+        FullDescriptor = (PCM_FULL_RESOURCE_DESCRIPTOR)(FullDescriptor->PartialResourceList.PartialDescriptors +
+                                                        FullDescriptor->PartialResourceList.Count);
+    }
+
+    return (MessageId == MessageCount) ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+
 NTSTATUS
 AllocateAddressMapping(
     PMAPPED_ADDRESS *MappedAddressList,
@@ -29,6 +29,25 @@
 #define TAG_ACCRESS_RANGE   'RAtS'
 #define TAG_RESOURCE_LIST   'LRtS'
 #define TAG_ADDRESS_MAPPING 'MAtS'
+#define TAG_MESSAGE_DATA    'MMtS'
+#define TAG_REQUEST         'QRtS'
+#define TAG_UNIT_DATA       'DUtS'
+
+/* Transfer limit used when the miniport does not report one */
+#define PORT_DEFAULT_MAXIMUM_TRANSFER   0x10000
+
+/* Limits of the bus scan, see srb.h */
+#define PORT_MAXIMUM_BUSES              8
+#define PORT_MAXIMUM_TARGETS            128
+#define PORT_MAXIMUM_LUNS               8
+
+#ifndef IOCTL_SCSI_EXECUTE_IN
+#define IOCTL_SCSI_EXECUTE_IN   ((FILE_DEVICE_SCSI << 16) + 0x0011)
+#endif
+
+#ifndef DEVICE_QUALIFIER_NOT_SUPPORTED
+#define DEVICE_QUALIFIER_NOT_SUPPORTED  0x03
+#endif
 
 typedef enum
 {
@@ -79,6 +98,43 @@ typedef struct _MINIPORT
     PMINIPORT_DEVICE_EXTENSION MiniportExtension;
 } MINIPORT, *PMINIPORT;
 
+/* Logical unit found by the bus scan */
+typedef struct _PORT_UNIT
+{
+    LIST_ENTRY ListEntry;
+    UCHAR PathId;
+    UCHAR TargetId;
+    UCHAR Lun;
+    LONG Claimed;
+    INQUIRYDATA InquiryData;
+} PORT_UNIT, *PPORT_UNIT;
+
+/* Port side state of a request handed to the miniport */
+typedef struct _PORT_REQUEST
+{
+    KDPC CompletionDpc;
+    struct _FDO_DEVICE_EXTENSION *DeviceExtension;
+    PIRP Irp;
+    PSCSI_REQUEST_BLOCK Srb;
+    PVOID DataBuffer;
+    PMDL Mdl;
+    PSCATTER_GATHER_LIST SgList;
+    BOOLEAN WriteToDevice;
+    /* The SRB extension of the miniport follows */
+} PORT_REQUEST, *PPORT_REQUEST;
+
+typedef struct _MESSAGE_INTERRUPT
+{
+    struct _FDO_DEVICE_EXTENSION *DeviceExtension;
+    ULONG MessageId;
+    PKINTERRUPT Interrupt;
+    ULONG Vector;
+    KIRQL Irql;
+    KIRQL LockIrql;
+    KINTERRUPT_MODE InterruptMode;
+    KAFFINITY Affinity;
+} MESSAGE_INTERRUPT, *PMESSAGE_INTERRUPT;
+
 typedef struct _FDO_DEVICE_EXTENSION
 {
     EXTENSION_TYPE ExtensionType;
@@ -103,6 +159,21 @@ typedef struct _FDO_DEVICE_EXTENSION
     PHW_PASSIVE_INITIALIZE_ROUTINE HwPassiveInitRoutine;
     PKINTERRUPT Interrupt;
     ULONG InterruptIrql;
+    ULONG MessageCount;
+    PMESSAGE_INTERRUPT MessageInterrupts;
+    KSPIN_LOCK MessageLock;
+    KSPIN_LOCK StartIoLock;
+    ULONG DeviceQueueDepth;
+    PDMA_ADAPTER DmaAdapter;
+    ULONG MapRegisterCount;
+    NPAGED_LOOKASIDE_LIST RequestLookaside;
+    ULONG RequestSize;
+    LIST_ENTRY UnitListHead;
+    ULONG UnitCount;
+    IO_SCSI_CAPABILITIES PortCapabilities;
+    ULONG PortNumber;
+    ULONG ScsiPortNumber;
+    BOOLEAN ScsiPortLinked;
 } FDO_DEVICE_EXTENSION, *PFDO_DEVICE_EXTENSION;
 
 
@@ -125,6 +196,28 @@ PortFdoPnp(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp);
 
+NTSTATUS
+NTAPI
+PortFdoScsi(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+NTAPI
+PortFdoDeviceControl(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+NTSTATUS
+NTAPI
+PortFdoPower(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ PIRP Irp);
+
+PPORT_REQUEST
+PortGetRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
 
 /* miniport.c */
 
@@ -146,6 +239,26 @@ BOOLEAN
 MiniportHwInterrupt(
     _In_ PMINIPORT Miniport);
 
+BOOLEAN
+MiniportHwMessageInterrupt(
+    _In_ PMINIPORT Miniport,
+    _In_ ULONG MessageId);
+
+BOOLEAN
+MiniportBuildIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+BOOLEAN
+MiniportStartIo(
+    _In_ PMINIPORT Miniport,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+BOOLEAN
+MiniportAdapterControl(
+    _In_ PMINIPORT Miniport,
+    _In_ SCSI_ADAPTER_CONTROL_TYPE ControlType);
+
 /* misc.c */
 
 NTSTATUS
@@ -196,6 +309,16 @@ GetResourceListInterrupt(
     PBOOLEAN ShareVector,
     PKAFFINITY Affinity);
 
+ULONG
+GetResourceListMessageCount(
+    PFDO_DEVICE_EXTENSION DeviceExtension);
+
+NTSTATUS
+GetResourceListMessageInterrupts(
+    PFDO_DEVICE_EXTENSION DeviceExtension,
+    PMESSAGE_INTERRUPT MessageInterrupts,
+    ULONG MessageCount);
+
 NTSTATUS
 AllocateAddressMapping(
     PMAPPED_ADDRESS *MappedAddressList,
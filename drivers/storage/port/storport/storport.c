@@ -20,6 +20,72 @@ ULONG PortNumber = 0;
 
 /* FUNCTIONS ******************************************************************/
 
+static
+STOR_PHYSICAL_ADDRESS
+PortGetPhysicalRun(
+    _In_ PVOID VirtualAddress,
+    _In_ ULONG Remaining,
+    _Out_ PULONG Length)
+{
+    STOR_PHYSICAL_ADDRESS PhysicalAddress, NextAddress;
+    PUCHAR Address = VirtualAddress;
+    ULONG RunLength;
+
+    PhysicalAddress = MmGetPhysicalAddress(Address);
+    RunLength = min(PAGE_SIZE - BYTE_OFFSET(Address), Remaining);
+
+    /* Merge the following pages as long as they are physically contiguous */
+    while (RunLength < Remaining)
+    {
+        NextAddress = MmGetPhysicalAddress(Address + RunLength);
+        if (NextAddress.QuadPart != PhysicalAddress.QuadPart + RunLength)
+            break;
+
+        RunLength += min(PAGE_SIZE, Remaining - RunLength);
+    }
+
+    *Length = RunLength;
+    return PhysicalAddress;
+}
+
+
+static
+PKINTERRUPT
+PortGetMessageInterrupt(
+    _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ ULONG MessageId)
+{
+    /* Message 0 is the line based interrupt if no messages were connected */
+    if (DeviceExtension->MessageCount == 0)
+        return (MessageId == 0) ? DeviceExtension->Interrupt : NULL;
+
+    if (MessageId >= DeviceExtension->MessageCount)
+        return NULL;
+
+    return DeviceExtension->MessageInterrupts[MessageId].Interrupt;
+}
+
+
+typedef struct _SYNCHRONIZE_CONTEXT
+{
+    PSTOR_SYNCHRONIZED_ACCESS SynchronizedAccessRoutine;
+    PVOID HwDeviceExtension;
+    PVOID Context;
+} SYNCHRONIZE_CONTEXT, *PSYNCHRONIZE_CONTEXT;
+
+static
+BOOLEAN
+NTAPI
+PortSynchronizeRoutine(
+    _In_ PVOID SynchronizeContext)
+{
+    PSYNCHRONIZE_CONTEXT Context = SynchronizeContext;
+
+    return Context->SynchronizedAccessRoutine(Context->HwDeviceExtension,
+                                              Context->Context);
+}
+
+
 static
 NTSTATUS
 PortAddDriverInitData(
@@ -125,7 +191,6 @@ PortAddDevice(
              L"\\Device\\RaidPort%lu",
              PortNumber);
     RtlInitUnicodeString(&DeviceName, NameBuffer);
-    PortNumber++;
 
     DPRINT1("Creating device: %wZ\n", &DeviceName);
 
@@ -159,6 +224,10 @@ PortAddDevice(
     DeviceExtension->PhysicalDevice = PhysicalDeviceObject;
 
     DeviceExtension->PnpState = dsStopped;
+    DeviceExtension->PortNumber = PortNumber++;
+
+    KeInitializeSpinLock(&DeviceExtension->StartIoLock);
+    InitializeListHead(&DeviceExtension->UnitListHead);
 
     /* Attach the FDO to the device stack */
     Status = IoAttachDeviceToDeviceStackSafe(Fdo,
@@ -261,15 +330,25 @@ PortDispatchDeviceControl(
     IN PDEVICE_OBJECT DeviceObject,
     IN PIRP Irp)
 {
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
     DPRINT1("PortDispatchDeviceControl(%p %p)\n",
             DeviceObject, Irp);
 
-    Irp->IoStatus.Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = 0;
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
-    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    switch (DeviceExtension->ExtensionType)
+    {
+        case FdoExtension:
+            return PortFdoDeviceControl(DeviceObject,
+                                        Irp);
 
-    return STATUS_SUCCESS;
+        default:
+            Irp->IoStatus.Status = STATUS_UNSUCCESSFUL;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return STATUS_UNSUCCESSFUL;
+    }
 }
 
 
@@ -280,15 +359,25 @@ PortDispatchScsi(
     IN PDEVICE_OBJECT DeviceObject,
     IN PIRP Irp)
 {
-    DPRINT1("PortDispatchScsi(%p %p)\n",
-            DeviceObject, Irp);
+    PFDO_DEVICE_EXTENSION DeviceExtension;
 
-    Irp->IoStatus.Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = 0;
+    DPRINT("PortDispatchScsi(%p %p)\n",
+           DeviceObject, Irp);
 
-    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
-    return STATUS_SUCCESS;
+    switch (DeviceExtension->ExtensionType)
+    {
+        case FdoExtension:
+            return PortFdoScsi(DeviceObject,
+                               Irp);
+
+        default:
+            Irp->IoStatus.Status = STATUS_UNSUCCESSFUL;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return STATUS_UNSUCCESSFUL;
+    }
 }
 
 
@@ -352,15 +441,26 @@ PortDispatchPower(
     IN PDEVICE_OBJECT DeviceObject,
     IN PIRP Irp)
 {
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
     DPRINT1("PortDispatchPower(%p %p)\n",
             DeviceObject, Irp);
 
-    Irp->IoStatus.Status = STATUS_SUCCESS;
-    Irp->IoStatus.Information = 0;
+    DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
-    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    switch (DeviceExtension->ExtensionType)
+    {
+        case FdoExtension:
+            return PortFdoPower(DeviceObject,
+                                Irp);
 
-    return STATUS_SUCCESS;
+        default:
+            PoStartNextPowerIrp(Irp);
+            Irp->IoStatus.Status = STATUS_SUCCESS;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest(Irp, IO_NO_INCREMENT);
+            return STATUS_SUCCESS;
+    }
 }
 
 
@@ -518,6 +618,130 @@ StorPortDeviceReady(
 }
 
 
+/*
+ * @implemented
+ */
+STORPORT_API
+ULONG
+StorPortExtendedFunction(
+    _In_ STORPORT_FUNCTION_CODE FunctionCode,
+    _In_ PVOID HwDeviceExtension,
+    ...)
+{
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PMESSAGE_INTERRUPT_INFORMATION InterruptInfo;
+    PMESSAGE_INTERRUPT MessageInterrupt;
+    PPROCESSOR_NUMBER ProcessorNumber;
+    PKINTERRUPT Interrupt;
+    PKAFFINITY Affinity;
+    PUSHORT GroupCount;
+    PULONG OldIrqlPtr;
+    ULONG OldIrql;
+    ULONG MessageId;
+    USHORT Group;
+    ULONG Status = STOR_STATUS_SUCCESS;
+    va_list ap;
+
+    DPRINT("StorPortExtendedFunction(%d %p)\n",
+           FunctionCode, HwDeviceExtension);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    va_start(ap, HwDeviceExtension);
+
+    switch (FunctionCode)
+    {
+        case ExtFunctionAcquireMSISpinLock:
+            MessageId = (ULONG)va_arg(ap, ULONG);
+            OldIrqlPtr = (PULONG)va_arg(ap, PULONG);
+
+            Interrupt = PortGetMessageInterrupt(DeviceExtension, MessageId);
+            if (Interrupt == NULL)
+            {
+                Status = STOR_STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            *OldIrqlPtr = KeAcquireInterruptSpinLock(Interrupt);
+            break;
+
+        case ExtFunctionReleaseMSISpinLock:
+            MessageId = (ULONG)va_arg(ap, ULONG);
+            OldIrql = (ULONG)va_arg(ap, ULONG);
+
+            Interrupt = PortGetMessageInterrupt(DeviceExtension, MessageId);
+            if (Interrupt == NULL)
+            {
+                Status = STOR_STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            KeReleaseInterruptSpinLock(Interrupt, (KIRQL)OldIrql);
+            break;
+
+        case ExtFunctionGetMessageInterruptInformation:
+            MessageId = (ULONG)va_arg(ap, ULONG);
+            InterruptInfo = (PMESSAGE_INTERRUPT_INFORMATION)va_arg(ap, PMESSAGE_INTERRUPT_INFORMATION);
+
+            if (MessageId >= DeviceExtension->MessageCount)
+            {
+                Status = STOR_STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            /* The message address and data are programmed by the bus driver */
+            MessageInterrupt = &DeviceExtension->MessageInterrupts[MessageId];
+            RtlZeroMemory(InterruptInfo, sizeof(MESSAGE_INTERRUPT_INFORMATION));
+            InterruptInfo->MessageId = MessageId;
+            InterruptInfo->InterruptVector = MessageInterrupt->Vector;
+            InterruptInfo->InterruptLevel = MessageInterrupt->Irql;
+            InterruptInfo->InterruptMode = MessageInterrupt->InterruptMode;
+            break;
+
+        case ExtFunctionGetCurrentProcessorNumber:
+            ProcessorNumber = (PPROCESSOR_NUMBER)va_arg(ap, PPROCESSOR_NUMBER);
+
+            ProcessorNumber->Group = 0;
+            ProcessorNumber->Number = (UCHAR)KeGetCurrentProcessorNumber();
+            ProcessorNumber->Reserved = 0;
+            break;
+
+        case ExtFunctionGetActiveGroupCount:
+            GroupCount = (PUSHORT)va_arg(ap, PUSHORT);
+
+            *GroupCount = 1;
+            break;
+
+        case ExtFunctionGetGroupAffinity:
+            Group = (USHORT)va_arg(ap, ULONG);
+            Affinity = (PKAFFINITY)va_arg(ap, PKAFFINITY);
+
+            if (Group != 0)
+            {
+                Status = STOR_STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            *Affinity = KeQueryActiveProcessors();
+            break;
+
+        default:
+            DPRINT1("Unsupported extended function %d\n", FunctionCode);
+            Status = STOR_STATUS_NOT_IMPLEMENTED;
+            break;
+    }
+
+    va_end(ap);
+
+    return Status;
+}
+
+
 /*
  * @implemented
  */
@@ -697,17 +921,19 @@ StorPortGetPhysicalAddress(
     PMINIPORT_DEVICE_EXTENSION MiniportExtension;
     PFDO_DEVICE_EXTENSION DeviceExtension;
     STOR_PHYSICAL_ADDRESS PhysicalAddress;
+    PPORT_REQUEST Request;
     ULONG_PTR Offset;
+    ULONG i;
 
-    DPRINT1("StorPortGetPhysicalAddress(%p %p %p %p)\n",
-            HwDeviceExtension, Srb, VirtualAddress, Length);
+    DPRINT("StorPortGetPhysicalAddress(%p %p %p %p)\n",
+           HwDeviceExtension, Srb, VirtualAddress, Length);
 
     /* Get the miniport extension */
     MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
                                           MINIPORT_DEVICE_EXTENSION,
                                           HwDeviceExtension);
-    DPRINT1("HwDeviceExtension %p  MiniportExtension %p\n",
-            HwDeviceExtension, MiniportExtension);
+    DPRINT("HwDeviceExtension %p  MiniportExtension %p\n",
+           HwDeviceExtension, MiniportExtension);
 
     DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
 
@@ -723,19 +949,47 @@ StorPortGetPhysicalAddress(
         return PhysicalAddress;
     }
 
-    // FIXME
+    /* Inside of the data buffer of the request? */
+    if ((Srb != NULL) &&
+        ((ULONG_PTR)VirtualAddress >= (ULONG_PTR)Srb->DataBuffer) &&
+        ((ULONG_PTR)VirtualAddress < (ULONG_PTR)Srb->DataBuffer + Srb->DataTransferLength))
+    {
+        Request = PortGetRequest(Srb);
+        if (Request == NULL || Request->SgList == NULL)
+        {
+            *Length = 0;
+            PhysicalAddress.QuadPart = 0;
+            return PhysicalAddress;
+        }
 
-    UNIMPLEMENTED;
+        /* Use the addresses the DMA adapter mapped for the device */
+        Offset = (ULONG_PTR)VirtualAddress - (ULONG_PTR)Srb->DataBuffer;
+        for (i = 0; i < Request->SgList->NumberOfElements; i++)
+        {
+            if (Offset < Request->SgList->Elements[i].Length)
+            {
+                PhysicalAddress.QuadPart = Request->SgList->Elements[i].Address.QuadPart + Offset;
+                *Length = Request->SgList->Elements[i].Length - (ULONG)Offset;
+                return PhysicalAddress;
+            }
 
-    *Length = 0;
-    PhysicalAddress.QuadPart = (LONGLONG)0;
+            Offset -= Request->SgList->Elements[i].Length;
+        }
 
-    return PhysicalAddress;
+        *Length = 0;
+        PhysicalAddress.QuadPart = 0;
+        return PhysicalAddress;
+    }
+
+    /* Anything else must be non-paged memory of the miniport */
+    return PortGetPhysicalRun(VirtualAddress,
+                              PAGE_SIZE - BYTE_OFFSET(VirtualAddress),
+                              Length);
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PSTOR_SCATTER_GATHER_LIST
@@ -744,9 +998,23 @@ StorPortGetScatterGatherList(
     _In_ PVOID DeviceExtension,
     _In_ PSCSI_REQUEST_BLOCK Srb)
 {
-    DPRINT1("StorPortGetScatterGatherList()\n");
-    UNIMPLEMENTED;
-    return NULL;
+    PPORT_REQUEST Request;
+
+    DPRINT("StorPortGetScatterGatherList(%p %p)\n",
+           DeviceExtension, Srb);
+
+    if (Srb == NULL)
+        return NULL;
+
+    /* The list was built by the DMA adapter before the request was started */
+    Request = PortGetRequest(Srb);
+    if (Request == NULL)
+        return NULL;
+
+    C_ASSERT(sizeof(STOR_SCATTER_GATHER_LIST) == sizeof(SCATTER_GATHER_LIST));
+    C_ASSERT(sizeof(STOR_SCATTER_GATHER_ELEMENT) == sizeof(SCATTER_GATHER_ELEMENT));
+
+    return (PSTOR_SCATTER_GATHER_LIST)Request->SgList;
 }
 
 
@@ -821,7 +1089,7 @@ StorPortGetUncachedExtension(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PVOID
@@ -830,10 +1098,29 @@ StorPortGetVirtualAddress(
     _In_ PVOID HwDeviceExtension,
     _In_ STOR_PHYSICAL_ADDRESS PhysicalAddress)
 {
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    ULONGLONG Offset;
+
     DPRINT1("StorPortGetVirtualAddress(%p %I64x)\n",
             HwDeviceExtension, PhysicalAddress.QuadPart);
-    UNIMPLEMENTED;
-    return NULL;
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /* Only the uncached extension can be mapped back */
+    if (DeviceExtension->UncachedExtensionVirtualBase == NULL ||
+        PhysicalAddress.QuadPart < DeviceExtension->UncachedExtensionPhysicalBase.QuadPart)
+        return NULL;
+
+    Offset = PhysicalAddress.QuadPart - DeviceExtension->UncachedExtensionPhysicalBase.QuadPart;
+    if (Offset >= DeviceExtension->UncachedExtensionSize)
+        return NULL;
+
+    return (PUCHAR)DeviceExtension->UncachedExtensionVirtualBase + Offset;
 }
 
 
@@ -998,10 +1285,18 @@ StorPortNotification(
     PBOOLEAN Result;
     PSTOR_DPC Dpc;
     PHW_DPC_ROUTINE HwDpcRoutine;
+    PSCSI_REQUEST_BLOCK Srb;
+    PPORT_REQUEST Request;
+    STOR_SPINLOCK SpinLock;
+    PVOID LockContext;
+    PSTOR_LOCK_HANDLE LockHandle;
+    PKINTERRUPT Interrupt;
+    PVOID SystemArgument1, SystemArgument2;
     va_list ap;
 
-    DPRINT1("StorPortNotification(%x %p)\n",
-            NotificationType, HwDeviceExtension);
+    /* Called for every completed request, so don't trace loudly here */
+    DPRINT("StorPortNotification(%x %p)\n",
+           NotificationType, HwDeviceExtension);
 
     /* Get the miniport extension */
     if (HwDeviceExtension != NULL)
@@ -1009,8 +1304,8 @@ StorPortNotification(
         MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
                                               MINIPORT_DEVICE_EXTENSION,
                                               HwDeviceExtension);
-        DPRINT1("HwDeviceExtension %p  MiniportExtension %p\n",
-                HwDeviceExtension, MiniportExtension);
+        DPRINT("HwDeviceExtension %p  MiniportExtension %p\n",
+               HwDeviceExtension, MiniportExtension);
 
         DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
     }
@@ -1019,6 +1314,16 @@ StorPortNotification(
 
     switch (NotificationType)
     {
+        case RequestComplete:
+            Srb = (PSCSI_REQUEST_BLOCK)va_arg(ap, PSCSI_REQUEST_BLOCK);
+            DPRINT("RequestComplete Srb %p  SrbStatus 0x%02x\n", Srb, Srb->SrbStatus);
+
+            /* The notification may come at DIRQL, complete the IRP in a DPC */
+            Request = PortGetRequest(Srb);
+            if (Request != NULL)
+                KeInsertQueueDpc(&Request->CompletionDpc, NULL, NULL);
+            break;
+
         case EnablePassiveInitialization:
             DPRINT1("EnablePassiveInitialization\n");
             HwPassiveInitRoutine = (PHW_PASSIVE_INITIALIZE_ROUTINE)va_arg(ap, PHW_PASSIVE_INITIALIZE_ROUTINE);
@@ -1048,6 +1353,66 @@ StorPortNotification(
             KeInitializeSpinLock(&Dpc->Lock);
             break;
 
+        case IssueDpc:
+            Dpc = (PSTOR_DPC)va_arg(ap, PSTOR_DPC);
+            SystemArgument1 = (PVOID)va_arg(ap, PVOID);
+            SystemArgument2 = (PVOID)va_arg(ap, PVOID);
+            Result = (PBOOLEAN)va_arg(ap, PBOOLEAN);
+
+            *Result = KeInsertQueueDpc((PRKDPC)&Dpc->Dpc,
+                                       SystemArgument1,
+                                       SystemArgument2);
+            break;
+
+        case AcquireSpinLock:
+            SpinLock = (STOR_SPINLOCK)va_arg(ap, STOR_SPINLOCK);
+            LockContext = (PVOID)va_arg(ap, PVOID);
+            LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
+
+            LockHandle->Lock = SpinLock;
+            switch (SpinLock)
+            {
+                case DpcLock:
+                    Dpc = (PSTOR_DPC)LockContext;
+                    KeAcquireInStackQueuedSpinLock(&Dpc->Lock,
+                                                   (PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
+                    break;
+
+                case StartIoLock:
+                    KeAcquireInStackQueuedSpinLock(&DeviceExtension->StartIoLock,
+                                                   (PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
+                    break;
+
+                case InterruptLock:
+                    Interrupt = PortGetMessageInterrupt(DeviceExtension, 0);
+                    if (Interrupt != NULL)
+                        LockHandle->Context.OldIrql = KeAcquireInterruptSpinLock(Interrupt);
+                    else
+                        KeRaiseIrql(DISPATCH_LEVEL, &LockHandle->Context.OldIrql);
+                    break;
+            }
+            break;
+
+        case ReleaseSpinLock:
+            LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
+
+            switch (LockHandle->Lock)
+            {
+                case DpcLock:
+                case StartIoLock:
+                    KeReleaseInStackQueuedSpinLock((PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
+                    break;
+
+                case InterruptLock:
+                    Interrupt = PortGetMessageInterrupt(DeviceExtension, 0);
+                    if (Interrupt != NULL)
+                        KeReleaseInterruptSpinLock(Interrupt, LockHandle->Context.OldIrql);
+                    else
+                        KeLowerIrql(LockHandle->Context.OldIrql);
+                    break;
+            }
+            break;
+
         default:
             DPRINT1("Unsupported Notification %lx\n", NotificationType);
             break;
@@ -1222,7 +1587,7 @@ StorPortSetBusDataByOffset(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1234,9 +1599,23 @@ StorPortSetDeviceQueueDepth(
     _In_ UCHAR Lun,
     _In_ ULONG Depth)
 {
-    DPRINT1("StorPortSetDeviceQueueDepth()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+
+    DPRINT1("StorPortSetDeviceQueueDepth(%p %u %u %u %lu)\n",
+            HwDeviceExtension, PathId, TargetId, Lun, Depth);
+
+    if (Depth == 0)
+        return FALSE;
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    /* We only have one logical unit per adapter */
+    MiniportExtension->Miniport->DeviceExtension->DeviceQueueDepth = Depth;
+
+    return TRUE;
 }
 
 
@@ -1254,7 +1633,7 @@ StorPortStallExecution(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 VOID
@@ -1264,8 +1643,64 @@ StorPortSynchronizeAccess(
     _In_ PSTOR_SYNCHRONIZED_ACCESS SynchronizedAccessRoutine,
     _In_opt_ PVOID Context)
 {
-    DPRINT1("StorPortSynchronizeAccess()\n");
-    UNIMPLEMENTED;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PMESSAGE_INTERRUPT MessageInterrupt;
+    SYNCHRONIZE_CONTEXT SynchronizeContext;
+    ULONG i;
+
+    DPRINT("StorPortSynchronizeAccess(%p %p %p)\n",
+           HwDeviceExtension, SynchronizedAccessRoutine, Context);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    SynchronizeContext.SynchronizedAccessRoutine = SynchronizedAccessRoutine;
+    SynchronizeContext.HwDeviceExtension = HwDeviceExtension;
+    SynchronizeContext.Context = Context;
+
+    if (DeviceExtension->MessageCount == 0)
+    {
+        if (DeviceExtension->Interrupt != NULL)
+        {
+            KeSynchronizeExecution(DeviceExtension->Interrupt,
+                                   PortSynchronizeRoutine,
+                                   &SynchronizeContext);
+        }
+        else
+        {
+            PortSynchronizeRoutine(&SynchronizeContext);
+        }
+        return;
+    }
+
+    if (DeviceExtension->Miniport.PortConfig.InterruptSynchronizationMode != InterruptSynchronizePerMessage)
+    {
+        /* All messages share the same lock */
+        KeSynchronizeExecution(DeviceExtension->MessageInterrupts[0].Interrupt,
+                               PortSynchronizeRoutine,
+                               &SynchronizeContext);
+        return;
+    }
+
+    /* Hold every message lock, always taken in the same order */
+    for (i = 0; i < DeviceExtension->MessageCount; i++)
+    {
+        MessageInterrupt = &DeviceExtension->MessageInterrupts[i];
+        MessageInterrupt->LockIrql = KeAcquireInterruptSpinLock(MessageInterrupt->Interrupt);
+    }
+
+    PortSynchronizeRoutine(&SynchronizeContext);
+
+    for (i = DeviceExtension->MessageCount; i-- > 0;)
+    {
+        MessageInterrupt = &DeviceExtension->MessageInterrupts[i];
+        KeReleaseInterruptSpinLock(MessageInterrupt->Interrupt,
+                                   MessageInterrupt->LockIrql);
+    }
 }
 
 
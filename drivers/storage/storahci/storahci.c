@@ -214,6 +214,67 @@ AhciAllocateResourceForAdapter (
     return TRUE;
 }// -- AhciAllocateResourceForAdapter();
 
+/**
+ * @name AhciComReset
+ * @implemented
+ *
+ * Perform COMRESET on the port and wait for the device to show up again.
+ * PxCMD.ST must be 0.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciComReset (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    ULONG index;
+    AHCI_SERIAL_ATA_STATUS ssts;
+    AHCI_SERIAL_ATA_CONTROL sctl;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciComReset()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    // section 10.4.2
+
+    // Software causes a port reset (COMRESET) by writing 1h to the PxSCTL.DET field to invoke a
+    // COMRESET on the interface and start a re-establishment of Phy layer communications. Software shall
+    // wait at least 1 millisecond before clearing PxSCTL.DET to 0h; this ensures that at least one COMRESET
+    // signal is sent over the interface. After clearing PxSCTL.DET to 0h, software should wait for
+    // communication to be re-established as indicated by PxSSTS.DET being set to 3h. Then software should
+    // write all 1s to the PxSERR register to clear any bits that were set as part of the port reset.
+
+    sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+    sctl.DET = 1;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+    StorPortStallExecution(1000);
+
+    sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+    sctl.DET = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+    // Poll DET to verify if a device is attached to the port
+    index = 0;
+    do
+    {
+        StorPortStallExecution(1000);
+        ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
+
+        index++;
+        if (ssts.DET != 0)
+        {
+            break;
+        }
+    }
+    while(index < 30);
+
+    return;
+}// -- AhciComReset();
+
 /**
  * @name AhciStartPort
  * @implemented
@@ -234,7 +295,6 @@ AhciStartPort (
     AHCI_TASK_FILE_DATA tfd;
     AHCI_INTERRUPT_ENABLE ie;
     AHCI_SERIAL_ATA_STATUS ssts;
-    AHCI_SERIAL_ATA_CONTROL sctl;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
 
     AhciDebugPrint("AhciStartPort()\n");
@@ -254,41 +314,7 @@ AhciStartPort (
     if (((cmd.FR == 1) && (cmd.FRE == 0)) ||
         ((cmd.CR == 1) && (cmd.ST == 0)))
     {
-        AhciDebugPrint("\tCOMRESET\n");
-        // perform COMRESET
-        // section 10.4.2
-
-        // Software causes a port reset (COMRESET) by writing 1h to the PxSCTL.DET field to invoke a
-        // COMRESET on the interface and start a re-establishment of Phy layer communications. Software shall
-        // wait at least 1 millisecond before clearing PxSCTL.DET to 0h; this ensures that at least one COMRESET
-        // signal is sent over the interface. After clearing PxSCTL.DET to 0h, software should wait for
-        // communication to be re-established as indicated by PxSSTS.DET being set to 3h. Then software should
-        // write all 1s to the PxSERR register to clear any bits that were set as part of the port reset.
-
-        sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
-        sctl.DET = 1;
-        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
-
-        StorPortStallExecution(1000);
-
-        sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
-        sctl.DET = 0;
-        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
-
-        // Poll DET to verify if a device is attached to the port
-        index = 0;
-        do
-        {
-            StorPortStallExecution(1000);
-            ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
-
-            index++;
-            if (ssts.DET != 0)
-            {
-                break;
-            }
-        }
-        while(index < 30);
+        AhciComReset(PortExtension);
     }
 
     ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
@@ -579,7 +605,7 @@ AhciCompleteIssuedSrb (
 
     for (i = 0; i < NCS; i++)
     {
-        if (((1 << i) & CommandsToComplete) != 0)
+        if (((1UL << i) & CommandsToComplete) != 0)
         {
             Srb = PortExtension->Slot[i];
 
@@ -588,6 +614,9 @@ AhciCompleteIssuedSrb (
                 continue;
             }
 
+            // the slot (and its NCQ tag) can be reused from now on
+            PortExtension->Slot[i] = NULL;
+
             SrbExtension = GetSrbExtension(Srb);
             NT_ASSERT(SrbExtension != NULL);
 
@@ -605,9 +634,119 @@ AhciCompleteIssuedSrb (
         }
     }
 
+    PortExtension->NcqSlots &= ~CommandsToComplete;
     return;
 }// -- AhciCompleteIssuedSrb();
 
+/**
+ * @name AhciRecoverPort
+ * @implemented
+ *
+ * Fatal error recovery (section 6.2.2). The port is stopped, reset if the device
+ * is still busy, and restarted. Every issued command is failed back to storport.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciRecoverPort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    ULONG NCS, i, index;
+    AHCI_PORT_CMD cmd;
+    AHCI_TASK_FILE_DATA tfd;
+    PSCSI_REQUEST_BLOCK Srb;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciRecoverPort()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+
+    // 6.2.2.1
+    // Software clears PxCMD.ST to '0' to reset the PxCI register, and waits for PxCMD.CR to return '0'
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    cmd.ST = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    index = 0;
+    do
+    {
+        StorPortStallExecution(1000);
+        cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+        index++;
+    }
+    while((cmd.CR != 0) && (index < 500));
+
+    // Software clears PxSERR and PxIS
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+
+    // If PxTFD.STS.BSY or PxTFD.STS.DRQ is still set, a COMRESET is needed
+    // to get the device back to an idle state
+    tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    if ((cmd.CR != 0) || (tfd.STS.BSY) || (tfd.STS.DRQ))
+    {
+        AhciComReset(PortExtension);
+    }
+
+    // The failing command is not known without the NCQ Command Error log (READ LOG EXT, page 10h),
+    // so fail all issued commands, storport retries them
+    for (i = 0; i < NCS; i++)
+    {
+        if (((1UL << i) & PortExtension->CommandIssuedSlots) == 0)
+        {
+            continue;
+        }
+
+        Srb = PortExtension->Slot[i];
+        PortExtension->Slot[i] = NULL;
+
+        if (Srb != NULL)
+        {
+            Srb->SrbStatus = SRB_STATUS_BUS_RESET;
+            StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        }
+    }
+
+    PortExtension->NcqSlots &= ~PortExtension->CommandIssuedSlots;
+    PortExtension->CommandIssuedSlots = 0;
+
+    PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
+    if (PortExtension->DeviceParams.IsActive)
+    {
+        return;
+    }
+
+    AhciDebugPrint("\tFailed to restart Port\n");
+
+    // the port is gone, nothing will ever pick up the
+    // assigned and pending Srbs
+    for (i = 0; i < NCS; i++)
+    {
+        Srb = PortExtension->Slot[i];
+        PortExtension->Slot[i] = NULL;
+
+        if (Srb != NULL)
+        {
+            Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+            StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        }
+    }
+
+    PortExtension->QueueSlots = 0;
+    PortExtension->NcqSlots = 0;
+
+    while ((Srb = RemoveQueue(&PortExtension->SrbQueue)) != NULL)
+    {
+        Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+        StorPortNotification(RequestComplete, AdapterExtension, Srb);
+    }
+
+    return;
+}// -- AhciRecoverPort();
+
 /**
  * @name AhciInterruptHandler
  * @not_implemented
@@ -663,6 +802,31 @@ AhciInterruptHandler (
         // non-queued commands were being issued or native command queuing commands were being issued.
 
         AhciDebugPrint("\tFatal Error: %x\n", PxIS.Status);
+
+        // commands which completed before the error are still good
+        ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
+        sact = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SACT);
+
+        outstanding = ci | sact;
+        if ((PortExtension->CommandIssuedSlots & (~outstanding)) != 0)
+        {
+            AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
+            PortExtension->CommandIssuedSlots &= outstanding;
+        }
+
+        AhciRecoverPort(PortExtension);
+
+        // Clear port interrupt
+        StorPortWriteRegisterUlong(AdapterExtension, AdapterExtension->IS, (1 << PortExtension->PortNumber));
+
+        if (PortExtension->DeviceParams.IsActive)
+        {
+            // reissue the Srbs which were assigned but not issued yet
+            AhciAssignCommandSlots(PortExtension);
+            AhciActivatePort(PortExtension);
+        }
+
+        return;
     }
 
     // Normal Command Completion
@@ -697,6 +861,14 @@ AhciInterruptHandler (
     {
         AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
         PortExtension->CommandIssuedSlots &= outstanding;
+
+        // we are synchronized with AhciProcessIO here, so hand the
+        // freed slots to the pending Srbs and issue them right away
+        if (PortExtension->DeviceParams.IsActive)
+        {
+            AhciAssignCommandSlots(PortExtension);
+            AhciActivatePort(PortExtension);
+        }
     }
 
     return;
@@ -1403,6 +1575,14 @@ AhciProcessSrb (
     NT_ASSERT(SlotIndex < AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
     SrbExtension->SlotIndex = SlotIndex;
 
+    if (IsNcqCommand(SrbExtension))
+    {
+        // FPDMA QUEUED commands carry their tag in SectorCount[7:3],
+        // we use the command slot as tag
+        SrbExtension->SectorCountLow = (UCHAR)(SlotIndex << 3);
+        PortExtension->NcqSlots |= 1UL << SlotIndex;
+    }
+
     // program the CFIS in the CommandTable
     CommandHeader = &PortExtension->CommandList[SlotIndex];
 
@@ -1467,7 +1647,7 @@ AhciProcessSrb (
 
     // mark this slot
     PortExtension->Slot[SlotIndex] = Srb;
-    PortExtension->QueueSlots |= 1 << SlotIndex;
+    PortExtension->QueueSlots |= 1UL << SlotIndex;
     return;
 }// -- AhciProcessSrb();
 
@@ -1486,7 +1666,7 @@ AhciActivatePort (
     )
 {
     AHCI_PORT_CMD cmd;
-    ULONG QueueSlots, slotToActivate, tmp;
+    ULONG QueueSlots, slotToActivate, ncqIssued, nonNcqIssued;
     PAHCI_ADAPTER_EXTENSION AdapterExtension;
 
     AhciDebugPrint("AhciActivatePort()\n");
@@ -1508,27 +1688,105 @@ AhciActivatePort (
         return;
     }
 
-    // get the lowest set bit
-    tmp = QueueSlots & (QueueSlots - 1);
+    // Native queued and non-queued commands must not be outstanding at the same time,
+    // so issue only one kind and let the other one drain first.
+    // Non-queued commands win, otherwise a stream of queued ones could starve them.
+    ncqIssued = PortExtension->CommandIssuedSlots & PortExtension->NcqSlots;
+    nonNcqIssued = PortExtension->CommandIssuedSlots & ~PortExtension->NcqSlots;
 
-    if (tmp == 0)
-        slotToActivate = QueueSlots;
+    slotToActivate = QueueSlots & ~PortExtension->NcqSlots;
+    if (slotToActivate != 0)
+    {
+        if (ncqIssued != 0)
+        {
+            return;
+        }
+    }
     else
-        slotToActivate = (QueueSlots & (~tmp));
+    {
+        if (nonNcqIssued != 0)
+        {
+            return;
+        }
 
-    // mark that bit off in QueueSlots
+        slotToActivate = QueueSlots;
+
+        // section 3.3.13
+        // PxSACT must be set before the command is issued through PxCI
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SACT, slotToActivate);
+    }
+
+    // mark these bits off in QueueSlots
     // so we can know we it is really needed to activate port or not
     PortExtension->QueueSlots &= ~slotToActivate;
     // mark this CommandIssuedSlots
     // to validate in completeIssuedCommand
     PortExtension->CommandIssuedSlots |= slotToActivate;
 
-    // tell the HBA to issue this Command Slot to the given port
+    // tell the HBA to issue these Command Slots to the given port
     StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, slotToActivate);
 
     return;
 }// -- AhciActivatePort();
 
+/**
+ * @name AhciAssignCommandSlots
+ * @implemented
+ *
+ * Move pending Srbs from SrbQueue to the free command slots of the port.
+ * Caller must be synchronized with the interrupt handler.
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciAssignCommandSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PSCSI_REQUEST_BLOCK tmpSrb;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    ULONG commandSlotMask, occupiedSlots, slotIndex, slotCount;
+
+    AhciDebugPrint("AhciAssignCommandSlots()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    // slot index is used as NCQ tag, so don't use more slots than the device has tags
+    slotCount = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+    if (PortExtension->DeviceParams.QueueDepth != 0)
+    {
+        slotCount = min(slotCount, PortExtension->DeviceParams.QueueDepth);
+    }
+
+    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
+    commandSlotMask = AHCI_SLOT_MASK(slotCount); // available slots mask
+
+    commandSlotMask = (commandSlotMask & ~occupiedSlots);
+
+    // iterate over HBA port slots
+    for (slotIndex = 0; (slotIndex < slotCount) && (commandSlotMask != 0); slotIndex++)
+    {
+        // skip busy slots
+        if ((commandSlotMask & (1UL << slotIndex)) == 0)
+        {
+            continue;
+        }
+
+        tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
+        if (tmpSrb == NULL)
+        {
+            break;
+        }
+
+        NT_ASSERT(tmpSrb->PathId == PortExtension->PortNumber);
+        AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
+        commandSlotMask &= ~(1UL << slotIndex);
+    }
+
+    return;
+}// -- AhciAssignCommandSlots();
+
 /**
  * @name AhciProcessIO
  * @implemented
@@ -1548,10 +1806,8 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PSCSI_REQUEST_BLOCK tmpSrb;
     STOR_LOCK_HANDLE lockhandle = {0};
     PAHCI_PORT_EXTENSION PortExtension;
-    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
 
     AhciDebugPrint("AhciProcessIO()\n");
     AhciDebugPrint("\tPathId: %d\n", PathId);
@@ -1573,36 +1829,8 @@ AhciProcessIO (
         return; // we should wait for device to get active
     }
 
-    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
-    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
-    commandSlotMask = (1 << NCS) - 1; // available slots mask
-
-    commandSlotMask = (commandSlotMask & ~occupiedSlots);
-    if(commandSlotMask != 0)
-    {
-        // iterate over HBA port slots
-        for (slotIndex = 0; slotIndex < NCS; slotIndex++)
-        {
-            // find first free slot
-            if ((commandSlotMask & (1 << slotIndex)) != 0)
-            {
-                tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
-                if (tmpSrb != NULL)
-                {
-                    NT_ASSERT(tmpSrb->PathId == PathId);
-                    AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
-                }
-                else
-                {
-                    break;
-                }
-            }
-            else
-            {
-                break;
-            }
-        }
-    }
+    // populate free command slots
+    AhciAssignCommandSlots(PortExtension);
 
     // program HBA port
     AhciActivatePort(PortExtension);
@@ -1711,6 +1939,8 @@ InquiryCompletion (
 
     // Device specific data
     PortExtension->DeviceParams.MaxLba.QuadPart = 0;
+    PortExtension->DeviceParams.NcqSupported = 0;
+    PortExtension->DeviceParams.QueueDepth = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
 
     if (SrbExtension->CommandReg == IDE_COMMAND_IDENTIFY)
     {
@@ -1727,6 +1957,20 @@ InquiryCompletion (
 
         PortExtension->DeviceParams.AccessType = DIRECT_ACCESS_DEVICE;
 
+        /* Native Command Queuing, FPDMA QUEUED commands always use 48 bit addressing */
+        if (IsAdapterCAPSNCQ(AdapterExtension->CAP) &&
+            IdentifyDeviceData->SerialAtaCapabilities.NCQ &&
+            PortExtension->DeviceParams.Lba48BitMode)
+        {
+            PortExtension->DeviceParams.NcqSupported = 1;
+
+            // QueueDepth is 0's based
+            PortExtension->DeviceParams.QueueDepth = min(PortExtension->DeviceParams.QueueDepth,
+                                                         (ULONG)IdentifyDeviceData->QueueDepth + 1);
+
+            AhciDebugPrint("\tNCQ Queue Depth: %d\n", PortExtension->DeviceParams.QueueDepth);
+        }
+
         /* Device max address lba */
         if (PortExtension->DeviceParams.Lba48BitMode)
         {
@@ -1788,7 +2032,7 @@ InquiryCompletion (
     // prepare data to send
     InquiryData->Versions = 2;
     InquiryData->Wide32Bit = 1;
-    InquiryData->CommandQueue = 0; // NCQ not supported
+    InquiryData->CommandQueue = PortExtension->DeviceParams.NcqSupported;
     InquiryData->ResponseDataFormat = 0x2;
     InquiryData->DeviceTypeModifier = 0;
     InquiryData->DeviceTypeQualifier = DEVICE_CONNECTED;
@@ -1810,7 +2054,7 @@ InquiryCompletion (
                                          Srb->PathId,
                                          Srb->TargetId,
                                          Srb->Lun,
-                                         AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
+                                         PortExtension->DeviceParams.QueueDepth);
 
     NT_ASSERT(status == TRUE);
     return;
@@ -2017,6 +2261,7 @@ DeviceRequestReadWrite (
     NT_ASSERT(SectorCount > 0);
 
     SrbExtension->AtaFunction = ATA_FUNCTION_ATA_READ;
+    SrbExtension->Flags = 0;
     SrbExtension->Flags |= ATA_FLAGS_USE_DMA;
     SrbExtension->CompletionRoutine = NULL;
 
@@ -2066,6 +2311,28 @@ DeviceRequestReadWrite (
 
     NT_ASSERT(SectorCount < 0x100);
 
+    if (PortExtension->DeviceParams.NcqSupported)
+    {
+        // FPDMA QUEUED commands carry the sector count in the features register,
+        // the tag goes to the sector count register once we get a slot (AhciProcessSrb)
+        SrbExtension->Flags |= ATA_FLAGS_NCQ;
+
+        if (IsReading)
+        {
+            SrbExtension->CommandReg = IDE_COMMAND_READ_FPDMA_QUEUED;
+        }
+        else
+        {
+            SrbExtension->CommandReg = IDE_COMMAND_WRITE_FPDMA_QUEUED;
+        }
+
+        SrbExtension->FeaturesLow = (SectorCount >> 0) & 0xFF;
+        SrbExtension->FeaturesHigh = (SectorCount >> 8) & 0xFF;
+        SrbExtension->SectorCountLow = 0;
+        SrbExtension->SectorCountHigh = 0;
+        SrbExtension->Device = IDE_LBA_MODE;
+    }
+
     SrbExtension->pSgl = (PLOCAL_SCATTER_GATHER_LIST)StorPortGetScatterGatherList(AdapterExtension, Srb);
 
     return SRB_STATUS_PENDING;
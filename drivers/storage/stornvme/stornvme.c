@@ -0,0 +1,2017 @@
+/*
+ * PROJECT:     ReactOS NVMe Storport Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     NVM Express miniport with one queue pair per processor
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#include "stornvme.h"
+
+#define SERVICE_ACTION_READ_CAPACITY16      0x10
+
+static
+ULONG
+NvmeReadRegister (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Offset
+    )
+{
+    return StorPortReadRegisterUlong(AdapterExtension,
+                                     (PULONG)(AdapterExtension->Registers + Offset));
+}
+
+static
+VOID
+NvmeWriteRegister (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Offset,
+    __in ULONG Value
+    )
+{
+    StorPortWriteRegisterUlong(AdapterExtension,
+                               (PULONG)(AdapterExtension->Registers + Offset),
+                               Value);
+}
+
+static
+VOID
+NvmeWriteRegister64 (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in ULONG Offset,
+    __in ULONGLONG Value
+    )
+{
+    // 64-bit registers may be written as two dwords, low first
+    NvmeWriteRegister(AdapterExtension, Offset, (ULONG)Value);
+    NvmeWriteRegister(AdapterExtension, Offset + 4, (ULONG)(Value >> 32));
+}
+
+/**
+ * @name NvmeWaitReady
+ * @implemented
+ *
+ * Wait for CSTS.RDY to reach the given state, up to CAP.TO
+ *
+ * @param AdapterExtension
+ * @param Ready
+ *
+ * @return
+ * TRUE if the controller reached the state in time
+ */
+static
+BOOLEAN
+NvmeWaitReady (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in BOOLEAN Ready
+    )
+{
+    ULONG status = 0, ticks;
+
+    for (ticks = 0; ticks < AdapterExtension->ReadyTimeout; ticks++)
+    {
+        status = NvmeReadRegister(AdapterExtension, NVME_REG_CSTS);
+
+        if (status == (ULONG)-1)
+        {
+            // Device gone
+            AdapterExtension->StateFlags.Removed = 1;
+            return FALSE;
+        }
+
+        if (!!(status & NVME_CSTS_RDY) == Ready)
+            return TRUE;
+
+        StorPortStallExecution(1000);
+    }
+
+    DPRINT1("Controller did not become %s (CSTS %08lx)\n", Ready ? "ready" : "idle", status);
+    return FALSE;
+}// -- NvmeWaitReady();
+
+/**
+ * @name NvmeEnableController
+ * @implemented
+ *
+ * Hand the admin queue to a disabled controller and enable it
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * TRUE if the controller became ready
+ */
+static
+BOOLEAN
+NvmeEnableController (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    ULONG config;
+
+    NvmeWriteRegister(AdapterExtension,
+                      NVME_REG_AQA,
+                      (NVME_ADMIN_QUEUE_DEPTH - 1) | ((NVME_ADMIN_QUEUE_DEPTH - 1) << 16));
+    NvmeWriteRegister64(AdapterExtension,
+                        NVME_REG_ASQ,
+                        AdapterExtension->AdminQueue.SubmissionQueuePhysical.QuadPart);
+    NvmeWriteRegister64(AdapterExtension,
+                        NVME_REG_ACQ,
+                        AdapterExtension->AdminQueue.CompletionQueuePhysical.QuadPart);
+
+    config = NVME_CC_EN |
+             NVME_CC_CSS_NVM |
+             NVME_CC_MPS(NVME_PAGE_SHIFT) |
+             NVME_CC_AMS_RR |
+             NVME_CC_IOSQES(6) |
+             NVME_CC_IOCQES(4);
+    NvmeWriteRegister(AdapterExtension, NVME_REG_CC, config);
+
+    return NvmeWaitReady(AdapterExtension, TRUE);
+}// -- NvmeEnableController();
+
+/**
+ * @name NvmeDisableController
+ * @implemented
+ *
+ * Clear CC.EN; the controller drops every queue and the commands in them
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * TRUE if the controller went idle
+ */
+static
+BOOLEAN
+NvmeDisableController (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    ULONG config;
+
+    config = NvmeReadRegister(AdapterExtension, NVME_REG_CC);
+    if (config == (ULONG)-1)
+    {
+        AdapterExtension->StateFlags.Removed = 1;
+        return FALSE;
+    }
+
+    if (config & NVME_CC_EN)
+    {
+        NvmeWriteRegister(AdapterExtension, NVME_REG_CC, config & ~(NVME_CC_EN | NVME_CC_SHN_MASK));
+    }
+
+    return NvmeWaitReady(AdapterExtension, FALSE);
+}// -- NvmeDisableController();
+
+/**
+ * @name NvmeShutdownController
+ * @implemented
+ *
+ * Request a normal shutdown and wait for CSTS.SHST to report it complete,
+ * up to CAP.TO. The controller writes its volatile cache back before it does.
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * TRUE if the shutdown completed in time
+ */
+static
+BOOLEAN
+NvmeShutdownController (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    ULONG config, status = 0, ticks;
+
+    config = NvmeReadRegister(AdapterExtension, NVME_REG_CC);
+    if (config == (ULONG)-1)
+    {
+        AdapterExtension->StateFlags.Removed = 1;
+        return FALSE;
+    }
+
+    if (!(config & NVME_CC_EN) || AdapterExtension->StateFlags.ShutDown)
+        return TRUE;
+
+    NvmeWriteRegister(AdapterExtension, NVME_REG_CC, (config & ~NVME_CC_SHN_MASK) | NVME_CC_SHN_NORMAL);
+
+    for (ticks = 0; ticks < AdapterExtension->ReadyTimeout; ticks++)
+    {
+        status = NvmeReadRegister(AdapterExtension, NVME_REG_CSTS);
+
+        if (status == (ULONG)-1)
+        {
+            AdapterExtension->StateFlags.Removed = 1;
+            return FALSE;
+        }
+
+        if ((status & NVME_CSTS_SHST_MASK) == NVME_CSTS_SHST_COMPLETE)
+        {
+            AdapterExtension->StateFlags.ShutDown = 1;
+            return TRUE;
+        }
+
+        StorPortStallExecution(1000);
+    }
+
+    DPRINT1("Shutdown did not complete (CSTS %08lx)\n", status);
+    return FALSE;
+}// -- NvmeShutdownController();
+
+/**
+ * @name NvmeResetQueue
+ * @implemented
+ *
+ * Bring a queue back to the state of a newly created one
+ *
+ * @param Queue
+ */
+static
+VOID
+NvmeResetQueue (
+    __inout PNVME_QUEUE Queue
+    )
+{
+    Queue->SubmissionTail = 0;
+    Queue->CompletionHead = 0;
+    Queue->CompletionPhase = 1;
+    Queue->NextCommandId = 0;
+    Queue->Outstanding = 0;
+
+    if (Queue->CompletionQueue != NULL)
+        RtlZeroMemory(Queue->CompletionQueue, Queue->Depth * sizeof(NVME_COMPLETION));
+}// -- NvmeResetQueue();
+
+/**
+ * @name NvmeAbortRequests
+ * @implemented
+ *
+ * Complete every outstanding request with the given status and reset the
+ * queues. Runs with all interrupts of the adapter synchronized, once the
+ * controller no longer owns the commands.
+ *
+ * @param DeviceExtension
+ * @param Context
+ * SRB status to complete the requests with
+ *
+ * @return
+ * TRUE
+ */
+static
+BOOLEAN
+NTAPI
+NvmeAbortRequests (
+    __in PVOID DeviceExtension,
+    __in PVOID Context
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    PSCSI_REQUEST_BLOCK srb;
+    PNVME_QUEUE queue;
+    ULONG index, commandId;
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    for (index = 0; index < adapterExtension->IoQueueCount; index++)
+    {
+        queue = &adapterExtension->IoQueues[index];
+
+        for (commandId = 0; commandId < queue->Depth; commandId++)
+        {
+            srb = queue->Requests[commandId];
+            if (srb == NULL)
+                continue;
+
+            queue->Requests[commandId] = NULL;
+
+            srb->SrbStatus = (UCHAR)(ULONG_PTR)Context;
+            srb->DataTransferLength = 0;
+            StorPortNotification(RequestComplete, adapterExtension, srb);
+        }
+
+        NvmeResetQueue(queue);
+    }
+
+    NvmeResetQueue(&adapterExtension->AdminQueue);
+    adapterExtension->AdminCompleted = FALSE;
+
+    return TRUE;
+}// -- NvmeAbortRequests();
+
+/**
+ * @name NvmeOutstandingRequests
+ * @implemented
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * Number of requests the controller has not completed yet
+ */
+static
+ULONG
+NvmeOutstandingRequests (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    ULONG index, count = 0;
+
+    for (index = 0; index < AdapterExtension->IoQueueCount; index++)
+        count += AdapterExtension->IoQueues[index].Outstanding;
+
+    return count;
+}// -- NvmeOutstandingRequests();
+
+/**
+ * @name NvmeInitializeQueue
+ * @implemented
+ *
+ * Lay a queue pair out in the uncached extension and compute its doorbells
+ *
+ * @param AdapterExtension
+ * @param Queue
+ * @param QueueId
+ * @param Depth
+ * @param Memory
+ * Page aligned memory; advanced past the space the queue uses
+ *
+ * @return
+ * TRUE if every physical address could be resolved
+ */
+static
+BOOLEAN
+NvmeInitializeQueue (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __inout PNVME_QUEUE Queue,
+    __in USHORT QueueId,
+    __in USHORT Depth,
+    __inout PUCHAR *Memory
+    )
+{
+    ULONG length, stride;
+
+    stride = AdapterExtension->DoorbellStride;
+
+    Queue->QueueId = QueueId;
+    Queue->Depth = Depth;
+    Queue->CompletionPhase = 1;
+
+    Queue->SubmissionQueue = (PNVME_COMMAND)*Memory;
+    Queue->SubmissionQueuePhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, *Memory, &length);
+    *Memory += ROUND_TO_PAGES(Depth * sizeof(NVME_COMMAND));
+
+    Queue->CompletionQueue = (PNVME_COMPLETION)*Memory;
+    Queue->CompletionQueuePhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, *Memory, &length);
+    *Memory += ROUND_TO_PAGES(Depth * sizeof(NVME_COMPLETION));
+
+    // The admin queue has no PRP lists, its commands carry at most one page
+    if (QueueId != 0)
+    {
+        Queue->PrpLists = (PULONGLONG)*Memory;
+        Queue->PrpListsPhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, *Memory, &length);
+        *Memory += ROUND_TO_PAGES(Depth * NVME_PRP_LIST_SIZE);
+    }
+
+    Queue->SubmissionDoorbell = (PULONG)(AdapterExtension->Registers + NVME_REG_DOORBELL + (2 * QueueId) * stride);
+    Queue->CompletionDoorbell = (PULONG)(AdapterExtension->Registers + NVME_REG_DOORBELL + (2 * QueueId + 1) * stride);
+
+    return (Queue->SubmissionQueuePhysical.QuadPart != 0) &&
+           (Queue->CompletionQueuePhysical.QuadPart != 0);
+}// -- NvmeInitializeQueue();
+
+/**
+ * @name NvmeAllocateResourceForAdapter
+ * @implemented
+ *
+ * Allocate the admin queue, one queue pair per processor and the identify
+ * buffers from a single uncached extension
+ *
+ * @param AdapterExtension
+ * @param ConfigInfo
+ *
+ * @return
+ * TRUE if allocation was successful
+ */
+static
+BOOLEAN
+NvmeAllocateResourceForAdapter (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PPORT_CONFIGURATION_INFORMATION ConfigInfo
+    )
+{
+    ULONG index, length, queueSize, ioDepth, processorCount;
+    KAFFINITY affinity;
+    PUCHAR memory;
+
+    // Cap the queues by the processors that may submit to them
+    processorCount = 1;
+    if (StorPortGetGroupAffinity(AdapterExtension, 0, &affinity) == STOR_STATUS_SUCCESS)
+    {
+        for (processorCount = 0; affinity != 0; affinity &= affinity - 1)
+            processorCount++;
+    }
+
+    AdapterExtension->IoQueueCount = min(processorCount, NVME_MAX_IO_QUEUES);
+
+    ioDepth = min(NVME_IO_QUEUE_DEPTH, NVME_CAP_MQES(AdapterExtension->Capabilities) + 1);
+
+    queueSize = ROUND_TO_PAGES(ioDepth * sizeof(NVME_COMMAND)) +
+                ROUND_TO_PAGES(ioDepth * sizeof(NVME_COMPLETION)) +
+                ROUND_TO_PAGES(ioDepth * NVME_PRP_LIST_SIZE);
+
+    // One spare page keeps the layout page aligned whatever storport gives us
+    length = NVME_PAGE_SIZE +
+             ROUND_TO_PAGES(NVME_ADMIN_QUEUE_DEPTH * sizeof(NVME_COMMAND)) +
+             ROUND_TO_PAGES(NVME_ADMIN_QUEUE_DEPTH * sizeof(NVME_COMPLETION)) +
+             sizeof(NVME_IDENTIFY_CONTROLLER) +
+             sizeof(NVME_IDENTIFY_NAMESPACE) +
+             AdapterExtension->IoQueueCount * queueSize;
+
+    AdapterExtension->UncachedExtension = StorPortGetUncachedExtension(AdapterExtension,
+                                                                       ConfigInfo,
+                                                                       length);
+    if (AdapterExtension->UncachedExtension == NULL)
+    {
+        DPRINT1("StorPortGetUncachedExtension(%lu) failed\n", length);
+        return FALSE;
+    }
+
+    AdapterExtension->UncachedExtensionSize = length;
+    RtlZeroMemory(AdapterExtension->UncachedExtension, length);
+
+    memory = (PUCHAR)ALIGN_UP_POINTER_BY(AdapterExtension->UncachedExtension, NVME_PAGE_SIZE);
+
+    if (!NvmeInitializeQueue(AdapterExtension,
+                             &AdapterExtension->AdminQueue,
+                             0,
+                             NVME_ADMIN_QUEUE_DEPTH,
+                             &memory))
+    {
+        return FALSE;
+    }
+
+    AdapterExtension->IdentifyController = (PNVME_IDENTIFY_CONTROLLER)memory;
+    AdapterExtension->IdentifyControllerPhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, memory, &length);
+    memory += sizeof(NVME_IDENTIFY_CONTROLLER);
+
+    AdapterExtension->IdentifyNamespace = (PNVME_IDENTIFY_NAMESPACE)memory;
+    AdapterExtension->IdentifyNamespacePhysical = StorPortGetPhysicalAddress(AdapterExtension, NULL, memory, &length);
+    memory += sizeof(NVME_IDENTIFY_NAMESPACE);
+
+    for (index = 0; index < AdapterExtension->IoQueueCount; index++)
+    {
+        if (!NvmeInitializeQueue(AdapterExtension,
+                                 &AdapterExtension->IoQueues[index],
+                                 (USHORT)(index + 1),
+                                 (USHORT)ioDepth,
+                                 &memory))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}// -- NvmeAllocateResourceForAdapter();
+
+/**
+ * @name NvmeSubmitCommand
+ * @implemented
+ *
+ * Copy a command into the submission queue and ring its doorbell.
+ * The caller holds the lock of the queue.
+ *
+ * @param AdapterExtension
+ * @param Queue
+ * @param Command
+ */
+static
+VOID
+NvmeSubmitCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_QUEUE Queue,
+    __in PNVME_COMMAND Command
+    )
+{
+    StorPortCopyMemory(&Queue->SubmissionQueue[Queue->SubmissionTail], Command, sizeof(NVME_COMMAND));
+
+    if (++Queue->SubmissionTail == Queue->Depth)
+        Queue->SubmissionTail = 0;
+
+    StorPortWriteRegisterUlong(AdapterExtension, Queue->SubmissionDoorbell, Queue->SubmissionTail);
+}// -- NvmeSubmitCommand();
+
+/**
+ * @name NvmeTranslateStatus
+ * @implemented
+ *
+ * Map an NVMe completion status onto an SRB status
+ *
+ * @param Srb
+ * @param Status
+ *
+ * @return
+ * SRB status of the request
+ */
+static
+UCHAR
+NvmeTranslateStatus (
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in USHORT Status
+    )
+{
+    if ((Status & NVME_STATUS_MASK) == 0)
+    {
+        Srb->ScsiStatus = SCSISTAT_GOOD;
+        return SRB_STATUS_SUCCESS;
+    }
+
+    // Status code type in bits 11:9, status code in bits 8:1
+    DPRINT1("Command failed, SCT %x SC %02x\n", (Status >> 9) & 0x7, (Status >> 1) & 0xFF);
+
+    Srb->ScsiStatus = SCSISTAT_CHECK_CONDITION;
+    Srb->DataTransferLength = 0;
+    return SRB_STATUS_ERROR;
+}// -- NvmeTranslateStatus();
+
+/**
+ * @name NvmeProcessCompletions
+ * @implemented
+ *
+ * Consume every new entry of a completion queue and complete its requests.
+ * Called from the interrupt routine of the queue, or under its lock.
+ *
+ * @param AdapterExtension
+ * @param Queue
+ *
+ * @return
+ * TRUE if at least one entry was consumed
+ */
+BOOLEAN
+NvmeProcessCompletions (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_QUEUE Queue
+    )
+{
+    PNVME_COMPLETION entry;
+    PSCSI_REQUEST_BLOCK srb;
+    USHORT status, commandId;
+    BOOLEAN found = FALSE;
+
+    if (Queue->CompletionQueue == NULL)
+        return FALSE;
+
+    for (;;)
+    {
+        entry = &Queue->CompletionQueue[Queue->CompletionHead];
+        status = *(volatile USHORT *)&entry->Status;
+
+        // Entries the controller has not written yet still carry the old phase
+        if ((status & NVME_STATUS_PHASE) != Queue->CompletionPhase)
+            break;
+
+        found = TRUE;
+        commandId = entry->CommandId;
+
+        if (Queue->QueueId == 0)
+        {
+            AdapterExtension->AdminCompletion = *entry;
+            AdapterExtension->AdminCompleted = TRUE;
+        }
+        else if (commandId < Queue->Depth && Queue->Requests[commandId] != NULL)
+        {
+            srb = Queue->Requests[commandId];
+            Queue->Requests[commandId] = NULL;
+            Queue->Outstanding--;
+
+            srb->SrbStatus = NvmeTranslateStatus(srb, status);
+            StorPortNotification(RequestComplete, AdapterExtension, srb);
+        }
+        else
+        {
+            DPRINT1("Spurious completion %u on queue %u\n", commandId, Queue->QueueId);
+        }
+
+        if (++Queue->CompletionHead == Queue->Depth)
+        {
+            Queue->CompletionHead = 0;
+            Queue->CompletionPhase ^= 1;
+        }
+    }
+
+    if (found)
+    {
+        StorPortWriteRegisterUlong(AdapterExtension, Queue->CompletionDoorbell, Queue->CompletionHead);
+    }
+
+    return found;
+}// -- NvmeProcessCompletions();
+
+static
+BOOLEAN
+NTAPI
+NvmePollAdminQueue (
+    __in PVOID DeviceExtension,
+    __in PVOID Context
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    NvmeProcessCompletions(adapterExtension, &adapterExtension->AdminQueue);
+    return adapterExtension->AdminCompleted;
+}
+
+/**
+ * @name NvmeAdminCommand
+ * @implemented
+ *
+ * Issue an admin command and poll for its completion. Admin commands are
+ * only sent from initialization, one at a time; the completion may also be
+ * consumed by the interrupt routine of message 0.
+ *
+ * @param AdapterExtension
+ * @param Command
+ * @param Completion
+ *
+ * @return
+ * TRUE if the command completed successfully
+ */
+BOOLEAN
+NvmeAdminCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __inout PNVME_COMMAND Command,
+    __out_opt PNVME_COMPLETION Completion
+    )
+{
+    PNVME_QUEUE queue;
+    ULONG ticks;
+
+    queue = &AdapterExtension->AdminQueue;
+
+    Command->CommandId = queue->NextCommandId++;
+    AdapterExtension->AdminCompleted = FALSE;
+
+    NvmeSubmitCommand(AdapterExtension, queue, Command);
+
+    for (ticks = 0; ticks < AdapterExtension->ReadyTimeout * 100; ticks++)
+    {
+        StorPortSynchronizeAccess(AdapterExtension, NvmePollAdminQueue, NULL);
+        if (AdapterExtension->AdminCompleted)
+            break;
+
+        StorPortStallExecution(10);
+    }
+
+    if (!AdapterExtension->AdminCompleted)
+    {
+        DPRINT1("Admin command %02x timed out\n", Command->Opcode);
+        return FALSE;
+    }
+
+    if (Completion != NULL)
+        *Completion = AdapterExtension->AdminCompletion;
+
+    if ((AdapterExtension->AdminCompletion.Status & NVME_STATUS_MASK) != 0)
+    {
+        DPRINT1("Admin command %02x failed, status %04x\n",
+                Command->Opcode, AdapterExtension->AdminCompletion.Status);
+        return FALSE;
+    }
+
+    return TRUE;
+}// -- NvmeAdminCommand();
+
+/**
+ * @name NvmeIdentify
+ * @implemented
+ *
+ * Read the identify controller data and the namespace the disk is exposed from
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * TRUE if the controller has a usable namespace
+ */
+static
+BOOLEAN
+NvmeIdentify (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    PNVME_IDENTIFY_CONTROLLER identifyController;
+    PNVME_IDENTIFY_NAMESPACE identifyNamespace;
+    NVME_COMMAND command;
+    ULONG maxTransfer;
+
+    identifyController = AdapterExtension->IdentifyController;
+    identifyNamespace = AdapterExtension->IdentifyNamespace;
+
+    RtlZeroMemory(&command, sizeof(command));
+    command.Opcode = NVME_ADMIN_IDENTIFY;
+    command.Prp1 = AdapterExtension->IdentifyControllerPhysical.QuadPart;
+    command.Cdw10 = NVME_IDENTIFY_CONTROLLER;
+
+    if (!NvmeAdminCommand(AdapterExtension, &command, NULL))
+        return FALSE;
+
+    if (identifyController->NumberOfNamespaces == 0)
+    {
+        DPRINT1("Controller has no namespace\n");
+        return FALSE;
+    }
+
+    AdapterExtension->NamespaceId = NVME_DEFAULT_NAMESPACE;
+    AdapterExtension->VolatileWriteCache = (identifyController->VolatileWriteCache & 1) != 0;
+
+    // MDTS is a power of two in units of the minimum page size, 0 means no limit
+    maxTransfer = MAXIMUM_TRANSFER_LENGTH;
+    if (identifyController->MaximumDataTransferSize != 0 &&
+        identifyController->MaximumDataTransferSize < 16)
+    {
+        maxTransfer = min(maxTransfer, NVME_PAGE_SIZE << identifyController->MaximumDataTransferSize);
+    }
+    AdapterExtension->MaximumTransferLength = maxTransfer;
+
+    RtlZeroMemory(&command, sizeof(command));
+    command.Opcode = NVME_ADMIN_IDENTIFY;
+    command.NamespaceId = AdapterExtension->NamespaceId;
+    command.Prp1 = AdapterExtension->IdentifyNamespacePhysical.QuadPart;
+    command.Cdw10 = NVME_IDENTIFY_NAMESPACE;
+
+    if (!NvmeAdminCommand(AdapterExtension, &command, NULL))
+        return FALSE;
+
+    AdapterExtension->BlockCount = identifyNamespace->Size;
+    AdapterExtension->BlockShift = identifyNamespace->LbaFormat[identifyNamespace->FormattedLbaSize & 0xF].DataSizeShift;
+
+    if (AdapterExtension->BlockCount == 0 ||
+        AdapterExtension->BlockShift < 9 ||
+        AdapterExtension->BlockShift > NVME_PAGE_SHIFT)
+    {
+        DPRINT1("Unusable namespace: %I64u blocks, shift %lu\n",
+                AdapterExtension->BlockCount, AdapterExtension->BlockShift);
+        return FALSE;
+    }
+
+    AdapterExtension->BlockSize = 1 << AdapterExtension->BlockShift;
+
+    DPRINT1("Namespace %lu: %I64u blocks of %lu bytes, write cache %d, max transfer %lu\n",
+            AdapterExtension->NamespaceId,
+            AdapterExtension->BlockCount,
+            AdapterExtension->BlockSize,
+            AdapterExtension->VolatileWriteCache,
+            AdapterExtension->MaximumTransferLength);
+
+    return TRUE;
+}// -- NvmeIdentify();
+
+/**
+ * @name NvmeCreateIoQueues
+ * @implemented
+ *
+ * Negotiate the number of I/O queues and create one queue pair per processor,
+ * each completion queue on its own message when enough messages are granted
+ *
+ * @param AdapterExtension
+ *
+ * @return
+ * TRUE if at least one I/O queue pair exists
+ */
+static
+BOOLEAN
+NvmeCreateIoQueues (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension
+    )
+{
+    MESSAGE_INTERRUPT_INFORMATION messageInfo;
+    NVME_COMPLETION completion;
+    NVME_COMMAND command;
+    PNVME_QUEUE queue;
+    ULONG index, granted, queueCount;
+
+    // Count the messages storport connected for us
+    AdapterExtension->MessageCount = 0;
+    while (AdapterExtension->MessageCount < NVME_MAX_IO_QUEUES + 1 &&
+           StorPortGetMSIInfo(AdapterExtension,
+                              AdapterExtension->MessageCount,
+                              &messageInfo) == STOR_STATUS_SUCCESS)
+    {
+        AdapterExtension->MessageCount++;
+    }
+
+    queueCount = AdapterExtension->IoQueueCount;
+
+    // Message 0 serves the admin queue, every I/O queue wants one of its own
+    if (AdapterExtension->MessageCount > 1)
+        queueCount = min(queueCount, AdapterExtension->MessageCount - 1);
+
+    RtlZeroMemory(&command, sizeof(command));
+    command.Opcode = NVME_ADMIN_SET_FEATURES;
+    command.Cdw10 = NVME_FEATURE_NUMBER_OF_QUEUES;
+    command.Cdw11 = (queueCount - 1) | ((queueCount - 1) << 16);
+
+    if (!NvmeAdminCommand(AdapterExtension, &command, &completion))
+        return FALSE;
+
+    granted = min((completion.Result & 0xFFFF), (completion.Result >> 16)) + 1;
+    queueCount = min(queueCount, granted);
+
+    DPRINT1("%lu messages, %lu I/O queues (%lu granted)\n",
+            AdapterExtension->MessageCount, queueCount, granted);
+
+    for (index = 0; index < queueCount; index++)
+    {
+        queue = &AdapterExtension->IoQueues[index];
+        queue->MessageId = (AdapterExtension->MessageCount > 1) ? index + 1 : 0;
+
+        RtlZeroMemory(&command, sizeof(command));
+        command.Opcode = NVME_ADMIN_CREATE_CQ;
+        command.Prp1 = queue->CompletionQueuePhysical.QuadPart;
+        command.Cdw10 = queue->QueueId | ((queue->Depth - 1) << 16);
+        command.Cdw11 = NVME_QUEUE_PHYS_CONTIG | NVME_CQ_IRQ_ENABLED | (queue->MessageId << 16);
+
+        if (!NvmeAdminCommand(AdapterExtension, &command, NULL))
+            break;
+
+        RtlZeroMemory(&command, sizeof(command));
+        command.Opcode = NVME_ADMIN_CREATE_SQ;
+        command.Prp1 = queue->SubmissionQueuePhysical.QuadPart;
+        command.Cdw10 = queue->QueueId | ((queue->Depth - 1) << 16);
+        command.Cdw11 = NVME_QUEUE_PHYS_CONTIG | (queue->QueueId << 16);
+
+        if (!NvmeAdminCommand(AdapterExtension, &command, NULL))
+        {
+            RtlZeroMemory(&command, sizeof(command));
+            command.Opcode = NVME_ADMIN_DELETE_CQ;
+            command.Cdw10 = queue->QueueId;
+            NvmeAdminCommand(AdapterExtension, &command, NULL);
+            break;
+        }
+    }
+
+    AdapterExtension->IoQueueCount = index;
+
+    // Spread the processors over the queues until the interrupts tell us better
+    for (index = 0; index < NVME_MAX_PROCESSORS; index++)
+    {
+        AdapterExtension->ProcessorQueue[index] = (UCHAR)(index % max(AdapterExtension->IoQueueCount, 1));
+    }
+
+    return (AdapterExtension->IoQueueCount != 0);
+}// -- NvmeCreateIoQueues();
+
+/**
+ * @name NvmeHwPassiveInitialize
+ * @implemented
+ *
+ * Create the I/O queues once storport connected the interrupts
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE if the I/O queues were created
+ */
+BOOLEAN
+NvmeHwPassiveInitialize (
+    __in PVOID DeviceExtension
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+
+    DPRINT("NvmeHwPassiveInitialize()\n");
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    if (!NvmeCreateIoQueues(adapterExtension))
+    {
+        DPRINT1("Failed to create the I/O queues\n");
+        return FALSE;
+    }
+
+    adapterExtension->StateFlags.Initialized = 1;
+    return TRUE;
+}// -- NvmeHwPassiveInitialize();
+
+/**
+ * @name NvmeHwInitialize
+ * @implemented
+ *
+ * Queue creation needs to wait for completions, so it is deferred to
+ * passive initialization
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE if intialization was successful
+ */
+BOOLEAN
+NTAPI
+NvmeHwInitialize (
+    __in PVOID DeviceExtension
+    )
+{
+    DPRINT("NvmeHwInitialize()\n");
+
+    return StorPortEnablePassiveInitialization(DeviceExtension, NvmeHwPassiveInitialize);
+}// -- NvmeHwInitialize();
+
+/**
+ * @name NvmeHwMessageInterrupt
+ * @implemented
+ *
+ * Interrupt routine of one MSI-X message. Message 0 also serves the admin queue.
+ * The processor the message arrives on is remembered, so that later requests
+ * from that processor go to the queue whose completions are delivered locally.
+ *
+ * @param DeviceExtension
+ * @param MessageId
+ *
+ * @return
+ * return TRUE if the interrupt was for this controller
+ */
+BOOLEAN
+NTAPI
+NvmeHwMessageInterrupt (
+    __in PVOID DeviceExtension,
+    __in ULONG MessageId
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    PROCESSOR_NUMBER processor;
+    PNVME_QUEUE queue;
+    BOOLEAN found = FALSE;
+    ULONG index;
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    if (adapterExtension->StateFlags.Removed)
+        return FALSE;
+
+    if (MessageId == 0)
+        found = NvmeProcessCompletions(adapterExtension, &adapterExtension->AdminQueue);
+
+    for (index = 0; index < adapterExtension->IoQueueCount; index++)
+    {
+        queue = &adapterExtension->IoQueues[index];
+        if (queue->MessageId != MessageId)
+            continue;
+
+        if (NvmeProcessCompletions(adapterExtension, queue))
+        {
+            found = TRUE;
+
+            if (MessageId != 0 &&
+                StorPortGetCurrentProcessorNumber(adapterExtension, &processor) == STOR_STATUS_SUCCESS &&
+                processor.Number < NVME_MAX_PROCESSORS)
+            {
+                adapterExtension->ProcessorQueue[processor.Number] = (UCHAR)index;
+            }
+        }
+    }
+
+    return found;
+}// -- NvmeHwMessageInterrupt();
+
+/**
+ * @name NvmeHwInterrupt
+ * @implemented
+ *
+ * Line based interrupt routine; every queue shares the one interrupt
+ *
+ * @param DeviceExtension
+ *
+ * @return
+ * return TRUE if the interrupt was for this controller
+ */
+BOOLEAN
+NTAPI
+NvmeHwInterrupt (
+    __in PVOID DeviceExtension
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    BOOLEAN found;
+    ULONG index;
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    if (adapterExtension->StateFlags.Removed)
+        return FALSE;
+
+    found = NvmeProcessCompletions(adapterExtension, &adapterExtension->AdminQueue);
+
+    for (index = 0; index < adapterExtension->IoQueueCount; index++)
+    {
+        found |= NvmeProcessCompletions(adapterExtension, &adapterExtension->IoQueues[index]);
+    }
+
+    return found;
+}// -- NvmeHwInterrupt();
+
+/**
+ * @name NvmeBuildPrp
+ * @implemented
+ *
+ * Describe a scatter/gather list with PRP entries. The first entry may start
+ * anywhere in a page, every following one must start on a page boundary.
+ * Two pages fit in the command itself, larger transfers use the PRP list
+ * that belongs to the command id.
+ *
+ * @param Queue
+ * @param CommandId
+ * @param Sgl
+ * @param Command
+ *
+ * @return
+ * FALSE if the buffer cannot be described with PRPs
+ */
+BOOLEAN
+NvmeBuildPrp (
+    __in PNVME_QUEUE Queue,
+    __in USHORT CommandId,
+    __in PSTOR_SCATTER_GATHER_LIST Sgl,
+    __inout PNVME_COMMAND Command
+    )
+{
+    PULONGLONG prpList;
+    ULONGLONG address;
+    ULONG index, length, chunk, count = 0;
+
+    prpList = (PULONGLONG)((PUCHAR)Queue->PrpLists + CommandId * NVME_PRP_LIST_SIZE);
+
+    for (index = 0; index < Sgl->NumberOfElements; index++)
+    {
+        address = Sgl->List[index].PhysicalAddress.QuadPart;
+        length = Sgl->List[index].Length;
+
+        // Only the first element may be offset, only the last one may end early
+        if ((index != 0 && (address & (NVME_PAGE_SIZE - 1)) != 0) ||
+            (index != Sgl->NumberOfElements - 1 && ((address + length) & (NVME_PAGE_SIZE - 1)) != 0))
+        {
+            DPRINT1("Element %lu (%I64x, %lu) is not PRP compatible\n", index, address, length);
+            return FALSE;
+        }
+
+        while (length != 0)
+        {
+            chunk = min(length, NVME_PAGE_SIZE - (ULONG)(address & (NVME_PAGE_SIZE - 1)));
+
+            if (count == 0)
+            {
+                Command->Prp1 = address;
+            }
+            else
+            {
+                if (count > NVME_PRP_LIST_ENTRIES)
+                {
+                    DPRINT1("Transfer needs more than %u PRP entries\n", NVME_PRP_LIST_ENTRIES + 1);
+                    return FALSE;
+                }
+
+                prpList[count - 1] = address;
+            }
+
+            count++;
+            address += chunk;
+            length -= chunk;
+        }
+    }
+
+    if (count <= 1)
+        Command->Prp2 = 0;
+    else if (count == 2)
+        Command->Prp2 = prpList[0];
+    else
+        Command->Prp2 = Queue->PrpListsPhysical.QuadPart + CommandId * NVME_PRP_LIST_SIZE;
+
+    return TRUE;
+}// -- NvmeBuildPrp();
+
+/**
+ * @name NvmeSubmitRequest
+ * @implemented
+ *
+ * Send an NVM command for the request on the queue of the current processor
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Command
+ * Command with every field but the command id and the PRPs filled in
+ *
+ * @return
+ * SRB_STATUS_PENDING if the command was issued
+ */
+UCHAR
+NvmeSubmitRequest (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __inout PNVME_COMMAND Command
+    )
+{
+    PSTOR_SCATTER_GATHER_LIST sgl = NULL;
+    PROCESSOR_NUMBER processor;
+    STOR_LOCK_HANDLE lockHandle;
+    PNVME_QUEUE queue;
+    ULONG oldIrql, index;
+    USHORT commandId;
+    UCHAR srbStatus;
+
+    if (AdapterExtension->StateFlags.Removed)
+        return SRB_STATUS_NO_DEVICE;
+
+    if (!AdapterExtension->StateFlags.Initialized)
+        return AdapterExtension->StateFlags.ShutDown ? SRB_STATUS_ERROR : SRB_STATUS_NO_DEVICE;
+
+    if (Srb->DataTransferLength != 0)
+    {
+        sgl = StorPortGetScatterGatherList(AdapterExtension, Srb);
+        if (sgl == NULL)
+            return SRB_STATUS_BUSY;
+    }
+
+    index = 0;
+    if (StorPortGetCurrentProcessorNumber(AdapterExtension, &processor) == STOR_STATUS_SUCCESS)
+    {
+        index = (processor.Number < NVME_MAX_PROCESSORS) ?
+                    AdapterExtension->ProcessorQueue[processor.Number] :
+                    processor.Number % AdapterExtension->IoQueueCount;
+    }
+    queue = &AdapterExtension->IoQueues[index];
+
+    // The interrupt routine of the queue consumes its completions
+    if (AdapterExtension->MessageCount != 0)
+        StorPortAcquireMSISpinLock(AdapterExtension, queue->MessageId, &oldIrql);
+    else
+        StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockHandle);
+
+    // One slot stays free so that a full queue cannot look empty
+    if (queue->Outstanding >= (ULONG)queue->Depth - 1)
+    {
+        srbStatus = SRB_STATUS_BUSY;
+        goto Release;
+    }
+
+    commandId = queue->NextCommandId;
+    while (queue->Requests[commandId] != NULL)
+    {
+        if (++commandId == queue->Depth)
+            commandId = 0;
+    }
+    queue->NextCommandId = (commandId + 1 == queue->Depth) ? 0 : commandId + 1;
+
+    Command->CommandId = commandId;
+    Command->NamespaceId = AdapterExtension->NamespaceId;
+
+    if (sgl != NULL && !NvmeBuildPrp(queue, commandId, sgl, Command))
+    {
+        srbStatus = SRB_STATUS_INVALID_REQUEST;
+        goto Release;
+    }
+
+    queue->Requests[commandId] = Srb;
+    queue->Outstanding++;
+
+    NvmeSubmitCommand(AdapterExtension, queue, Command);
+    srbStatus = SRB_STATUS_PENDING;
+
+Release:
+    if (AdapterExtension->MessageCount != 0)
+        StorPortReleaseMSISpinLock(AdapterExtension, queue->MessageId, oldIrql);
+    else
+        StorPortReleaseSpinLock(AdapterExtension, &lockHandle);
+
+    return srbStatus;
+}// -- NvmeSubmitRequest();
+
+/**
+ * @name NvmeHwStartIo
+ * @implemented
+ *
+ * Translate a SCSI request into an NVM command or answer it from the identify data
+ *
+ * @param DeviceExtension
+ * @param Srb
+ *
+ * @return
+ * return TRUE if the request was accepted
+ */
+BOOLEAN
+NTAPI
+NvmeHwStartIo (
+    __in PVOID DeviceExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    PCDB cdb;
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_EXECUTE_SCSI:
+            if (Srb->PathId != 0 || Srb->TargetId != 0 || Srb->Lun != 0)
+            {
+                Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+                break;
+            }
+
+            cdb = (PCDB)&Srb->Cdb;
+            if (Srb->CdbLength == 0)
+            {
+                Srb->SrbStatus = SRB_STATUS_BAD_FUNCTION;
+                break;
+            }
+
+            switch (cdb->CDB10.OperationCode)
+            {
+                case SCSIOP_INQUIRY:
+                    Srb->SrbStatus = DeviceInquiryRequest(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_REPORT_LUNS:
+                    Srb->SrbStatus = DeviceReportLuns(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_READ_CAPACITY:
+                case SCSIOP_READ_CAPACITY16:
+                    Srb->SrbStatus = DeviceRequestCapacity(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_MODE_SENSE:
+                case SCSIOP_MODE_SENSE10:
+                    Srb->SrbStatus = DeviceRequestSense(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_READ6:
+                case SCSIOP_WRITE6:
+                case SCSIOP_READ:
+                case SCSIOP_WRITE:
+                case SCSIOP_READ12:
+                case SCSIOP_WRITE12:
+                case SCSIOP_READ16:
+                case SCSIOP_WRITE16:
+                    Srb->SrbStatus = DeviceRequestReadWrite(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_SYNCHRONIZE_CACHE:
+                case SCSIOP_SYNCHRONIZE_CACHE16:
+                    Srb->SrbStatus = DeviceRequestFlush(adapterExtension, Srb, cdb);
+                    break;
+                case SCSIOP_TEST_UNIT_READY:
+                case SCSIOP_START_STOP_UNIT:
+                case SCSIOP_VERIFY:
+                case SCSIOP_VERIFY16:
+                    Srb->ScsiStatus = SCSISTAT_GOOD;
+                    Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                    break;
+                default:
+                    DPRINT("Unsupported OperationCode %02x\n", cdb->CDB10.OperationCode);
+                    Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                    break;
+            }
+            break;
+
+        case SRB_FUNCTION_FLUSH:
+            Srb->SrbStatus = DeviceRequestFlush(adapterExtension, Srb, NULL);
+            break;
+
+        case SRB_FUNCTION_SHUTDOWN:
+            Srb->SrbStatus = DeviceRequestShutdown(adapterExtension, Srb);
+            break;
+
+        case SRB_FUNCTION_RESET_BUS:
+        case SRB_FUNCTION_RESET_DEVICE:
+        case SRB_FUNCTION_RESET_LOGICAL_UNIT:
+            // There is a single namespace, every reset is a controller reset
+            Srb->SrbStatus = NvmeHwResetBus(adapterExtension, Srb->PathId) ?
+                                 SRB_STATUS_SUCCESS : SRB_STATUS_ERROR;
+            break;
+
+        default:
+            DPRINT("Unknown function code %x\n", Srb->Function);
+            Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+            break;
+    }
+
+    if (Srb->SrbStatus != SRB_STATUS_PENDING)
+    {
+        StorPortNotification(RequestComplete, adapterExtension, Srb);
+    }
+
+    return TRUE;
+}// -- NvmeHwStartIo();
+
+/**
+ * @name NvmeHwResetBus
+ * @implemented
+ *
+ * Reset the controller. Disabling it drops every queue, so the outstanding
+ * requests are completed with SRB_STATUS_BUS_RESET before the admin and
+ * I/O queues are created again.
+ *
+ * @param DeviceExtension
+ * @param PathId
+ *
+ * @return
+ * return TRUE if the controller is usable again
+ */
+BOOLEAN
+NTAPI
+NvmeHwResetBus (
+    __in PVOID DeviceExtension,
+    __in ULONG PathId
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+
+    UNREFERENCED_PARAMETER(PathId);
+
+    DPRINT1("NvmeHwResetBus(%lu)\n", PathId);
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+    adapterExtension->StateFlags.Initialized = 0;
+
+    if (!NvmeDisableController(adapterExtension))
+    {
+        // A controller that does not go idle may still write to the queues
+        if (adapterExtension->StateFlags.Removed)
+        {
+            StorPortSynchronizeAccess(adapterExtension,
+                                      NvmeAbortRequests,
+                                      (PVOID)(ULONG_PTR)SRB_STATUS_NO_DEVICE);
+        }
+        return FALSE;
+    }
+
+    StorPortSynchronizeAccess(adapterExtension,
+                              NvmeAbortRequests,
+                              (PVOID)(ULONG_PTR)SRB_STATUS_BUS_RESET);
+
+    adapterExtension->StateFlags.ShutDown = 0;
+
+    if (!NvmeEnableController(adapterExtension) ||
+        !NvmeCreateIoQueues(adapterExtension))
+    {
+        DPRINT1("Controller did not come back after the reset\n");
+        return FALSE;
+    }
+
+    adapterExtension->StateFlags.Initialized = 1;
+    return TRUE;
+}// -- NvmeHwResetBus();
+
+/**
+ * @name NvmeHwAdapterControl
+ * @implemented
+ *
+ * Shut the controller down when the adapter is stopped, powered down or
+ * surprise removed
+ *
+ * @param DeviceExtension
+ * @param ControlType
+ * @param Parameters
+ *
+ * @return
+ * ScsiAdapterControlSuccess if the control type was handled
+ */
+SCSI_ADAPTER_CONTROL_STATUS
+NTAPI
+NvmeHwAdapterControl (
+    __in PVOID DeviceExtension,
+    __in SCSI_ADAPTER_CONTROL_TYPE ControlType,
+    __in PVOID Parameters
+    )
+{
+    PSCSI_SUPPORTED_CONTROL_TYPE_LIST supportedTypes;
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    ULONG index;
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+
+    switch (ControlType)
+    {
+        case ScsiQuerySupportedControlTypes:
+            supportedTypes = (PSCSI_SUPPORTED_CONTROL_TYPE_LIST)Parameters;
+            for (index = 0; index < supportedTypes->MaxControlType; index++)
+            {
+                supportedTypes->SupportedTypeList[index] = (index == ScsiQuerySupportedControlTypes ||
+                                                            index == ScsiStopAdapter);
+            }
+            return ScsiAdapterControlSuccess;
+
+        case ScsiStopAdapter:
+            DPRINT1("NvmeHwAdapterControl(ScsiStopAdapter)\n");
+            adapterExtension->StateFlags.Initialized = 0;
+
+            if (NvmeReadRegister(adapterExtension, NVME_REG_CSTS) == (ULONG)-1)
+                adapterExtension->StateFlags.Removed = 1;
+
+            if (!adapterExtension->StateFlags.Removed)
+                NvmeShutdownController(adapterExtension);
+
+            // Nothing completes the requests still owned by a stopped or missing controller
+            if (adapterExtension->StateFlags.Removed || NvmeOutstandingRequests(adapterExtension) != 0)
+            {
+                StorPortSynchronizeAccess(adapterExtension,
+                                          NvmeAbortRequests,
+                                          (PVOID)(ULONG_PTR)(adapterExtension->StateFlags.Removed ?
+                                                             SRB_STATUS_NO_DEVICE : SRB_STATUS_ABORTED));
+            }
+            return ScsiAdapterControlSuccess;
+
+        default:
+            return ScsiAdapterControlUnsuccessful;
+    }
+}// -- NvmeHwAdapterControl();
+
+/**
+ * @name NvmeHwFindAdapter
+ * @implemented
+ *
+ * Map the controller registers, reset and enable the controller with an
+ * admin queue and identify the namespace. I/O queues are created once
+ * interrupts are connected.
+ *
+ * @param DeviceExtension
+ * @param HwContext
+ * @param BusInformation
+ * @param ArgumentString
+ * @param ConfigInfo
+ * @param Reserved3
+ *
+ * @return
+ * SP_RETURN_FOUND if the controller was initialized
+ */
+ULONG
+NTAPI
+NvmeHwFindAdapter (
+    __in PVOID DeviceExtension,
+    __in PVOID HwContext,
+    __in PVOID BusInformation,
+    __in PCHAR ArgumentString,
+    __inout PPORT_CONFIGURATION_INFORMATION ConfigInfo,
+    __in PBOOLEAN Reserved3
+    )
+{
+    PNVME_ADAPTER_EXTENSION adapterExtension;
+    PCI_COMMON_CONFIG pciConfigData;
+    ACCESS_RANGE *accessRange;
+    ULONGLONG barAddress;
+    ULONG pciLength, index;
+
+    UNREFERENCED_PARAMETER(HwContext);
+    UNREFERENCED_PARAMETER(BusInformation);
+    UNREFERENCED_PARAMETER(ArgumentString);
+    UNREFERENCED_PARAMETER(Reserved3);
+
+    DPRINT("NvmeHwFindAdapter()\n");
+
+    adapterExtension = (PNVME_ADAPTER_EXTENSION)DeviceExtension;
+    adapterExtension->SlotNumber = ConfigInfo->SlotNumber;
+    adapterExtension->SystemIoBusNumber = ConfigInfo->SystemIoBusNumber;
+
+    pciLength = StorPortGetBusData(adapterExtension,
+                                   PCIConfiguration,
+                                   adapterExtension->SystemIoBusNumber,
+                                   adapterExtension->SlotNumber,
+                                   &pciConfigData,
+                                   sizeof(PCI_COMMON_CONFIG));
+    if (pciLength != sizeof(PCI_COMMON_CONFIG))
+    {
+        DPRINT1("StorPortGetBusData() returned %lu\n", pciLength);
+        return SP_RETURN_ERROR;
+    }
+
+    if (pciConfigData.BaseClass != PCI_CLASS_MASS_STORAGE_CTLR ||
+        pciConfigData.SubClass != PCI_SUBCLASS_MSC_NVM_CTLR ||
+        pciConfigData.ProgIf != PCI_PROGRAMMING_INTERFACE_NVME)
+    {
+        return SP_RETURN_NOT_FOUND;
+    }
+
+    adapterExtension->VendorID = pciConfigData.VendorID;
+    adapterExtension->DeviceID = pciConfigData.DeviceID;
+
+    // BAR0, with BAR1 as the upper half when it is a 64-bit BAR
+    barAddress = pciConfigData.u.type0.BaseAddresses[0] & ~0xFULL;
+    if ((pciConfigData.u.type0.BaseAddresses[0] & 0x6) == 0x4)
+        barAddress |= (ULONGLONG)pciConfigData.u.type0.BaseAddresses[1] << 32;
+
+    accessRange = *ConfigInfo->AccessRanges;
+    for (index = 0; index < ConfigInfo->NumberOfAccessRanges; index++)
+    {
+        if ((ULONGLONG)accessRange[index].RangeStart.QuadPart == barAddress)
+        {
+            adapterExtension->Registers = StorPortGetDeviceBase(adapterExtension,
+                                                                ConfigInfo->AdapterInterfaceType,
+                                                                ConfigInfo->SystemIoBusNumber,
+                                                                accessRange[index].RangeStart,
+                                                                accessRange[index].RangeLength,
+                                                                !accessRange[index].RangeInMemory);
+            break;
+        }
+    }
+
+    if (adapterExtension->Registers == NULL)
+    {
+        DPRINT1("Controller registers at %I64x are not mapped\n", barAddress);
+        return SP_RETURN_ERROR;
+    }
+
+    adapterExtension->Capabilities = NvmeReadRegister(adapterExtension, NVME_REG_CAP) |
+                                     ((ULONGLONG)NvmeReadRegister(adapterExtension, NVME_REG_CAP + 4) << 32);
+    adapterExtension->Version = NvmeReadRegister(adapterExtension, NVME_REG_VS);
+    adapterExtension->DoorbellStride = 4 << NVME_CAP_DSTRD(adapterExtension->Capabilities);
+    adapterExtension->ReadyTimeout = max(NVME_CAP_TO(adapterExtension->Capabilities), 1) * 500;
+
+    DPRINT1("NVMe %lu.%lu controller %04x:%04x, CAP %I64x\n",
+            adapterExtension->Version >> 16,
+            (adapterExtension->Version >> 8) & 0xFF,
+            adapterExtension->VendorID,
+            adapterExtension->DeviceID,
+            adapterExtension->Capabilities);
+
+    if (NVME_CAP_MPSMIN(adapterExtension->Capabilities) != 0)
+    {
+        DPRINT1("Controller does not support %u byte pages\n", NVME_PAGE_SIZE);
+        return SP_RETURN_ERROR;
+    }
+
+    // Reset the controller before handing it new queues
+    if (!NvmeDisableController(adapterExtension))
+        return SP_RETURN_ERROR;
+
+    if (!NvmeAllocateResourceForAdapter(adapterExtension, ConfigInfo))
+        return SP_RETURN_ERROR;
+
+    if (!NvmeEnableController(adapterExtension))
+        return SP_RETURN_ERROR;
+
+    if (!NvmeIdentify(adapterExtension))
+        return SP_RETURN_NOT_FOUND;
+
+    ConfigInfo->Master = TRUE;
+    ConfigInfo->AlignmentMask = 0x3;
+    ConfigInfo->ScatterGather = TRUE;
+    ConfigInfo->DmaWidth = Width32Bits;
+    ConfigInfo->WmiDataProvider = FALSE;
+    ConfigInfo->Dma32BitAddresses = TRUE;
+    ConfigInfo->Dma64BitAddresses = TRUE;
+    ConfigInfo->CachesData = adapterExtension->VolatileWriteCache;
+    ConfigInfo->MaximumNumberOfTargets = 1;
+    ConfigInfo->MaximumNumberOfLogicalUnits = 1;
+    ConfigInfo->NumberOfBuses = 1;
+    ConfigInfo->MaximumTransferLength = adapterExtension->MaximumTransferLength;
+    ConfigInfo->NumberOfPhysicalBreaks = adapterExtension->MaximumTransferLength / NVME_PAGE_SIZE;
+    ConfigInfo->SynchronizationModel = StorSynchronizeFullDuplex;
+    ConfigInfo->HwMSInterruptRoutine = NvmeHwMessageInterrupt;
+    ConfigInfo->InterruptSynchronizationMode = InterruptSynchronizePerMessage;
+
+    return SP_RETURN_FOUND;
+}// -- NvmeHwFindAdapter();
+
+/**
+ * @name DriverEntry
+ * @implemented
+ *
+ * Initial Entrypoint for stornvme miniport driver
+ *
+ * @param DriverObject
+ * @param RegistryPath
+ *
+ * @return
+ * NT_STATUS in case of driver loaded successfully.
+ */
+ULONG
+NTAPI
+DriverEntry (
+    __in PVOID DriverObject,
+    __in PVOID RegistryPath
+    )
+{
+    HW_INITIALIZATION_DATA hwInitializationData = {0};
+    ULONG status;
+
+    hwInitializationData.HwInitializationDataSize = sizeof(HW_INITIALIZATION_DATA);
+
+    hwInitializationData.HwStartIo = NvmeHwStartIo;
+    hwInitializationData.HwResetBus = NvmeHwResetBus;
+    hwInitializationData.HwInterrupt = NvmeHwInterrupt;
+    hwInitializationData.HwInitialize = NvmeHwInitialize;
+    hwInitializationData.HwFindAdapter = NvmeHwFindAdapter;
+    hwInitializationData.HwAdapterControl = NvmeHwAdapterControl;
+
+    hwInitializationData.TaggedQueuing = TRUE;
+    hwInitializationData.AutoRequestSense = TRUE;
+    hwInitializationData.MultipleRequestPerLu = TRUE;
+    hwInitializationData.NeedPhysicalAddresses = TRUE;
+
+    hwInitializationData.NumberOfAccessRanges = 6;
+    hwInitializationData.AdapterInterfaceType = PCIBus;
+    hwInitializationData.MapBuffers = STOR_MAP_NON_READ_WRITE_BUFFERS;
+
+    // Commands live in the PRP lists of the queues, requests need no extension
+    hwInitializationData.SrbExtensionSize = 0;
+    hwInitializationData.DeviceExtensionSize = sizeof(NVME_ADAPTER_EXTENSION);
+
+    status = StorPortInitialize(DriverObject,
+                                RegistryPath,
+                                &hwInitializationData,
+                                NULL);
+
+    NT_ASSERT(status == STATUS_SUCCESS);
+    return status;
+}// -- DriverEntry();
+
+/**
+ * @name DeviceRequestReadWrite
+ * @implemented
+ *
+ * Handle the READ and WRITE OperationCodes of every CDB size
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceRequestReadWrite
+ */
+UCHAR
+DeviceRequestReadWrite (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    NVME_COMMAND command;
+    ULONGLONG lba = 0;
+    ULONG blocks = 0;
+    BOOLEAN isWrite, fua = FALSE;
+
+    switch (Cdb->CDB10.OperationCode)
+    {
+        case SCSIOP_READ6:
+        case SCSIOP_WRITE6:
+            lba = ((ULONG)Cdb->CDB6READWRITE.LogicalBlockMsb1 << 16) |
+                  ((ULONG)Cdb->CDB6READWRITE.LogicalBlockMsb0 << 8) |
+                  Cdb->CDB6READWRITE.LogicalBlockLsb;
+            blocks = Cdb->CDB6READWRITE.TransferBlocks;
+            if (blocks == 0)
+                blocks = 256;
+            break;
+
+        case SCSIOP_READ:
+        case SCSIOP_WRITE:
+            lba = ((ULONG)Cdb->CDB10.LogicalBlockByte0 << 24) |
+                  ((ULONG)Cdb->CDB10.LogicalBlockByte1 << 16) |
+                  ((ULONG)Cdb->CDB10.LogicalBlockByte2 << 8) |
+                  Cdb->CDB10.LogicalBlockByte3;
+            blocks = ((ULONG)Cdb->CDB10.TransferBlocksMsb << 8) | Cdb->CDB10.TransferBlocksLsb;
+            fua = Cdb->CDB10.ForceUnitAccess;
+            break;
+
+        case SCSIOP_READ12:
+        case SCSIOP_WRITE12:
+            REVERSE_BYTES(&lba, Cdb->CDB12.LogicalBlock);
+            REVERSE_BYTES(&blocks, Cdb->CDB12.TransferLength);
+            fua = Cdb->CDB12.ForceUnitAccess;
+            break;
+
+        case SCSIOP_READ16:
+        case SCSIOP_WRITE16:
+            REVERSE_BYTES_QUAD(&lba, Cdb->CDB16.LogicalBlock);
+            REVERSE_BYTES(&blocks, Cdb->CDB16.TransferLength);
+            fua = Cdb->CDB16.ForceUnitAccess;
+            break;
+    }
+
+    isWrite = (Cdb->CDB10.OperationCode == SCSIOP_WRITE6 ||
+               Cdb->CDB10.OperationCode == SCSIOP_WRITE ||
+               Cdb->CDB10.OperationCode == SCSIOP_WRITE12 ||
+               Cdb->CDB10.OperationCode == SCSIOP_WRITE16);
+
+    if (blocks == 0)
+    {
+        Srb->ScsiStatus = SCSISTAT_GOOD;
+        return SRB_STATUS_SUCCESS;
+    }
+
+    if (lba >= AdapterExtension->BlockCount ||
+        blocks > AdapterExtension->BlockCount - lba ||
+        blocks > (AdapterExtension->MaximumTransferLength >> AdapterExtension->BlockShift) ||
+        Srb->DataTransferLength < (blocks << AdapterExtension->BlockShift))
+    {
+        DPRINT1("Invalid transfer: LBA %I64u, %lu blocks, %lu bytes\n",
+                lba, blocks, Srb->DataTransferLength);
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    RtlZeroMemory(&command, sizeof(command));
+    command.Opcode = isWrite ? NVME_CMD_WRITE : NVME_CMD_READ;
+    command.Cdw10 = (ULONG)lba;
+    command.Cdw11 = (ULONG)(lba >> 32);
+    command.Cdw12 = (blocks - 1) | (fua ? NVME_RW_FUA : 0);
+
+    return NvmeSubmitRequest(AdapterExtension, Srb, &command);
+}// -- DeviceRequestReadWrite();
+
+/**
+ * @name DeviceRequestFlush
+ * @implemented
+ *
+ * Handle SCSIOP_SYNCHRONIZE_CACHE, SRB_FUNCTION_FLUSH and SRB_FUNCTION_SHUTDOWN
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceRequestFlush
+ */
+UCHAR
+DeviceRequestFlush (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    NVME_COMMAND command;
+
+    UNREFERENCED_PARAMETER(Cdb);
+
+    // Without a volatile write cache every write is already durable
+    if (!AdapterExtension->VolatileWriteCache)
+    {
+        Srb->ScsiStatus = SCSISTAT_GOOD;
+        return SRB_STATUS_SUCCESS;
+    }
+
+    RtlZeroMemory(&command, sizeof(command));
+    command.Opcode = NVME_CMD_FLUSH;
+
+    return NvmeSubmitRequest(AdapterExtension, Srb, &command);
+}// -- DeviceRequestFlush();
+
+/**
+ * @name DeviceRequestShutdown
+ * @implemented
+ *
+ * Handle SRB_FUNCTION_SHUTDOWN with a normal controller shutdown, which also
+ * writes the volatile cache back. Later requests are failed.
+ *
+ * @param AdapterExtension
+ * @param Srb
+ *
+ * @return
+ * return STOR status for DeviceRequestShutdown
+ */
+UCHAR
+DeviceRequestShutdown (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    )
+{
+    if (AdapterExtension->StateFlags.Removed)
+        return SRB_STATUS_NO_DEVICE;
+
+    // The class driver retries once the outstanding requests completed
+    if (NvmeOutstandingRequests(AdapterExtension) != 0)
+        return SRB_STATUS_BUSY;
+
+    AdapterExtension->StateFlags.Initialized = 0;
+
+    if (!NvmeShutdownController(AdapterExtension))
+        return SRB_STATUS_ERROR;
+
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    return SRB_STATUS_SUCCESS;
+}// -- DeviceRequestShutdown();
+
+/**
+ * @name DeviceRequestCapacity
+ * @implemented
+ *
+ * Handle SCSIOP_READ_CAPACITY and SCSIOP_READ_CAPACITY16 OperationCodes
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceRequestCapacity
+ */
+UCHAR
+DeviceRequestCapacity (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    PREAD_CAPACITY_DATA_EX readCapacityEx;
+    PREAD_CAPACITY_DATA readCapacity;
+    ULONGLONG maxLba;
+    ULONG maxLba32, blockSize;
+
+    maxLba = AdapterExtension->BlockCount - 1;
+    blockSize = AdapterExtension->BlockSize;
+
+    if (Cdb->CDB10.OperationCode == SCSIOP_READ_CAPACITY)
+    {
+        if (Srb->DataTransferLength < sizeof(READ_CAPACITY_DATA))
+            return SRB_STATUS_DATA_OVERRUN;
+
+        // Larger disks report the maximum and expect READ CAPACITY (16)
+        maxLba32 = (maxLba > 0xFFFFFFFF) ? 0xFFFFFFFF : (ULONG)maxLba;
+
+        readCapacity = (PREAD_CAPACITY_DATA)Srb->DataBuffer;
+        REVERSE_BYTES(&readCapacity->LogicalBlockAddress, &maxLba32);
+        REVERSE_BYTES(&readCapacity->BytesPerBlock, &blockSize);
+        Srb->DataTransferLength = sizeof(READ_CAPACITY_DATA);
+    }
+    else
+    {
+        if (Cdb->READ_CAPACITY16.ServiceAction != SERVICE_ACTION_READ_CAPACITY16)
+            return SRB_STATUS_INVALID_REQUEST;
+
+        if (Srb->DataTransferLength < sizeof(READ_CAPACITY_DATA_EX))
+            return SRB_STATUS_DATA_OVERRUN;
+
+        readCapacityEx = (PREAD_CAPACITY_DATA_EX)Srb->DataBuffer;
+        REVERSE_BYTES_QUAD(&readCapacityEx->LogicalBlockAddress, &maxLba);
+        REVERSE_BYTES(&readCapacityEx->BytesPerBlock, &blockSize);
+        Srb->DataTransferLength = sizeof(READ_CAPACITY_DATA_EX);
+    }
+
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    return SRB_STATUS_SUCCESS;
+}// -- DeviceRequestCapacity();
+
+/**
+ * @name DeviceRequestSense
+ * @implemented
+ *
+ * Handle SCSIOP_MODE_SENSE and SCSIOP_MODE_SENSE10 OperationCodes.
+ * Only the header is returned; the disk is not write protected.
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceRequestSense
+ */
+UCHAR
+DeviceRequestSense (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    PMODE_PARAMETER_HEADER10 header10;
+    PMODE_PARAMETER_HEADER header;
+
+    UNREFERENCED_PARAMETER(AdapterExtension);
+
+    if (Cdb->CDB10.OperationCode == SCSIOP_MODE_SENSE)
+    {
+        if (Srb->DataTransferLength < sizeof(MODE_PARAMETER_HEADER))
+            return SRB_STATUS_DATA_OVERRUN;
+
+        header = (PMODE_PARAMETER_HEADER)Srb->DataBuffer;
+        RtlZeroMemory(header, sizeof(MODE_PARAMETER_HEADER));
+        header->ModeDataLength = sizeof(MODE_PARAMETER_HEADER) - 1;
+        Srb->DataTransferLength = sizeof(MODE_PARAMETER_HEADER);
+    }
+    else
+    {
+        if (Srb->DataTransferLength < sizeof(MODE_PARAMETER_HEADER10))
+            return SRB_STATUS_DATA_OVERRUN;
+
+        header10 = (PMODE_PARAMETER_HEADER10)Srb->DataBuffer;
+        RtlZeroMemory(header10, sizeof(MODE_PARAMETER_HEADER10));
+        header10->ModeDataLength[1] = sizeof(MODE_PARAMETER_HEADER10) - 2;
+        Srb->DataTransferLength = sizeof(MODE_PARAMETER_HEADER10);
+    }
+
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    return SRB_STATUS_SUCCESS;
+}// -- DeviceRequestSense();
+
+/**
+ * @name DeviceReportLuns
+ * @implemented
+ *
+ * Handle SCSIOP_REPORT_LUNS OperationCode; the namespace is LUN 0
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceReportLuns
+ */
+UCHAR
+DeviceReportLuns (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    PLUN_LIST lunList;
+    ULONG length;
+
+    UNREFERENCED_PARAMETER(AdapterExtension);
+    UNREFERENCED_PARAMETER(Cdb);
+
+    length = sizeof(LUN_LIST) + 8;
+    if (Srb->DataTransferLength < sizeof(LUN_LIST))
+        return SRB_STATUS_DATA_OVERRUN;
+
+    length = min(length, Srb->DataTransferLength);
+
+    lunList = (PLUN_LIST)Srb->DataBuffer;
+    RtlZeroMemory(lunList, length);
+    lunList->LunListLength[3] = 8;
+
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    Srb->DataTransferLength = length;
+    return SRB_STATUS_SUCCESS;
+}// -- DeviceReportLuns();
+
+/**
+ * @name DeviceInquiryRequest
+ * @implemented
+ *
+ * Handle SCSIOP_INQUIRY OperationCode from the identify controller data
+ *
+ * @param AdapterExtension
+ * @param Srb
+ * @param Cdb
+ *
+ * @return
+ * return STOR status for DeviceInquiryRequest
+ */
+UCHAR
+DeviceInquiryRequest (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    )
+{
+    PNVME_IDENTIFY_CONTROLLER identifyController;
+    PVPD_SUPPORTED_PAGES_PAGE supportedPages;
+    PVPD_SERIAL_NUMBER_PAGE serialPage;
+    UCHAR buffer[sizeof(INQUIRYDATA)];
+    PINQUIRYDATA inquiryData;
+    ULONG length;
+
+    identifyController = AdapterExtension->IdentifyController;
+    RtlZeroMemory(buffer, sizeof(buffer));
+
+    if (Cdb->CDB6INQUIRY3.EnableVitalProductData == 0)
+    {
+        inquiryData = (PINQUIRYDATA)buffer;
+        inquiryData->DeviceType = DIRECT_ACCESS_DEVICE;
+        inquiryData->Versions = 5;
+        inquiryData->ResponseDataFormat = 2;
+        inquiryData->CommandQueue = 1;
+        inquiryData->AdditionalLength = sizeof(INQUIRYDATA) - 5;
+
+        StorPortCopyMemory(inquiryData->VendorId, "NVMe    ", sizeof(inquiryData->VendorId));
+        StorPortCopyMemory(inquiryData->ProductId, identifyController->ModelNumber, sizeof(inquiryData->ProductId));
+        StorPortCopyMemory(inquiryData->ProductRevisionLevel, identifyController->FirmwareRevision, sizeof(inquiryData->ProductRevisionLevel));
+
+        length = sizeof(INQUIRYDATA);
+    }
+    else if (Cdb->CDB6INQUIRY3.PageCode == VPD_SUPPORTED_PAGES)
+    {
+        supportedPages = (PVPD_SUPPORTED_PAGES_PAGE)buffer;
+        supportedPages->DeviceType = DIRECT_ACCESS_DEVICE;
+        supportedPages->PageCode = VPD_SUPPORTED_PAGES;
+        supportedPages->PageLength = 2;
+        supportedPages->SupportedPageList[0] = VPD_SUPPORTED_PAGES;
+        supportedPages->SupportedPageList[1] = VPD_SERIAL_NUMBER;
+
+        length = sizeof(VPD_SUPPORTED_PAGES_PAGE) + 2;
+    }
+    else if (Cdb->CDB6INQUIRY3.PageCode == VPD_SERIAL_NUMBER)
+    {
+        serialPage = (PVPD_SERIAL_NUMBER_PAGE)buffer;
+        serialPage->DeviceType = DIRECT_ACCESS_DEVICE;
+        serialPage->PageCode = VPD_SERIAL_NUMBER;
+        serialPage->PageLength = sizeof(identifyController->SerialNumber);
+        StorPortCopyMemory(serialPage->SerialNumber,
+                           identifyController->SerialNumber,
+                           sizeof(identifyController->SerialNumber));
+
+        length = sizeof(VPD_SERIAL_NUMBER_PAGE) + sizeof(identifyController->SerialNumber);
+    }
+    else
+    {
+        return SRB_STATUS_INVALID_REQUEST;
+    }
+
+    length = min(length, Srb->DataTransferLength);
+    StorPortCopyMemory(Srb->DataBuffer, buffer, length);
+
+    Srb->ScsiStatus = SCSISTAT_GOOD;
+    Srb->DataTransferLength = length;
+    return SRB_STATUS_SUCCESS;
+}// -- DeviceInquiryRequest();
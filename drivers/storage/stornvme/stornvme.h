@@ -0,0 +1,352 @@
+/*
+ * PROJECT:     ReactOS NVMe Storport Miniport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     NVMe controller definitions and driver structures
+ * COPYRIGHT:   Copyright 2026 ReactOS Team
+ */
+
+#ifndef _STORNVME_H_
+#define _STORNVME_H_
+
+#include <ntddk.h>
+#include <storport.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#if defined(_MSC_VER)
+#pragma warning(disable:4201) // nameless struct/union
+#endif
+
+#define NVME_PAGE_SIZE                      4096
+#define NVME_PAGE_SHIFT                     12
+
+#define NVME_ADMIN_QUEUE_DEPTH              32
+#define NVME_IO_QUEUE_DEPTH                 64
+#define NVME_MAX_IO_QUEUES                  8
+#define NVME_MAX_PROCESSORS                 64
+
+#define MAXIMUM_TRANSFER_LENGTH             (128 * 1024)
+
+// One PRP list per command. A buffer that does not start on a page boundary
+// touches one page more than its length; PRP1 takes the first one.
+#define NVME_PRP_LIST_ENTRIES               (MAXIMUM_TRANSFER_LENGTH / NVME_PAGE_SIZE + 1)
+// Power of two stride, so that no list crosses a page boundary
+#define NVME_PRP_LIST_SIZE                  512
+
+#define NVME_DEFAULT_NAMESPACE              1
+
+// Controller registers (NVMe 1.2, section 3.1)
+#define NVME_REG_CAP                        0x0000
+#define NVME_REG_VS                         0x0008
+#define NVME_REG_INTMS                      0x000C
+#define NVME_REG_INTMC                      0x0010
+#define NVME_REG_CC                         0x0014
+#define NVME_REG_CSTS                       0x001C
+#define NVME_REG_AQA                        0x0024
+#define NVME_REG_ASQ                        0x0028
+#define NVME_REG_ACQ                        0x0030
+#define NVME_REG_DOORBELL                   0x1000
+
+#define NVME_CAP_MQES(cap)                  ((ULONG)((cap) & 0xFFFF))
+#define NVME_CAP_TO(cap)                    ((ULONG)(((cap) >> 24) & 0xFF))
+#define NVME_CAP_DSTRD(cap)                 ((ULONG)(((cap) >> 32) & 0xF))
+#define NVME_CAP_MPSMIN(cap)                ((ULONG)(((cap) >> 48) & 0xF))
+
+#define NVME_CC_EN                          (1 << 0)
+#define NVME_CC_CSS_NVM                     (0 << 4)
+#define NVME_CC_MPS(shift)                  (((shift) - 12) << 7)
+#define NVME_CC_AMS_RR                      (0 << 11)
+#define NVME_CC_SHN_NORMAL                  (1 << 14)
+#define NVME_CC_SHN_MASK                    (3 << 14)
+#define NVME_CC_IOSQES(shift)               ((shift) << 16)
+#define NVME_CC_IOCQES(shift)               ((shift) << 20)
+
+#define NVME_CSTS_RDY                       (1 << 0)
+#define NVME_CSTS_CFS                       (1 << 1)
+#define NVME_CSTS_SHST_MASK                 (3 << 2)
+#define NVME_CSTS_SHST_OCCURRING            (1 << 2)
+#define NVME_CSTS_SHST_COMPLETE             (2 << 2)
+
+// Admin command set opcodes
+#define NVME_ADMIN_DELETE_SQ                0x00
+#define NVME_ADMIN_CREATE_SQ                0x01
+#define NVME_ADMIN_DELETE_CQ                0x04
+#define NVME_ADMIN_CREATE_CQ                0x05
+#define NVME_ADMIN_IDENTIFY                 0x06
+#define NVME_ADMIN_SET_FEATURES             0x09
+
+// NVM command set opcodes
+#define NVME_CMD_FLUSH                      0x00
+#define NVME_CMD_WRITE                      0x01
+#define NVME_CMD_READ                       0x02
+
+#define NVME_IDENTIFY_NAMESPACE             0x00
+#define NVME_IDENTIFY_CONTROLLER            0x01
+
+#define NVME_FEATURE_NUMBER_OF_QUEUES       0x07
+
+#define NVME_QUEUE_PHYS_CONTIG              (1 << 0)
+#define NVME_CQ_IRQ_ENABLED                 (1 << 1)
+
+#define NVME_RW_FUA                         (1 << 30)
+
+// Completion status field, without the phase tag
+#define NVME_STATUS_PHASE                   0x0001
+#define NVME_STATUS_MASK                    0xFFFE
+
+// PCI class code of NVM Express controllers
+#define PCI_CLASS_MASS_STORAGE_CTLR         0x01
+#define PCI_SUBCLASS_MSC_NVM_CTLR           0x08
+#define PCI_PROGRAMMING_INTERFACE_NVME      0x02
+
+#include <pshpack1.h>
+
+typedef struct _NVME_COMMAND
+{
+    UCHAR Opcode;
+    UCHAR Flags;
+    USHORT CommandId;
+    ULONG NamespaceId;
+    ULONG Reserved[2];
+    ULONGLONG MetadataPointer;
+    ULONGLONG Prp1;
+    ULONGLONG Prp2;
+    ULONG Cdw10;
+    ULONG Cdw11;
+    ULONG Cdw12;
+    ULONG Cdw13;
+    ULONG Cdw14;
+    ULONG Cdw15;
+} NVME_COMMAND, *PNVME_COMMAND;
+
+typedef struct _NVME_COMPLETION
+{
+    ULONG Result;
+    ULONG Reserved;
+    USHORT SubmissionQueueHead;
+    USHORT SubmissionQueueId;
+    USHORT CommandId;
+    USHORT Status;
+} NVME_COMPLETION, *PNVME_COMPLETION;
+
+typedef struct _NVME_IDENTIFY_CONTROLLER
+{
+    USHORT VendorId;
+    USHORT SubsystemVendorId;
+    UCHAR SerialNumber[20];
+    UCHAR ModelNumber[40];
+    UCHAR FirmwareRevision[8];
+    UCHAR RecommendedArbitrationBurst;
+    UCHAR IeeeOui[3];
+    UCHAR MultiInterface;
+    UCHAR MaximumDataTransferSize;
+    UCHAR Reserved1[438];
+    UCHAR SubmissionQueueEntrySize;
+    UCHAR CompletionQueueEntrySize;
+    UCHAR Reserved2[2];
+    ULONG NumberOfNamespaces;
+    USHORT OptionalNvmCommands;
+    USHORT FusedOperations;
+    UCHAR FormatNvmAttributes;
+    UCHAR VolatileWriteCache;
+    UCHAR Reserved3[3570];
+} NVME_IDENTIFY_CONTROLLER, *PNVME_IDENTIFY_CONTROLLER;
+
+typedef struct _NVME_LBA_FORMAT
+{
+    USHORT MetadataSize;
+    UCHAR DataSizeShift;
+    UCHAR RelativePerformance;
+} NVME_LBA_FORMAT, *PNVME_LBA_FORMAT;
+
+typedef struct _NVME_IDENTIFY_NAMESPACE
+{
+    ULONGLONG Size;
+    ULONGLONG Capacity;
+    ULONGLONG Utilization;
+    UCHAR Features;
+    UCHAR NumberOfLbaFormats;
+    UCHAR FormattedLbaSize;
+    UCHAR Reserved1[101];
+    NVME_LBA_FORMAT LbaFormat[16];
+    UCHAR Reserved2[3904];
+} NVME_IDENTIFY_NAMESPACE, *PNVME_IDENTIFY_NAMESPACE;
+
+#include <poppack.h>
+
+C_ASSERT(sizeof(NVME_COMMAND) == 64);
+C_ASSERT(sizeof(NVME_COMPLETION) == 16);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, MaximumDataTransferSize) == 77);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, NumberOfNamespaces) == 516);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_CONTROLLER, VolatileWriteCache) == 525);
+C_ASSERT(sizeof(NVME_IDENTIFY_CONTROLLER) == NVME_PAGE_SIZE);
+C_ASSERT(FIELD_OFFSET(NVME_IDENTIFY_NAMESPACE, LbaFormat) == 128);
+C_ASSERT(sizeof(NVME_IDENTIFY_NAMESPACE) == NVME_PAGE_SIZE);
+C_ASSERT(NVME_PRP_LIST_ENTRIES * sizeof(ULONGLONG) <= NVME_PRP_LIST_SIZE);
+C_ASSERT(NVME_PAGE_SIZE % NVME_PRP_LIST_SIZE == 0);
+
+typedef struct _NVME_QUEUE
+{
+    USHORT QueueId;
+    USHORT Depth;
+    ULONG MessageId;
+
+    PNVME_COMMAND SubmissionQueue;
+    PNVME_COMPLETION CompletionQueue;
+    STOR_PHYSICAL_ADDRESS SubmissionQueuePhysical;
+    STOR_PHYSICAL_ADDRESS CompletionQueuePhysical;
+    PULONG SubmissionDoorbell;
+    PULONG CompletionDoorbell;
+
+    USHORT SubmissionTail;
+    USHORT CompletionHead;
+    USHORT CompletionPhase;
+    USHORT NextCommandId;
+    ULONG Outstanding;
+
+    // PRP list of every command id, NVME_PRP_LIST_SIZE each
+    PULONGLONG PrpLists;
+    STOR_PHYSICAL_ADDRESS PrpListsPhysical;
+
+    // Outstanding requests by command id
+    PSCSI_REQUEST_BLOCK Requests[NVME_IO_QUEUE_DEPTH];
+} NVME_QUEUE, *PNVME_QUEUE;
+
+typedef struct _NVME_ADAPTER_EXTENSION
+{
+    ULONG SystemIoBusNumber;
+    ULONG SlotNumber;
+    USHORT VendorID;
+    USHORT DeviceID;
+
+    PUCHAR Registers;
+    ULONGLONG Capabilities;
+    ULONG Version;
+    ULONG DoorbellStride;
+    ULONG ReadyTimeout;     // in milliseconds
+
+    PVOID UncachedExtension;
+    ULONG UncachedExtensionSize;
+
+    NVME_QUEUE AdminQueue;
+    volatile BOOLEAN AdminCompleted;
+    NVME_COMPLETION AdminCompletion;
+
+    ULONG IoQueueCount;
+    NVME_QUEUE IoQueues[NVME_MAX_IO_QUEUES];
+
+    // Message signaled interrupts granted by storport, 0 if line based
+    ULONG MessageCount;
+
+    // I/O queue of every processor; learned from where the messages arrive
+    UCHAR ProcessorQueue[NVME_MAX_PROCESSORS];
+
+    PNVME_IDENTIFY_CONTROLLER IdentifyController;
+    STOR_PHYSICAL_ADDRESS IdentifyControllerPhysical;
+    PNVME_IDENTIFY_NAMESPACE IdentifyNamespace;
+    STOR_PHYSICAL_ADDRESS IdentifyNamespacePhysical;
+
+    ULONG NamespaceId;
+    ULONGLONG BlockCount;
+    ULONG BlockSize;
+    ULONG BlockShift;
+    ULONG MaximumTransferLength;
+    BOOLEAN VolatileWriteCache;
+
+    struct
+    {
+        ULONG Initialized:1;
+        ULONG Removed:1;
+        ULONG ShutDown:1;
+    } StateFlags;
+} NVME_ADAPTER_EXTENSION, *PNVME_ADAPTER_EXTENSION;
+
+//////////////////////////////////////////////////////////////
+//                       Declarations                       //
+//////////////////////////////////////////////////////////////
+
+BOOLEAN
+NvmeAdminCommand (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __inout PNVME_COMMAND Command,
+    __out_opt PNVME_COMPLETION Completion
+    );
+
+BOOLEAN
+NvmeProcessCompletions (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PNVME_QUEUE Queue
+    );
+
+BOOLEAN
+NvmeBuildPrp (
+    __in PNVME_QUEUE Queue,
+    __in USHORT CommandId,
+    __in PSTOR_SCATTER_GATHER_LIST Sgl,
+    __inout PNVME_COMMAND Command
+    );
+
+BOOLEAN
+NTAPI
+NvmeHwResetBus (
+    __in PVOID DeviceExtension,
+    __in ULONG PathId
+    );
+
+UCHAR
+NvmeSubmitRequest (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __inout PNVME_COMMAND Command
+    );
+
+UCHAR
+DeviceInquiryRequest (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceRequestCapacity (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceRequestSense (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceReportLuns (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceRequestReadWrite (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceRequestFlush (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb,
+    __in PCDB Cdb
+    );
+
+UCHAR
+DeviceRequestShutdown (
+    __in PNVME_ADAPTER_EXTENSION AdapterExtension,
+    __in PSCSI_REQUEST_BLOCK Srb
+    );
+
+#endif /* _STORNVME_H_ */
@@ -0,0 +1,177 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the Fast486 code cache
+ */
+
+#include <apitest.h>
+
+#include <windef.h>
+#include <winbase.h>
+#include <fast486.h>
+
+#define MEMORY_SIZE     (1024 * 1024)
+#define CODE_SEGMENT    0x1000
+#define DATA_OFFSET     0x2000
+#define DATA_SIZE       0x100
+#define OUTER_LOOPS     2
+
+/* Every outer loop runs 65536 times through the inner one */
+#define INNER_INSTRUCTIONS  (65536 * 4 + 3)
+
+static PUCHAR Memory;
+static FAST486_STATE State;
+static FAST486_TLB_ENTRY Tlb[FAST486_TLB_ENTRIES];
+
+/* Sum words from a 256 byte buffer, 65536 * DX times */
+static const UCHAR LoopCode[] =
+{
+    0x31, 0xC0,                 /* 0100: xor ax, ax */
+    0xBB, 0x00, 0x20,           /* 0102: mov bx, 2000h */
+    0xB9, 0x00, 0x00,           /* 0105: mov cx, 0 */
+    0x03, 0x07,                 /* 0108: add ax, [bx] */
+    0x43,                       /* 010A: inc bx */
+    0x81, 0xE3, 0xFF, 0x20,     /* 010B: and bx, 20FFh */
+    0xE2, 0xF7,                 /* 010F: loop 0108 */
+    0x4A,                       /* 0111: dec dx */
+    0x75, 0xF1,                 /* 0112: jnz 0105 */
+    0xF4                        /* 0114: hlt */
+};
+
+/* Patch the next instruction from a nop to an inc ax */
+static const UCHAR SelfModifyingCode[] =
+{
+    0xB8, 0x00, 0x00,                   /* 0200: mov ax, 0 */
+    0x2E, 0xC6, 0x06, 0x09, 0x02, 0x40, /* 0203: mov byte ptr cs:[0209], 40h */
+    0x90,                               /* 0209: nop */
+    0xF4                                /* 020A: hlt */
+};
+
+static
+VOID
+FASTCALL
+MemReadCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        RtlCopyMemory(Buffer, Memory + Address, Size);
+    else
+        RtlFillMemory(Buffer, Size, 0xFF);
+}
+
+static
+VOID
+FASTCALL
+MemWriteCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        RtlCopyMemory(Memory + Address, Buffer, Size);
+}
+
+/* Patched by the host (like a DMA transfer would) between two runs */
+static const UCHAR HostModifiedCode[] =
+{
+    0xB8, 0x00, 0x00,           /* 0300: mov ax, 0 */
+    0x90,                       /* 0303: nop */
+    0xF4                        /* 0304: hlt */
+};
+
+static
+ULONGLONG
+RunCode(USHORT Offset)
+{
+    ULONGLONG Instructions = 0;
+
+    State.Halted = FALSE;
+    Fast486ExecuteAt(&State, CODE_SEGMENT, Offset);
+
+    while (!State.Halted)
+    {
+        Fast486StepInto(&State);
+        Instructions++;
+    }
+
+    return Instructions;
+}
+
+static
+VOID
+TestSelfModifyingCode(VOID)
+{
+    RtlCopyMemory(Memory + CODE_SEGMENT * 16 + 0x200, SelfModifyingCode, sizeof(SelfModifyingCode));
+
+    /* The patched line is already cached when the write happens */
+    RunCode(0x200);
+    ok(State.GeneralRegs[FAST486_REG_EAX].LowWord == 1, "AX is %x\n", State.GeneralRegs[FAST486_REG_EAX].LowWord);
+    ok(Memory[CODE_SEGMENT * 16 + 0x209] == 0x40, "Code wasn't patched\n");
+}
+
+static
+VOID
+TestHostModifiedCode(VOID)
+{
+    RtlCopyMemory(Memory + CODE_SEGMENT * 16 + 0x300, HostModifiedCode, sizeof(HostModifiedCode));
+
+    RunCode(0x300);
+    ok(State.GeneralRegs[FAST486_REG_EAX].LowWord == 0, "AX is %x\n", State.GeneralRegs[FAST486_REG_EAX].LowWord);
+
+    /* The CPU doesn't see this write, it has to be told */
+    Memory[CODE_SEGMENT * 16 + 0x303] = 0x40;
+    Fast486InvalidateCache(&State, CODE_SEGMENT * 16 + 0x303, sizeof(UCHAR));
+
+    RunCode(0x300);
+    ok(State.GeneralRegs[FAST486_REG_EAX].LowWord == 1, "AX is %x\n", State.GeneralRegs[FAST486_REG_EAX].LowWord);
+}
+
+static
+VOID
+TestLoop(VOID)
+{
+    PUSHORT Data = (PUSHORT)(Memory + CODE_SEGMENT * 16 + DATA_OFFSET);
+    ULONGLONG Instructions;
+    USHORT Expected = 0;
+    ULONG i;
+
+    RtlCopyMemory(Memory + CODE_SEGMENT * 16 + 0x100, LoopCode, sizeof(LoopCode));
+    for (i = 0; i < DATA_SIZE / sizeof(USHORT) + 1; i++)
+        Data[i] = (USHORT)(i * 0x9E37 + 1);
+
+    /* The same sum, computed natively */
+    for (i = 0; i < OUTER_LOOPS * 65536; i++)
+        Expected += *(PUSHORT)((PUCHAR)Data + (i % DATA_SIZE));
+
+    Fast486SetSegment(&State, FAST486_REG_DS, CODE_SEGMENT);
+    State.GeneralRegs[FAST486_REG_EDX].LowWord = OUTER_LOOPS;
+
+    /* The loop runs from the cached lines all the time */
+    Instructions = RunCode(0x100);
+
+    ok(Instructions == 3 + OUTER_LOOPS * INNER_INSTRUCTIONS, "Executed %I64u instructions\n", Instructions);
+    ok(State.GeneralRegs[FAST486_REG_EAX].LowWord == Expected,
+       "AX is %x, expected %x\n", State.GeneralRegs[FAST486_REG_EAX].LowWord, Expected);
+}
+
+START_TEST(CodeCache)
+{
+    Memory = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MEMORY_SIZE);
+    if (!Memory)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      Tlb);
+
+    TestSelfModifyingCode();
+    TestHostModifiedCode();
+    TestLoop();
+
+    HeapFree(GetProcessHeap(), 0, Memory);
+}
@@ -0,0 +1,13 @@
+#define __ROS_LONG64__
+
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_CodeCache(void);
+
+const struct test winetest_testlist[] =
+{
+    { "CodeCache", func_CodeCache },
+
+    { 0, 0 }
+};
@@ -0,0 +1,203 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for ExtTextOut glyph caching and batching
+ */
+
+#include "precomp.h"
+
+#define BITMAP_WIDTH    640
+#define BITMAP_HEIGHT   100
+#define FIRST_CHAR      0x20
+#define LAST_CHAR       0x24F
+
+static PULONG Bits;
+
+static
+HFONT
+CreateTestFont(INT Height, INT Escapement, DWORD Quality)
+{
+    LOGFONTW LogFont;
+
+    ZeroMemory(&LogFont, sizeof(LogFont));
+    LogFont.lfHeight = Height;
+    LogFont.lfEscapement = Escapement;
+    LogFont.lfOrientation = Escapement;
+    LogFont.lfWeight = FW_NORMAL;
+    LogFont.lfCharSet = DEFAULT_CHARSET;
+    LogFont.lfQuality = (BYTE)Quality;
+    wcscpy(LogFont.lfFaceName, L"Tahoma");
+
+    return CreateFontIndirectW(&LogFont);
+}
+
+static
+VOID
+DrawTestText(HDC hdc, HFONT Font, PCWSTR Text, INT Length)
+{
+    RECT Rect = { 0, 0, BITMAP_WIDTH, BITMAP_HEIGHT };
+    HFONT OldFont;
+
+    OldFont = SelectObject(hdc, Font);
+    ExtTextOutW(hdc, 10, 50, ETO_OPAQUE, &Rect, Text, Length, NULL);
+    SelectObject(hdc, OldFont);
+}
+
+/* Draws every glyph of the range in chunks, which is more than the cache used to hold */
+static
+ULONG
+DrawAllGlyphs(HDC hdc, HFONT Font)
+{
+    WCHAR Text[64];
+    ULONG Glyphs = 0;
+    WCHAR Char = FIRST_CHAR;
+    INT i;
+
+    while (Char <= LAST_CHAR)
+    {
+        for (i = 0; i < _countof(Text) && Char <= LAST_CHAR; i++)
+            Text[i] = Char++;
+
+        DrawTestText(hdc, Font, Text, i);
+        Glyphs += i;
+    }
+
+    return Glyphs;
+}
+
+static
+VOID
+TestGlyphCache(HDC hdc)
+{
+    static const WCHAR Text[] = L"The quick brown fox jumps over the lazy dog";
+    static const DWORD Qualities[] = { NONANTIALIASED_QUALITY, ANTIALIASED_QUALITY };
+    HFONT Font, OtherFont, RotatedFont;
+    PULONG Expected;
+    SIZE_T Size = BITMAP_WIDTH * BITMAP_HEIGHT * sizeof(ULONG);
+    INT i;
+
+    Expected = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!Expected)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < _countof(Qualities); i++)
+    {
+        Font = CreateTestFont(-20, 0, Qualities[i]);
+        OtherFont = CreateTestFont(-21, 0, Qualities[i]);
+        RotatedFont = CreateTestFont(-20, 100, Qualities[i]);
+
+        /* Drawing from the cache must give the same result as rendering the glyphs */
+        DrawTestText(hdc, Font, Text, wcslen(Text));
+        CopyMemory(Expected, Bits, Size);
+        DrawTestText(hdc, Font, Text, wcslen(Text));
+        ok(!memcmp(Expected, Bits, Size), "Cached glyphs differ for quality %lu\n", Qualities[i]);
+
+        /* Also after the glyphs were thrown out of the cache */
+        DrawAllGlyphs(hdc, Font);
+        DrawAllGlyphs(hdc, OtherFont);
+        DrawTestText(hdc, Font, Text, wcslen(Text));
+        ok(!memcmp(Expected, Bits, Size), "Glyphs differ after flushing the cache for quality %lu\n", Qualities[i]);
+
+        /* Other sizes and transformations must not get our glyphs */
+        DrawTestText(hdc, OtherFont, Text, wcslen(Text));
+        ok(memcmp(Expected, Bits, Size) != 0, "Bigger font drew the same glyphs\n");
+        DrawTestText(hdc, RotatedFont, Text, wcslen(Text));
+        ok(memcmp(Expected, Bits, Size) != 0, "Rotated font drew the same glyphs\n");
+
+        DeleteObject(Font);
+        DeleteObject(OtherFont);
+        DeleteObject(RotatedFont);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Expected);
+}
+
+/* Text is batched for DCs without a DIB section, the batch must still use
+   the attributes which were set at the time of each call */
+static
+VOID
+TestBatching(VOID)
+{
+    RECT Rect1 = { 0, 0, 1, 1 }, Rect2 = { 1, 0, 2, 1 };
+    HBITMAP hbmp, hbmpOld;
+    HDC hdc;
+
+    hdc = CreateCompatibleDC(NULL);
+    hbmp = CreateBitmap(4, 1, 1, 32, NULL);
+    if (!hdc || !hbmp)
+    {
+        skip("Could not create the batching DC\n");
+        if (hdc) DeleteDC(hdc);
+        return;
+    }
+
+    hbmpOld = SelectObject(hdc, hbmp);
+
+    SetBkColor(hdc, RGB(255, 0, 0));
+    ok(ExtTextOutW(hdc, 0, 0, ETO_OPAQUE, &Rect1, NULL, 0, NULL), "ExtTextOutW failed\n");
+    SetBkColor(hdc, RGB(0, 0, 255));
+    ok(ExtTextOutW(hdc, 0, 0, ETO_OPAQUE, &Rect2, NULL, 0, NULL), "ExtTextOutW failed\n");
+
+    /* The background of the text cell is filled in the opaque mode */
+    SetBkMode(hdc, OPAQUE);
+    SetBkColor(hdc, RGB(0, 255, 0));
+    ok(TextOutW(hdc, 2, 0, L"  ", 2), "TextOutW failed\n");
+    SetBkMode(hdc, TRANSPARENT);
+    SetBkColor(hdc, RGB(0, 0, 0));
+
+    /* Reading the pixels flushes the batch */
+    ok_long(GetPixel(hdc, 0, 0), RGB(255, 0, 0));
+    ok_long(GetPixel(hdc, 1, 0), RGB(0, 0, 255));
+    ok_long(GetPixel(hdc, 2, 0), RGB(0, 255, 0));
+    ok_long(GetPixel(hdc, 3, 0), RGB(0, 255, 0));
+
+    SelectObject(hdc, hbmpOld);
+    DeleteObject(hbmp);
+    DeleteDC(hdc);
+}
+
+START_TEST(ExtTextOut)
+{
+    BITMAPINFO bmi;
+    HBITMAP hbmp, hbmpOld;
+    HDC hdc;
+
+    hdc = CreateCompatibleDC(NULL);
+    ok(hdc != NULL, "CreateCompatibleDC failed\n");
+    if (!hdc)
+    {
+        skip("No DC\n");
+        return;
+    }
+
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = BITMAP_WIDTH;
+    bmi.bmiHeader.biHeight = -BITMAP_HEIGHT;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hbmp = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, (PVOID*)&Bits, NULL, 0);
+    ok(hbmp != NULL, "CreateDIBSection failed\n");
+    if (!hbmp)
+    {
+        skip("No bitmap\n");
+        DeleteDC(hdc);
+        return;
+    }
+
+    hbmpOld = SelectObject(hdc, hbmp);
+    SetBkColor(hdc, RGB(255, 255, 255));
+    SetTextColor(hdc, RGB(0, 0, 0));
+
+    TestGlyphCache(hdc);
+    TestBatching();
+
+    SelectObject(hdc, hbmpOld);
+    DeleteObject(hbmp);
+    DeleteDC(hdc);
+}
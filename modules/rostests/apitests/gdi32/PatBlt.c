@@ -123,6 +123,62 @@ void Test_BrushOrigin()
 
 }
 
+/* PatBlt is batched for DCs without a DIB section, the batch must still
+   use the attributes which were set at the time of each call */
+void Test_Batching()
+{
+    HDC hdc;
+    HBITMAP hbmp, hbmpOld;
+    HBRUSH hbrRed, hbrBlue, hbrOld;
+
+    hdc = CreateCompatibleDC(0);
+    hbmp = CreateBitmap(8, 1, 1, 32, NULL);
+    if (!hdc || !hbmp)
+    {
+        skip("Could not create the batching DC\n");
+        if (hdc) DeleteDC(hdc);
+        return;
+    }
+
+    hbmpOld = SelectObject(hdc, hbmp);
+    hbrRed = CreateSolidBrush(RGB(255, 0, 0));
+    hbrBlue = CreateSolidBrush(RGB(0, 0, 255));
+
+    hbrOld = SelectObject(hdc, GetStockObject(DC_BRUSH));
+    SetDCBrushColor(hdc, RGB(0, 255, 0));
+    ok_long(PatBlt(hdc, 0, 0, 1, 1, PATCOPY), 1);
+    SetDCBrushColor(hdc, RGB(255, 255, 0));
+    ok_long(PatBlt(hdc, 1, 0, 1, 1, PATCOPY), 1);
+    SelectObject(hdc, hbrRed);
+    ok_long(PatBlt(hdc, 2, 0, 1, 1, PATCOPY), 1);
+    SelectObject(hdc, hbrBlue);
+    ok_long(PatBlt(hdc, 3, 0, 1, 1, PATCOPY), 1);
+    ok_long(PatBlt(hdc, 4, 0, 1, 1, WHITENESS), 1);
+    ok_long(PatBlt(hdc, 4, 0, 2, 1, PATINVERT), 1);
+    SelectObject(hdc, GetStockObject(DC_BRUSH));
+    SetDCBrushColor(hdc, RGB(0, 255, 255));
+    ok_long(PatBlt(hdc, 6, 0, 2, 1, PATCOPY), 1);
+
+    /* A source rop is still refused */
+    ok_long(PatBlt(hdc, 0, 0, 1, 1, SRCCOPY), 0);
+
+    /* Reading the pixels flushes the batch */
+    ok_long(GetPixel(hdc, 0, 0), RGB(0, 255, 0));
+    ok_long(GetPixel(hdc, 1, 0), RGB(255, 255, 0));
+    ok_long(GetPixel(hdc, 2, 0), RGB(255, 0, 0));
+    ok_long(GetPixel(hdc, 3, 0), RGB(0, 0, 255));
+    ok_long(GetPixel(hdc, 4, 0), RGB(255, 255, 0));
+    ok_long(GetPixel(hdc, 6, 0), RGB(0, 255, 255));
+    ok_long(GetPixel(hdc, 7, 0), RGB(0, 255, 255));
+
+    SelectObject(hdc, hbrOld);
+    SelectObject(hdc, hbmpOld);
+    DeleteObject(hbrRed);
+    DeleteObject(hbrBlue);
+    DeleteObject(hbmp);
+    DeleteDC(hdc);
+}
+
 START_TEST(PatBlt)
 {
     BITMAPINFO bmi;
@@ -168,6 +224,6 @@ START_TEST(PatBlt)
 
     Test_BrushOrigin();
 
-
+    Test_Batching();
 }
 
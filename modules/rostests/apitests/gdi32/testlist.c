@@ -28,6 +28,7 @@ extern void func_EnumFontFamilies(void);
 extern void func_ExcludeClipRect(void);
 extern void func_ExtCreatePen(void);
 extern void func_ExtCreateRegion(void);
+extern void func_ExtTextOut(void);
 extern void func_FrameRgn(void);
 extern void func_GdiConvertBitmap(void);
 extern void func_GdiConvertBrush(void);
@@ -101,6 +102,7 @@ const struct test winetest_testlist[] =
     { "ExcludeClipRect", func_ExcludeClipRect },
     { "ExtCreatePen", func_ExtCreatePen },
     { "ExtCreateRegion", func_ExtCreateRegion },
+    { "ExtTextOut", func_ExtTextOut },
     { "FrameRgn", func_FrameRgn },
     { "GdiConvertBitmap", func_GdiConvertBitmap },
     { "GdiConvertBrush", func_GdiConvertBrush },
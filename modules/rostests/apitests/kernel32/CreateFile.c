@@ -0,0 +1,125 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for opening files in big directories
+ */
+
+#include "precomp.h"
+
+static
+VOID
+GetTestFileName(PWSTR Buffer, SIZE_T BufferLength, PCWSTR Directory, ULONG Index)
+{
+    StringCchPrintfW(Buffer, BufferLength, L"%s\\Log file number %05lu.txt", Directory, Index);
+}
+
+static
+BOOL
+OpenTestFile(PCWSTR FileName)
+{
+    HANDLE File;
+
+    File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE) return FALSE;
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+ULONG
+CreateTestDirectory(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH];
+    HANDLE File;
+    ULONG i;
+
+    if (!CreateDirectoryW(Directory, NULL)) return 0;
+
+    for (i = 0; i < FileCount; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, i);
+        File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        if (File == INVALID_HANDLE_VALUE) break;
+        CloseHandle(File);
+    }
+
+    return i;
+}
+
+static
+VOID
+DeleteTestDirectory(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < FileCount; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, i);
+        DeleteFileW(FileName);
+    }
+
+    RemoveDirectoryW(Directory);
+}
+
+static
+VOID
+TestLookups(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH], ShortName[MAX_PATH], NewName[MAX_PATH];
+    ULONG Index = FileCount / 2;
+
+    /* Names are case insensitive */
+    GetTestFileName(FileName, _countof(FileName), Directory, Index);
+    _wcsupr(FileName + wcslen(Directory));
+    ok(OpenTestFile(FileName), "Failed to open %S\n", FileName);
+
+    /* Short names must be found too */
+    if (GetShortPathNameW(FileName, ShortName, _countof(ShortName)))
+        ok(OpenTestFile(ShortName), "Failed to open %S\n", ShortName);
+
+    /* Deleted files must go away */
+    GetTestFileName(FileName, _countof(FileName), Directory, 0);
+    ok(DeleteFileW(FileName), "DeleteFileW failed with %lu\n", GetLastError());
+    ok(!OpenTestFile(FileName), "Opened deleted file %S\n", FileName);
+
+    /* And come back when created again */
+    CloseHandle(CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL));
+    ok(OpenTestFile(FileName), "Failed to open recreated %S\n", FileName);
+
+    /* Renamed files must only be found by their new name */
+    GetTestFileName(FileName, _countof(FileName), Directory, Index);
+    StringCchPrintfW(NewName, _countof(NewName), L"%s\\Renamed log file.txt", Directory);
+    ok(MoveFileW(FileName, NewName), "MoveFileW failed with %lu\n", GetLastError());
+    ok(!OpenTestFile(FileName), "Opened renamed file %S\n", FileName);
+    ok(OpenTestFile(NewName), "Failed to open %S\n", NewName);
+    ok(MoveFileW(NewName, FileName), "MoveFileW failed with %lu\n", GetLastError());
+    ok(OpenTestFile(FileName), "Failed to open %S\n", FileName);
+}
+
+START_TEST(CreateFile)
+{
+    static const ULONG FileCounts[] = { 100, 1000 };
+    WCHAR TempPath[MAX_PATH], Directory[MAX_PATH];
+    ULONG i, Created;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+
+    for (i = 0; i < _countof(FileCounts); i++)
+    {
+        StringCchPrintfW(Directory, _countof(Directory), L"%sCreateFile%lu", TempPath, FileCounts[i]);
+
+        Created = CreateTestDirectory(Directory, FileCounts[i]);
+        if (Created != FileCounts[i])
+        {
+            skip("Only created %lu of %lu files\n", Created, FileCounts[i]);
+            DeleteTestDirectory(Directory, Created);
+            break;
+        }
+
+        TestLookups(Directory, FileCounts[i]);
+
+        DeleteTestDirectory(Directory, FileCounts[i]);
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+static
+void
+TestLowFragmentationHeap(void)
+{
+    HANDLE Heap;
+    ULONG Info;
+    PUCHAR Block, Block2;
+    SIZE_T Size;
+    BOOL Ret;
+
+    Heap = HeapCreate(0, 0, 0);
+    ok(Heap != NULL, "HeapCreate failed with %lu\n", GetLastError());
+    if (!Heap) return;
+
+    /* Enable the front end */
+    Info = 2;
+    Ret = HeapSetInformation(Heap, HeapCompatibilityInformation, &Info, sizeof(Info));
+    ok(Ret, "HeapSetInformation failed with %lu\n", GetLastError());
+
+    Info = 0xdeadbeef;
+    Ret = HeapQueryInformation(Heap, HeapCompatibilityInformation, &Info, sizeof(Info), NULL);
+    ok(Ret, "HeapQueryInformation failed with %lu\n", GetLastError());
+    ok(Info == 2, "Expected LFH, got %lu\n", Info);
+
+    /* Small blocks */
+    Block = HeapAlloc(Heap, HEAP_ZERO_MEMORY, 24);
+    ok(Block != NULL, "HeapAlloc failed\n");
+    ok(HeapSize(Heap, 0, Block) == 24, "Unexpected size %lu\n", (ULONG)HeapSize(Heap, 0, Block));
+    ok(Block[0] == 0 && Block[23] == 0, "Block wasn't zeroed\n");
+    ok(HeapValidate(Heap, 0, Block), "Block isn't valid\n");
+
+    /* In place shrinking and growing */
+    Block2 = HeapReAlloc(Heap, HEAP_REALLOC_IN_PLACE_ONLY, Block, 20);
+    ok(Block2 == Block, "Block moved: %p -> %p\n", Block, Block2);
+    Size = HeapSize(Heap, 0, Block);
+    ok(Size == 20, "Unexpected size %lu\n", (ULONG)Size);
+
+    /* Moving out of the bucket */
+    memset(Block, 0x55, 20);
+    Block2 = HeapReAlloc(Heap, HEAP_ZERO_MEMORY, Block, 4096);
+    ok(Block2 != NULL, "HeapReAlloc failed\n");
+    if (Block2)
+    {
+        ok(Block2[0] == 0x55 && Block2[19] == 0x55, "Data wasn't copied\n");
+        ok(Block2[20] == 0 && Block2[4095] == 0, "Tail wasn't zeroed\n");
+        Block = Block2;
+    }
+
+    ok(HeapFree(Heap, 0, Block), "HeapFree failed\n");
+
+    /* Shrinking a large block moves it to a smaller bucket */
+    Block = HeapAlloc(Heap, 0, 1000);
+    ok(Block != NULL, "HeapAlloc failed\n");
+    if (Block)
+    {
+        memset(Block, 0x55, 1000);
+        Block2 = HeapReAlloc(Heap, 0, Block, 8);
+        ok(Block2 != NULL, "HeapReAlloc failed\n");
+        if (Block2)
+        {
+            Block = Block2;
+            Size = HeapSize(Heap, 0, Block);
+            ok(Size == 8, "Unexpected size %lu\n", (ULONG)Size);
+            ok(Block[0] == 0x55 && Block[7] == 0x55, "Data wasn't copied\n");
+
+            /* And it can grow from its real size again */
+            Block2 = HeapReAlloc(Heap, HEAP_ZERO_MEMORY, Block, 16);
+            ok(Block2 != NULL, "HeapReAlloc failed\n");
+            if (Block2)
+            {
+                Block = Block2;
+                ok(HeapSize(Heap, 0, Block) == 16, "Unexpected size %lu\n", (ULONG)HeapSize(Heap, 0, Block));
+                ok(Block[7] == 0x55 && Block[8] == 0 && Block[15] == 0, "Tail wasn't zeroed\n");
+            }
+        }
+        ok(HeapFree(Heap, 0, Block), "HeapFree failed\n");
+    }
+
+    ok(HeapValidate(Heap, 0, NULL), "Heap isn't valid\n");
+    HeapDestroy(Heap);
+
+    /* The front end isn't available for non-serialized heaps */
+    Heap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    ok(Heap != NULL, "HeapCreate failed with %lu\n", GetLastError());
+    if (Heap)
+    {
+        Info = 2;
+        Ret = HeapSetInformation(Heap, HeapCompatibilityInformation, &Info, sizeof(Info));
+        ok(!Ret, "HeapSetInformation succeeded\n");
+        HeapDestroy(Heap);
+    }
+}
+
+START_TEST(HeapSetInformation)
+{
+    TestLowFragmentationHeap();
+}
@@ -0,0 +1,122 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for batched completion port dequeues
+ */
+
+#include "precomp.h"
+
+#define MAX_BATCH         64
+
+/* Same layout as the Vista OVERLAPPED_ENTRY, which we don't get at 0x502 */
+typedef struct _IOCP_ENTRY
+{
+    ULONG_PTR lpCompletionKey;
+    LPOVERLAPPED lpOverlapped;
+    ULONG_PTR Internal;
+    DWORD dwNumberOfBytesTransferred;
+} IOCP_ENTRY, *PIOCP_ENTRY;
+
+static BOOL (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE, PIOCP_ENTRY, ULONG, PULONG, DWORD, BOOL);
+
+static ULONG ApcCount;
+
+static
+VOID
+CALLBACK
+ApcRoutine(ULONG_PTR Parameter)
+{
+    ApcCount++;
+}
+
+static
+VOID
+TestRemove(VOID)
+{
+    IOCP_ENTRY Entries[MAX_BATCH];
+    HANDLE Port;
+    ULONG Removed, i;
+    BOOL ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* An empty port times out without removing anything */
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, MAX_BATCH, &Removed, 0, FALSE);
+    ok(ret == FALSE, "ret = %d\n", ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "GetLastError() = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    /* A zero sized array isn't allowed */
+    SetLastError(0xdeadbeef);
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(ret == FALSE, "ret = %d\n", ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "GetLastError() = %lu\n", GetLastError());
+
+    /* Everything queued comes back in a single call, in order */
+    for (i = 0; i < 3; i++)
+    {
+        ret = PostQueuedCompletionStatus(Port, i * 10, i + 1, (LPOVERLAPPED)(ULONG_PTR)(i + 100));
+        ok(ret == TRUE, "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+    }
+
+    Removed = 0;
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, MAX_BATCH, &Removed, 0, FALSE);
+    ok(ret == TRUE, "GetQueuedCompletionStatusEx failed: %lu\n", GetLastError());
+    ok(Removed == 3, "Removed = %lu\n", Removed);
+    for (i = 0; i < Removed; i++)
+    {
+        ok(Entries[i].lpCompletionKey == i + 1, "Entry %lu key = %Iu\n", i, Entries[i].lpCompletionKey);
+        ok(Entries[i].lpOverlapped == (LPOVERLAPPED)(ULONG_PTR)(i + 100), "Entry %lu overlapped = %p\n", i, Entries[i].lpOverlapped);
+        ok(Entries[i].dwNumberOfBytesTransferred == i * 10, "Entry %lu bytes = %lu\n", i, Entries[i].dwNumberOfBytesTransferred);
+    }
+
+    /* A smaller array leaves the rest queued */
+    for (i = 0; i < 3; i++)
+        PostQueuedCompletionStatus(Port, 0, i, NULL);
+
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, 2, &Removed, 0, FALSE);
+    ok(ret == TRUE && Removed == 2, "ret = %d, Removed = %lu\n", ret, Removed);
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, MAX_BATCH, &Removed, 0, FALSE);
+    ok(ret == TRUE && Removed == 1, "ret = %d, Removed = %lu\n", ret, Removed);
+    ok(Entries[0].lpCompletionKey == 2, "key = %Iu\n", Entries[0].lpCompletionKey);
+
+    /* An alertable wait is broken by a user APC */
+    ApcCount = 0;
+    ret = QueueUserAPC(ApcRoutine, GetCurrentThread(), 0);
+    ok(ret != FALSE, "QueueUserAPC failed: %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    ret = pGetQueuedCompletionStatusEx(Port, Entries, MAX_BATCH, &Removed, INFINITE, TRUE);
+    ok(ret == FALSE, "ret = %d\n", ret);
+    ok(GetLastError() == WAIT_IO_COMPLETION, "GetLastError() = %lu\n", GetLastError());
+    ok(ApcCount == 1, "ApcCount = %lu\n", ApcCount);
+
+    CloseHandle(Port);
+}
+
+START_TEST(IoCompletion)
+{
+    HMODULE hKernel;
+
+    /* Vista has it in kernel32, we keep it in kernel32_vista */
+    hKernel = GetModuleHandleA("kernel32.dll");
+    pGetQueuedCompletionStatusEx = (void *)GetProcAddress(hKernel, "GetQueuedCompletionStatusEx");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        hKernel = LoadLibraryA("kernel32_vista.dll");
+        if (hKernel)
+            pGetQueuedCompletionStatusEx = (void *)GetProcAddress(hKernel, "GetQueuedCompletionStatusEx");
+    }
+
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx not available\n");
+        return;
+    }
+
+    TestRemove();
+}
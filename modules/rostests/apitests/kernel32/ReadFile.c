@@ -0,0 +1,175 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for concurrent cached reads
+ */
+
+#include "precomp.h"
+
+#define READ_BLOCK_SIZE   (64 * 1024)
+#define READ_FILE_SIZE    (1024 * 1024)
+#define READ_ITERATIONS   64
+#define READ_THREADS      4
+
+typedef struct _READ_CONTEXT
+{
+    PCWSTR FileName;
+    ULONG Index;
+    ULONG Failures;
+} READ_CONTEXT, *PREAD_CONTEXT;
+
+/* Every DWORD of the file holds its own offset */
+static
+BOOL
+CreateTestFile(PCWSTR FileName)
+{
+    PULONG Buffer;
+    HANDLE File;
+    ULONG Offset, i;
+    DWORD Written;
+    BOOL Ret = TRUE;
+
+    File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+    if (File == INVALID_HANDLE_VALUE) return FALSE;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, READ_BLOCK_SIZE);
+    if (!Buffer)
+    {
+        CloseHandle(File);
+        return FALSE;
+    }
+
+    for (Offset = 0; Offset < READ_FILE_SIZE && Ret; Offset += READ_BLOCK_SIZE)
+    {
+        for (i = 0; i < READ_BLOCK_SIZE / sizeof(ULONG); i++)
+            Buffer[i] = Offset + i * sizeof(ULONG);
+
+        Ret = WriteFile(File, Buffer, READ_BLOCK_SIZE, &Written, NULL) && Written == READ_BLOCK_SIZE;
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+    return Ret;
+}
+
+static
+DWORD
+WINAPI
+ReadThread(LPVOID Parameter)
+{
+    PREAD_CONTEXT Context = Parameter;
+    ULONG Offset, i;
+    HANDLE File;
+    PULONG Buffer;
+    DWORD Read;
+
+    File = CreateFileW(Context->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        Context->Failures++;
+        return 0;
+    }
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, READ_BLOCK_SIZE);
+    if (!Buffer)
+    {
+        Context->Failures++;
+        CloseHandle(File);
+        return 0;
+    }
+
+    /* Every thread walks the file in a different order, with an odd stride */
+    for (i = 0; i < READ_ITERATIONS; i++)
+    {
+        Offset = ((Context->Index + i * 7) % (READ_FILE_SIZE / READ_BLOCK_SIZE)) * READ_BLOCK_SIZE;
+
+        SetFilePointer(File, Offset, NULL, FILE_BEGIN);
+        if (!ReadFile(File, Buffer, READ_BLOCK_SIZE, &Read, NULL) ||
+            Read != READ_BLOCK_SIZE ||
+            Buffer[0] != Offset ||
+            Buffer[READ_BLOCK_SIZE / sizeof(ULONG) - 1] != Offset + READ_BLOCK_SIZE - sizeof(ULONG))
+        {
+            Context->Failures++;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+    return 0;
+}
+
+static
+VOID
+TestConcurrentReads(PCWSTR FileName)
+{
+    READ_CONTEXT Contexts[READ_THREADS];
+    HANDLE Threads[READ_THREADS];
+    ULONG i;
+
+    for (i = 0; i < READ_THREADS; i++)
+    {
+        Contexts[i].FileName = FileName;
+        Contexts[i].Index = i;
+        Contexts[i].Failures = 0;
+        Threads[i] = CreateThread(NULL, 0, ReadThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < READ_THREADS; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+        ok(Contexts[i].Failures == 0, "Thread %lu had %lu failures\n", i, Contexts[i].Failures);
+    }
+}
+
+static
+VOID
+TestEndOfFile(PCWSTR FileName)
+{
+    ULONG Buffer[4];
+    HANDLE File;
+    DWORD Read;
+    BOOL Ret;
+
+    File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE) return;
+
+    /* A read across the end only returns what is there */
+    SetFilePointer(File, READ_FILE_SIZE - sizeof(ULONG), NULL, FILE_BEGIN);
+    Read = 0xdeadbeef;
+    Ret = ReadFile(File, Buffer, sizeof(Buffer), &Read, NULL);
+    ok(Ret, "ReadFile failed with %lu\n", GetLastError());
+    ok(Read == sizeof(ULONG), "Read %lu bytes\n", Read);
+    ok(Buffer[0] == READ_FILE_SIZE - sizeof(ULONG), "Got %lx\n", Buffer[0]);
+
+    /* And one at the end doesn't return anything */
+    Read = 0xdeadbeef;
+    Ret = ReadFile(File, Buffer, sizeof(Buffer), &Read, NULL);
+    ok(Ret, "ReadFile failed with %lu\n", GetLastError());
+    ok(Read == 0, "Read %lu bytes\n", Read);
+
+    CloseHandle(File);
+}
+
+START_TEST(ReadFile)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"crd", 0, FileName);
+
+    if (!CreateTestFile(FileName))
+    {
+        skip("Failed to create the test file\n");
+        DeleteFileW(FileName);
+        return;
+    }
+
+    TestConcurrentReads(FileName);
+    TestEndOfFile(FileName);
+
+    DeleteFileW(FileName);
+}
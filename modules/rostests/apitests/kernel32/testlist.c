@@ -4,6 +4,7 @@
 #include <apitest.h>
 
 extern void func_Console(void);
+extern void func_CreateFile(void);
 extern void func_CreateProcess(void);
 extern void func_DefaultActCtx(void);
 extern void func_DeviceIoControl(void);
@@ -16,7 +17,9 @@ extern void func_GetCurrentDirectory(void);
 extern void func_GetDriveType(void);
 extern void func_GetModuleFileName(void);
 extern void func_GetVolumeInformation(void);
+extern void func_HeapSetInformation(void);
 extern void func_interlck(void);
+extern void func_IoCompletion(void);
 extern void func_IsDBCSLeadByteEx(void);
 extern void func_LoadLibraryExW(void);
 extern void func_lstrcpynW(void);
@@ -24,16 +27,19 @@ extern void func_lstrlen(void);
 extern void func_Mailslot(void);
 extern void func_MultiByteToWideChar(void);
 extern void func_PrivMoveFileIdentityW(void);
+extern void func_ReadFile(void);
 extern void func_SetConsoleWindowInfo(void);
 extern void func_SetCurrentDirectory(void);
 extern void func_SetUnhandledExceptionFilter(void);
 extern void func_TerminateProcess(void);
 extern void func_TunnelCache(void);
+extern void func_UnbufferedIo(void);
 extern void func_WideCharToMultiByte(void);
 
 const struct test winetest_testlist[] =
 {
     { "ConsoleCP",                   func_Console },
+    { "CreateFile",                  func_CreateFile },
     { "CreateProcess",               func_CreateProcess },
     { "DefaultActCtx",               func_DefaultActCtx },
     { "DeviceIoControl",             func_DeviceIoControl },
@@ -46,7 +52,9 @@ const struct test winetest_testlist[] =
     { "GetDriveType",                func_GetDriveType },
     { "GetModuleFileName",           func_GetModuleFileName },
     { "GetVolumeInformation",        func_GetVolumeInformation },
+    { "HeapSetInformation",          func_HeapSetInformation },
     { "interlck",                    func_interlck },
+    { "IoCompletion",                func_IoCompletion },
     { "IsDBCSLeadByteEx",            func_IsDBCSLeadByteEx },
     { "LoadLibraryExW",              func_LoadLibraryExW },
     { "lstrcpynW",                   func_lstrcpynW },
@@ -54,11 +62,13 @@ const struct test winetest_testlist[] =
     { "MailslotRead",                func_Mailslot },
     { "MultiByteToWideChar",         func_MultiByteToWideChar },
     { "PrivMoveFileIdentityW",       func_PrivMoveFileIdentityW },
+    { "ReadFile",                    func_ReadFile },
     { "SetConsoleWindowInfo",        func_SetConsoleWindowInfo },
     { "SetCurrentDirectory",         func_SetCurrentDirectory },
     { "SetUnhandledExceptionFilter", func_SetUnhandledExceptionFilter },
     { "TerminateProcess",            func_TerminateProcess },
     { "TunnelCache",                 func_TunnelCache },
+    { "UnbufferedIo",                func_UnbufferedIo },
     { "WideCharToMultiByte",         func_WideCharToMultiByte },
     { 0, 0 }
 };
@@ -0,0 +1,197 @@
+/*
+ * PROJECT:         ReactOS API tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for NtQueryValueKey
+ */
+
+#include "precomp.h"
+
+#define VALUE_COUNT         64
+#define LARGE_DATA_SIZE     (16 * 1024)
+
+static UCHAR LargeData[LARGE_DATA_SIZE];
+
+static
+VOID
+GetValueName(PUNICODE_STRING ValueName, PWSTR Buffer, SIZE_T BufferLength, ULONG Index)
+{
+    /* Every other name can't be stored compressed */
+    StringCchPrintfW(Buffer, BufferLength, (Index & 1) ? L"Value\x00e9\x0411%lu" : L"Value%lu", Index);
+    RtlInitUnicodeString(ValueName, Buffer);
+}
+
+static
+NTSTATUS
+SetTestValue(HANDLE KeyHandle, ULONG Index, ULONG Seed)
+{
+    UNICODE_STRING ValueName;
+    WCHAR Name[32], String[64];
+
+    GetValueName(&ValueName, Name, _countof(Name), Index);
+
+    /* Mix small, medium and large data */
+    switch (Index % 3)
+    {
+        case 0:
+            return NtSetValueKey(KeyHandle, &ValueName, 0, REG_DWORD, &Seed, sizeof(Seed));
+
+        case 1:
+            StringCchPrintfW(String, _countof(String), L"String data %lu for value %lu", Seed, Index);
+            return NtSetValueKey(KeyHandle, &ValueName, 0, REG_SZ, String, (ULONG)(wcslen(String) + 1) * sizeof(WCHAR));
+
+        default:
+            LargeData[0] = (UCHAR)Seed;
+            LargeData[LARGE_DATA_SIZE - 1] = (UCHAR)Index;
+            return NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY, LargeData, LARGE_DATA_SIZE);
+    }
+}
+
+static
+BOOLEAN
+CheckTestValue(HANDLE KeyHandle, ULONG Index, ULONG Seed, PKEY_VALUE_PARTIAL_INFORMATION Info, ULONG InfoLength)
+{
+    UNICODE_STRING ValueName;
+    WCHAR Name[32], String[64];
+    ULONG ResultLength;
+    NTSTATUS Status;
+
+    GetValueName(&ValueName, Name, _countof(Name), Index);
+    Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, InfoLength, &ResultLength);
+    if (!NT_SUCCESS(Status)) return FALSE;
+
+    switch (Index % 3)
+    {
+        case 0:
+            return Info->Type == REG_DWORD &&
+                   Info->DataLength == sizeof(ULONG) &&
+                   *(PULONG)Info->Data == Seed;
+
+        case 1:
+            StringCchPrintfW(String, _countof(String), L"String data %lu for value %lu", Seed, Index);
+            return Info->Type == REG_SZ &&
+                   Info->DataLength == (wcslen(String) + 1) * sizeof(WCHAR) &&
+                   !memcmp(Info->Data, String, Info->DataLength);
+
+        default:
+            return Info->Type == REG_BINARY &&
+                   Info->DataLength == LARGE_DATA_SIZE &&
+                   Info->Data[0] == (UCHAR)Seed &&
+                   Info->Data[LARGE_DATA_SIZE - 1] == (UCHAR)Index;
+    }
+}
+
+static
+VOID
+TestValueCache(HANDLE KeyHandle, PKEY_VALUE_PARTIAL_INFORMATION Info, ULONG InfoLength)
+{
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"VALUE0");
+    UNICODE_STRING Missing = RTL_CONSTANT_STRING(L"Missing");
+    KEY_VALUE_BASIC_INFORMATION BasicInfo;
+    ULONG ResultLength, i, Found;
+    NTSTATUS Status;
+
+    /* Query everything twice, the second time comes from the cache */
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        ok(CheckTestValue(KeyHandle, i, 1, Info, InfoLength), "Value %lu is wrong\n", i);
+        ok(CheckTestValue(KeyHandle, i, 1, Info, InfoLength), "Cached value %lu is wrong\n", i);
+    }
+
+    /* Names are case insensitive */
+    Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, InfoLength, &ResultLength);
+    ok(Status == STATUS_SUCCESS, "NtQueryValueKey returned %lx\n", Status);
+
+    Status = NtQueryValueKey(KeyHandle, &Missing, KeyValuePartialInformation, Info, InfoLength, &ResultLength);
+    ok(Status == STATUS_OBJECT_NAME_NOT_FOUND, "NtQueryValueKey returned %lx\n", Status);
+
+    /* Changed data must show up right away */
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        Status = SetTestValue(KeyHandle, i, 2);
+        ok(Status == STATUS_SUCCESS, "NtSetValueKey returned %lx\n", Status);
+        ok(CheckTestValue(KeyHandle, i, 2, Info, InfoLength), "Value %lu wasn't updated\n", i);
+    }
+
+    /* So must deleted values */
+    RtlInitUnicodeString(&ValueName, L"Value2");
+    Status = NtDeleteValueKey(KeyHandle, &ValueName);
+    ok(Status == STATUS_SUCCESS, "NtDeleteValueKey returned %lx\n", Status);
+    Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, InfoLength, &ResultLength);
+    ok(Status == STATUS_OBJECT_NAME_NOT_FOUND, "NtQueryValueKey returned %lx\n", Status);
+
+    /* Enumeration must see one value less */
+    for (i = 0, Found = 0; ; i++)
+    {
+        Status = NtEnumerateValueKey(KeyHandle, i, KeyValueBasicInformation, &BasicInfo, sizeof(BasicInfo), &ResultLength);
+        if (Status == STATUS_NO_MORE_ENTRIES) break;
+        ok(Status == STATUS_SUCCESS || Status == STATUS_BUFFER_OVERFLOW, "NtEnumerateValueKey returned %lx\n", Status);
+        Found++;
+    }
+    ok(Found == VALUE_COUNT - 1, "Enumerated %lu values\n", Found);
+
+    /* And it comes back */
+    Status = SetTestValue(KeyHandle, 2, 2);
+    ok(Status == STATUS_SUCCESS, "NtSetValueKey returned %lx\n", Status);
+    ok(CheckTestValue(KeyHandle, 2, 2, Info, InfoLength), "Value 2 wasn't recreated\n");
+}
+
+START_TEST(NtQueryValueKey)
+{
+    UNICODE_STRING KeyName = RTL_CONSTANT_STRING(L"SOFTWARE\\ntdll-apitest-NtQueryValueKey");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    PKEY_VALUE_PARTIAL_INFORMATION Info;
+    HANDLE ParentKeyHandle, KeyHandle;
+    ULONG InfoLength, i;
+    NTSTATUS Status;
+
+    Status = RtlOpenCurrentUser(READ_CONTROL, &ParentKeyHandle);
+    ok(Status == STATUS_SUCCESS, "RtlOpenCurrentUser returned %lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("No user key handle\n");
+        return;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &KeyName,
+                               OBJ_CASE_INSENSITIVE,
+                               ParentKeyHandle,
+                               NULL);
+    Status = NtCreateKey(&KeyHandle,
+                         KEY_QUERY_VALUE | KEY_SET_VALUE | DELETE,
+                         &ObjectAttributes,
+                         0,
+                         NULL,
+                         REG_OPTION_VOLATILE,
+                         NULL);
+    ok(Status == STATUS_SUCCESS, "NtCreateKey returned %lx\n", Status);
+    NtClose(ParentKeyHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("No key handle\n");
+        return;
+    }
+
+    InfoLength = FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + LARGE_DATA_SIZE;
+    Info = RtlAllocateHeap(RtlGetProcessHeap(), 0, InfoLength);
+    if (!Info)
+    {
+        skip("Out of memory\n");
+        NtDeleteKey(KeyHandle);
+        NtClose(KeyHandle);
+        return;
+    }
+
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        Status = SetTestValue(KeyHandle, i, 1);
+        ok(Status == STATUS_SUCCESS, "NtSetValueKey returned %lx\n", Status);
+    }
+
+    TestValueCache(KeyHandle, Info, InfoLength);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Info);
+    Status = NtDeleteKey(KeyHandle);
+    ok(Status == STATUS_SUCCESS, "NtDeleteKey returned %lx\n", Status);
+    NtClose(KeyHandle);
+}
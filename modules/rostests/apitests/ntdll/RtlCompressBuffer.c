@@ -0,0 +1,167 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the LZNT1 compression routines
+ */
+
+#include "precomp.h"
+
+static NTSTATUS (NTAPI *pRtlCompressChunks)(PUCHAR, ULONG, PUCHAR, ULONG, PCOMPRESSED_DATA_INFO, ULONG, PVOID);
+static NTSTATUS (NTAPI *pRtlDecompressChunks)(PUCHAR, ULONG, PUCHAR, ULONG, PUCHAR, ULONG, PCOMPRESSED_DATA_INFO);
+static NTSTATUS (NTAPI *pRtlDescribeChunk)(USHORT, PUCHAR *, PUCHAR, PUCHAR *, PULONG);
+static NTSTATUS (NTAPI *pRtlReserveChunk)(USHORT, PUCHAR *, PUCHAR, PUCHAR *, ULONG);
+
+static
+void
+TestRoundTrip(USHORT FormatAndEngine, PUCHAR Data, ULONG Size, PULONG CompressedSize)
+{
+    PUCHAR Compressed, Decompressed, WorkSpace;
+    ULONG WorkSpaceSize, FragmentSize, FinalSize;
+    NTSTATUS Status;
+
+    *CompressedSize = 0;
+
+    Status = RtlGetCompressionWorkSpaceSize(FormatAndEngine, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* Incompressible data can grow by a header per chunk */
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, Size + Size / 16 + 16);
+    Decompressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, Size);
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    if (!Compressed || !Decompressed || !WorkSpace)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    Status = RtlCompressBuffer(FormatAndEngine, Data, Size, Compressed, Size + Size / 16 + 16,
+                               4096, &FinalSize, WorkSpace);
+    ok(Status == STATUS_SUCCESS, "RtlCompressBuffer returned %lx\n", Status);
+    if (!NT_SUCCESS(Status)) goto Cleanup;
+    *CompressedSize = FinalSize;
+
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, Decompressed, Size,
+                                 Compressed, FinalSize, &FinalSize);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressBuffer returned %lx\n", Status);
+    ok(FinalSize == Size, "Expected %lu bytes, got %lu\n", Size, FinalSize);
+    ok(!memcmp(Data, Decompressed, Size), "Data doesn't match\n");
+
+Cleanup:
+    if (WorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+    if (Decompressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Decompressed);
+    if (Compressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+}
+
+static
+void
+TestCompressBuffer(void)
+{
+    UCHAR Data[3 * 4096 + 100];
+    ULONG CompressedSize, i;
+
+    /* Text-like data has to compress well */
+    for (i = 0; i < sizeof(Data); i++)
+        Data[i] = "The quick brown fox jumps over the lazy dog. "[i % 45];
+
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, Data, sizeof(Data), &CompressedSize);
+    ok(CompressedSize && CompressedSize < sizeof(Data) / 4, "Compressed to %lu bytes\n", CompressedSize);
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM, Data, sizeof(Data), &CompressedSize);
+    ok(CompressedSize && CompressedSize < sizeof(Data) / 4, "Compressed to %lu bytes\n", CompressedSize);
+
+    /* Noise must survive as uncompressed chunks */
+    for (i = 0; i < sizeof(Data); i++)
+        Data[i] = (UCHAR)((i * 2654435761u) >> 13);
+
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, Data, sizeof(Data), &CompressedSize);
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM, Data, sizeof(Data), &CompressedSize);
+
+    /* Short inputs */
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1, Data, 1, &CompressedSize);
+    TestRoundTrip(COMPRESSION_FORMAT_LZNT1, Data, 4097, &CompressedSize);
+}
+
+static
+void
+TestChunks(void)
+{
+    UCHAR Data[4 * 4096], Compressed[5 * 4096], Decompressed[4 * 4096];
+    ULONG InfoBuffer[16], WorkSpaceSize, FragmentSize, ChunkSize, Total, i;
+    PCOMPRESSED_DATA_INFO Info = (PCOMPRESSED_DATA_INFO)InfoBuffer;
+    PUCHAR WorkSpace, Current, Chunk;
+    NTSTATUS Status;
+
+    if (!pRtlCompressChunks || !pRtlDecompressChunks || !pRtlDescribeChunk || !pRtlReserveChunk)
+    {
+        win_skip("Chunk compression API not available\n");
+        return;
+    }
+
+    RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1, &WorkSpaceSize, &FragmentSize);
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    if (!WorkSpace)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    /* Compressible, zero, incompressible and compressible again */
+    for (i = 0; i < 4096; i++)
+        Data[i] = (UCHAR)(i % 7);
+    RtlZeroMemory(Data + 4096, 4096);
+    for (i = 2 * 4096; i < 3 * 4096; i++)
+        Data[i] = (UCHAR)((i * 2654435761u) >> 13);
+    for (i = 3 * 4096; i < sizeof(Data); i++)
+        Data[i] = (UCHAR)(i % 5);
+
+    RtlZeroMemory(InfoBuffer, sizeof(InfoBuffer));
+    Info->CompressionFormatAndEngine = COMPRESSION_FORMAT_LZNT1;
+    Info->ChunkShift = 12;
+    Status = pRtlCompressChunks(Data, sizeof(Data), Compressed, sizeof(Compressed),
+                                Info, sizeof(InfoBuffer), WorkSpace);
+    ok(Status == STATUS_SUCCESS, "RtlCompressChunks returned %lx\n", Status);
+    ok(Info->NumberOfChunks == 4, "Expected 4 chunks, got %u\n", Info->NumberOfChunks);
+    ok(Info->CompressedChunkSizes[1] == 0, "Zero chunk has size %lu\n", Info->CompressedChunkSizes[1]);
+
+    /* Put the last chunk in the tail buffer */
+    Total = Info->CompressedChunkSizes[0] + Info->CompressedChunkSizes[1] + Info->CompressedChunkSizes[2];
+    RtlFillMemory(Decompressed, sizeof(Decompressed), 0xCC);
+    Status = pRtlDecompressChunks(Decompressed, sizeof(Decompressed), Compressed, Total,
+                                  Compressed + Total, Info->CompressedChunkSizes[3], Info);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressChunks returned %lx\n", Status);
+    ok(!memcmp(Data, Decompressed, sizeof(Data)), "Data doesn't match\n");
+
+    /* A reserved zero chunk decompresses to zeros and can be described */
+    Current = Compressed;
+    Status = pRtlReserveChunk(COMPRESSION_FORMAT_LZNT1, &Current, Compressed + sizeof(Compressed), &Chunk, 0);
+    ok(Status == STATUS_SUCCESS, "RtlReserveChunk returned %lx\n", Status);
+    *(PUSHORT)Current = 0;
+
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, Decompressed, 4096,
+                                 Compressed, (ULONG)(Current - Compressed) + 2, &ChunkSize);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressBuffer returned %lx\n", Status);
+    ok(ChunkSize == 4096, "Expected 4096 bytes, got %lu\n", ChunkSize);
+    ok(Decompressed[0] == 0 && Decompressed[4095] == 0, "Chunk isn't zero\n");
+
+    Current = Compressed;
+    Status = pRtlDescribeChunk(COMPRESSION_FORMAT_LZNT1, &Current, Compressed + sizeof(Compressed), &Chunk, &ChunkSize);
+    ok(Status == STATUS_SUCCESS, "RtlDescribeChunk returned %lx\n", Status);
+    ok(Chunk == Compressed, "Unexpected chunk %p\n", Chunk);
+    Status = pRtlDescribeChunk(COMPRESSION_FORMAT_LZNT1, &Current, Compressed + sizeof(Compressed), &Chunk, &ChunkSize);
+    ok(Status == STATUS_NO_MORE_ENTRIES, "RtlDescribeChunk returned %lx\n", Status);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    HMODULE Ntdll = GetModuleHandleW(L"ntdll.dll");
+
+    pRtlCompressChunks = (PVOID)GetProcAddress(Ntdll, "RtlCompressChunks");
+    pRtlDecompressChunks = (PVOID)GetProcAddress(Ntdll, "RtlDecompressChunks");
+    pRtlDescribeChunk = (PVOID)GetProcAddress(Ntdll, "RtlDescribeChunk");
+    pRtlReserveChunk = (PVOID)GetProcAddress(Ntdll, "RtlReserveChunk");
+
+    TestCompressBuffer();
+    TestChunks();
+}
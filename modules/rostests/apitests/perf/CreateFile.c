@@ -0,0 +1,139 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Benchmark for opening files in big directories
+ */
+
+#include "precomp.h"
+
+#define OPEN_ITERATIONS  2000
+
+static
+VOID
+GetTestFileName(PWSTR Buffer, SIZE_T BufferLength, PCWSTR Directory, ULONG Index)
+{
+    StringCchPrintfW(Buffer, BufferLength, L"%s\\Log file number %05lu.txt", Directory, Index);
+}
+
+static
+BOOL
+OpenTestFile(PCWSTR FileName)
+{
+    HANDLE File;
+
+    File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE) return FALSE;
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+ULONG
+CreateTestDirectory(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH];
+    HANDLE File;
+    ULONG i;
+
+    if (!CreateDirectoryW(Directory, NULL)) return 0;
+
+    for (i = 0; i < FileCount; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, i);
+        File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        if (File == INVALID_HANDLE_VALUE) break;
+        CloseHandle(File);
+    }
+
+    return i;
+}
+
+static
+VOID
+DeleteTestDirectory(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < FileCount; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, i);
+        DeleteFileW(FileName);
+    }
+
+    RemoveDirectoryW(Directory);
+}
+
+static
+VOID
+BenchmarkLookups(PCWSTR Directory, ULONG FileCount)
+{
+    WCHAR FileName[MAX_PATH];
+    ULONGLONG HitTime, MissTime;
+    ULONG i, Seed = 1, Failures = 0, Found = 0;
+    PERF_TIMER Timer;
+    HANDLE DirectoryHandle;
+
+    /* Keep the directory open, so that it stays known to the file system */
+    DirectoryHandle = CreateFileW(Directory, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+
+    PerfStartTimer(&Timer);
+
+    for (i = 0; i < OPEN_ITERATIONS; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, PerfRandom(&Seed) % FileCount);
+        if (!OpenTestFile(FileName)) Failures++;
+    }
+
+    HitTime = PerfElapsedMs(&Timer);
+    PerfStartTimer(&Timer);
+
+    /* Names which don't exist have to be looked up completely */
+    for (i = 0; i < OPEN_ITERATIONS; i++)
+    {
+        GetTestFileName(FileName, _countof(FileName), Directory, FileCount + i);
+        if (OpenTestFile(FileName)) Found++;
+    }
+
+    MissTime = PerfElapsedMs(&Timer);
+
+    if (DirectoryHandle != INVALID_HANDLE_VALUE) CloseHandle(DirectoryHandle);
+
+    ok(Failures == 0, "%lu opens failed\n", Failures);
+    ok(Found == 0, "%lu missing files were found\n", Found);
+    trace("%lu files: %d opens in %I64u ms, %d misses in %I64u ms\n",
+          FileCount, OPEN_ITERATIONS, HitTime, OPEN_ITERATIONS, MissTime);
+}
+
+START_TEST(CreateFile)
+{
+    /*
+     * Each of our names takes three FAT directory entries (two long name
+     * entries and the short one), and a FAT directory can't hold more than
+     * 65536 entries, so stay well below 21845 files.
+     */
+    static const ULONG FileCounts[] = { 100, 1000, 10000 };
+    WCHAR TempPath[MAX_PATH], Directory[MAX_PATH];
+    ULONG i, Created;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+
+    for (i = 0; i < _countof(FileCounts); i++)
+    {
+        StringCchPrintfW(Directory, _countof(Directory), L"%sCreateFile%lu", TempPath, FileCounts[i]);
+
+        Created = CreateTestDirectory(Directory, FileCounts[i]);
+        if (Created != FileCounts[i])
+        {
+            skip("Only created %lu of %lu files\n", Created, FileCounts[i]);
+            DeleteTestDirectory(Directory, Created);
+            break;
+        }
+
+        BenchmarkLookups(Directory, FileCounts[i]);
+
+        DeleteTestDirectory(Directory, FileCounts[i]);
+    }
+}
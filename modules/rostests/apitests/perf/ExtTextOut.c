@@ -0,0 +1,143 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Glyph cache benchmark for ExtTextOut
+ */
+
+#include "precomp.h"
+
+#define BITMAP_WIDTH    640
+#define BITMAP_HEIGHT   100
+#define FIRST_CHAR      0x20
+#define LAST_CHAR       0x24F
+#define BENCHMARK_PASSES 20
+
+static PULONG Bits;
+
+static
+HFONT
+CreateTestFont(INT Height, INT Escapement, DWORD Quality)
+{
+    LOGFONTW LogFont;
+
+    ZeroMemory(&LogFont, sizeof(LogFont));
+    LogFont.lfHeight = Height;
+    LogFont.lfEscapement = Escapement;
+    LogFont.lfOrientation = Escapement;
+    LogFont.lfWeight = FW_NORMAL;
+    LogFont.lfCharSet = DEFAULT_CHARSET;
+    LogFont.lfQuality = (BYTE)Quality;
+    wcscpy(LogFont.lfFaceName, L"Tahoma");
+
+    return CreateFontIndirectW(&LogFont);
+}
+
+static
+VOID
+DrawTestText(HDC hdc, HFONT Font, PCWSTR Text, INT Length)
+{
+    RECT Rect = { 0, 0, BITMAP_WIDTH, BITMAP_HEIGHT };
+    HFONT OldFont;
+
+    OldFont = SelectObject(hdc, Font);
+    ExtTextOutW(hdc, 10, 50, ETO_OPAQUE, &Rect, Text, Length, NULL);
+    SelectObject(hdc, OldFont);
+}
+
+/* Draws every glyph of the range in chunks, which is more than the cache used to hold */
+static
+ULONG
+DrawAllGlyphs(HDC hdc, HFONT Font)
+{
+    WCHAR Text[64];
+    ULONG Glyphs = 0;
+    WCHAR Char = FIRST_CHAR;
+    INT i;
+
+    while (Char <= LAST_CHAR)
+    {
+        for (i = 0; i < _countof(Text) && Char <= LAST_CHAR; i++)
+            Text[i] = Char++;
+
+        DrawTestText(hdc, Font, Text, i);
+        Glyphs += i;
+    }
+
+    return Glyphs;
+}
+
+static
+VOID
+BenchmarkGlyphCache(HDC hdc)
+{
+    static const INT Heights[] = { -11, -13, -16, -24 };
+    HFONT Fonts[_countof(Heights)];
+    ULONG Glyphs = 0, Pass;
+    ULONGLONG Milliseconds;
+    PERF_TIMER Timer;
+    INT i;
+
+    for (i = 0; i < _countof(Heights); i++)
+        Fonts[i] = CreateTestFont(Heights[i], 0, ANTIALIASED_QUALITY);
+
+    /* Warm up the cache */
+    for (i = 0; i < _countof(Heights); i++)
+        DrawAllGlyphs(hdc, Fonts[i]);
+
+    PerfStartTimer(&Timer);
+
+    for (Pass = 0; Pass < BENCHMARK_PASSES; Pass++)
+    {
+        for (i = 0; i < _countof(Heights); i++)
+            Glyphs += DrawAllGlyphs(hdc, Fonts[i]);
+    }
+
+    Milliseconds = PerfElapsedMs(&Timer);
+    trace("%lu glyphs in %I64u ms, %I64u glyphs per second\n",
+          Glyphs, Milliseconds, PerfRate(Glyphs, Milliseconds));
+
+    for (i = 0; i < _countof(Heights); i++)
+        DeleteObject(Fonts[i]);
+}
+
+START_TEST(ExtTextOut)
+{
+    BITMAPINFO bmi;
+    HBITMAP hbmp, hbmpOld;
+    HDC hdc;
+
+    hdc = CreateCompatibleDC(NULL);
+    ok(hdc != NULL, "CreateCompatibleDC failed\n");
+    if (!hdc)
+    {
+        skip("No DC\n");
+        return;
+    }
+
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = BITMAP_WIDTH;
+    bmi.bmiHeader.biHeight = -BITMAP_HEIGHT;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    hbmp = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, (PVOID*)&Bits, NULL, 0);
+    ok(hbmp != NULL, "CreateDIBSection failed\n");
+    if (!hbmp)
+    {
+        skip("No bitmap\n");
+        DeleteDC(hdc);
+        return;
+    }
+
+    hbmpOld = SelectObject(hdc, hbmp);
+    SetBkColor(hdc, RGB(255, 255, 255));
+    SetTextColor(hdc, RGB(0, 0, 0));
+
+    BenchmarkGlyphCache(hdc);
+
+    SelectObject(hdc, hbmpOld);
+    DeleteObject(hbmp);
+    DeleteDC(hdc);
+}
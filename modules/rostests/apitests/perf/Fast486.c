@@ -0,0 +1,216 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Instruction throughput and paging benchmark for Fast486
+ */
+
+#include "precomp.h"
+
+#include <fast486.h>
+
+#define MEMORY_SIZE     (4 * 1024 * 1024)
+#define CODE_SEGMENT    0x1000
+#define DATA_OFFSET     0x2000
+#define DATA_SIZE       0x100
+#define OUTER_LOOPS     16
+
+/* Every outer loop runs 65536 times through the inner one */
+#define INNER_INSTRUCTIONS  (65536 * 4 + 3)
+
+/* Protected mode layout, identity mapped through a single page table */
+#define GDT_BASE        0x1000
+#define PAGE_DIRECTORY  0x2000
+#define PAGE_TABLE      0x3000
+#define PAGED_CODE      0x20000
+#define PAGED_DATA      0x100000
+#define PAGED_DATA_END  0x300000
+#define PAGED_PASSES    2000
+
+/* Every pass touches each data page once, then reloads CR3 like a task switch would */
+#define PAGED_PASS_INSTRUCTIONS  (1 + (PAGED_DATA_END - PAGED_DATA) / 0x1000 * 4 + 3)
+
+static PUCHAR Memory;
+static FAST486_STATE State;
+static FAST486_TLB_ENTRY Tlb[FAST486_TLB_ENTRIES];
+
+/* Sum words from a 256 byte buffer, 65536 * DX times */
+static const UCHAR LoopCode[] =
+{
+    0x31, 0xC0,                 /* 0100: xor ax, ax */
+    0xBB, 0x00, 0x20,           /* 0102: mov bx, 2000h */
+    0xB9, 0x00, 0x00,           /* 0105: mov cx, 0 */
+    0x03, 0x07,                 /* 0108: add ax, [bx] */
+    0x43,                       /* 010A: inc bx */
+    0x81, 0xE3, 0xFF, 0x20,     /* 010B: and bx, 20FFh */
+    0xE2, 0xF7,                 /* 010F: loop 0108 */
+    0x4A,                       /* 0111: dec dx */
+    0x75, 0xF1,                 /* 0112: jnz 0105 */
+    0xF4                        /* 0114: hlt */
+};
+
+/* Flat 4 GB 32-bit code (08h) and data (10h) segments */
+static const UCHAR Gdt[] =
+{
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xFF, 0xFF, 0x00, 0x00, 0x00, 0x9A, 0xCF, 0x00,
+    0xFF, 0xFF, 0x00, 0x00, 0x00, 0x92, 0xCF, 0x00
+};
+
+/* Sum the first dword of every data page, ECX times */
+static const UCHAR PagedCode[] =
+{
+    0x31, 0xC0,                         /* 00: xor eax, eax */
+    0xBB, 0x00, 0x00, 0x10, 0x00,       /* 02: mov ebx, 100000h */
+    0x03, 0x03,                         /* 07: add eax, [ebx] */
+    0x81, 0xC3, 0x00, 0x10, 0x00, 0x00, /* 09: add ebx, 1000h */
+    0x81, 0xFB, 0x00, 0x00, 0x30, 0x00, /* 0F: cmp ebx, 300000h */
+    0x72, 0xF0,                         /* 15: jb 07 */
+    0x0F, 0x20, 0xDA,                   /* 17: mov edx, cr3 */
+    0x0F, 0x22, 0xDA,                   /* 1A: mov cr3, edx */
+    0xE2, 0xE3,                         /* 1D: loop 02 */
+    0xF4                                /* 1F: hlt */
+};
+
+static
+VOID
+FASTCALL
+MemReadCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        RtlCopyMemory(Buffer, Memory + Address, Size);
+    else
+        RtlFillMemory(Buffer, Size, 0xFF);
+}
+
+static
+VOID
+FASTCALL
+MemWriteCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    if (Address < MEMORY_SIZE && Size <= MEMORY_SIZE - Address)
+        RtlCopyMemory(Memory + Address, Buffer, Size);
+}
+
+static
+ULONGLONG
+RunCode(USHORT Segment, ULONG Offset)
+{
+    ULONGLONG Instructions = 0;
+
+    State.Halted = FALSE;
+    Fast486ExecuteAt(&State, Segment, Offset);
+
+    while (!State.Halted)
+    {
+        Fast486StepInto(&State);
+        Instructions++;
+    }
+
+    return Instructions;
+}
+
+static
+VOID
+BenchmarkLoop(VOID)
+{
+    PUSHORT Data = (PUSHORT)(Memory + CODE_SEGMENT * 16 + DATA_OFFSET);
+    ULONGLONG Instructions, Microseconds;
+    PERF_TIMER Timer;
+    USHORT Expected = 0;
+    ULONG i;
+
+    RtlCopyMemory(Memory + CODE_SEGMENT * 16 + 0x100, LoopCode, sizeof(LoopCode));
+    for (i = 0; i < DATA_SIZE / sizeof(USHORT) + 1; i++)
+        Data[i] = (USHORT)(i * 0x9E37 + 1);
+
+    /* The same sum, computed natively */
+    for (i = 0; i < OUTER_LOOPS * 65536; i++)
+        Expected += *(PUSHORT)((PUCHAR)Data + (i % DATA_SIZE));
+
+    Fast486SetSegment(&State, FAST486_REG_DS, CODE_SEGMENT);
+    State.GeneralRegs[FAST486_REG_EDX].LowWord = OUTER_LOOPS;
+
+    PerfStartTimer(&Timer);
+    Instructions = RunCode(CODE_SEGMENT, 0x100);
+    Microseconds = PerfElapsedUs(&Timer);
+
+    ok(Instructions == 3 + OUTER_LOOPS * INNER_INSTRUCTIONS, "Executed %I64u instructions\n", Instructions);
+    ok(State.GeneralRegs[FAST486_REG_EAX].LowWord == Expected,
+       "AX is %x, expected %x\n", State.GeneralRegs[FAST486_REG_EAX].LowWord, Expected);
+
+    trace("real mode, %I64u instructions: %I64u ms, %I64u MIPS\n",
+          Instructions, Microseconds / 1000, Instructions / Microseconds);
+}
+
+static
+VOID
+BenchmarkPaging(VOID)
+{
+    PULONG PageDirectory = (PULONG)(Memory + PAGE_DIRECTORY);
+    PULONG PageTable = (PULONG)(Memory + PAGE_TABLE);
+    ULONGLONG Instructions, Microseconds;
+    ULONG Expected = 0, Page;
+    PERF_TIMER Timer;
+
+    RtlCopyMemory(Memory + GDT_BASE, Gdt, sizeof(Gdt));
+    RtlCopyMemory(Memory + PAGED_CODE, PagedCode, sizeof(PagedCode));
+
+    /* Present, writable and user accessible */
+    PageDirectory[0] = PAGE_TABLE | 7;
+    for (Page = 0; Page < MEMORY_SIZE / 0x1000; Page++)
+        PageTable[Page] = (Page * 0x1000) | 7;
+
+    for (Page = PAGED_DATA; Page < PAGED_DATA_END; Page += 0x1000)
+    {
+        *(PULONG)(Memory + Page) = Page >> 12;
+        Expected += (Page >> 12) * PAGED_PASSES;
+    }
+
+    State.Gdtr.Address = GDT_BASE;
+    State.Gdtr.Size = sizeof(Gdt) - 1;
+    State.ControlRegisters[FAST486_REG_CR3] = PAGE_DIRECTORY;
+    State.ControlRegisters[FAST486_REG_CR0] |= FAST486_CR0_PE | FAST486_CR0_PG;
+
+    Fast486SetSegment(&State, FAST486_REG_DS, 0x10);
+    Fast486SetSegment(&State, FAST486_REG_ES, 0x10);
+    Fast486SetStack(&State, 0x10, PAGED_CODE);
+    State.GeneralRegs[FAST486_REG_ECX].Long = PAGED_PASSES;
+
+    PerfStartTimer(&Timer);
+    Instructions = RunCode(0x08, PAGED_CODE);
+    Microseconds = PerfElapsedUs(&Timer);
+
+    ok(Instructions == 2 + PAGED_PASSES * PAGED_PASS_INSTRUCTIONS, "Executed %I64u instructions\n", Instructions);
+    ok(State.GeneralRegs[FAST486_REG_EAX].Long == Expected,
+       "EAX is %lx, expected %lx\n", State.GeneralRegs[FAST486_REG_EAX].Long, Expected);
+
+    trace("paging, %I64u instructions and %d CR3 loads: %I64u ms, %I64u MIPS\n",
+          Instructions, PAGED_PASSES, Microseconds / 1000, Instructions / Microseconds);
+}
+
+START_TEST(Fast486)
+{
+    Memory = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MEMORY_SIZE);
+    if (!Memory)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      Tlb);
+
+    BenchmarkLoop();
+
+    /* This one leaves the CPU in protected mode with paging */
+    BenchmarkPaging();
+
+    HeapFree(GetProcessHeap(), 0, Memory);
+}
@@ -0,0 +1,125 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Stress benchmark for the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define STRESS_THREADS     4
+#define STRESS_ITERATIONS  200000
+#define STRESS_SLOTS       64
+
+typedef struct _STRESS_CONTEXT
+{
+    HANDLE Heap;
+    ULONG Seed;
+    ULONG Failures;
+} STRESS_CONTEXT, *PSTRESS_CONTEXT;
+
+static
+DWORD
+WINAPI
+StressThread(LPVOID Parameter)
+{
+    PSTRESS_CONTEXT Context = Parameter;
+    PUCHAR Blocks[STRESS_SLOTS] = { NULL };
+    SIZE_T Sizes[STRESS_SLOTS] = { 0 };
+    ULONG i, Slot, Random;
+
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        /* Small, mostly short lived allocations */
+        Random = PerfRandom(&Context->Seed);
+        Slot = Random % STRESS_SLOTS;
+
+        if (Blocks[Slot])
+        {
+            /* Make sure nobody else touched our block */
+            if (Blocks[Slot][0] != (UCHAR)Sizes[Slot] ||
+                Blocks[Slot][Sizes[Slot] - 1] != (UCHAR)Slot)
+            {
+                Context->Failures++;
+            }
+
+            HeapFree(Context->Heap, 0, Blocks[Slot]);
+            Blocks[Slot] = NULL;
+        }
+        else
+        {
+            Sizes[Slot] = 1 + ((Random >> 8) % 256);
+            Blocks[Slot] = HeapAlloc(Context->Heap, 0, Sizes[Slot]);
+            if (!Blocks[Slot])
+            {
+                Context->Failures++;
+                continue;
+            }
+
+            Blocks[Slot][0] = (UCHAR)Sizes[Slot];
+            Blocks[Slot][Sizes[Slot] - 1] = (UCHAR)Slot;
+        }
+    }
+
+    for (Slot = 0; Slot < STRESS_SLOTS; Slot++)
+    {
+        if (Blocks[Slot]) HeapFree(Context->Heap, 0, Blocks[Slot]);
+    }
+
+    return 0;
+}
+
+static
+ULONGLONG
+RunStress(HANDLE Heap)
+{
+    STRESS_CONTEXT Contexts[STRESS_THREADS];
+    HANDLE Threads[STRESS_THREADS];
+    PERF_TIMER Timer;
+    ULONG i;
+
+    PerfStartTimer(&Timer);
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        Contexts[i].Heap = Heap;
+        Contexts[i].Seed = i + 1;
+        Contexts[i].Failures = 0;
+        Threads[i] = CreateThread(NULL, 0, StressThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+        ok(Contexts[i].Failures == 0, "Thread %lu had %lu failures\n", i, Contexts[i].Failures);
+    }
+
+    return PerfElapsedMs(&Timer);
+}
+
+START_TEST(HeapSetInformation)
+{
+    HANDLE Heap;
+    ULONG Info = 2;
+    ULONGLONG BackEnd, FrontEnd;
+
+    Heap = HeapCreate(0, 0, 0);
+    ok(Heap != NULL, "HeapCreate failed with %lu\n", GetLastError());
+    if (!Heap) return;
+    BackEnd = RunStress(Heap);
+    HeapDestroy(Heap);
+
+    Heap = HeapCreate(0, 0, 0);
+    ok(Heap != NULL, "HeapCreate failed with %lu\n", GetLastError());
+    if (!Heap) return;
+    ok(HeapSetInformation(Heap, HeapCompatibilityInformation, &Info, sizeof(Info)),
+       "HeapSetInformation failed with %lu\n", GetLastError());
+    FrontEnd = RunStress(Heap);
+    ok(HeapValidate(Heap, 0, NULL), "Heap isn't valid\n");
+    HeapDestroy(Heap);
+
+    trace("%d threads x %d operations: back end %I64u ms, front end %I64u ms\n",
+          STRESS_THREADS, STRESS_ITERATIONS, BackEnd, FrontEnd);
+}
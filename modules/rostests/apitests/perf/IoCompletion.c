@@ -0,0 +1,100 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Benchmark for batched completion port dequeues
+ */
+
+#include "precomp.h"
+
+#define PACKETS           100000
+#define MAX_BATCH         64
+
+/* Same layout as the Vista OVERLAPPED_ENTRY, which we don't get at 0x502 */
+typedef struct _IOCP_ENTRY
+{
+    ULONG_PTR lpCompletionKey;
+    LPOVERLAPPED lpOverlapped;
+    ULONG_PTR Internal;
+    DWORD dwNumberOfBytesTransferred;
+} IOCP_ENTRY, *PIOCP_ENTRY;
+
+static BOOL (WINAPI *pGetQueuedCompletionStatusEx)(HANDLE, PIOCP_ENTRY, ULONG, PULONG, DWORD, BOOL);
+
+static
+VOID
+BenchmarkRemove(ULONG Batch)
+{
+    IOCP_ENTRY Entries[MAX_BATCH];
+    HANDLE Port;
+    ULONGLONG Elapsed;
+    PERF_TIMER Timer;
+    ULONG Total, Removed, Calls, i;
+    BOOL ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    for (i = 0; i < PACKETS; i++)
+    {
+        if (!PostQueuedCompletionStatus(Port, 0, i, NULL))
+        {
+            ok(FALSE, "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+            CloseHandle(Port);
+            return;
+        }
+    }
+
+    PerfStartTimer(&Timer);
+
+    /* Drain the port, one system call per batch */
+    Total = 0;
+    Calls = 0;
+    while (Total < PACKETS)
+    {
+        ret = pGetQueuedCompletionStatusEx(Port, Entries, Batch, &Removed, 0, FALSE);
+        if (!ret)
+            break;
+
+        Total += Removed;
+        Calls++;
+    }
+
+    Elapsed = PerfElapsedMs(&Timer);
+
+    ok(Total == PACKETS, "Removed %lu of %u packets\n", Total, PACKETS);
+
+    trace("batch=%2lu: %lu packets in %lu calls, %I64u ms, %I64u packets/s\n",
+          Batch,
+          Total,
+          Calls,
+          Elapsed,
+          PerfRate(Total, Elapsed));
+
+    CloseHandle(Port);
+}
+
+START_TEST(IoCompletion)
+{
+    HMODULE hKernel;
+
+    /* Vista has it in kernel32, we keep it in kernel32_vista */
+    hKernel = GetModuleHandleA("kernel32.dll");
+    pGetQueuedCompletionStatusEx = (void *)GetProcAddress(hKernel, "GetQueuedCompletionStatusEx");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        hKernel = LoadLibraryA("kernel32_vista.dll");
+        if (hKernel)
+            pGetQueuedCompletionStatusEx = (void *)GetProcAddress(hKernel, "GetQueuedCompletionStatusEx");
+    }
+
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx not available\n");
+        return;
+    }
+
+    BenchmarkRemove(1);
+    BenchmarkRemove(MAX_BATCH);
+}
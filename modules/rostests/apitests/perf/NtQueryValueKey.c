@@ -0,0 +1,98 @@
+/*
+ * PROJECT:         ReactOS API tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Query benchmark for NtQueryValueKey
+ */
+
+#include "precomp.h"
+
+#define VALUE_COUNT         64
+#define DATA_SIZE           64
+#define BENCHMARK_PASSES    2000
+
+static
+VOID
+GetValueName(PUNICODE_STRING ValueName, PWSTR Buffer, SIZE_T BufferLength, ULONG Index)
+{
+    /* Every other name can't be stored compressed */
+    StringCchPrintfW(Buffer, BufferLength, (Index & 1) ? L"Value\x00e9\x0411%lu" : L"Value%lu", Index);
+    RtlInitUnicodeString(ValueName, Buffer);
+}
+
+START_TEST(NtQueryValueKey)
+{
+    UNICODE_STRING KeyName = RTL_CONSTANT_STRING(L"SOFTWARE\\perf-apitest-NtQueryValueKey");
+    UCHAR InfoBuffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + DATA_SIZE];
+    PKEY_VALUE_PARTIAL_INFORMATION Info = (PKEY_VALUE_PARTIAL_INFORMATION)InfoBuffer;
+    UCHAR Data[DATA_SIZE] = { 0 };
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE ParentKeyHandle, KeyHandle;
+    UNICODE_STRING ValueName;
+    WCHAR Name[32];
+    ULONG Pass, i, ResultLength, Hits = 0, Misses = 0;
+    ULONGLONG Milliseconds;
+    PERF_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = RtlOpenCurrentUser(READ_CONTROL, &ParentKeyHandle);
+    ok(Status == STATUS_SUCCESS, "RtlOpenCurrentUser returned %lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("No user key handle\n");
+        return;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &KeyName,
+                               OBJ_CASE_INSENSITIVE,
+                               ParentKeyHandle,
+                               NULL);
+    Status = NtCreateKey(&KeyHandle,
+                         KEY_QUERY_VALUE | KEY_SET_VALUE | DELETE,
+                         &ObjectAttributes,
+                         0,
+                         NULL,
+                         REG_OPTION_VOLATILE,
+                         NULL);
+    ok(Status == STATUS_SUCCESS, "NtCreateKey returned %lx\n", Status);
+    NtClose(ParentKeyHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("No key handle\n");
+        return;
+    }
+
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        GetValueName(&ValueName, Name, _countof(Name), i);
+        Status = NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY, Data, (i % DATA_SIZE) + 1);
+        ok(Status == STATUS_SUCCESS, "NtSetValueKey returned %lx\n", Status);
+    }
+
+    PerfStartTimer(&Timer);
+
+    /* Query every value and the same number of missing ones, over and over */
+    for (Pass = 0; Pass < BENCHMARK_PASSES; Pass++)
+    {
+        for (i = 0; i < 2 * VALUE_COUNT; i++)
+        {
+            GetValueName(&ValueName, Name, _countof(Name), i);
+            Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, sizeof(InfoBuffer), &ResultLength);
+            if (NT_SUCCESS(Status))
+                Hits++;
+            else if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+                Misses++;
+        }
+    }
+
+    Milliseconds = PerfElapsedMs(&Timer);
+
+    ok(Hits == BENCHMARK_PASSES * VALUE_COUNT, "Got %lu hits\n", Hits);
+    ok(Misses == BENCHMARK_PASSES * VALUE_COUNT, "Got %lu misses\n", Misses);
+    trace("%lu queries (%lu hits, %lu misses) over %d values: %I64u ms, %I64u queries/s\n",
+          Hits + Misses, Hits, Misses, VALUE_COUNT, Milliseconds, PerfRate(Hits + Misses, Milliseconds));
+
+    Status = NtDeleteKey(KeyHandle);
+    ok(Status == STATUS_SUCCESS, "NtDeleteKey returned %lx\n", Status);
+    NtClose(KeyHandle);
+}
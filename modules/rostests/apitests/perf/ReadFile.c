@@ -0,0 +1,165 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         File server style benchmark for cached reads
+ */
+
+#include "precomp.h"
+
+#define READ_BLOCK_SIZE   (64 * 1024)
+#define READ_ITERATIONS   2000
+#define MAX_THREADS       8
+
+typedef struct _READ_CONTEXT
+{
+    PCWSTR FileName;
+    ULONG FileSize;
+    ULONG Seed;
+    ULONG Failures;
+} READ_CONTEXT, *PREAD_CONTEXT;
+
+/* Every DWORD of the file holds its own offset */
+static
+BOOL
+CreateTestFile(PCWSTR FileName, ULONG FileSize)
+{
+    PULONG Buffer;
+    HANDLE File;
+    ULONG Offset, i;
+    DWORD Written;
+    BOOL Ret = TRUE;
+
+    File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+    if (File == INVALID_HANDLE_VALUE) return FALSE;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, READ_BLOCK_SIZE);
+    if (!Buffer)
+    {
+        CloseHandle(File);
+        return FALSE;
+    }
+
+    for (Offset = 0; Offset < FileSize && Ret; Offset += READ_BLOCK_SIZE)
+    {
+        for (i = 0; i < READ_BLOCK_SIZE / sizeof(ULONG); i++)
+            Buffer[i] = Offset + i * sizeof(ULONG);
+
+        Ret = WriteFile(File, Buffer, READ_BLOCK_SIZE, &Written, NULL) && Written == READ_BLOCK_SIZE;
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+    return Ret;
+}
+
+static
+DWORD
+WINAPI
+ReadThread(LPVOID Parameter)
+{
+    PREAD_CONTEXT Context = Parameter;
+    ULONG Offset, i;
+    HANDLE File;
+    PULONG Buffer;
+    DWORD Read;
+
+    /* Every client gets its own handle, like a file server would */
+    File = CreateFileW(Context->FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        Context->Failures++;
+        return 0;
+    }
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, READ_BLOCK_SIZE);
+    if (!Buffer)
+    {
+        Context->Failures++;
+        CloseHandle(File);
+        return 0;
+    }
+
+    for (i = 0; i < READ_ITERATIONS; i++)
+    {
+        Offset = (PerfRandom(&Context->Seed) % (Context->FileSize / READ_BLOCK_SIZE)) * READ_BLOCK_SIZE;
+
+        SetFilePointer(File, Offset, NULL, FILE_BEGIN);
+        if (!ReadFile(File, Buffer, READ_BLOCK_SIZE, &Read, NULL) ||
+            Read != READ_BLOCK_SIZE ||
+            Buffer[0] != Offset ||
+            Buffer[READ_BLOCK_SIZE / sizeof(ULONG) - 1] != Offset + READ_BLOCK_SIZE - sizeof(ULONG))
+        {
+            Context->Failures++;
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+    return 0;
+}
+
+static
+ULONGLONG
+RunReaders(PCWSTR FileName, ULONG FileSize, ULONG ThreadCount)
+{
+    READ_CONTEXT Contexts[MAX_THREADS];
+    HANDLE Threads[MAX_THREADS];
+    PERF_TIMER Timer;
+    ULONG i;
+
+    PerfStartTimer(&Timer);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Contexts[i].FileName = FileName;
+        Contexts[i].FileSize = FileSize;
+        Contexts[i].Seed = i + 1;
+        Contexts[i].Failures = 0;
+        Threads[i] = CreateThread(NULL, 0, ReadThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+        ok(Contexts[i].Failures == 0, "Thread %lu had %lu failures\n", i, Contexts[i].Failures);
+    }
+
+    return PerfElapsedMs(&Timer);
+}
+
+START_TEST(ReadFile)
+{
+    static const ULONG FileSizes[] = { 1 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+    static const ULONG ThreadCounts[] = { 1, 2, 4, 8 };
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    ULONGLONG Milliseconds;
+    ULONG Size, Threads;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"crd", 0, FileName);
+
+    for (Size = 0; Size < _countof(FileSizes); Size++)
+    {
+        if (!CreateTestFile(FileName, FileSizes[Size]))
+        {
+            skip("Failed to create a %lu MB file\n", FileSizes[Size] / (1024 * 1024));
+            break;
+        }
+
+        /* Warm up the cache, so that we measure lookups rather than the disk */
+        RunReaders(FileName, FileSizes[Size], 1);
+
+        for (Threads = 0; Threads < _countof(ThreadCounts); Threads++)
+        {
+            Milliseconds = RunReaders(FileName, FileSizes[Size], ThreadCounts[Threads]);
+            trace("%lu MB file, %lu threads: %I64u ms, %I64u MB/s\n",
+                  FileSizes[Size] / (1024 * 1024), ThreadCounts[Threads], Milliseconds,
+                  PerfRate((ULONGLONG)ThreadCounts[Threads] * READ_ITERATIONS * READ_BLOCK_SIZE, Milliseconds) / (1024 * 1024));
+        }
+    }
+
+    DeleteFileW(FileName);
+}
@@ -0,0 +1,117 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Benchmark for the LZNT1 compression routines
+ */
+
+#include "precomp.h"
+
+static const PCWSTR CorpusFiles[] =
+{
+    L"ntdll.dll",
+    L"kernel32.dll",
+    L"user32.dll",
+    L"shell32.dll",
+    L"regedit.exe",
+};
+
+#define CORPUS_MAX_SIZE  (4 * 1024 * 1024)
+
+static
+PUCHAR
+LoadCorpusFile(PCWSTR FileName, PULONG Size)
+{
+    WCHAR Path[MAX_PATH];
+    HANDLE File;
+    PUCHAR Buffer;
+    DWORD Read = 0;
+
+    GetSystemDirectoryW(Path, _countof(Path));
+    StringCchCatW(Path, _countof(Path), L"\\");
+    StringCchCatW(Path, _countof(Path), FileName);
+
+    File = CreateFileW(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE) return NULL;
+
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, CORPUS_MAX_SIZE);
+    if (Buffer && (!ReadFile(File, Buffer, CORPUS_MAX_SIZE, &Read, NULL) || Read == 0))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+        Buffer = NULL;
+    }
+
+    CloseHandle(File);
+    *Size = Read;
+    return Buffer;
+}
+
+static
+VOID
+BenchmarkCorpus(USHORT FormatAndEngine, PCSTR Name)
+{
+    ULONG File, Size, CompressedSize, FinalSize, WorkSpaceSize, FragmentSize;
+    ULONG Uncompressed = 0, Compressed = 0;
+    ULONGLONG CompressTime = 0, DecompressTime = 0;
+    PUCHAR Data, CompressedData, Decompressed, WorkSpace;
+    PERF_TIMER Timer;
+    NTSTATUS Status;
+
+    Status = RtlGetCompressionWorkSpaceSize(FormatAndEngine, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* Incompressible data can grow by a header per chunk */
+    CompressedData = RtlAllocateHeap(RtlGetProcessHeap(), 0, CORPUS_MAX_SIZE + CORPUS_MAX_SIZE / 16 + 16);
+    Decompressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, CORPUS_MAX_SIZE);
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    if (!CompressedData || !Decompressed || !WorkSpace)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    for (File = 0; File < _countof(CorpusFiles); File++)
+    {
+        Data = LoadCorpusFile(CorpusFiles[File], &Size);
+        if (!Data) continue;
+
+        PerfStartTimer(&Timer);
+        Status = RtlCompressBuffer(FormatAndEngine, Data, Size, CompressedData, Size + Size / 16 + 16,
+                                   4096, &CompressedSize, WorkSpace);
+        CompressTime += PerfElapsedMs(&Timer);
+        ok(Status == STATUS_SUCCESS, "RtlCompressBuffer returned %lx for %S\n", Status, CorpusFiles[File]);
+
+        if (NT_SUCCESS(Status))
+        {
+            PerfStartTimer(&Timer);
+            Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, Decompressed, Size,
+                                         CompressedData, CompressedSize, &FinalSize);
+            DecompressTime += PerfElapsedMs(&Timer);
+            ok(Status == STATUS_SUCCESS, "RtlDecompressBuffer returned %lx for %S\n", Status, CorpusFiles[File]);
+            ok(FinalSize == Size && !memcmp(Data, Decompressed, Size), "%S doesn't match\n", CorpusFiles[File]);
+
+            Uncompressed += Size;
+            Compressed += CompressedSize;
+        }
+
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Data);
+    }
+
+    if (Uncompressed)
+    {
+        trace("%s engine: %lu -> %lu bytes (%lu%%), compress %I64u ms, decompress %I64u ms\n",
+              Name, Uncompressed, Compressed, (ULONG)((ULONGLONG)Compressed * 100 / Uncompressed),
+              CompressTime, DecompressTime);
+    }
+
+Cleanup:
+    if (WorkSpace) RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+    if (Decompressed) RtlFreeHeap(RtlGetProcessHeap(), 0, Decompressed);
+    if (CompressedData) RtlFreeHeap(RtlGetProcessHeap(), 0, CompressedData);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    BenchmarkCorpus(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, "Standard");
+    BenchmarkCorpus(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM, "Maximum");
+}
@@ -0,0 +1,203 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Scheduler benchmark for parallel runnable threads and wake ups
+ */
+
+#include "precomp.h"
+
+#define MAX_THREADS       32
+#define SPIN_ITERATIONS   50000000
+#define PING_PONGS        100000
+
+typedef struct _SPIN_CONTEXT
+{
+    HANDLE StartEvent;
+    ULONG Result;
+    ULONG ProcessorMask;
+} SPIN_CONTEXT, *PSPIN_CONTEXT;
+
+typedef struct _PING_CONTEXT
+{
+    HANDLE Ping;
+    HANDLE Pong;
+} PING_CONTEXT, *PPING_CONTEXT;
+
+static
+DWORD
+WINAPI
+SpinThread(LPVOID Parameter)
+{
+    PSPIN_CONTEXT Context = Parameter;
+    ULONG Seed = 1, Result = 0, ProcessorMask = 0, i;
+
+    WaitForSingleObject(Context->StartEvent, INFINITE);
+
+    /* Pure CPU work that never blocks, and stays off the shared context */
+    for (i = 0; i < SPIN_ITERATIONS; i++)
+    {
+        Result += PerfRandom(&Seed);
+
+        /* Note where we ran, every now and then */
+        if (!(i & 0xFFFFF))
+            ProcessorMask |= 1UL << (NtGetCurrentProcessorNumber() % 32);
+    }
+
+    Context->Result = Result;
+    Context->ProcessorMask = ProcessorMask;
+    return 0;
+}
+
+static
+ULONGLONG
+RunSpinners(ULONG ThreadCount, PULONG ProcessorMask)
+{
+    SPIN_CONTEXT Contexts[MAX_THREADS];
+    HANDLE Threads[MAX_THREADS];
+    HANDLE StartEvent;
+    PERF_TIMER Timer;
+    ULONG i;
+
+    *ProcessorMask = 0;
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(StartEvent != NULL, "CreateEventW failed with %lu\n", GetLastError());
+    if (!StartEvent) return 0;
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Contexts[i].StartEvent = StartEvent;
+        Contexts[i].Result = 0;
+        Contexts[i].ProcessorMask = 0;
+        Threads[i] = CreateThread(NULL, 0, SpinThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    /* Make all of them ready at once */
+    PerfStartTimer(&Timer);
+    SetEvent(StartEvent);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+        *ProcessorMask |= Contexts[i].ProcessorMask;
+    }
+
+    CloseHandle(StartEvent);
+    return PerfElapsedMs(&Timer);
+}
+
+static
+ULONG
+CountBits(ULONG Mask)
+{
+    ULONG Count = 0;
+
+    while (Mask)
+    {
+        Mask &= Mask - 1;
+        Count++;
+    }
+
+    return Count;
+}
+
+static
+VOID
+BenchmarkParallelThreads(ULONG ProcessorCount)
+{
+    ULONGLONG Single, Milliseconds;
+    ULONG ThreadCount, ProcessorMask;
+
+    Single = RunSpinners(1, &ProcessorMask);
+    trace("1 thread: %I64u ms\n", Single);
+
+    for (ThreadCount = 2; ThreadCount <= min(2 * ProcessorCount, MAX_THREADS); ThreadCount *= 2)
+    {
+        Milliseconds = RunSpinners(ThreadCount, &ProcessorMask);
+
+        /* Runnable threads have to be spread over the processors */
+        if (ThreadCount <= ProcessorCount)
+        {
+            ok(CountBits(ProcessorMask) >= min(ThreadCount, 32),
+               "%lu threads only ran on processors %lx\n", ThreadCount, ProcessorMask);
+        }
+
+        /* Speedup over running the same work one thread after the other, in percent */
+        trace("%lu threads: %I64u ms on processors %lx, speedup %I64u%%\n",
+              ThreadCount, Milliseconds, ProcessorMask, Single * ThreadCount * 100 / Milliseconds);
+    }
+}
+
+static
+DWORD
+WINAPI
+PongThread(LPVOID Parameter)
+{
+    PPING_CONTEXT Context = Parameter;
+    ULONG i;
+
+    for (i = 0; i < PING_PONGS; i++)
+    {
+        WaitForSingleObject(Context->Ping, INFINITE);
+        SetEvent(Context->Pong);
+    }
+
+    return 0;
+}
+
+/* Every round trip readies a thread that is waiting, most likely on another processor */
+static
+VOID
+BenchmarkPingPong(VOID)
+{
+    PING_CONTEXT Context;
+    ULONGLONG Milliseconds;
+    PERF_TIMER Timer;
+    HANDLE Thread;
+    ULONG i;
+
+    Context.Ping = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Context.Pong = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Thread = CreateThread(NULL, 0, PongThread, &Context, 0, NULL);
+    ok(Context.Ping && Context.Pong && Thread, "Setup failed with %lu\n", GetLastError());
+    if (!Context.Ping || !Context.Pong || !Thread)
+    {
+        skip("No ping pong\n");
+        if (Context.Ping) CloseHandle(Context.Ping);
+        if (Context.Pong) CloseHandle(Context.Pong);
+        return;
+    }
+
+    PerfStartTimer(&Timer);
+
+    for (i = 0; i < PING_PONGS; i++)
+    {
+        SetEvent(Context.Ping);
+        WaitForSingleObject(Context.Pong, INFINITE);
+    }
+
+    Milliseconds = PerfElapsedMs(&Timer);
+
+    WaitForSingleObject(Thread, INFINITE);
+    trace("%d round trips: %I64u ms, %I64u round trips/s\n",
+          PING_PONGS, Milliseconds, PerfRate(PING_PONGS, Milliseconds));
+
+    CloseHandle(Thread);
+    CloseHandle(Context.Ping);
+    CloseHandle(Context.Pong);
+}
+
+START_TEST(Scheduler)
+{
+    SYSTEM_INFO SystemInfo;
+
+    /* Interesting on an SMP build, e.g. under QEMU with -smp 4 */
+    GetSystemInfo(&SystemInfo);
+    trace("%lu processors\n", SystemInfo.dwNumberOfProcessors);
+
+    BenchmarkParallelThreads(SystemInfo.dwNumberOfProcessors);
+    BenchmarkPingPong();
+}
@@ -0,0 +1,285 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Fio style benchmark for unbuffered overlapped disk I/O
+ */
+
+#include "precomp.h"
+
+#define FILE_SIZE         (64 * 1024 * 1024)
+#define STAMP_SIZE        4096
+#define MAX_THREADS       4
+#define MAX_DEPTH         32
+
+typedef struct _IO_JOB
+{
+    PCSTR Name;
+    BOOL Write;
+    BOOL Random;
+    ULONG BlockSize;
+    ULONG Depth;
+    ULONG Threads;
+} IO_JOB, *PIO_JOB;
+
+typedef struct _IO_CONTEXT
+{
+    PCWSTR FileName;
+    const IO_JOB *Job;
+    ULONG Index;
+    ULONG Completed;
+    ULONG Failures;
+} IO_CONTEXT, *PIO_CONTEXT;
+
+/* Sequential writes come first, they lay down the stamps the reads check */
+static const IO_JOB Jobs[] =
+{
+    { "seqwrite",  TRUE,  FALSE, 128 * 1024,  1, 1 },
+    { "seqwrite",  TRUE,  FALSE, 128 * 1024,  4, 1 },
+    { "seqread",   FALSE, FALSE, 128 * 1024,  1, 1 },
+    { "seqread",   FALSE, FALSE, 128 * 1024,  4, 1 },
+    { "randread",  FALSE, TRUE,    4 * 1024,  1, 1 },
+    { "randread",  FALSE, TRUE,    4 * 1024,  4, 1 },
+    { "randread",  FALSE, TRUE,    4 * 1024, 16, 1 },
+    { "randread",  FALSE, TRUE,    4 * 1024, 32, 1 },
+    { "randread",  FALSE, TRUE,    4 * 1024, 32, 4 },
+    { "randwrite", TRUE,  TRUE,    4 * 1024,  1, 1 },
+    { "randwrite", TRUE,  TRUE,    4 * 1024, 32, 4 },
+};
+
+/* Every 4 KB of the file starts with its own offset */
+static
+VOID
+StampBuffer(PUCHAR Buffer, ULONG Offset, ULONG Length)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i += STAMP_SIZE)
+        *(PULONG)(Buffer + i) = Offset + i;
+}
+
+static
+BOOL
+CheckBuffer(PUCHAR Buffer, ULONG Offset, ULONG Length)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i += STAMP_SIZE)
+    {
+        if (*(PULONG)(Buffer + i) != Offset + i)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONG
+NextOffset(const IO_JOB *Job, PULONG Seed, ULONG Index, ULONG Issued)
+{
+    ULONG Blocks = FILE_SIZE / Job->BlockSize;
+    ULONG Region = Blocks / Job->Threads;
+
+    if (Job->Random)
+    {
+        return (PerfRandom(Seed) % Blocks) * Job->BlockSize;
+    }
+
+    /* Each thread streams through its own part of the file */
+    return (Index * Region + Issued % Region) * Job->BlockSize;
+}
+
+static
+BOOL
+IssueIo(HANDLE File, const IO_JOB *Job, PUCHAR Buffer, LPOVERLAPPED Overlapped, ULONG Offset)
+{
+    BOOL Ret;
+
+    Overlapped->Offset = Offset;
+
+    if (Job->Write)
+    {
+        StampBuffer(Buffer, Offset, Job->BlockSize);
+        Ret = WriteFile(File, Buffer, Job->BlockSize, NULL, Overlapped);
+    }
+    else
+    {
+        Ret = ReadFile(File, Buffer, Job->BlockSize, NULL, Overlapped);
+    }
+
+    return Ret || GetLastError() == ERROR_IO_PENDING;
+}
+
+static
+DWORD
+WINAPI
+IoThread(LPVOID Parameter)
+{
+    PIO_CONTEXT Context = Parameter;
+    const IO_JOB *Job = Context->Job;
+    OVERLAPPED Overlapped[MAX_DEPTH];
+    HANDLE Events[MAX_DEPTH];
+    PUCHAR Buffers[MAX_DEPTH];
+    BOOL Busy[MAX_DEPTH];
+    ULONG Seed = Context->Index + 1;
+    ULONG Total, Issued = 0, Pending = 0, Slot;
+    DWORD Transferred, Wait;
+    HANDLE File;
+
+    File = CreateFileW(Context->FileName,
+                       Job->Write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED,
+                       NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        Context->Failures++;
+        return 0;
+    }
+
+    /* VirtualAlloc keeps the buffers sector aligned */
+    for (Slot = 0; Slot < Job->Depth; Slot++)
+    {
+        Buffers[Slot] = VirtualAlloc(NULL, Job->BlockSize, MEM_COMMIT, PAGE_READWRITE);
+        Events[Slot] = CreateEventW(NULL, TRUE, FALSE, NULL);
+        ZeroMemory(&Overlapped[Slot], sizeof(OVERLAPPED));
+        Overlapped[Slot].hEvent = Events[Slot];
+        Busy[Slot] = FALSE;
+    }
+
+    Total = FILE_SIZE / Job->BlockSize / Job->Threads;
+
+    /* Keep Depth requests in flight until Total have been issued */
+    for (Slot = 0; Slot < Job->Depth && Issued < Total; Slot++, Issued++)
+    {
+        Busy[Slot] = IssueIo(File, Job, Buffers[Slot], &Overlapped[Slot],
+                             NextOffset(Job, &Seed, Context->Index, Issued));
+        if (Busy[Slot])
+            Pending++;
+        else
+            Context->Failures++;
+    }
+
+    while (Pending != 0)
+    {
+        Wait = WaitForMultipleObjects(Job->Depth, Events, FALSE, INFINITE);
+        if (Wait >= WAIT_OBJECT_0 + Job->Depth)
+        {
+            Context->Failures++;
+            break;
+        }
+
+        Wait -= WAIT_OBJECT_0;
+        ResetEvent(Events[Wait]);
+        Busy[Wait] = FALSE;
+        Pending--;
+
+        if (!GetOverlappedResult(File, &Overlapped[Wait], &Transferred, FALSE) ||
+            Transferred != Job->BlockSize ||
+            (!Job->Write && !CheckBuffer(Buffers[Wait], Overlapped[Wait].Offset, Job->BlockSize)))
+        {
+            Context->Failures++;
+        }
+        Context->Completed++;
+
+        if (Issued == Total)
+            continue;
+
+        Busy[Wait] = IssueIo(File, Job, Buffers[Wait], &Overlapped[Wait],
+                             NextOffset(Job, &Seed, Context->Index, Issued));
+        Issued++;
+        if (Busy[Wait])
+            Pending++;
+        else
+            Context->Failures++;
+    }
+
+    if (Pending != 0)
+        CancelIo(File);
+
+    for (Slot = 0; Slot < Job->Depth; Slot++)
+    {
+        if (Busy[Slot])
+            GetOverlappedResult(File, &Overlapped[Slot], &Transferred, TRUE);
+        CloseHandle(Events[Slot]);
+        VirtualFree(Buffers[Slot], 0, MEM_RELEASE);
+    }
+
+    CloseHandle(File);
+    return 0;
+}
+
+static
+ULONGLONG
+RunJob(PCWSTR FileName, const IO_JOB *Job, PULONG Completed)
+{
+    IO_CONTEXT Contexts[MAX_THREADS];
+    HANDLE Threads[MAX_THREADS];
+    PERF_TIMER Timer;
+    ULONG i;
+
+    *Completed = 0;
+
+    PerfStartTimer(&Timer);
+
+    for (i = 0; i < Job->Threads; i++)
+    {
+        Contexts[i].FileName = FileName;
+        Contexts[i].Job = Job;
+        Contexts[i].Index = i;
+        Contexts[i].Completed = 0;
+        Contexts[i].Failures = 0;
+        Threads[i] = CreateThread(NULL, 0, IoThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < Job->Threads; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+        ok(Contexts[i].Failures == 0, "%s thread %lu had %lu failures\n", Job->Name, i, Contexts[i].Failures);
+        *Completed += Contexts[i].Completed;
+    }
+
+    return PerfElapsedMs(&Timer);
+}
+
+START_TEST(UnbufferedIo)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    ULONGLONG Milliseconds;
+    ULONG Job, Completed;
+    HANDLE File;
+    BOOL Ret;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"fio", 0, FileName);
+
+    /* Reserve the whole file up front, the jobs never extend it */
+    File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Ret = SetFilePointer(File, FILE_SIZE, NULL, FILE_BEGIN) == FILE_SIZE && SetEndOfFile(File);
+    CloseHandle(File);
+    if (!Ret)
+    {
+        skip("Failed to create a %lu MB file\n", FILE_SIZE / (1024 * 1024));
+        DeleteFileW(FileName);
+        return;
+    }
+
+    for (Job = 0; Job < _countof(Jobs); Job++)
+    {
+        Milliseconds = RunJob(FileName, &Jobs[Job], &Completed);
+        trace("%-9s bs=%3luk iodepth=%2lu numjobs=%lu: %I64u ms, %I64u IOPS, %I64u MB/s\n",
+              Jobs[Job].Name, Jobs[Job].BlockSize / 1024, Jobs[Job].Depth, Jobs[Job].Threads, Milliseconds,
+              PerfRate(Completed, Milliseconds),
+              PerfRate((ULONGLONG)Completed * Jobs[Job].BlockSize, Milliseconds) / (1024 * 1024));
+    }
+
+    DeleteFileW(FileName);
+}
@@ -0,0 +1,52 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Timing and random number helpers shared by the benchmarks
+ */
+
+#include "precomp.h"
+
+VOID
+PerfStartTimer(PPERF_TIMER Timer)
+{
+    QueryPerformanceFrequency(&Timer->Frequency);
+    QueryPerformanceCounter(&Timer->Start);
+}
+
+/* The elapsed times are never 0, so that they can always be divided by */
+ULONGLONG
+PerfElapsedUs(PPERF_TIMER Timer)
+{
+    LARGE_INTEGER Now;
+    ULONGLONG Elapsed;
+
+    QueryPerformanceCounter(&Now);
+    Elapsed = (Now.QuadPart - Timer->Start.QuadPart) * 1000000 / Timer->Frequency.QuadPart;
+    return Elapsed ? Elapsed : 1;
+}
+
+ULONGLONG
+PerfElapsedMs(PPERF_TIMER Timer)
+{
+    LARGE_INTEGER Now;
+    ULONGLONG Elapsed;
+
+    QueryPerformanceCounter(&Now);
+    Elapsed = (Now.QuadPart - Timer->Start.QuadPart) * 1000 / Timer->Frequency.QuadPart;
+    return Elapsed ? Elapsed : 1;
+}
+
+/* Count per second, over a time from PerfElapsedMs */
+ULONGLONG
+PerfRate(ULONGLONG Count, ULONGLONG Milliseconds)
+{
+    return Count * 1000 / Milliseconds;
+}
+
+/* The same sequence on every run, so that runs can be compared */
+ULONG
+PerfRandom(PULONG Seed)
+{
+    *Seed = *Seed * 1103515245 + 12345;
+    return *Seed >> 8;
+}
@@ -0,0 +1,25 @@
+#ifndef _PERF_APITEST_PERF_H_
+#define _PERF_APITEST_PERF_H_
+
+typedef struct _PERF_TIMER
+{
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER Start;
+} PERF_TIMER, *PPERF_TIMER;
+
+VOID
+PerfStartTimer(PPERF_TIMER Timer);
+
+ULONGLONG
+PerfElapsedUs(PPERF_TIMER Timer);
+
+ULONGLONG
+PerfElapsedMs(PPERF_TIMER Timer);
+
+ULONGLONG
+PerfRate(ULONGLONG Count, ULONGLONG Milliseconds);
+
+ULONG
+PerfRandom(PULONG Seed);
+
+#endif /* _PERF_APITEST_PERF_H_ */
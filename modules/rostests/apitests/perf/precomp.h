@@ -0,0 +1,15 @@
+#ifndef _PERF_APITEST_PRECOMP_H_
+#define _PERF_APITEST_PRECOMP_H_
+
+#define WIN32_NO_STATUS
+#define _INC_WINDOWS
+#define COM_NO_WINDOWS_H
+
+#include <apitest.h>
+#include <wingdi.h>
+#include <strsafe.h>
+#include <ndk/ntndk.h>
+
+#include "perf.h"
+
+#endif /* _PERF_APITEST_PRECOMP_H_ */
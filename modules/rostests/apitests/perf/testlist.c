@@ -0,0 +1,33 @@
+#define __ROS_LONG64__
+
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_CreateFile(void);
+extern void func_ExtTextOut(void);
+extern void func_Fast486(void);
+extern void func_HeapSetInformation(void);
+extern void func_IoCompletion(void);
+extern void func_loopback(void);
+extern void func_NtQueryValueKey(void);
+extern void func_ReadFile(void);
+extern void func_RtlCompressBuffer(void);
+extern void func_Scheduler(void);
+extern void func_UnbufferedIo(void);
+
+const struct test winetest_testlist[] =
+{
+    { "CreateFile", func_CreateFile },
+    { "ExtTextOut", func_ExtTextOut },
+    { "Fast486", func_Fast486 },
+    { "HeapSetInformation", func_HeapSetInformation },
+    { "IoCompletion", func_IoCompletion },
+    { "loopback", func_loopback },
+    { "NtQueryValueKey", func_NtQueryValueKey },
+    { "ReadFile", func_ReadFile },
+    { "RtlCompressBuffer", func_RtlCompressBuffer },
+    { "Scheduler", func_Scheduler },
+    { "UnbufferedIo", func_UnbufferedIo },
+
+    { 0, 0 }
+};
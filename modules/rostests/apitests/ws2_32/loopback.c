@@ -0,0 +1,256 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for loopback TCP streams and connections
+ */
+
+#include "ws2_32.h"
+
+#define STREAM_SIZE       (1024 * 1024)
+#define CONNECTIONS       50
+#define MAX_STREAMS       2
+
+typedef struct _STREAM_CONTEXT
+{
+    SOCKET Listener;
+    ULONG ChunkSize;
+    ULONG Connections;
+    ULONGLONG Received;
+    ULONG Accepted;
+    ULONG Failures;
+} STREAM_CONTEXT, *PSTREAM_CONTEXT;
+
+static
+SOCKET
+CreateListener(struct sockaddr_in *Address)
+{
+    SOCKET sock;
+    int len = sizeof(*Address);
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(Address, 0, sizeof(*Address));
+    Address->sin_family = AF_INET;
+    Address->sin_addr.s_addr = inet_addr("127.0.0.1");
+    Address->sin_port = 0;
+
+    if (bind(sock, (const struct sockaddr *)Address, sizeof(*Address)) == SOCKET_ERROR ||
+        listen(sock, SOMAXCONN) == SOCKET_ERROR ||
+        getsockname(sock, (struct sockaddr *)Address, &len) == SOCKET_ERROR)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+static
+DWORD
+WINAPI
+ReceiveThread(PVOID Parameter)
+{
+    PSTREAM_CONTEXT Context = Parameter;
+    SOCKET sock;
+    PCHAR Buffer;
+    int ret;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, Context->ChunkSize);
+    if (!Buffer)
+    {
+        Context->Failures++;
+        return 0;
+    }
+
+    sock = accept(Context->Listener, NULL, NULL);
+    if (sock == INVALID_SOCKET)
+    {
+        Context->Failures++;
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return 0;
+    }
+
+    /* Drain the stream until the sender closes it */
+    while ((ret = recv(sock, Buffer, Context->ChunkSize, 0)) > 0)
+        Context->Received += ret;
+
+    if (ret == SOCKET_ERROR)
+        Context->Failures++;
+
+    closesocket(sock);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return 0;
+}
+
+static
+DWORD
+WINAPI
+AcceptThread(PVOID Parameter)
+{
+    PSTREAM_CONTEXT Context = Parameter;
+    SOCKET sock;
+    ULONG i;
+
+    for (i = 0; i < Context->Connections; i++)
+    {
+        sock = accept(Context->Listener, NULL, NULL);
+        if (sock == INVALID_SOCKET)
+        {
+            Context->Failures++;
+            break;
+        }
+
+        Context->Accepted++;
+        closesocket(sock);
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestStreams(ULONG ChunkSize, ULONG Streams)
+{
+    STREAM_CONTEXT Contexts[MAX_STREAMS];
+    HANDLE Threads[MAX_STREAMS];
+    SOCKET Senders[MAX_STREAMS];
+    struct sockaddr_in Address;
+    ULONGLONG Sent;
+    PCHAR Buffer;
+    ULONG i;
+    int ret;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ChunkSize);
+    ok(Buffer != NULL, "HeapAlloc failed\n");
+    if (!Buffer)
+    {
+        skip("No memory\n");
+        return;
+    }
+
+    for (i = 0; i < Streams; i++)
+    {
+        memset(&Contexts[i], 0, sizeof(Contexts[i]));
+        Contexts[i].ChunkSize = ChunkSize;
+        Contexts[i].Listener = CreateListener(&Address);
+        ok(Contexts[i].Listener != INVALID_SOCKET, "CreateListener failed: %d\n", WSAGetLastError());
+
+        Senders[i] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ok(Senders[i] != INVALID_SOCKET, "socket failed: %d\n", WSAGetLastError());
+
+        Threads[i] = CreateThread(NULL, 0, ReceiveThread, &Contexts[i], 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed: %lu\n", GetLastError());
+
+        ret = connect(Senders[i], (const struct sockaddr *)&Address, sizeof(Address));
+        ok(ret == 0, "connect failed: %d\n", WSAGetLastError());
+    }
+
+    /* Interleave the streams so they all compete for the stack at once */
+    Sent = 0;
+    while (Sent < (ULONGLONG)STREAM_SIZE * Streams)
+    {
+        for (i = 0; i < Streams; i++)
+        {
+            ret = send(Senders[i], Buffer, ChunkSize, 0);
+            if (ret != ChunkSize)
+            {
+                ok(ret == ChunkSize, "send returned %d, error %d\n", ret, WSAGetLastError());
+                Sent = (ULONGLONG)STREAM_SIZE * Streams;
+                break;
+            }
+
+            Sent += ret;
+        }
+    }
+
+    for (i = 0; i < Streams; i++)
+        closesocket(Senders[i]);
+
+    WaitForMultipleObjects(Streams, Threads, TRUE, INFINITE);
+
+    for (i = 0; i < Streams; i++)
+    {
+        ok(Contexts[i].Failures == 0, "Stream %lu had %lu failures\n", i, Contexts[i].Failures);
+        ok(Contexts[i].Received == STREAM_SIZE, "Stream %lu received %I64u bytes\n", i, Contexts[i].Received);
+
+        CloseHandle(Threads[i]);
+        closesocket(Contexts[i].Listener);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+}
+
+static
+VOID
+TestConnections(VOID)
+{
+    STREAM_CONTEXT Context;
+    struct sockaddr_in Address;
+    HANDLE Thread;
+    SOCKET sock;
+    ULONG i, Connected;
+
+    memset(&Context, 0, sizeof(Context));
+    Context.Connections = CONNECTIONS;
+    Context.Listener = CreateListener(&Address);
+    ok(Context.Listener != INVALID_SOCKET, "CreateListener failed: %d\n", WSAGetLastError());
+    if (Context.Listener == INVALID_SOCKET)
+    {
+        skip("No listener\n");
+        return;
+    }
+
+    Thread = CreateThread(NULL, 0, AcceptThread, &Context, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed: %lu\n", GetLastError());
+    if (!Thread)
+    {
+        closesocket(Context.Listener);
+        return;
+    }
+
+    Connected = 0;
+    for (i = 0; i < CONNECTIONS; i++)
+    {
+        sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET)
+            break;
+
+        if (connect(sock, (const struct sockaddr *)&Address, sizeof(Address)) == 0)
+            Connected++;
+
+        closesocket(sock);
+    }
+
+    ok(Connected == CONNECTIONS, "Connected %lu times\n", Connected);
+
+    /* Don't leave the acceptor waiting for connections that never came */
+    if (Connected != CONNECTIONS)
+        closesocket(Context.Listener);
+
+    WaitForSingleObject(Thread, INFINITE);
+
+    ok(Context.Accepted == Connected, "Accepted %lu of %lu\n", Context.Accepted, Connected);
+
+    CloseHandle(Thread);
+    if (Connected == CONNECTIONS)
+        closesocket(Context.Listener);
+}
+
+START_TEST(loopback)
+{
+    WSADATA wdata;
+    int iResult;
+
+    iResult = WSAStartup(MAKEWORD(2, 2), &wdata);
+    ok(iResult == 0, "WSAStartup failed, iResult == %d\n", iResult);
+    if (iResult != 0)
+        return;
+
+    TestStreams(4 * 1024, 1);
+    TestStreams(64 * 1024, MAX_STREAMS);
+    TestConnections();
+
+    WSACleanup();
+}
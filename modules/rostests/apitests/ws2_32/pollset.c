@@ -0,0 +1,173 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the AFD poll set IOCTLs
+ */
+
+#include "ws2_32.h"
+
+#include <ndk/iofuncs.h>
+#include <ndk/obfuncs.h>
+#include <tdi.h>
+#include <drivers/afd/shared.h>
+
+static
+NTSTATUS
+PollSetIoctl(SOCKET Socket, ULONG Code, PVOID Buffer, ULONG InputLength, ULONG OutputLength, PIO_STATUS_BLOCK IoStatus)
+{
+    NTSTATUS Status;
+    HANDLE Event;
+
+    Event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!Event)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    IoStatus->Status = (NTSTATUS)0xdeadbeef;
+    IoStatus->Information = 0xdeadbeef;
+    Status = NtDeviceIoControlFile((HANDLE)Socket,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   IoStatus,
+                                   Code,
+                                   Buffer,
+                                   InputLength,
+                                   Buffer,
+                                   OutputLength);
+    if (Status == STATUS_PENDING)
+    {
+        WaitForSingleObject(Event, INFINITE);
+        Status = IoStatus->Status;
+    }
+
+    CloseHandle(Event);
+    return Status;
+}
+
+static
+BOOLEAN
+CreateConnectedPair(SOCKET *Client, SOCKET *Server)
+{
+    SOCKET Listener;
+    struct sockaddr_in Address;
+    int AddressLength = sizeof(Address);
+
+    *Client = *Server = INVALID_SOCKET;
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET)
+        return FALSE;
+
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(Listener, (struct sockaddr *)&Address, sizeof(Address)) == SOCKET_ERROR ||
+        listen(Listener, 1) == SOCKET_ERROR ||
+        getsockname(Listener, (struct sockaddr *)&Address, &AddressLength) == SOCKET_ERROR)
+    {
+        closesocket(Listener);
+        return FALSE;
+    }
+
+    *Client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*Client != INVALID_SOCKET &&
+        connect(*Client, (struct sockaddr *)&Address, sizeof(Address)) != SOCKET_ERROR)
+    {
+        *Server = accept(Listener, NULL, NULL);
+    }
+
+    closesocket(Listener);
+
+    if (*Server == INVALID_SOCKET)
+    {
+        if (*Client != INVALID_SOCKET)
+            closesocket(*Client);
+        *Client = INVALID_SOCKET;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+START_TEST(pollset)
+{
+    WSADATA WsaData;
+    SOCKET SetOwner, Client, Server;
+    AFD_POLL_SET_INFO SetInfo;
+    AFD_POLL_SET_WAIT_INFO WaitInfo;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Status;
+
+    if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+    {
+        skip("WSAStartup failed\n");
+        return;
+    }
+
+    SetOwner = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (SetOwner == INVALID_SOCKET || !CreateConnectedPair(&Client, &Server))
+    {
+        skip("Could not create the sockets\n");
+        if (SetOwner != INVALID_SOCKET)
+            closesocket(SetOwner);
+        WSACleanup();
+        return;
+    }
+
+    /* A short output buffer only gets back what fits into it */
+    SetInfo.HandleCount = 1;
+    SetInfo.Handles[0].Handle = Server;
+    SetInfo.Handles[0].Events = AFD_EVENT_RECEIVE;
+    SetInfo.Handles[0].Status = (NTSTATUS)0xdeadbeef;
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_UPDATE_POLL_SET, &SetInfo,
+                          sizeof(SetInfo), FIELD_OFFSET(AFD_POLL_SET_INFO, Handles), &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(IoStatus.Information == FIELD_OFFSET(AFD_POLL_SET_INFO, Handles),
+       "Information = %Iu\n", IoStatus.Information);
+    ok(SetInfo.Handles[0].Status == (NTSTATUS)0xdeadbeef, "Handle status = 0x%lx\n", SetInfo.Handles[0].Status);
+
+    /* Registering it again just updates the entry and reports its status */
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_UPDATE_POLL_SET, &SetInfo,
+                          sizeof(SetInfo), sizeof(SetInfo), &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(IoStatus.Information == sizeof(SetInfo), "Information = %Iu\n", IoStatus.Information);
+    ok(SetInfo.Handles[0].Status == STATUS_SUCCESS, "Handle status = 0x%lx\n", SetInfo.Handles[0].Status);
+
+    /* Nothing to read yet */
+    WaitInfo.Timeout.QuadPart = 0;
+    WaitInfo.HandleCount = 0;
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_WAIT_POLL_SET, &WaitInfo,
+                          sizeof(WaitInfo), sizeof(WaitInfo), &IoStatus);
+    ok(Status == STATUS_TIMEOUT, "Status = 0x%lx\n", Status);
+    ok(WaitInfo.HandleCount == 0, "HandleCount = %lu\n", WaitInfo.HandleCount);
+
+    ok(send(Client, "x", 1, 0) == 1, "send failed with %d\n", WSAGetLastError());
+
+    WaitInfo.Timeout.QuadPart = -5 * 10000000LL;
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_WAIT_POLL_SET, &WaitInfo,
+                          sizeof(WaitInfo), sizeof(WaitInfo), &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(IoStatus.Information == sizeof(WaitInfo), "Information = %Iu\n", IoStatus.Information);
+    ok(WaitInfo.HandleCount == 1, "HandleCount = %lu\n", WaitInfo.HandleCount);
+    ok(WaitInfo.Handles[0].Handle == Server, "Handle = %Ix\n", WaitInfo.Handles[0].Handle);
+    ok(WaitInfo.Handles[0].Events & AFD_EVENT_RECEIVE, "Events = 0x%lx\n", WaitInfo.Handles[0].Events);
+
+    /* No events takes it out of the set again, even though it is still readable */
+    SetInfo.Handles[0].Handle = Server;
+    SetInfo.Handles[0].Events = 0;
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_UPDATE_POLL_SET, &SetInfo,
+                          sizeof(SetInfo), sizeof(SetInfo), &IoStatus);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(SetInfo.Handles[0].Status == STATUS_SUCCESS, "Handle status = 0x%lx\n", SetInfo.Handles[0].Status);
+
+    WaitInfo.Timeout.QuadPart = 0;
+    Status = PollSetIoctl(SetOwner, IOCTL_AFD_WAIT_POLL_SET, &WaitInfo,
+                          sizeof(WaitInfo), sizeof(WaitInfo), &IoStatus);
+    ok(Status == STATUS_TIMEOUT, "Status = 0x%lx\n", Status);
+
+    closesocket(Client);
+    closesocket(Server);
+    closesocket(SetOwner);
+    WSACleanup();
+}
@@ -10,8 +10,10 @@ extern void func_getnameinfo(void);
 extern void func_getservbyname(void);
 extern void func_getservbyport(void);
 extern void func_ioctlsocket(void);
+extern void func_loopback(void);
 extern void func_nonblocking(void);
 extern void func_nostartup(void);
+extern void func_pollset(void);
 extern void func_recv(void);
 extern void func_send(void);
 extern void func_WSAAsync(void);
@@ -28,8 +30,10 @@ const struct test winetest_testlist[] =
     { "getservbyname", func_getservbyname },
     { "getservbyport", func_getservbyport },
     { "ioctlsocket", func_ioctlsocket },
+    { "loopback", func_loopback },
     { "nonblocking", func_nonblocking },
     { "nostartup", func_nostartup },
+    { "pollset", func_pollset },
     { "recv", func_recv },
     { "send", func_send },
     { "WSAAsync", func_WSAAsync },
@@ -0,0 +1,12 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite btrfs zstd codec test declarations
+ */
+
+#ifndef _KMTEST_BTRFSZSTD_H_
+#define _KMTEST_BTRFSZSTD_H_
+
+#define IOCTL_RUN_TEST        1
+
+#endif /* !defined _KMTEST_BTRFSZSTD_H_ */
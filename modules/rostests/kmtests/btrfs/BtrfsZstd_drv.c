@@ -0,0 +1,164 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite btrfs zstd codec test
+ */
+
+#include <kmt_test.h>
+#include "BtrfsZstd.h"
+
+/* Built from drivers/filesystems/btrfs/zstd.c */
+NTSTATUS zstd_decompress(UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen);
+NTSTATUS zstd_compress(const UINT8* inbuf, UINT32 inlen, UINT8* outbuf, UINT32 outlen, UINT32 level, UINT32* complen);
+
+#define TEST_DATA_SIZE  (64 * 1024)
+#define TAG_TEST        'tZtB'
+
+static KMT_MESSAGE_HANDLER TestMessageHandler;
+
+NTSTATUS
+TestEntry(
+    _In_ PDRIVER_OBJECT DriverObject,
+    _In_ PCUNICODE_STRING RegistryPath,
+    _Out_ PCWSTR *DeviceName,
+    _Inout_ INT *Flags)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(DriverObject);
+    UNREFERENCED_PARAMETER(RegistryPath);
+
+    *DeviceName = L"BtrfsZstd";
+    *Flags = TESTENTRY_NO_EXCLUSIVE_DEVICE;
+
+    KmtRegisterMessageHandler(0, NULL, TestMessageHandler);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+TestUnload(
+    _In_ PDRIVER_OBJECT DriverObject)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(DriverObject);
+}
+
+static
+VOID
+FillTestData(
+    _Out_writes_bytes_(Length) PUCHAR Buffer,
+    _In_ ULONG Length)
+{
+    static const CHAR Text[] = "The quick brown fox jumps over the lazy dog. ";
+    ULONG i;
+
+    /* Text with the odd counter thrown in, so there are literals as well as matches */
+    for (i = 0; i < Length; i++)
+    {
+        if ((i % 509) == 0)
+            Buffer[i] = (UCHAR)(i >> 9);
+        else
+            Buffer[i] = Text[i % (sizeof(Text) - 1)];
+    }
+}
+
+static
+VOID
+TestRoundTrip(
+    _In_ ULONG Level)
+{
+    PUCHAR Data, Compressed, Decompressed;
+    UINT32 CompressedLength;
+    NTSTATUS Status;
+
+    Data = ExAllocatePoolWithTag(PagedPool, 3 * TEST_DATA_SIZE, TAG_TEST);
+    if (skip(Data != NULL, "Out of memory\n"))
+        return;
+
+    Compressed = Data + TEST_DATA_SIZE;
+    Decompressed = Compressed + TEST_DATA_SIZE;
+    FillTestData(Data, TEST_DATA_SIZE);
+
+    CompressedLength = 0;
+    Status = zstd_compress(Data, TEST_DATA_SIZE, Compressed, TEST_DATA_SIZE, Level, &CompressedLength);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok(CompressedLength != 0 && CompressedLength < TEST_DATA_SIZE / 4,
+       "Level %lu: compressed to %u bytes\n", Level, CompressedLength);
+
+    if (NT_SUCCESS(Status))
+    {
+        RtlFillMemory(Decompressed, TEST_DATA_SIZE, 0xcc);
+        Status = zstd_decompress(Compressed, CompressedLength, Decompressed, TEST_DATA_SIZE);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        ok(RtlCompareMemory(Data, Decompressed, TEST_DATA_SIZE) == TEST_DATA_SIZE,
+           "Level %lu: data doesn't round trip\n", Level);
+    }
+
+    ExFreePoolWithTag(Data, TAG_TEST);
+}
+
+static
+VOID
+TestSkippableFrames(VOID)
+{
+    /* A skippable frame whose size would wrap the input position */
+    static UCHAR WrappingFrame[] = { 0x50, 0x2a, 0x4d, 0x18, 0xf8, 0xff, 0xff, 0xff };
+    /* A skippable frame cut off in the middle of its header */
+    static UCHAR TruncatedHeader[] = { 0x50, 0x2a, 0x4d, 0x18, 0x00, 0x00 };
+    /* A skippable frame claiming one byte more than there is */
+    static UCHAR OverlongFrame[] = { 0x5f, 0x2a, 0x4d, 0x18, 0x04, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03 };
+    /* A skippable frame followed by a frame holding one raw block of "abc" */
+    static UCHAR SkipThenRaw[] = { 0x50, 0x2a, 0x4d, 0x18, 0x02, 0x00, 0x00, 0x00, 0xaa, 0xbb,
+                                   0x28, 0xb5, 0x2f, 0xfd, 0x20, 0x03, 0x19, 0x00, 0x00, 0x61, 0x62, 0x63 };
+    UCHAR Output[8];
+    NTSTATUS Status;
+
+    Status = zstd_decompress(WrappingFrame, sizeof(WrappingFrame), Output, sizeof(Output));
+    ok_eq_hex(Status, STATUS_INTERNAL_ERROR);
+
+    Status = zstd_decompress(TruncatedHeader, sizeof(TruncatedHeader), Output, sizeof(Output));
+    ok_eq_hex(Status, STATUS_INTERNAL_ERROR);
+
+    Status = zstd_decompress(OverlongFrame, sizeof(OverlongFrame), Output, sizeof(Output));
+    ok_eq_hex(Status, STATUS_INTERNAL_ERROR);
+
+    RtlFillMemory(Output, sizeof(Output), 0xcc);
+    Status = zstd_decompress(SkipThenRaw, sizeof(SkipThenRaw), Output, 3);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok(Output[0] == 'a' && Output[1] == 'b' && Output[2] == 'c',
+       "Got %02x %02x %02x\n", Output[0], Output[1], Output[2]);
+    ok_eq_uint(Output[3], 0xcc);
+}
+
+static
+NTSTATUS
+TestMessageHandler(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_ ULONG ControlCode,
+    _In_opt_ PVOID Buffer,
+    _In_ SIZE_T InLength,
+    _Inout_ PSIZE_T OutLength)
+{
+    PAGED_CODE();
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Buffer);
+    UNREFERENCED_PARAMETER(InLength);
+    UNREFERENCED_PARAMETER(OutLength);
+
+    switch (ControlCode)
+    {
+        case IOCTL_RUN_TEST:
+            TestSkippableFrames();
+            TestRoundTrip(1);
+            TestRoundTrip(3);
+            TestRoundTrip(9);
+            break;
+        default:
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,17 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite btrfs zstd codec test user-mode part
+ */
+
+#include <kmt_test.h>
+#include "BtrfsZstd.h"
+
+START_TEST(BtrfsZstd)
+{
+    KmtLoadDriver(L"BtrfsZstd", TRUE);
+    KmtOpenDriver();
+    KmtSendToDriver(IOCTL_RUN_TEST);
+    KmtCloseDriver();
+    KmtUnloadDriver();
+}
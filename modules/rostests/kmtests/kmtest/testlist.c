@@ -7,6 +7,7 @@
 
 #include <kmt_test.h>
 
+KMT_TESTFUNC Test_BtrfsZstd;
 KMT_TESTFUNC Test_CcCopyRead;
 KMT_TESTFUNC Test_Example;
 KMT_TESTFUNC Test_FileAttributes;
@@ -35,6 +36,7 @@ KMT_TESTFUNC Test_TcpIpConnect;
 /* tests with a leading '-' will not be listed */
 const KMT_TEST TestList[] =
 {
+    { "BtrfsZstd",                    Test_BtrfsZstd },
     { "CcCopyRead",                   Test_CcCopyRead },
     { "-Example",                     Test_Example },
     { "FileAttributes",               Test_FileAttributes },
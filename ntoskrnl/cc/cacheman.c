@@ -17,8 +17,84 @@
 BOOLEAN CcPfEnablePrefetcher;
 PFSN_PREFETCHER_GLOBALS CcPfGlobals;
 
+typedef struct _ROS_READ_AHEAD_CONTEXT
+{
+    WORK_QUEUE_ITEM WorkItem;
+    PFILE_OBJECT FileObject;
+    LONGLONG FileOffset;
+    LONGLONG Length;
+} ROS_READ_AHEAD_CONTEXT, *PROS_READ_AHEAD_CONTEXT;
+
+/* Counters:
+ * - Number of read-ahead requests queued
+ * - Number of views actually read by them
+ */
+ULONG CcReadAheadIos = 0;
+ULONG CcReadAheadViews = 0;
+
 /* FUNCTIONS *****************************************************************/
 
+static
+VOID
+NTAPI
+CcRosReadAheadWorker(
+    PVOID Parameter)
+{
+    PROS_READ_AHEAD_CONTEXT Context = Parameter;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    LONGLONG CurrentOffset, EndOffset;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    PROS_VACB Vacb;
+    NTSTATUS Status;
+
+    SharedCacheMap = Context->FileObject->SectionObjectPointer->SharedCacheMap;
+    ASSERT(SharedCacheMap);
+
+    /* The file system has to be ready for paging reads on this file */
+    if (SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, TRUE))
+    {
+        CurrentOffset = ROUND_DOWN(Context->FileOffset, VACB_MAPPING_GRANULARITY);
+        EndOffset = min(Context->FileOffset + Context->Length, SharedCacheMap->FileSize.QuadPart);
+
+        for (; CurrentOffset < EndOffset; CurrentOffset += VACB_MAPPING_GRANULARITY)
+        {
+            Status = CcRosRequestVacb(SharedCacheMap,
+                                      CurrentOffset,
+                                      &BaseAddress,
+                                      &Valid,
+                                      &Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            /* Somebody else may have read it in the meantime */
+            if (!Valid)
+            {
+                Status = CcReadVirtualAddress(Vacb);
+                Valid = NT_SUCCESS(Status);
+                if (Valid)
+                {
+                    InterlockedIncrementUL(&CcReadAheadViews);
+                }
+            }
+
+            CcRosReleaseVacb(SharedCacheMap, Vacb, Valid, FALSE, FALSE);
+            if (!Valid)
+            {
+                break;
+            }
+        }
+
+        SharedCacheMap->Callbacks->ReleaseFromReadAhead(SharedCacheMap->LazyWriteContext);
+    }
+
+    CcRosDereferenceCache(Context->FileObject);
+    ObDereferenceObject(Context->FileObject);
+    ExFreePoolWithTag(Context, TAG_READ_AHEAD);
+}
+
 VOID
 NTAPI
 INIT_FUNCTION
@@ -86,7 +162,7 @@ CcRemapBcb (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -96,11 +172,97 @@ CcScheduleReadAhead (
 	IN	ULONG			Length
 	)
 {
-	UNIMPLEMENTED;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_READ_AHEAD_CONTEXT Context;
+    LONGLONG BeyondLastByte, ReadAheadStart, ReadAheadEnd;
+    ULONG ReadAheadLength;
+    BOOLEAN Sequential;
+    KIRQL OldIrql;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
+        FileObject, FileOffset->QuadPart, Length);
+
+    PrivateMap = FileObject->PrivateCacheMap;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (PrivateMap == NULL || SharedCacheMap == NULL || Length == 0)
+    {
+        return;
+    }
+
+    /* Random access files and callers who asked for it don't get any */
+    if (SharedCacheMap->ReadAheadDisabled ||
+        BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
+    {
+        return;
+    }
+
+    BeyondLastByte = FileOffset->QuadPart + Length;
+    ReadAheadLength = (CC_READ_AHEAD_LENGTH + PrivateMap->ReadAheadMask) & ~PrivateMap->ReadAheadMask;
+
+    KeAcquireSpinLock(&PrivateMap->ReadAheadSpinLock, &OldIrql);
+
+    /* A read is sequential when it starts in the granule where the previous one ended */
+    Sequential = (PrivateMap->BeyondLastByte.QuadPart != 0) &&
+                 ((FileOffset->QuadPart & ~(LONGLONG)PrivateMap->ReadAheadMask) ==
+                  (PrivateMap->BeyondLastByte.QuadPart & ~(LONGLONG)PrivateMap->ReadAheadMask) ||
+                  FileOffset->QuadPart == PrivateMap->BeyondLastByte.QuadPart);
+
+    PrivateMap->FileOffset = *FileOffset;
+    PrivateMap->BeyondLastByte.QuadPart = BeyondLastByte;
+
+    if (!Sequential)
+    {
+        /* Forget about what we read ahead for the previous stream */
+        PrivateMap->ReadAheadOffset.QuadPart = 0;
+        KeReleaseSpinLock(&PrivateMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Only go on once the reader has consumed half of what we read ahead */
+    ReadAheadStart = max(BeyondLastByte, PrivateMap->ReadAheadOffset.QuadPart);
+    if (ReadAheadStart - BeyondLastByte > ReadAheadLength / 2)
+    {
+        KeReleaseSpinLock(&PrivateMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Stick to the granularity the file system asked for */
+    ReadAheadStart &= ~(LONGLONG)PrivateMap->ReadAheadMask;
+    ReadAheadEnd = (BeyondLastByte + ReadAheadLength + PrivateMap->ReadAheadMask) &
+                   ~(LONGLONG)PrivateMap->ReadAheadMask;
+    ReadAheadEnd = min(ReadAheadEnd, SharedCacheMap->FileSize.QuadPart);
+    if (ReadAheadStart >= ReadAheadEnd)
+    {
+        KeReleaseSpinLock(&PrivateMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    PrivateMap->ReadAheadOffset.QuadPart = ReadAheadEnd;
+    KeReleaseSpinLock(&PrivateMap->ReadAheadSpinLock, OldIrql);
+
+    /* Do the actual reading on a worker thread */
+    Context = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Context), TAG_READ_AHEAD);
+    if (Context == NULL)
+    {
+        return;
+    }
+
+    /* Keep the file and its cache alive until the worker is done */
+    ObReferenceObject(FileObject);
+    CcRosReferenceCache(FileObject);
+
+    Context->FileObject = FileObject;
+    Context->FileOffset = ReadAheadStart;
+    Context->Length = ReadAheadEnd - ReadAheadStart;
+    InterlockedIncrementUL(&CcReadAheadIos);
+
+    ExInitializeWorkItem(&Context->WorkItem, CcRosReadAheadWorker, Context);
+    ExQueueWorkItem(&Context->WorkItem, DelayedWorkQueue);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -110,10 +272,18 @@ CcSetAdditionalCacheAttributes (
 	IN	BOOLEAN		DisableWriteBehind
 	)
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p DisableReadAhead=%d DisableWriteBehind=%d\n",
         FileObject, DisableReadAhead, DisableWriteBehind);
 
-	UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap != NULL)
+    {
+        SharedCacheMap->ReadAheadDisabled = DisableReadAhead;
+    }
+
+    /* FIXME: We don't do write-behind yet */
 }
 
 /*
@@ -170,7 +340,7 @@ CcSetDirtyPageThreshold (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -179,10 +349,21 @@ CcSetReadAheadGranularity (
 	IN	ULONG		Granularity
 	)
 {
-    static ULONG Warn;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
 
     CCTRACE(CC_API_DEBUG, "FileObject=%p Granularity=%lu\n",
         FileObject, Granularity);
 
-    if (!Warn++) UNIMPLEMENTED;
+    /* Granularity has to be a power of two, and at least a page */
+    if (Granularity < PAGE_SIZE || (Granularity & (Granularity - 1)))
+    {
+        DPRINT1("Invalid read-ahead granularity %lu\n", Granularity);
+        return;
+    }
+
+    PrivateMap = FileObject->PrivateCacheMap;
+    if (PrivateMap != NULL)
+    {
+        PrivateMap->ReadAheadMask = Granularity - 1;
+    }
 }
@@ -238,6 +238,7 @@ CcPurgeCacheSection (
             Vacb->SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
         }
         RemoveEntryList(&Vacb->CacheMapVacbListEntry);
+        RemoveEntryList(&Vacb->CacheMapVacbHashEntry);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
@@ -30,6 +30,15 @@
  *
  * (5) Release the cache page
  */
+/* LOCKING ********************************************************************
+ *
+ * ViewLock protects the global VACB lists (LRU and dirty) and the open count
+ * of the shared cache maps. The CacheMapLock of a shared cache map protects
+ * its own VACB list and hash table, so looking up a view only takes the lock
+ * of the file it belongs to. When both are needed, ViewLock is taken first.
+ * VACB reference counts are updated with interlocked operations, since they
+ * are touched under either lock.
+ */
 /* INCLUDES ******************************************************************/
 
 #include <ntoskrnl.h>
@@ -83,27 +92,27 @@ KSPIN_LOCK iSharedCacheMapLock;
 #if DBG
 static void CcRosVacbIncRefCount_(PROS_VACB vacb, const char* file, int line)
 {
-    ++vacb->ReferenceCount;
+    ULONG Refs = InterlockedIncrementUL(&vacb->ReferenceCount);
     if (vacb->SharedCacheMap->Trace)
     {
         DbgPrint("(%s:%i) VACB %p ++RefCount=%lu, Dirty %u, PageOut %lu\n",
-                 file, line, vacb, vacb->ReferenceCount, vacb->Dirty, vacb->PageOut);
+                 file, line, vacb, Refs, vacb->Dirty, vacb->PageOut);
     }
 }
 static void CcRosVacbDecRefCount_(PROS_VACB vacb, const char* file, int line)
 {
-    --vacb->ReferenceCount;
+    ULONG Refs = InterlockedDecrementUL(&vacb->ReferenceCount);
     if (vacb->SharedCacheMap->Trace)
     {
         DbgPrint("(%s:%i) VACB %p --RefCount=%lu, Dirty %u, PageOut %lu\n",
-                 file, line, vacb, vacb->ReferenceCount, vacb->Dirty, vacb->PageOut);
+                 file, line, vacb, Refs, vacb->Dirty, vacb->PageOut);
     }
 }
 #define CcRosVacbIncRefCount(vacb) CcRosVacbIncRefCount_(vacb,__FILE__,__LINE__)
 #define CcRosVacbDecRefCount(vacb) CcRosVacbDecRefCount_(vacb,__FILE__,__LINE__)
 #else
-#define CcRosVacbIncRefCount(vacb) (++((vacb)->ReferenceCount))
-#define CcRosVacbDecRefCount(vacb) (--((vacb)->ReferenceCount))
+#define CcRosVacbIncRefCount(vacb) InterlockedIncrementUL(&(vacb)->ReferenceCount)
+#define CcRosVacbDecRefCount(vacb) InterlockedDecrementUL(&(vacb)->ReferenceCount)
 #endif
 
 NTSTATUS
@@ -307,7 +316,7 @@ CcRosFlushDirtyPages (
     return STATUS_SUCCESS;
 }
 
-/* FIXME: Someday this could somewhat implement write-behind/read-ahead */
+/* FIXME: Someday this could somewhat implement write-behind */
 VOID
 NTAPI
 CciLazyWriter(PVOID Unused)
@@ -460,6 +469,7 @@ retry:
             ASSERT(!current->MappedCount);
 
             RemoveEntryList(&current->CacheMapVacbListEntry);
+            RemoveEntryList(&current->CacheMapVacbHashEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
 
@@ -560,50 +570,65 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
-/* Returns with VACB Lock Held! */
+/* Caller must hold the CacheMapLock */
 PROS_VACB
 NTAPI
-CcRosLookupVacb (
+CcRosFindVacbLocked (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
+    PLIST_ENTRY current_entry, bucket;
     PROS_VACB current;
-    KIRQL oldIrql;
 
-    ASSERT(SharedCacheMap);
-
-    DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
-           SharedCacheMap, FileOffset);
-
-    KeAcquireGuardedMutex(&ViewLock);
-    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
-
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    bucket = CcRosVacbHashBucket(SharedCacheMap, FileOffset);
+    current_entry = bucket->Flink;
+    while (current_entry != bucket)
     {
         current = CONTAINING_RECORD(current_entry,
                                     ROS_VACB,
-                                    CacheMapVacbListEntry);
+                                    CacheMapVacbHashEntry);
         if (IsPointInRange(current->FileOffset.QuadPart,
                            VACB_MAPPING_GRANULARITY,
                            FileOffset))
         {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-            KeReleaseGuardedMutex(&ViewLock);
-            CcRosAcquireVacbLock(current, NULL);
             return current;
         }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
         current_entry = current_entry->Flink;
     }
 
+    return NULL;
+}
+
+/* Returns with VACB Lock Held! */
+PROS_VACB
+NTAPI
+CcRosLookupVacb (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    PROS_VACB current;
+    KIRQL oldIrql;
+
+    ASSERT(SharedCacheMap);
+
+    DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
+           SharedCacheMap, FileOffset);
+
+    /* Only the lock of this cache map is needed to find and reference the VACB */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
+    current = CcRosFindVacbLocked(SharedCacheMap, FileOffset);
+    if (current != NULL)
+    {
+        CcRosVacbIncRefCount(current);
+    }
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
-    KeReleaseGuardedMutex(&ViewLock);
 
-    return NULL;
+    if (current != NULL)
+    {
+        CcRosAcquireVacbLock(current, NULL);
+    }
+
+    return current;
 }
 
 VOID
@@ -831,55 +856,45 @@ CcRosCreateVacb (
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosFindVacbLocked(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
+        CcRosVacbIncRefCount(current);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
-#endif
-            CcRosReleaseVacbLock(*Vacb);
-            KeReleaseGuardedMutex(&ViewLock);
-            ExFreeToNPagedLookasideList(&VacbLookasideList, *Vacb);
-            *Vacb = current;
-            CcRosAcquireVacbLock(current, NULL);
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
+        if (SharedCacheMap->Trace)
         {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
         }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+#endif
+        CcRosReleaseVacbLock(*Vacb);
+        KeReleaseGuardedMutex(&ViewLock);
+        ExFreeToNPagedLookasideList(&VacbLookasideList, *Vacb);
+        *Vacb = current;
+        CcRosAcquireVacbLock(current, NULL);
+        return STATUS_SUCCESS;
     }
     /* There was no existing VACB. */
     current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
+    InsertHeadList(CcRosVacbHashBucket(SharedCacheMap, FileOffset),
+                   &current->CacheMapVacbHashEntry);
+
+    /* Keep the list sorted by offset. Files are mostly read sequentially,
+     * so look for our place starting from the end of the list. */
+    current_entry = SharedCacheMap->CacheMapVacbListHead.Blink;
+    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
     {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+        previous = CONTAINING_RECORD(current_entry,
+                                     ROS_VACB,
+                                     CacheMapVacbListEntry);
+        if (previous->FileOffset.QuadPart < current->FileOffset.QuadPart)
+            break;
+        current_entry = current_entry->Blink;
     }
+    InsertHeadList(current_entry, &current->CacheMapVacbListEntry);
     KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseGuardedMutex(&ViewLock);
@@ -906,8 +921,13 @@ CcRosCreateVacb (
     Status = CcRosMapVacb(current);
     if (!NT_SUCCESS(Status))
     {
+        KeAcquireGuardedMutex(&ViewLock);
+        KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
         RemoveEntryList(&current->CacheMapVacbListEntry);
+        RemoveEntryList(&current->CacheMapVacbHashEntry);
         RemoveEntryList(&current->VacbLruListEntry);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
+        KeReleaseGuardedMutex(&ViewLock);
         CcRosReleaseVacbLock(current);
         ExFreeToNPagedLookasideList(&VacbLookasideList, current);
     }
@@ -1161,6 +1181,7 @@ CcRosDeleteFileCache (
         {
             current_entry = RemoveTailList(&SharedCacheMap->CacheMapVacbListHead);
             current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
+            RemoveEntryList(&current->CacheMapVacbHashEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             if (current->Dirty)
             {
@@ -1248,6 +1269,30 @@ CcRosDereferenceCache (
     KeReleaseGuardedMutex(&ViewLock);
 }
 
+static
+PROS_PRIVATE_CACHE_MAP
+CcRosCreatePrivateCacheMap (
+    PFILE_OBJECT FileObject,
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+{
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
+
+    PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(*PrivateMap), TAG_PRIVATE_CACHE_MAP);
+    if (PrivateMap == NULL)
+    {
+        return NULL;
+    }
+
+    RtlZeroMemory(PrivateMap, sizeof(*PrivateMap));
+    PrivateMap->NodeTypeCode = NODE_TYPE_PRIVATE_MAP;
+    PrivateMap->FileObject = FileObject;
+    PrivateMap->SharedCacheMap = SharedCacheMap;
+    PrivateMap->ReadAheadMask = PAGE_SIZE - 1;
+    KeInitializeSpinLock(&PrivateMap->ReadAheadSpinLock);
+
+    return PrivateMap;
+}
+
 NTSTATUS
 NTAPI
 CcRosReleaseFileCache (
@@ -1266,6 +1311,7 @@ CcRosReleaseFileCache (
         SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
         if (FileObject->PrivateCacheMap != NULL)
         {
+            ExFreePoolWithTag(FileObject->PrivateCacheMap, TAG_PRIVATE_CACHE_MAP);
             FileObject->PrivateCacheMap = NULL;
             if (SharedCacheMap->OpenCount > 0)
             {
@@ -1300,12 +1346,19 @@ CcTryToInitializeFileCache (
     }
     else
     {
+        Status = STATUS_SUCCESS;
         if (FileObject->PrivateCacheMap == NULL)
         {
-            FileObject->PrivateCacheMap = SharedCacheMap;
-            SharedCacheMap->OpenCount++;
+            FileObject->PrivateCacheMap = CcRosCreatePrivateCacheMap(FileObject, SharedCacheMap);
+            if (FileObject->PrivateCacheMap == NULL)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            else
+            {
+                SharedCacheMap->OpenCount++;
+            }
         }
-        Status = STATUS_SUCCESS;
     }
     KeReleaseGuardedMutex(&ViewLock);
 
@@ -1335,6 +1388,7 @@ CcRosInitializeFileCache (
     if (SharedCacheMap == NULL)
     {
         KIRQL OldIrql;
+        ULONG i;
 
         SharedCacheMap = ExAllocateFromNPagedLookasideList(&SharedCacheMapLookasideList);
         if (SharedCacheMap == NULL)
@@ -1357,6 +1411,10 @@ CcRosInitializeFileCache (
         SharedCacheMap->DirtyPages = 0;
         KeInitializeSpinLock(&SharedCacheMap->CacheMapLock);
         InitializeListHead(&SharedCacheMap->CacheMapVacbListHead);
+        for (i = 0; i < CC_VACB_HASH_BUCKETS; i++)
+        {
+            InitializeListHead(&SharedCacheMap->VacbHashTable[i]);
+        }
         FileObject->SectionObjectPointer->SharedCacheMap = SharedCacheMap;
 
         KeAcquireSpinLock(&iSharedCacheMapLock, &OldIrql);
@@ -1365,7 +1423,12 @@ CcRosInitializeFileCache (
     }
     if (FileObject->PrivateCacheMap == NULL)
     {
-        FileObject->PrivateCacheMap = SharedCacheMap;
+        FileObject->PrivateCacheMap = CcRosCreatePrivateCacheMap(FileObject, SharedCacheMap);
+        if (FileObject->PrivateCacheMap == NULL)
+        {
+            KeReleaseGuardedMutex(&ViewLock);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
         SharedCacheMap->OpenCount++;
     }
     KeReleaseGuardedMutex(&ViewLock);
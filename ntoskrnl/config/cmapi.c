@@ -872,25 +872,16 @@ DoAgain:
         KeQuerySystemTime(&Parent->LastWriteTime);
         Kcb->KcbLastWriteTime = Parent->LastWriteTime;
 
-        /* Check if the cell is cached */
-        if ((Found) && (CMP_IS_CELL_CACHED(Kcb->ValueCache.ValueList)))
-        {
-            /* Shouldn't happen */
-            ASSERT(FALSE);
-        }
-        else
-        {
-            /* Cleanup the value cache */
-            CmpCleanUpKcbValueCache(Kcb);
+        /* The cached values are stale now, cleanup the value cache */
+        CmpCleanUpKcbValueCache(Kcb);
 
-            /* Sanity checks */
-            ASSERT(!(CMP_IS_CELL_CACHED(Kcb->ValueCache.ValueList)));
-            ASSERT(!(Kcb->ExtFlags & CM_KCB_SYM_LINK_FOUND));
+        /* Sanity checks */
+        ASSERT(!(CMP_IS_CELL_CACHED(Kcb->ValueCache.ValueList)));
+        ASSERT(!(Kcb->ExtFlags & CM_KCB_SYM_LINK_FOUND));
 
-            /* Set the value cache */
-            Kcb->ValueCache.Count = Parent->ValueList.Count;
-            Kcb->ValueCache.ValueList = Parent->ValueList.List;
-        }
+        /* Set the value cache */
+        Kcb->ValueCache.Count = Parent->ValueList.Count;
+        Kcb->ValueCache.ValueList = Parent->ValueList.List;
 
         /* Notify registered callbacks */
         CmpReportNotify(Kcb,
@@ -1232,6 +1223,25 @@ DoAgain:
     if (Kcb->ValueCache.Count != Parent->ValueList.Count)
     {
         DPRINT1("HACK: Overriding value cache count\n");
+
+        /* A cached list would have the old count, so throw it away */
+        if (CMP_IS_CELL_CACHED(Kcb->ValueCache.ValueList))
+        {
+            /* That needs the exclusive lock */
+            if (!(CmpIsKcbLockedExclusive(Kcb)) &&
+                !(CmpTryToConvertKcbSharedToExclusive(Kcb)))
+            {
+                /* Try with exclusive KCB lock */
+                HvReleaseCell(Hive, Kcb->KeyCell);
+                CmpConvertKcbSharedToExclusive(Kcb);
+                goto DoAgain;
+            }
+
+            /* Cleanup the value cache */
+            CmpCleanUpKcbValueCache(Kcb);
+            Kcb->ValueCache.ValueList = Parent->ValueList.List;
+        }
+
         Kcb->ValueCache.Count = Parent->ValueList.Count;
     }
 
@@ -12,9 +12,13 @@
 #define NDEBUG
 #include "debug.h"
 
+/* GLOBALS *******************************************************************/
+
+ULONG CmpValueCacheHits, CmpValueCacheMisses;
+
 FORCEINLINE
 BOOLEAN
-CmpIsValueCached(IN HCELL_INDEX CellIndex)
+CmpIsValueCached(IN ULONG_PTR CellIndex)
 {
     /* Make sure that the cell is valid in the first place */
     if (CellIndex == HCELL_NIL) return FALSE;
@@ -28,17 +32,133 @@ CmpIsValueCached(IN HCELL_INDEX CellIndex)
 
 FORCEINLINE
 VOID
-CmpSetValueCached(IN PHCELL_INDEX CellIndex)
+CmpSetValueCached(IN PULONG_PTR CellIndex)
 {
     /* Set the cached bit */
     *CellIndex |= 1;
 }
 
-#define ASSERT_VALUE_CACHE() \
-    ASSERTMSG("Cached Values Not Yet Supported!", FALSE);
-
 /* FUNCTIONS *****************************************************************/
 
+static
+ULONG
+CmpComputeValueNameHash(IN PCUNICODE_STRING Name)
+{
+    ULONG HashKey = 0, i;
+
+    /* Same hash as for key names, so that case doesn't matter */
+    for (i = 0; i < Name->Length / sizeof(WCHAR); i++)
+    {
+        HashKey = 37 * HashKey + RtlUpcaseUnicodeChar(Name->Buffer[i]);
+    }
+
+    return HashKey;
+}
+
+static
+ULONG
+CmpComputeKeyValueHash(IN PCM_KEY_VALUE KeyValue)
+{
+    UNICODE_STRING Name;
+    PUCHAR CompressedName;
+    ULONG HashKey = 0, i;
+
+    /* Check if the name is compressed */
+    if (KeyValue->Flags & VALUE_COMP_NAME)
+    {
+        /* Hash it one byte per character */
+        CompressedName = (PUCHAR)KeyValue->Name;
+        for (i = 0; i < KeyValue->NameLength; i++)
+        {
+            HashKey = 37 * HashKey + RtlUpcaseUnicodeChar((WCHAR)CompressedName[i]);
+        }
+
+        return HashKey;
+    }
+
+    /* It's a regular name */
+    Name.Length = KeyValue->NameLength;
+    Name.MaximumLength = Name.Length;
+    Name.Buffer = KeyValue->Name;
+    return CmpComputeValueNameHash(&Name);
+}
+
+static
+PCM_CACHED_VALUE
+CmpCacheKeyValue(IN PHHIVE Hive,
+                 IN PCM_KEY_VALUE KeyValue)
+{
+    PCM_CACHED_VALUE CachedValue;
+    ULONG NameSize, ValueKeySize, DataLength, Length;
+    USHORT DataCacheType;
+    PVOID Buffer = NULL;
+    BOOLEAN BufferAllocated = FALSE;
+    HCELL_INDEX CellToRelease = HCELL_NIL;
+
+    /* The data goes right after the name, aligned */
+    NameSize = FIELD_OFFSET(CM_KEY_VALUE, Name) + KeyValue->NameLength;
+    ValueKeySize = ALIGN_UP_BY(NameSize, sizeof(ULONG));
+
+    /* Small values already have their data inside the key value */
+    if (CmpIsKeyValueSmall(&DataLength, KeyValue->DataLength) || !DataLength)
+    {
+        DataCacheType = CM_CACHE_DATA_CACHED;
+        DataLength = 0;
+    }
+    else if (DataLength > MAXIMUM_CACHED_DATA)
+    {
+        /* This one will always be read from the hive */
+        DataCacheType = CM_CACHE_DATA_TOO_LARGE;
+        DataLength = 0;
+    }
+    else if (CmpGetValueData(Hive,
+                             KeyValue,
+                             &Length,
+                             &Buffer,
+                             &BufferAllocated,
+                             &CellToRelease))
+    {
+        /* We'll keep a copy of the data */
+        ASSERT(Length == DataLength);
+        DataCacheType = CM_CACHE_DATA_CACHED;
+    }
+    else
+    {
+        /* We couldn't read it now, try again when it's asked for */
+        DataCacheType = CM_CACHE_DATA_NOT_CACHED;
+        DataLength = 0;
+    }
+
+    /* Allocate the cached value */
+    CachedValue = CmpAllocate(FIELD_OFFSET(CM_CACHED_VALUE, KeyValue) +
+                              ValueKeySize +
+                              DataLength,
+                              TRUE,
+                              TAG_CM);
+    if (CachedValue)
+    {
+        /* Fill it out */
+        CachedValue->DataCacheType = DataCacheType;
+        CachedValue->ValueKeySize = (USHORT)ValueKeySize;
+        CachedValue->HashKey = CmpComputeKeyValueHash(KeyValue);
+        RtlCopyMemory(&CachedValue->KeyValue, KeyValue, NameSize);
+
+        /* Copy the data if we have any */
+        if (DataLength)
+        {
+            RtlCopyMemory((PUCHAR)&CachedValue->KeyValue + ValueKeySize,
+                          Buffer,
+                          DataLength);
+        }
+    }
+
+    /* Release the data */
+    if (CellToRelease != HCELL_NIL) HvReleaseCell(Hive, CellToRelease);
+    if (BufferAllocated) CmpFree(Buffer, 0);
+
+    return CachedValue;
+}
+
 VALUE_SEARCH_RETURN_TYPE
 NTAPI
 CmpGetValueListFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
@@ -49,6 +169,8 @@ CmpGetValueListFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
     PHHIVE Hive;
     PCACHED_CHILD_LIST ChildList;
     HCELL_INDEX CellToRelease;
+    PCM_CACHED_VALUE_INDEX CachedIndex;
+    ULONG i;
 
     /* Set defaults */
     *ValueListToRelease = HCELL_NIL;
@@ -61,10 +183,9 @@ CmpGetValueListFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
     /* Check if the value is cached */
     if (CmpIsValueCached(ChildList->ValueList))
     {
-        /* It is: we don't expect this yet! */
-        ASSERT_VALUE_CACHE();
+        /* It is, return the cached list */
         *IndexIsCached = TRUE;
-        *CellData = NULL;
+        *CellData = (PCELL_DATA)CMP_GET_CACHED_DATA(ChildList->ValueList);
     }
     else
     {
@@ -80,11 +201,35 @@ CmpGetValueListFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
         CellToRelease = ChildList->ValueList;
         *CellData = (PCELL_DATA)HvGetCell(Hive, CellToRelease);
         if (!(*CellData)) return SearchFail;
-        
-        /* FIXME: Here we would cache the value */
 
-        /* Return the cell to be released */
-        *ValueListToRelease = CellToRelease;
+        /* Now cache the list, values will be added to it as they're used */
+        CachedIndex = CmpAllocate(FIELD_OFFSET(CM_CACHED_VALUE_INDEX, Data.List) +
+                                  ChildList->Count * sizeof(ULONG_PTR),
+                                  TRUE,
+                                  TAG_CM);
+        if (CachedIndex)
+        {
+            /* Copy the cell indexes */
+            CachedIndex->CellIndex = CellToRelease;
+            for (i = 0; i < ChildList->Count; i++)
+            {
+                CachedIndex->Data.List[i] = (*CellData)->u.KeyList[i];
+            }
+
+            /* We don't need the cell anymore */
+            HvReleaseCell(Hive, CellToRelease);
+
+            /* Replace the value list in the KCB and return the cached one */
+            ChildList->ValueList = (ULONG_PTR)CachedIndex;
+            CmpSetValueCached(&ChildList->ValueList);
+            *CellData = (PCELL_DATA)CMP_GET_CACHED_DATA(ChildList->ValueList);
+            *IndexIsCached = TRUE;
+        }
+        else
+        {
+            /* No memory to cache it, return the cell to be released */
+            *ValueListToRelease = CellToRelease;
+        }
     }
 
     /* If we got here, then the value list was found */
@@ -104,6 +249,8 @@ CmpGetValueKeyFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
 {
     PHHIVE Hive;
     PCM_KEY_VALUE KeyValue;
+    PCM_CACHED_VALUE NewValue;
+    PULONG_PTR CachedList;
     HCELL_INDEX Cell;
 
     /* Set defaults */
@@ -117,13 +264,58 @@ CmpGetValueKeyFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
     /* Check if the index was cached */
     if (IndexIsCached)
     {
-        /* Not expected yet! */
-        ASSERT_VALUE_CACHE();
-        *ValueIsCached = TRUE;
+        /* Get the entry for this value */
+        CachedList = (PULONG_PTR)CellData;
+        *CachedValue = (PCM_CACHED_VALUE *)&CachedList[Index];
+
+        /* Check if the value itself is cached too */
+        if (CmpIsValueCached(CachedList[Index]))
+        {
+            /* It is, nothing to read from the hive */
+            InterlockedIncrement((PLONG)&CmpValueCacheHits);
+            *Value = CMP_GET_CACHED_VALUE(CachedList[Index]);
+            *ValueIsCached = TRUE;
+            return SearchSuccess;
+        }
+
+        /* We'll have to cache it, make sure the KCB is locked exclusive */
+        if (!(CmpIsKcbLockedExclusive(Kcb)) &&
+            !(CmpTryToConvertKcbSharedToExclusive(Kcb)))
+        {
+            /* We need the exclusive lock */
+            return SearchNeedExclusiveLock;
+        }
+
+        /* Get the cell index and the key value associated to it */
+        InterlockedIncrement((PLONG)&CmpValueCacheMisses);
+        Cell = (HCELL_INDEX)CachedList[Index];
+        KeyValue = (PCM_KEY_VALUE)HvGetCell(Hive, Cell);
+        if (!KeyValue) return SearchFail;
+
+        /* Cache it */
+        NewValue = CmpCacheKeyValue(Hive, KeyValue);
+        if (NewValue)
+        {
+            /* We don't need the cell anymore */
+            HvReleaseCell(Hive, Cell);
+
+            /* Replace the entry and return the cached value */
+            CachedList[Index] = (ULONG_PTR)NewValue;
+            CmpSetValueCached(&CachedList[Index]);
+            *Value = &NewValue->KeyValue;
+            *ValueIsCached = TRUE;
+        }
+        else
+        {
+            /* No memory to cache it, return the cell to be released */
+            *CellToRelease = Cell;
+            *Value = KeyValue;
+        }
     }
     else
     {
         /* Get the cell index and the key value associated to it */
+        InterlockedIncrement((PLONG)&CmpValueCacheMisses);
         Cell = CellData->u.KeyList[Index];
         KeyValue = (PCM_KEY_VALUE)HvGetCell(Hive, Cell);
         if (!KeyValue) return SearchFail;
@@ -148,6 +340,7 @@ CmpGetValueDataFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
                          OUT PHCELL_INDEX CellToRelease)
 {
     PHHIVE Hive;
+    PCM_CACHED_VALUE Cached;
     ULONG Length;
 
     /* Sanity checks */
@@ -165,26 +358,31 @@ CmpGetValueDataFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
     /* Check it the value is cached */
     if (ValueIsCached)
     {
-        /* This isn't expected! */
-        ASSERT_VALUE_CACHE();
-    }
-    else
-    {
-        /* It's not, get the value data using the typical routine */
-        if (!CmpGetValueData(Hive,
-                             &ValueKey->u.KeyValue,
-                             &Length,
-                             DataPointer,
-                             Allocated,
-                             CellToRelease))
+        /* Get the cached value, and check if its data is cached as well */
+        Cached = (PCM_CACHED_VALUE)CMP_GET_CACHED_CELL((ULONG_PTR)*CachedValue);
+        ASSERT(&Cached->KeyValue == &ValueKey->u.KeyValue);
+        if (Cached->DataCacheType == CM_CACHE_DATA_CACHED)
         {
-            /* Nothing found: make sure no data was allocated */
-            ASSERT(*Allocated == FALSE);
-            ASSERT(*DataPointer == NULL);
-            return SearchFail;
+            /* It is, the data follows the key value */
+            *DataPointer = (PUCHAR)&Cached->KeyValue + Cached->ValueKeySize;
+            return SearchSuccess;
         }
     }
 
+    /* Get the value data using the typical routine */
+    if (!CmpGetValueData(Hive,
+                         &ValueKey->u.KeyValue,
+                         &Length,
+                         DataPointer,
+                         Allocated,
+                         CellToRelease))
+    {
+        /* Nothing found: make sure no data was allocated */
+        ASSERT(*Allocated == FALSE);
+        ASSERT(*DataPointer == NULL);
+        return SearchFail;
+    }
+
     /* We found the actual data, return success */
     return SearchSuccess;
 }
@@ -207,7 +405,7 @@ CmpFindValueByNameFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
     PCACHED_CHILD_LIST ChildList;
     PCM_KEY_VALUE KeyValue;
     BOOLEAN IndexIsCached;
-    ULONG i = 0;
+    ULONG i = 0, HashKey;
     HCELL_INDEX Cell = HCELL_NIL;
 
     /* Set defaults */
@@ -234,8 +432,8 @@ CmpFindValueByNameFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
             return SearchResult;
         }
 
-        /* The index shouldn't be cached right now */
-        if (IndexIsCached) ASSERT_VALUE_CACHE();
+        /* Cached values are compared by hash first */
+        HashKey = IndexIsCached ? CmpComputeValueNameHash(Name) : 0;
 
         /* Loop every value */
         while (TRUE)
@@ -266,15 +464,15 @@ CmpFindValueByNameFromCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
             }
 
             /* Check if the both the index and the value are cached */
-            if (IndexIsCached && *ValueIsCached)
+            if (IndexIsCached && *ValueIsCached &&
+                (CONTAINING_RECORD(*Value, CM_CACHED_VALUE, KeyValue)->HashKey != HashKey))
             {
-                /* We don't expect this yet */
-                ASSERT_VALUE_CACHE();
+                /* The hash doesn't match, so the name can't either */
                 Result = -1;
             }
             else
             {
-                /* No cache, so try to compare the name. Is it compressed? */
+                /* Try to compare the name. Is it compressed? */
                 KeyValue = *Value;
                 if (KeyValue->Flags & VALUE_COMP_NAME)
                 {
@@ -799,13 +997,13 @@ CmpCompareNewValueDataAgainstKCBCache(IN PCM_KEY_CONTROL_BLOCK Kcb,
 
 Quickie:
     /* Release the value cell */
-    if (ValueCellToRelease) HvReleaseCell(Kcb->KeyHive, ValueCellToRelease);
+    if (ValueCellToRelease != HCELL_NIL) HvReleaseCell(Kcb->KeyHive, ValueCellToRelease);
     
     /* Free the buffer */
     if (BufferAllocated) CmpFree(Buffer, 0);
     
     /* Free the cell */
-    if (CellToRelease) HvReleaseCell(Kcb->KeyHive, CellToRelease);
+    if (CellToRelease != HCELL_NIL) HvReleaseCell(Kcb->KeyHive, CellToRelease);
 
     /* Return the search result */
     return SearchResult;
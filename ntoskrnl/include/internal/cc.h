@@ -147,9 +147,15 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/* Number of hash buckets used to look up the VACBs of a shared cache map.
+ * Consecutive views go to consecutive buckets, so a file needs to be bigger
+ * than CC_VACB_HASH_BUCKETS * VACB_MAPPING_GRANULARITY to get any chain. */
+#define CC_VACB_HASH_BUCKETS 128
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     LIST_ENTRY CacheMapVacbListHead;
+    LIST_ENTRY VacbHashTable[CC_VACB_HASH_BUCKETS];
     ULONG TimeStamp;
     PFILE_OBJECT FileObject;
     LARGE_INTEGER SectionSize;
@@ -162,11 +168,33 @@ typedef struct _ROS_SHARED_CACHE_MAP
     ULONG DirtyPages;
     LIST_ENTRY SharedCacheMapLinks;
     ULONG DirtyPageThreshold;
+    BOOLEAN ReadAheadDisabled;
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
 } ROS_SHARED_CACHE_MAP, *PROS_SHARED_CACHE_MAP;
 
+#define NODE_TYPE_PRIVATE_MAP 0x02FE
+
+/* How far we read ahead of a sequential reader, rounded up to the read-ahead
+ * granularity of the file */
+#define CC_READ_AHEAD_LENGTH (2 * VACB_MAPPING_GRANULARITY)
+
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    CSHORT NodeTypeCode;
+    PFILE_OBJECT FileObject;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    /* Read-ahead state, protected by ReadAheadSpinLock */
+    KSPIN_LOCK ReadAheadSpinLock;
+    ULONG ReadAheadMask;
+    /* Range of the last read on this file object */
+    LARGE_INTEGER FileOffset;
+    LARGE_INTEGER BeyondLastByte;
+    /* Everything before this offset has already been scheduled for read-ahead */
+    LARGE_INTEGER ReadAheadOffset;
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
 typedef struct _ROS_VACB
 {
     /* Base address of the region where the view's data is mapped. */
@@ -182,6 +210,8 @@ typedef struct _ROS_VACB
     ULONG MappedCount;
     /* Entry in the list of VACBs for this shared cache map. */
     LIST_ENTRY CacheMapVacbListEntry;
+    /* Entry in the hash chain of VACBs for this shared cache map. */
+    LIST_ENTRY CacheMapVacbHashEntry;
     /* Entry in the list of VACBs which are dirty. */
     LIST_ENTRY DirtyVacbListEntry;
     /* Entry in the list of VACBs. */
@@ -293,6 +323,13 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+PROS_VACB
+NTAPI
+CcRosFindVacbLocked(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
@@ -374,6 +411,16 @@ VOID
 NTAPI
 CcShutdownSystem(VOID);
 
+FORCEINLINE
+PLIST_ENTRY
+CcRosVacbHashBucket(
+    _In_ PROS_SHARED_CACHE_MAP SharedCacheMap,
+    _In_ LONGLONG FileOffset)
+{
+    ULONG Index = (ULONG)(FileOffset / VACB_MAPPING_GRANULARITY);
+    return &SharedCacheMap->VacbHashTable[Index & (CC_VACB_HASH_BUCKETS - 1)];
+}
+
 FORCEINLINE
 NTSTATUS
 CcRosAcquireVacbLock(
@@ -113,6 +113,13 @@
 //
 #define MAXIMUM_CACHED_DATA                             2 * PAGE_SIZE
 
+//
+// Value Cache Data Types
+//
+#define CM_CACHE_DATA_NOT_CACHED                        0
+#define CM_CACHE_DATA_CACHED                            1
+#define CM_CACHE_DATA_TOO_LARGE                         2
+
 //
 // Hives to load on startup
 //
@@ -206,7 +213,7 @@ typedef struct _CACHED_CHILD_LIST
     ULONG Count;
     union
     {
-        ULONG ValueList;
+        ULONG_PTR ValueList;
         struct _CM_KEY_CONTROL_BLOCK *RealKcb;
     };
 } CACHED_CHILD_LIST, *PCACHED_CHILD_LIST;
@@ -1518,6 +1525,7 @@ extern BOOLEAN CmpProfileLoaded;
 extern PCMHIVE CmiVolatileHive;
 extern LIST_ENTRY CmiKeyObjectListHead;
 extern BOOLEAN CmpHoldLazyFlush;
+extern ULONG CmpValueCacheHits, CmpValueCacheMisses;
 
 //
 // Inlined functions
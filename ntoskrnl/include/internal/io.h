@@ -86,6 +86,11 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Max completion packets NtRemoveIoCompletionEx removes in one call
+//
+#define IOP_MAX_COMPLETION_BATCH 64
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
@@ -226,6 +226,17 @@ KiReleasePrcbLock(IN PKPRCB Prcb)
     UNREFERENCED_PARAMETER(Prcb);
 }
 
+//
+// This routine protects against multiple CPU acquires, it's meaningless on UP.
+//
+FORCEINLINE
+BOOLEAN
+KiTryAcquirePrcbLock(IN PKPRCB Prcb)
+{
+    UNREFERENCED_PARAMETER(Prcb);
+    return TRUE;
+}
+
 //
 // This routine protects against multiple CPU acquires, it's meaningless on UP.
 //
@@ -469,6 +480,25 @@ KiReleasePrcbLock(IN PKPRCB Prcb)
     InterlockedAnd((PLONG)&Prcb->PrcbLock, 0);
 }
 
+//
+// This routine attempts to acquire the PRCB lock without spinning. It is used
+// when the caller already owns another PRCB lock and must not wait for this
+// one, since the owner could be waiting for ours.
+//
+FORCEINLINE
+BOOLEAN
+KiTryAcquirePrcbLock(IN PKPRCB Prcb)
+{
+    /* Make sure we're at a safe level to touch the PRCB lock */
+    ASSERT(KeGetCurrentIrql() >= DISPATCH_LEVEL);
+
+    /* Don't bother with the interlocked operation if it's already taken */
+    if (Prcb->PrcbLock) return FALSE;
+
+    /* Return whether we acquired it first */
+    return (InterlockedExchange((PLONG)&Prcb->PrcbLock, 1) == 0);
+}
+
 //
 // This routine acquires the thread lock so that only one caller can touch
 // volatile thread data.
@@ -1231,7 +1261,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
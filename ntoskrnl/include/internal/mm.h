@@ -43,7 +43,7 @@ extern PMMPTE MmDebugPte; // internal
 struct _KTRAP_FRAME;
 struct _EPROCESS;
 struct _MM_RMAP_ENTRY;
-typedef ULONG_PTR SWAPENTRY;
+typedef ULONG_PTR SWAPENTRY, *PSWAPENTRY;
 
 //
 // MmDbgCopyMemory Flags
@@ -229,6 +229,31 @@ typedef struct _MEMORY_AREA
     } Data;
 } MEMORY_AREA, *PMEMORY_AREA;
 
+//
+// Dirty pages gathered by the trimmer, written out to a run of paging file
+// slots with a single I/O
+//
+#define MM_SWAP_CLUSTER_SIZE     16
+
+typedef struct _MM_PAGEOUT_ENTRY
+{
+    PMMSUPPORT AddressSpace;
+    PMEMORY_AREA MemoryArea;
+    PVOID Address;
+    PFN_NUMBER Page;
+    ULONG_PTR SectionEntry;
+    LARGE_INTEGER Offset;
+    BOOLEAN Private;
+}
+MM_PAGEOUT_ENTRY, *PMM_PAGEOUT_ENTRY;
+
+typedef struct _MM_PAGEOUT_CLUSTER
+{
+    ULONG Count;
+    MM_PAGEOUT_ENTRY Entries[MM_SWAP_CLUSTER_SIZE];
+}
+MM_PAGEOUT_CLUSTER, *PMM_PAGEOUT_CLUSTER;
+
 typedef struct _MM_RMAP_ENTRY
 {
    struct _MM_RMAP_ENTRY* Next;
@@ -600,6 +625,20 @@ SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID);
 
+ULONG
+NTAPI
+MmAllocSwapPages(
+    ULONG Count,
+    PSWAPENTRY SwapEntries
+);
+
+SWAPENTRY
+NTAPI
+MmOffsetSwapEntry(
+    SWAPENTRY SwapEntry,
+    LONG Pages
+);
+
 VOID
 NTAPI
 MmFreeSwapPage(SWAPENTRY Entry);
@@ -626,6 +665,22 @@ MmWriteToSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    SWAPENTRY SwapEntry,
+    PPFN_NUMBER Pages,
+    ULONG Count
+);
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    SWAPENTRY SwapEntry,
+    PPFN_NUMBER Pages,
+    ULONG Count
+);
+
 VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
@@ -637,6 +692,45 @@ MiReadPageFile(
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset);
 
+NTSTATUS
+NTAPI
+MiWriteToSwapPagesOnDisk(
+    SWAPENTRY SwapEntry,
+    PPFN_NUMBER Pages,
+    ULONG Count
+);
+
+/* pagestore.c ***************************************************************/
+
+VOID
+NTAPI
+MmInitializePageStore(VOID);
+
+BOOLEAN
+NTAPI
+MmStorePage(
+    SWAPENTRY SwapEntry,
+    PFN_NUMBER Page
+);
+
+BOOLEAN
+NTAPI
+MmLoadStoredPage(
+    SWAPENTRY SwapEntry,
+    PFN_NUMBER Page
+);
+
+VOID
+NTAPI
+MmRemoveStoredPage(SWAPENTRY SwapEntry);
+
+VOID
+NTAPI
+MmAccountPageStoreDiskRead(
+    ULONG Pages,
+    LONGLONG Ticks
+);
+
 /* process.c ****************************************************************/
 
 NTSTATUS
@@ -866,6 +960,13 @@ NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page);
 
+NTSTATUS
+NTAPI
+MmPageOutPhysicalAddressCluster(
+    PFN_NUMBER Page,
+    PMM_PAGEOUT_CLUSTER Cluster
+);
+
 /* freelist.c **********************************************************/
 
 FORCEINLINE
@@ -1303,7 +1404,14 @@ MmPageOutSectionView(
     PMMSUPPORT AddressSpace,
     PMEMORY_AREA MemoryArea,
     PVOID Address,
-    ULONG_PTR Entry
+    ULONG_PTR Entry,
+    PMM_PAGEOUT_CLUSTER Cluster
+);
+
+ULONG
+NTAPI
+MmFlushPageOutCluster(
+    PMM_PAGEOUT_CLUSTER Cluster
 );
 
 NTSTATUS
@@ -64,6 +64,9 @@ KiDpcInterruptHandler(VOID)
         NewThread->State = Running;
         OldThread->WaitReason = WrDispatchInt;
 
+        /* Set context swap busy */
+        KiSetThreadSwapBusy(OldThread);
+
         /* Make the old thread ready */
         KxQueueReadyThread(OldThread, Prcb);
 
@@ -103,6 +106,9 @@ KeUserModeCallback(IN ULONG RoutineIndex,
                    OUT PVOID *Result,
                    OUT PULONG ResultLength)
 {
+    /* The callback must see the GDI commands queued before it */
+    if (NtCurrentTeb()->GdiBatchCount) KeGdiFlushUserBatch();
+
     UNIMPLEMENTED;
     __debugbreak();
     return STATUS_UNSUCCESSFUL;
@@ -136,6 +142,11 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Look for work on the other processors if we were asked to */
+        if (Prcb->IdleSchedule) KiIdleSchedule(Prcb);
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -354,6 +365,13 @@ KiSystemCallHandler(
     /* Get descriptor table */
     DescriptorTable = (PVOID)((ULONG_PTR)Thread->ServiceTable + Offset);
 
+    /* Check if this is a GUI call */
+    if (Offset & SERVICE_TABLE_TEST)
+    {
+        /* Get the batch count and flush if necessary */
+        if (NtCurrentTeb()->GdiBatchCount) KeGdiFlushUserBatch();
+    }
+
     /* Get stack bytes and calculate argument count */
     Count = DescriptorTable->Number[ServiceNumber] / 8;
 
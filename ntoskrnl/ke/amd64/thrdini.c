@@ -151,6 +151,10 @@ KiSwapContextResume(
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
+
+    /* The old thread is off its stack, other processors may run it now */
+    OldThread->SwapBusy = FALSE;
+
     if (OldProcess != NewProcess)
     {
         /* Switch address space and flush TLB */
@@ -291,6 +291,11 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Look for work on the other processors if we were asked to */
+        if (Prcb->IdleSchedule) KiIdleSchedule(Prcb);
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -334,6 +339,10 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
+
+    /* The old thread is off its stack, other processors may run it now */
+    OldThread->SwapBusy = FALSE;
+
     if (OldProcess != NewProcess)
     {
         /* Check if there is a different LDT */
@@ -435,6 +444,9 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
+    /* Wait until the new thread's old processor has switched off its stack */
+    while (NewThread->SwapBusy) YieldProcessor();
+
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
 
@@ -502,6 +514,9 @@ KiDispatchInterrupt(VOID)
         NewThread->State = Running;
         OldThread->WaitReason = WrDispatchInt;
 
+        /* Set context swap busy */
+        KiSetThreadSwapBusy(OldThread);
+
         /* Make the old thread ready */
         KxQueueReadyThread(OldThread, Prcb);
 
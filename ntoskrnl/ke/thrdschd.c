@@ -15,9 +15,13 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -27,13 +31,160 @@ ULONG_PTR KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+//
+// Picks the processor a thread should run on out of a set of candidates.
+// The ideal processor wins, then the processor the thread last ran on (its
+// cache is still warm), then the current processor (no IPI is needed), and
+// finally the next candidate to the right of the ideal processor.
+//
+FORCEINLINE
+ULONG
+KiSelectCandidateProcessor(IN PKTHREAD Thread,
+                           IN KAFFINITY Candidates)
+{
+    ULONG Processor;
+    ASSERT(Candidates != 0);
+
+    /* Check the ideal processor first */
+    Processor = Thread->IdealProcessor;
+    if (Candidates & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Then the processor the thread last ran on */
+    Processor = Thread->NextProcessor;
+    if (Candidates & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Then the current processor */
+    Processor = KeGetCurrentProcessorNumber();
+    if (Candidates & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Otherwise spread out starting from the ideal processor */
+    return KeFindNextRightSetAffinity(Thread->IdealProcessor,
+                                      (ULONG)Candidates);
+}
+
+//
+// Tries to take the highest priority ready thread, at or above the given
+// priority, that is allowed to run on the given PRCB away from another
+// processor. The caller owns the destination PRCB lock; the source PRCB lock
+// is only tried, since two processors balancing at once would otherwise be
+// able to deadlock on each other's PRCB lock.
+//
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB Prcb,
+                   IN PKPRCB SourcePrcb,
+                   IN KPRIORITY Priority)
+{
+    ULONG PrioritySet;
+    LONG HighPriority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Don't bother taking the lock if there is nothing worth stealing */
+    if (!(SourcePrcb->ReadySummary >> Priority)) return NULL;
+    if (!KiTryAcquirePrcbLock(SourcePrcb)) return NULL;
+
+    /* Scan the ready queues from the highest priority down */
+    PrioritySet = SourcePrcb->ReadySummary >> Priority;
+    while (PrioritySet)
+    {
+        /* Get the highest priority with a ready thread */
+        BitScanReverse((PULONG)&HighPriority, PrioritySet);
+        PrioritySet ^= PRIORITY_MASK(HighPriority);
+        HighPriority += Priority;
+
+        /* Loop the ready threads at this priority */
+        ListHead = &SourcePrcb->DispatcherReadyListHead[HighPriority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            /* Skip threads which cannot run on the destination processor */
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            if (!(Thread->Affinity & Prcb->SetMember)) continue;
+
+            /* Sanity checks */
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->NextProcessor == SourcePrcb->Number);
+
+            /* Remove it and update the ready summary if the list is empty */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                SourcePrcb->ReadySummary ^= PRIORITY_MASK(HighPriority);
+            }
+
+            /* It belongs to the destination processor now */
+            Thread->NextProcessor = Prcb->Number;
+            KiReleasePrcbLock(SourcePrcb);
+            return Thread;
+        }
+    }
+
+    /* Nothing could be moved */
+    KiReleasePrcbLock(SourcePrcb);
+    return NULL;
+}
+
+//
+// Load-balancing pass run by a processor that ran out of work: look at the
+// other processors' ready queues and pull over a thread that may run here.
+//
+static
+PKTHREAD
+KiFindReadyThread(IN PKPRCB Prcb)
+{
+    ULONG Index, Processor;
+    PKTHREAD Thread;
+
+    /* Start with our right neighbour so that idle processors spread out */
+    Processor = Prcb->Number;
+    for (Index = 1; Index < (ULONG)KeNumberProcessors; Index++)
+    {
+        /* Get the next processor, wrapping around */
+        if (++Processor == (ULONG)KeNumberProcessors) Processor = 0;
+
+        /* Try to take a thread from it */
+        Thread = KiStealReadyThread(Prcb, KiProcessorBlock[Processor], 0);
+        if (Thread) return Thread;
+    }
+
+    /* No other processor has work for us */
+    return NULL;
+}
+#endif
+
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    PKTHREAD Thread = NULL;
+
+    /* Lock the PRCB and see if somebody already gave us work */
+    KiAcquirePrcbLock(Prcb);
+    Prcb->IdleSchedule = FALSE;
+    if (!Prcb->NextThread)
+    {
+        /* Go look for work on the other processors */
+        Thread = KiFindReadyThread(Prcb);
+        if (Thread)
+        {
+            /* We're no longer idle, run it next */
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+        }
+    }
+
+    /* Release the lock and return the thread we found, if any */
+    KiReleasePrcbLock(Prcb);
+    return Thread;
+#else
+    /* There are no other processors to take work from */
+    Prcb->IdleSchedule = FALSE;
     return NULL;
+#endif
 }
 
 VOID
@@ -83,6 +234,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    KAFFINITY Affinity, IdleSet;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,6 +382,43 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
+#ifdef CONFIG_SMP
+    /* Check if any processor this thread may run on is idle */
+    Affinity = Thread->Affinity;
+    IdleSet = Affinity & KiIdleSummary;
+    while (IdleSet)
+    {
+        /* Pick the best idle processor, get its PRCB and lock it */
+        Processor = KiSelectCandidateProcessor(Thread, IdleSet);
+        Prcb = KiProcessorBlock[Processor];
+        KiAcquirePrcbLock(Prcb);
+
+        /* Make sure nobody else grabbed it while we were looking */
+        if ((KiIdleSummary & AFFINITY_MASK(Processor)) && !(Prcb->NextThread))
+        {
+            /* Clear its idle bit and set this thread as the next one */
+            InterlockedAndSetMember(&KiIdleSummary, ~AFFINITY_MASK(Processor));
+            Thread->NextProcessor = (UCHAR)Processor;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+
+            /* Unlock the PRCB and wake up the processor if it's not us */
+            KiReleasePrcbLock(Prcb);
+            KiRescheduleThread(TRUE, Processor);
+            return;
+        }
+
+        /* Try the next idle processor */
+        KiReleasePrcbLock(Prcb);
+        IdleSet &= ~AFFINITY_MASK(Processor) & KiIdleSummary;
+    }
+
+    /* Nobody is idle, queue the thread on its preferred processor */
+    Processor = KiSelectCandidateProcessor(Thread, Affinity);
+    Thread->NextProcessor = (UCHAR)Processor;
+    Prcb = KiProcessorBlock[Processor];
+    KiAcquirePrcbLock(Prcb);
+#else
     /* Queue the thread on CPU 0 and get the PRCB and lock it */
     Thread->NextProcessor = 0;
     Prcb = KiProcessorBlock[0];
@@ -245,6 +436,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         KiReleasePrcbLock(Prcb);
         return;
     }
+#endif
 
     /* Set the CPU number */
     Thread->NextProcessor = (UCHAR)Processor;
@@ -336,12 +528,9 @@ KiSelectNextThread(IN PKPRCB Prcb)
         /* Didn't find any, get the current idle thread */
         Thread = Prcb->IdleThread;
 
-        /* Enable idle scheduling */
+        /* Enable idle scheduling, the idle loop will look for work to steal */
         InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -377,6 +566,10 @@ KiSwapThread(IN PKTHREAD CurrentThread,
     {
         /* Try to find a ready thread */
         NextThread = KiSelectReadyThread(0, Prcb);
+#ifdef CONFIG_SMP
+        /* If we don't have any, try to balance work from other processors */
+        if (!NextThread) NextThread = KiFindReadyThread(Prcb);
+#endif
         if (NextThread)
         {
             /* Switch to it */
@@ -680,6 +873,68 @@ KiSetPriorityThread(IN PKTHREAD Thread,
     }
 }
 
+#ifdef CONFIG_SMP
+//
+// Moves a thread whose affinity changed away from a processor that is no
+// longer part of it, based on the thread's current scheduling state.
+//
+static
+VOID
+KiMigrateThread(IN PKTHREAD Thread)
+{
+    PKPRCB Prcb;
+    ULONG Processor;
+    PKTHREAD NewThread;
+
+    /* Nothing to do if the thread's processor is still allowed */
+    Processor = Thread->NextProcessor;
+    if (Thread->Affinity & AFFINITY_MASK(Processor)) return;
+
+    /* Get the PRCB the thread is on and lock it */
+    Prcb = KiProcessorBlock[Processor];
+    KiAcquirePrcbLock(Prcb);
+
+    /* Check the thread's state now that it can't change under us */
+    if ((Thread->State == Ready) &&
+        !(Thread->ProcessReadyQueue) &&
+        (Thread->NextProcessor == Prcb->Number))
+    {
+        /* Remove it from the current queue */
+        if (RemoveEntryList(&Thread->WaitListEntry))
+        {
+            /* Update the ready summary */
+            Prcb->ReadySummary ^= PRIORITY_MASK(Thread->Priority);
+        }
+
+        /* Re-insert it, it will be placed on an allowed processor */
+        KiInsertDeferredReadyList(Thread);
+    }
+    else if ((Thread->State == Standby) && (Thread == Prcb->NextThread))
+    {
+        /* Select somebody else to run there and dispatch our thread */
+        NewThread = KiSelectNextThread(Prcb);
+        NewThread->State = Standby;
+        Prcb->NextThread = NewThread;
+        KiInsertDeferredReadyList(Thread);
+    }
+    else if ((Thread->State == Running) &&
+             (Thread == Prcb->CurrentThread) &&
+             !(Prcb->NextThread))
+    {
+        /* Select somebody else to run there and kick the processor */
+        NewThread = KiSelectNextThread(Prcb);
+        NewThread->State = Standby;
+        Prcb->NextThread = NewThread;
+        KiReleasePrcbLock(Prcb);
+        KiRescheduleThread(TRUE, Processor);
+        return;
+    }
+
+    /* Release the PRCB lock */
+    KiReleasePrcbLock(Prcb);
+}
+#endif
+
 KAFFINITY
 FASTCALL
 KiSetAffinityThread(IN PKTHREAD Thread,
@@ -704,9 +959,21 @@ KiSetAffinityThread(IN PKTHREAD Thread,
     /* Check if system affinity is disabled */
     if (!Thread->SystemAffinityActive)
     {
+        /* Update the effective affinity too */
+        Thread->Affinity = Affinity;
+
+        /* Make sure the ideal processor is still part of it */
+        if (!(Affinity & AFFINITY_MASK(Thread->IdealProcessor)))
+        {
+            /* Pick the next one that is */
+            Thread->IdealProcessor =
+                KeFindNextRightSetAffinity(Thread->IdealProcessor,
+                                           (ULONG)Affinity);
+        }
+
 #ifdef CONFIG_SMP
-        /* FIXME: TODO */
-        DPRINT1("Affinity support disabled!\n");
+        /* Move the thread off processors it may no longer run on */
+        KiMigrateThread(Thread);
 #endif
     }
 
@@ -177,17 +177,32 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
 NTSTATUS
 MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
 {
+    MM_PAGEOUT_CLUSTER Cluster;
     PFN_NUMBER CurrentPage;
     PFN_NUMBER NextPage;
     NTSTATUS Status;
 
     (*NrFreedPages) = 0;
 
+    /*
+     * Dirty pages are gathered and written to the paging file in clusters
+     * rather than one page per I/O
+     */
+    Cluster.Count = 0;
+
     CurrentPage = MmGetLRUFirstUserPage();
     while (CurrentPage != 0 && Target > 0)
     {
-        Status = MmPageOutPhysicalAddress(CurrentPage);
-        if (NT_SUCCESS(Status))
+        Status = MmPageOutPhysicalAddressCluster(CurrentPage, &Cluster);
+        if (Status == STATUS_PENDING)
+        {
+            Target--;
+            if (Cluster.Count == MM_SWAP_CLUSTER_SIZE)
+            {
+                (*NrFreedPages) += MmFlushPageOutCluster(&Cluster);
+            }
+        }
+        else if (NT_SUCCESS(Status))
         {
             DPRINT("Succeeded\n");
             Target--;
@@ -203,6 +218,11 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         CurrentPage = NextPage;
     }
 
+    if (Cluster.Count != 0)
+    {
+        (*NrFreedPages) += MmFlushPageOutCluster(&Cluster);
+    }
+
     return STATUS_SUCCESS;
 }
 
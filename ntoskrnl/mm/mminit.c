@@ -225,6 +225,7 @@ MmInitSystem(IN ULONG Phase,
     MmInitializeRmapList();
     MmInitSectionImplementation();
     MmInitPagingFile();
+    MmInitializePageStore();
 
     //
     // Create a PTE to double-map the shared data section. We allocate it
@@ -217,20 +217,95 @@ MmGetOffsetPageFile(PRETRIEVAL_POINTERS_BUFFER RetrievalPointers, LARGE_INTEGER
 #endif
 }
 
-NTSTATUS
-NTAPI
-MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+static NTSTATUS
+MiPagingFileIo(PPAGINGFILE PagingFile,
+               ULONG_PTR PageFileOffset,
+               PPFN_NUMBER Pages,
+               ULONG Count,
+               BOOLEAN Write)
+/*
+ * FUNCTION: Reads or writes a run of consecutive paging file slots.
+ * NOTES: The run is split where the paging file isn't contiguous on the
+ *        volume, every other piece goes out in a single MDL.
+ */
 {
-    ULONG i;
-    ULONG_PTR offset;
     LARGE_INTEGER file_offset;
+    LARGE_INTEGER next_offset;
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
+    UCHAR MdlBase[sizeof(MDL) + MM_SWAP_CLUSTER_SIZE * sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
+    ULONG Run;
+
+    ASSERT(Count <= MM_SWAP_CLUSTER_SIZE);
+
+    while (Count != 0)
+    {
+        file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
+        file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
+
+        for (Run = 1; Run < Count; Run++)
+        {
+            next_offset.QuadPart = (PageFileOffset + Run) * PAGE_SIZE;
+            next_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, next_offset);
+            if (next_offset.QuadPart != file_offset.QuadPart + Run * PAGE_SIZE)
+                break;
+        }
 
-    DPRINT("MmWriteToSwapPage\n");
+        MmInitializeMdl(Mdl, NULL, Run * PAGE_SIZE);
+        MmBuildMdlFromPages(Mdl, Pages);
+        Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+        KeInitializeEvent(&Event, NotificationEvent, FALSE);
+        if (Write)
+        {
+            Status = IoSynchronousPageWrite(PagingFile->FileObject,
+                                            Mdl,
+                                            &file_offset,
+                                            &Event,
+                                            &Iosb);
+        }
+        else
+        {
+            Status = IoPageRead(PagingFile->FileObject,
+                                Mdl,
+                                &file_offset,
+                                &Event,
+                                &Iosb);
+        }
+        if (Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+            Status = Iosb.Status;
+        }
+
+        if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+        {
+            MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            return(Status);
+        }
+
+        PageFileOffset += Run;
+        Pages += Run;
+        Count -= Run;
+    }
+
+    return(STATUS_SUCCESS);
+}
+
+NTSTATUS
+NTAPI
+MiWriteToSwapPagesOnDisk(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, ULONG Count)
+{
+    ULONG i;
+    ULONG_PTR offset;
+
+    DPRINT("MiWriteToSwapPagesOnDisk\n");
 
     if (SwapEntry == 0)
     {
@@ -248,38 +323,139 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+    return MiPagingFileIo(PagingFileList[i], offset, Pages, Count, TRUE);
+}
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, ULONG Count)
+{
+    NTSTATUS Status;
+    ULONG i, Run;
+
+    DPRINT("MmWriteToSwapPages\n");
+
+    if (SwapEntry == 0)
+    {
+        KeBugCheck(MEMORY_MANAGEMENT);
+        return(STATUS_UNSUCCESSFUL);
+    }
+
+    /* Pages that compress well stay in memory, the rest goes to the disk */
+    for (i = 0; i < Count; i += Run)
+    {
+        for (Run = 0; i + Run < Count; Run++)
+        {
+            if (MmStorePage(MmOffsetSwapEntry(SwapEntry, i + Run), Pages[i + Run]))
+                break;
+        }
+
+        if (Run != 0)
+        {
+            Status = MiWriteToSwapPagesOnDisk(MmOffsetSwapEntry(SwapEntry, i), &Pages[i], Run);
+            if (!NT_SUCCESS(Status))
+            {
+                return(Status);
+            }
+        }
+
+        /* Step over the stored page */
+        Run++;
+    }
+
+    return(STATUS_SUCCESS);
+}
 
-    file_offset.QuadPart = offset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFileList[i]->RetrievalPointers, file_offset);
+NTSTATUS
+NTAPI
+MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    return MmWriteToSwapPages(SwapEntry, &Page, 1);
+}
 
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoSynchronousPageWrite(PagingFileList[i]->FileObject,
-                                    Mdl,
-                                    &file_offset,
-                                    &Event,
-                                    &Iosb);
-    if (Status == STATUS_PENDING)
+static NTSTATUS
+MiReadFromSwapPagesOnDisk(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, ULONG Count)
+{
+    LARGE_INTEGER Start, End;
+    NTSTATUS Status;
+    ULONG i;
+    ULONG_PTR offset;
+
+    DPRINT("MiReadFromSwapPagesOnDisk\n");
+
+    if (SwapEntry == 0)
     {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
+        KeBugCheck(MEMORY_MANAGEMENT);
+        return(STATUS_UNSUCCESSFUL);
     }
 
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    i = FILE_FROM_ENTRY(SwapEntry);
+    offset = OFFSET_FROM_ENTRY(SwapEntry) - 1;
+
+    if (PagingFileList[i]->FileObject == NULL ||
+            PagingFileList[i]->FileObject->DeviceObject == NULL)
     {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+        DPRINT1("Bad paging file 0x%.8X\n", SwapEntry);
+        KeBugCheck(MEMORY_MANAGEMENT);
+    }
+
+    Start = KeQueryPerformanceCounter(NULL);
+    Status = MiPagingFileIo(PagingFileList[i], offset, Pages, Count, FALSE);
+    End = KeQueryPerformanceCounter(NULL);
+
+    if (NT_SUCCESS(Status))
+    {
+        MmAccountPageStoreDiskRead(Count, End.QuadPart - Start.QuadPart);
     }
+
     return(Status);
 }
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, ULONG Count)
+{
+    NTSTATUS Status;
+    ULONG i, Run;
+
+    DPRINT("MmReadFromSwapPages\n");
+
+    if (SwapEntry == 0)
+    {
+        KeBugCheck(MEMORY_MANAGEMENT);
+        return(STATUS_UNSUCCESSFUL);
+    }
+
+    /* Serve what the page store has, read the rest */
+    for (i = 0; i < Count; i += Run)
+    {
+        for (Run = 0; i + Run < Count; Run++)
+        {
+            if (MmLoadStoredPage(MmOffsetSwapEntry(SwapEntry, i + Run), Pages[i + Run]))
+                break;
+        }
+
+        if (Run != 0)
+        {
+            Status = MiReadFromSwapPagesOnDisk(MmOffsetSwapEntry(SwapEntry, i), &Pages[i], Run);
+            if (!NT_SUCCESS(Status))
+            {
+                return(Status);
+            }
+        }
+
+        /* Step over the stored page */
+        Run++;
+    }
+
+    return(STATUS_SUCCESS);
+}
 
 NTSTATUS
 NTAPI
 MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
 {
-    return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+    return MmReadFromSwapPages(SwapEntry, &Page, 1);
 }
 
 NTSTATUS
@@ -289,12 +465,6 @@ MiReadPageFile(
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset)
 {
-    LARGE_INTEGER file_offset;
-    IO_STATUS_BLOCK Iosb;
-    NTSTATUS Status;
-    KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
-    PMDL Mdl = (PMDL)MdlBase;
     PPAGINGFILE PagingFile;
 
     DPRINT("MiReadSwapFile\n");
@@ -315,29 +485,26 @@ MiReadPageFile(
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+    return MiPagingFileIo(PagingFile, PageFileOffset, &Page, 1, FALSE);
+}
 
-    file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
+SWAPENTRY
+NTAPI
+MmOffsetSwapEntry(SWAPENTRY SwapEntry, LONG Pages)
+/*
+ * FUNCTION: Returns the entry for the slot a number of pages away from
+ *           another one in the same paging file, or zero if there is none.
+ */
+{
+    LONG_PTR off;
 
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoPageRead(PagingFile->FileObject,
-                        Mdl,
-                        &file_offset,
-                        &Event,
-                        &Iosb);
-    if (Status == STATUS_PENDING)
-    {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
-    }
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    off = (LONG_PTR)OFFSET_FROM_ENTRY(SwapEntry) + Pages;
+    if (off < 1)
     {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+        return(0);
     }
-    return(Status);
+
+    return(ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(SwapEntry), (SWAPENTRY)off));
 }
 
 VOID
@@ -361,30 +528,77 @@ MmInitPagingFile(VOID)
 }
 
 static ULONG
-MiAllocPageFromPagingFile(PPAGINGFILE PagingFile)
+MiAllocPagesFromPagingFile(PPAGINGFILE PagingFile, ULONG Count, PULONG Allocated)
+/*
+ * FUNCTION: Allocates a run of consecutive slots in a paging file.
+ * RETURNS: The first slot of the first free run of Count slots or, failing
+ *          that, of the longest free run there is.
+ */
 {
     KIRQL oldIrql;
     ULONG i, j;
+    ULONG RunStart, RunLength;
+    ULONG BestStart, BestLength;
+    ULONG Slots;
 
     KeAcquireSpinLock(&PagingFile->AllocMapLock, &oldIrql);
 
-    for (i = 0; i < PagingFile->AllocMapSize; i++)
+    /* The bits past the end of the file are never handed out */
+    Slots = (ULONG)(PagingFile->FreePages + PagingFile->UsedPages);
+
+    RunStart = RunLength = 0;
+    BestStart = BestLength = 0;
+    for (i = 0; i < PagingFile->AllocMapSize && BestLength < Count; i++)
     {
-        for (j = 0; j < 32; j++)
+        if (PagingFile->AllocMap[i] == 0xFFFFFFFF)
         {
-            if (!(PagingFile->AllocMap[i] & (1 << j)))
+            RunLength = 0;
+            continue;
+        }
+
+        for (j = 0; j < 32 && (i * 32) + j < Slots; j++)
+        {
+            if (PagingFile->AllocMap[i] & (1 << j))
+            {
+                RunLength = 0;
+                continue;
+            }
+
+            if (RunLength == 0)
             {
-                PagingFile->AllocMap[i] |= (1 << j);
-                PagingFile->UsedPages++;
-                PagingFile->FreePages--;
-                KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
-                return((i * 32) + j);
+                RunStart = (i * 32) + j;
+            }
+            RunLength++;
+
+            if (RunLength > BestLength)
+            {
+                BestStart = RunStart;
+                BestLength = RunLength;
+                if (BestLength == Count)
+                {
+                    break;
+                }
             }
         }
     }
 
+    if (BestLength == 0)
+    {
+        KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
+        *Allocated = 0;
+        return(0xFFFFFFFF);
+    }
+
+    for (i = BestStart; i < BestStart + BestLength; i++)
+    {
+        PagingFile->AllocMap[i >> 5] |= (1 << (i % 32));
+    }
+    PagingFile->UsedPages += BestLength;
+    PagingFile->FreePages -= BestLength;
+
     KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
-    return(0xFFFFFFFF);
+    *Allocated = BestLength;
+    return(BestStart);
 }
 
 VOID
@@ -395,6 +609,9 @@ MmFreeSwapPage(SWAPENTRY Entry)
     ULONG_PTR off;
     KIRQL oldIrql;
 
+    /* The slot may be handed out again, drop what's kept for it */
+    MmRemoveStoredPage(Entry);
+
     i = FILE_FROM_ENTRY(Entry);
     off = OFFSET_FROM_ENTRY(Entry) - 1;
 
@@ -417,14 +634,22 @@ MmFreeSwapPage(SWAPENTRY Entry)
     KeReleaseSpinLock(&PagingFileListLock, oldIrql);
 }
 
-SWAPENTRY
+ULONG
 NTAPI
-MmAllocSwapPage(VOID)
+MmAllocSwapPages(ULONG Count, PSWAPENTRY SwapEntries)
+/*
+ * FUNCTION: Allocates up to Count consecutive slots from one paging file.
+ * RETURNS: The number of slots allocated, their entries are stored in
+ *          SwapEntries.
+ */
 {
     KIRQL oldIrql;
-    ULONG i;
+    ULONG i, j;
     ULONG off;
-    SWAPENTRY entry;
+    ULONG Allocated;
+    PPAGINGFILE PagingFile;
+
+    ASSERT(Count != 0);
 
     KeAcquireSpinLock(&PagingFileListLock, &oldIrql);
 
@@ -434,30 +659,66 @@ MmAllocSwapPage(VOID)
         return(0);
     }
 
+    /* Prefer a paging file that can hold the whole run */
+    PagingFile = NULL;
     for (i = 0; i < MAX_PAGING_FILES; i++)
     {
         if (PagingFileList[i] != NULL &&
-                PagingFileList[i]->FreePages >= 1)
+                PagingFileList[i]->FreePages >= Count)
+        {
+            PagingFile = PagingFileList[i];
+            break;
+        }
+    }
+    if (PagingFile == NULL)
+    {
+        for (i = 0; i < MAX_PAGING_FILES; i++)
         {
-            off = MiAllocPageFromPagingFile(PagingFileList[i]);
-            if (off == 0xFFFFFFFF)
+            if (PagingFileList[i] != NULL &&
+                    PagingFileList[i]->FreePages >= 1)
             {
-                KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-                return(STATUS_UNSUCCESSFUL);
+                PagingFile = PagingFileList[i];
+                break;
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
-            KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-
-            entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
-            return(entry);
         }
     }
+    if (PagingFile == NULL)
+    {
+        KeReleaseSpinLock(&PagingFileListLock, oldIrql);
+        KeBugCheck(MEMORY_MANAGEMENT);
+        return(0);
+    }
 
+    off = MiAllocPagesFromPagingFile(PagingFile, Count, &Allocated);
+    if (off == 0xFFFFFFFF)
+    {
+        KeBugCheck(MEMORY_MANAGEMENT);
+        KeReleaseSpinLock(&PagingFileListLock, oldIrql);
+        return(0);
+    }
+    MiUsedSwapPages += Allocated;
+    MiFreeSwapPages -= Allocated;
     KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-    KeBugCheck(MEMORY_MANAGEMENT);
-    return(0);
+
+    for (j = 0; j < Allocated; j++)
+    {
+        SwapEntries[j] = ENTRY_FROM_FILE_OFFSET(i, off + j + 1);
+    }
+    return(Allocated);
+}
+
+SWAPENTRY
+NTAPI
+MmAllocSwapPage(VOID)
+{
+    SWAPENTRY entry;
+
+    if (MmAllocSwapPages(1, &entry) == 0)
+    {
+        return(0);
+    }
+
+    return(entry);
 }
 
 static PRETRIEVEL_DESCRIPTOR_LIST FASTCALL
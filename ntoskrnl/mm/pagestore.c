@@ -0,0 +1,546 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS kernel
+ * FILE:            ntoskrnl/mm/pagestore.c
+ * PURPOSE:         Compressed in-memory store for paged out pages
+ */
+
+/*
+ * Pages written to the paging file are first offered to the store. A page
+ * that compresses well is kept in nonpaged pool and never reaches the disk,
+ * a fault on it is served by decompressing it again. The store is keyed by
+ * swap entry, so the slot in the paging file stays reserved for the page.
+ * When the store grows over its budget the oldest pages are written to
+ * their slots and dropped.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+#include "ARM3/miarm.h"
+
+#if defined (ALLOC_PRAGMA)
+#pragma alloc_text(INIT, MmInitializePageStore)
+#endif
+
+/* TYPES ********************************************************************/
+
+typedef struct _MI_STORED_PAGE
+{
+    LIST_ENTRY HashLinks;
+    LIST_ENTRY AgeLinks;
+    SWAPENTRY SwapEntry;
+    ULONG Size;
+    BOOLEAN Spilling;
+    UCHAR Data[ANYSIZE_ARRAY];
+}
+MI_STORED_PAGE, *PMI_STORED_PAGE;
+
+typedef struct _MI_PAGE_STORE_STATISTICS
+{
+    ULONG StoredPages;
+    SIZE_T StoredBytes;
+    ULONG PagesAdmitted;
+    ULONG PagesRejected;
+    ULONG PagesSpilled;
+    ULONG SpillWrites;
+    ULONG StoreFaults;
+    ULONGLONG StoreFaultTicks;
+    ULONG DiskFaults;
+    ULONGLONG DiskFaultTicks;
+}
+MI_PAGE_STORE_STATISTICS, *PMI_PAGE_STORE_STATISTICS;
+
+/* GLOBALS ******************************************************************/
+
+#define MI_PAGE_STORE_COMPRESSION   (COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD)
+
+/* Pages that don't shrink to three quarters aren't worth the CPU time */
+#define MI_PAGE_STORE_MAX_SIZE      (PAGE_SIZE * 3 / 4)
+
+#define TAG_PAGE_STORE              'SPmM'
+
+static BOOLEAN MiPageStoreEnabled;
+static SIZE_T MiPageStoreLimit;
+
+static PLIST_ENTRY MiPageStoreHash;
+static ULONG MiPageStoreHashMask;
+static LIST_ENTRY MiPageStoreAgeList;
+static KSPIN_LOCK MiPageStoreLock;
+
+/* Serializes the use of the compression buffers */
+static FAST_MUTEX MiPageStoreCompressLock;
+static PVOID MiPageStoreWorkSpace;
+static PUCHAR MiPageStoreBuffer;
+
+/* Serializes spilling, MiPageStoreSpillEvent is cleared while one runs */
+static FAST_MUTEX MiPageStoreSpillLock;
+static KEVENT MiPageStoreSpillEvent;
+static PFN_NUMBER MiPageStoreSpillPages[MM_SWAP_CLUSTER_SIZE];
+
+static MI_PAGE_STORE_STATISTICS MiPageStoreStatistics;
+
+/* FUNCTIONS ****************************************************************/
+
+VOID
+INIT_FUNCTION
+NTAPI
+MmInitializePageStore(VOID)
+{
+    ULONG WorkSpaceSize, FragmentWorkSpaceSize;
+    ULONG Buckets, i;
+    NTSTATUS Status;
+
+    InitializeListHead(&MiPageStoreAgeList);
+    KeInitializeSpinLock(&MiPageStoreLock);
+    ExInitializeFastMutex(&MiPageStoreCompressLock);
+    ExInitializeFastMutex(&MiPageStoreSpillLock);
+    KeInitializeEvent(&MiPageStoreSpillEvent, NotificationEvent, TRUE);
+
+    /* An eighth of memory, as long as that leaves enough nonpaged pool */
+    MiPageStoreLimit = min((SIZE_T)(MmNumberOfPhysicalPages / 8) * PAGE_SIZE,
+                           MmMaximumNonPagedPoolInBytes / 4);
+
+    /* Aim for a handful of pages per bucket when the store is full */
+    Buckets = 256;
+    while (Buckets < MiPageStoreLimit / MI_PAGE_STORE_MAX_SIZE / 4)
+    {
+        Buckets <<= 1;
+    }
+
+    Status = RtlGetCompressionWorkSpaceSize(MI_PAGE_STORE_COMPRESSION,
+                                            &WorkSpaceSize,
+                                            &FragmentWorkSpaceSize);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("No compression work space size (Status %x), page store disabled\n", Status);
+        return;
+    }
+
+    MiPageStoreHash = ExAllocatePoolWithTag(NonPagedPool, Buckets * sizeof(LIST_ENTRY), TAG_PAGE_STORE);
+    MiPageStoreWorkSpace = ExAllocatePoolWithTag(NonPagedPool, WorkSpaceSize, TAG_PAGE_STORE);
+    MiPageStoreBuffer = ExAllocatePoolWithTag(NonPagedPool, MI_PAGE_STORE_MAX_SIZE, TAG_PAGE_STORE);
+    if (MiPageStoreHash == NULL || MiPageStoreWorkSpace == NULL || MiPageStoreBuffer == NULL)
+    {
+        DPRINT1("Out of memory, page store disabled\n");
+        if (MiPageStoreHash) ExFreePoolWithTag(MiPageStoreHash, TAG_PAGE_STORE);
+        if (MiPageStoreWorkSpace) ExFreePoolWithTag(MiPageStoreWorkSpace, TAG_PAGE_STORE);
+        if (MiPageStoreBuffer) ExFreePoolWithTag(MiPageStoreBuffer, TAG_PAGE_STORE);
+        return;
+    }
+
+    for (i = 0; i < Buckets; i++)
+    {
+        InitializeListHead(&MiPageStoreHash[i]);
+    }
+    MiPageStoreHashMask = Buckets - 1;
+
+    /* Spilled pages are decompressed into these before they're written */
+    for (i = 0; i < MM_SWAP_CLUSTER_SIZE; i++)
+    {
+        Status = MmRequestPageMemoryConsumer(MC_SYSTEM, FALSE, &MiPageStoreSpillPages[i]);
+        if (!NT_SUCCESS(Status))
+        {
+            KeBugCheck(NO_PAGES_AVAILABLE);
+        }
+    }
+
+    DPRINT("Page store: %Iu KB in %lu buckets\n", MiPageStoreLimit / 1024, Buckets);
+    MiPageStoreEnabled = TRUE;
+}
+
+static
+PLIST_ENTRY
+MiPageStoreBucket(SWAPENTRY SwapEntry)
+{
+    return &MiPageStoreHash[((SwapEntry >> 11) ^ (SwapEntry & 0x0f)) & MiPageStoreHashMask];
+}
+
+static
+PMI_STORED_PAGE
+MiLookupStoredPage(SWAPENTRY SwapEntry)
+{
+    PLIST_ENTRY ListHead, ListEntry;
+    PMI_STORED_PAGE StoredPage;
+
+    ListHead = MiPageStoreBucket(SwapEntry);
+    for (ListEntry = ListHead->Flink; ListEntry != ListHead; ListEntry = ListEntry->Flink)
+    {
+        StoredPage = CONTAINING_RECORD(ListEntry, MI_STORED_PAGE, HashLinks);
+        if (StoredPage->SwapEntry == SwapEntry)
+        {
+            return StoredPage;
+        }
+    }
+
+    return NULL;
+}
+
+static
+VOID
+MiUnlinkStoredPage(PMI_STORED_PAGE StoredPage)
+{
+    RemoveEntryList(&StoredPage->HashLinks);
+    RemoveEntryList(&StoredPage->AgeLinks);
+    MiPageStoreStatistics.StoredPages--;
+    MiPageStoreStatistics.StoredBytes -= StoredPage->Size;
+}
+
+VOID
+NTAPI
+MmRemoveStoredPage(SWAPENTRY SwapEntry)
+/*
+ * FUNCTION: Drops the stored copy of a swap entry, if there is one.
+ * NOTES: A copy that is being spilled is waited for, so that the spill
+ *        can't land on the slot after it was rewritten or handed out again.
+ */
+{
+    PMI_STORED_PAGE StoredPage;
+    KIRQL OldIrql;
+
+    if (!MiPageStoreEnabled)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+        StoredPage = MiLookupStoredPage(SwapEntry);
+        if (StoredPage == NULL)
+        {
+            KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+            return;
+        }
+
+        if (!StoredPage->Spilling)
+        {
+            MiUnlinkStoredPage(StoredPage);
+            KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+            ExFreePoolWithTag(StoredPage, TAG_PAGE_STORE);
+            return;
+        }
+
+        KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+        KeWaitForSingleObject(&MiPageStoreSpillEvent, Executive, KernelMode, FALSE, NULL);
+    }
+}
+
+static
+VOID
+MiSpillStoredPages(SIZE_T Needed)
+/*
+ * FUNCTION: Writes the oldest stored pages to their paging file slots and
+ *           drops them until Needed bytes fit into the store.
+ */
+{
+    PMI_STORED_PAGE StoredPages[MM_SWAP_CLUSTER_SIZE];
+    PMI_STORED_PAGE StoredPage;
+    PLIST_ENTRY ListEntry;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    PVOID Address;
+    ULONG Count, Run, Size, i;
+
+    ExAcquireFastMutex(&MiPageStoreSpillLock);
+
+    while (MiPageStoreStatistics.StoredBytes + Needed > MiPageStoreLimit)
+    {
+        /* Take a batch of the oldest pages, their slots are often consecutive */
+        KeClearEvent(&MiPageStoreSpillEvent);
+        KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+        Count = 0;
+        for (ListEntry = MiPageStoreAgeList.Flink;
+             ListEntry != &MiPageStoreAgeList && Count < MM_SWAP_CLUSTER_SIZE;
+             ListEntry = ListEntry->Flink)
+        {
+            StoredPage = CONTAINING_RECORD(ListEntry, MI_STORED_PAGE, AgeLinks);
+            StoredPage->Spilling = TRUE;
+            StoredPages[Count++] = StoredPage;
+        }
+        KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+
+        if (Count == 0)
+        {
+            KeSetEvent(&MiPageStoreSpillEvent, IO_NO_INCREMENT, FALSE);
+            break;
+        }
+
+        /* Nobody drops a page that is being spilled, its data stays put */
+        for (i = 0; i < Count; i++)
+        {
+            Address = MiMapPageInHyperSpace(PsGetCurrentProcess(), MiPageStoreSpillPages[i], &OldIrql);
+            Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1,
+                                         Address,
+                                         PAGE_SIZE,
+                                         StoredPages[i]->Data,
+                                         StoredPages[i]->Size,
+                                         &Size);
+            if (NT_SUCCESS(Status) && Size < PAGE_SIZE)
+            {
+                RtlZeroMemory((PUCHAR)Address + Size, PAGE_SIZE - Size);
+            }
+            MiUnmapPageInHyperSpace(PsGetCurrentProcess(), Address, OldIrql);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Stored page %Ix is corrupt (Status %x)\n", StoredPages[i]->SwapEntry, Status);
+                KeBugCheckEx(MEMORY_MANAGEMENT, Status, StoredPages[i]->SwapEntry, (ULONG_PTR)StoredPages[i], 0);
+            }
+        }
+
+        /* Write every run of consecutive slots in one go */
+        for (i = 0; i < Count; i += Run)
+        {
+            for (Run = 1; i + Run < Count; Run++)
+            {
+                if (StoredPages[i + Run]->SwapEntry != MmOffsetSwapEntry(StoredPages[i]->SwapEntry, Run))
+                    break;
+            }
+
+            Status = MiWriteToSwapPagesOnDisk(StoredPages[i]->SwapEntry, &MiPageStoreSpillPages[i], Run);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Failed to spill stored pages (Status %x)\n", Status);
+                break;
+            }
+            MiPageStoreStatistics.SpillWrites++;
+        }
+
+        /* Pages that made it to the disk leave the store */
+        KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+        for (Run = 0; Run < Count; Run++)
+        {
+            StoredPages[Run]->Spilling = FALSE;
+            if (Run < i)
+            {
+                MiUnlinkStoredPage(StoredPages[Run]);
+                MiPageStoreStatistics.PagesSpilled++;
+            }
+        }
+        KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+        KeSetEvent(&MiPageStoreSpillEvent, IO_NO_INCREMENT, FALSE);
+
+        for (Run = 0; Run < i; Run++)
+        {
+            ExFreePoolWithTag(StoredPages[Run], TAG_PAGE_STORE);
+        }
+
+        if (i < Count)
+        {
+            break;
+        }
+    }
+
+    ExReleaseFastMutex(&MiPageStoreSpillLock);
+}
+
+BOOLEAN
+NTAPI
+MmStorePage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+/*
+ * FUNCTION: Tries to keep a page that is written to a swap entry in the
+ *           store instead.
+ * RETURNS: TRUE if the page was stored, it needn't be written then.
+ */
+{
+    PMI_STORED_PAGE StoredPage;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    PVOID Address;
+    ULONG Size;
+
+    /* Whatever was written to this entry before is out of date */
+    MmRemoveStoredPage(SwapEntry);
+
+    if (!MiPageStoreEnabled)
+    {
+        return FALSE;
+    }
+
+    ExAcquireFastMutex(&MiPageStoreCompressLock);
+
+    Address = MiMapPageInHyperSpace(PsGetCurrentProcess(), Page, &OldIrql);
+    Status = RtlCompressBuffer(MI_PAGE_STORE_COMPRESSION,
+                               Address,
+                               PAGE_SIZE,
+                               MiPageStoreBuffer,
+                               MI_PAGE_STORE_MAX_SIZE,
+                               PAGE_SIZE,
+                               &Size,
+                               MiPageStoreWorkSpace);
+    MiUnmapPageInHyperSpace(PsGetCurrentProcess(), Address, OldIrql);
+
+    if (!NT_SUCCESS(Status))
+    {
+        /* It didn't compress well enough */
+        ExReleaseFastMutex(&MiPageStoreCompressLock);
+        KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+        MiPageStoreStatistics.PagesRejected++;
+        KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+        return FALSE;
+    }
+
+    if (MiPageStoreStatistics.StoredBytes + Size > MiPageStoreLimit)
+    {
+        MiSpillStoredPages(Size);
+    }
+
+    StoredPage = ExAllocatePoolWithTag(NonPagedPool,
+                                       FIELD_OFFSET(MI_STORED_PAGE, Data[Size]),
+                                       TAG_PAGE_STORE);
+    if (StoredPage == NULL)
+    {
+        ExReleaseFastMutex(&MiPageStoreCompressLock);
+        return FALSE;
+    }
+
+    StoredPage->SwapEntry = SwapEntry;
+    StoredPage->Size = Size;
+    StoredPage->Spilling = FALSE;
+    RtlCopyMemory(StoredPage->Data, MiPageStoreBuffer, Size);
+
+    ExReleaseFastMutex(&MiPageStoreCompressLock);
+
+    KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+    InsertTailList(MiPageStoreBucket(SwapEntry), &StoredPage->HashLinks);
+    InsertTailList(&MiPageStoreAgeList, &StoredPage->AgeLinks);
+    MiPageStoreStatistics.StoredPages++;
+    MiPageStoreStatistics.StoredBytes += Size;
+    MiPageStoreStatistics.PagesAdmitted++;
+    KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+
+    return TRUE;
+}
+
+BOOLEAN
+NTAPI
+MmLoadStoredPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+/*
+ * FUNCTION: Fills a page from the stored copy of a swap entry.
+ * RETURNS: FALSE if the entry isn't in the store and has to be read from
+ *          the paging file.
+ * NOTES: The copy stays in the store until the entry is freed or
+ *        rewritten, the paging file slot has never seen the data.
+ */
+{
+    PMI_STORED_PAGE StoredPage;
+    LARGE_INTEGER Start, End;
+    NTSTATUS Status;
+    KIRQL OldIrql, MapIrql;
+    PVOID Address;
+    ULONG Size;
+
+    if (!MiPageStoreEnabled)
+    {
+        return FALSE;
+    }
+
+    Start = KeQueryPerformanceCounter(NULL);
+
+    KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+    StoredPage = MiLookupStoredPage(SwapEntry);
+    if (StoredPage == NULL)
+    {
+        KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+        return FALSE;
+    }
+
+    /* Recently used pages are the last ones to be spilled */
+    RemoveEntryList(&StoredPage->AgeLinks);
+    InsertTailList(&MiPageStoreAgeList, &StoredPage->AgeLinks);
+
+    Address = MiMapPageInHyperSpace(PsGetCurrentProcess(), Page, &MapIrql);
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1,
+                                 Address,
+                                 PAGE_SIZE,
+                                 StoredPage->Data,
+                                 StoredPage->Size,
+                                 &Size);
+    if (NT_SUCCESS(Status) && Size < PAGE_SIZE)
+    {
+        RtlZeroMemory((PUCHAR)Address + Size, PAGE_SIZE - Size);
+    }
+    MiUnmapPageInHyperSpace(PsGetCurrentProcess(), Address, MapIrql);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Stored page %Ix is corrupt (Status %x)\n", SwapEntry, Status);
+        KeBugCheckEx(MEMORY_MANAGEMENT, Status, SwapEntry, (ULONG_PTR)StoredPage, 0);
+    }
+
+    End = KeQueryPerformanceCounter(NULL);
+    MiPageStoreStatistics.StoreFaults++;
+    MiPageStoreStatistics.StoreFaultTicks += End.QuadPart - Start.QuadPart;
+    KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+
+    return TRUE;
+}
+
+VOID
+NTAPI
+MmAccountPageStoreDiskRead(ULONG Pages, LONGLONG Ticks)
+/*
+ * FUNCTION: Records a read from the paging file, to compare fault latency
+ *           against the store.
+ */
+{
+    KIRQL OldIrql;
+
+    if (!MiPageStoreEnabled)
+    {
+        return;
+    }
+
+    KeAcquireSpinLock(&MiPageStoreLock, &OldIrql);
+    MiPageStoreStatistics.DiskFaults += Pages;
+    MiPageStoreStatistics.DiskFaultTicks += Ticks;
+    KeReleaseSpinLock(&MiPageStoreLock, OldIrql);
+}
+
+#if DBG && defined(KDBG)
+
+BOOLEAN
+ExpKdbgExtPageStore(ULONG Argc, PCHAR Argv[])
+{
+    PMI_PAGE_STORE_STATISTICS Statistics = &MiPageStoreStatistics;
+    LARGE_INTEGER Frequency;
+    ULONGLONG Ratio;
+
+    if (!MiPageStoreEnabled)
+    {
+        KdbpPrint("Page store is disabled\n");
+        return TRUE;
+    }
+
+    KeQueryPerformanceCounter(&Frequency);
+
+    /* No need to lock the spin lock here, we're in DBG */
+    Ratio = Statistics->StoredBytes ?
+            (ULONGLONG)Statistics->StoredPages * PAGE_SIZE * 100 / Statistics->StoredBytes : 0;
+
+    KdbpPrint("Stored pages:\t%lu (%Iu KB of %Iu KB)\n",
+              Statistics->StoredPages,
+              Statistics->StoredBytes / 1024,
+              MiPageStoreLimit / 1024);
+    KdbpPrint("Compression:\t%I64u.%02I64u : 1\n", Ratio / 100, Ratio % 100);
+    KdbpPrint("Admitted:\t%lu\n", Statistics->PagesAdmitted);
+    KdbpPrint("Rejected:\t%lu\n", Statistics->PagesRejected);
+    KdbpPrint("Spilled:\t%lu in %lu writes\n", Statistics->PagesSpilled, Statistics->SpillWrites);
+    KdbpPrint("Store faults:\t%lu, %I64u us average\n",
+              Statistics->StoreFaults,
+              Statistics->StoreFaults ?
+              Statistics->StoreFaultTicks * 1000000 / Frequency.QuadPart / Statistics->StoreFaults : 0);
+    KdbpPrint("Disk faults:\t%lu, %I64u us average\n",
+              Statistics->DiskFaults,
+              Statistics->DiskFaults ?
+              Statistics->DiskFaultTicks * 1000000 / Frequency.QuadPart / Statistics->DiskFaults : 0);
+
+    return TRUE;
+}
+
+#endif
+
+/* EOF */
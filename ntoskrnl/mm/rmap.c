@@ -55,6 +55,19 @@ MmInitializeRmapList(VOID)
 NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page)
+{
+    return MmPageOutPhysicalAddressCluster(Page, NULL);
+}
+
+NTSTATUS
+NTAPI
+MmPageOutPhysicalAddressCluster(PFN_NUMBER Page, PMM_PAGEOUT_CLUSTER Cluster)
+/*
+ * FUNCTION: Pages out a page, or adds it to Cluster if it has to be written
+ *           to the paging file.
+ * RETURNS: STATUS_PENDING if the page was added to the cluster, the caller
+ *          finishes it with MmFlushPageOutCluster.
+ */
 {
     PMM_RMAP_ENTRY entry;
     PMEMORY_AREA MemoryArea;
@@ -169,7 +182,7 @@ MmPageOutPhysicalAddress(PFN_NUMBER Page)
         /*
          * Do the actual page out work.
          */
-        Status = MmPageOutSectionView(AddressSpace, MemoryArea, Address, Entry);
+        Status = MmPageOutSectionView(AddressSpace, MemoryArea, Address, Entry, Cluster);
     }
     else if (Type == MEMORY_AREA_CACHE)
     {
@@ -182,7 +195,8 @@ MmPageOutPhysicalAddress(PFN_NUMBER Page)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    if (Address < MmSystemRangeStart)
+    /* A gathered page keeps the process until the cluster is written */
+    if (Address < MmSystemRangeStart && Status != STATUS_PENDING)
     {
         ExReleaseRundownProtection(&Process->RundownProtect);
         ObDereferenceObject(Process);
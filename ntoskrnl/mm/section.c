@@ -1277,6 +1277,206 @@ MiReadPage(PMEMORY_AREA MemoryArea,
 }
 #endif
 
+/*
+ * Misses on file backed views are read in clusters: the neighbours of the
+ * faulting page that aren't resident yet are brought in and mapped with it.
+ * The cache reads a whole view per I/O, so the extra pages cost no more disk
+ * reads, only the soft faults they would have taken one by one later.
+ * Image sections are read front to back on startup and get the larger
+ * cluster, writable image and data views would mostly be copied or touched
+ * sparsely so they get a smaller one.
+ */
+#define MI_IMAGE_CLUSTER_SIZE   16
+#define MI_DATA_CLUSTER_SIZE    8
+#define MI_MAX_CLUSTER_SIZE     16
+
+static
+ULONG
+MiGetFaultClusterSize(PMEMORY_AREA MemoryArea)
+{
+    PROS_SECTION_OBJECT Section = MemoryArea->Data.SectionData.Section;
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+
+    if ((Section->AllocationAttributes & SEC_IMAGE) && !Segment->WriteCopy)
+        return MI_IMAGE_CLUSTER_SIZE;
+
+    return MI_DATA_CLUSTER_SIZE;
+}
+
+static
+BOOLEAN
+MiIsClusterNeighbour(PEPROCESS Process,
+                     PMEMORY_AREA MemoryArea,
+                     PVOID Address,
+                     PVOID RegionBase,
+                     PMM_REGION Region,
+                     PLARGE_INTEGER Offset)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+
+    /* It must share the fault's view and protection */
+    if ((ULONG_PTR)Address < MA_GetStartingAddress(MemoryArea) ||
+        (ULONG_PTR)Address >= MA_GetEndingAddress(MemoryArea) ||
+        (ULONG_PTR)Address < (ULONG_PTR)RegionBase ||
+        (ULONG_PTR)Address >= (ULONG_PTR)RegionBase + Region->Length)
+    {
+        return FALSE;
+    }
+
+    /* Private, swapped, disabled or already handled pages are left alone */
+    if (MmIsPagePresent(Process, Address) ||
+        MmIsPageSwapEntry(Process, Address) ||
+        MmIsDisabledPage(Process, Address))
+    {
+        return FALSE;
+    }
+
+    Offset->QuadPart = (ULONG_PTR)Address - MA_GetStartingAddress(MemoryArea)
+                       + MemoryArea->Data.SectionData.ViewOffset.QuadPart;
+
+    return Offset->QuadPart < Segment->Length.QuadPart;
+}
+
+static
+BOOLEAN
+MiIsFaultClusterPage(PEPROCESS Process,
+                     PMEMORY_AREA MemoryArea,
+                     PVOID Address,
+                     PVOID RegionBase,
+                     PMM_REGION Region)
+{
+    PROS_SECTION_OBJECT Section = MemoryArea->Data.SectionData.Section;
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    LARGE_INTEGER Offset;
+
+    if (!MiIsClusterNeighbour(Process, MemoryArea, Address, RegionBase, Region, &Offset))
+        return FALSE;
+
+    /* Zero filled image pages don't come from the file */
+    if ((Section->AllocationAttributes & SEC_IMAGE) &&
+        Offset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart))
+    {
+        return FALSE;
+    }
+
+    return MmGetPageEntrySectionSegment(Segment, &Offset) == 0;
+}
+
+static
+ULONG
+MiFindFaultCluster(PEPROCESS Process,
+                   PMEMORY_AREA MemoryArea,
+                   PVOID Address,
+                   PVOID RegionBase,
+                   PMM_REGION Region,
+                   PVOID *ClusterAddress)
+/*
+ * FUNCTION: Find the run of non-resident pages around a faulting page that
+ *           can be read in along with it.
+ * PARAMETERS:
+ *       Address - Page aligned faulting address.
+ *       ClusterAddress - Variable that receives the first page of the run.
+ * RETURNS: The number of pages in the run, including the faulting one.
+ * NOTES: The address space and the segment must be locked.
+ */
+{
+    ULONG_PTR Window, WindowStart, First, Last;
+
+    /* Stay within the naturally aligned window around the fault */
+    Window = MiGetFaultClusterSize(MemoryArea) * PAGE_SIZE;
+    WindowStart = (ULONG_PTR)MM_ROUND_DOWN(Address, Window);
+
+    First = (ULONG_PTR)Address;
+    while (First > WindowStart &&
+           MiIsFaultClusterPage(Process, MemoryArea, (PVOID)(First - PAGE_SIZE), RegionBase, Region))
+    {
+        First -= PAGE_SIZE;
+    }
+
+    Last = (ULONG_PTR)Address;
+    while (Last + PAGE_SIZE < WindowStart + Window &&
+           MiIsFaultClusterPage(Process, MemoryArea, (PVOID)(Last + PAGE_SIZE), RegionBase, Region))
+    {
+        Last += PAGE_SIZE;
+    }
+
+    *ClusterAddress = (PVOID)First;
+    return (ULONG)((Last - First) >> PAGE_SHIFT) + 1;
+}
+
+static
+BOOLEAN
+MiIsSwapClusterPage(PEPROCESS Process,
+                    PMEMORY_AREA MemoryArea,
+                    PVOID Address,
+                    PVOID RegionBase,
+                    PMM_REGION Region,
+                    SWAPENTRY SwapEntry)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    LARGE_INTEGER Offset;
+
+    if (SwapEntry == 0 ||
+        !MiIsClusterNeighbour(Process, MemoryArea, Address, RegionBase, Region, &Offset))
+    {
+        return FALSE;
+    }
+
+    /* It must have been written out in the same run as the faulting page */
+    return MmGetPageEntrySectionSegment(Segment, &Offset) == MAKE_SWAP_SSE(SwapEntry);
+}
+
+static
+ULONG
+MiFindSwapCluster(PEPROCESS Process,
+                  PMEMORY_AREA MemoryArea,
+                  PVOID Address,
+                  PVOID RegionBase,
+                  PMM_REGION Region,
+                  SWAPENTRY SwapEntry,
+                  PVOID *ClusterAddress)
+/*
+ * FUNCTION: Find the run of swapped out pages around a faulting page whose
+ *           paging file slots follow each other, so that they can be read
+ *           in with a single I/O.
+ * PARAMETERS:
+ *       Address - Page aligned faulting address.
+ *       SwapEntry - Swap entry of the faulting page.
+ *       ClusterAddress - Variable that receives the first page of the run.
+ * RETURNS: The number of pages in the run, including the faulting one.
+ * NOTES: The address space and the segment must be locked.
+ */
+{
+    ULONG_PTR Window, WindowStart, First, Last;
+    LONG Delta;
+
+    Window = MM_SWAP_CLUSTER_SIZE * PAGE_SIZE;
+    WindowStart = (ULONG_PTR)MM_ROUND_DOWN(Address, Window);
+
+    First = (ULONG_PTR)Address;
+    Delta = -1;
+    while (First > WindowStart &&
+           MiIsSwapClusterPage(Process, MemoryArea, (PVOID)(First - PAGE_SIZE), RegionBase, Region,
+                               MmOffsetSwapEntry(SwapEntry, Delta)))
+    {
+        First -= PAGE_SIZE;
+        Delta--;
+    }
+
+    Last = (ULONG_PTR)Address;
+    Delta = 1;
+    while (Last + PAGE_SIZE < WindowStart + Window &&
+           MiIsSwapClusterPage(Process, MemoryArea, (PVOID)(Last + PAGE_SIZE), RegionBase, Region,
+                               MmOffsetSwapEntry(SwapEntry, Delta)))
+    {
+        Last += PAGE_SIZE;
+        Delta++;
+    }
+
+    *ClusterAddress = (PVOID)First;
+    return (ULONG)((Last - First) >> PAGE_SHIFT) + 1;
+}
+
 NTSTATUS
 NTAPI
 MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
@@ -1293,6 +1493,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     ULONG_PTR Entry1;
     ULONG Attributes;
     PMM_REGION Region;
+    PVOID RegionBase;
     BOOLEAN HasSwapEntry;
     PVOID PAddress;
     PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
@@ -1329,7 +1530,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     Section = MemoryArea->Data.SectionData.Section;
     Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
                           &MemoryArea->Data.SectionData.RegionListHead,
-                          Address, NULL);
+                          Address, &RegionBase);
     ASSERT(Region != NULL);
     /*
      * Lock the segment
@@ -1497,28 +1698,62 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     if (Entry == 0)
     {
         SWAPENTRY FakeSwapEntry;
+        PFN_NUMBER Pages[MI_MAX_CLUSTER_SIZE];
+        LARGE_INTEGER PageOffset;
+        PVOID ClusterAddress;
+        PVOID PageAddress;
+        ULONG ClusterCount;
+        ULONG FaultIndex;
+        ULONG Missing;
+        ULONG i;
+        BOOLEAN ReadFromFile;
 
         /*
          * If the entry is zero (and it can't change because we have
          * locked the segment) then we need to load the page.
          */
+        ReadFromFile = !((Segment->Flags & MM_PAGEFILE_SEGMENT) ||
+                         ((Offset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart) &&
+                           (Section->AllocationAttributes & SEC_IMAGE))));
+
+        /*
+         * Pages that come from the file bring their neighbours along,
+         * unless touching the neighbours is meant to fault
+         */
+        ClusterAddress = PAddress;
+        ClusterCount = 1;
+        if (ReadFromFile && !(Region->Protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        {
+            ClusterCount = MiFindFaultCluster(Process,
+                                              MemoryArea,
+                                              PAddress,
+                                              RegionBase,
+                                              Region,
+                                              &ClusterAddress);
+        }
+        FaultIndex = (ULONG)(((ULONG_PTR)PAddress - (ULONG_PTR)ClusterAddress) >> PAGE_SHIFT);
 
         /*
-         * Release all our locks and read in the page from disk
+         * Release all our locks and read in the pages from disk
          */
-        MmSetPageEntrySectionSegment(Segment, &Offset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        for (i = 0; i < ClusterCount; i++)
+        {
+            PageOffset.QuadPart = Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE;
+            MmSetPageEntrySectionSegment(Segment, &PageOffset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        }
         MmUnlockSectionSegment(Segment);
-        MmCreatePageFileMapping(Process, PAddress, MM_WAIT_ENTRY);
+        for (i = 0; i < ClusterCount; i++)
+        {
+            MmCreatePageFileMapping(Process, (PCHAR)ClusterAddress + i * PAGE_SIZE, MM_WAIT_ENTRY);
+        }
         MmUnlockAddressSpace(AddressSpace);
 
-        if ((Segment->Flags & MM_PAGEFILE_SEGMENT) ||
-                ((Offset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart) &&
-                  (Section->AllocationAttributes & SEC_IMAGE))))
+        if (!ReadFromFile)
         {
             MI_SET_USAGE(MI_USAGE_SECTION);
             if (Process) MI_SET_PROCESS2(Process->ImageFileName);
             if (!Process) MI_SET_PROCESS2("Kernel Section");
-            Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Page);
+            Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Pages[FaultIndex]);
             if (!NT_SUCCESS(Status))
             {
                 DPRINT1("MmRequestPageMemoryConsumer failed (Status %x)\n", Status);
@@ -1527,12 +1762,32 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         }
         else
         {
-            Status = MiReadPage(MemoryArea, Offset.QuadPart, &Page);
+            Status = MiReadPage(MemoryArea, Offset.QuadPart, &Pages[FaultIndex]);
             if (!NT_SUCCESS(Status))
             {
                 DPRINT1("MiReadPage failed (Status %x)\n", Status);
             }
         }
+
+        /*
+         * The faulting page brought the view in, the neighbours are
+         * cache hits now. The ones that fail are left to their own fault.
+         */
+        Missing = 0;
+        for (i = 0; i < ClusterCount; i++)
+        {
+            if (i == FaultIndex)
+                continue;
+
+            if (!NT_SUCCESS(Status) ||
+                !NT_SUCCESS(MiReadPage(MemoryArea,
+                                       Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE,
+                                       &Pages[i])))
+            {
+                Missing |= 1 << i;
+            }
+        }
+
         if (!NT_SUCCESS(Status))
         {
             /*
@@ -1542,6 +1797,20 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
              * Cleanup and release locks
              */
             MmLockAddressSpace(AddressSpace);
+            if (ClusterCount > 1)
+            {
+                MmLockSectionSegment(Segment);
+                for (i = 0; i < ClusterCount; i++)
+                {
+                    if (i == FaultIndex)
+                        continue;
+
+                    PageOffset.QuadPart = Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE;
+                    MmDeletePageFileMapping(Process, (PCHAR)ClusterAddress + i * PAGE_SIZE, &FakeSwapEntry);
+                    MmSetPageEntrySectionSegment(Segment, &PageOffset, 0);
+                }
+                MmUnlockSectionSegment(Segment);
+            }
             MiSetPageEvent(Process, Address);
             DPRINT("Address 0x%p\n", Address);
             return(Status);
@@ -1551,25 +1820,38 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         MmLockAddressSpace(AddressSpace);
         MmLockSectionSegment(Segment);
 
-        MmDeletePageFileMapping(Process, PAddress, &FakeSwapEntry);
-        DPRINT("CreateVirtualMapping Page %x Process %p PAddress %p Attributes %x\n",
-               Page, Process, PAddress, Attributes);
-        Status = MmCreateVirtualMapping(Process,
-                                        PAddress,
-                                        Attributes,
-                                        &Page,
-                                        1);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < ClusterCount; i++)
         {
-            DPRINT1("Unable to create virtual mapping\n");
-            KeBugCheck(MEMORY_MANAGEMENT);
-        }
-        ASSERT(MmIsPagePresent(Process, PAddress));
-        MmInsertRmap(Page, Process, Address);
+            PageAddress = (PCHAR)ClusterAddress + i * PAGE_SIZE;
+            PageOffset.QuadPart = Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE;
+
+            MmDeletePageFileMapping(Process, PageAddress, &FakeSwapEntry);
+
+            if (Missing & (1 << i))
+            {
+                MmSetPageEntrySectionSegment(Segment, &PageOffset, 0);
+                continue;
+            }
 
-        /* Set this section offset has being backed by our new page. */
-        Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
-        MmSetPageEntrySectionSegment(Segment, &Offset, Entry);
+            DPRINT("CreateVirtualMapping Page %x Process %p PAddress %p Attributes %x\n",
+                   Pages[i], Process, PageAddress, Attributes);
+            Status = MmCreateVirtualMapping(Process,
+                                            PageAddress,
+                                            Attributes,
+                                            &Pages[i],
+                                            1);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Unable to create virtual mapping\n");
+                KeBugCheck(MEMORY_MANAGEMENT);
+            }
+            ASSERT(MmIsPagePresent(Process, PageAddress));
+            MmInsertRmap(Pages[i], Process, i == FaultIndex ? Address : PageAddress);
+
+            /* Set this section offset has being backed by our new page. */
+            Entry = MAKE_SSE(Pages[i] << PAGE_SHIFT, 1);
+            MmSetPageEntrySectionSegment(Segment, &PageOffset, Entry);
+        }
         MmUnlockSectionSegment(Segment);
 
         MiSetPageEvent(Process, Address);
@@ -1579,6 +1861,15 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     else if (IS_SWAP_FROM_SSE(Entry))
     {
         SWAPENTRY SwapEntry;
+        SWAPENTRY FirstSwapEntry;
+        PFN_NUMBER Pages[MM_SWAP_CLUSTER_SIZE];
+        LARGE_INTEGER PageOffset;
+        PVOID ClusterAddress;
+        PVOID PageAddress;
+        ULONG ClusterCount;
+        ULONG FaultIndex;
+        BOOLEAN ClusterFailed;
+        ULONG i;
 
         SwapEntry = SWAPENTRY_FROM_SSE(Entry);
 
@@ -1593,7 +1884,36 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         }
 
         /*
-        * Release all our locks and read in the page from disk
+         * Neighbours that were paged out along with this page sit in the
+         * following paging file slots, bring them back in the same read
+         */
+        ClusterAddress = PAddress;
+        ClusterCount = 1;
+        if (!(Region->Protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        {
+            ClusterCount = MiFindSwapCluster(Process,
+                                             MemoryArea,
+                                             PAddress,
+                                             RegionBase,
+                                             Region,
+                                             SwapEntry,
+                                             &ClusterAddress);
+        }
+        FaultIndex = (ULONG)(((ULONG_PTR)PAddress - (ULONG_PTR)ClusterAddress) >> PAGE_SHIFT);
+        FirstSwapEntry = MmOffsetSwapEntry(SwapEntry, -(LONG)FaultIndex);
+
+        /*
+         * Mark the faulting page too, so that faults on its neighbours neither
+         * read it in a second time nor take it into their own cluster
+         */
+        for (i = 0; i < ClusterCount; i++)
+        {
+            PageOffset.QuadPart = Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE;
+            MmSetPageEntrySectionSegment(Segment, &PageOffset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        }
+
+        /*
+        * Release all our locks and read in the pages from disk
         */
         MmUnlockSectionSegment(Segment);
 
@@ -1601,13 +1921,24 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         MI_SET_USAGE(MI_USAGE_SECTION);
         if (Process) MI_SET_PROCESS2(Process->ImageFileName);
         if (!Process) MI_SET_PROCESS2("Kernel Section");
-        Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Page);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < ClusterCount; i++)
         {
-            KeBugCheck(MEMORY_MANAGEMENT);
+            Status = MmRequestPageMemoryConsumer(MC_USER, TRUE, &Pages[i]);
+            if (!NT_SUCCESS(Status))
+            {
+                KeBugCheck(MEMORY_MANAGEMENT);
+            }
         }
 
-        Status = MmReadFromSwapPage(SwapEntry, Page);
+        ClusterFailed = FALSE;
+        Status = MmReadFromSwapPages(FirstSwapEntry, Pages, ClusterCount);
+        if (!NT_SUCCESS(Status) && ClusterCount > 1)
+        {
+            /* The neighbours fault on their own, only this page must come in */
+            DPRINT1("MmReadFromSwapPages failed, status = %x\n", Status);
+            ClusterFailed = TRUE;
+            Status = MmReadFromSwapPage(SwapEntry, Pages[FaultIndex]);
+        }
         if (!NT_SUCCESS(Status))
         {
             KeBugCheck(MEMORY_MANAGEMENT);
@@ -1624,36 +1955,51 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
          * that has a pending page-in.
          */
         Entry1 = MmGetPageEntrySectionSegment(Segment, &Offset);
-        if (Entry != Entry1)
+        if (Entry1 != MAKE_SWAP_SSE(MM_WAIT_ENTRY))
         {
-            DPRINT1("Someone changed ppte entry while we slept (%x vs %x)\n", Entry, Entry1);
+            DPRINT1("Someone changed ppte entry while we slept (%x vs %x)\n", MAKE_SWAP_SSE(MM_WAIT_ENTRY), Entry1);
             KeBugCheck(MEMORY_MANAGEMENT);
         }
 
-        /*
-         * Save the swap entry.
-         */
-        MmSetSavedSwapEntryPage(Page, SwapEntry);
-
-        /* Map the page into the process address space */
-        Status = MmCreateVirtualMapping(Process,
-                                        PAddress,
-                                        Region->Protect,
-                                        &Page,
-                                        1);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < ClusterCount; i++)
         {
-            DPRINT1("Unable to create virtual mapping\n");
-            KeBugCheck(MEMORY_MANAGEMENT);
-        }
-        MmInsertRmap(Page, Process, Address);
+            PageAddress = (PCHAR)ClusterAddress + i * PAGE_SIZE;
+            PageOffset.QuadPart = Offset.QuadPart + ((LONGLONG)i - FaultIndex) * PAGE_SIZE;
 
-        /*
-         * Mark the offset within the section as having valid, in-memory
-         * data
-         */
-        Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
-        MmSetPageEntrySectionSegment(Segment, &Offset, Entry);
+            if (ClusterFailed && i != FaultIndex)
+            {
+                MmSetPageEntrySectionSegment(Segment,
+                                             &PageOffset,
+                                             MAKE_SWAP_SSE(MmOffsetSwapEntry(FirstSwapEntry, i)));
+                MmReleasePageMemoryConsumer(MC_USER, Pages[i]);
+                continue;
+            }
+
+            /*
+             * Save the swap entry.
+             */
+            MmSetSavedSwapEntryPage(Pages[i], MmOffsetSwapEntry(FirstSwapEntry, i));
+
+            /* Map the page into the process address space */
+            Status = MmCreateVirtualMapping(Process,
+                                            PageAddress,
+                                            Region->Protect,
+                                            &Pages[i],
+                                            1);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Unable to create virtual mapping\n");
+                KeBugCheck(MEMORY_MANAGEMENT);
+            }
+            MmInsertRmap(Pages[i], Process, i == FaultIndex ? Address : PageAddress);
+
+            /*
+             * Mark the offset within the section as having valid, in-memory
+             * data
+             */
+            Entry = MAKE_SSE(Pages[i] << PAGE_SHIFT, 1);
+            MmSetPageEntrySectionSegment(Segment, &PageOffset, Entry);
+        }
         MmUnlockSectionSegment(Segment);
 
         MiSetPageEvent(Process, Address);
@@ -1856,14 +2202,231 @@ MmPageOutDeleteMapping(PVOID Context, PEPROCESS Process, PVOID Address)
     }
 }
 
+static
+VOID
+MmRestorePageOutSectionView(PMM_PAGEOUT_ENTRY Request)
+/*
+ * FUNCTION: Maps a page back in when it couldn't be written to the
+ *           paging file.
+ */
+{
+    PMMSUPPORT AddressSpace = Request->AddressSpace;
+    PMEMORY_AREA MemoryArea = Request->MemoryArea;
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    ULONG_PTR Entry;
+    NTSTATUS Status;
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Segment);
+
+    Status = MmCreateVirtualMapping(Process,
+                                    Request->Address,
+                                    MemoryArea->Protect,
+                                    &Request->Page,
+                                    1);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Status %x Restoring %p:%p\n", Status, Process, Request->Address);
+        KeBugCheckEx(MEMORY_MANAGEMENT, Status, (ULONG_PTR)Process, (ULONG_PTR)Request->Address, Request->Page);
+    }
+    MmSetDirtyPage(Process, Request->Address);
+    MmInsertRmap(Request->Page,
+                 Process,
+                 Request->Address);
+
+    if (Request->Private)
+    {
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        Entry = Request->SectionEntry;
+    }
+    else
+    {
+        /*
+         * For non-private pages if the page wasn't direct mapped then
+         * set it back into the section segment entry so we don't loose
+         * our copy. Otherwise it will be handled by the cache manager.
+         */
+        ASSERT(MmGetPageEntrySectionSegment(Segment, &Request->Offset) == 0 ||
+               MmGetPageEntrySectionSegment(Segment, &Request->Offset) == MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        Entry = MAKE_SSE(Request->Page << PAGE_SHIFT, 1);
+    }
+    MmSetPageEntrySectionSegment(Segment, &Request->Offset, Entry);
+
+    MmUnlockSectionSegment(Segment);
+    MmUnlockAddressSpace(AddressSpace);
+    MiSetPageEvent(NULL, NULL);
+}
+
+static
+VOID
+MmFinishPageOutSectionView(PMM_PAGEOUT_ENTRY Request, SWAPENTRY SwapEntry)
+/*
+ * FUNCTION: Replaces a page that was written to the paging file by its
+ *           swap entry.
+ */
+{
+    PMMSUPPORT AddressSpace = Request->AddressSpace;
+    PMM_SECTION_SEGMENT Segment = Request->MemoryArea->Data.SectionData.Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    PFN_NUMBER Page = Request->Page;
+    ULONG_PTR Entry;
+    NTSTATUS Status;
+
+    DPRINT("MM: Wrote section page 0x%.8X to swap!\n", Page << PAGE_SHIFT);
+    MmSetSavedSwapEntryPage(Page, 0);
+    if (Segment->Flags & MM_PAGEFILE_SEGMENT ||
+            Segment->Image.Characteristics & IMAGE_SCN_MEM_SHARED)
+    {
+        MmLockSectionSegment(Segment);
+        MmSetPageEntrySectionSegment(Segment, &Request->Offset, MAKE_SWAP_SSE(SwapEntry));
+        MmUnlockSectionSegment(Segment);
+    }
+    else
+    {
+        MmReleasePageMemoryConsumer(MC_USER, Page);
+    }
+
+    if (Request->Private)
+    {
+        MmLockAddressSpace(AddressSpace);
+        MmLockSectionSegment(Segment);
+        Status = MmCreatePageFileMapping(Process,
+                                         Request->Address,
+                                         SwapEntry);
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        MmSetPageEntrySectionSegment(Segment, &Request->Offset, Request->SectionEntry);
+        MmUnlockSectionSegment(Segment);
+        MmUnlockAddressSpace(AddressSpace);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Status %x Creating page file mapping for %p:%p\n", Status, Process, Request->Address);
+            KeBugCheckEx(MEMORY_MANAGEMENT, Status, (ULONG_PTR)Process, (ULONG_PTR)Request->Address, SwapEntry);
+        }
+    }
+    else
+    {
+        MmLockAddressSpace(AddressSpace);
+        MmLockSectionSegment(Segment);
+        Entry = MAKE_SWAP_SSE(SwapEntry);
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        MmSetPageEntrySectionSegment(Segment, &Request->Offset, Entry);
+        MmUnlockSectionSegment(Segment);
+        MmUnlockAddressSpace(AddressSpace);
+    }
+
+    MiSetPageEvent(NULL, NULL);
+}
+
+static
+BOOLEAN
+MiPageOutEntryPrecedes(PMM_PAGEOUT_ENTRY First, PMM_PAGEOUT_ENTRY Second)
+{
+    if (First->AddressSpace != Second->AddressSpace)
+        return (ULONG_PTR)First->AddressSpace < (ULONG_PTR)Second->AddressSpace;
+
+    return (ULONG_PTR)First->Address < (ULONG_PTR)Second->Address;
+}
+
+ULONG
+NTAPI
+MmFlushPageOutCluster(PMM_PAGEOUT_CLUSTER Cluster)
+/*
+ * FUNCTION: Writes the pages gathered by MmPageOutSectionView to the
+ *           paging file and finishes paging them out.
+ * RETURNS: The number of pages that were paged out.
+ * NOTES: Every run of consecutive paging file slots is written with a
+ *        single I/O. The references MmPageOutPhysicalAddressCluster took
+ *        on the processes are dropped.
+ */
+{
+    SWAPENTRY SwapEntries[MM_SWAP_CLUSTER_SIZE];
+    PFN_NUMBER Pages[MM_SWAP_CLUSTER_SIZE];
+    MM_PAGEOUT_ENTRY Request;
+    PEPROCESS Process;
+    NTSTATUS Status;
+    ULONG Allocated;
+    ULONG NrPagedOut;
+    ULONG i, j;
+
+    /*
+     * Sort the pages by address, neighbours then get neighbouring slots
+     * and can be faulted back in together
+     */
+    for (i = 1; i < Cluster->Count; i++)
+    {
+        Request = Cluster->Entries[i];
+        for (j = i; j > 0 && MiPageOutEntryPrecedes(&Request, &Cluster->Entries[j - 1]); j--)
+        {
+            Cluster->Entries[j] = Cluster->Entries[j - 1];
+        }
+        Cluster->Entries[j] = Request;
+    }
+
+    NrPagedOut = 0;
+    for (i = 0; i < Cluster->Count; i += Allocated)
+    {
+        Allocated = MmAllocSwapPages(Cluster->Count - i, &SwapEntries[i]);
+        if (Allocated == 0)
+        {
+            MmShowOutOfSpaceMessagePagingFile();
+            Allocated = Cluster->Count - i;
+            Status = STATUS_PAGEFILE_QUOTA;
+        }
+        else
+        {
+            for (j = i; j < i + Allocated; j++)
+            {
+                Pages[j] = Cluster->Entries[j].Page;
+            }
+
+            Status = MmWriteToSwapPages(SwapEntries[i], &Pages[i], Allocated);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("MM: Failed to write to swap pages (Status was 0x%.8X)\n",
+                        Status);
+                for (j = i; j < i + Allocated; j++)
+                {
+                    MmFreeSwapPage(SwapEntries[j]);
+                }
+            }
+        }
+
+        for (j = i; j < i + Allocated; j++)
+        {
+            if (NT_SUCCESS(Status))
+            {
+                MmFinishPageOutSectionView(&Cluster->Entries[j], SwapEntries[j]);
+                NrPagedOut++;
+            }
+            else
+            {
+                MmRestorePageOutSectionView(&Cluster->Entries[j]);
+            }
+
+            if (Cluster->Entries[j].Address < MmSystemRangeStart)
+            {
+                Process = MmGetAddressSpaceOwner(Cluster->Entries[j].AddressSpace);
+                ExReleaseRundownProtection(&Process->RundownProtect);
+                ObDereferenceObject(Process);
+            }
+        }
+    }
+
+    Cluster->Count = 0;
+    return NrPagedOut;
+}
+
 NTSTATUS
 NTAPI
 MmPageOutSectionView(PMMSUPPORT AddressSpace,
                      MEMORY_AREA* MemoryArea,
-                     PVOID Address, ULONG_PTR Entry)
+                     PVOID Address, ULONG_PTR Entry,
+                     PMM_PAGEOUT_CLUSTER Cluster)
 {
     PFN_NUMBER Page;
     MM_SECTION_PAGEOUT_CONTEXT Context;
+    MM_PAGEOUT_ENTRY Request;
     SWAPENTRY SwapEntry;
     NTSTATUS Status;
 #ifndef NEWCC
@@ -2111,6 +2674,30 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
         return(STATUS_SUCCESS);
     }
 
+    Request.AddressSpace = AddressSpace;
+    Request.MemoryArea = MemoryArea;
+    Request.Address = Address;
+    Request.Page = Page;
+    Request.SectionEntry = Entry;
+    Request.Offset = Context.Offset;
+    Request.Private = Context.Private;
+
+    /*
+     * When the caller gathers dirty pages, leave the write to it. The page
+     * gets a slot next to the others, its old one is stale anyway.
+     */
+    if (Cluster != NULL)
+    {
+        ASSERT(Cluster->Count < MM_SWAP_CLUSTER_SIZE);
+        if (SwapEntry != 0)
+        {
+            MmSetSavedSwapEntryPage(Page, 0);
+            MmFreeSwapPage(SwapEntry);
+        }
+        Cluster->Entries[Cluster->Count++] = Request;
+        return(STATUS_PENDING);
+    }
+
     /*
      * If necessary, allocate an entry in the paging file for this page
      */
@@ -2120,51 +2707,7 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
         if (SwapEntry == 0)
         {
             MmShowOutOfSpaceMessagePagingFile();
-            MmLockAddressSpace(AddressSpace);
-            /*
-             * For private pages restore the old mappings.
-             */
-            if (Context.Private)
-            {
-                Status = MmCreateVirtualMapping(Process,
-                                                Address,
-                                                MemoryArea->Protect,
-                                                &Page,
-                                                1);
-                MmSetDirtyPage(Process, Address);
-                MmInsertRmap(Page,
-                             Process,
-                             Address);
-            }
-            else
-            {
-                ULONG_PTR OldEntry;
-
-                MmLockSectionSegment(Context.Segment);
-
-                /*
-                 * For non-private pages if the page wasn't direct mapped then
-                 * set it back into the section segment entry so we don't loose
-                 * our copy. Otherwise it will be handled by the cache manager.
-                 */
-                Status = MmCreateVirtualMapping(Process,
-                                                Address,
-                                                MemoryArea->Protect,
-                                                &Page,
-                                                1);
-                MmSetDirtyPage(Process, Address);
-                MmInsertRmap(Page,
-                             Process,
-                             Address);
-                // If we got here, the previous entry should have been a wait
-                Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
-                OldEntry = MmGetPageEntrySectionSegment(Context.Segment, &Context.Offset);
-                ASSERT(OldEntry == 0 || OldEntry == MAKE_SWAP_SSE(MM_WAIT_ENTRY));
-                MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-                MmUnlockSectionSegment(Context.Segment);
-            }
-            MmUnlockAddressSpace(AddressSpace);
-            MiSetPageEvent(NULL, NULL);
+            MmRestorePageOutSectionView(&Request);
             return(STATUS_PAGEFILE_QUOTA);
         }
     }
@@ -2179,88 +2722,17 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
                 Status);
         /*
          * As above: undo our actions.
-         * FIXME: Also free the swap page.
          */
-        MmLockAddressSpace(AddressSpace);
-        if (Context.Private)
-        {
-            Status = MmCreateVirtualMapping(Process,
-                                            Address,
-                                            MemoryArea->Protect,
-                                            &Page,
-                                            1);
-            MmSetDirtyPage(Process, Address);
-            MmInsertRmap(Page,
-                         Process,
-                         Address);
-        }
-        else
-        {
-            MmLockSectionSegment(Context.Segment);
-            Status = MmCreateVirtualMapping(Process,
-                                            Address,
-                                            MemoryArea->Protect,
-                                            &Page,
-                                            1);
-            MmSetDirtyPage(Process, Address);
-            MmInsertRmap(Page,
-                         Process,
-                         Address);
-            Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
-            MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-            MmUnlockSectionSegment(Context.Segment);
-        }
-        MmUnlockAddressSpace(AddressSpace);
-        MiSetPageEvent(NULL, NULL);
+        MmSetSavedSwapEntryPage(Page, 0);
+        MmFreeSwapPage(SwapEntry);
+        MmRestorePageOutSectionView(&Request);
         return(STATUS_UNSUCCESSFUL);
     }
 
     /*
      * Otherwise we have succeeded.
      */
-    DPRINT("MM: Wrote section page 0x%.8X to swap!\n", Page << PAGE_SHIFT);
-    MmSetSavedSwapEntryPage(Page, 0);
-    if (Context.Segment->Flags & MM_PAGEFILE_SEGMENT ||
-            Context.Segment->Image.Characteristics & IMAGE_SCN_MEM_SHARED)
-    {
-        MmLockSectionSegment(Context.Segment);
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, MAKE_SWAP_SSE(SwapEntry));
-        MmUnlockSectionSegment(Context.Segment);
-    }
-    else
-    {
-        MmReleasePageMemoryConsumer(MC_USER, Page);
-    }
-
-    if (Context.Private)
-    {
-        MmLockAddressSpace(AddressSpace);
-        MmLockSectionSegment(Context.Segment);
-        Status = MmCreatePageFileMapping(Process,
-                                         Address,
-                                         SwapEntry);
-        /* We had placed a wait entry upon entry ... replace it before leaving */
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-        MmUnlockSectionSegment(Context.Segment);
-        MmUnlockAddressSpace(AddressSpace);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT1("Status %x Creating page file mapping for %p:%p\n", Status, Process, Address);
-            KeBugCheckEx(MEMORY_MANAGEMENT, Status, (ULONG_PTR)Process, (ULONG_PTR)Address, SwapEntry);
-        }
-    }
-    else
-    {
-        MmLockAddressSpace(AddressSpace);
-        MmLockSectionSegment(Context.Segment);
-        Entry = MAKE_SWAP_SSE(SwapEntry);
-        /* We had placed a wait entry upon entry ... replace it before leaving */
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-        MmUnlockSectionSegment(Context.Segment);
-        MmUnlockAddressSpace(AddressSpace);
-    }
-
-    MiSetPageEvent(NULL, NULL);
+    MmFinishPageOutSectionView(&Request, SwapEntry);
     return(STATUS_SUCCESS);
 }
 
@@ -222,6 +222,7 @@ list(APPEND SOURCE
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/mmfault.c
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/mminit.c
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/pagefile.c
+    ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/pagestore.c
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/region.c
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/rmap.c
     ${REACTOS_SOURCE_DIR}/ntoskrnl/mm/section.c
@@ -403,6 +403,51 @@ typedef enum _STOR_SYNCHRONIZATION_MODEL
     StorSynchronizeFullDuplex
 } STOR_SYNCHRONIZATION_MODEL;
 
+typedef enum _INTERRUPT_SYNCHRONIZATION_MODE
+{
+    InterruptSupportNone,
+    InterruptSynchronizeAll,
+    InterruptSynchronizePerMessage
+} INTERRUPT_SYNCHRONIZATION_MODE;
+
+typedef enum _STORPORT_FUNCTION_CODE
+{
+    ExtFunctionAllocatePool,
+    ExtFunctionFreePool,
+    ExtFunctionAllocateMdl,
+    ExtFunctionFreeMdl,
+    ExtFunctionBuildMdlForNonPagedPool,
+    ExtFunctionGetSystemAddress,
+    ExtFunctionGetOriginalMdl,
+    ExtFunctionCompleteServiceIrp,
+    ExtFunctionGetDeviceObjects,
+    ExtFunctionBuildScatterGatherList,
+    ExtFunctionPutScatterGatherList,
+    ExtFunctionAcquireMSISpinLock,
+    ExtFunctionReleaseMSISpinLock,
+    ExtFunctionGetMessageInterruptInformation,
+    ExtFunctionInitializePerformanceOptimizations,
+    ExtFunctionGetStartIoPerformanceParameters,
+    ExtFunctionLogSystemEvent,
+    ExtFunctionGetCurrentProcessorNumber,
+    ExtFunctionGetActiveGroupCount,
+    ExtFunctionGetGroupAffinity
+} STORPORT_FUNCTION_CODE, *PSTORPORT_FUNCTION_CODE;
+
+#define STOR_STATUS_SUCCESS                 (0x00000000L)
+#define STOR_STATUS_UNSUCCESSFUL            (0xC1000001L)
+#define STOR_STATUS_NOT_IMPLEMENTED         (0xC1000002L)
+#define STOR_STATUS_INSUFFICIENT_RESOURCES  (0xC1000003L)
+#define STOR_STATUS_BUFFER_TOO_SMALL        (0xC1000004L)
+#define STOR_STATUS_ACCESS_DENIED           (0xC1000005L)
+#define STOR_STATUS_INVALID_PARAMETER       (0xC1000006L)
+#define STOR_STATUS_INVALID_DEVICE_REQUEST  (0xC1000007L)
+#define STOR_STATUS_INVALID_IRQL            (0xC1000008L)
+#define STOR_STATUS_INVALID_DEVICE_STATE    (0xC1000009L)
+#define STOR_STATUS_INVALID_BUFFER_SIZE     (0xC100000AL)
+#define STOR_STATUS_UNSUPPORTED_VERSION     (0xC100000BL)
+#define STOR_STATUS_BUSY                    (0xC100000CL)
+
 typedef enum _STOR_DMA_WIDTH
 {
     DmaUnknown,
@@ -435,6 +480,12 @@ typedef enum _SCSI_ADAPTER_CONTROL_STATUS
     ScsiAdapterControlUnsuccessful
 } SCSI_ADAPTER_CONTROL_STATUS, *PSCSI_ADAPTER_CONTROL_STATUS;
 
+typedef struct _SCSI_SUPPORTED_CONTROL_TYPE_LIST
+{
+    ULONG MaxControlType;
+    BOOLEAN SupportedTypeList[0];
+} SCSI_SUPPORTED_CONTROL_TYPE_LIST, *PSCSI_SUPPORTED_CONTROL_TYPE_LIST;
+
 typedef enum _SCSI_NOTIFICATION_TYPE
 {
     RequestComplete,
@@ -1896,6 +1947,22 @@ typedef struct _MEMORY_REGION
     ULONG Length;
 } MEMORY_REGION, *PMEMORY_REGION;
 
+typedef struct _MESSAGE_INTERRUPT_INFORMATION
+{
+    ULONG MessageId;
+    ULONG MessageData;
+    STOR_PHYSICAL_ADDRESS MessageAddress;
+    ULONG InterruptVector;
+    ULONG InterruptLevel;
+    KINTERRUPT_MODE InterruptMode;
+} MESSAGE_INTERRUPT_INFORMATION, *PMESSAGE_INTERRUPT_INFORMATION;
+
+typedef
+BOOLEAN
+(NTAPI *PHW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE)(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG MessageId);
+
 typedef struct _PORT_CONFIGURATION_INFORMATION
 {
     ULONG Length;
@@ -1950,6 +2017,11 @@ typedef struct _PORT_CONFIGURATION_INFORMATION
     UCHAR MaximumNumberOfLogicalUnits;
     BOOLEAN WmiDataProvider;
     STOR_SYNCHRONIZATION_MODEL SynchronizationModel;
+    PHW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE HwMSInterruptRoutine;
+    INTERRUPT_SYNCHRONIZATION_MODE InterruptSynchronizationMode;
+    MEMORY_REGION DumpRegion;
+    ULONG RequestedDumpBufferSize;
+    BOOLEAN VirtualDevice;
 } PORT_CONFIGURATION_INFORMATION, *PPORT_CONFIGURATION_INFORMATION;
 
 typedef struct _STOR_SCATTER_GATHER_ELEMENT
@@ -2213,6 +2285,14 @@ StorPortDeviceReady(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun);
 
+STORPORT_API
+ULONG
+__cdecl
+StorPortExtendedFunction(
+    _In_ STORPORT_FUNCTION_CODE FunctionCode,
+    _In_ PVOID HwDeviceExtension,
+    ...);
+
 STORPORT_API
 VOID
 NTAPI
@@ -2721,6 +2801,80 @@ StorPortReleaseSpinLock(
                          LockHandle);
 }
 
+FORCEINLINE
+ULONG
+StorPortAcquireMSISpinLock(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG MessageId,
+    _Out_ PULONG OldIrql)
+{
+    return StorPortExtendedFunction(ExtFunctionAcquireMSISpinLock,
+                                    HwDeviceExtension,
+                                    MessageId,
+                                    OldIrql);
+}
+
+FORCEINLINE
+ULONG
+StorPortReleaseMSISpinLock(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG MessageId,
+    _In_ ULONG OldIrql)
+{
+    return StorPortExtendedFunction(ExtFunctionReleaseMSISpinLock,
+                                    HwDeviceExtension,
+                                    MessageId,
+                                    OldIrql);
+}
+
+FORCEINLINE
+ULONG
+StorPortGetMSIInfo(
+    _In_ PVOID HwDeviceExtension,
+    _In_ ULONG MessageId,
+    _Out_ PMESSAGE_INTERRUPT_INFORMATION InterruptInfo)
+{
+    return StorPortExtendedFunction(ExtFunctionGetMessageInterruptInformation,
+                                    HwDeviceExtension,
+                                    MessageId,
+                                    InterruptInfo);
+}
+
+FORCEINLINE
+ULONG
+StorPortGetCurrentProcessorNumber(
+    _In_ PVOID HwDeviceExtension,
+    _Out_ PPROCESSOR_NUMBER ProcNumber)
+{
+    return StorPortExtendedFunction(ExtFunctionGetCurrentProcessorNumber,
+                                    HwDeviceExtension,
+                                    ProcNumber);
+}
+
+FORCEINLINE
+ULONG
+StorPortGetActiveGroupCount(
+    _In_ PVOID HwDeviceExtension,
+    _Out_ PUSHORT NumberGroups)
+{
+    return StorPortExtendedFunction(ExtFunctionGetActiveGroupCount,
+                                    HwDeviceExtension,
+                                    NumberGroups);
+}
+
+FORCEINLINE
+ULONG
+StorPortGetGroupAffinity(
+    _In_ PVOID HwDeviceExtension,
+    _In_ USHORT GroupNumber,
+    _Out_ PKAFFINITY GroupAffinityMask)
+{
+    return StorPortExtendedFunction(ExtFunctionGetGroupAffinity,
+                                    HwDeviceExtension,
+                                    GroupNumber,
+                                    GroupAffinityMask);
+}
+
 #if DBG
 #define DebugPrint(x) StorPortDebugPrint x
 #else
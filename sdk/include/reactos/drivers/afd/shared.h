@@ -59,6 +59,19 @@ typedef struct _AFD_POLL_INFO {
     AFD_HANDLE			        Handles[1];
 } AFD_POLL_INFO, *PAFD_POLL_INFO;
 
+/* Handles with no events are taken out of the set */
+typedef struct _AFD_POLL_SET_INFO {
+    ULONG				HandleCount;
+    AFD_HANDLE			        Handles[1];
+} AFD_POLL_SET_INFO, *PAFD_POLL_SET_INFO;
+
+/* Returns as many ready handles as the output buffer can hold */
+typedef struct _AFD_POLL_SET_WAIT_INFO {
+    LARGE_INTEGER		        Timeout;
+    ULONG				HandleCount;
+    AFD_HANDLE			        Handles[1];
+} AFD_POLL_SET_WAIT_INFO, *PAFD_POLL_SET_WAIT_INFO;
+
 typedef struct _AFD_ACCEPT_DATA {
     ULONG				UseSAN;
     ULONG				SequenceNumber;
@@ -261,6 +274,9 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+/* ReactOS specific */
+#define AFD_UPDATE_POLL_SET		0x100
+#define AFD_WAIT_POLL_SET		0x101
 
 /* AFD IOCTLs */
 
@@ -336,6 +352,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_UPDATE_POLL_SET \
+  _AFD_CONTROL_CODE(AFD_UPDATE_POLL_SET, METHOD_BUFFERED)
+#define IOCTL_AFD_WAIT_POLL_SET \
+  _AFD_CONTROL_CODE(AFD_WAIT_POLL_SET, METHOD_BUFFERED)
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -106,6 +106,8 @@
 
 #define FAST486_PAGE_SIZE 4096
 #define FAST486_CACHE_SIZE 32
+#define FAST486_CACHE_LINES 256
+#define FAST486_TLB_ENTRIES 4096
 
 /*
  * These are condiciones sine quibus non that should be respected, because
@@ -423,6 +425,20 @@ typedef struct _FAST486_LEGACY_TSS
 
 #include <poppack.h>
 
+typedef struct _FAST486_CACHE_LINE
+{
+    ULONG Address;
+    ULONG Generation;
+    UCHAR Data[FAST486_CACHE_SIZE];
+} FAST486_CACHE_LINE, *PFAST486_CACHE_LINE;
+
+typedef struct _FAST486_TLB_ENTRY
+{
+    ULONG Tag;
+    ULONG Generation;
+    ULONG Value;
+} FAST486_TLB_ENTRY, *PFAST486_TLB_ENTRY;
+
 typedef struct _FAST486_TABLE_REG
 {
     USHORT Size;
@@ -537,12 +553,11 @@ struct _FAST486_STATE
     BOOLEAN Halted;
     BOOLEAN IntSignaled;
     BOOLEAN DoNotInterrupt;
-    PULONG Tlb;
-    BOOLEAN TlbEmpty;
+    PFAST486_TLB_ENTRY Tlb;
+    ULONG TlbGeneration;
 #ifndef FAST486_NO_PREFETCH
-    BOOLEAN PrefetchValid;
-    ULONG PrefetchAddress;
-    UCHAR PrefetchCache[FAST486_CACHE_SIZE];
+    ULONG PrefetchGeneration;
+    FAST486_CACHE_LINE PrefetchCache[FAST486_CACHE_LINES];
 #endif
 #ifndef FAST486_NO_FPU
     FAST486_FPU_DATA_REG FpuRegisters[FAST486_NUM_FPU_REGS];
@@ -568,7 +583,7 @@ Fast486Initialize(PFAST486_STATE         State,
                   FAST486_BOP_PROC       BopCallback,
                   FAST486_INT_ACK_PROC   IntAckCallback,
                   FAST486_FPU_PROC       FpuCallback,
-                  PULONG                 Tlb);
+                  PFAST486_TLB_ENTRY     Tlb);
 
 VOID
 NTAPI
@@ -619,6 +634,10 @@ VOID
 NTAPI
 Fast486Rewind(PFAST486_STATE State);
 
+VOID
+NTAPI
+Fast486InvalidateCache(PFAST486_STATE State, ULONG Address, ULONG Size);
+
 #endif // _FAST486_H_
 
 /* EOF */
@@ -461,6 +461,10 @@ VOID ProcessFragment(
     /* FIXME: Assumes IPv4 */
     IPInitializePacket(&Datagram, IP_ADDRESS_V4);
 
+    /* A datagram that arrived whole keeps what the adapter verified for it */
+    if (IPDR->FragmentListHead.Flink == IPDR->FragmentListHead.Blink)
+        Datagram.Flags |= (IPPacket->Flags & IP_PACKET_FLAG_CHECKSUM_OK);
+
     Success = ReassembleDatagram(&Datagram, IPDR);
 
     FreeIPDR(IPDR);
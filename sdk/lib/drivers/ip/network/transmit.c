@@ -190,6 +190,11 @@ NTSTATUS SendFragments(
     IFC->Data         = (PVOID)((ULONG_PTR)IFC->Header + IPPacket->HeaderSize);
     KeInitializeEvent(&IFC->Event, NotificationEvent, FALSE);
 
+    /* A datagram that goes out in one piece keeps its checksum offload request */
+    if (IFC->BytesLeft <= ((PathMTU - IFC->HeaderSize) & ~7))
+        NDIS_PER_PACKET_INFO_FROM_PACKET(IFC->NdisPacket, TcpIpChecksumPacketInfo) =
+            NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket->NdisPacket, TcpIpChecksumPacketInfo);
+
     TI_DbgPrint(MID_TRACE,("Copying header from %x to %x (%d)\n",
 			   IPPacket->Header, IFC->Header,
 			   IPPacket->HeaderSize));
@@ -49,10 +49,11 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
     NTSTATUS Status = STATUS_SUCCESS;
     struct ip_addr AddressToBind;
     KIRQL OldIrql;
-    TA_IP_ADDRESS LocalAddress;
+    u16_t LocalPort;
 
     ASSERT(Connection);
 
+    LibTCPLockCore();
     LockObject(Connection, &OldIrql);
 
     ASSERT_KM_POINTER(Connection->AddressFile);
@@ -73,12 +74,14 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
         /* Check if we had an unspecified port */
         if (!Connection->AddressFile->Port)
         {
-            /* We did, so we need to copy back the port */
-            Status = TCPGetSockAddress(Connection, (PTRANSPORT_ADDRESS)&LocalAddress, FALSE);
+            /* We did, so we need to copy back the port (TCPGetSockAddress would take our lock again) */
+            Status = TCPTranslateError(LibTCPGetHostName(Connection->SocketContext,
+                                                         &AddressToBind,
+                                                         &LocalPort));
             if (NT_SUCCESS(Status))
             {
                 /* Allocate the port in the port bitmap */
-                Connection->AddressFile->Port = TCPAllocatePort(LocalAddress.Address[0].Address[0].sin_port);
+                Connection->AddressFile->Port = TCPAllocatePort(LocalPort);
                 
                 /* This should never fail */
                 ASSERT(Connection->AddressFile->Port != 0xFFFF);
@@ -94,6 +97,7 @@ NTSTATUS TCPListen(PCONNECTION_ENDPOINT Connection, UINT Backlog)
     }
 
     UnlockObject(Connection, OldIrql);
+    LibTCPUnlockCore();
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPListen] Leaving. Status = %x\n", Status));
 
@@ -35,11 +35,14 @@ DisconnectTimeoutDpc(PKDPC Dpc,
     PLIST_ENTRY Entry;
     PTDI_BUCKET Bucket;
 
-    LockObjectAtDpcLevel(Connection);
+    /* The shutdown may end up in TCPFinEventHandler, which takes the connection lock */
+    LibTCPLockCore();
 
     /* We timed out waiting for pending sends so force it to shutdown */
     TCPTranslateError(LibTCPShutdown(Connection, 0, 1));
 
+    LockObjectAtDpcLevel(Connection);
+
     while (!IsListEmpty(&Connection->SendRequest))
     {
         Entry = RemoveHeadList(&Connection->SendRequest);
@@ -65,6 +68,8 @@ DisconnectTimeoutDpc(PKDPC Dpc,
     }
     
     UnlockObjectFromDpcLevel(Connection);
+
+    LibTCPUnlockCore();
     
     DereferenceObject(Connection);
 }
@@ -128,6 +133,7 @@ NTSTATUS TCPSocket( PCONNECTION_ENDPOINT Connection,
     NTSTATUS Status;
     KIRQL OldIrql;
 
+    LibTCPLockCore();
     LockObject(Connection, &OldIrql);
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSocket] Called: Connection %x, Family %d, Type %d, "
@@ -141,6 +147,7 @@ NTSTATUS TCPSocket( PCONNECTION_ENDPOINT Connection,
         Status = STATUS_INSUFFICIENT_RESOURCES;
 
     UnlockObject(Connection, OldIrql);
+    LibTCPUnlockCore();
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSocket] Leaving. Status = 0x%x\n", Status));
 
@@ -149,15 +156,15 @@ NTSTATUS TCPSocket( PCONNECTION_ENDPOINT Connection,
 
 NTSTATUS TCPClose( PCONNECTION_ENDPOINT Connection )
 {
-    KIRQL OldIrql;
-
-    LockObject(Connection, &OldIrql);
+    /* Don't hold the connection lock here, both FlushAllQueues and the
+     * TCPFinEventHandler call from the close callback take it */
+    LibTCPLockCore();
 
     FlushAllQueues(Connection, STATUS_CANCELLED);
 
     LibTCPClose(Connection, FALSE, TRUE);
 
-    UnlockObject(Connection, OldIrql);
+    LibTCPUnlockCore();
 
     DereferenceObject(Connection);
 
@@ -177,7 +184,10 @@ VOID TCPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
                            IPPacket->TotalSize,
                            IPPacket->HeaderSize));
     
-    LibIPInsertPacket(Interface->TCPContext, IPPacket->Header, IPPacket->TotalSize);
+    LibIPInsertPacket(Interface->TCPContext,
+                      IPPacket->Header,
+                      IPPacket->TotalSize,
+                      (IPPacket->Flags & IP_PACKET_FLAG_CHECKSUM_OK) != 0);
 }
 
 NTSTATUS TCPStartup(VOID)
@@ -284,7 +294,7 @@ NTSTATUS TCPConnect
     struct ip_addr bindaddr, connaddr;
     IP_ADDRESS RemoteAddress;
     USHORT RemotePort;
-    TA_IP_ADDRESS LocalAddress;
+    u16_t LocalPort;
     PTDI_BUCKET Bucket;
     PNEIGHBOR_CACHE_ENTRY NCE;
     KIRQL OldIrql;
@@ -308,11 +318,13 @@ NTSTATUS TCPConnect
                  RemoteAddress.Address.IPv4Address,
                  RemotePort));
 
+    LibTCPLockCore();
     LockObject(Connection, &OldIrql);
 
     if (!Connection->AddressFile)
     {
         UnlockObject(Connection, OldIrql);
+        LibTCPUnlockCore();
         return STATUS_INVALID_PARAMETER;
     }
 
@@ -321,6 +333,7 @@ NTSTATUS TCPConnect
         if (!(NCE = RouteGetRouteToDestination(&RemoteAddress)))
         {
             UnlockObject(Connection, OldIrql);
+            LibTCPUnlockCore();
             return STATUS_NETWORK_UNREACHABLE;
         }
 
@@ -342,12 +355,14 @@ NTSTATUS TCPConnect
         /* Check if we had an unspecified port */
         if (!Connection->AddressFile->Port)
         {
-            /* We did, so we need to copy back the port */
-            Status = TCPGetSockAddress(Connection, (PTRANSPORT_ADDRESS)&LocalAddress, FALSE);
+            /* We did, so we need to copy back the port (TCPGetSockAddress would take our lock again) */
+            Status = TCPTranslateError(LibTCPGetHostName(Connection->SocketContext,
+                                                         &bindaddr,
+                                                         &LocalPort));
             if (NT_SUCCESS(Status))
             {
                 /* Allocate the port in the port bitmap */
-                Connection->AddressFile->Port = TCPAllocatePort(LocalAddress.Address[0].Address[0].sin_port);
+                Connection->AddressFile->Port = TCPAllocatePort(LocalPort);
                     
                 /* This should never fail */
                 ASSERT(Connection->AddressFile->Port != 0xFFFF);
@@ -362,6 +377,7 @@ NTSTATUS TCPConnect
             if (!Bucket)
             {
                 UnlockObject(Connection, OldIrql);
+                LibTCPUnlockCore();
                 return STATUS_NO_MEMORY;
             }
             
@@ -377,6 +393,7 @@ NTSTATUS TCPConnect
     }
 
     UnlockObject(Connection, OldIrql);
+    LibTCPUnlockCore();
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPConnect] Leaving. Status = 0x%x\n", Status));
 
@@ -396,9 +413,11 @@ NTSTATUS TCPDisconnect
     PTDI_BUCKET Bucket;
     KIRQL OldIrql;
     LARGE_INTEGER ActualTimeout;
+    BOOLEAN ShutdownSend = FALSE, ShutdownReceive = FALSE;
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPDisconnect] Called\n"));
 
+    LibTCPLockCore();
     LockObject(Connection, &OldIrql);
 
     if (Connection->SocketContext)
@@ -407,12 +426,12 @@ NTSTATUS TCPDisconnect
         {
             if (IsListEmpty(&Connection->SendRequest))
             {
-                Status = TCPTranslateError(LibTCPShutdown(Connection, 0, 1));
+                ShutdownSend = TRUE;
             }
             else if (Timeout && Timeout->QuadPart == 0)
             {
                 FlushSendQueue(Connection, STATUS_FILE_CLOSED, FALSE);
-                TCPTranslateError(LibTCPShutdown(Connection, 0, 1));
+                ShutdownSend = TRUE;
                 Status = STATUS_TIMEOUT;
             }
             else 
@@ -432,6 +451,7 @@ NTSTATUS TCPDisconnect
                 if (!Bucket)
                 {
                     UnlockObject(Connection, OldIrql);
+                    LibTCPUnlockCore();
                     return STATUS_NO_MEMORY;
                 }
 
@@ -456,7 +476,8 @@ NTSTATUS TCPDisconnect
             FlushReceiveQueue(Connection, STATUS_FILE_CLOSED, FALSE);
             FlushSendQueue(Connection, STATUS_FILE_CLOSED, FALSE);
             FlushShutdownQueue(Connection, STATUS_FILE_CLOSED, FALSE);
-            Status = TCPTranslateError(LibTCPShutdown(Connection, 1, 1));
+            ShutdownSend = TRUE;
+            ShutdownReceive = TRUE;
         }
     }
     else
@@ -465,8 +486,23 @@ NTSTATUS TCPDisconnect
         Status = STATUS_SUCCESS;
     }
 
+    /* Shutting down both directions runs TCPFinEventHandler, which takes the connection lock */
     UnlockObject(Connection, OldIrql);
 
+    if (ShutdownReceive)
+    {
+        Status = TCPTranslateError(LibTCPShutdown(Connection, 1, 1));
+    }
+    else if (ShutdownSend)
+    {
+        if (Status == STATUS_TIMEOUT)
+            TCPTranslateError(LibTCPShutdown(Connection, 0, 1));
+        else
+            Status = TCPTranslateError(LibTCPShutdown(Connection, 0, 1));
+    }
+
+    LibTCPUnlockCore();
+
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPDisconnect] Leaving. Status = 0x%x\n", Status));
 
     return Status;
@@ -533,8 +569,8 @@ NTSTATUS TCPSendData
     NTSTATUS Status;
     PTDI_BUCKET Bucket;
     KIRQL OldIrql;
-
-    LockObject(Connection, &OldIrql);
+    ULONG Length;
+    u32_t Sent;
 
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Called for %d bytes (on socket %x)\n",
                            SendLength, Connection->SocketContext));
@@ -543,34 +579,59 @@ NTSTATUS TCPSendData
     TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Connection->SocketContext = %x\n",
                            Connection->SocketContext));
 
-    Status = TCPTranslateError(LibTCPSend(Connection,
-                                          BufferData,
-                                          SendLength,
-                                          BytesSent,
-                                          FALSE));
-    
-    TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Send: %x, %d\n", Status, SendLength));
+    (*BytesSent) = 0;
 
-    /* Keep this request around ... there was no data yet */
-    if (Status == STATUS_PENDING)
+    /* lwIP only takes a few segments per call so that the core lock isn't held for long.
+     * Keep feeding it until it has all of the data or runs out of send buffer */
+    do
     {
-        /* Freed in TCPSocketState */
-        Bucket = ExAllocateFromNPagedLookasideList(&TdiBucketLookasideList);
-        if (!Bucket)
+        Length = SendLength - (*BytesSent);
+        if (Length > 0xFFFF)
+            Length = 0xFFFF;
+
+        LibTCPLockCore();
+
+        Status = TCPTranslateError(LibTCPSend(Connection,
+                                              BufferData + (*BytesSent),
+                                              (u16_t)Length,
+                                              &Sent,
+                                              FALSE));
+
+        TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Send: %x, %d\n", Status, Sent));
+
+        /* Keep this request around ... there was no data yet. This is queued before we
+         * leave the core so a send event can't come in between and miss it */
+        if (Status == STATUS_PENDING && (*BytesSent) == 0)
         {
+            /* Freed in TCPSocketState */
+            Bucket = ExAllocateFromNPagedLookasideList(&TdiBucketLookasideList);
+            if (!Bucket)
+            {
+                LibTCPUnlockCore();
+                TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Failed to allocate bucket\n"));
+                return STATUS_NO_MEMORY;
+            }
+
+            Bucket->Request.RequestNotifyObject = Complete;
+            Bucket->Request.RequestContext = Context;
+
+            LockObject(Connection, &OldIrql);
+            InsertTailList( &Connection->SendRequest, &Bucket->Entry );
             UnlockObject(Connection, OldIrql);
-            TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Failed to allocate bucket\n"));
-            return STATUS_NO_MEMORY;
+            TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Queued write irp\n"));
         }
-        
-        Bucket->Request.RequestNotifyObject = Complete;
-        Bucket->Request.RequestContext = Context;
-        
-        InsertTailList( &Connection->SendRequest, &Bucket->Entry );
-        TI_DbgPrint(DEBUG_TCP,("[IP, TCPSendData] Queued write irp\n"));
-    }
 
-    UnlockObject(Connection, OldIrql);
+        LibTCPUnlockCore();
+
+        if (Status != STATUS_SUCCESS)
+            break;
+
+        (*BytesSent) += Sent;
+    } while ((*BytesSent) < SendLength);
+
+    /* A partial send still succeeds, the caller sends the rest later */
+    if ((*BytesSent) != 0)
+        Status = STATUS_SUCCESS;
 
     TI_DbgPrint(DEBUG_TCP, ("[IP, TCPSendData] Leaving. Status = %x\n", Status));
 
@@ -15,6 +15,7 @@ PORT_SET UDPPorts;
 
 NTSTATUS AddUDPHeaderIPv4(
     PADDRESS_FILE AddrFile,
+    PIP_INTERFACE Interface,
     PIP_ADDRESS RemoteAddress,
     USHORT RemotePort,
     PIP_ADDRESS LocalAddress,
@@ -26,6 +27,7 @@ NTSTATUS AddUDPHeaderIPv4(
  * FUNCTION: Adds an IPv4 and UDP header to an IP packet
  * ARGUMENTS:
  *     SendRequest  = Pointer to send request
+ *     Interface    = Pointer to the interface the datagram leaves on
  *     LocalAddress = Pointer to our local address
  *     LocalPort    = The port we send this datagram from
  *     IPPacket     = Pointer to IP packet
@@ -35,6 +37,7 @@ NTSTATUS AddUDPHeaderIPv4(
 {
     PUDP_HEADER UDPHeader;
     NTSTATUS Status;
+    NDIS_TCP_IP_CHECKSUM_PACKET_INFO ChecksumInfo;
 
     TI_DbgPrint(MID_TRACE, ("Packet: %x NdisPacket %x\n",
 			    IPPacket, IPPacket->NdisPacket));
@@ -61,10 +64,23 @@ NTSTATUS AddUDPHeaderIPv4(
 
     RtlCopyMemory(IPPacket->Data, Data, DataLength);
 
-    UDPHeader->Checksum = UDPv4ChecksumCalculate((PIPv4_HEADER)IPPacket->Header,
-                                                 (PUCHAR)UDPHeader,
-                                                 DataLength + sizeof(UDP_HEADER));
-    UDPHeader->Checksum = WH2N(UDPHeader->Checksum);
+    /* Fragments can't be checksummed one by one, so only offload whole datagrams */
+    if ((Interface->OffloadFlags & IP_OFFLOAD_UDP_CHECKSUM) &&
+        IPPacket->TotalSize <= Interface->MTU)
+    {
+        ChecksumInfo.Value = 0;
+        ChecksumInfo.Transmit.NdisPacketChecksumV4 = 1;
+        ChecksumInfo.Transmit.NdisPacketUdpChecksum = 1;
+        NDIS_PER_PACKET_INFO_FROM_PACKET(IPPacket->NdisPacket,
+                                         TcpIpChecksumPacketInfo) = (PVOID)(ULONG_PTR)ChecksumInfo.Value;
+    }
+    else
+    {
+        UDPHeader->Checksum = UDPv4ChecksumCalculate((PIPv4_HEADER)IPPacket->Header,
+                                                     (PUCHAR)UDPHeader,
+                                                     DataLength + sizeof(UDP_HEADER));
+        UDPHeader->Checksum = WH2N(UDPHeader->Checksum);
+    }
 
     TI_DbgPrint(MID_TRACE, ("Packet: %d ip %d udp %d payload\n",
 			    (PCHAR)UDPHeader - (PCHAR)IPPacket->Header,
@@ -77,6 +93,7 @@ NTSTATUS AddUDPHeaderIPv4(
 
 NTSTATUS BuildUDPPacket(
     PADDRESS_FILE AddrFile,
+    PIP_INTERFACE Interface,
     PIP_PACKET Packet,
     PIP_ADDRESS RemoteAddress,
     USHORT RemotePort,
@@ -88,6 +105,7 @@ NTSTATUS BuildUDPPacket(
  * FUNCTION: Builds an UDP packet
  * ARGUMENTS:
  *     Context      = Pointer to context information (DATAGRAM_SEND_REQUEST)
+ *     Interface    = Pointer to the interface the datagram leaves on
  *     LocalAddress = Pointer to our local address
  *     LocalPort    = The port we send this datagram from
  *     IPPacket     = Address of pointer to IP packet
@@ -121,7 +139,7 @@ NTSTATUS BuildUDPPacket(
 
     switch (RemoteAddress->Type) {
         case IP_ADDRESS_V4:
-            Status = AddUDPHeaderIPv4(AddrFile, RemoteAddress, RemotePort,
+            Status = AddUDPHeaderIPv4(AddrFile, Interface, RemoteAddress, RemotePort,
                                       LocalAddress, LocalPort, Packet, DataBuffer, DataLen);
             break;
         case IP_ADDRESS_V6:
@@ -215,6 +233,7 @@ NTSTATUS UDPSendDatagram(
     }
 
     Status = BuildUDPPacket( AddrFile,
+							 NCE->Interface,
 							 &Packet,
 							 &RemoteAddress,
 							 RemotePort,
@@ -279,14 +298,17 @@ VOID UDPReceive(PIP_INTERFACE Interface, PIP_PACKET IPPacket)
 
   UDPHeader = (PUDP_HEADER)IPPacket->Data;
 
-  /* Calculate and validate UDP checksum */
-  i = UDPv4ChecksumCalculate(IPv4Header,
-                             (PUCHAR)UDPHeader,
-                             WH2N(UDPHeader->Length));
-  if (i != DH2N(0x0000FFFF) && UDPHeader->Checksum != 0)
+  /* Calculate and validate UDP checksum, unless the adapter already did */
+  if (!(IPPacket->Flags & IP_PACKET_FLAG_CHECKSUM_OK))
   {
-      TI_DbgPrint(MIN_TRACE, ("Bad checksum on packet received.\n"));
-      return;
+      i = UDPv4ChecksumCalculate(IPv4Header,
+                                 (PUCHAR)UDPHeader,
+                                 WH2N(UDPHeader->Length));
+      if (i != DH2N(0x0000FFFF) && UDPHeader->Checksum != 0)
+      {
+          TI_DbgPrint(MIN_TRACE, ("Bad checksum on packet received.\n"));
+          return;
+      }
   }
 
   /* Sanity checks */
@@ -104,7 +104,16 @@ tcp_timer_needed(void)
   if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs)) {
     /* enable and start timer */
     tcpip_tcp_timer_active = 1;
+#if LWIP_TCPIP_CORE_LOCKING && LWIP_TCPIP_TIMEOUT
+    /* With core locking we may be running in any thread, but the timeout
+       list is only walked by tcpip_thread: let it insert the timer itself
+       (and recompute how long it sleeps). */
+    if (tcpip_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL) != ERR_OK) {
+      tcpip_tcp_timer_active = 0;
+    }
+#else /* LWIP_TCPIP_CORE_LOCKING && LWIP_TCPIP_TIMEOUT */
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
+#endif /* LWIP_TCPIP_CORE_LOCKING && LWIP_TCPIP_TIMEOUT */
   }
 }
 #endif /* LWIP_TCP */
@@ -15,6 +15,18 @@ typedef struct _sys_mbox_t
     int Valid;
 } sys_mbox_t;
 
+/* The core lock is taken by callers running at DISPATCH_LEVEL with their
+ * own spinlocks held, so it has to be a spinlock. It's recursive because
+ * raw API callbacks may call back into the core */
+typedef struct _sys_mutex_t
+{
+    KSPIN_LOCK Lock;
+    KIRQL OldIrql;
+    PKTHREAD Owner;
+    ULONG RecursionCount;
+    int Valid;
+} sys_mutex_t;
+
 typedef KIRQL sys_prot_t;
 
 typedef u32_t sys_thread_t;
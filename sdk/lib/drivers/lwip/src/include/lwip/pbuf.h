@@ -75,6 +75,8 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+/** indicates the network adapter already verified this pbuf's TCP checksum */
+#define PBUF_FLAG_CSUM_OK   0x40U
 
 struct pbuf {
   /** next pbuf in singly linked pbuf chain */
@@ -10,7 +10,7 @@
 
 /* Define LWIP_COMPAT_MUTEX if the port has no mutexes and binary semaphores
  should be used instead */
-#define LWIP_COMPAT_MUTEX               1
+#define LWIP_COMPAT_MUTEX               0
 
 #define MEM_ALIGNMENT                   4
 
@@ -80,6 +80,11 @@
 
 #define LWIP_NETIF_API                  1
 
+/* Raw API calls run in the caller's context under the core lock instead
+ * of being queued to the tcpip thread, which is left with incoming packets
+ * and timers */
+#define LWIP_TCPIP_CORE_LOCKING         1
+
 #define LWIP_SOCKET                     0
 
 #define LWIP_NETCONN                    0
@@ -8,7 +8,6 @@
 
 #ifndef LWIP_TAG
     #define LWIP_TAG         'PIwl'
-    #define LWIP_MESSAGE_TAG 'sMwl'
     #define LWIP_QUEUE_TAG   'uQwl'
 #endif
 
@@ -21,11 +20,9 @@ typedef struct _QUEUE_ENTRY
     LIST_ENTRY ListEntry;
 } QUEUE_ENTRY, *PQUEUE_ENTRY;
 
+/* Arguments of a raw API call made under the core lock */
 struct lwip_callback_msg
 {
-    /* Synchronization */
-    KEVENT Event;
-    
     /* Input */
     union {
         struct {
@@ -98,6 +95,8 @@ extern void TCPFinEventHandler(void *arg, const err_t err);
 extern void TCPRecvEventHandler(void *arg);
 
 /* TCP functions */
+void        LibTCPLockCore(void);
+void        LibTCPUnlockCore(void);
 PTCP_PCB    LibTCPSocket(void *arg);
 err_t       LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port);
 PTCP_PCB    LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog);
@@ -112,7 +111,7 @@ void        LibTCPAccept(PTCP_PCB pcb, struct tcp_pcb *listen_pcb, void *arg);
 void        LibTCPSetNoDelay(PTCP_PCB pcb, BOOLEAN Set);
 
 /* IP functions */
-void LibIPInsertPacket(void *ifarg, const void *const data, const u32_t size);
+void LibIPInsertPacket(void *ifarg, const void *const data, const u32_t size, const u8_t checksum_ok);
 void LibIPInitialize(void);
 void LibIPShutdown(void);
 
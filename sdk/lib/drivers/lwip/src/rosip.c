@@ -11,7 +11,8 @@ typedef struct netif* PNETIF;
 void
 LibIPInsertPacket(void *ifarg,
                   const void *const data,
-                  const u32_t size)
+                  const u32_t size,
+                  const u8_t checksum_ok)
 {
     struct pbuf *p;
 
@@ -27,6 +28,9 @@ LibIPInsertPacket(void *ifarg,
 
         RtlCopyMemory(p->payload, data, p->len);
 
+        if (checksum_ok)
+            p->flags |= PBUF_FLAG_CSUM_OK;
+
         ((PNETIF)ifarg)->input(p, (PNETIF)ifarg);
     }
 }
@@ -20,16 +20,20 @@ static const char * const tcp_state_str[] = {
   "TIME_WAIT"
 };
 
-/* The way that lwIP does multi-threading is really not ideal for our purposes but
- * we best go along with it unless we want another unstable TCP library. lwIP uses
- * a thread called the "tcpip thread" which is the only one allowed to call raw API
- * functions. Since this is the case, for each of our LibTCP* functions, we queue a request
- * for a callback to "tcpip thread" which calls our LibTCP*Callback functions. Yes, this is
- * a lot of unnecessary thread swapping and it could definitely be faster, but I don't want
- * to going messing around in lwIP because I have no desire to create another mess like oskittcp */
+/* lwIP's raw API may only be called by one thread at a time. We used to queue every
+ * LibTCP* request to the "tcpip thread" and wait for it to run our LibTCP*Callback
+ * function, which cost two context switches per send. lwIP's PCB lists, timers and
+ * pools are global so the core can't be split per connection or per CPU, but it can
+ * be entered from any thread that holds the core lock (LWIP_TCPIP_CORE_LOCKING).
+ * Our LibTCP* functions now run their callbacks right in the caller's context under
+ * that lock. The tcpip thread is left with incoming packets and the timers */
+
+/* Every send copies its data and builds its segments at DISPATCH_LEVEL while holding
+ * the core lock, which any other processor entering lwIP spins on. Copy at most this
+ * much per acquisition so the hold time stays at a few segments' worth of work */
+#define LIBTCP_MAX_SEND_LENGTH (4 * TCP_MSS)
 
 extern KEVENT TerminationEvent;
-extern NPAGED_LOOKASIDE_LIST MessageLookasideList;
 extern NPAGED_LOOKASIDE_LIST QueueEntryLookasideList;
 
 /* Required for ERR_T to NTSTATUS translation in receive error handling */
@@ -64,7 +68,7 @@ LibTCPEmptyQueue(PCONNECTION_ENDPOINT Connection)
         Entry = RemoveHeadList(&Connection->PacketQueue);
         qp = CONTAINING_RECORD(Entry, QUEUE_ENTRY, ListEntry);
 
-        /* We're in the tcpip thread here so this is safe */
+        /* We hold the core lock here so this is safe */
         pbuf_free(qp->p);
 
         ExFreeToNPagedLookasideList(&QueueEntryLookasideList, qp);
@@ -146,7 +150,9 @@ NTSTATUS LibTCPGetDataFromConnectionQueue(PCONNECTION_ENDPOINT Connection, PUCHA
 
             if (qp != NULL)
             {
-                /* Use this special pbuf free callback function because we're outside tcpip thread */
+                /* Use this special pbuf free callback function because we're outside the core
+                 * and taking its lock here, under the connection lock, would invert the order
+                 * our event handlers use */
                 pbuf_free_callback(qp->p);
 
                 ExFreeToNPagedLookasideList(&QueueEntryLookasideList, qp);
@@ -177,29 +183,42 @@ NTSTATUS LibTCPGetDataFromConnectionQueue(PCONNECTION_ENDPOINT Connection, PUCHA
     return Status;
 }
 
+/* The core lock is the outermost lock of the TCP code. Our event handlers run under it
+ * and take connection and then address file locks, so anyone entering the core from
+ * outside must take it before any of those, never while holding them */
+void
+LibTCPLockCore(void)
+{
+    LOCK_TCPIP_CORE();
+}
+
+void
+LibTCPUnlockCore(void)
+{
+    UNLOCK_TCPIP_CORE();
+}
+
 static
 BOOLEAN
-WaitForEventSafely(PRKEVENT Event)
+LibTCPCall(void (*Function)(void *arg), struct lwip_callback_msg *msg, const int safe)
 {
-    PVOID WaitObjects[] = {Event, &TerminationEvent};
-
-    if (KeWaitForMultipleObjects(2,
-                                 WaitObjects,
-                                 WaitAny,
-                                 Executive,
-                                 KernelMode,
-                                 FALSE,
-                                 NULL,
-                                 NULL) == STATUS_WAIT_0)
+    /* Don't enter the core once it's being torn down */
+    if (KeReadStateEvent(&TerminationEvent))
+        return FALSE;
+
+    if (safe)
     {
-        /* Signalled by the caller's event */
-        return TRUE;
+        /* We're called from a raw API callback so we already own the core */
+        Function(msg);
     }
-    else /* if KeWaitForMultipleObjects() == STATUS_WAIT_1 */
+    else
     {
-        /* Signalled by our termination event */
-        return FALSE;
+        LOCK_TCPIP_CORE();
+        Function(msg);
+        UNLOCK_TCPIP_CORE();
     }
+
+    return TRUE;
 }
 
 static
@@ -334,32 +353,17 @@ LibTCPSocketCallback(void *arg)
         tcp_arg(msg->Output.Socket.NewPcb, msg->Input.Socket.Arg);
         tcp_err(msg->Output.Socket.NewPcb, InternalErrorEventHandler);
     }
-
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 struct tcp_pcb *
 LibTCPSocket(void *arg)
 {
-    struct lwip_callback_msg *msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    struct tcp_pcb *ret;
-
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-        msg->Input.Socket.Arg = arg;
-
-        tcpip_callback_with_block(LibTCPSocketCallback, msg, 1);
+    struct lwip_callback_msg msg;
 
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Socket.NewPcb;
-        else
-            ret = NULL;
+    msg.Input.Socket.Arg = arg;
 
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
-
-        return ret;
-    }
+    if (LibTCPCall(LibTCPSocketCallback, &msg, FALSE))
+        return msg.Output.Socket.NewPcb;
 
     return NULL;
 }
@@ -376,7 +380,7 @@ LibTCPBindCallback(void *arg)
     if (!msg->Input.Bind.Connection->SocketContext)
     {
         msg->Output.Bind.Error = ERR_CLSD;
-        goto done;
+        return;
     }
 
     /* We're guaranteed that the local address is valid to bind at this point */
@@ -385,38 +389,21 @@ LibTCPBindCallback(void *arg)
     msg->Output.Bind.Error = tcp_bind(pcb,
                                       msg->Input.Bind.IpAddress,
                                       ntohs(msg->Input.Bind.Port));
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
 LibTCPBind(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port)
 {
-    struct lwip_callback_msg *msg;
-    err_t ret;
-
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-        msg->Input.Bind.Connection = Connection;
-        msg->Input.Bind.IpAddress = ipaddr;
-        msg->Input.Bind.Port = port;
-
-        tcpip_callback_with_block(LibTCPBindCallback, msg, 1);
+    struct lwip_callback_msg msg;
 
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Bind.Error;
-        else
-            ret = ERR_CLSD;
-
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
+    msg.Input.Bind.Connection = Connection;
+    msg.Input.Bind.IpAddress = ipaddr;
+    msg.Input.Bind.Port = port;
 
-        return ret;
-    }
+    if (LibTCPCall(LibTCPBindCallback, &msg, FALSE))
+        return msg.Output.Bind.Error;
 
-    return ERR_MEM;
+    return ERR_CLSD;
 }
 
 static
@@ -430,7 +417,7 @@ LibTCPListenCallback(void *arg)
     if (!msg->Input.Listen.Connection->SocketContext)
     {
         msg->Output.Listen.NewPcb = NULL;
-        goto done;
+        return;
     }
 
     msg->Output.Listen.NewPcb = tcp_listen_with_backlog((PTCP_PCB)msg->Input.Listen.Connection->SocketContext, msg->Input.Listen.Backlog);
@@ -439,35 +426,18 @@ LibTCPListenCallback(void *arg)
     {
         tcp_accept(msg->Output.Listen.NewPcb, InternalAcceptEventHandler);
     }
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 PTCP_PCB
 LibTCPListen(PCONNECTION_ENDPOINT Connection, const u8_t backlog)
 {
-    struct lwip_callback_msg *msg;
-    PTCP_PCB ret;
+    struct lwip_callback_msg msg;
 
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-        msg->Input.Listen.Connection = Connection;
-        msg->Input.Listen.Backlog = backlog;
+    msg.Input.Listen.Connection = Connection;
+    msg.Input.Listen.Backlog = backlog;
 
-        tcpip_callback_with_block(LibTCPListenCallback, msg, 1);
-
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Listen.NewPcb;
-        else
-            ret = NULL;
-
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
-
-        return ret;
-    }
+    if (LibTCPCall(LibTCPListenCallback, &msg, FALSE))
+        return msg.Output.Listen.NewPcb;
 
     return NULL;
 }
@@ -486,22 +456,28 @@ LibTCPSendCallback(void *arg)
     if (!msg->Input.Send.Connection->SocketContext)
     {
         msg->Output.Send.Error = ERR_CLSD;
-        goto done;
+        return;
     }
 
     if (msg->Input.Send.Connection->SendShutdown)
     {
         msg->Output.Send.Error = ERR_CLSD;
-        goto done;
+        return;
     }
 
     SendFlags = TCP_WRITE_FLAG_COPY;
     SendLength = msg->Input.Send.DataLength;
+    if (SendLength > LIBTCP_MAX_SEND_LENGTH)
+    {
+        /* Don't hold up the other processors for long, TCPSendData comes back for the rest */
+        SendLength = LIBTCP_MAX_SEND_LENGTH;
+        SendFlags |= TCP_WRITE_FLAG_MORE;
+    }
     if (tcp_sndbuf(pcb) == 0)
     {
         /* No buffer space so return pending */
         msg->Output.Send.Error = ERR_INPROGRESS;
-        goto done;
+        return;
     }
     else if (tcp_sndbuf(pcb) < SendLength)
     {
@@ -527,46 +503,29 @@ LibTCPSendCallback(void *arg)
         /* The queue is too long */
         msg->Output.Send.Error = ERR_INPROGRESS;
     }
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
 LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
 {
+    struct lwip_callback_msg msg;
     err_t ret;
-    struct lwip_callback_msg *msg;
 
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-        msg->Input.Send.Connection = Connection;
-        msg->Input.Send.Data = dataptr;
-        msg->Input.Send.DataLength = len;
-
-        if (safe)
-            LibTCPSendCallback(msg);
-        else
-            tcpip_callback_with_block(LibTCPSendCallback, msg, 1);
-
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Send.Error;
-        else
-            ret = ERR_CLSD;
+    msg.Input.Send.Connection = Connection;
+    msg.Input.Send.Data = dataptr;
+    msg.Input.Send.DataLength = len;
 
-        if (ret == ERR_OK)
-            *sent = msg->Output.Send.Information;
-        else
-            *sent = 0;
-
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
+    if (LibTCPCall(LibTCPSendCallback, &msg, safe))
+        ret = msg.Output.Send.Error;
+    else
+        ret = ERR_CLSD;
 
-        return ret;
-    }
+    if (ret == ERR_OK)
+        *sent = msg.Output.Send.Information;
+    else
+        *sent = 0;
 
-    return ERR_MEM;
+    return ret;
 }
 
 static
@@ -581,7 +540,7 @@ LibTCPConnectCallback(void *arg)
     if (!msg->Input.Connect.Connection->SocketContext)
     {
         msg->Output.Connect.Error = ERR_CLSD;
-        goto done;
+        return;
     }
 
     tcp_recv((PTCP_PCB)msg->Input.Connect.Connection->SocketContext, InternalRecvEventHandler);
@@ -592,40 +551,21 @@ LibTCPConnectCallback(void *arg)
                         InternalConnectEventHandler);
 
     msg->Output.Connect.Error = Error == ERR_OK ? ERR_INPROGRESS : Error;
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
 LibTCPConnect(PCONNECTION_ENDPOINT Connection, struct ip_addr *const ipaddr, const u16_t port)
 {
-    struct lwip_callback_msg *msg;
-    err_t ret;
-
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-        msg->Input.Connect.Connection = Connection;
-        msg->Input.Connect.IpAddress = ipaddr;
-        msg->Input.Connect.Port = port;
-
-        tcpip_callback_with_block(LibTCPConnectCallback, msg, 1);
+    struct lwip_callback_msg msg;
 
-        if (WaitForEventSafely(&msg->Event))
-        {
-            ret = msg->Output.Connect.Error;
-        }
-        else
-            ret = ERR_CLSD;
+    msg.Input.Connect.Connection = Connection;
+    msg.Input.Connect.IpAddress = ipaddr;
+    msg.Input.Connect.Port = port;
 
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
-
-        return ret;
-    }
+    if (LibTCPCall(LibTCPConnectCallback, &msg, FALSE))
+        return msg.Output.Connect.Error;
 
-    return ERR_MEM;
+    return ERR_CLSD;
 }
 
 static
@@ -638,7 +578,7 @@ LibTCPShutdownCallback(void *arg)
     if (!msg->Input.Shutdown.Connection->SocketContext)
     {
         msg->Output.Shutdown.Error = ERR_CLSD;
-        goto done;
+        return;
     }
 
     /* LwIP makes the (questionable) assumption that SHUTDOWN_RDWR is equivalent to tcp_close().
@@ -674,39 +614,21 @@ LibTCPShutdownCallback(void *arg)
             TCPFinEventHandler(msg->Input.Shutdown.Connection, ERR_CLSD);
         }
     }
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
 LibTCPShutdown(PCONNECTION_ENDPOINT Connection, const int shut_rx, const int shut_tx)
 {
-    struct lwip_callback_msg *msg;
-    err_t ret;
-
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
-
-        msg->Input.Shutdown.Connection = Connection;
-        msg->Input.Shutdown.shut_rx = shut_rx;
-        msg->Input.Shutdown.shut_tx = shut_tx;
+    struct lwip_callback_msg msg;
 
-        tcpip_callback_with_block(LibTCPShutdownCallback, msg, 1);
+    msg.Input.Shutdown.Connection = Connection;
+    msg.Input.Shutdown.shut_rx = shut_rx;
+    msg.Input.Shutdown.shut_tx = shut_tx;
 
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Shutdown.Error;
-        else
-            ret = ERR_CLSD;
-
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
+    if (LibTCPCall(LibTCPShutdownCallback, &msg, FALSE))
+        return msg.Output.Shutdown.Error;
 
-        return ret;
-    }
-
-    return ERR_MEM;
+    return ERR_CLSD;
 }
 
 static
@@ -723,7 +645,7 @@ LibTCPCloseCallback(void *arg)
     if (msg->Input.Close.Connection->Closing)
     {
         msg->Output.Close.Error = ERR_OK;
-        goto done;
+        return;
     }
 
     /* Enter "closing" mode if we're doing a normal close */
@@ -734,7 +656,7 @@ LibTCPCloseCallback(void *arg)
     if (!msg->Input.Close.Connection->SocketContext)
     {
         msg->Output.Close.Error = ERR_OK;
-        goto done;
+        return;
     }
 
     /* Clear the PCB pointer and stop callbacks */
@@ -755,41 +677,20 @@ LibTCPCloseCallback(void *arg)
     {
         TCPFinEventHandler(msg->Input.Close.Connection, ERR_CLSD);
     }
-
-done:
-    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
 }
 
 err_t
 LibTCPClose(PCONNECTION_ENDPOINT Connection, const int safe, const int callback)
 {
-    err_t ret;
-    struct lwip_callback_msg *msg;
-
-    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
-    if (msg)
-    {
-        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
+    struct lwip_callback_msg msg;
 
-        msg->Input.Close.Connection = Connection;
-        msg->Input.Close.Callback = callback;
-
-        if (safe)
-            LibTCPCloseCallback(msg);
-        else
-            tcpip_callback_with_block(LibTCPCloseCallback, msg, 1);
+    msg.Input.Close.Connection = Connection;
+    msg.Input.Close.Callback = callback;
 
-        if (WaitForEventSafely(&msg->Event))
-            ret = msg->Output.Close.Error;
-        else
-            ret = ERR_CLSD;
-
-        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
-
-        return ret;
-    }
+    if (LibTCPCall(LibTCPCloseCallback, &msg, safe))
+        return msg.Output.Close.Error;
 
-    return ERR_MEM;
+    return ERR_CLSD;
 }
 
 void
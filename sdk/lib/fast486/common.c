@@ -42,6 +42,9 @@ Fast486ReadMemory(PFAST486_STATE State,
 {
     ULONG LinearAddress;
     PFAST486_SEG_REG CachedDescriptor;
+#ifndef FAST486_NO_PREFETCH
+    PFAST486_CACHE_LINE Line;
+#endif
     FAST486_EXCEPTIONS Exception = SegmentReg != FAST486_REG_SS
                                    ? FAST486_EXCEPTION_GP : FAST486_EXCEPTION_SS;
 
@@ -111,44 +114,37 @@ Fast486ReadMemory(PFAST486_STATE State,
     LinearAddress = CachedDescriptor->Base + Offset;
 
 #ifndef FAST486_NO_PREFETCH
-    if (InstFetch && ((Offset + FAST486_CACHE_SIZE - 1) <= CachedDescriptor->Limit))
+    /*
+     * Fill the whole line. Lines are aligned, so they never cross a page
+     * boundary, but they have to be entirely inside the code segment.
+     */
+    if (InstFetch
+        && (CACHE_LINE_OFFSET(LinearAddress) + Size <= FAST486_CACHE_SIZE)
+        && (CACHE_LINE_ALIGN(LinearAddress) >= CachedDescriptor->Base)
+        && ((CACHE_LINE_ALIGN(LinearAddress) - CachedDescriptor->Base + FAST486_CACHE_SIZE - 1)
+            <= CachedDescriptor->Limit))
     {
-        State->PrefetchAddress = LinearAddress;
-
-        if ((State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
-            && (PAGE_OFFSET(State->PrefetchAddress) > (FAST486_PAGE_SIZE - FAST486_CACHE_SIZE)))
-        {
-            /* We mustn't prefetch across a page boundary */
-            State->PrefetchAddress = PAGE_ALIGN(State->PrefetchAddress)
-                                     | (FAST486_PAGE_SIZE - FAST486_CACHE_SIZE);
+        Line = GET_CACHE_LINE(State, LinearAddress);
 
-            if ((LinearAddress - State->PrefetchAddress + Size) >= FAST486_CACHE_SIZE)
-            {
-                /* We can't prefetch without possibly violating page permissions */
-                State->PrefetchValid = FALSE;
-                return Fast486ReadLinearMemory(State, LinearAddress, Buffer, Size, TRUE);
-            }
-        }
-
-        /* Prefetch */
-        if (Fast486ReadLinearMemory(State,
-                                    State->PrefetchAddress,
-                                    State->PrefetchCache,
-                                    FAST486_CACHE_SIZE,
-                                    TRUE))
-        {
-            State->PrefetchValid = TRUE;
+        /* Make sure a failed read doesn't leave a valid line behind */
+        Line->Generation = 0;
 
-            RtlMoveMemory(Buffer,
-                          &State->PrefetchCache[LinearAddress - State->PrefetchAddress],
-                          Size);
-            return TRUE;
-        }
-        else
+        if (!Fast486ReadLinearMemory(State,
+                                     CACHE_LINE_ALIGN(LinearAddress),
+                                     Line->Data,
+                                     FAST486_CACHE_SIZE,
+                                     TRUE))
         {
-            State->PrefetchValid = FALSE;
             return FALSE;
         }
+
+        Line->Address = CACHE_LINE_ALIGN(LinearAddress);
+        Line->Generation = State->PrefetchGeneration;
+
+        RtlMoveMemory(Buffer,
+                      &Line->Data[CACHE_LINE_OFFSET(LinearAddress)],
+                      Size);
+        return TRUE;
     }
     else
 #endif
@@ -230,18 +226,6 @@ Fast486WriteMemory(PFAST486_STATE State,
     /* Find the linear address */
     LinearAddress = CachedDescriptor->Base + Offset;
 
-#ifndef FAST486_NO_PREFETCH
-    if (State->PrefetchValid
-        && (LinearAddress >= State->PrefetchAddress)
-        && ((LinearAddress + Size) <= (State->PrefetchAddress + FAST486_CACHE_SIZE)))
-    {
-        /* Update the prefetch */
-        RtlMoveMemory(&State->PrefetchCache[LinearAddress - State->PrefetchAddress],
-                      Buffer,
-                      min(Size, FAST486_CACHE_SIZE + State->PrefetchAddress - LinearAddress));
-    }
-#endif
-
     /* Write to the linear address */
     return Fast486WriteLinearMemory(State, LinearAddress, Buffer, Size, TRUE);
 }
@@ -909,7 +893,7 @@ Fast486TaskSwitch(PFAST486_STATE State, FAST486_TASK_SWITCH_TYPE Type, USHORT Se
 
 #ifndef FAST486_NO_PREFETCH
     /* Context switching invalidates the prefetch */
-    State->PrefetchValid = FALSE;
+    Fast486FlushPrefetch(State);
 #endif
 
     /* Load the registers */
@@ -68,8 +68,10 @@ if (State->PrefixFlags & FAST486_PREFIX_LOCK)\
 #define PAGE_OFFSET(x)  ((x) & 0x00000FFF)
 #define GET_ADDR_PDE(x) ((x) >> 22)
 #define GET_ADDR_PTE(x) (((x) >> 12) & 0x3FF)
-#define INVALID_TLB_FIELD 0xFFFFFFFF
-#define NUM_TLB_ENTRIES 0x100000
+#define GET_TLB_ENTRY(s, x) (&(s)->Tlb[((x) >> 12) & (FAST486_TLB_ENTRIES - 1)])
+#define CACHE_LINE_ALIGN(x) ((x) & ~(FAST486_CACHE_SIZE - 1))
+#define CACHE_LINE_OFFSET(x) ((x) & (FAST486_CACHE_SIZE - 1))
+#define GET_CACHE_LINE(s, x) (&(s)->PrefetchCache[((x) / FAST486_CACHE_SIZE) & (FAST486_CACHE_LINES - 1)])
 
 typedef struct _FAST486_MOD_REG_RM
 {
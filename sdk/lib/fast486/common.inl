@@ -72,12 +72,19 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
     FAST486_PAGE_DIR DirectoryEntry;
     FAST486_PAGE_TABLE TableEntry;
     ULONG PageDirectory = State->ControlRegisters[FAST486_REG_CR3];
+    PFAST486_TLB_ENTRY TlbEntry = NULL;
 
-    if ((State->Tlb != NULL)
-        && (State->Tlb[VirtualAddress >> 12] != INVALID_TLB_FIELD))
+    if (State->Tlb != NULL)
     {
-        /* Return the cached entry */
-        return State->Tlb[VirtualAddress >> 12];
+        TlbEntry = GET_TLB_ENTRY(State, VirtualAddress);
+
+        if ((TlbEntry->Generation == State->TlbGeneration)
+            && (TlbEntry->Tag == (VirtualAddress >> 12)))
+        {
+            /* Return the cached entry, unless we have to set the dirty bit */
+            TableEntry.Value = TlbEntry->Value;
+            if (!MarkAsDirty || TableEntry.Dirty) return TableEntry.Value;
+        }
     }
 
     /* Read the directory entry */
@@ -134,11 +141,12 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
     TableEntry.Writeable &= DirectoryEntry.Writeable;
     TableEntry.Usermode &= DirectoryEntry.Usermode;
 
-    if (State->Tlb != NULL)
+    if (TlbEntry != NULL)
     {
         /* Set the TLB entry */
-        State->Tlb[VirtualAddress >> 12] = TableEntry.Value;
-        State->TlbEmpty = FALSE;
+        TlbEntry->Tag = VirtualAddress >> 12;
+        TlbEntry->Generation = State->TlbGeneration;
+        TlbEntry->Value = TableEntry.Value;
     }
 
     /* Return the table entry */
@@ -150,9 +158,72 @@ VOID
 FASTCALL
 Fast486FlushTlb(PFAST486_STATE State)
 {
-    if (!State->Tlb || State->TlbEmpty) return;
-    RtlFillMemory(State->Tlb, NUM_TLB_ENTRIES * sizeof(ULONG), 0xFF);
-    State->TlbEmpty = TRUE;
+    if (!State->Tlb) return;
+
+    /* Entries from older generations are invalid, so this flushes everything */
+    if (++State->TlbGeneration != 0) return;
+
+    /* The counter wrapped around, old entries could look valid again */
+    RtlZeroMemory(State->Tlb, FAST486_TLB_ENTRIES * sizeof(FAST486_TLB_ENTRY));
+    State->TlbGeneration = 1;
+}
+
+#ifndef FAST486_NO_PREFETCH
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486FlushPrefetch(PFAST486_STATE State)
+{
+    /* Lines from older generations are invalid, so this flushes everything */
+    if (++State->PrefetchGeneration != 0) return;
+
+    /* The counter wrapped around, old lines could look valid again */
+    RtlZeroMemory(State->PrefetchCache, sizeof(State->PrefetchCache));
+    State->PrefetchGeneration = 1;
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486InvalidatePrefetch(PFAST486_STATE State,
+                          ULONG LinearAddress,
+                          ULONG Size)
+{
+    PFAST486_CACHE_LINE Line;
+    ULONG Address = CACHE_LINE_ALIGN(LinearAddress);
+    ULONG Count = (CACHE_LINE_OFFSET(LinearAddress) + Size + FAST486_CACHE_SIZE - 1) / FAST486_CACHE_SIZE;
+
+    /* A big write would go over the whole cache anyway */
+    if (Count > FAST486_CACHE_LINES)
+    {
+        Fast486FlushPrefetch(State);
+        return;
+    }
+
+    /* Drop every line containing code that is being written to */
+    while (Count--)
+    {
+        Line = GET_CACHE_LINE(State, Address);
+        if (Line->Address == Address) Line->Generation = 0;
+        Address += FAST486_CACHE_SIZE;
+    }
+}
+
+#endif
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486InvalidateTlbEntry(PFAST486_STATE State, ULONG VirtualAddress)
+{
+    PFAST486_TLB_ENTRY TlbEntry;
+
+    if (!State->Tlb) return;
+
+    /* Generation zero is never current */
+    TlbEntry = GET_TLB_ENTRY(State, VirtualAddress);
+    if (TlbEntry->Tag == (VirtualAddress >> 12)) TlbEntry->Generation = 0;
 }
 
 FORCEINLINE
@@ -234,6 +305,11 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
                          ULONG Size,
                          BOOLEAN CheckPrivilege)
 {
+#ifndef FAST486_NO_PREFETCH
+    /* Self-modifying code must not run from stale cache lines */
+    Fast486InvalidatePrefetch(State, LinearAddress, Size);
+#endif
+
     /* Check if paging is enabled */
     if (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
     {
@@ -643,7 +719,7 @@ Fast486LoadSegmentInternal(PFAST486_STATE State,
 
 #ifndef FAST486_NO_PREFETCH
             /* Invalidate the prefetch */
-            State->PrefetchValid = FALSE;
+            Fast486FlushPrefetch(State);
 #endif
 
             if (!(Selector & SEGMENT_TABLE_INDICATOR) && GET_SEGMENT_INDEX(Selector) == 0)
@@ -863,6 +939,7 @@ Fast486FetchByte(PFAST486_STATE State,
     ULONG Offset;
 #ifndef FAST486_NO_PREFETCH
     ULONG LinearAddress;
+    PFAST486_CACHE_LINE Line;
 #endif
 
     /* Get the cached descriptor of CS */
@@ -873,11 +950,14 @@ Fast486FetchByte(PFAST486_STATE State,
 #ifndef FAST486_NO_PREFETCH
     LinearAddress = CachedDescriptor->Base + Offset;
 
-    if (State->PrefetchValid
-        && (LinearAddress >= State->PrefetchAddress)
-        && ((LinearAddress + sizeof(UCHAR)) <= (State->PrefetchAddress + FAST486_CACHE_SIZE)))
+    Line = GET_CACHE_LINE(State, LinearAddress);
+
+    if ((Line->Generation == State->PrefetchGeneration)
+        && (Line->Address == CACHE_LINE_ALIGN(LinearAddress))
+        && ((CACHE_LINE_OFFSET(LinearAddress) + sizeof(UCHAR)) <= FAST486_CACHE_SIZE)
+        && ((Offset + sizeof(UCHAR) - 1) <= CachedDescriptor->Limit))
     {
-        *Data = *(PUCHAR)&State->PrefetchCache[LinearAddress - State->PrefetchAddress];
+        *Data = *(PUCHAR)&Line->Data[CACHE_LINE_OFFSET(LinearAddress)];
     }
     else
 #endif
@@ -912,6 +992,7 @@ Fast486FetchWord(PFAST486_STATE State,
     ULONG Offset;
 #ifndef FAST486_NO_PREFETCH
     ULONG LinearAddress;
+    PFAST486_CACHE_LINE Line;
 #endif
 
     /* Get the cached descriptor of CS */
@@ -923,11 +1004,14 @@ Fast486FetchWord(PFAST486_STATE State,
 #ifndef FAST486_NO_PREFETCH
     LinearAddress = CachedDescriptor->Base + Offset;
 
-    if (State->PrefetchValid
-        && (LinearAddress >= State->PrefetchAddress)
-        && ((LinearAddress + sizeof(USHORT)) <= (State->PrefetchAddress + FAST486_CACHE_SIZE)))
+    Line = GET_CACHE_LINE(State, LinearAddress);
+
+    if ((Line->Generation == State->PrefetchGeneration)
+        && (Line->Address == CACHE_LINE_ALIGN(LinearAddress))
+        && ((CACHE_LINE_OFFSET(LinearAddress) + sizeof(USHORT)) <= FAST486_CACHE_SIZE)
+        && ((Offset + sizeof(USHORT) - 1) <= CachedDescriptor->Limit))
     {
-        *Data = *(PUSHORT)&State->PrefetchCache[LinearAddress - State->PrefetchAddress];
+        *Data = *(PUSHORT)&Line->Data[CACHE_LINE_OFFSET(LinearAddress)];
     }
     else
 #endif
@@ -963,6 +1047,7 @@ Fast486FetchDword(PFAST486_STATE State,
     ULONG Offset;
 #ifndef FAST486_NO_PREFETCH
     ULONG LinearAddress;
+    PFAST486_CACHE_LINE Line;
 #endif
 
     /* Get the cached descriptor of CS */
@@ -974,11 +1059,14 @@ Fast486FetchDword(PFAST486_STATE State,
 #ifndef FAST486_NO_PREFETCH
     LinearAddress = CachedDescriptor->Base + Offset;
 
-    if (State->PrefetchValid
-        && (LinearAddress >= State->PrefetchAddress)
-        && ((LinearAddress + sizeof(ULONG)) <= (State->PrefetchAddress + FAST486_CACHE_SIZE)))
+    Line = GET_CACHE_LINE(State, LinearAddress);
+
+    if ((Line->Generation == State->PrefetchGeneration)
+        && (Line->Address == CACHE_LINE_ALIGN(LinearAddress))
+        && ((CACHE_LINE_OFFSET(LinearAddress) + sizeof(ULONG)) <= FAST486_CACHE_SIZE)
+        && ((Offset + sizeof(ULONG) - 1) <= CachedDescriptor->Limit))
     {
-        *Data = *(PULONG)&State->PrefetchCache[LinearAddress - State->PrefetchAddress];
+        *Data = *(PULONG)&Line->Data[CACHE_LINE_OFFSET(LinearAddress)];
     }
     else
 #endif
@@ -108,7 +108,7 @@ Fast486Initialize(PFAST486_STATE         State,
                   FAST486_BOP_PROC       BopCallback,
                   FAST486_INT_ACK_PROC   IntAckCallback,
                   FAST486_FPU_PROC       FpuCallback,
-                  PULONG                 Tlb)
+                  PFAST486_TLB_ENTRY     Tlb)
 {
     /* Set the callbacks (or use default ones if some are NULL) */
     State->MemReadCallback  = (MemReadCallback  ? MemReadCallback  : Fast486MemReadCallback );
@@ -140,7 +140,7 @@ Fast486Reset(PFAST486_STATE State)
     FAST486_BOP_PROC       BopCallback      = State->BopCallback;
     FAST486_INT_ACK_PROC   IntAckCallback   = State->IntAckCallback;
     FAST486_FPU_PROC       FpuCallback      = State->FpuCallback;
-    PULONG                 Tlb              = State->Tlb;
+    PFAST486_TLB_ENTRY     Tlb              = State->Tlb;
 
     /* Clear the entire structure */
     RtlZeroMemory(State, sizeof(*State));
@@ -196,7 +196,13 @@ Fast486Reset(PFAST486_STATE State)
     State->FpuCallback      = FpuCallback;
     State->Tlb              = Tlb;
 
-    /* Flush the TLB */
+#ifndef FAST486_NO_PREFETCH
+    /* The prefetch cache was cleared with everything else */
+    State->PrefetchGeneration = 1;
+#endif
+
+    /* Flush the TLB, making sure that it really gets cleared */
+    State->TlbGeneration = MAXULONG;
     Fast486FlushTlb(State);
 }
 
@@ -256,7 +262,30 @@ Fast486Rewind(PFAST486_STATE State)
     State->InstPtr.Long = State->SavedInstPtr.Long;
 
 #ifndef FAST486_NO_PREFETCH
-    State->PrefetchValid = FALSE;
+    Fast486FlushPrefetch(State);
+#endif
+}
+
+VOID
+NTAPI
+Fast486InvalidateCache(PFAST486_STATE State, ULONG Address, ULONG Size)
+{
+    /* This is used when memory has been written to without going through the CPU */
+#ifndef FAST486_NO_PREFETCH
+    if (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
+    {
+        /* The cache is tagged with linear addresses, we can't tell which ones map here */
+        Fast486FlushPrefetch(State);
+    }
+    else
+    {
+        /* Without paging, linear addresses are physical addresses */
+        Fast486InvalidatePrefetch(State, Address, Size);
+    }
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Address);
+    UNREFERENCED_PARAMETER(Size);
 #endif
 }
 
@@ -4140,14 +4140,17 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeLdsLes)
                 return;
             }
 
-#ifndef FAST486_NO_PREFETCH
-            /* Invalidate the prefetch since BOP handlers can alter the memory */
-            State->PrefetchValid = FALSE;
-#endif
-
             /* Call the BOP handler */
             State->BopCallback(State, BopCode);
 
+#ifndef FAST486_NO_PREFETCH
+            /*
+             * Invalidate the prefetch since BOP handlers can alter the memory.
+             * Do it afterwards, they may also run guest code before writing.
+             */
+            Fast486FlushPrefetch(State);
+#endif
+
             /*
              * If an interrupt should occur at this time, delay it.
              * We must do this because if an interrupt begins and the BOP callback
@@ -2261,7 +2261,7 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeGroup0F01)
         {
 #ifndef FAST486_NO_PREFETCH
             /* Invalidate the prefetch */
-            State->PrefetchValid = FALSE;
+            Fast486FlushPrefetch(State);
 #endif
 
             /* This is a privileged instruction */
@@ -2278,11 +2278,8 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeGroup0F01)
                 return;
             }
 
-            if (State->Tlb != NULL)
-            {
-                /* Clear the TLB entry */
-                State->Tlb[ModRegRm.MemoryAddress >> 12] = INVALID_TLB_FIELD;
-            }
+            /* Clear the TLB entry */
+            Fast486InvalidateTlbEntry(State, ModRegRm.MemoryAddress);
 
             break;
         }
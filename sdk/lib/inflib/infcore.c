@@ -19,6 +19,10 @@
 /* actual string limit is MAX_INF_STRING_LENGTH+1 (plus terminating null) under Windows */
 #define MAX_STRING_LEN        (MAX_INF_STRING_LENGTH+1)
 
+#define INF_BLOCK_SIZE        (64 * 1024)
+#define INF_HASH_MIN_ENTRIES  16
+#define INF_ALIGN(x)          (((x) + sizeof(PVOID) - 1) & ~(ULONG)(sizeof(PVOID) - 1))
+
 
 /* parser definitions */
 
@@ -82,60 +86,192 @@ static const parser_state_func parser_funcs[NB_PARSER_STATES] =
 
 /* PRIVATE FUNCTIONS ********************************************************/
 
-static PINFCACHELINE
-InfpFreeLine (PINFCACHELINE Line)
+static PVOID
+InfpAllocate(PINFCACHE Cache,
+             ULONG Size)
 {
-  PINFCACHELINE Next;
-  PINFCACHEFIELD Field;
+  PINFCACHEBLOCK Block;
+  ULONG BlockSize;
+  PVOID Data;
 
-  if (Line == NULL)
+  Size = INF_ALIGN(Size);
+
+  Block = Cache->FirstBlock;
+  if (Block == NULL || Block->Size - Block->Used < Size)
     {
-      return NULL;
+      /* Start a new block, big items get one of their own */
+      BlockSize = INF_ALIGN(sizeof(INFCACHEBLOCK)) + Size;
+      if (BlockSize < INF_BLOCK_SIZE)
+        BlockSize = INF_BLOCK_SIZE;
+
+      Block = (PINFCACHEBLOCK)MALLOC(BlockSize);
+      if (Block == NULL)
+        {
+          DPRINT("MALLOC() failed\n");
+          return NULL;
+        }
+
+      Block->Size = BlockSize;
+      Block->Used = INF_ALIGN(sizeof(INFCACHEBLOCK));
+      Block->Next = Cache->FirstBlock;
+      Cache->FirstBlock = Block;
     }
 
-  Next = Line->Next;
-  if (Line->Key != NULL)
+  Data = (PUCHAR)Block + Block->Used;
+  Block->Used += Size;
+  ZEROMEMORY(Data, Size);
+
+  return Data;
+}
+
+
+static ULONG
+InfpHashName(PCWSTR Name)
+{
+  ULONG Hash = 0;
+
+  /* Must match strcmpiW, which compares lower case characters */
+  while (*Name != 0)
+    {
+      Hash = Hash * 37 + tolowerW(*Name);
+      Name++;
+    }
+
+  return Hash;
+}
+
+
+static ULONG
+InfpGetHashSize(LONG Count)
+{
+  ULONG Size = INF_HASH_MIN_ENTRIES;
+
+  /* Keep the chains short, the size must be a power of two */
+  while (Size < (ULONG)Count)
+    Size *= 2;
+
+  return Size;
+}
+
+
+static VOID
+InfpBuildSectionIndex(PINFCACHE Cache)
+{
+  PINFCACHESECTION *Table;
+  PINFCACHESECTION Section;
+  ULONG Size, Index;
+
+  Size = InfpGetHashSize(Cache->SectionCount);
+  Table = (PINFCACHESECTION *)MALLOC(Size * sizeof(PINFCACHESECTION));
+  if (Table == NULL)
     {
-      FREE (Line->Key);
-      Line->Key = NULL;
+      /* Lookups will use the old index or the list */
+      DPRINT("MALLOC() failed\n");
+      return;
     }
+  ZEROMEMORY(Table, Size * sizeof(PINFCACHESECTION));
 
-  /* Remove data fields */
-  while (Line->FirstField != NULL)
+  for (Section = Cache->FirstSection; Section != NULL; Section = Section->Next)
     {
-      Field = Line->FirstField->Next;
-      FREE (Line->FirstField);
-      Line->FirstField = Field;
+      Index = Section->NameHash & (Size - 1);
+      Section->HashNext = Table[Index];
+      Table[Index] = Section;
+    }
+
+  if (Cache->SectionHashTable != NULL)
+    FREE(Cache->SectionHashTable);
+
+  Cache->SectionHashTable = Table;
+  Cache->SectionHashSize = Size;
+}
+
+
+static VOID
+InfpBuildKeyIndex(PINFCACHESECTION Section)
+{
+  PINFCACHELINE *Table;
+  PINFCACHELINE Line;
+  ULONG Size, Index;
+
+  Size = InfpGetHashSize(Section->KeyCount);
+  Table = (PINFCACHELINE *)MALLOC(Size * sizeof(PINFCACHELINE));
+  if (Table == NULL)
+    {
+      /* Lookups will use the old index or the list */
+      DPRINT("MALLOC() failed\n");
+      return;
     }
-  Line->LastField = NULL;
+  ZEROMEMORY(Table, Size * sizeof(PINFCACHELINE));
 
-  FREE (Line);
+  /* Keys can be duplicated, go backwards so that chains stay in line order */
+  for (Line = Section->LastLine; Line != NULL; Line = Line->Prev)
+    {
+      if (Line->Key == NULL)
+        continue;
 
-  return Next;
+      Index = Line->KeyHash & (Size - 1);
+      Line->HashNext = Table[Index];
+      Table[Index] = Line;
+    }
+
+  if (Section->KeyHashTable != NULL)
+    FREE(Section->KeyHashTable);
+
+  Section->KeyHashTable = Table;
+  Section->KeyHashSize = Size;
 }
 
 
 PINFCACHESECTION
 InfpFreeSection (PINFCACHESECTION Section)
 {
-  PINFCACHESECTION Next;
-
   if (Section == NULL)
     {
       return NULL;
     }
 
-  /* Release all keys */
-  Next = Section->Next;
-  while (Section->FirstLine != NULL)
+  /* Lines live in the cache blocks, only the index is ours */
+  if (Section->KeyHashTable != NULL)
     {
-      Section->FirstLine = InfpFreeLine (Section->FirstLine);
+      FREE (Section->KeyHashTable);
+      Section->KeyHashTable = NULL;
     }
-  Section->LastLine = NULL;
 
-  FREE (Section);
+  return Section->Next;
+}
+
 
-  return Next;
+VOID
+InfpFreeCache(PINFCACHE Cache)
+{
+  PINFCACHEBLOCK Block;
+
+  if (Cache == NULL)
+    {
+      return;
+    }
+
+  /* Release all sections */
+  while (Cache->FirstSection != NULL)
+    {
+      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
+    }
+  Cache->LastSection = NULL;
+
+  if (Cache->SectionHashTable != NULL)
+    {
+      FREE(Cache->SectionHashTable);
+    }
+
+  /* And the memory they were using */
+  while (Cache->FirstBlock != NULL)
+    {
+      Block = Cache->FirstBlock->Next;
+      FREE(Cache->FirstBlock);
+      Cache->FirstBlock = Block;
+    }
+
+  FREE(Cache);
 }
 
 
@@ -144,12 +280,38 @@ InfpFindSection(PINFCACHE Cache,
                 PCWSTR Name)
 {
   PINFCACHESECTION Section = NULL;
+  ULONG Hash;
 
   if (Cache == NULL || Name == NULL)
     {
       return NULL;
     }
 
+  /* Index big files on the first lookup, and grow the index along with them */
+  if (Cache->SectionHashTable == NULL ?
+      Cache->SectionCount > INF_HASH_MIN_ENTRIES :
+      (ULONG)Cache->SectionCount > 2 * Cache->SectionHashSize)
+    {
+      InfpBuildSectionIndex(Cache);
+    }
+
+  if (Cache->SectionHashTable != NULL)
+    {
+      Hash = InfpHashName(Name);
+      Section = Cache->SectionHashTable[Hash & (Cache->SectionHashSize - 1)];
+      while (Section != NULL)
+        {
+          if (Section->NameHash == Hash && strcmpiW(Section->Name, Name) == 0)
+            {
+              return Section;
+            }
+
+          Section = Section->HashNext;
+        }
+
+      return NULL;
+    }
+
   /* iterate through list of sections */
   Section = Cache->FirstSection;
   while (Section != NULL)
@@ -172,7 +334,7 @@ InfpAddSection(PINFCACHE Cache,
                PCWSTR Name)
 {
   PINFCACHESECTION Section = NULL;
-  ULONG Size;
+  ULONG Size, Index;
 
   if (Cache == NULL || Name == NULL)
     {
@@ -183,17 +345,16 @@ InfpAddSection(PINFCACHE Cache,
   /* Allocate and initialize the new section */
   Size = (ULONG)FIELD_OFFSET(INFCACHESECTION,
                              Name[strlenW(Name) + 1]);
-  Section = (PINFCACHESECTION)MALLOC(Size);
+  Section = (PINFCACHESECTION)InfpAllocate(Cache, Size);
   if (Section == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
-  ZEROMEMORY (Section,
-              Size);
 
   /* Copy section name */
   strcpyW(Section->Name, Name);
+  Section->NameHash = InfpHashName(Name);
 
   /* Append section */
   if (Cache->FirstSection == NULL)
@@ -207,30 +368,38 @@ InfpAddSection(PINFCACHE Cache,
       Section->Prev = Cache->LastSection;
       Cache->LastSection = Section;
     }
+  Cache->SectionCount++;
+
+  /* Keep the index up to date once it's there */
+  if (Cache->SectionHashTable != NULL)
+    {
+      Index = Section->NameHash & (Cache->SectionHashSize - 1);
+      Section->HashNext = Cache->SectionHashTable[Index];
+      Cache->SectionHashTable[Index] = Section;
+    }
 
   return Section;
 }
 
 
 PINFCACHELINE
-InfpAddLine(PINFCACHESECTION Section)
+InfpAddLine(PINFCACHE Cache,
+            PINFCACHESECTION Section)
 {
   PINFCACHELINE Line;
 
-  if (Section == NULL)
+  if (Cache == NULL || Section == NULL)
     {
       DPRINT("Invalid parameter\n");
       return NULL;
     }
 
-  Line = (PINFCACHELINE)MALLOC(sizeof(INFCACHELINE));
+  Line = (PINFCACHELINE)InfpAllocate(Cache, sizeof(INFCACHELINE));
   if (Line == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
-  ZEROMEMORY(Line,
-             sizeof(INFCACHELINE));
 
   /* Append line */
   if (Section->FirstLine == NULL)
@@ -251,9 +420,13 @@ InfpAddLine(PINFCACHESECTION Section)
 
 
 PVOID
-InfpAddKeyToLine(PINFCACHELINE Line,
+InfpAddKeyToLine(PINFCACHE Cache,
+                 PINFCACHESECTION Section,
+                 PINFCACHELINE Line,
                  PCWSTR Key)
 {
+  PINFCACHELINE *Link;
+
   if (Line == NULL)
     {
       DPRINT1("Invalid Line\n");
@@ -266,21 +439,34 @@ InfpAddKeyToLine(PINFCACHELINE Line,
       return NULL;
     }
 
-  Line->Key = (PWCHAR)MALLOC((strlenW(Key) + 1) * sizeof(WCHAR));
+  Line->Key = (PWCHAR)InfpAllocate(Cache, (strlenW(Key) + 1) * sizeof(WCHAR));
   if (Line->Key == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
+      DPRINT1("InfpAllocate() failed\n");
       return NULL;
     }
 
   strcpyW(Line->Key, Key);
+  Line->KeyHash = InfpHashName(Key);
+  Section->KeyCount++;
+
+  /* Keep the index up to date once it's there. The line is the last one
+     of the section, so it goes to the end of its chain */
+  if (Section->KeyHashTable != NULL)
+    {
+      Link = &Section->KeyHashTable[Line->KeyHash & (Section->KeyHashSize - 1)];
+      while (*Link != NULL)
+        Link = &(*Link)->HashNext;
+      *Link = Line;
+    }
 
   return (PVOID)Line->Key;
 }
 
 
 PVOID
-InfpAddFieldToLine(PINFCACHELINE Line,
+InfpAddFieldToLine(PINFCACHE Cache,
+                   PINFCACHELINE Line,
                    PCWSTR Data)
 {
   PINFCACHEFIELD Field;
@@ -288,14 +474,12 @@ InfpAddFieldToLine(PINFCACHELINE Line,
 
   Size = (ULONG)FIELD_OFFSET(INFCACHEFIELD,
                              Data[strlenW(Data) + 1]);
-  Field = (PINFCACHEFIELD)MALLOC(Size);
+  Field = (PINFCACHEFIELD)InfpAllocate(Cache, Size);
   if (Field == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
+      DPRINT1("InfpAllocate() failed\n");
       return NULL;
     }
-  ZEROMEMORY (Field,
-              Size);
   strcpyW(Field->Data, Data);
 
   /* Append key */
@@ -321,6 +505,32 @@ InfpFindKeyLine(PINFCACHESECTION Section,
                 PCWSTR Key)
 {
   PINFCACHELINE Line;
+  ULONG Hash;
+
+  /* Index big sections on the first lookup, and grow the index along with them */
+  if (Section->KeyHashTable == NULL ?
+      Section->KeyCount > INF_HASH_MIN_ENTRIES :
+      (ULONG)Section->KeyCount > 2 * Section->KeyHashSize)
+    {
+      InfpBuildKeyIndex(Section);
+    }
+
+  if (Section->KeyHashTable != NULL)
+    {
+      Hash = InfpHashName(Key);
+      Line = Section->KeyHashTable[Hash & (Section->KeyHashSize - 1)];
+      while (Line != NULL)
+        {
+          if (Line->KeyHash == Hash && strcmpiW(Line->Key, Key) == 0)
+            {
+              return Line;
+            }
+
+          Line = Line->HashNext;
+        }
+
+      return NULL;
+    }
 
   Line = Section->FirstLine;
   while (Line != NULL)
@@ -375,7 +585,7 @@ __inline static int is_eol( struct parser *parser, const WCHAR *ptr )
   return (ptr >= parser->end ||
           *ptr == CONTROL_Z ||
           *ptr == '\n' ||
-          (*ptr == '\r' && *(ptr + 1) == '\n') ||
+          (*ptr == '\r' && ptr + 1 < parser->end && *(ptr + 1) == '\n') ||
           *ptr == 0);
 }
 
@@ -456,7 +666,7 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
           return NULL;
         }
 
-      parser->line = InfpAddLine(parser->cur_section);
+      parser->line = InfpAddLine(parser->file, parser->cur_section);
       if (parser->line == NULL)
         goto error;
     }
@@ -467,11 +677,11 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
 
   if (is_key)
     {
-      field = InfpAddKeyToLine(parser->line, parser->token);
+      field = InfpAddKeyToLine(parser->file, parser->cur_section, parser->line, parser->token);
     }
   else
     {
-      field = InfpAddFieldToLine(parser->line, parser->token);
+      field = InfpAddFieldToLine(parser->file, parser->line, parser->token);
     }
 
   if (field != NULL)
@@ -260,26 +260,18 @@ InfpFindFirstMatchLine(PINFCONTEXT ContextIn,
   if (ContextIn->Inf == NULL || ContextIn->Section == NULL)
     return INF_STATUS_INVALID_PARAMETER;
 
-  CacheLine = ((PINFCACHESECTION)(ContextIn->Section))->FirstLine;
-  while (CacheLine != NULL)
-    {
-      if (CacheLine->Key != NULL && strcmpiW (CacheLine->Key, Key) == 0)
-        {
-
-          if (ContextIn != ContextOut)
-            {
-              ContextOut->Inf = ContextIn->Inf;
-              ContextOut->Section = ContextIn->Section;
-            }
-          ContextOut->Line = (PVOID)CacheLine;
-
-          return INF_STATUS_SUCCESS;
-        }
+  CacheLine = InfpFindKeyLine((PINFCACHESECTION)ContextIn->Section, Key);
+  if (CacheLine == NULL)
+    return INF_STATUS_NOT_FOUND;
 
-      CacheLine = CacheLine->Next;
+  if (ContextIn != ContextOut)
+    {
+      ContextOut->Inf = ContextIn->Inf;
+      ContextOut->Section = ContextIn->Section;
     }
+  ContextOut->Line = (PVOID)CacheLine;
 
-  return INF_STATUS_NOT_FOUND;
+  return INF_STATUS_SUCCESS;
 }
 
 
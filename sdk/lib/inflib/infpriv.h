@@ -30,10 +30,12 @@ typedef struct _INFCACHELINE
 {
   struct _INFCACHELINE *Next;
   struct _INFCACHELINE *Prev;
+  struct _INFCACHELINE *HashNext;
 
   LONG FieldCount;
 
   PWCHAR Key;
+  ULONG KeyHash;
 
   PINFCACHEFIELD FirstField;
   PINFCACHEFIELD LastField;
@@ -44,15 +46,29 @@ typedef struct _INFCACHESECTION
 {
   struct _INFCACHESECTION *Next;
   struct _INFCACHESECTION *Prev;
+  struct _INFCACHESECTION *HashNext;
 
   PINFCACHELINE FirstLine;
   PINFCACHELINE LastLine;
 
   LONG LineCount;
+  LONG KeyCount;
 
+  /* Index of the keyed lines, built on the first lookup */
+  PINFCACHELINE *KeyHashTable;
+  ULONG KeyHashSize;
+
+  ULONG NameHash;
   WCHAR Name[1];
 } INFCACHESECTION, *PINFCACHESECTION;
 
+typedef struct _INFCACHEBLOCK
+{
+  struct _INFCACHEBLOCK *Next;
+  ULONG Size;
+  ULONG Used;
+} INFCACHEBLOCK, *PINFCACHEBLOCK;
+
 typedef struct _INFCACHE
 {
   LANGID LanguageId;
@@ -60,6 +76,15 @@ typedef struct _INFCACHE
   PINFCACHESECTION LastSection;
 
   PINFCACHESECTION StringsSection;
+
+  LONG SectionCount;
+
+  /* Index of the sections, built on the first lookup */
+  PINFCACHESECTION *SectionHashTable;
+  ULONG SectionHashSize;
+
+  /* Sections, lines and fields are carved out of these blocks */
+  PINFCACHEBLOCK FirstBlock;
 } INFCACHE, *PINFCACHE;
 
 typedef struct _INFCONTEXT
@@ -78,13 +103,18 @@ extern INFSTATUS InfpParseBuffer(PINFCACHE file,
                                  const WCHAR *buffer,
                                  const WCHAR *end,
                                  PULONG error_line);
+extern VOID InfpFreeCache(PINFCACHE Cache);
 extern PINFCACHESECTION InfpFreeSection(PINFCACHESECTION Section);
 extern PINFCACHESECTION InfpAddSection(PINFCACHE Cache,
                                        PCWSTR Name);
-extern PINFCACHELINE InfpAddLine(PINFCACHESECTION Section);
-extern PVOID InfpAddKeyToLine(PINFCACHELINE Line,
+extern PINFCACHELINE InfpAddLine(PINFCACHE Cache,
+                                 PINFCACHESECTION Section);
+extern PVOID InfpAddKeyToLine(PINFCACHE Cache,
+                              PINFCACHESECTION Section,
+                              PINFCACHELINE Line,
                               PCWSTR Key);
-extern PVOID InfpAddFieldToLine(PINFCACHELINE Line,
+extern PVOID InfpAddFieldToLine(PINFCACHE Cache,
+                                PINFCACHELINE Line,
                                 PCWSTR Data);
 extern PINFCACHELINE InfpFindKeyLine(PINFCACHESECTION Section,
                                      PCWSTR Key);
@@ -20,8 +20,21 @@
 #define COMPRESSION_FORMAT_MASK  0x00FF
 #define COMPRESSION_ENGINE_MASK  0xFF00
 
+/* LZNT1 encoder work space, the hash chains are indexed by position + 1 so that 0 means "none" */
+#define LZNT1_CHUNK_SIZE    0x1000
+#define LZNT1_HASH_BITS     12
+#define LZNT1_HASH_SIZE     (1 << LZNT1_HASH_BITS)
+#define LZNT1_MIN_MATCH     3
 
+/* how many candidates are looked at for the standard and the maximum engine */
+#define LZNT1_STANDARD_CHAIN_DEPTH  16
+#define LZNT1_MAXIMUM_CHAIN_DEPTH   LZNT1_CHUNK_SIZE
 
+typedef struct _LZNT1_WORKSPACE
+{
+    USHORT HashHead[LZNT1_HASH_SIZE];
+    USHORT HashChain[LZNT1_CHUNK_SIZE];
+} LZNT1_WORKSPACE, *PLZNT1_WORKSPACE;
 
 /* FUNCTIONS ****************************************************************/
 
@@ -216,18 +229,155 @@ out:
 }
 
 
-static NTSTATUS
-RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+static inline ULONG lznt1_hash(const UCHAR *src)
+{
+    return ((src[0] << 4) ^ (src[1] << 2) ^ src[2] ^ (src[0] >> 4)) & (LZNT1_HASH_SIZE - 1);
+}
+
+/* number of displacement bits available at the given position of a chunk,
+ * this must match what lznt1_decompress_chunk calculates */
+static inline ULONG lznt1_displacement_bits(ULONG position)
+{
+    ULONG displacement_bits;
+
+    for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
+        if ((1 << (displacement_bits - 1)) < position) break;
+
+    return displacement_bits;
+}
+
+static inline void lznt1_insert_hash(LZNT1_WORKSPACE *ws, const UCHAR *src, ULONG pos, ULONG src_size)
+{
+    ULONG hash;
+
+    if (pos + LZNT1_MIN_MATCH > src_size) return;
+
+    hash = lznt1_hash(src + pos);
+    ws->HashChain[pos] = ws->HashHead[hash];
+    ws->HashHead[hash] = (USHORT)(pos + 1);
+}
+
+/* find the longest match for the given position in the hash chains */
+static ULONG lznt1_find_match(LZNT1_WORKSPACE *ws, const UCHAR *src, ULONG pos, ULONG src_size,
+                              ULONG max_chain, ULONG *match_displacement)
+{
+    ULONG displacement_bits, max_displacement, max_length;
+    ULONG candidate, length, best_length = 0;
+
+    if (pos + LZNT1_MIN_MATCH > src_size) return 0;
+
+    displacement_bits = lznt1_displacement_bits(pos);
+    max_displacement  = 1 << displacement_bits;
+    max_length        = min((1 << (16 - displacement_bits)) + LZNT1_MIN_MATCH - 1, src_size - pos);
+
+    candidate = ws->HashHead[lznt1_hash(src + pos)];
+    while (candidate && max_chain--)
+    {
+        candidate--;
+
+        /* candidates only get older, stop when they get out of reach */
+        if (pos - candidate > max_displacement) break;
+
+        /* quickly reject candidates which can't beat the best match */
+        if (src[candidate + best_length] == src[pos + best_length] &&
+            src[candidate] == src[pos] && src[candidate + 1] == src[pos + 1])
+        {
+            for (length = 2; length < max_length; length++)
+                if (src[candidate + length] != src[pos + length]) break;
+
+            if (length > best_length)
+            {
+                best_length = length;
+                *match_displacement = pos - candidate;
+                if (length == max_length) break;
+            }
+        }
+
+        candidate = ws->HashChain[candidate];
+    }
+
+    return (best_length >= LZNT1_MIN_MATCH) ? best_length : 0;
+}
+
+/* compress a single LZNT1 chunk, returns the compressed size without chunk header
+ * or 0 if the result doesn't fit into dst_size bytes */
+static ULONG lznt1_compress_chunk(UCHAR *dst, ULONG dst_size, const UCHAR *src, ULONG src_size,
+                                  ULONG max_chain, LZNT1_WORKSPACE *ws)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *flags_ptr;
+    ULONG pos = 0, length, displacement = 0, i;
+    UCHAR flags, flag_bit;
+    WORD code;
+
+    memset(ws->HashHead, 0, sizeof(ws->HashHead));
+
+    while (pos < src_size)
+    {
+        /* reserve space for the flags of the next 8 entities */
+        if (dst_cur >= dst_end) return 0;
+        flags_ptr = dst_cur++;
+        flags = 0;
+
+        for (flag_bit = 0; flag_bit < 8 && pos < src_size; flag_bit++)
+        {
+            length = lznt1_find_match(ws, src, pos, src_size, max_chain, &displacement);
+            if (length)
+            {
+                /* backwards reference */
+                if (dst_cur + sizeof(WORD) > dst_end) return 0;
+                code = (WORD)(((displacement - 1) << (16 - lznt1_displacement_bits(pos))) |
+                              (length - LZNT1_MIN_MATCH));
+                *(WORD *)dst_cur = code;
+                dst_cur += sizeof(WORD);
+                flags |= 1 << flag_bit;
+
+                for (i = 0; i < length; i++)
+                    lznt1_insert_hash(ws, src, pos + i, src_size);
+                pos += length;
+            }
+            else
+            {
+                /* uncompressed data */
+                if (dst_cur >= dst_end) return 0;
+                *dst_cur++ = src[pos];
+                lznt1_insert_hash(ws, src, pos, src_size);
+                pos++;
+            }
+        }
+
+        *flags_ptr = flags;
+    }
+
+    return dst_cur - dst;
+}
+
+/* compress data with LZNT1, chunks which don't get smaller are stored uncompressed */
+static NTSTATUS lznt1_compress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                               ULONG max_chain, ULONG *final_size, LZNT1_WORKSPACE *ws)
 {
-        UCHAR *src_cur = src, *src_end = src + src_size;
-        UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG block_size, chunk_size;
 
-        while (src_cur < src_end)
+    while (src_cur < src_end)
+    {
+        /* determine size of current chunk */
+        block_size = min(LZNT1_CHUNK_SIZE, src_end - src_cur);
+        if (dst_cur + sizeof(WORD) > dst_end)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        /* try to compress it, it's only worth it if it gets smaller */
+        chunk_size = lznt1_compress_chunk(dst_cur + sizeof(WORD),
+                                          min(block_size - 1, dst_end - dst_cur - sizeof(WORD)),
+                                          src_cur, block_size, max_chain, ws);
+        if (chunk_size)
+        {
+            /* write compressed chunk header */
+            *(WORD *)dst_cur = 0xB000 | (chunk_size - 1);
+            dst_cur += sizeof(WORD) + chunk_size;
+        }
+        else
         {
-            /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
             if (dst_cur + sizeof(WORD) + block_size > dst_end)
                 return STATUS_BUFFER_TOO_SMALL;
 
@@ -238,13 +388,31 @@ RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
             /* write chunk content */
             memcpy(dst_cur, src_cur, block_size);
             dst_cur += block_size;
-            src_cur += block_size;
         }
 
-        if (final_size)
-            *final_size = dst_cur - dst;
+        src_cur += block_size;
+    }
 
-        return STATUS_SUCCESS;
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace,
+                        USHORT Engine)
+{
+    /* the encoder keeps its hash chains in the work space */
+    if (!workspace)
+        return STATUS_INVALID_PARAMETER;
+
+    /* the maximum engine looks at every candidate in the window */
+    return lznt1_compress(src, src_size, dst, dst_size,
+                          (Engine == COMPRESSION_ENGINE_MAXIMUM) ?
+                          LZNT1_MAXIMUM_CHAIN_DEPTH : LZNT1_STANDARD_CHAIN_DEPTH,
+                          final_size, (LZNT1_WORKSPACE *)workspace);
 }
 
 
@@ -261,7 +429,7 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
    }
    else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
    {
-      *BufferAndWorkSpaceSize = 0x10;
+      *BufferAndWorkSpaceSize = 0x8010;
       *FragmentWorkSpaceSize = 0x1000;
       return(STATUS_SUCCESS);
    }
@@ -284,7 +452,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -297,14 +465,29 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      CompressedBufferSize,
                                      UncompressedChunkSize,
                                      FinalCompressedSize,
-                                     WorkSpace));
+                                     WorkSpace,
+                                     Engine));
 
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
 
+static BOOLEAN
+RtlpIsZeroChunk(IN PUCHAR Buffer,
+                IN ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        if (Buffer[i]) return FALSE;
+    }
+
+    return TRUE;
+}
+
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlCompressChunks(IN PUCHAR UncompressedBuffer,
@@ -315,12 +498,69 @@ RtlCompressChunks(IN PUCHAR UncompressedBuffer,
                   IN ULONG CompressedDataInfoLength,
                   IN PVOID WorkSpace)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    ULONG ChunkSize, BlockSize, FinalSize, NumberOfChunks, i;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 12 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+
+    /* Make sure there is room to describe every chunk */
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+    NumberOfChunks = (UncompressedBufferSize + ChunkSize - 1) / ChunkSize;
+    if (CompressedDataInfoLength < FIELD_OFFSET(COMPRESSED_DATA_INFO, CompressedChunkSizes) +
+                                   NumberOfChunks * sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    CompressedDataInfo->NumberOfChunks = (USHORT)NumberOfChunks;
+
+    for (i = 0; i < NumberOfChunks; i++)
+    {
+        BlockSize = min(ChunkSize, UncompressedBufferSize);
+
+        /* Chunks of zeros aren't stored at all */
+        if (RtlpIsZeroChunk(UncompressedBuffer, BlockSize))
+        {
+            CompressedDataInfo->CompressedChunkSizes[i] = 0;
+            UncompressedBuffer += BlockSize;
+            UncompressedBufferSize -= BlockSize;
+            continue;
+        }
+
+        /* Compressing is only worth it if the chunk gets smaller */
+        Status = RtlCompressBuffer(CompressedDataInfo->CompressionFormatAndEngine,
+                                   UncompressedBuffer,
+                                   BlockSize,
+                                   CompressedBuffer,
+                                   min(CompressedBufferSize, BlockSize - 1),
+                                   ChunkSize,
+                                   &FinalSize,
+                                   WorkSpace);
+        if (Status == STATUS_BUFFER_TOO_SMALL)
+        {
+            /* Store it as is, a chunk as big as its data is known to be uncompressed */
+            if (CompressedBufferSize < BlockSize)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            RtlCopyMemory(CompressedBuffer, UncompressedBuffer, BlockSize);
+            FinalSize = BlockSize;
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        CompressedDataInfo->CompressedChunkSizes[i] = FinalSize;
+        CompressedBuffer += FinalSize;
+        CompressedBufferSize -= FinalSize;
+        UncompressedBuffer += BlockSize;
+        UncompressedBufferSize -= BlockSize;
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
@@ -331,8 +571,67 @@ RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
                     IN ULONG CompressedTailSize,
                     IN PCOMPRESSED_DATA_INFO CompressedDataInfo)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    ULONG ChunkSize, BlockSize, Size, FinalSize, i;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 12 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+
+    for (i = 0; i < CompressedDataInfo->NumberOfChunks && UncompressedBufferSize; i++)
+    {
+        BlockSize = min(ChunkSize, UncompressedBufferSize);
+        Size = CompressedDataInfo->CompressedChunkSizes[i];
+
+        if (Size == 0)
+        {
+            /* This chunk only had zeros */
+            RtlZeroMemory(UncompressedBuffer, BlockSize);
+        }
+        else
+        {
+            /* The last chunks can live in the tail buffer */
+            if (Size > CompressedBufferSize && CompressedTail)
+            {
+                CompressedBuffer = CompressedTail;
+                CompressedBufferSize = CompressedTailSize;
+                CompressedTail = NULL;
+            }
+
+            if (Size > CompressedBufferSize)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            if (Size == BlockSize)
+            {
+                /* This chunk was stored uncompressed */
+                RtlCopyMemory(UncompressedBuffer, CompressedBuffer, BlockSize);
+            }
+            else
+            {
+                Status = RtlDecompressBuffer(CompressedDataInfo->CompressionFormatAndEngine,
+                                             UncompressedBuffer,
+                                             BlockSize,
+                                             CompressedBuffer,
+                                             Size,
+                                             &FinalSize);
+                if (!NT_SUCCESS(Status))
+                    return Status;
+
+                /* Whatever the chunk didn't cover is zero */
+                if (FinalSize < BlockSize)
+                    RtlZeroMemory(UncompressedBuffer + FinalSize, BlockSize - FinalSize);
+            }
+
+            CompressedBuffer += Size;
+            CompressedBufferSize -= Size;
+        }
+
+        UncompressedBuffer += BlockSize;
+        UncompressedBufferSize -= BlockSize;
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /*
@@ -383,7 +682,7 @@ RtlDecompressBuffer(IN USHORT CompressionFormat,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlDescribeChunk(IN USHORT CompressionFormat,
@@ -392,8 +691,44 @@ RtlDescribeChunk(IN USHORT CompressionFormat,
                  OUT PUCHAR *ChunkBuffer,
                  OUT PULONG ChunkSize)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    PUCHAR Chunk = *CompressedBuffer;
+    WORD ChunkHeader;
+    ULONG Size;
+
+    if ((CompressionFormat & COMPRESSION_FORMAT_MASK) != COMPRESSION_FORMAT_LZNT1)
+        return STATUS_UNSUPPORTED_COMPRESSION;
+
+    *ChunkBuffer = Chunk;
+    *ChunkSize = 0;
+
+    /* A zero header (or no room for a real chunk) ends the buffer */
+    if (Chunk + 2 * sizeof(WORD) > EndOfCompressedBufferPlus1)
+        return STATUS_NO_MORE_ENTRIES;
+
+    ChunkHeader = *(WORD *)Chunk;
+    if (!ChunkHeader)
+        return STATUS_NO_MORE_ENTRIES;
+
+    /* The size includes the chunk header */
+    Size = (ChunkHeader & 0xFFF) + 1 + sizeof(WORD);
+    if (Chunk + Size > EndOfCompressedBufferPlus1)
+        return STATUS_BAD_COMPRESSION_BUFFER;
+
+    *CompressedBuffer = Chunk + Size;
+
+    if (ChunkHeader & 0x8000)
+    {
+        /* Compressed chunks are described with their header */
+        *ChunkSize = Size;
+    }
+    else
+    {
+        /* Uncompressed chunks are described by their data only */
+        *ChunkBuffer = Chunk + sizeof(WORD);
+        *ChunkSize = Size - sizeof(WORD);
+    }
+
+    return STATUS_SUCCESS;
 }
 
 
@@ -423,7 +758,7 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS NTAPI
 RtlReserveChunk(IN USHORT CompressionFormat,
@@ -432,8 +767,49 @@ RtlReserveChunk(IN USHORT CompressionFormat,
                 OUT PUCHAR *ChunkBuffer,
                 IN ULONG ChunkSize)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    PUCHAR Chunk = *CompressedBuffer;
+
+    if ((CompressionFormat & COMPRESSION_FORMAT_MASK) != COMPRESSION_FORMAT_LZNT1)
+        return STATUS_UNSUPPORTED_COMPRESSION;
+
+    if (ChunkSize > LZNT1_CHUNK_SIZE || (ChunkSize && ChunkSize < 3))
+        return STATUS_INVALID_PARAMETER;
+
+    if (ChunkSize == 0)
+    {
+        /* A chunk of zeros: one literal and a single match covering the rest */
+        if (Chunk + 6 > EndOfCompressedBufferPlus1)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        *(WORD *)Chunk = 0xB003;
+        Chunk[2] = 0x02;
+        Chunk[3] = 0x00;
+        *(WORD *)(Chunk + 4) = (LZNT1_CHUNK_SIZE - 1) - LZNT1_MIN_MATCH;
+        *ChunkBuffer = Chunk;
+        *CompressedBuffer = Chunk + 6;
+    }
+    else if (ChunkSize == LZNT1_CHUNK_SIZE)
+    {
+        /* An uncompressed chunk, the caller fills in the data after the header */
+        if (Chunk + sizeof(WORD) + ChunkSize > EndOfCompressedBufferPlus1)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        *(WORD *)Chunk = 0x3000 | (LZNT1_CHUNK_SIZE - 1);
+        *ChunkBuffer = Chunk + sizeof(WORD);
+        *CompressedBuffer = Chunk + sizeof(WORD) + ChunkSize;
+    }
+    else
+    {
+        /* A compressed chunk, its size includes the header the caller will copy */
+        if (Chunk + ChunkSize > EndOfCompressedBufferPlus1)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        *(WORD *)Chunk = 0xB000 | (ChunkSize - 3);
+        *ChunkBuffer = Chunk;
+        *CompressedBuffer = Chunk + ChunkSize;
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /* EOF */
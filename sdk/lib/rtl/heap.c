@@ -159,6 +159,10 @@ RtlpInitializeHeap(OUT PHEAP Heap,
     Heap->HeaderValidateCopy = NULL;
     Heap->HeaderValidateLength = (USHORT)HeaderSize;
 
+    /* There is no front end heap until somebody asks for one */
+    Heap->FrontEndHeap = NULL;
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+
     /* Initialise the Heap Lock */
     if (!(Flags & HEAP_NO_SERIALIZE) && !(Flags & HEAP_LOCK_USER_ALLOCATED))
     {
@@ -1977,6 +1981,25 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small blocks without extra stuff come from the front end heap, if any */
+    if ((Heap->FrontEndHeapType == HEAP_FRONT_END_LFH) &&
+        (Index < HEAP_LFH_BUCKETS) &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT) &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        InUseEntry = RtlpLfhAllocate(Heap, Size, AllocationSize, Index, EntryFlags);
+        if (InUseEntry)
+        {
+            /* Zero memory if that was requested */
+            if (Flags & HEAP_ZERO_MEMORY)
+                RtlZeroMemory(InUseEntry + 1, Size);
+
+            return InUseEntry + 1;
+        }
+
+        /* Otherwise let the back end try */
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2180,6 +2203,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     if (RtlpHeapIsSpecial(Flags))
         return RtlDebugFreeHeap(Heap, Flags, Ptr);
 
+    /* Get pointer to the heap entry */
+    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+
+    /* Front end blocks are freed without taking the heap lock */
+    if (RtlpIsLfhEntry(Heap, HeapEntry))
+        return RtlpLfhFree(Heap, HeapEntry);
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2187,9 +2217,6 @@ BOOLEAN NTAPI RtlFreeHeap(
         Locked = TRUE;
     }
 
-    /* Get pointer to the heap entry */
-    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
-
     /* Check this entry, fail if it's invalid */
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
         (((ULONG_PTR)Ptr & 0x7) != 0) ||
@@ -2605,6 +2632,29 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         AllocationSize += sizeof(HEAP_ENTRY_EXTRA);
     }
 
+    /* Get the pointer to the in-use entry */
+    InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+
+    /* Front end blocks have a fixed size, they are handled separately */
+    if (RtlpIsLfhEntry(Heap, InUseEntry))
+    {
+        Ptr = RtlpLfhReAllocate(Heap, Flags, InUseEntry, Size, AllocationSize);
+
+        /* Generate an exception if required */
+        if (!Ptr && (Flags & HEAP_GENERATE_EXCEPTIONS))
+        {
+            ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+            ExceptionRecord.ExceptionRecord = NULL;
+            ExceptionRecord.NumberParameters = 1;
+            ExceptionRecord.ExceptionFlags = 0;
+            ExceptionRecord.ExceptionInformation[0] = AllocationSize;
+
+            RtlRaiseException(&ExceptionRecord);
+        }
+
+        return Ptr;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2613,9 +2663,6 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         Flags &= ~HEAP_NO_SERIALIZE;
     }
 
-    /* Get the pointer to the in-use entry */
-    InUseEntry = (PHEAP_ENTRY)Ptr - 1;
-
     /* If that entry is not really in-use, we have a problem */
     if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY))
     {
@@ -3154,6 +3201,9 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks live inside busy blocks, just look for their segment */
+    if (RtlpIsLfhEntry(Heap, HeapEntry)) goto find_segment;
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -3174,6 +3224,7 @@ RtlpValidateHeapEntry(
     /* Checks are done, if this is a virtual entry, that's all */
     if (HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC) return TRUE;
 
+find_segment:
     /* Go through segments and check if this entry fits into any of them */
     for (SegmentOffset = 0; SegmentOffset < HEAP_SEGMENTS; SegmentOffset++)
     {
@@ -3918,13 +3969,18 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* There is no front end heap for the default handle */
+        if (!HeapHandle) return STATUS_INVALID_PARAMETER;
+
+        /* Page heaps and debug heaps don't have a front end */
+        if (RtlpPageHeapEnabled) return STATUS_UNSUCCESSFUL;
+
+        return RtlpActivateLowFragmentationHeap((PHEAP)HeapHandle);
     }
 
     return STATUS_SUCCESS;
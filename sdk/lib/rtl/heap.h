@@ -55,6 +55,16 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types */
+#define HEAP_FRONT_END_NONE    0
+#define HEAP_FRONT_END_LFH     2
+
+/* Low fragmentation front end heap */
+#define HEAP_LFH_BUCKETS         128
+#define HEAP_LFH_AFFINITY_SLOTS  4
+#define HEAP_LFH_SUBSEGMENT_SIZE 0x4000
+#define HEAP_LFH_SEGMENT_OFFSET  0xFF
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -269,6 +279,18 @@ typedef struct _HEAP
     HEAP_TUNING_PARAMETERS TuningParameters;
 } HEAP, *PHEAP;
 
+typedef struct _HEAP_LFH_BUCKET
+{
+    SLIST_HEADER FreeBlocks[HEAP_LFH_AFFINITY_SLOTS];
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    HEAP_LFH_BUCKET Buckets[HEAP_LFH_BUCKETS];
+    ULONG SubSegmentOffset;
+    LONG SubSegmentCount;
+} HEAP_LFH, *PHEAP_LFH;
+
 typedef struct _HEAP_SEGMENT
 {
     HEAP_ENTRY Entry;
@@ -352,6 +374,37 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+FORCEINLINE BOOLEAN
+RtlpIsLfhEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry)
+{
+    /* Front end blocks are marked with a segment offset no segment can have */
+    return (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+            !(HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC) &&
+            HeapEntry->LFHFlags == HEAP_LFH_SEGMENT_OFFSET);
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap);
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Size,
+                SIZE_T AllocationSize,
+                SIZE_T Index,
+                UCHAR EntryFlags);
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PHEAP_ENTRY InUseEntry,
+                  SIZE_T Size,
+                  SIZE_T AllocationSize);
+
 /* heapdbg.c */
 HANDLE NTAPI
 RtlDebugCreateHeap(ULONG Flags,
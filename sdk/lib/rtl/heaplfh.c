@@ -0,0 +1,297 @@
+/*
+ * PROJECT:         ReactOS Runtime Library
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         Heap manager low fragmentation front end heap
+ * PROGRAMMERS:     ReactOS Team
+ */
+
+/* Useful references:
+   http://illmatics.com/Understanding_the_LFH.pdf
+*/
+
+/* INCLUDES ******************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS ******************************************************************/
+
+/*
+ * Small blocks are carved out of subsegments, which are ordinary busy blocks
+ * of the back end heap. Each block keeps a normal heap entry header, so that
+ * RtlSizeHeap and friends keep working, but its segment offset is set to
+ * HEAP_LFH_SEGMENT_OFFSET so that RtlFreeHeap can hand it back here.
+ *
+ * Free blocks of the same size are kept in lock-free S-Lists, one per
+ * affinity slot, so that concurrent threads mostly touch different lists
+ * and never have to take the heap lock on the fast path. Subsegments are
+ * never given back to the back end before the heap is destroyed.
+ */
+
+FORCEINLINE
+ULONG
+RtlpLfhGetAffinitySlot(VOID)
+{
+    ULONG_PTR StackLocation = (ULONG_PTR)&StackLocation;
+
+    /* Every thread runs on its own stack, so hashing our location on it
+       spreads threads over the slots without asking the kernel where we run */
+    return (ULONG)((StackLocation >> 16) ^ (StackLocation >> 20)) %
+           HEAP_LFH_AFFINITY_SLOTS;
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    ULONG Bucket, Slot;
+
+    /* Nothing to do if it's already there */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH) return STATUS_SUCCESS;
+
+    /* The front end can't be used with non-serialized or checked heaps, and
+       it can't grow under the heap lock if that could raise an exception */
+    if (RtlpHeapIsSpecial(Heap->Flags) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED)) ||
+        (Heap->ForceFlags & HEAP_GENERATE_EXCEPTIONS))
+    {
+        DPRINT1("HEAP: Heap %p with flags 0x%x can't have a front end heap\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* Allocate the front end data from the back end itself */
+    Lfh = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, sizeof(HEAP_LFH));
+    if (!Lfh) return STATUS_NO_MEMORY;
+
+    /* Initialize all the free lists */
+    for (Bucket = 0; Bucket < HEAP_LFH_BUCKETS; Bucket++)
+    {
+        for (Slot = 0; Slot < HEAP_LFH_AFFINITY_SLOTS; Slot++)
+        {
+            RtlInitializeSListHead(&Lfh->Buckets[Bucket].FreeBlocks[Slot]);
+        }
+    }
+
+    /* Blocks start inside the subsegment so that their data is aligned
+       the way the heap was asked for */
+    if (Heap->Flags & HEAP_CREATE_ALIGN_16)
+        Lfh->SubSegmentOffset = 16 - sizeof(HEAP_ENTRY);
+    else
+        Lfh->SubSegmentOffset = 0;
+
+    /* Publish it under the heap lock */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH)
+    {
+        /* Somebody beat us to it */
+        RtlLeaveHeapLock(Heap->LockVariable);
+        RtlFreeHeap(Heap, 0, Lfh);
+        return STATUS_SUCCESS;
+    }
+
+    Heap->FrontEndHeap = Lfh;
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    DPRINT("HEAP: Low fragmentation heap %p activated for heap %p\n", Lfh, Heap);
+    return STATUS_SUCCESS;
+}
+
+static
+PSLIST_ENTRY
+RtlpLfhRefillBucket(PHEAP Heap,
+                    PHEAP_LFH Lfh,
+                    SIZE_T AllocationSize,
+                    SIZE_T Index,
+                    ULONG Slot)
+{
+    PHEAP_LFH_BUCKET Bucket = &Lfh->Buckets[Index];
+    PSLIST_ENTRY ListEntry;
+    PHEAP_ENTRY HeapEntry;
+    PUCHAR SubSegment;
+    ULONG Count, i;
+
+    /* Refills are serialized by the heap lock */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Somebody could have refilled our list while we were waiting */
+    ListEntry = RtlInterlockedPopEntrySList(&Bucket->FreeBlocks[Slot]);
+    if (ListEntry)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return ListEntry;
+    }
+
+    /* Get a new subsegment from the back end. We own the lock already */
+    SubSegment = RtlAllocateHeap(Heap, HEAP_NO_SERIALIZE, HEAP_LFH_SUBSEGMENT_SIZE);
+    if (SubSegment) Lfh->SubSegmentCount++;
+    RtlLeaveHeapLock(Heap->LockVariable);
+    if (!SubSegment) return NULL;
+
+    /* Carve it into blocks of this bucket's size */
+    Count = (ULONG)((HEAP_LFH_SUBSEGMENT_SIZE - Lfh->SubSegmentOffset) / AllocationSize);
+    ASSERT(Count > 1);
+    HeapEntry = (PHEAP_ENTRY)(SubSegment + Lfh->SubSegmentOffset);
+
+    for (i = 0; i < Count; i++)
+    {
+        /* Initialize this block as a free front end block */
+        RtlZeroMemory(HeapEntry, sizeof(HEAP_ENTRY));
+        HeapEntry->Size = (USHORT)Index;
+        HeapEntry->LFHFlags = HEAP_LFH_SEGMENT_OFFSET;
+
+        /* Keep the first one for the caller, put the others on our list */
+        if (i == 0)
+            ListEntry = (PSLIST_ENTRY)(HeapEntry + 1);
+        else
+            RtlInterlockedPushEntrySList(&Bucket->FreeBlocks[Slot], (PSLIST_ENTRY)(HeapEntry + 1));
+
+        HeapEntry += Index;
+    }
+
+    return ListEntry;
+}
+
+PHEAP_ENTRY NTAPI
+RtlpLfhAllocate(PHEAP Heap,
+                SIZE_T Size,
+                SIZE_T AllocationSize,
+                SIZE_T Index,
+                UCHAR EntryFlags)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket;
+    PSLIST_ENTRY ListEntry;
+    PHEAP_ENTRY HeapEntry;
+    ULONG Slot, i;
+
+    ASSERT(Index < HEAP_LFH_BUCKETS);
+    Bucket = &Lfh->Buckets[Index];
+
+    /* Fast path: take a block from our own slot */
+    Slot = RtlpLfhGetAffinitySlot();
+    ListEntry = RtlInterlockedPopEntrySList(&Bucket->FreeBlocks[Slot]);
+
+    if (!ListEntry)
+    {
+        /* Look at the other slots before growing the bucket */
+        for (i = 1; i < HEAP_LFH_AFFINITY_SLOTS && !ListEntry; i++)
+        {
+            ListEntry = RtlInterlockedPopEntrySList(&Bucket->FreeBlocks[(Slot + i) % HEAP_LFH_AFFINITY_SLOTS]);
+        }
+
+        /* Still nothing, get a new subsegment */
+        if (!ListEntry)
+        {
+            ListEntry = RtlpLfhRefillBucket(Heap, Lfh, AllocationSize, Index, Slot);
+            if (!ListEntry) return NULL;
+        }
+    }
+
+    /* Get the entry and make sure it's really one of ours */
+    HeapEntry = (PHEAP_ENTRY)ListEntry - 1;
+    ASSERT(HeapEntry->Size == Index);
+    ASSERT(HeapEntry->LFHFlags == HEAP_LFH_SEGMENT_OFFSET);
+    ASSERT(!(HeapEntry->Flags & HEAP_ENTRY_BUSY));
+
+    /* Mark it busy */
+    HeapEntry->Flags = EntryFlags;
+    HeapEntry->SmallTagIndex = 0;
+    HeapEntry->UnusedBytes = (UCHAR)(AllocationSize - Size);
+
+    return HeapEntry;
+}
+
+BOOLEAN NTAPI
+RtlpLfhFree(PHEAP Heap,
+            PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+
+    /* Check this entry, fail if it's invalid */
+    if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
+        (HeapEntry->Size >= HEAP_LFH_BUCKETS))
+    {
+        /* This is an invalid block */
+        DPRINT1("HEAP: Trying to free an invalid front end block %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Mark it free and put it on the list of our slot */
+    HeapEntry->Flags = 0;
+    RtlInterlockedPushEntrySList(&Lfh->Buckets[HeapEntry->Size].FreeBlocks[RtlpLfhGetAffinitySlot()],
+                                 (PSLIST_ENTRY)(HeapEntry + 1));
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLfhReAllocate(PHEAP Heap,
+                  ULONG Flags,
+                  PHEAP_ENTRY InUseEntry,
+                  SIZE_T Size,
+                  SIZE_T AllocationSize)
+{
+    PVOID NewBaseAddress;
+    SIZE_T OldSize, BlockSize;
+
+    /* If that entry is not really in-use, we have a problem */
+    if (!(InUseEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return InUseEntry + 1;
+    }
+
+    BlockSize = (SIZE_T)InUseEntry->Size << HEAP_ENTRY_SHIFT;
+    OldSize = BlockSize - InUseEntry->UnusedBytes;
+
+    /* The block size is fixed, but anything fitting into it stays in place,
+       as long as the slack can still be described by UnusedBytes */
+    if ((AllocationSize <= BlockSize) && (BlockSize - Size <= MAXUCHAR))
+    {
+        InUseEntry->UnusedBytes = (UCHAR)(BlockSize - Size);
+
+        /* Zero out the additional space if required */
+        if ((Size > OldSize) && (Flags & HEAP_ZERO_MEMORY))
+            RtlZeroMemory((PCHAR)(InUseEntry + 1) + OldSize, Size - OldSize);
+
+        return InUseEntry + 1;
+    }
+
+    /* Moving to another bucket is the only option */
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        return NULL;
+    }
+
+    /* Allocate new block from the heap */
+    NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewBaseAddress) return NULL;
+
+    /* Copy actual user bits and zero the remaining part if required */
+    if (Size > OldSize)
+    {
+        RtlMoveMemory(NewBaseAddress, InUseEntry + 1, OldSize);
+        if (Flags & HEAP_ZERO_MEMORY)
+            RtlZeroMemory((PCHAR)NewBaseAddress + OldSize, Size - OldSize);
+    }
+    else
+    {
+        RtlMoveMemory(NewBaseAddress, InUseEntry + 1, Size);
+    }
+
+    /* Free the old block */
+    RtlpLfhFree(Heap, InUseEntry);
+
+    return NewBaseAddress;
+}
+
+/* EOF */
@@ -39,6 +39,9 @@
 FAST486_STATE EmulatorContext;
 BOOLEAN CpuRunning = FALSE;
 
+/* Flushing it is cheap, so protected mode programs switching CR3 don't pay for it */
+static FAST486_TLB_ENTRY CpuTlb[FAST486_TLB_ENTRIES];
+
 /* No more than 'MaxCpuCallLevel' recursive CPU calls are allowed */
 static const INT MaxCpuCallLevel = 32;
 static INT CpuCallLevel = 0; // == 0: CPU stopped; >= 1: CPU running or halted
@@ -225,13 +228,13 @@ BOOLEAN CpuInitialize(VOID)
     /* Initialize the CPU */
     Fast486Initialize(&EmulatorContext,
                       EmulatorReadMemory,
-                      EmulatorWriteMemory,
+                      EmulatorCpuWriteMemory,
                       EmulatorReadIo,
                       EmulatorWriteIo,
                       EmulatorBiosOperation,
                       EmulatorIntAcknowledge,
                       EmulatorFpu,
-                      NULL /* TODO: Use a TLB */);
+                      CpuTlb);
 
     /* Initialize the software callback system and register the emulator BOPs */
     // RegisterBop(BOP_DEBUGGER  , EmulatorDebugBreakBop);
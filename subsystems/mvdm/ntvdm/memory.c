@@ -180,7 +180,7 @@ VOID FASTCALL EmulatorReadMemory(PFAST486_STATE State, ULONG Address, PVOID Buff
     }
 }
 
-VOID FASTCALL EmulatorWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+VOID FASTCALL EmulatorCpuWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
 {
     ULONG i, Offset, Length;
     ULONG FirstPage, LastPage;
@@ -213,6 +213,19 @@ VOID FASTCALL EmulatorWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buf
     }
 }
 
+VOID FASTCALL EmulatorWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    /*
+     * Host-to-guest memory write (BIOS, DMA...)
+     */
+
+    EmulatorCpuWriteMemory(State, Address, Buffer, Size);
+
+    /* The CPU only drops the cached code it overwrites itself */
+    if (!A20Line) Address &= ~(1 << 20);
+    Fast486InvalidateCache(State, Address, Size);
+}
+
 VOID FASTCALL EmulatorCopyMemory(PFAST486_STATE State, ULONG DestAddress, ULONG SrcAddress, ULONG Size)
 {
     /*
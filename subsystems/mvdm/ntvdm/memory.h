@@ -45,6 +45,16 @@ EmulatorReadMemory
     ULONG Size
 );
 
+VOID
+FASTCALL
+EmulatorCpuWriteMemory
+(
+    PFAST486_STATE State,
+    ULONG Address,
+    PVOID Buffer,
+    ULONG Size
+);
+
 VOID
 FASTCALL
 EmulatorWriteMemory
@@ -315,12 +315,13 @@ BOOL FASTCALL LoadTheSpoolerDrv(VOID);
 
 FORCEINLINE
 PVOID
-GdiAllocBatchCommand(
+GdiAllocBatchCommandEx(
     HDC hdc,
-    USHORT Cmd)
+    USHORT Cmd,
+    ULONG cjData)
 {
     PTEB pTeb;
-    USHORT cjSize;
+    ULONG cjSize;
     PGDIBATCHHDR pHdr;
 
     /* Get a pointer to the TEB */
@@ -329,21 +330,14 @@ GdiAllocBatchCommand(
     /* Check if we have a valid environment */
     if (!pTeb || !pTeb->Win32ThreadInfo) return NULL;
 
-    /* Do we use a DC? */
-    if (hdc)
-    {
-        /* If the batch DC is NULL, we set this one as the new one */
-        if (!pTeb->GdiTebBatch.HDC) pTeb->GdiTebBatch.HDC = hdc;
-
-        /* If not, check if the batch DC equal to our DC */
-        else if (pTeb->GdiTebBatch.HDC != hdc) return NULL;
-    }
+    /* Do we use a DC? If so, the batch DC must be NULL or equal to our DC */
+    if (hdc && pTeb->GdiTebBatch.HDC && (pTeb->GdiTebBatch.HDC != hdc)) return NULL;
 
-    /* Get the size of the entry */
-    if      (Cmd == GdiBCPatBlt) cjSize = 0;
-    else if (Cmd == GdiBCPolyPatBlt) cjSize = 0;
-    else if (Cmd == GdiBCTextOut) cjSize = 0;
-    else if (Cmd == GdiBCExtTextOut) cjSize = 0;
+    /* Get the size of the entry, cjData is the size of the variable part */
+    if      (Cmd == GdiBCPatBlt) cjSize = sizeof(GDIBSPATBLT);
+    else if (Cmd == GdiBCPolyPatBlt) cjSize = FIELD_OFFSET(GDIBSPPATBLT, pRect);
+    else if (Cmd == GdiBCTextOut) cjSize = FIELD_OFFSET(GDIBSTEXTOUT, String);
+    else if (Cmd == GdiBCExtTextOut) cjSize = sizeof(GDIBSEXTTEXTOUT);
     else if (Cmd == GdiBCSetBrushOrg) cjSize = sizeof(GDIBSSETBRHORG);
     else if (Cmd == GdiBCExtSelClipRgn) cjSize = 0;
     else if (Cmd == GdiBCSelObj) cjSize = sizeof(GDIBSOBJECT);
@@ -354,6 +348,10 @@ GdiAllocBatchCommand(
     /* Unsupported operation */
     if (cjSize == 0) return NULL;
 
+    /* Keep the entries aligned, and check if the entry fits at all */
+    cjSize = (cjSize + cjData + sizeof(ULONG_PTR) - 1) & ~(sizeof(ULONG_PTR) - 1);
+    if (cjSize > GDIBATCHBUFSIZE) return NULL;
+
     /* Check if the buffer is full */
     if ((pTeb->GdiBatchCount >= GDI_BatchLimit) ||
         ((pTeb->GdiTebBatch.Offset + cjSize) > GDIBATCHBUFSIZE))
@@ -363,6 +361,9 @@ GdiAllocBatchCommand(
         NtGdiFlush();
     }
 
+    /* Set the batch DC, only now since flushing resets it */
+    if (hdc) pTeb->GdiTebBatch.HDC = hdc;
+
     /* Get the head of the entry */
     pHdr = (PVOID)((PUCHAR)pTeb->GdiTebBatch.Buffer + pTeb->GdiTebBatch.Offset);
 
@@ -372,11 +373,20 @@ GdiAllocBatchCommand(
 
     /* Fill in the core fields */
     pHdr->Cmd = Cmd;
-    pHdr->Size = cjSize;
+    pHdr->Size = (SHORT)cjSize;
 
     return pHdr;
 }
 
+FORCEINLINE
+PVOID
+GdiAllocBatchCommand(
+    HDC hdc,
+    USHORT Cmd)
+{
+    return GdiAllocBatchCommandEx(hdc, Cmd, 0);
+}
+
 FORCEINLINE
 PDC_ATTR
 GdiGetDcAttr(HDC hdc)
@@ -456,9 +456,41 @@ PatBlt(
     _In_ INT nHeight,
     _In_ DWORD dwRop)
 {
+    PDC_ATTR pdcattr;
+    PGDIBSPATBLT pgPB;
+
     HANDLE_METADC(BOOL, PatBlt, FALSE, hdc, nXLeft, nYLeft, nWidth, nHeight, dwRop);
 
-    /* FIXME some part need be done in user mode */
+    /* Get the DC attribute */
+    pdcattr = GdiGetDcAttr(hdc);
+
+    /* If the DC does not have a DIB section selected, try a batch command.
+       ROPs using a source are rejected by win32k, so leave them to it. */
+    if (pdcattr &&
+        !(pdcattr->ulDirty_ & DC_DIBSECTION) &&
+        !ROP_USES_SOURCE(dwRop))
+    {
+        pgPB = GdiAllocBatchCommand(hdc, GdiBCPatBlt);
+        if (pgPB)
+        {
+            pgPB->nXLeft = nXLeft;
+            pgPB->nYLeft = nYLeft;
+            pgPB->nWidth = nWidth;
+            pgPB->nHeight = nHeight;
+            pgPB->dwRop = dwRop;
+
+            /* The attributes can change in user mode before the batch is
+               flushed, so take the current ones along */
+            pgPB->hbrush = pdcattr->hbrush;
+            pgPB->crForegroundClr = pdcattr->crForegroundClr;
+            pgPB->crBackgroundClr = pdcattr->crBackgroundClr;
+            pgPB->crBrushClr = pdcattr->crBrushClr;
+            pgPB->IcmBrushColor = pdcattr->IcmBrushColor;
+            return TRUE;
+        }
+    }
+
+    /* We could not use the batch command, call win32k */
     return NtGdiPatBlt( hdc,  nXLeft,  nYLeft,  nWidth,  nHeight,  dwRop);
 }
 
@@ -474,6 +506,8 @@ PolyPatBlt(
     UINT i;
     BOOL bResult;
     HBRUSH hbrOld;
+    PDC_ATTR pdcattr;
+    PGDIBSPPATBLT pgPPB;
 
     /* Handle meta DCs */
     if ((GDI_HANDLE_GET_TYPE(hdc) == GDILoObjType_LO_METADC16_TYPE) ||
@@ -511,7 +545,35 @@ PolyPatBlt(
         return bResult;
     }
 
-    /* FIXME some part need be done in user mode */
+    /* Get the DC attribute */
+    pdcattr = GdiGetDcAttr(hdc);
+
+    /* If the DC does not have a DIB section selected, try a batch command */
+    if (pdcattr &&
+        !(pdcattr->ulDirty_ & DC_DIBSECTION) &&
+        (nCount > 0) &&
+        (nCount <= GDIBATCHBUFSIZE / sizeof(PATRECT)))
+    {
+        pgPPB = GdiAllocBatchCommandEx(hdc, GdiBCPolyPatBlt, nCount * sizeof(PATRECT));
+        if (pgPPB)
+        {
+            pgPPB->rop4 = dwRop;
+            pgPPB->Mode = dwMode;
+            pgPPB->Count = nCount;
+
+            /* The attributes can change in user mode before the batch is
+               flushed, so take the current ones along */
+            pgPPB->crForegroundClr = pdcattr->crForegroundClr;
+            pgPPB->crBackgroundClr = pdcattr->crBackgroundClr;
+            pgPPB->crBrushClr = pdcattr->crBrushClr;
+
+            /* POLYPATBLT and PATRECT have the same layout */
+            RtlCopyMemory(pgPPB->pRect, pPoly, nCount * sizeof(PATRECT));
+            return TRUE;
+        }
+    }
+
+    /* We could not use the batch command, call win32k */
     return NtGdiPolyPatBlt(hdc, dwRop, pPoly, nCount, dwMode);
 }
 
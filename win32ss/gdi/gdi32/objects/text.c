@@ -488,6 +488,8 @@ ExtTextOutW(
     _In_ UINT cwc,
     _In_reads_opt_(cwc) const INT *lpDx)
 {
+    PDC_ATTR pdcattr;
+
     HANDLE_METADC(BOOL,
                   ExtTextOut,
                   FALSE,
@@ -500,6 +502,77 @@ ExtTextOutW(
                   cwc,
                   lpDx);
 
+    /* Get the DC attribute */
+    pdcattr = GdiGetDcAttr(hdc);
+
+    /* If the DC does not have a DIB section selected, try a batch command.
+       Updating the current position and the character and break extra
+       spacing, which the batch entry does not carry, are left to win32k. */
+    if (pdcattr &&
+        !(pdcattr->ulDirty_ & DC_DIBSECTION) &&
+        !(pdcattr->lTextAlign & TA_UPDATECP) &&
+        (pdcattr->lTextExtra == 0) &&
+        (pdcattr->lBreakExtra == 0))
+    {
+        /* The rectangle is only used with these options */
+        if (!lprc) fuOptions &= ~(ETO_OPAQUE | ETO_CLIPPED);
+
+        if (cwc == 0)
+        {
+            PGDIBSEXTTEXTOUT pgETO;
+
+            /* Nothing but the rectangle to fill */
+            pgETO = GdiAllocBatchCommand(hdc, GdiBCExtTextOut);
+            if (pgETO)
+            {
+                pgETO->Count = 0;
+                pgETO->Options = fuOptions;
+                if (lprc) pgETO->Rect = *lprc;
+                else RtlZeroMemory(&pgETO->Rect, sizeof(RECT));
+                pgETO->crBackgroundClr = pdcattr->crBackgroundClr;
+                return TRUE;
+            }
+        }
+        else if (lpString && (cwc <= GDIBATCHBUFSIZE / sizeof(WCHAR)))
+        {
+            PGDIBSTEXTOUT pgTO;
+            ULONG cjString, cjDx = 0;
+
+            /* The Dx values follow the string, aligned to an INT */
+            cjString = (cwc * sizeof(WCHAR) + sizeof(INT) - 1) & ~(sizeof(INT) - 1);
+            if (lpDx) cjDx = cwc * sizeof(INT) * ((fuOptions & ETO_PDY) ? 2 : 1);
+
+            pgTO = GdiAllocBatchCommandEx(hdc, GdiBCTextOut, cjString + cjDx);
+            if (pgTO)
+            {
+                pgTO->x = x;
+                pgTO->y = y;
+                pgTO->Options = fuOptions;
+                if (lprc) pgTO->Rect = *lprc;
+                else RtlZeroMemory(&pgTO->Rect, sizeof(RECT));
+                pgTO->iCS_CP = 0;
+                pgTO->cbCount = cwc;
+                pgTO->Size = cjDx;
+
+                /* The attributes can change in user mode before the batch is
+                   flushed, so take the current ones along */
+                pgTO->crForegroundClr = pdcattr->crForegroundClr;
+                pgTO->crBackgroundClr = pdcattr->crBackgroundClr;
+                pgTO->lmBkMode = pdcattr->lBkMode;
+                pgTO->hlfntNew = pdcattr->hlfntNew;
+                pgTO->flTextAlign = pdcattr->lTextAlign;
+
+                RtlCopyMemory(pgTO->String, lpString, cwc * sizeof(WCHAR));
+                if (lpDx)
+                {
+                    RtlCopyMemory((PUCHAR)pgTO->String + cjString, lpDx, cjDx);
+                }
+                return TRUE;
+            }
+        }
+    }
+
+    /* We could not use the batch command, call win32k */
     return NtGdiExtTextOutW(hdc,
                             x,
                             y,
@@ -24,7 +24,9 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;       /* In the LRU list, most recently used first */
+    LIST_ENTRY HashListEntry;   /* In the hash bucket */
+    SIZE_T Size;                /* Counted against the cache budget */
     int GlyphIndex;
     FT_Face Face;
     FT_BitmapGlyph BitmapGlyph;
@@ -86,10 +86,16 @@ static BOOL RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
   ASSERT(FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
+/* The glyph cache is limited by the memory it uses, not by the number of
+   glyphs, as big glyphs take far more memory than small ones */
+#define MAX_FONT_CACHE_SIZE (2 * 1024 * 1024)
+#define FONT_CACHE_HASH_BITS 10
+#define FONT_CACHE_HASH_SIZE (1 << FONT_CACHE_HASH_BITS)
 
 static LIST_ENTRY FontCacheListHead;
+static LIST_ENTRY FontCacheHashTable[FONT_CACHE_HASH_SIZE];
 static UINT FontCacheNumEntries;
+static SIZE_T FontCacheSize;
 
 static PWCHAR ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -229,9 +235,11 @@ RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
 
     FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
+    RemoveEntryList(&Entry->HashListEntry);
+    ASSERT(FontCacheSize >= Entry->Size);
+    FontCacheSize -= Entry->Size;
     ExFreePoolWithTag(Entry, TAG_FONT);
     FontCacheNumEntries--;
-    ASSERT(FontCacheNumEntries <= MAX_FONT_CACHE);
 }
 
 static void
@@ -450,11 +458,16 @@ IntLoadFontSubstList(PLIST_ENTRY pHead)
 BOOL FASTCALL
 InitFontSupport(VOID)
 {
-    ULONG ulError;
+    ULONG ulError, i;
 
     InitializeListHead(&FontListHead);
     InitializeListHead(&FontCacheListHead);
+    for (i = 0; i < FONT_CACHE_HASH_SIZE; i++)
+    {
+        InitializeListHead(&FontCacheHashTable[i]);
+    }
     FontCacheNumEntries = 0;
+    FontCacheSize = 0;
     /* Fast Mutexes must be allocated from non paged pool */
     FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (FontListLock == NULL)
@@ -2603,6 +2616,26 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
+/* The transformation isn't hashed, as equal FLOATOBJs don't need to have the
+   same bits. Text drawn at the same size with different transformations is
+   rare enough for the few collisions not to matter. */
+static PLIST_ENTRY
+FontCacheBucket(
+    FT_Face Face,
+    INT GlyphIndex,
+    INT Height,
+    FT_Render_Mode RenderMode)
+{
+    ULONG Hash;
+
+    Hash = (ULONG)((ULONG_PTR)Face >> 4);
+    Hash = (Hash ^ (ULONG)GlyphIndex) * 0x9E3779B1;
+    Hash = (Hash ^ (ULONG)Height) * 0x9E3779B1;
+    Hash ^= (ULONG)RenderMode;
+
+    return &FontCacheHashTable[(Hash * 0x9E3779B1) >> (32 - FONT_CACHE_HASH_BITS)];
+}
+
 FT_BitmapGlyph APIENTRY
 ftGdiGlyphCacheGet(
     FT_Face Face,
@@ -2611,32 +2644,29 @@ ftGdiGlyphCacheGet(
     FT_Render_Mode RenderMode,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
+    PLIST_ENTRY Bucket, CurrentEntry;
     PFONT_CACHE_ENTRY FontEntry;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    CurrentEntry = FontCacheListHead.Flink;
-    while (CurrentEntry != &FontCacheListHead)
+    Bucket = FontCacheBucket(Face, GlyphIndex, Height, RenderMode);
+    for (CurrentEntry = Bucket->Flink; CurrentEntry != Bucket; CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, HashListEntry);
         if ((FontEntry->Face == Face) &&
             (FontEntry->GlyphIndex == GlyphIndex) &&
             (FontEntry->Height == Height) &&
             (FontEntry->RenderMode == RenderMode) &&
             (SameScaleMatrix(&FontEntry->mxWorldToDevice, pmx)))
-            break;
-        CurrentEntry = CurrentEntry->Flink;
-    }
-
-    if (CurrentEntry == &FontCacheListHead)
-    {
-        return NULL;
+        {
+            /* Move it to the front of the LRU list */
+            RemoveEntryList(&FontEntry->ListEntry);
+            InsertHeadList(&FontCacheListHead, &FontEntry->ListEntry);
+            return FontEntry->BitmapGlyph;
+        }
     }
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&FontCacheListHead, CurrentEntry);
-    return FontEntry->BitmapGlyph;
+    return NULL;
 }
 
 /* no cache */
@@ -2741,12 +2771,20 @@ ftGdiGlyphCacheSet(
     NewEntry->Height = Height;
     NewEntry->RenderMode = RenderMode;
     NewEntry->mxWorldToDevice = *pmx;
+    NewEntry->Size = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                     abs(AlignedBitmap.pitch) * AlignedBitmap.rows;
 
     InsertHeadList(&FontCacheListHead, &NewEntry->ListEntry);
-    if (++FontCacheNumEntries > MAX_FONT_CACHE)
+    InsertHeadList(FontCacheBucket(Face, GlyphIndex, Height, RenderMode), &NewEntry->HashListEntry);
+    FontCacheNumEntries++;
+    FontCacheSize += NewEntry->Size;
+
+    /* Throw out the least recently used glyphs, but never the one we've just
+       rendered, as the caller is about to use it */
+    while (FontCacheSize > MAX_FONT_CACHE_SIZE &&
+           FontCacheListHead.Blink != &NewEntry->ListEntry)
     {
-        NewEntry = CONTAINING_RECORD(FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
-        RemoveCachedEntry(NewEntry);
+        RemoveCachedEntry(CONTAINING_RECORD(FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry));
     }
 
     return BitmapGlyph;
@@ -59,15 +59,96 @@ SynchonizeDriver(FLONG Flags)
   return;
 }
 
+//
+// Attributes of a batched drawing command. gdi32 changes colors, modes, the
+// brush and the font in the DC_ATTR without calling us, so by the time the
+// batch is flushed they may already be newer than the command.
+//
+typedef struct _GDIBATCHATTR
+{
+  HANDLE hbrush;
+  HANDLE hlfntNew;
+  COLORREF crForegroundClr;
+  COLORREF crBackgroundClr;
+  COLORREF crBrushClr;
+  LONG lBkMode;
+  LONG lTextAlign;
+} GDIBATCHATTR, *PGDIBATCHATTR;
+
+static
+VOID
+FASTCALL
+GdiInitBatchAttr(PDC_ATTR pdcattr, PGDIBATCHATTR pAttr)
+{
+  pAttr->hbrush = pdcattr->hbrush;
+  pAttr->hlfntNew = pdcattr->hlfntNew;
+  pAttr->crForegroundClr = pdcattr->crForegroundClr;
+  pAttr->crBackgroundClr = pdcattr->crBackgroundClr;
+  pAttr->crBrushClr = pdcattr->crBrushClr;
+  pAttr->lBkMode = pdcattr->lBkMode;
+  pAttr->lTextAlign = pdcattr->lTextAlign;
+}
+
+//
+// Exchange the attributes of the DC with the ones of the command, marking
+// whatever changed as dirty. Calling it a second time restores the DC.
+//
+static
+VOID
+FASTCALL
+GdiSwapBatchAttr(PDC_ATTR pdcattr, PGDIBATCHATTR pAttr)
+{
+  GDIBATCHATTR Old;
+
+  GdiInitBatchAttr(pdcattr, &Old);
+
+  if (pAttr->hbrush != Old.hbrush)
+  {
+     pdcattr->hbrush = pAttr->hbrush;
+     pdcattr->ulDirty_ |= DC_BRUSH_DIRTY;
+  }
+
+  if (pAttr->hlfntNew != Old.hlfntNew)
+  {
+     pdcattr->hlfntNew = pAttr->hlfntNew;
+     pdcattr->ulDirty_ |= DIRTY_CHARSET;
+  }
+
+  if (pAttr->crForegroundClr != Old.crForegroundClr)
+  {
+     pdcattr->crForegroundClr = pAttr->crForegroundClr;
+     pdcattr->ulDirty_ |= (DIRTY_TEXT|DIRTY_LINE|DIRTY_FILL);
+  }
+
+  if (pAttr->crBackgroundClr != Old.crBackgroundClr)
+  {
+     pdcattr->crBackgroundClr = pAttr->crBackgroundClr;
+     pdcattr->ulDirty_ |= (DIRTY_BACKGROUND|DIRTY_LINE|DIRTY_FILL);
+  }
+
+  if (pAttr->crBrushClr != Old.crBrushClr)
+  {
+     pdcattr->crBrushClr = pAttr->crBrushClr;
+     pdcattr->ulDirty_ |= DIRTY_FILL;
+  }
+
+  pdcattr->lBkMode = pAttr->lBkMode;
+  pdcattr->jBkMode = (BYTE)pAttr->lBkMode;
+  pdcattr->lTextAlign = pAttr->lTextAlign;
+
+  *pAttr = Old;
+}
+
 //
 // Process the batch.
 //
 ULONG
 FASTCALL
-GdiFlushUserBatch(PDC dc, PGDIBATCHHDR pHdr)
+GdiFlushUserBatch(PDC dc, PGDIBATCHHDR pHdr, ULONG cjBuffer)
 {
   ULONG Cmd = 0, Size = 0;
   PDC_ATTR pdcattr = NULL;
+  GDIBATCHATTR Attr;
 
   if (dc)
   {
@@ -86,19 +167,175 @@ GdiFlushUserBatch(PDC dc, PGDIBATCHHDR pHdr)
   }
   _SEH2_END;
 
+  // Entries must not overlap the next one or run off the end of the buffer.
+  if (Size < sizeof(GDIBATCHHDR) || Size > cjBuffer)
+  {
+     DPRINT1("WARNING! GdiBatch bad entry size %lu!\n", Size);
+     return 0;
+  }
+
   switch(Cmd)
   {
      case GdiBCPatBlt:
+     {
+        PGDIBSPATBLT pgDPB;
+        DWORD dwRop;
+
+        if (!dc || Size < sizeof(GDIBSPATBLT)) break;
+        pgDPB = (PGDIBSPATBLT) pHdr;
+
+        /* Convert the ROP3 to a ROP4, a source is not possible */
+        dwRop = MAKEROP4(pgDPB->dwRop & 0xFF0000, pgDPB->dwRop);
+        if (WIN32_ROP4_USES_SOURCE(dwRop)) break;
+
+        /* Nothing to do for an empty memory or info DC */
+        if (!dc->dclevel.pSurface) break;
+
+        GdiInitBatchAttr(pdcattr, &Attr);
+        Attr.hbrush = pgDPB->hbrush;
+        Attr.crForegroundClr = pgDPB->crForegroundClr;
+        Attr.crBackgroundClr = pgDPB->crBackgroundClr;
+        Attr.crBrushClr = pgDPB->crBrushClr;
+        GdiSwapBatchAttr(pdcattr, &Attr);
+
+        if (pdcattr->ulDirty_ & (DIRTY_FILL | DC_BRUSH_DIRTY))
+           DC_vUpdateFillBrush(dc);
+
+        IntPatBlt(dc,
+                  pgDPB->nXLeft,
+                  pgDPB->nYLeft,
+                  pgDPB->nWidth,
+                  pgDPB->nHeight,
+                  dwRop,
+                  &dc->eboFill);
+
+        GdiSwapBatchAttr(pdcattr, &Attr);
         break;
+     }
 
      case GdiBCPolyPatBlt:
+     {
+        PGDIBSPPATBLT pgDPB;
+        PPATRECT pRect;
+        PBRUSH pbrush;
+        EBRUSHOBJ eboFill;
+        ULONG Count;
+
+        if (!dc || Size < FIELD_OFFSET(GDIBSPPATBLT, pRect)) break;
+        pgDPB = (PGDIBSPPATBLT) pHdr;
+
+        Count = pgDPB->Count;
+        if (Count > (Size - FIELD_OFFSET(GDIBSPPATBLT, pRect)) / sizeof(PATRECT)) break;
+
+        if (!dc->dclevel.pSurface) break;
+
+        GdiInitBatchAttr(pdcattr, &Attr);
+        Attr.crForegroundClr = pgDPB->crForegroundClr;
+        Attr.crBackgroundClr = pgDPB->crBackgroundClr;
+        Attr.crBrushClr = pgDPB->crBrushClr;
+        GdiSwapBatchAttr(pdcattr, &Attr);
+
+        /* Same as IntGdiPolyPatBlt, but the DC is already locked */
+        for (pRect = pgDPB->pRect; Count > 0; Count--, pRect++)
+        {
+           pbrush = BRUSH_ShareLockBrush(pRect->hBrush);
+           if (pbrush != NULL)
+           {
+              EBRUSHOBJ_vInitFromDC(&eboFill, pbrush, dc);
+
+              IntPatBlt(dc,
+                        pRect->r.left,
+                        pRect->r.top,
+                        pRect->r.right,
+                        pRect->r.bottom,
+                        pgDPB->rop4,
+                        &eboFill);
+
+              EBRUSHOBJ_vCleanup(&eboFill);
+              BRUSH_ShareUnlockBrush(pbrush);
+           }
+        }
+
+        GdiSwapBatchAttr(pdcattr, &Attr);
         break;
+     }
 
      case GdiBCTextOut:
+     {
+        PGDIBSTEXTOUT pgDTO;
+        RECTL Rect;
+        UINT Options, Count;
+        ULONG cjString, cjDx;
+        LPINT Dx = NULL;
+
+        if (!dc || Size < FIELD_OFFSET(GDIBSTEXTOUT, String)) break;
+        pgDTO = (PGDIBSTEXTOUT) pHdr;
+
+        /* The string and the Dx values must be within the entry */
+        Options = pgDTO->Options;
+        Count = pgDTO->cbCount;
+        cjDx = pgDTO->Size;
+        if (Count > GDIBATCHBUFSIZE / sizeof(WCHAR)) break;
+        cjString = ALIGN_UP_BY(Count * sizeof(WCHAR), sizeof(INT));
+        if (cjDx)
+        {
+           if (cjDx != Count * sizeof(INT) * ((Options & ETO_PDY) ? 2 : 1)) break;
+           Dx = (LPINT)((PUCHAR)pgDTO->String + cjString);
+        }
+        if (FIELD_OFFSET(GDIBSTEXTOUT, String) + cjString + cjDx > Size) break;
+
+        GdiInitBatchAttr(pdcattr, &Attr);
+        Attr.hlfntNew = pgDTO->hlfntNew;
+        Attr.crForegroundClr = pgDTO->crForegroundClr;
+        Attr.crBackgroundClr = pgDTO->crBackgroundClr;
+        Attr.lBkMode = pgDTO->lmBkMode;
+        Attr.lTextAlign = pgDTO->flTextAlign;
+        GdiSwapBatchAttr(pdcattr, &Attr);
+
+        /* GreExtTextOutW converts the rectangle in place.
+           It locks the DC again, which is fine for its owner thread. */
+        Rect = *(PRECTL)&pgDTO->Rect;
+        GreExtTextOutW(dc->BaseObject.hHmgr,
+                       pgDTO->x,
+                       pgDTO->y,
+                       Options,
+                       &Rect,
+                       pgDTO->String,
+                       Count,
+                       Dx,
+                       pgDTO->iCS_CP);
+
+        GdiSwapBatchAttr(pdcattr, &Attr);
         break;
+     }
 
      case GdiBCExtTextOut:
+     {
+        PGDIBSEXTTEXTOUT pgDETO;
+        RECTL Rect;
+
+        if (!dc || Size < sizeof(GDIBSEXTTEXTOUT)) break;
+        pgDETO = (PGDIBSEXTTEXTOUT) pHdr;
+
+        /* This one has no string, it only fills the rectangle */
+        GdiInitBatchAttr(pdcattr, &Attr);
+        Attr.crBackgroundClr = pgDETO->crBackgroundClr;
+        GdiSwapBatchAttr(pdcattr, &Attr);
+
+        Rect = *(PRECTL)&pgDETO->Rect;
+        GreExtTextOutW(dc->BaseObject.hHmgr,
+                       0,
+                       0,
+                       pgDETO->Options,
+                       &Rect,
+                       NULL,
+                       0,
+                       NULL,
+                       0);
+
+        GdiSwapBatchAttr(pdcattr, &Attr);
         break;
+     }
 
      case GdiBCSetBrushOrg:
      {
@@ -180,6 +417,7 @@ NtGdiFlushUserBatch(VOID)
     if (hDC || GdiBatchCount)
     {
       PCHAR pHdr = (PCHAR)&pTeb->GdiTebBatch.Buffer[0];
+      PCHAR pEnd = pHdr + GDIBATCHBUFSIZE;
       PDC pDC = NULL;
 
       if (GDI_HANDLE_GET_TYPE(hDC) == GDILoObjType_LO_DC_TYPE && GreIsHandleValid(hDC))
@@ -192,7 +430,7 @@ NtGdiFlushUserBatch(VOID)
        {
            ULONG Size;
            // Process Gdi Batch!
-           Size = GdiFlushUserBatch(pDC, (PGDIBATCHHDR) pHdr);
+           Size = GdiFlushUserBatch(pDC, (PGDIBATCHHDR) pHdr, (ULONG)(pEnd - pHdr));
            if (!Size) break;
            pHdr += Size;
        }
@@ -61,6 +61,15 @@ GreMoveTo( HDC hdc,
 
 /* Shape functions */
 
+BOOL FASTCALL
+IntPatBlt(PDC pdc,
+          INT XLeft,
+          INT YLeft,
+          INT Width,
+          INT Height,
+          DWORD dwRop3,
+          PEBRUSHOBJ pebo);
+
 BOOL
 NTAPI
 GreGradientFill(
@@ -466,10 +466,6 @@ typedef struct _GDIBSPATBLT
   COLORREF crBackgroundClr;
   COLORREF crBrushClr;
   INT IcmBrushColor;
-  POINTL ptlViewportOrg;
-  ULONG ulForegroundClr;
-  ULONG ulBackgroundClr;
-  ULONG ulBrushClr;
 } GDIBSPATBLT, *PGDIBSPATBLT;
 
 /* FIXME: this should go to some "public" GDI32 header */
@@ -488,10 +484,6 @@ typedef struct _GDIBSPPATBLT
   COLORREF crForegroundClr;
   COLORREF crBackgroundClr;
   COLORREF crBrushClr;
-  ULONG ulForegroundClr;
-  ULONG ulBackgroundClr;
-  ULONG ulBrushClr;
-  POINTL ptlViewportOrg;
   PATRECT pRect[1]; // POLYPATBLT
 } GDIBSPPATBLT, *PGDIBSPPATBLT;
 
@@ -501,18 +493,15 @@ typedef struct _GDIBSTEXTOUT
   COLORREF crForegroundClr;
   COLORREF crBackgroundClr;
   LONG lmBkMode;
-  ULONG ulForegroundClr;
-  ULONG ulBackgroundClr;
   int x;
   int y;
   UINT Options;
   RECT Rect;
   DWORD iCS_CP;
-  UINT cbCount;
-  UINT Size;
+  UINT cbCount; // Number of characters in String
+  UINT Size;    // Size of the Dx values following the INT aligned String
   HANDLE hlfntNew;
   FLONG flTextAlign;
-  POINTL ptlViewportOrg;
   WCHAR String[2];
 } GDIBSTEXTOUT, *PGDIBSTEXTOUT;
 
@@ -522,8 +511,7 @@ typedef struct _GDIBSEXTTEXTOUT
   UINT Count;
   UINT Options;
   RECT Rect;
-  POINTL ptlViewportOrg;
-  ULONG ulBackgroundClr;
+  COLORREF crBackgroundClr;
 } GDIBSEXTTEXTOUT, *PGDIBSEXTTEXTOUT;
 
 typedef struct _GDIBSSETBRHORG